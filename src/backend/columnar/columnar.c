@@ -24,6 +24,7 @@
 #include "citus_version.h"
 
 #include "columnar/columnar.h"
+#include "columnar/columnar_chunk_cache.h"
 #include "columnar/columnar_tableam.h"
 
 /* Default values for option parameters */
@@ -42,6 +43,10 @@ int columnar_compression = DEFAULT_COMPRESSION_TYPE;
 int columnar_stripe_row_limit = DEFAULT_STRIPE_ROW_COUNT;
 int columnar_chunk_group_row_limit = DEFAULT_CHUNK_ROW_COUNT;
 int columnar_compression_level = 3;
+bool columnar_enable_vector_filter = true;
+bool columnar_enable_column_encodings = false;
+double columnar_vacuum_rewrite_threshold = 0.2;
+int columnar_chunk_cache_size = 0;
 
 static const struct config_enum_entry columnar_compression_options[] =
 {
@@ -61,6 +66,7 @@ columnar_init(void)
 {
 	columnar_init_gucs();
 	columnar_tableam_init();
+	InitializeColumnarChunkCache();
 }
 
 
@@ -79,6 +85,24 @@ columnar_init_gucs()
 							 NULL,
 							 NULL);
 
+	DefineCustomIntVariable("columnar.chunk_cache_size",
+							"Sets the size of the cache of decompressed column "
+							"chunks that is shared between the backends.",
+							gettext_noop("Scans look up the compressed chunks they read "
+										 "in this cache before decompressing them. "
+										 "Setting this to 0 disables the cache. The cache "
+										 "is only available if citus_columnar is loaded "
+										 "via shared_preload_libraries."),
+							&columnar_chunk_cache_size,
+							0,
+							0,
+							INT_MAX / 1024,
+							PGC_POSTMASTER,
+							GUC_UNIT_KB,
+							NULL,
+							NULL,
+							NULL);
+
 	DefineCustomIntVariable("columnar.compression_level",
 							"Compression level to be used with zstd.",
 							NULL,
@@ -94,7 +118,10 @@ columnar_init_gucs()
 
 	DefineCustomIntVariable("columnar.stripe_row_limit",
 							"Maximum number of tuples per stripe.",
-							NULL,
+							"Every stripe reserves this many row numbers. Before "
+							"PostgreSQL 18, bitmap heap scans are not used on "
+							"tables that reserved more than about 38 million row "
+							"numbers, unless effective_io_concurrency is 0.",
 							&columnar_stripe_row_limit,
 							DEFAULT_STRIPE_ROW_COUNT,
 							STRIPE_ROW_COUNT_MINIMUM,
@@ -117,6 +144,51 @@ columnar_init_gucs()
 							NULL,
 							NULL,
 							NULL);
+
+	DefineCustomBoolVariable("columnar.enable_column_encodings",
+							 "Enables lightweight encodings of column chunks.",
+							 gettext_noop("When enabled, the values of each column chunk "
+										  "that is written are dictionary, run-length, "
+										  "delta or frame-of-reference encoded before they "
+										  "are compressed, if that makes them smaller. "
+										  "Older versions of columnar can't read encoded "
+										  "chunks."),
+							 &columnar_enable_column_encodings,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.enable_vector_filter",
+							 "Enables evaluating pushed-down quals over whole "
+							 "column vectors before rows are returned.",
+							 NULL,
+							 &columnar_enable_vector_filter,
+							 true,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomRealVariable("columnar.vacuum_rewrite_threshold",
+							 "Fraction of deleted rows above which VACUUM rewrites "
+							 "a stripe.",
+							 gettext_noop("VACUUM rewrites the live rows of the stripes "
+										  "whose fraction of deleted rows is at least this "
+										  "value into new stripes. Setting this to 0 "
+										  "disables rewriting stripes."),
+							 &columnar_vacuum_rewrite_threshold,
+							 0.2,
+							 0.0,
+							 1.0,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
 }
 
 
@@ -0,0 +1,174 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_bloom_filter.c
+ *
+ * This file contains the bloom filters that columnar optionally keeps for the
+ * column chunks of the columns listed in the bloom_filter_columns option. The
+ * bloom filter of a chunk is built from the 64-bit hashes of its non-NULL
+ * values, computed with the extended hash function of the column's default
+ * hash operator class. At read time, a chunk can be skipped if none of the
+ * values that an equality qual compares the column against are in the bloom
+ * filter.
+ *
+ * A bloom filter is stored as a bytea, whose first byte is the number of hash
+ * functions, followed by the bits of the filter. We derive the hash functions
+ * from the two halves of the 64-bit hash using double hashing.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "utils/typcache.h"
+#include "utils/varlena.h"
+
+#include "columnar/columnar_bloom_filter.h"
+
+/* about 1% false positive rate when using 7 hash functions */
+#define BLOOM_FILTER_BITS_PER_VALUE 10
+#define BLOOM_FILTER_HASH_FUNCTION_COUNT 7
+#define BLOOM_FILTER_MIN_BITS 64
+#define BLOOM_FILTER_HEADER_SIZE 1
+#define BLOOM_FILTER_HASH_SEED 0
+
+
+static uint64 BloomFilterBitIndex(uint64 hash, uint32 hashFunctionIndex,
+								  uint64 bitCount);
+
+
+/*
+ * ParseBloomFilterColumnList parses the value of the bloom_filter_columns
+ * option, which is a comma-separated list of column names, and returns the
+ * list of column names.
+ */
+List *
+ParseBloomFilterColumnList(const char *bloomFilterColumns)
+{
+	List *columnNameList = NIL;
+	char *rawString = pstrdup(bloomFilterColumns);
+
+	if (!SplitIdentifierString(rawString, ',', &columnNameList))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("invalid list syntax for columnar option "
+							   "\"bloom_filter_columns\"")));
+	}
+
+	return columnNameList;
+}
+
+
+/*
+ * BloomFilterHashFunctionOrNull returns the extended hash function of the
+ * default hash operator class of the given type, or NULL if the type doesn't
+ * have one.
+ */
+FmgrInfo *
+BloomFilterHashFunctionOrNull(Oid typeId)
+{
+	TypeCacheEntry *typeEntry = lookup_type_cache(typeId,
+												  TYPECACHE_HASH_EXTENDED_PROC_FINFO);
+	if (!OidIsValid(typeEntry->hash_extended_proc))
+	{
+		return NULL;
+	}
+
+	return &typeEntry->hash_extended_proc_finfo;
+}
+
+
+/*
+ * BloomFilterHashDatum returns the hash of the given non-NULL value to be
+ * added to, or to be looked up in a bloom filter.
+ */
+uint64
+BloomFilterHashDatum(FmgrInfo *hashFunction, Oid collation, Datum value)
+{
+	Datum hashDatum = FunctionCall2Coll(hashFunction, collation, value,
+										UInt64GetDatum(BLOOM_FILTER_HASH_SEED));
+
+	return DatumGetUInt64(hashDatum);
+}
+
+
+/*
+ * BuildBloomFilter builds a bloom filter that contains the given hashes. The
+ * size of the bloom filter is proportional to the number of hashes.
+ */
+bytea *
+BuildBloomFilter(uint64 *hashArray, uint32 hashCount)
+{
+	uint64 bitCount = Max((uint64) hashCount * BLOOM_FILTER_BITS_PER_VALUE,
+						  BLOOM_FILTER_MIN_BITS);
+	uint64 byteCount = (bitCount + 7) / 8;
+	bitCount = byteCount * 8;
+
+	Size bloomFilterSize = VARHDRSZ + BLOOM_FILTER_HEADER_SIZE + byteCount;
+	bytea *bloomFilter = palloc0(bloomFilterSize);
+	SET_VARSIZE(bloomFilter, bloomFilterSize);
+
+	uint8 *bloomFilterData = (uint8 *) VARDATA(bloomFilter);
+	bloomFilterData[0] = BLOOM_FILTER_HASH_FUNCTION_COUNT;
+
+	uint8 *bits = bloomFilterData + BLOOM_FILTER_HEADER_SIZE;
+	for (uint32 hashIndex = 0; hashIndex < hashCount; hashIndex++)
+	{
+		for (uint32 functionIndex = 0;
+			 functionIndex < BLOOM_FILTER_HASH_FUNCTION_COUNT;
+			 functionIndex++)
+		{
+			uint64 bitIndex = BloomFilterBitIndex(hashArray[hashIndex], functionIndex,
+												  bitCount);
+			bits[bitIndex / 8] |= (1 << (bitIndex % 8));
+		}
+	}
+
+	return bloomFilter;
+}
+
+
+/*
+ * BloomFilterMightContain returns false if the value with the given hash is
+ * certainly not in the bloom filter, and true if it might be.
+ */
+bool
+BloomFilterMightContain(bytea *bloomFilter, uint64 hash)
+{
+	uint64 byteCount = VARSIZE_ANY_EXHDR(bloomFilter);
+	if (byteCount <= BLOOM_FILTER_HEADER_SIZE)
+	{
+		/* not a bloom filter we know of, don't skip anything */
+		return true;
+	}
+
+	uint8 *bloomFilterData = (uint8 *) VARDATA_ANY(bloomFilter);
+	uint32 hashFunctionCount = bloomFilterData[0];
+	uint8 *bits = bloomFilterData + BLOOM_FILTER_HEADER_SIZE;
+	uint64 bitCount = (byteCount - BLOOM_FILTER_HEADER_SIZE) * 8;
+
+	for (uint32 functionIndex = 0; functionIndex < hashFunctionCount; functionIndex++)
+	{
+		uint64 bitIndex = BloomFilterBitIndex(hash, functionIndex, bitCount);
+		if ((bits[bitIndex / 8] & (1 << (bitIndex % 8))) == 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * BloomFilterBitIndex returns the bit that the given hash function maps the
+ * given hash to.
+ */
+static uint64
+BloomFilterBitIndex(uint64 hash, uint32 hashFunctionIndex, uint64 bitCount)
+{
+	uint64 firstHash = (uint32) hash;
+	uint64 secondHash = (uint32) (hash >> 32) | 1;
+
+	return (firstHash + hashFunctionIndex * secondHash) % bitCount;
+}
@@ -0,0 +1,537 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_chunk_cache.c
+ *
+ * This file contains the cache of decompressed column chunks that is shared
+ * between the backends. Without it, every scan reads the compressed value
+ * streams of the chunks it needs through ColumnarStorageRead and decompresses
+ * them again, even when many concurrent queries read the same stripes.
+ *
+ * When columnar.chunk_cache_size is set and citus_columnar is loaded via
+ * shared_preload_libraries, the decompressed value stream of each compressed
+ * chunk that a scan reads is stored in a dynamic shared memory area, keyed by
+ * the storage id, stripe id, column and chunk group of the chunk. Stripes are
+ * never modified and storage ids and stripe ids are never reused, so cached
+ * chunks never need to be invalidated; the chunks of dropped or rewritten
+ * tables are simply evicted eventually.
+ *
+ * Chunks are evicted using the clock algorithm: every lookup bumps the usage
+ * count of the chunk, and when the cache is full we sweep over the chunks,
+ * decrementing their usage counts and evicting the ones that reached zero.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "access/htup_details.h"
+#include "lib/dshash.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/dsa.h"
+#include "utils/memutils.h"
+
+#include "pg_version_constants.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_chunk_cache.h"
+
+
+/* usage count that a lookup bumps a chunk to at most */
+#define CHUNK_CACHE_MAX_USAGE_COUNT 5
+
+/* number of columns returned by columnar.chunk_cache_stats() */
+#define CHUNK_CACHE_STATS_COLUMNS 5
+
+
+/*
+ * ColumnarChunkCacheData is stored in the main shared memory segment and
+ * allows backends to find the dynamic shared memory area of the cache.
+ */
+typedef struct ColumnarChunkCacheData
+{
+	int trancheId;
+	char *lockTrancheName;
+
+	/* protects the creation of the area and the hash */
+	LWLock lock;
+
+	dsa_handle areaHandle;
+	dshash_table_handle hashHandle;
+
+	/* total size of the cached chunks */
+	pg_atomic_uint64 cachedBytes;
+	pg_atomic_uint64 cachedChunks;
+
+	pg_atomic_uint64 hits;
+	pg_atomic_uint64 misses;
+	pg_atomic_uint64 evictions;
+} ColumnarChunkCacheData;
+
+
+/* storage ids are only unique within a database */
+typedef struct ColumnarChunkCacheKey
+{
+	Oid databaseId;
+	uint32 columnIndex;
+	uint64 storageId;
+	uint64 stripeId;
+	uint64 chunkGroupIndex;
+} ColumnarChunkCacheKey;
+
+
+/* ColumnarChunkCacheEntry points to the decompressed value stream of a chunk */
+typedef struct ColumnarChunkCacheEntry
+{
+	ColumnarChunkCacheKey key;
+
+	pg_atomic_uint32 usageCount;
+
+	Size length;
+	dsa_pointer data;
+} ColumnarChunkCacheEntry;
+
+
+static ColumnarChunkCacheData *ColumnarChunkCacheState = NULL;
+static dsa_area *ColumnarChunkCacheArea = NULL;
+static dshash_table *ColumnarChunkCacheHash = NULL;
+
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+
+static void ColumnarChunkCacheShmemRequest(void);
+static void ColumnarChunkCacheShmemInit(void);
+static bool AttachColumnarChunkCache(void);
+static dshash_parameters ColumnarChunkCacheHashParameters(void);
+static void InitColumnarChunkCacheKey(ColumnarChunkCacheKey *key, uint64 storageId,
+									  uint64 stripeId, uint32 columnIndex,
+									  uint64 chunkGroupIndex);
+static Size ColumnarChunkCacheLimit(void);
+static void EvictColumnarChunks(Size requiredBytes);
+
+
+/*
+ * InitializeColumnarChunkCache sets up the shared memory hooks of the chunk
+ * cache. The cache needs shared memory, so it is only enabled if
+ * citus_columnar is loaded via shared_preload_libraries.
+ */
+void
+InitializeColumnarChunkCache(void)
+{
+	if (!process_shared_preload_libraries_in_progress ||
+		columnar_chunk_cache_size <= 0)
+	{
+		return;
+	}
+
+	prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = ColumnarChunkCacheShmemRequest;
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = ColumnarChunkCacheShmemInit;
+}
+
+
+/*
+ * ColumnarChunkCacheShmemRequest requests the part of the chunk cache that
+ * lives in the main shared memory segment. The chunks themselves are
+ * allocated in dynamic shared memory.
+ */
+static void
+ColumnarChunkCacheShmemRequest(void)
+{
+	if (prev_shmem_request_hook != NULL)
+	{
+		prev_shmem_request_hook();
+	}
+
+	RequestAddinShmemSpace(sizeof(ColumnarChunkCacheData));
+}
+
+
+/*
+ * ColumnarChunkCacheShmemInit initializes the shared memory that is used to
+ * find the chunk cache.
+ */
+static void
+ColumnarChunkCacheShmemInit(void)
+{
+	bool alreadyInitialized = false;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	ColumnarChunkCacheState =
+		(ColumnarChunkCacheData *) ShmemInitStruct("Columnar Chunk Cache Data",
+												   sizeof(ColumnarChunkCacheData),
+												   &alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		ColumnarChunkCacheState->trancheId = LWLockNewTrancheId();
+		ColumnarChunkCacheState->lockTrancheName = "Columnar Chunk Cache Tranche";
+		LWLockRegisterTranche(ColumnarChunkCacheState->trancheId,
+							  ColumnarChunkCacheState->lockTrancheName);
+
+		LWLockInitialize(&ColumnarChunkCacheState->lock,
+						 ColumnarChunkCacheState->trancheId);
+
+		ColumnarChunkCacheState->areaHandle = DSA_HANDLE_INVALID;
+		ColumnarChunkCacheState->hashHandle = DSHASH_HANDLE_INVALID;
+
+		pg_atomic_init_u64(&ColumnarChunkCacheState->cachedBytes, 0);
+		pg_atomic_init_u64(&ColumnarChunkCacheState->cachedChunks, 0);
+		pg_atomic_init_u64(&ColumnarChunkCacheState->hits, 0);
+		pg_atomic_init_u64(&ColumnarChunkCacheState->misses, 0);
+		pg_atomic_init_u64(&ColumnarChunkCacheState->evictions, 0);
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * ColumnarChunkCacheEnabled returns whether the chunk cache can be used in
+ * this backend.
+ */
+bool
+ColumnarChunkCacheEnabled(void)
+{
+	return ColumnarChunkCacheState != NULL;
+}
+
+
+/*
+ * ColumnarChunkCacheLookup returns a copy of the decompressed value stream of
+ * the given chunk if it is in the cache, or NULL otherwise.
+ */
+StringInfo
+ColumnarChunkCacheLookup(uint64 storageId, uint64 stripeId, uint32 columnIndex,
+						 uint64 chunkGroupIndex)
+{
+	ColumnarChunkCacheKey key;
+
+	if (!AttachColumnarChunkCache())
+	{
+		return NULL;
+	}
+
+	InitColumnarChunkCacheKey(&key, storageId, stripeId, columnIndex,
+							  chunkGroupIndex);
+
+	ColumnarChunkCacheEntry *entry = dshash_find(ColumnarChunkCacheHash, &key, false);
+	if (entry == NULL)
+	{
+		pg_atomic_fetch_add_u64(&ColumnarChunkCacheState->misses, 1);
+		return NULL;
+	}
+
+	StringInfo valueBuffer = makeStringInfo();
+	enlargeStringInfo(valueBuffer, entry->length);
+	memcpy(valueBuffer->data, dsa_get_address(ColumnarChunkCacheArea, entry->data),
+		   entry->length);
+	valueBuffer->len = entry->length;
+	valueBuffer->data[valueBuffer->len] = '\0';
+
+	/* concurrent lookups might lose an increment, which is fine for a hint */
+	uint32 usageCount = pg_atomic_read_u32(&entry->usageCount);
+	if (usageCount < CHUNK_CACHE_MAX_USAGE_COUNT)
+	{
+		pg_atomic_write_u32(&entry->usageCount, usageCount + 1);
+	}
+
+	dshash_release_lock(ColumnarChunkCacheHash, entry);
+
+	pg_atomic_fetch_add_u64(&ColumnarChunkCacheState->hits, 1);
+
+	return valueBuffer;
+}
+
+
+/*
+ * ColumnarChunkCacheInsert stores the decompressed value stream of the given
+ * chunk in the cache, evicting other chunks if the cache is full. Chunks
+ * that don't fit into the cache are silently not cached.
+ */
+void
+ColumnarChunkCacheInsert(uint64 storageId, uint64 stripeId, uint32 columnIndex,
+						 uint64 chunkGroupIndex, StringInfo valueBuffer)
+{
+	ColumnarChunkCacheKey key;
+	bool found = false;
+	Size length = valueBuffer->len;
+
+	if (!AttachColumnarChunkCache() || length == 0 ||
+		length > ColumnarChunkCacheLimit())
+	{
+		return;
+	}
+
+	if (pg_atomic_read_u64(&ColumnarChunkCacheState->cachedBytes) + length >
+		ColumnarChunkCacheLimit())
+	{
+		EvictColumnarChunks(length);
+	}
+
+	dsa_pointer data = dsa_allocate_extended(ColumnarChunkCacheArea, length,
+											 DSA_ALLOC_NO_OOM);
+	if (!DsaPointerIsValid(data))
+	{
+		return;
+	}
+
+	memcpy(dsa_get_address(ColumnarChunkCacheArea, data), valueBuffer->data, length);
+
+	InitColumnarChunkCacheKey(&key, storageId, stripeId, columnIndex,
+							  chunkGroupIndex);
+
+	ColumnarChunkCacheEntry *entry =
+		dshash_find_or_insert(ColumnarChunkCacheHash, &key, &found);
+
+	if (found)
+	{
+		/* another backend cached the same chunk in the meantime */
+		dshash_release_lock(ColumnarChunkCacheHash, entry);
+		dsa_free(ColumnarChunkCacheArea, data);
+		return;
+	}
+
+	pg_atomic_init_u32(&entry->usageCount, 1);
+	entry->length = length;
+	entry->data = data;
+
+	dshash_release_lock(ColumnarChunkCacheHash, entry);
+
+	pg_atomic_fetch_add_u64(&ColumnarChunkCacheState->cachedBytes, length);
+	pg_atomic_fetch_add_u64(&ColumnarChunkCacheState->cachedChunks, 1);
+}
+
+
+/*
+ * EvictColumnarChunks sweeps over the cached chunks until there is enough
+ * space for requiredBytes more, decrementing the usage counts of the chunks
+ * and evicting the ones whose usage count is zero. Since a chunk's usage count
+ * is at most CHUNK_CACHE_MAX_USAGE_COUNT, the cache is empty after that many
+ * sweeps.
+ */
+static void
+EvictColumnarChunks(Size requiredBytes)
+{
+	Size limit = ColumnarChunkCacheLimit();
+
+	for (int sweep = 0; sweep <= CHUNK_CACHE_MAX_USAGE_COUNT; sweep++)
+	{
+		dshash_seq_status status;
+		ColumnarChunkCacheEntry *entry = NULL;
+
+		dshash_seq_init(&status, ColumnarChunkCacheHash, true);
+
+		while ((entry = dshash_seq_next(&status)) != NULL)
+		{
+			if (pg_atomic_read_u64(&ColumnarChunkCacheState->cachedBytes) +
+				requiredBytes <= limit)
+			{
+				break;
+			}
+
+			uint32 usageCount = pg_atomic_read_u32(&entry->usageCount);
+			if (usageCount > 0)
+			{
+				pg_atomic_write_u32(&entry->usageCount, usageCount - 1);
+				continue;
+			}
+
+			pg_atomic_fetch_sub_u64(&ColumnarChunkCacheState->cachedBytes,
+									entry->length);
+			pg_atomic_fetch_sub_u64(&ColumnarChunkCacheState->cachedChunks, 1);
+			pg_atomic_fetch_add_u64(&ColumnarChunkCacheState->evictions, 1);
+
+			dsa_free(ColumnarChunkCacheArea, entry->data);
+			dshash_delete_current(&status);
+		}
+
+		dshash_seq_term(&status);
+
+		if (pg_atomic_read_u64(&ColumnarChunkCacheState->cachedBytes) +
+			requiredBytes <= limit)
+		{
+			break;
+		}
+	}
+}
+
+
+/*
+ * AttachColumnarChunkCache attaches the backend to the dynamic shared memory
+ * area of the cache, creating it if no backend did so far. The mapping is
+ * kept until the backend exits. Returns false if the cache cannot be used.
+ */
+static bool
+AttachColumnarChunkCache(void)
+{
+	if (ColumnarChunkCacheHash != NULL)
+	{
+		return true;
+	}
+
+	if (ColumnarChunkCacheState == NULL)
+	{
+		return false;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+	LWLockRegisterTranche(ColumnarChunkCacheState->trancheId,
+						  ColumnarChunkCacheState->lockTrancheName);
+
+	LWLockAcquire(&ColumnarChunkCacheState->lock, LW_EXCLUSIVE);
+
+	dshash_parameters hashParameters = ColumnarChunkCacheHashParameters();
+
+	if (ColumnarChunkCacheState->areaHandle == DSA_HANDLE_INVALID)
+	{
+		ColumnarChunkCacheArea = dsa_create(ColumnarChunkCacheState->trancheId);
+		dsa_pin(ColumnarChunkCacheArea);
+		dsa_pin_mapping(ColumnarChunkCacheArea);
+
+		/* leave some room for the hash table and the allocator overhead */
+		dsa_set_size_limit(ColumnarChunkCacheArea, ColumnarChunkCacheLimit() * 5 / 4);
+
+		ColumnarChunkCacheHash = dshash_create(ColumnarChunkCacheArea, &hashParameters,
+											   NULL);
+
+		ColumnarChunkCacheState->hashHandle =
+			dshash_get_hash_table_handle(ColumnarChunkCacheHash);
+		ColumnarChunkCacheState->areaHandle = dsa_get_handle(ColumnarChunkCacheArea);
+	}
+	else
+	{
+		ColumnarChunkCacheArea = dsa_attach(ColumnarChunkCacheState->areaHandle);
+		dsa_pin_mapping(ColumnarChunkCacheArea);
+
+		ColumnarChunkCacheHash = dshash_attach(ColumnarChunkCacheArea, &hashParameters,
+											   ColumnarChunkCacheState->hashHandle,
+											   NULL);
+	}
+
+	LWLockRelease(&ColumnarChunkCacheState->lock);
+
+	MemoryContextSwitchTo(oldContext);
+
+	return true;
+}
+
+
+/*
+ * ColumnarChunkCacheHashParameters returns the parameters of the hash that
+ * maps chunks to their decompressed value streams.
+ */
+static dshash_parameters
+ColumnarChunkCacheHashParameters(void)
+{
+	dshash_parameters hashParameters;
+
+	memset(&hashParameters, 0, sizeof(hashParameters));
+	hashParameters.key_size = sizeof(ColumnarChunkCacheKey);
+	hashParameters.entry_size = sizeof(ColumnarChunkCacheEntry);
+	hashParameters.compare_function = dshash_memcmp;
+	hashParameters.hash_function = dshash_memhash;
+#if PG_VERSION_NUM >= PG_VERSION_17
+	hashParameters.copy_function = dshash_memcpy;
+#endif
+	hashParameters.tranche_id = ColumnarChunkCacheState->trancheId;
+
+	return hashParameters;
+}
+
+
+/*
+ * InitColumnarChunkCacheKey initializes the hash key of the given chunk of a
+ * table in the current database.
+ */
+static void
+InitColumnarChunkCacheKey(ColumnarChunkCacheKey *key, uint64 storageId,
+						  uint64 stripeId, uint32 columnIndex, uint64 chunkGroupIndex)
+{
+	memset(key, 0, sizeof(ColumnarChunkCacheKey));
+	key->databaseId = MyDatabaseId;
+	key->columnIndex = columnIndex;
+	key->storageId = storageId;
+	key->stripeId = stripeId;
+	key->chunkGroupIndex = chunkGroupIndex;
+}
+
+
+/*
+ * ColumnarChunkCacheLimit returns the maximum total size of the cached chunks
+ * in bytes.
+ */
+static Size
+ColumnarChunkCacheLimit(void)
+{
+	return (Size) columnar_chunk_cache_size * 1024;
+}
+
+
+/*
+ * columnar_chunk_cache_stats returns the number of lookups that found their
+ * chunk in the chunk cache and that didn't, the number of evicted chunks,
+ * and the number and total size of the cached chunks. All of them are zero
+ * if the cache is disabled.
+ *
+ * DDL:
+ *   CREATE FUNCTION columnar.chunk_cache_stats(
+ *       OUT hits bigint, OUT misses bigint, OUT evictions bigint,
+ *       OUT cached_chunks bigint, OUT cached_bytes bigint)
+ *     LANGUAGE c AS 'MODULE_PATHNAME', 'columnar_chunk_cache_stats';
+ */
+PG_FUNCTION_INFO_V1(columnar_chunk_cache_stats);
+Datum
+columnar_chunk_cache_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+	Datum values[CHUNK_CACHE_STATS_COLUMNS] = { 0 };
+	bool nulls[CHUNK_CACHE_STATS_COLUMNS] = { false };
+
+	if (get_call_result_type(fcinfo, NULL, &tupleDescriptor) != TYPEFUNC_COMPOSITE)
+	{
+		elog(ERROR, "return type must be a row type");
+	}
+
+	if (ColumnarChunkCacheState != NULL)
+	{
+		values[0] = Int64GetDatum(pg_atomic_read_u64(&ColumnarChunkCacheState->hits));
+		values[1] = Int64GetDatum(pg_atomic_read_u64(&ColumnarChunkCacheState->misses));
+		values[2] = Int64GetDatum(
+			pg_atomic_read_u64(&ColumnarChunkCacheState->evictions));
+		values[3] = Int64GetDatum(
+			pg_atomic_read_u64(&ColumnarChunkCacheState->cachedChunks));
+		values[4] = Int64GetDatum(
+			pg_atomic_read_u64(&ColumnarChunkCacheState->cachedBytes));
+	}
+	else
+	{
+		for (int columnIndex = 0; columnIndex < CHUNK_CACHE_STATS_COLUMNS;
+			 columnIndex++)
+		{
+			values[columnIndex] = Int64GetDatum(0);
+		}
+	}
+
+	HeapTuple tuple = heap_form_tuple(tupleDescriptor, values, nulls);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(tuple));
+}
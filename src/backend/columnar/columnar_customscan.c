@@ -17,7 +17,14 @@
 #include "miscadmin.h"
 
 #include "access/amapi.h"
+#include "access/nbtree.h"
+#include "access/parallel.h"
 #include "access/skey.h"
+#include "access/sysattr.h"
+#include "access/table.h"
+#include "access/tableam.h"
+#include "access/xact.h"
+#include "catalog/pg_aggregate.h"
 #include "catalog/pg_am.h"
 #include "catalog/pg_statistic.h"
 #include "commands/defrem.h"
@@ -38,22 +45,29 @@
 #include "optimizer/pathnode.h"
 #include "optimizer/paths.h"
 #include "optimizer/plancat.h"
+#include "optimizer/planner.h"
 #include "optimizer/restrictinfo.h"
+#include "optimizer/tlist.h"
 #include "parser/parse_relation.h"
 #include "parser/parsetree.h"
 #include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/fmgroids.h"
 #include "utils/guc.h"
 #include "utils/lsyscache.h"
+#include "utils/rel.h"
 #include "utils/relcache.h"
 #include "utils/ruleutils.h"
 #include "utils/selfuncs.h"
 #include "utils/spccache.h"
+#include "utils/syscache.h"
 
 #include "citus_version.h"
 
 #include "columnar/columnar.h"
 #include "columnar/columnar_customscan.h"
 #include "columnar/columnar_metadata.h"
+#include "columnar/columnar_storage.h"
 #include "columnar/columnar_tableam.h"
 
 #include "distributed/listutils.h"
@@ -68,9 +82,76 @@ typedef struct ColumnarScanState
 
 	ExprContext *css_RuntimeContext;
 	List *qual;
+
+	/* rows removed by vector filters that were added to the instrumentation */
+	int64 vectorFilteredRows;
+
+	/* shared scan descriptor if the scan is executed by parallel workers */
+	ParallelTableScanDesc parallelScanDesc;
 } ColumnarScanState;
 
 
+/*
+ * ColumnarAggregateKind is the kind of an aggregate that ColumnarAggScan can
+ * compute using the metadata of the chunk groups.
+ */
+typedef enum ColumnarAggregateKind
+{
+	COLUMNAR_AGGREGATE_COUNT_STAR,
+	COLUMNAR_AGGREGATE_MIN,
+	COLUMNAR_AGGREGATE_MAX
+} ColumnarAggregateKind;
+
+/*
+ * ColumnarAggregate represents the state of an aggregate computed by a
+ * columnar aggregate scan.
+ */
+typedef struct ColumnarAggregate
+{
+	ColumnarAggregateKind kind;
+
+	/* column aggregated by min() or max(), and how to compare its values */
+	int columnIndex;
+	FmgrInfo *comparisonFunction;
+	Oid collation;
+	bool typeByValue;
+	int16 typeLength;
+
+	/* result of the aggregate */
+	int64 count;
+	bool hasValue;
+	Datum value;
+} ColumnarAggregate;
+
+/*
+ * ColumnarAggScanState represents the state for a columnar aggregate scan,
+ * which computes the aggregates of a query over a single columnar table. It
+ * uses the row counts and the min/max values of the chunk groups whose rows
+ * all satisfy the quals, and only reads the remaining chunk groups.
+ */
+typedef struct ColumnarAggScanState
+{
+	CustomScanState custom_scanstate; /* must be first field */
+
+	ExprContext *css_RuntimeContext;
+	Relation relation;
+
+	/* quals and their columns, referencing the attributes of relation */
+	List *qual;
+	List *projectedColumnList;
+
+	List *aggregateList;
+	TupleTableSlot *rowSlot;
+	MemoryContext aggregateContext;
+	bool aggregatesComputed;
+
+	/* statistics about the last execution for EXPLAIN */
+	bool executed;
+	int64 chunkGroupsFiltered;
+	int64 chunkGroupsCovered;
+} ColumnarAggScanState;
+
+
 typedef bool (*PathPredicate)(Path *path);
 
 
@@ -78,6 +159,9 @@ typedef bool (*PathPredicate)(Path *path);
 static void CostColumnarPaths(PlannerInfo *root, RelOptInfo *rel, Oid relationId);
 static void CostColumnarIndexPath(PlannerInfo *root, RelOptInfo *rel, Oid relationId,
 								  IndexPath *indexPath);
+static void CostColumnarBitmapHeapPath(RelOptInfo *rel, Oid relationId,
+									   BitmapHeapPath *bitmapHeapPath);
+static void CostColumnarTidPath(RelOptInfo *rel, Oid relationId, TidPath *tidPath);
 static void CostColumnarSeqPath(RelOptInfo *rel, Oid relationId, Path *path);
 static void CostColumnarScan(PlannerInfo *root, RelOptInfo *rel, Oid relationId,
 							 CustomPath *cpath, int numberOfColumnsRead,
@@ -87,17 +171,22 @@ static void CostColumnarScan(PlannerInfo *root, RelOptInfo *rel, Oid relationId,
 static void AddColumnarScanPaths(PlannerInfo *root, RelOptInfo *rel,
 								 RangeTblEntry *rte);
 static void AddColumnarScanPath(PlannerInfo *root, RelOptInfo *rel,
-								RangeTblEntry *rte, Relids required_relids);
+								RangeTblEntry *rte, Relids required_relids,
+								int parallelWorkers);
 
 /* helper functions to be used when costing paths or altering them */
 static void RemovePathsByPredicate(RelOptInfo *rel, PathPredicate removePathPredicate);
-static bool IsNotIndexPath(Path *path);
+static bool IsNotIndexBitmapOrTidPath(Path *path);
+static bool IsBitmapHeapPath(Path *path);
+static bool ColumnarBitmapHeapScanIsSafe(RelOptInfo *rel, Relation relation);
 static Cost ColumnarIndexScanAdditionalCost(PlannerInfo *root, RelOptInfo *rel,
 											Oid relationId, IndexPath *indexPath);
 static int RelationIdGetNumberOfAttributes(Oid relationId);
 static Cost ColumnarPerStripeScanCost(RelOptInfo *rel, Oid relationId,
 									  int numberOfColumnsRead);
 static uint64 ColumnarTableStripeCount(Oid relationId);
+static int ColumnarParallelWorkers(RelOptInfo *rel, Oid relationId);
+static double ColumnarParallelDivisor(int parallelWorkers);
 static Path * CreateColumnarSeqScanPath(PlannerInfo *root, RelOptInfo *rel,
 										Oid relationId);
 static void AddColumnarScanPathsRec(PlannerInfo *root, RelOptInfo *rel,
@@ -128,6 +217,49 @@ static void ColumnarScan_EndCustomScan(CustomScanState *node);
 static void ColumnarScan_ReScanCustomScan(CustomScanState *node);
 static void ColumnarScan_ExplainCustomScan(CustomScanState *node, List *ancestors,
 										   ExplainState *es);
+static void FlushPendingWritesForParallelScan(Relation relation, Snapshot snapshot);
+
+/* functions for aggregate pushdown */
+static void ColumnarCreateUpperPathsHook(PlannerInfo *root, UpperRelationKind stage,
+										 RelOptInfo *input_rel, RelOptInfo *output_rel,
+										 void *extra);
+static void AddColumnarAggScanPath(PlannerInfo *root, RelOptInfo *inputRel,
+								   RelOptInfo *groupedRel);
+static Path * CheapestColumnarScanPath(RelOptInfo *rel);
+static bool PushableColumnarAggregate(Aggref *aggref,
+									  ColumnarAggregateKind *aggregateKind,
+									  Var **aggregatedColumn);
+static Plan * ColumnarAggScanPath_PlanCustomPath(PlannerInfo *root,
+												 RelOptInfo *rel,
+												 struct CustomPath *best_path,
+												 List *tlist,
+												 List *clauses,
+												 List *custom_plans);
+static Node * ColumnarAggScan_CreateCustomScanState(CustomScan *cscan);
+static void ColumnarAggScan_BeginCustomScan(CustomScanState *node, EState *estate,
+											int eflags);
+static TupleTableSlot * ColumnarAggScan_ExecCustomScan(CustomScanState *node);
+static void ColumnarAggScan_EndCustomScan(CustomScanState *node);
+static void ColumnarAggScan_ReScanCustomScan(CustomScanState *node);
+static void ColumnarAggScan_ExplainCustomScan(CustomScanState *node, List *ancestors,
+											  ExplainState *es);
+static Node * ScanTargetListVarMutator(Node *node, List *scanTargetList);
+static void ComputeColumnarAggregates(ColumnarAggScanState *aggScanState);
+static bool AggregateCoveredChunkGroup(StripeMetadata *stripeMetadata,
+									   StripeSkipList *stripeSkipList,
+									   uint32 chunkIndex, void *callbackArg);
+static void AdvanceColumnarMinMaxAggregate(ColumnarAggregate *aggregate, Datum value);
+static Size ColumnarScan_EstimateDSMCustomScan(CustomScanState *node,
+											   ParallelContext *pcxt);
+static void ColumnarScan_InitializeDSMCustomScan(CustomScanState *node,
+												 ParallelContext *pcxt,
+												 void *coordinate);
+static void ColumnarScan_ReInitializeDSMCustomScan(CustomScanState *node,
+												   ParallelContext *pcxt,
+												   void *coordinate);
+static void ColumnarScan_InitializeWorkerCustomScan(CustomScanState *node,
+													shm_toc *toc,
+													void *coordinate);
 
 /* helper functions to build strings for EXPLAIN */
 static const char * ColumnarPushdownClausesStr(List *context, List *clauses);
@@ -144,9 +276,11 @@ static Bitmapset * fixup_inherited_columns(Oid parentId, Oid childId, Bitmapset
 /* saved hook value in case of unload */
 static set_rel_pathlist_hook_type PreviousSetRelPathlistHook = NULL;
 static get_relation_info_hook_type PreviousGetRelationInfoHook = NULL;
+static create_upper_paths_hook_type PreviousCreateUpperPathsHook = NULL;
 
 static bool EnableColumnarCustomScan = true;
 static bool EnableColumnarQualPushdown = true;
+static bool EnableColumnarAggregatePushdown = true;
 static double ColumnarQualPushdownCorrelationThreshold = 0.9;
 static int ColumnarMaxCustomScanPaths = 64;
 static int ColumnarPlannerDebugLevel = DEBUG3;
@@ -171,9 +305,35 @@ const struct CustomExecMethods ColumnarScanExecuteMethods = {
 	.EndCustomScan = ColumnarScan_EndCustomScan,
 	.ReScanCustomScan = ColumnarScan_ReScanCustomScan,
 
+	.EstimateDSMCustomScan = ColumnarScan_EstimateDSMCustomScan,
+	.InitializeDSMCustomScan = ColumnarScan_InitializeDSMCustomScan,
+	.ReInitializeDSMCustomScan = ColumnarScan_ReInitializeDSMCustomScan,
+	.InitializeWorkerCustomScan = ColumnarScan_InitializeWorkerCustomScan,
+
 	.ExplainCustomScan = ColumnarScan_ExplainCustomScan,
 };
 
+const struct CustomPathMethods ColumnarAggScanPathMethods = {
+	.CustomName = "ColumnarAggScan",
+	.PlanCustomPath = ColumnarAggScanPath_PlanCustomPath,
+};
+
+const struct CustomScanMethods ColumnarAggScanScanMethods = {
+	.CustomName = "ColumnarAggScan",
+	.CreateCustomScanState = ColumnarAggScan_CreateCustomScanState,
+};
+
+const struct CustomExecMethods ColumnarAggScanExecuteMethods = {
+	.CustomName = "ColumnarAggScan",
+
+	.BeginCustomScan = ColumnarAggScan_BeginCustomScan,
+	.ExecCustomScan = ColumnarAggScan_ExecCustomScan,
+	.EndCustomScan = ColumnarAggScan_EndCustomScan,
+	.ReScanCustomScan = ColumnarAggScan_ReScanCustomScan,
+
+	.ExplainCustomScan = ColumnarAggScan_ExplainCustomScan,
+};
+
 static const struct config_enum_entry debug_level_options[] = {
 	{ "debug5", DEBUG5, false },
 	{ "debug4", DEBUG4, false },
@@ -202,6 +362,9 @@ columnar_customscan_init()
 	PreviousGetRelationInfoHook = get_relation_info_hook;
 	get_relation_info_hook = ColumnarGetRelationInfoHook;
 
+	PreviousCreateUpperPathsHook = create_upper_paths_hook;
+	create_upper_paths_hook = ColumnarCreateUpperPathsHook;
+
 	/* register customscan specific GUC's */
 	DefineCustomBoolVariable(
 		"columnar.enable_custom_scan",
@@ -223,6 +386,17 @@ columnar_customscan_init()
 		PGC_USERSET,
 		GUC_NO_SHOW_ALL | GUC_NOT_IN_SAMPLE,
 		NULL, NULL, NULL);
+	DefineCustomBoolVariable(
+		"columnar.enable_aggregate_pushdown",
+		gettext_noop("Enables computing count(*), min() and max() aggregates using "
+					 "the metadata of the chunk groups in columnar. This has no "
+					 "effect unless columnar.enable_custom_scan is true."),
+		NULL,
+		&EnableColumnarAggregatePushdown,
+		true,
+		PGC_USERSET,
+		GUC_NO_SHOW_ALL | GUC_NOT_IN_SAMPLE,
+		NULL, NULL, NULL);
 	DefineCustomRealVariable(
 		"columnar.qual_pushdown_correlation_threshold",
 		gettext_noop("Correlation threshold to attempt to push a qual "
@@ -263,6 +437,7 @@ columnar_customscan_init()
 		NULL);
 
 	RegisterCustomScanMethods(&ColumnarScanScanMethods);
+	RegisterCustomScanMethods(&ColumnarAggScanScanMethods);
 }
 
 
@@ -304,8 +479,9 @@ ColumnarSetRelPathlistHook(PlannerInfo *root, RelOptInfo *rel, Index rti,
 		if (list_length(rel->partial_pathlist) != 0)
 		{
 			/*
-			 * Parallel scans on columnar tables are already discardad by
-			 * ColumnarGetRelationInfoHook but be on the safe side.
+			 * Parallel seq scans on columnar tables are already discardad by
+			 * ColumnarGetRelationInfoHook but be on the safe side. Parallel
+			 * columnar custom scans are added by AddColumnarScanPaths below.
 			 */
 			elog(ERROR, "parallel scans on columnar are not supported");
 		}
@@ -321,6 +497,11 @@ ColumnarSetRelPathlistHook(PlannerInfo *root, RelOptInfo *rel, Index rti,
 		 * Before doing that, we first re-cost all the existing paths so that
 		 * add_path makes correct cost comparisons when appending our SeqPath.
 		 */
+		if (!ColumnarBitmapHeapScanIsSafe(rel, relation))
+		{
+			RemovePathsByPredicate(rel, IsBitmapHeapPath);
+		}
+
 		CostColumnarPaths(root, rel, rte->relid);
 
 		Path *seqPath = CreateColumnarSeqScanPath(root, rel, rte->relid);
@@ -332,9 +513,10 @@ ColumnarSetRelPathlistHook(PlannerInfo *root, RelOptInfo *rel, Index rti,
 
 			/*
 			 * When columnar custom scan is enabled (columnar.enable_custom_scan),
-			 * we only consider ColumnarScanPath's & IndexPath's. For this reason,
-			 * we remove other paths and re-estimate IndexPath costs to make accurate
-			 * comparisons between them.
+			 * we only consider ColumnarScanPath's and the paths that fetch rows
+			 * by TID, i.e. IndexPath's, BitmapHeapPath's and TidPath's. For this
+			 * reason, we remove other paths and re-estimate the costs of the
+			 * latter to make accurate comparisons between them.
 			 *
 			 * Even more, we might calculate an equal cost for a
 			 * ColumnarCustomScan and a SeqPath if we are reading all columns
@@ -343,7 +525,7 @@ ColumnarSetRelPathlistHook(PlannerInfo *root, RelOptInfo *rel, Index rti,
 			 * In that case, if we don't remove SeqPath's, we might wrongly choose
 			 * SeqPath thinking that its cost would be equal to ColumnarCustomScan.
 			 */
-			RemovePathsByPredicate(rel, IsNotIndexPath);
+			RemovePathsByPredicate(rel, IsNotIndexBitmapOrTidPath);
 			AddColumnarScanPaths(root, rel, rte);
 		}
 	}
@@ -362,7 +544,10 @@ ColumnarGetRelationInfoHook(PlannerInfo *root, Oid relationObjectId,
 
 	if (IsColumnarTableAmTable(relationObjectId))
 	{
-		/* disable parallel query */
+		/*
+		 * Disable parallel seq scans and parallel index builds, parallel
+		 * scans are only done via columnar custom scan.
+		 */
 		rel->rel_parallel_workers = 0;
 
 		/* disable index-only scan */
@@ -398,12 +583,60 @@ RemovePathsByPredicate(RelOptInfo *rel, PathPredicate removePathPredicate)
 
 
 /*
- * IsNotIndexPath returns true if given path is not an IndexPath.
+ * IsNotIndexBitmapOrTidPath returns true if given path is neither an
+ * IndexPath, nor a BitmapHeapPath, nor a TidPath.
+ */
+static bool
+IsNotIndexBitmapOrTidPath(Path *path)
+{
+	return !IsA(path, IndexPath) && !IsA(path, BitmapHeapPath) && !IsA(path, TidPath);
+}
+
+
+/*
+ * IsBitmapHeapPath returns true if given path is a BitmapHeapPath.
+ */
+static bool
+IsBitmapHeapPath(Path *path)
+{
+	return IsA(path, BitmapHeapPath);
+}
+
+
+/*
+ * ColumnarBitmapHeapScanIsSafe returns false if a bitmap heap scan on the
+ * given columnar table might error out.
+ *
+ * Before PG 18, the bitmap heap scan executor prefetches the pages of the
+ * TIDs that it is about to visit with PrefetchBuffer, which errors out for
+ * pages beyond the last segment file of the relation. Pages of columnar TIDs
+ * are virtual, and there are usually many more of them than physical pages,
+ * so we only consider bitmap heap scans if all the TIDs fall into the first
+ * segment file, i.e. the table has fewer than RELSEG_SIZE *
+ * VALID_ITEMPOINTER_OFFSETS (about 38 million with the default block and
+ * segment size) reserved row numbers, or if prefetching is disabled via
+ * effective_io_concurrency. Since PG 18, prefetching is left to the table
+ * AM, so there is no such limit.
  */
 static bool
-IsNotIndexPath(Path *path)
+ColumnarBitmapHeapScanIsSafe(RelOptInfo *rel, Relation relation)
 {
-	return !IsA(path, IndexPath);
+#if PG_VERSION_NUM >= PG_VERSION_18
+	return true;
+#else
+	if (get_tablespace_io_concurrency(rel->reltablespace) == 0)
+	{
+		return true;
+	}
+
+	if (!ColumnarStorageIsCurrent(relation))
+	{
+		return false;
+	}
+
+	uint64 reservedRowNumber = ColumnarStorageGetReservedRowNumber(relation, false);
+	return reservedRowNumber / VALID_ITEMPOINTER_OFFSETS < RELSEG_SIZE;
+#endif
 }
 
 
@@ -436,15 +669,16 @@ CostColumnarPaths(PlannerInfo *root, RelOptInfo *rel, Oid relationId)
 	{
 		if (IsA(path, IndexPath))
 		{
-			/*
-			 * Since we don't provide implementations for scan_bitmap_next_block
-			 * & scan_bitmap_next_tuple, postgres doesn't generate bitmap index
-			 * scan paths for columnar tables already (see related comments in
-			 * TableAmRoutine). For this reason, we only consider IndexPath's
-			 * here.
-			 */
 			CostColumnarIndexPath(root, rel, relationId, (IndexPath *) path);
 		}
+		else if (IsA(path, BitmapHeapPath))
+		{
+			CostColumnarBitmapHeapPath(rel, relationId, (BitmapHeapPath *) path);
+		}
+		else if (IsA(path, TidPath))
+		{
+			CostColumnarTidPath(rel, relationId, (TidPath *) path);
+		}
 		else if (path->pathtype == T_SeqScan)
 		{
 			CostColumnarSeqPath(rel, relationId, path);
@@ -583,6 +817,90 @@ ColumnarIndexScanAdditionalCost(PlannerInfo *root, RelOptInfo *rel,
 }
 
 
+/*
+ * CostColumnarBitmapHeapPath re-costs given bitmap heap path for columnar
+ * table with relationId.
+ */
+static void
+CostColumnarBitmapHeapPath(RelOptInfo *rel, Oid relationId,
+						   BitmapHeapPath *bitmapHeapPath)
+{
+	if (!enable_bitmapscan)
+	{
+		/* costs are already set to disable_cost, don't adjust them */
+		return;
+	}
+
+	ereport(DEBUG4, (errmsg("columnar table bitmap heap scan costs estimated "
+							"by postgres: startup cost = %.10f, total cost = "
+							"%.10f", bitmapHeapPath->path.startup_cost,
+							bitmapHeapPath->path.total_cost)));
+
+	Cost fakeIndexTotalCost;
+	Selectivity indexSelectivity;
+	cost_bitmap_tree_node(bitmapHeapPath->bitmapqual, &fakeIndexTotalCost,
+						  &indexSelectivity);
+
+	Relation relation = RelationIdGetRelation(relationId);
+	if (!RelationIsValid(relation))
+	{
+		ereport(ERROR, (errmsg("could not open relation with OID %u", relationId)));
+	}
+
+	uint64 rowCount = ColumnarTableRowCount(relation);
+	RelationClose(relation);
+	double estimatedRows = rowCount * indexSelectivity;
+
+	/*
+	 * Unlike index scans, bitmap heap scans visit the rows in row number
+	 * order, so we read each stripe at most once. Assuming that the matching
+	 * rows are spread uniformly over the stripes, this is the expected number
+	 * of stripes that contain at least one of them.
+	 */
+	double stripeCount = ColumnarTableStripeCount(relationId);
+	double estimatedStripeReadCount = 0;
+	if (stripeCount > 0)
+	{
+		estimatedStripeReadCount =
+			stripeCount * (1 - pow(1 - 1 / stripeCount, estimatedRows));
+	}
+
+	int numberOfColumnsRead = RelationIdGetNumberOfAttributes(relationId);
+	Cost perStripeCost = ColumnarPerStripeScanCost(rel, relationId, numberOfColumnsRead);
+
+	/* as in CostColumnarIndexPath, "add" ours to the cost estimated by postgres */
+	bitmapHeapPath->path.total_cost += estimatedStripeReadCount * perStripeCost;
+
+	ereport(DEBUG4, (errmsg("columnar table bitmap heap scan costs re-estimated "
+							"by columnarAM: selectivity = %.10f, estimated "
+							"stripe read count = %.10f, total cost = %.10f",
+							indexSelectivity, estimatedStripeReadCount,
+							bitmapHeapPath->path.total_cost)));
+}
+
+
+/*
+ * CostColumnarTidPath re-costs given TID scan path for columnar table with
+ * relationId. Each row is fetched by columnar_fetch_row_version, which reads
+ * the stripe of the row on its own.
+ */
+static void
+CostColumnarTidPath(RelOptInfo *rel, Oid relationId, TidPath *tidPath)
+{
+	if (!enable_tidscan)
+	{
+		/* costs are already set to disable_cost, don't adjust them */
+		return;
+	}
+
+	double estimatedRows = Max(tidPath->path.rows, 1.0);
+
+	int numberOfColumnsRead = RelationIdGetNumberOfAttributes(relationId);
+	Cost perStripeCost = ColumnarPerStripeScanCost(rel, relationId, numberOfColumnsRead);
+	tidPath->path.total_cost += estimatedRows * perStripeCost;
+}
+
+
 /*
  * CostColumnarSeqPath sets costs given seq path for columnar table with
  * relationId.
@@ -978,6 +1296,16 @@ FilterPushdownClauses(PlannerInfo *root, RelOptInfo *rel, List *inputClauses)
 			continue;
 		}
 
+		/*
+		 * The pushed-down clauses are evaluated on every row of a chunk group
+		 * before the executor evaluates the security barrier quals, so quals
+		 * of a higher security level must not leak the values they see.
+		 */
+		if (!restriction_is_securely_promotable(rinfo, rel))
+		{
+			continue;
+		}
+
 		Expr *pushdownableExpr = ExtractPushdownClause(root, rel, (Node *) rinfo->clause);
 		if (!pushdownableExpr)
 		{
@@ -1164,6 +1492,19 @@ AddColumnarScanPaths(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
 
 	AddColumnarScanPathsRec(root, rel, rte, paramRelids, candidateRelids,
 							depthLimit);
+
+	/*
+	 * Partial paths cannot be parameterized, so only consider a parallel scan
+	 * if the minimally-parameterized path is unparameterized.
+	 */
+	if (rel->consider_parallel && bms_is_empty(paramRelids))
+	{
+		int parallelWorkers = ColumnarParallelWorkers(rel, rte->relid);
+		if (parallelWorkers > 0)
+		{
+			AddColumnarScanPath(root, rel, rte, paramRelids, parallelWorkers);
+		}
+	}
 }
 
 
@@ -1206,7 +1547,7 @@ AddColumnarScanPathsRec(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte,
 	check_stack_depth();
 
 	Assert(!bms_overlap(paramRelids, candidateRelids));
-	AddColumnarScanPath(root, rel, rte, paramRelids);
+	AddColumnarScanPath(root, rel, rte, paramRelids, 0);
 
 	/* recurse for all candidateRelids, unless we hit the depth limit */
 	Assert(depthLimit >= 0);
@@ -1305,14 +1646,16 @@ ContainsExecParams(Node *node, void *notUsed)
 
 
 /*
- * Create and add a path with the given parameterization paramRelids.
+ * Create and add a path with the given parameterization paramRelids. If
+ * parallelWorkers is greater than zero, then a partial path that is to be
+ * executed by that many workers (and the leader) is added instead.
  *
  * XXX: Consider refactoring to be more like postgresGetForeignPaths(). The
  * only differences are param_info and custom_private.
  */
 static void
 AddColumnarScanPath(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte,
-					Relids paramRelids)
+					Relids paramRelids, int parallelWorkers)
 {
 	/*
 	 * Must return a CustomPath, not a larger structure containing a
@@ -1334,8 +1677,10 @@ AddColumnarScanPath(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte,
 	path->parent = rel;
 	path->pathtarget = rel->reltarget;
 
-	/* columnar scans are not parallel-aware, but they are parallel-safe */
+	/* columnar scans are parallel-safe, partial paths are also parallel-aware */
 	path->parallel_safe = rel->consider_parallel;
+	path->parallel_aware = parallelWorkers > 0;
+	path->parallel_workers = parallelWorkers;
 
 	path->param_info = get_baserel_parampathinfo(root, rel, paramRelids);
 
@@ -1426,6 +1771,23 @@ AddColumnarScanPath(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte,
 	CostColumnarScan(root, rel, rte->relid, cpath, numberOfColumnsRead,
 					 numberOfClausesPushed);
 
+	if (parallelWorkers > 0)
+	{
+		/* each participant reads and returns its share of the stripes */
+		double parallelDivisor = ColumnarParallelDivisor(parallelWorkers);
+		path->rows = clamp_row_est(path->rows / parallelDivisor);
+		path->total_cost = path->startup_cost +
+						   (path->total_cost - path->startup_cost) / parallelDivisor;
+
+		ereport(ColumnarPlannerDebugLevel,
+				(errmsg("columnar planner: adding partial CustomScan path for %s",
+						rte->eref->aliasname),
+				 errdetail("%d parallel workers; %d clauses pushed down",
+						   parallelWorkers, numberOfClausesPushed)));
+
+		add_partial_path(rel, path);
+		return;
+	}
 
 	StringInfoData buf;
 	initStringInfo(&buf);
@@ -1607,6 +1969,84 @@ ColumnarTableStripeCount(Oid relationId)
 }
 
 
+/*
+ * ColumnarParallelWorkers returns the number of workers to use when scanning
+ * the columnar table with relationId in parallel, or 0 if a parallel scan is
+ * not worthwhile.
+ */
+static int
+ColumnarParallelWorkers(RelOptInfo *rel, Oid relationId)
+{
+	Relation relation = RelationIdGetRelation(relationId);
+	if (!RelationIsValid(relation))
+	{
+		ereport(ERROR, (errmsg("could not open relation with OID %u", relationId)));
+	}
+
+	int relParallelWorkers = RelationGetParallelWorkers(relation, -1);
+	bool hasPendingWrites =
+		PendingWritesInSubTransaction(relation->rd_locator.relNumber,
+									  GetCurrentSubTransactionId());
+	RelationClose(relation);
+
+	/*
+	 * Prefer a serial scan if we have pending writes, so that we don't need to
+	 * flush them before starting the workers, see ColumnarScan_BeginCustomScan.
+	 */
+	if (hasPendingWrites)
+	{
+		return 0;
+	}
+
+	/*
+	 * ColumnarGetRelationInfoHook sets rel_parallel_workers to 0 to disable
+	 * parallel seq scans, so temporarily restore the parallel_workers
+	 * setting of the table while computing the number of workers.
+	 */
+	int savedRelParallelWorkers = rel->rel_parallel_workers;
+	rel->rel_parallel_workers = relParallelWorkers;
+	int parallelWorkers = compute_parallel_worker(rel, rel->pages, -1,
+												  max_parallel_workers_per_gather);
+	rel->rel_parallel_workers = savedRelParallelWorkers;
+
+	/*
+	 * Participants read whole stripes, so there is no point in having more
+	 * participants than stripes. The leader participates as well.
+	 */
+	uint64 stripeCount = ColumnarTableStripeCount(relationId);
+	if (stripeCount <= 1)
+	{
+		return 0;
+	}
+
+	return (int) Min((uint64) parallelWorkers, stripeCount - 1);
+}
+
+
+/*
+ * ColumnarParallelDivisor returns the estimated fraction of the work that
+ * the leader does not do when the scan is executed by parallelWorkers.
+ *
+ * Exact function Copied from get_parallel_divisor() in PG as it's static.
+ */
+static double
+ColumnarParallelDivisor(int parallelWorkers)
+{
+	double parallelDivisor = parallelWorkers;
+
+	if (parallel_leader_participation)
+	{
+		double leaderContribution = 1.0 - (0.3 * parallelWorkers);
+		if (leaderContribution > 0)
+		{
+			parallelDivisor += leaderContribution;
+		}
+	}
+
+	return parallelDivisor;
+}
+
+
 static Plan *
 ColumnarScanPath_PlanCustomPath(PlannerInfo *root,
 								RelOptInfo *rel,
@@ -1800,10 +2240,47 @@ ColumnarScan_BeginCustomScan(CustomScanState *cscanstate, EState *estate, int ef
 	columnarScanState->qual = (List *) EvalParamsMutator(
 		(Node *) plainClauses, columnarScanState->css_RuntimeContext);
 
+	if (cscan->scan.plan.parallel_aware && !IsParallelWorker())
+	{
+		FlushPendingWritesForParallelScan(cscanstate->ss.ss_currentRelation,
+										  estate->es_snapshot);
+	}
+
 	/* scan slot is already initialized */
 }
 
 
+/*
+ * FlushPendingWritesForParallelScan flushes the pending writes of the current
+ * subtransaction into given relation before the parallel workers are started,
+ * since the participants of a parallel scan cannot flush them.
+ *
+ * Like ColumnarReadFlushPendingWrites, we make the flushed writes visible by
+ * setting the curcid of the snapshot of the scan to the current command id.
+ * We cannot push a copied snapshot here since the snapshot is serialized for
+ * the workers later on. This is safe because a parallel plan is read-only, so
+ * the query doesn't see any of its own writes by doing so.
+ */
+static void
+FlushPendingWritesForParallelScan(Relation relation, Snapshot snapshot)
+{
+	RelFileNumber relfilenumber = relation->rd_locator.relNumber;
+
+	if (IsInParallelMode() ||
+		!PendingWritesInSubTransaction(relfilenumber, GetCurrentSubTransactionId()))
+	{
+		return;
+	}
+
+	FlushWriteStateForRelfilenumber(relfilenumber, GetCurrentSubTransactionId());
+
+	if (snapshot != InvalidSnapshot && IsMVCCSnapshot(snapshot))
+	{
+		snapshot->curcid = GetCurrentCommandId(false);
+	}
+}
+
+
 /*
  * ColumnarAttrNeeded returns a list of AttrNumber's for the ones that are
  * needed during columnar custom scan.
@@ -1827,11 +2304,18 @@ ColumnarAttrNeeded(ScanState *ss)
 	{
 		Var *var = lfirst(lc);
 
+		if (var->varattno == SelfItemPointerAttributeNumber ||
+			var->varattno == TableOidAttributeNumber)
+		{
+			/* scan sets those for each row, e.g.: for UPDATE and DELETE */
+			continue;
+		}
+
 		if (var->varattno < 0)
 		{
 			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-							errmsg(
-								"UPDATE and CTID scans not supported for ColumnarScan")));
+							errmsg("system columns other than ctid and tableoid are "
+								   "not supported for ColumnarScan")));
 		}
 
 		if (var->varattno == 0)
@@ -1870,14 +2354,25 @@ ColumnarScanNext(ColumnarScanState *columnarScanState)
 		uint32 flags = 0;
 		Bitmapset *attr_needed = ColumnarAttrNeeded(&node->ss);
 
-		/*
-		 * We reach here if the scan is not parallel, or if we're serially
-		 * executing a scan that was planned to be parallel.
-		 */
-		scandesc = columnar_beginscan_extended(node->ss.ss_currentRelation,
-											   estate->es_snapshot,
-											   0, NULL, NULL, flags, attr_needed,
-											   columnarScanState->qual);
+		if (columnarScanState->parallelScanDesc != NULL)
+		{
+			/* we're a participant of a parallel scan */
+			scandesc = columnar_beginscan_parallel_extended(
+				node->ss.ss_currentRelation,
+				columnarScanState->parallelScanDesc,
+				attr_needed, columnarScanState->qual);
+		}
+		else
+		{
+			/*
+			 * We reach here if the scan is not parallel, or if we're serially
+			 * executing a scan that was planned to be parallel.
+			 */
+			scandesc = columnar_beginscan_extended(node->ss.ss_currentRelation,
+												   estate->es_snapshot,
+												   0, NULL, NULL, flags, attr_needed,
+												   columnarScanState->qual);
+		}
 		bms_free(attr_needed);
 
 		node->ss.ss_currentScanDesc = scandesc;
@@ -1886,7 +2381,23 @@ ColumnarScanNext(ColumnarScanState *columnarScanState)
 	/*
 	 * get the next tuple from the table
 	 */
-	if (table_scan_getnextslot(scandesc, direction, slot))
+	bool found = table_scan_getnextslot(scandesc, direction, slot);
+
+	/*
+	 * Rows removed by vector filters would have been removed by the scan
+	 * quals otherwise, so count them as such.
+	 */
+	if (node->ss.ps.instrument != NULL)
+	{
+		int64 vectorFilteredRows =
+			ColumnarScanVectorFilteredRows((ColumnarScanDesc) scandesc);
+
+		InstrCountFiltered1(node, vectorFilteredRows -
+							columnarScanState->vectorFilteredRows);
+		columnarScanState->vectorFilteredRows = vectorFilteredRows;
+	}
+
+	if (found)
 	{
 		return slot;
 	}
@@ -1953,6 +2464,9 @@ ColumnarScan_ReScanCustomScan(CustomScanState *node)
 
 	TableScanDesc scanDesc = node->ss.ss_currentScanDesc;
 
+	/* ColumnarRescan resets the number of rows removed by vector filters */
+	columnarScanState->vectorFilteredRows = 0;
+
 	if (scanDesc != NULL)
 	{
 		/* XXX: hack to pass quals as scan keys */
@@ -1963,29 +2477,73 @@ ColumnarScan_ReScanCustomScan(CustomScanState *node)
 }
 
 
+static Size
+ColumnarScan_EstimateDSMCustomScan(CustomScanState *node, ParallelContext *pcxt)
+{
+	EState *estate = node->ss.ps.state;
+
+	return table_parallelscan_estimate(node->ss.ss_currentRelation,
+									   estate->es_snapshot);
+}
+
+
 static void
-ColumnarScan_ExplainCustomScan(CustomScanState *node, List *ancestors,
-							   ExplainState *es)
+ColumnarScan_InitializeDSMCustomScan(CustomScanState *node, ParallelContext *pcxt,
+									 void *coordinate)
 {
 	ColumnarScanState *columnarScanState = (ColumnarScanState *) node;
+	EState *estate = node->ss.ps.state;
+	ParallelTableScanDesc parallelScanDesc = (ParallelTableScanDesc) coordinate;
 
-	List *context = set_deparse_context_planstate(
-		es->deparse_cxt, (Node *) &node->ss.ps, ancestors);
+	table_parallelscan_initialize(node->ss.ss_currentRelation, parallelScanDesc,
+								  estate->es_snapshot);
+	columnarScanState->parallelScanDesc = parallelScanDesc;
+}
 
-	List *projectedColumns = ColumnarVarNeeded(columnarScanState);
-	const char *projectedColumnsStr = ColumnarProjectedColumnsStr(
-		context, projectedColumns);
-	ExplainPropertyText("Columnar Projected Columns",
-						projectedColumnsStr, es);
 
-	CustomScan *cscan = castNode(CustomScan, node->ss.ps.plan);
-	List *chunkGroupFilter = lsecond(cscan->custom_exprs);
-	if (chunkGroupFilter != NULL)
-	{
-		const char *pushdownClausesStr = ColumnarPushdownClausesStr(
-			context, chunkGroupFilter);
-		ExplainPropertyText("Columnar Chunk Group Filters",
-							pushdownClausesStr, es);
+static void
+ColumnarScan_ReInitializeDSMCustomScan(CustomScanState *node, ParallelContext *pcxt,
+									   void *coordinate)
+{
+	ParallelTableScanDesc parallelScanDesc = (ParallelTableScanDesc) coordinate;
+
+	table_parallelscan_reinitialize(node->ss.ss_currentRelation, parallelScanDesc);
+}
+
+
+static void
+ColumnarScan_InitializeWorkerCustomScan(CustomScanState *node, shm_toc *toc,
+										void *coordinate)
+{
+	ColumnarScanState *columnarScanState = (ColumnarScanState *) node;
+
+	columnarScanState->parallelScanDesc = (ParallelTableScanDesc) coordinate;
+}
+
+
+static void
+ColumnarScan_ExplainCustomScan(CustomScanState *node, List *ancestors,
+							   ExplainState *es)
+{
+	ColumnarScanState *columnarScanState = (ColumnarScanState *) node;
+
+	List *context = set_deparse_context_planstate(
+		es->deparse_cxt, (Node *) &node->ss.ps, ancestors);
+
+	List *projectedColumns = ColumnarVarNeeded(columnarScanState);
+	const char *projectedColumnsStr = ColumnarProjectedColumnsStr(
+		context, projectedColumns);
+	ExplainPropertyText("Columnar Projected Columns",
+						projectedColumnsStr, es);
+
+	CustomScan *cscan = castNode(CustomScan, node->ss.ps.plan);
+	List *chunkGroupFilter = lsecond(cscan->custom_exprs);
+	if (chunkGroupFilter != NULL)
+	{
+		const char *pushdownClausesStr = ColumnarPushdownClausesStr(
+			context, chunkGroupFilter);
+		ExplainPropertyText("Columnar Chunk Group Filters",
+							pushdownClausesStr, es);
 
 		ColumnarScanDesc columnarScanDesc =
 			(ColumnarScanDesc) node->ss.ss_currentScanDesc;
@@ -1994,7 +2552,788 @@ ColumnarScan_ExplainCustomScan(CustomScanState *node, List *ancestors,
 			ExplainPropertyInteger(
 				"Columnar Chunk Groups Removed by Filter",
 				NULL, ColumnarScanChunkGroupsFiltered(columnarScanDesc), es);
+
+			if (es->verbose)
+			{
+				ExplainPropertyInteger(
+					"Columnar Stripes Removed by Filter",
+					NULL, ColumnarScanStripesFiltered(columnarScanDesc), es);
+				ExplainPropertyInteger(
+					"Columnar Stripes Read",
+					NULL, ColumnarScanStripesRead(columnarScanDesc), es);
+				ExplainPropertyInteger(
+					"Columnar Stripes Prefetched",
+					NULL, ColumnarScanStripesPrefetched(columnarScanDesc), es);
+				ExplainPropertyInteger(
+					"Columnar Chunk Groups Removed by Vector Filter",
+					NULL, ColumnarScanChunkGroupsVectorFiltered(columnarScanDesc),
+					es);
+			}
+		}
+	}
+}
+
+
+/*
+ * ColumnarCreateUpperPathsHook adds a ColumnarAggScan path for the queries
+ * that compute only count(*), min() and max() aggregates over a single
+ * columnar table, without grouping.
+ */
+static void
+ColumnarCreateUpperPathsHook(PlannerInfo *root, UpperRelationKind stage,
+							 RelOptInfo *input_rel, RelOptInfo *output_rel,
+							 void *extra)
+{
+	/* call into previous hook if assigned */
+	if (PreviousCreateUpperPathsHook)
+	{
+		PreviousCreateUpperPathsHook(root, stage, input_rel, output_rel, extra);
+	}
+
+	if (stage != UPPERREL_GROUP_AGG || !EnableColumnarCustomScan ||
+		!EnableColumnarAggregatePushdown)
+	{
+		return;
+	}
+
+	Query *parse = root->parse;
+	if (!parse->hasAggs || parse->groupClause != NIL || parse->groupingSets != NIL ||
+		parse->havingQual != NULL || parse->hasTargetSRFs ||
+		root->hasPseudoConstantQuals)
+	{
+		return;
+	}
+
+	if (input_rel->reloptkind != RELOPT_BASEREL || IS_DUMMY_REL(input_rel) ||
+		bms_membership(root->all_baserels) != BMS_SINGLETON)
+	{
+		return;
+	}
+
+	RangeTblEntry *rte = root->simple_rte_array[input_rel->relid];
+	if (rte->rtekind != RTE_RELATION || rte->inh || rte->tablesample != NULL ||
+		!IsColumnarTableAmTable(rte->relid))
+	{
+		return;
+	}
+
+	AddColumnarAggScanPath(root, input_rel, output_rel);
+}
+
+
+/*
+ * AddColumnarAggScanPath adds a ColumnarAggScan path to groupedRel if all the
+ * aggregates of the query can be computed by it, and all the quals on the
+ * columnar table can be evaluated by it.
+ */
+static void
+AddColumnarAggScanPath(PlannerInfo *root, RelOptInfo *inputRel, RelOptInfo *groupedRel)
+{
+	Path *columnarScanPath = CheapestColumnarScanPath(inputRel);
+	if (columnarScanPath == NULL)
+	{
+		return;
+	}
+
+	List *targetNodeList = pull_var_clause((Node *) groupedRel->reltarget->exprs,
+										   PVC_INCLUDE_AGGREGATES |
+										   PVC_INCLUDE_WINDOWFUNCS |
+										   PVC_INCLUDE_PLACEHOLDERS);
+	List *aggregateList = NIL;
+	Node *targetNode = NULL;
+	foreach_declared_ptr(targetNode, targetNodeList)
+	{
+		ColumnarAggregateKind aggregateKind;
+		Var *aggregatedColumn = NULL;
+
+		if (!IsA(targetNode, Aggref) ||
+			!PushableColumnarAggregate((Aggref *) targetNode, &aggregateKind,
+									   &aggregatedColumn))
+		{
+			return;
+		}
+
+		aggregateList = list_append_unique(aggregateList, targetNode);
+	}
+
+	/*
+	 * The quals are evaluated on the rows of the chunk groups that cannot be
+	 * aggregated from metadata, so they must be safe to evaluate within the
+	 * scan and reference only user columns of the table.
+	 */
+	List *clauseList = NIL;
+	RestrictInfo *restrictInfo = NULL;
+	foreach_declared_ptr(restrictInfo, inputRel->baserestrictinfo)
+	{
+		if (restrictInfo->pseudoconstant || restrictInfo->security_level > 0 ||
+			contain_volatile_functions((Node *) restrictInfo->clause) ||
+			contain_subplans((Node *) restrictInfo->clause))
+		{
+			return;
+		}
+
+		List *clauseVarList = pull_var_clause((Node *) restrictInfo->clause,
+											  PVC_INCLUDE_PLACEHOLDERS);
+		Node *clauseVar = NULL;
+		foreach_declared_ptr(clauseVar, clauseVarList)
+		{
+			if (!IsA(clauseVar, Var) || ((Var *) clauseVar)->varattno <= 0)
+			{
+				return;
+			}
+		}
+
+		clauseList = lappend(clauseList, restrictInfo->clause);
+	}
+
+	CustomPath *cpath = makeNode(CustomPath);
+	cpath->methods = &ColumnarAggScanPathMethods;
+
+	Path *path = &cpath->path;
+	path->pathtype = T_CustomScan;
+	path->parent = groupedRel;
+	path->pathtarget = groupedRel->reltarget;
+	path->param_info = NULL;
+	path->parallel_aware = false;
+	path->parallel_safe = false;
+	path->parallel_workers = 0;
+	path->rows = 1;
+
+	/*
+	 * Without quals, all chunk groups are aggregated from metadata, which
+	 * costs about a page per stripe. Otherwise, we might need to read as much
+	 * as the columnar scan does.
+	 */
+	RangeTblEntry *rte = root->simple_rte_array[inputRel->relid];
+	if (clauseList == NIL)
+	{
+		path->startup_cost = ColumnarTableStripeCount(rte->relid) * seq_page_cost;
+	}
+	else
+	{
+		path->startup_cost = columnarScanPath->total_cost;
+	}
+	path->total_cost = path->startup_cost + cpu_tuple_cost;
+
+	cpath->custom_private = list_make3(aggregateList, clauseList,
+									   list_make1_oid(rte->relid));
+
+	ereport(ColumnarPlannerDebugLevel,
+			(errmsg("columnar planner: adding aggregate CustomScan path for %s",
+					rte->eref->aliasname)));
+
+	add_path(groupedRel, path);
+}
+
+
+/*
+ * CheapestColumnarScanPath returns the cheapest unparameterized ColumnarScan
+ * path of the given relation, or NULL if there is none.
+ */
+static Path *
+CheapestColumnarScanPath(RelOptInfo *rel)
+{
+	Path *cheapestPath = NULL;
+
+	Path *path = NULL;
+	foreach_declared_ptr(path, rel->pathlist)
+	{
+		/* the scan/join target might have been applied on top of the scan */
+		Path *scanPath = path;
+		if (IsA(scanPath, ProjectionPath))
+		{
+			scanPath = ((ProjectionPath *) scanPath)->subpath;
+		}
+
+		if (!IsA(scanPath, CustomPath) ||
+			((CustomPath *) scanPath)->methods != &ColumnarScanPathMethods ||
+			path->param_info != NULL)
+		{
+			continue;
+		}
+
+		if (cheapestPath == NULL || path->total_cost < cheapestPath->total_cost)
+		{
+			cheapestPath = path;
+		}
+	}
+
+	return cheapestPath;
+}
+
+
+/*
+ * PushableColumnarAggregate returns true if ColumnarAggScan can compute the
+ * given aggregate, and sets its kind and, for min() and max(), the column that
+ * it aggregates.
+ */
+static bool
+PushableColumnarAggregate(Aggref *aggref, ColumnarAggregateKind *aggregateKind,
+						  Var **aggregatedColumn)
+{
+	if (aggref->aggkind != AGGKIND_NORMAL || aggref->agglevelsup != 0 ||
+		aggref->aggsplit != AGGSPLIT_SIMPLE || aggref->aggdistinct != NIL ||
+		aggref->aggorder != NIL || aggref->aggfilter != NULL)
+	{
+		return false;
+	}
+
+	if (aggref->aggfnoid == F_COUNT_ && aggref->aggstar)
+	{
+		*aggregateKind = COLUMNAR_AGGREGATE_COUNT_STAR;
+		*aggregatedColumn = NULL;
+		return true;
+	}
+
+	if (list_length(aggref->args) != 1)
+	{
+		return false;
+	}
+
+	TargetEntry *argument = linitial_node(TargetEntry, aggref->args);
+	if (!IsA(argument->expr, Var))
+	{
+		return false;
+	}
+
+	Var *column = (Var *) argument->expr;
+	if (column->varlevelsup != 0 || column->varattno <= 0 ||
+		column->vartype != aggref->aggtype ||
+		column->varcollid != aggref->inputcollid)
+	{
+		return false;
+	}
+
+	/* min(), max() and the like are the aggregates with a sort operator */
+	HeapTuple aggTuple = SearchSysCache1(AGGFNOID,
+										 ObjectIdGetDatum(aggref->aggfnoid));
+	if (!HeapTupleIsValid(aggTuple))
+	{
+		elog(ERROR, "cache lookup failed for aggregate %u", aggref->aggfnoid);
+	}
+
+	Oid sortOperatorId = ((Form_pg_aggregate) GETSTRUCT(aggTuple))->aggsortop;
+	ReleaseSysCache(aggTuple);
+
+	Oid operatorFamilyId = InvalidOid;
+	Oid operatorInputType = InvalidOid;
+	int16 strategy = InvalidStrategy;
+	if (!OidIsValid(sortOperatorId) ||
+		!get_ordering_op_properties(sortOperatorId, &operatorFamilyId,
+									&operatorInputType, &strategy))
+	{
+		return false;
+	}
+
+	/*
+	 * The chunk group minimum and maximum values are computed using the
+	 * default btree operator class of the column type, so the aggregate must
+	 * sort by the same operator family.
+	 */
+	Oid operatorClassId = GetDefaultOpClass(column->vartype, BTREE_AM_OID);
+	if (!OidIsValid(operatorClassId) ||
+		get_opclass_family(operatorClassId) != operatorFamilyId ||
+		operatorInputType != column->vartype)
+	{
+		return false;
+	}
+
+	if (strategy == BTLessStrategyNumber)
+	{
+		*aggregateKind = COLUMNAR_AGGREGATE_MIN;
+	}
+	else if (strategy == BTGreaterStrategyNumber)
+	{
+		*aggregateKind = COLUMNAR_AGGREGATE_MAX;
+	}
+	else
+	{
+		return false;
+	}
+
+	*aggregatedColumn = column;
+	return true;
+}
+
+
+static Plan *
+ColumnarAggScanPath_PlanCustomPath(PlannerInfo *root,
+								   RelOptInfo *rel,
+								   struct CustomPath *best_path,
+								   List *tlist,
+								   List *clauses,
+								   List *custom_plans)
+{
+	CustomScan *cscan = makeNode(CustomScan);
+
+	cscan->methods = &ColumnarAggScanScanMethods;
+
+	List *aggregateList = linitial(best_path->custom_private);
+	List *clauseList = lsecond(best_path->custom_private);
+	List *relationIdList = lthird(best_path->custom_private);
+
+	/*
+	 * The scan tuple consists of the aggregates, followed by the columns that
+	 * the quals reference. The latter only let setrefs.c resolve the Vars of
+	 * the quals in custom_exprs, and are always NULL in the scan tuple.
+	 */
+	List *scanTargetList = NIL;
+	AttrNumber resno = 1;
+
+	Aggref *aggref = NULL;
+	foreach_declared_ptr(aggref, aggregateList)
+	{
+		scanTargetList = lappend(scanTargetList,
+								 makeTargetEntry((Expr *) copyObject(aggref), resno++,
+												 NULL, false));
+	}
+
+	List *clauseVarList = pull_var_clause((Node *) clauseList, 0);
+	Var *clauseVar = NULL;
+	foreach_declared_ptr(clauseVar, clauseVarList)
+	{
+		if (tlist_member((Expr *) clauseVar, scanTargetList) == NULL)
+		{
+			scanTargetList = lappend(scanTargetList,
+									 makeTargetEntry((Expr *) copyObject(clauseVar),
+													 resno++, NULL, true));
+		}
+	}
+
+	cscan->scan.scanrelid = 0;
+	cscan->scan.plan.targetlist = list_copy(tlist);
+	cscan->scan.plan.qual = NIL;
+	cscan->custom_scan_tlist = scanTargetList;
+	cscan->custom_exprs = copyObject(clauseList);
+	cscan->custom_private = list_copy(relationIdList);
+
+#if (PG_VERSION_NUM >= 150000)
+
+	/* necessary to avoid extra Result node in PG15 */
+	cscan->flags = CUSTOMPATH_SUPPORT_PROJECTION;
+#endif
+
+	return (Plan *) cscan;
+}
+
+
+static Node *
+ColumnarAggScan_CreateCustomScanState(CustomScan *cscan)
+{
+	ColumnarAggScanState *aggScanState = (ColumnarAggScanState *) newNode(
+		sizeof(ColumnarAggScanState), T_CustomScanState);
+
+	CustomScanState *cscanstate = &aggScanState->custom_scanstate;
+	cscanstate->methods = &ColumnarAggScanExecuteMethods;
+
+	return (Node *) cscanstate;
+}
+
+
+/*
+ * ScanTargetListVarMutator replaces the INDEX_VAR Vars in the given expression
+ * with the Vars of the relation that they reference in the scan target list.
+ */
+static Node *
+ScanTargetListVarMutator(Node *node, List *scanTargetList)
+{
+	if (node == NULL)
+	{
+		return NULL;
+	}
+
+	if (IsA(node, Var) && ((Var *) node)->varno == INDEX_VAR)
+	{
+		Var *var = (Var *) node;
+		TargetEntry *targetEntry = list_nth(scanTargetList, var->varattno - 1);
+
+		return (Node *) copyObject(targetEntry->expr);
+	}
+
+	return expression_tree_mutator(node, ScanTargetListVarMutator,
+								   (void *) scanTargetList);
+}
+
+
+static void
+ColumnarAggScan_BeginCustomScan(CustomScanState *cscanstate, EState *estate,
+								int eflags)
+{
+	CustomScan *cscan = (CustomScan *) cscanstate->ss.ps.plan;
+	ColumnarAggScanState *aggScanState = (ColumnarAggScanState *) cscanstate;
+	ExprContext *stdecontext = cscanstate->ss.ps.ps_ExprContext;
+
+	/*
+	 * Make a new ExprContext just like the existing one, except that we don't
+	 * reset it every tuple.
+	 */
+	ExecAssignExprContext(estate, &cscanstate->ss.ps);
+	aggScanState->css_RuntimeContext = cscanstate->ss.ps.ps_ExprContext;
+	cscanstate->ss.ps.ps_ExprContext = stdecontext;
+
+	/* the relation is already locked since it is in the range table */
+	Oid relationId = linitial_oid(cscan->custom_private);
+	Relation relation = table_open(relationId, NoLock);
+	aggScanState->relation = relation;
+
+	List *scanTargetList = cscan->custom_scan_tlist;
+	aggScanState->qual = (List *) ScanTargetListVarMutator(
+		(Node *) cscan->custom_exprs, scanTargetList);
+
+	List *projectedColumnList = NIL;
+	List *clauseVarList = pull_var_clause((Node *) aggScanState->qual, 0);
+	Var *clauseVar = NULL;
+	foreach_declared_ptr(clauseVar, clauseVarList)
+	{
+		projectedColumnList = list_append_unique_int(projectedColumnList,
+													 clauseVar->varattno);
+	}
+
+	TargetEntry *targetEntry = NULL;
+	foreach_declared_ptr(targetEntry, scanTargetList)
+	{
+		if (!IsA(targetEntry->expr, Aggref))
+		{
+			continue;
+		}
+
+		ColumnarAggregate *aggregate = palloc0(sizeof(ColumnarAggregate));
+		Var *aggregatedColumn = NULL;
+
+		if (!PushableColumnarAggregate((Aggref *) targetEntry->expr, &aggregate->kind,
+									   &aggregatedColumn))
+		{
+			elog(ERROR, "unexpected aggregate in columnar aggregate scan");
+		}
+
+		if (aggregatedColumn != NULL)
+		{
+			aggregate->columnIndex = aggregatedColumn->varattno - 1;
+			aggregate->comparisonFunction = GetFunctionInfoOrNull(
+				aggregatedColumn->vartype, BTREE_AM_OID, BTORDER_PROC);
+			aggregate->collation = aggregatedColumn->varcollid;
+			get_typlenbyval(aggregatedColumn->vartype, &aggregate->typeLength,
+							&aggregate->typeByValue);
+
+			if (aggregate->comparisonFunction == NULL)
+			{
+				elog(ERROR, "no comparison function for type %u",
+					 aggregatedColumn->vartype);
+			}
+
+			projectedColumnList = list_append_unique_int(projectedColumnList,
+														 aggregatedColumn->varattno);
 		}
+
+		aggScanState->aggregateList = lappend(aggScanState->aggregateList, aggregate);
+	}
+
+	aggScanState->projectedColumnList = projectedColumnList;
+	aggScanState->rowSlot = ExecInitExtraTupleSlot(estate, RelationGetDescr(relation),
+												   &TTSOpsVirtual);
+	aggScanState->aggregateContext = AllocSetContextCreate(CurrentMemoryContext,
+														   "Columnar Aggregate Context",
+														   ALLOCSET_DEFAULT_SIZES);
+}
+
+
+/*
+ * ComputeColumnarAggregates computes the aggregates of the scan. Chunk groups
+ * whose rows all satisfy the quals are aggregated from their metadata, and the
+ * remaining chunk groups that the quals cannot refute are read row by row.
+ */
+static void
+ComputeColumnarAggregates(ColumnarAggScanState *aggScanState)
+{
+	CustomScanState *node = &aggScanState->custom_scanstate;
+	EState *estate = node->ss.ps.state;
+	ExprContext *econtext = node->ss.ps.ps_ExprContext;
+	Relation relation = aggScanState->relation;
+
+	MemoryContextReset(aggScanState->aggregateContext);
+	MemoryContext oldContext = MemoryContextSwitchTo(aggScanState->aggregateContext);
+
+	ColumnarAggregate *aggregate = NULL;
+	foreach_declared_ptr(aggregate, aggScanState->aggregateList)
+	{
+		aggregate->count = 0;
+		aggregate->hasValue = false;
+		aggregate->value = (Datum) 0;
+	}
+
+	ResetExprContext(aggScanState->css_RuntimeContext);
+	List *qual = (List *) EvalParamsMutator((Node *) aggScanState->qual,
+											aggScanState->css_RuntimeContext);
+	ExprState *qualState = ExecInitQual(qual, &node->ss.ps);
+
+	ColumnarReadState *readState = ColumnarBeginRead(relation,
+													 RelationGetDescr(relation),
+													 aggScanState->projectedColumnList,
+													 qual,
+													 aggScanState->aggregateContext,
+													 estate->es_snapshot,
+													 false, NULL);
+	ColumnarReadSetCoveredChunkGroupCallback(readState, AggregateCoveredChunkGroup,
+											 aggScanState);
+
+	TupleTableSlot *rowSlot = aggScanState->rowSlot;
+	econtext->ecxt_scantuple = rowSlot;
+
+	while (true)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		ResetExprContext(econtext);
+		ExecClearTuple(rowSlot);
+
+		if (!ColumnarReadNextRow(readState, rowSlot->tts_values, rowSlot->tts_isnull,
+								 NULL))
+		{
+			break;
+		}
+
+		ExecStoreVirtualTuple(rowSlot);
+
+		if (!ExecQual(qualState, econtext))
+		{
+			continue;
+		}
+
+		foreach_declared_ptr(aggregate, aggScanState->aggregateList)
+		{
+			if (aggregate->kind == COLUMNAR_AGGREGATE_COUNT_STAR)
+			{
+				aggregate->count++;
+			}
+			else if (!rowSlot->tts_isnull[aggregate->columnIndex])
+			{
+				AdvanceColumnarMinMaxAggregate(
+					aggregate, rowSlot->tts_values[aggregate->columnIndex]);
+			}
+		}
+	}
+
+	aggScanState->chunkGroupsFiltered = ColumnarReadChunkGroupsFiltered(readState);
+	aggScanState->chunkGroupsCovered = ColumnarReadChunkGroupsCovered(readState);
+	aggScanState->executed = true;
+
+	ColumnarEndRead(readState);
+	ExecClearTuple(rowSlot);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * AggregateCoveredChunkGroup is the ColumnarCoveredChunkGroupCallback of the
+ * columnar aggregate scan. It aggregates a chunk group whose rows all satisfy
+ * the quals using its row count and the min/max values of its column chunks.
+ */
+static bool
+AggregateCoveredChunkGroup(StripeMetadata *stripeMetadata,
+						   StripeSkipList *stripeSkipList,
+						   uint32 chunkIndex, void *callbackArg)
+{
+	ColumnarAggScanState *aggScanState = (ColumnarAggScanState *) callbackArg;
+
+	/* columns added after the stripe was written don't have chunk metadata */
+	ColumnarAggregate *aggregate = NULL;
+	foreach_declared_ptr(aggregate, aggScanState->aggregateList)
+	{
+		if (aggregate->kind != COLUMNAR_AGGREGATE_COUNT_STAR &&
+			aggregate->columnIndex >= stripeMetadata->columnCount)
+		{
+			return false;
+		}
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(aggScanState->aggregateContext);
+
+	foreach_declared_ptr(aggregate, aggScanState->aggregateList)
+	{
+		if (aggregate->kind == COLUMNAR_AGGREGATE_COUNT_STAR)
+		{
+			aggregate->count += stripeSkipList->chunkGroupRowCounts[chunkIndex];
+			continue;
+		}
+
+		/* a chunk without min/max values only has NULLs */
+		ColumnChunkSkipNode *chunkSkipNode =
+			&stripeSkipList->chunkSkipNodeArray[aggregate->columnIndex][chunkIndex];
+		if (!chunkSkipNode->hasMinMax)
+		{
+			continue;
+		}
+
+		if (aggregate->kind == COLUMNAR_AGGREGATE_MIN)
+		{
+			AdvanceColumnarMinMaxAggregate(aggregate, chunkSkipNode->minimumValue);
+		}
+		else
+		{
+			AdvanceColumnarMinMaxAggregate(aggregate, chunkSkipNode->maximumValue);
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	return true;
+}
+
+
+/*
+ * AdvanceColumnarMinMaxAggregate replaces the result of the given min() or
+ * max() aggregate with the given non-NULL value if the value is smaller or
+ * greater, respectively.
+ */
+static void
+AdvanceColumnarMinMaxAggregate(ColumnarAggregate *aggregate, Datum value)
+{
+	if (aggregate->hasValue)
+	{
+		int32 comparison = DatumGetInt32(FunctionCall2Coll(aggregate->comparisonFunction,
+														   aggregate->collation,
+														   value, aggregate->value));
+		if ((aggregate->kind == COLUMNAR_AGGREGATE_MIN && comparison >= 0) ||
+			(aggregate->kind == COLUMNAR_AGGREGATE_MAX && comparison <= 0))
+		{
+			return;
+		}
+
+		if (!aggregate->typeByValue)
+		{
+			pfree(DatumGetPointer(aggregate->value));
+		}
+	}
+
+	aggregate->value = datumCopy(value, aggregate->typeByValue, aggregate->typeLength);
+	aggregate->hasValue = true;
+}
+
+
+/*
+ * ColumnarAggScanNext computes the aggregates on the first call and returns
+ * them as the scan tuple, and returns NULL on the subsequent calls.
+ */
+static TupleTableSlot *
+ColumnarAggScanNext(ColumnarAggScanState *aggScanState)
+{
+	if (aggScanState->aggregatesComputed)
+	{
+		return NULL;
+	}
+
+	ComputeColumnarAggregates(aggScanState);
+	aggScanState->aggregatesComputed = true;
+
+	TupleTableSlot *slot = aggScanState->custom_scanstate.ss.ss_ScanTupleSlot;
+	int attributeCount = slot->tts_tupleDescriptor->natts;
+
+	ExecClearTuple(slot);
+
+	/* the columns that follow the aggregates are only referenced by the quals */
+	memset(slot->tts_isnull, true, attributeCount * sizeof(bool));
+
+	int attributeIndex = 0;
+	ColumnarAggregate *aggregate = NULL;
+	foreach_declared_ptr(aggregate, aggScanState->aggregateList)
+	{
+		if (aggregate->kind == COLUMNAR_AGGREGATE_COUNT_STAR)
+		{
+			slot->tts_values[attributeIndex] = Int64GetDatum(aggregate->count);
+			slot->tts_isnull[attributeIndex] = false;
+		}
+		else
+		{
+			slot->tts_values[attributeIndex] = aggregate->value;
+			slot->tts_isnull[attributeIndex] = !aggregate->hasValue;
+		}
+
+		attributeIndex++;
+	}
+
+	return ExecStoreVirtualTuple(slot);
+}
+
+
+/*
+ * ColumnarAggScanRecheck -- access method routine to recheck a tuple in
+ * EvalPlanQual
+ */
+static bool
+ColumnarAggScanRecheck(ColumnarAggScanState *node, TupleTableSlot *slot)
+{
+	return true;
+}
+
+
+static TupleTableSlot *
+ColumnarAggScan_ExecCustomScan(CustomScanState *node)
+{
+	return ExecScan(&node->ss,
+					(ExecScanAccessMtd) ColumnarAggScanNext,
+					(ExecScanRecheckMtd) ColumnarAggScanRecheck);
+}
+
+
+static void
+ColumnarAggScan_EndCustomScan(CustomScanState *node)
+{
+	ColumnarAggScanState *aggScanState = (ColumnarAggScanState *) node;
+
+	/*
+	 * clean out the tuple table
+	 */
+	if (node->ss.ps.ps_ResultTupleSlot)
+	{
+		ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
+	}
+	ExecClearTuple(node->ss.ss_ScanTupleSlot);
+
+	MemoryContextDelete(aggScanState->aggregateContext);
+	table_close(aggScanState->relation, NoLock);
+}
+
+
+static void
+ColumnarAggScan_ReScanCustomScan(CustomScanState *node)
+{
+	ColumnarAggScanState *aggScanState = (ColumnarAggScanState *) node;
+
+	/* the Params of the quals are evaluated again when recomputing */
+	aggScanState->aggregatesComputed = false;
+}
+
+
+static void
+ColumnarAggScan_ExplainCustomScan(CustomScanState *node, List *ancestors,
+								  ExplainState *es)
+{
+	ColumnarAggScanState *aggScanState = (ColumnarAggScanState *) node;
+	CustomScan *cscan = castNode(CustomScan, node->ss.ps.plan);
+
+	List *context = set_deparse_context_planstate(
+		es->deparse_cxt, (Node *) &node->ss.ps, ancestors);
+
+	List *chunkGroupFilter = cscan->custom_exprs;
+	if (chunkGroupFilter != NIL)
+	{
+		const char *pushdownClausesStr = ColumnarPushdownClausesStr(
+			context, chunkGroupFilter);
+		ExplainPropertyText("Columnar Chunk Group Filters",
+							pushdownClausesStr, es);
+	}
+
+	if (aggScanState->executed)
+	{
+		if (chunkGroupFilter != NIL)
+		{
+			ExplainPropertyInteger("Columnar Chunk Groups Removed by Filter",
+								   NULL, aggScanState->chunkGroupsFiltered, es);
+		}
+
+		ExplainPropertyInteger("Columnar Chunk Groups Aggregated from Metadata",
+							   NULL, aggScanState->chunkGroupsCovered, es);
 	}
 }
 
@@ -0,0 +1,1096 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_encoding.c
+ *
+ * This file contains the lightweight encodings that columnar applies to the
+ * values of a column chunk before compressing them: dictionary and run-length
+ * encoding for any data type, and delta and frame-of-reference bit-packing for
+ * pass-by-value integer-like data types.
+ *
+ * The input of the encoder is the value buffer of a column chunk, i.e.: the
+ * non-NULL values of the chunk serialized as aligned datums. We compute the
+ * size of each applicable encoding and pick the smallest one, or keep the
+ * value buffer as is if none of them makes it smaller.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/tupmacs.h"
+#include "common/hashfn.h"
+#include "port/pg_bitutils.h"
+
+#include "columnar/columnar_encoding.h"
+
+/* dictionary codes are stored as uint8 or uint16 */
+#define DICTIONARY_MAX_ENTRIES (PG_UINT16_MAX + 1)
+#define DICTIONARY_SMALL_CODE_ENTRIES (PG_UINT8_MAX + 1)
+
+#define INSUFFICIENT_ENCODED_DATA_ERR_MSG "insufficient data left in encoded buffer"
+
+
+/*
+ * PlainValues describes the datums in the value buffer of a column chunk.
+ */
+typedef struct PlainValues
+{
+	uint32 valueCount;
+	char *data;
+
+	/* offset and aligned size of each datum in data */
+	uint32 *offsets;
+	uint32 *sizes;
+} PlainValues;
+
+/*
+ * BitWriter and BitReader pack and unpack values of a fixed bit width,
+ * starting from the least significant bits of each byte.
+ */
+typedef struct BitWriter
+{
+	StringInfo buffer;
+	uint8 pendingByte;
+	int pendingBits;
+} BitWriter;
+
+typedef struct BitReader
+{
+	const unsigned char *current;
+	const unsigned char *end;
+	uint64 pendingBits;
+	int pendingBitCount;
+} BitReader;
+
+
+static PlainValues * ParsePlainValues(StringInfo valueBuffer, uint32 valueCount,
+									  Form_pg_attribute attributeForm);
+static bool PlainValuesEqual(PlainValues *values, uint32 leftIndex, uint32 rightIndex);
+static uint32 * BuildDictionaryCodes(PlainValues *values, uint32 *entryCount,
+									 uint32 **entryValueIndexes);
+static uint32 CountRuns(PlainValues *values, uint64 *runValuesLength);
+static bool IsIntegerEncodable(Form_pg_attribute attributeForm);
+static int64 * ReadPlainIntegers(PlainValues *values, int16 typeLength);
+static int BitWidth(uint64 range);
+static uint64 BitPackedSize(uint64 valueCount, int bitWidth);
+static void EncodeDictionary(PlainValues *values, uint32 *codes, uint32 entryCount,
+							 uint32 *entryValueIndexes, StringInfo outputBuffer);
+static void EncodeRunLength(PlainValues *values, uint32 runCount,
+							uint64 runValuesLength, StringInfo outputBuffer);
+static void EncodeFrameOfReference(int64 *integers, uint32 valueCount,
+								   int64 reference, int bitWidth,
+								   StringInfo outputBuffer);
+static void EncodeDelta(int64 *integers, uint32 valueCount, int64 minDelta,
+						int bitWidth, StringInfo outputBuffer);
+static void DecodeDictionaryEntries(StringInfo encodedBuffer, uint32 *offset,
+									uint32 entryCount, uint32 entriesLength,
+									Form_pg_attribute attributeForm,
+									ChunkColumnDictionary *dictionary);
+static void DecodeDictionary(StringInfo encodedBuffer, bool *existsArray,
+							 uint32 datumCount, uint32 valueCount,
+							 Form_pg_attribute attributeForm, Datum *datumArray,
+							 ChunkColumnDictionary *dictionary);
+static void DecodeRunLength(StringInfo encodedBuffer, bool *existsArray,
+							uint32 datumCount, Form_pg_attribute attributeForm,
+							Datum *datumArray, ChunkColumnDictionary *dictionary);
+static void DecodeIntegers(StringInfo encodedBuffer, EncodingType encodingType,
+						   bool *existsArray, uint32 datumCount, int16 typeLength,
+						   Datum *datumArray);
+static Datum IntegerGetDatum(int64 value, int16 typeLength);
+static void AppendUInt32(StringInfo buffer, uint32 value);
+static void AppendInt64(StringInfo buffer, int64 value);
+static uint32 ReadUInt32(StringInfo buffer, uint32 *offset);
+static int64 ReadInt64(StringInfo buffer, uint32 *offset);
+static void BitWriterAppend(BitWriter *writer, uint64 value, int bitWidth);
+static void BitWriterFlush(BitWriter *writer);
+static inline uint64 BitReaderRead(BitReader *reader, int bitWidth);
+
+
+/*
+ * EncodeValueBuffer encodes the given value buffer that contains valueCount
+ * datums into outputBuffer using the encoding that results in the smallest
+ * size, and returns the encoding type. The function returns ENCODING_NONE if
+ * none of the encodings makes the value buffer smaller, and outputBuffer is
+ * only valid if it returns a different encoding type.
+ */
+EncodingType
+EncodeValueBuffer(StringInfo valueBuffer, uint32 valueCount,
+				  Form_pg_attribute attributeForm, StringInfo outputBuffer)
+{
+	if (valueCount == 0)
+	{
+		return ENCODING_NONE;
+	}
+
+	PlainValues *values = ParsePlainValues(valueBuffer, valueCount, attributeForm);
+
+	EncodingType bestEncodingType = ENCODING_NONE;
+	uint64 bestSize = valueBuffer->len;
+
+	/* dictionary encoding, for low-cardinality columns */
+	uint32 entryCount = 0;
+	uint32 *entryValueIndexes = NULL;
+	uint32 *codes = BuildDictionaryCodes(values, &entryCount, &entryValueIndexes);
+	if (codes != NULL)
+	{
+		uint64 entriesLength = 0;
+		for (uint32 entryIndex = 0; entryIndex < entryCount; entryIndex++)
+		{
+			entriesLength += values->sizes[entryValueIndexes[entryIndex]];
+		}
+
+		uint64 codeWidth = entryCount <= DICTIONARY_SMALL_CODE_ENTRIES ?
+						   sizeof(uint8) : sizeof(uint16);
+		uint64 dictionarySize = 2 * sizeof(uint32) + entriesLength +
+								valueCount * codeWidth;
+		if (dictionarySize < bestSize)
+		{
+			bestEncodingType = ENCODING_DICTIONARY;
+			bestSize = dictionarySize;
+		}
+	}
+
+	/* run-length encoding, for columns with long runs of the same value */
+	uint64 runValuesLength = 0;
+	uint32 runCount = CountRuns(values, &runValuesLength);
+	uint64 runLengthSize = 2 * sizeof(uint32) + runValuesLength +
+						   (uint64) runCount * sizeof(uint32);
+	if (runLengthSize < bestSize)
+	{
+		bestEncodingType = ENCODING_RLE;
+		bestSize = runLengthSize;
+	}
+
+	/* frame-of-reference and delta bit-packing, for integer-like columns */
+	int64 *integers = NULL;
+	int64 minValue = 0;
+	int64 minDelta = 0;
+	int forBitWidth = 0;
+	int deltaBitWidth = 0;
+	if (IsIntegerEncodable(attributeForm))
+	{
+		integers = ReadPlainIntegers(values, attributeForm->attlen);
+
+		int64 maxValue = integers[0];
+		minValue = integers[0];
+		for (uint32 valueIndex = 1; valueIndex < valueCount; valueIndex++)
+		{
+			minValue = Min(minValue, integers[valueIndex]);
+			maxValue = Max(maxValue, integers[valueIndex]);
+		}
+
+		forBitWidth = BitWidth((uint64) maxValue - (uint64) minValue);
+		uint64 forSize = sizeof(int64) + sizeof(uint8) +
+						 BitPackedSize(valueCount, forBitWidth);
+		if (forSize < bestSize)
+		{
+			bestEncodingType = ENCODING_FOR;
+			bestSize = forSize;
+		}
+
+		if (valueCount > 1)
+		{
+			/* deltas wrap around, decoding wraps them back */
+			int64 maxDelta = (int64) ((uint64) integers[1] - (uint64) integers[0]);
+			minDelta = maxDelta;
+			for (uint32 valueIndex = 2; valueIndex < valueCount; valueIndex++)
+			{
+				int64 delta = (int64) ((uint64) integers[valueIndex] -
+									   (uint64) integers[valueIndex - 1]);
+				minDelta = Min(minDelta, delta);
+				maxDelta = Max(maxDelta, delta);
+			}
+
+			deltaBitWidth = BitWidth((uint64) maxDelta - (uint64) minDelta);
+			uint64 deltaSize = 2 * sizeof(int64) + sizeof(uint8) +
+							   BitPackedSize(valueCount - 1, deltaBitWidth);
+			if (deltaSize < bestSize)
+			{
+				bestEncodingType = ENCODING_DELTA;
+				bestSize = deltaSize;
+			}
+		}
+	}
+
+	resetStringInfo(outputBuffer);
+
+	switch (bestEncodingType)
+	{
+		case ENCODING_DICTIONARY:
+		{
+			EncodeDictionary(values, codes, entryCount, entryValueIndexes,
+							 outputBuffer);
+			break;
+		}
+
+		case ENCODING_RLE:
+		{
+			EncodeRunLength(values, runCount, runValuesLength, outputBuffer);
+			break;
+		}
+
+		case ENCODING_FOR:
+		{
+			EncodeFrameOfReference(integers, valueCount, minValue, forBitWidth,
+								   outputBuffer);
+			break;
+		}
+
+		case ENCODING_DELTA:
+		{
+			EncodeDelta(integers, valueCount, minDelta, deltaBitWidth, outputBuffer);
+			break;
+		}
+
+		default:
+		{
+			break;
+		}
+	}
+
+	Assert(bestEncodingType == ENCODING_NONE || outputBuffer->len == bestSize);
+
+	/* this is called for each column chunk, don't accumulate until stripe flush */
+	if (codes != NULL)
+	{
+		pfree(codes);
+		pfree(entryValueIndexes);
+	}
+
+	if (integers != NULL)
+	{
+		pfree(integers);
+	}
+
+	pfree(values->offsets);
+	pfree(values->sizes);
+	pfree(values);
+
+	return bestEncodingType;
+}
+
+
+/*
+ * DecodeDatumArray decodes the values in the given encoded buffer into the
+ * entries of datumArray for which existsArray is true. Datums of types that
+ * are passed by reference point into encodedBuffer, so it should outlive
+ * datumArray.
+ *
+ * For dictionary and run-length encoded buffers, the function also returns
+ * the distinct values or the runs of the chunk in dictionary, so that quals
+ * can be evaluated once per entry. Otherwise, dictionary is set to NULL.
+ */
+void
+DecodeDatumArray(StringInfo encodedBuffer, EncodingType encodingType,
+				 bool *existsArray, uint32 datumCount,
+				 Form_pg_attribute attributeForm, Datum *datumArray,
+				 ChunkColumnDictionary **dictionary)
+{
+	uint32 valueCount = 0;
+	for (uint32 datumIndex = 0; datumIndex < datumCount; datumIndex++)
+	{
+		valueCount += existsArray[datumIndex];
+	}
+
+	*dictionary = NULL;
+
+	switch (encodingType)
+	{
+		case ENCODING_DICTIONARY:
+		{
+			*dictionary = palloc0(sizeof(ChunkColumnDictionary));
+			DecodeDictionary(encodedBuffer, existsArray, datumCount, valueCount,
+							 attributeForm, datumArray, *dictionary);
+			break;
+		}
+
+		case ENCODING_RLE:
+		{
+			*dictionary = palloc0(sizeof(ChunkColumnDictionary));
+			DecodeRunLength(encodedBuffer, existsArray, datumCount, attributeForm,
+							datumArray, *dictionary);
+			break;
+		}
+
+		case ENCODING_DELTA:
+		case ENCODING_FOR:
+		{
+			if (!IsIntegerEncodable(attributeForm))
+			{
+				ereport(ERROR, (errmsg("unexpected columnar encoding type %d for "
+									   "a column of type %u", encodingType,
+									   attributeForm->atttypid)));
+			}
+
+			DecodeIntegers(encodedBuffer, encodingType, existsArray, datumCount,
+						   attributeForm->attlen, datumArray);
+			break;
+		}
+
+		default:
+		{
+			ereport(ERROR, (errmsg("unknown columnar encoding type: %d",
+								   encodingType)));
+		}
+	}
+}
+
+
+/*
+ * ParsePlainValues finds the offset and the aligned size of each datum in the
+ * given value buffer.
+ */
+static PlainValues *
+ParsePlainValues(StringInfo valueBuffer, uint32 valueCount,
+				 Form_pg_attribute attributeForm)
+{
+	PlainValues *values = palloc0(sizeof(PlainValues));
+	values->valueCount = valueCount;
+	values->data = valueBuffer->data;
+	values->offsets = palloc(valueCount * sizeof(uint32));
+	values->sizes = palloc(valueCount * sizeof(uint32));
+
+	uint32 currentOffset = 0;
+	for (uint32 valueIndex = 0; valueIndex < valueCount; valueIndex++)
+	{
+		char *currentDatumPointer = valueBuffer->data + currentOffset;
+		uint32 nextOffset = att_addlength_pointer(currentOffset, attributeForm->attlen,
+												  currentDatumPointer);
+		nextOffset = att_align_nominal(nextOffset, attributeForm->attalign);
+
+		if (nextOffset > valueBuffer->len)
+		{
+			ereport(ERROR, (errmsg("insufficient data left in datum buffer")));
+		}
+
+		values->offsets[valueIndex] = currentOffset;
+		values->sizes[valueIndex] = nextOffset - currentOffset;
+		currentOffset = nextOffset;
+	}
+
+	return values;
+}
+
+
+/*
+ * PlainValuesEqual returns whether the serialized forms of the given datums
+ * are the same.
+ */
+static bool
+PlainValuesEqual(PlainValues *values, uint32 leftIndex, uint32 rightIndex)
+{
+	return values->sizes[leftIndex] == values->sizes[rightIndex] &&
+		   memcmp(values->data + values->offsets[leftIndex],
+				  values->data + values->offsets[rightIndex],
+				  values->sizes[leftIndex]) == 0;
+}
+
+
+/*
+ * BuildDictionaryCodes assigns each distinct value a code and returns the code
+ * of each value. entryValueIndexes is set to the index of the first value with
+ * each code. Returns NULL if there are too many distinct values to use
+ * dictionary encoding.
+ */
+static uint32 *
+BuildDictionaryCodes(PlainValues *values, uint32 *entryCount,
+					 uint32 **entryValueIndexes)
+{
+	uint32 maxEntryCount = Min(values->valueCount, DICTIONARY_MAX_ENTRIES);
+
+	/* open addressing hash table of entries, kept at most half full */
+	uint32 slotCount = pg_nextpower2_32(Max(maxEntryCount * 2, 16));
+	int32 *slots = palloc(slotCount * sizeof(int32));
+	memset(slots, -1, slotCount * sizeof(int32));
+
+	uint32 *entries = palloc(maxEntryCount * sizeof(uint32));
+	uint32 *codes = palloc(values->valueCount * sizeof(uint32));
+	uint32 currentEntryCount = 0;
+
+	for (uint32 valueIndex = 0; valueIndex < values->valueCount; valueIndex++)
+	{
+		uint32 hash = hash_bytes((unsigned char *) values->data +
+								 values->offsets[valueIndex],
+								 values->sizes[valueIndex]);
+		uint32 slot = hash & (slotCount - 1);
+
+		while (slots[slot] != -1 &&
+			   !PlainValuesEqual(values, entries[slots[slot]], valueIndex))
+		{
+			slot = (slot + 1) & (slotCount - 1);
+		}
+
+		if (slots[slot] == -1)
+		{
+			if (currentEntryCount == maxEntryCount)
+			{
+				pfree(slots);
+				pfree(entries);
+				pfree(codes);
+				return NULL;
+			}
+
+			entries[currentEntryCount] = valueIndex;
+			slots[slot] = currentEntryCount;
+			currentEntryCount++;
+		}
+
+		codes[valueIndex] = slots[slot];
+	}
+
+	pfree(slots);
+
+	*entryCount = currentEntryCount;
+	*entryValueIndexes = entries;
+	return codes;
+}
+
+
+/*
+ * CountRuns returns the number of runs of the same value in the given values,
+ * and sets runValuesLength to the total size of the first value of each run.
+ */
+static uint32
+CountRuns(PlainValues *values, uint64 *runValuesLength)
+{
+	uint32 runCount = 0;
+	*runValuesLength = 0;
+
+	for (uint32 valueIndex = 0; valueIndex < values->valueCount; valueIndex++)
+	{
+		if (valueIndex == 0 || !PlainValuesEqual(values, valueIndex - 1, valueIndex))
+		{
+			runCount++;
+			*runValuesLength += values->sizes[valueIndex];
+		}
+	}
+
+	return runCount;
+}
+
+
+/*
+ * IsIntegerEncodable returns whether the values of the given column can be
+ * delta or frame-of-reference encoded. This is the case for the types that
+ * are passed by value and that are stored as 2, 4 or 8 byte integers, such as
+ * integers, dates and timestamps. Other such types (e.g.: floats) are encoded
+ * losslessly too, but usually don't benefit.
+ */
+static bool
+IsIntegerEncodable(Form_pg_attribute attributeForm)
+{
+	return attributeForm->attbyval &&
+		   (attributeForm->attlen == sizeof(int16) ||
+			attributeForm->attlen == sizeof(int32) ||
+			attributeForm->attlen == sizeof(int64));
+}
+
+
+/*
+ * ReadPlainIntegers returns the given integer values as sign-extended int64s.
+ */
+static int64 *
+ReadPlainIntegers(PlainValues *values, int16 typeLength)
+{
+	int64 *integers = palloc(values->valueCount * sizeof(int64));
+
+	for (uint32 valueIndex = 0; valueIndex < values->valueCount; valueIndex++)
+	{
+		char *valuePointer = values->data + values->offsets[valueIndex];
+
+		switch (typeLength)
+		{
+			case sizeof(int16):
+			{
+				int16 value = 0;
+				memcpy(&value, valuePointer, sizeof(int16)); /* IGNORE-BANNED */
+				integers[valueIndex] = value;
+				break;
+			}
+
+			case sizeof(int32):
+			{
+				int32 value = 0;
+				memcpy(&value, valuePointer, sizeof(int32)); /* IGNORE-BANNED */
+				integers[valueIndex] = value;
+				break;
+			}
+
+			default:
+			{
+				int64 value = 0;
+				memcpy(&value, valuePointer, sizeof(int64)); /* IGNORE-BANNED */
+				integers[valueIndex] = value;
+				break;
+			}
+		}
+	}
+
+	return integers;
+}
+
+
+/*
+ * BitWidth returns the number of bits needed to store values in [0, range].
+ */
+static int
+BitWidth(uint64 range)
+{
+	return range == 0 ? 0 : pg_leftmost_one_pos64(range) + 1;
+}
+
+
+/*
+ * BitPackedSize returns the number of bytes needed to store valueCount values
+ * of the given bit width.
+ */
+static uint64
+BitPackedSize(uint64 valueCount, int bitWidth)
+{
+	return (valueCount * bitWidth + 7) / 8;
+}
+
+
+/*
+ * EncodeDictionary writes the dictionary encoded form of the given values:
+ *
+ * [uint32 entryCount][uint32 entriesLength][entries][codes]
+ *
+ * where entries are the distinct values serialized as aligned datums, and
+ * codes are uint8s if there are at most 256 entries and uint16s otherwise.
+ * The header keeps the entries maximally aligned.
+ */
+static void
+EncodeDictionary(PlainValues *values, uint32 *codes, uint32 entryCount,
+				 uint32 *entryValueIndexes, StringInfo outputBuffer)
+{
+	uint32 entriesLength = 0;
+	for (uint32 entryIndex = 0; entryIndex < entryCount; entryIndex++)
+	{
+		entriesLength += values->sizes[entryValueIndexes[entryIndex]];
+	}
+
+	AppendUInt32(outputBuffer, entryCount);
+	AppendUInt32(outputBuffer, entriesLength);
+
+	for (uint32 entryIndex = 0; entryIndex < entryCount; entryIndex++)
+	{
+		uint32 valueIndex = entryValueIndexes[entryIndex];
+		appendBinaryStringInfo(outputBuffer, values->data + values->offsets[valueIndex],
+							   values->sizes[valueIndex]);
+	}
+
+	for (uint32 valueIndex = 0; valueIndex < values->valueCount; valueIndex++)
+	{
+		if (entryCount <= DICTIONARY_SMALL_CODE_ENTRIES)
+		{
+			uint8 code = codes[valueIndex];
+			appendBinaryStringInfo(outputBuffer, (char *) &code, sizeof(uint8));
+		}
+		else
+		{
+			uint16 code = codes[valueIndex];
+			appendBinaryStringInfo(outputBuffer, (char *) &code, sizeof(uint16));
+		}
+	}
+}
+
+
+/*
+ * EncodeRunLength writes the run-length encoded form of the given values:
+ *
+ * [uint32 runCount][uint32 runValuesLength][run values][uint32 run lengths]
+ *
+ * where run values are the value of each run serialized as aligned datums.
+ */
+static void
+EncodeRunLength(PlainValues *values, uint32 runCount, uint64 runValuesLength,
+				StringInfo outputBuffer)
+{
+	AppendUInt32(outputBuffer, runCount);
+	AppendUInt32(outputBuffer, runValuesLength);
+
+	uint32 *runLengths = palloc0(runCount * sizeof(uint32));
+	int64 runIndex = -1;
+
+	for (uint32 valueIndex = 0; valueIndex < values->valueCount; valueIndex++)
+	{
+		if (valueIndex == 0 || !PlainValuesEqual(values, valueIndex - 1, valueIndex))
+		{
+			runIndex++;
+			appendBinaryStringInfo(outputBuffer,
+								   values->data + values->offsets[valueIndex],
+								   values->sizes[valueIndex]);
+		}
+
+		runLengths[runIndex]++;
+	}
+
+	appendBinaryStringInfo(outputBuffer, (char *) runLengths,
+						   runCount * sizeof(uint32));
+	pfree(runLengths);
+}
+
+
+/*
+ * EncodeFrameOfReference writes the frame-of-reference encoded form of the
+ * given integers:
+ *
+ * [int64 reference][uint8 bitWidth][bit-packed (value - reference)s]
+ */
+static void
+EncodeFrameOfReference(int64 *integers, uint32 valueCount, int64 reference,
+					   int bitWidth, StringInfo outputBuffer)
+{
+	AppendInt64(outputBuffer, reference);
+	appendStringInfoChar(outputBuffer, (char) bitWidth);
+
+	BitWriter writer = { .buffer = outputBuffer };
+	for (uint32 valueIndex = 0; valueIndex < valueCount; valueIndex++)
+	{
+		BitWriterAppend(&writer, (uint64) integers[valueIndex] - (uint64) reference,
+						bitWidth);
+	}
+
+	BitWriterFlush(&writer);
+}
+
+
+/*
+ * EncodeDelta writes the delta encoded form of the given integers:
+ *
+ * [int64 firstValue][int64 minDelta][uint8 bitWidth][bit-packed (delta - minDelta)s]
+ *
+ * where delta is the difference of each value from the previous one. For
+ * monotone sequences with a fixed step, such as serials or timestamps taken at
+ * regular intervals, bitWidth is 0 and the encoded form has a constant size.
+ */
+static void
+EncodeDelta(int64 *integers, uint32 valueCount, int64 minDelta, int bitWidth,
+			StringInfo outputBuffer)
+{
+	AppendInt64(outputBuffer, integers[0]);
+	AppendInt64(outputBuffer, minDelta);
+	appendStringInfoChar(outputBuffer, (char) bitWidth);
+
+	BitWriter writer = { .buffer = outputBuffer };
+	for (uint32 valueIndex = 1; valueIndex < valueCount; valueIndex++)
+	{
+		uint64 delta = (uint64) integers[valueIndex] - (uint64) integers[valueIndex - 1];
+		BitWriterAppend(&writer, delta - (uint64) minDelta, bitWidth);
+	}
+
+	BitWriterFlush(&writer);
+}
+
+
+/*
+ * DecodeDictionaryEntries reads entryCount aligned datums from the given
+ * offset of encodedBuffer into dictionary->entries, and advances offset past
+ * them.
+ */
+static void
+DecodeDictionaryEntries(StringInfo encodedBuffer, uint32 *offset, uint32 entryCount,
+						uint32 entriesLength, Form_pg_attribute attributeForm,
+						ChunkColumnDictionary *dictionary)
+{
+	if ((uint64) *offset + entriesLength > encodedBuffer->len)
+	{
+		ereport(ERROR, (errmsg(INSUFFICIENT_ENCODED_DATA_ERR_MSG)));
+	}
+
+	uint32 entriesEnd = *offset + entriesLength;
+	uint32 currentOffset = *offset;
+
+	dictionary->entryCount = entryCount;
+	dictionary->entries = palloc(Max(entryCount, 1) * sizeof(Datum));
+
+	for (uint32 entryIndex = 0; entryIndex < entryCount; entryIndex++)
+	{
+		if (currentOffset >= entriesEnd)
+		{
+			ereport(ERROR, (errmsg(INSUFFICIENT_ENCODED_DATA_ERR_MSG)));
+		}
+
+		char *currentDatumPointer = encodedBuffer->data + currentOffset;
+		dictionary->entries[entryIndex] = fetch_att(currentDatumPointer,
+													attributeForm->attbyval,
+													attributeForm->attlen);
+		currentOffset = att_addlength_datum(currentOffset, attributeForm->attlen,
+											dictionary->entries[entryIndex]);
+		currentOffset = att_align_nominal(currentOffset, attributeForm->attalign);
+
+		if (currentOffset > entriesEnd)
+		{
+			ereport(ERROR, (errmsg(INSUFFICIENT_ENCODED_DATA_ERR_MSG)));
+		}
+	}
+
+	*offset = entriesEnd;
+}
+
+
+/*
+ * DecodeDictionary decodes a dictionary encoded buffer, see EncodeDictionary.
+ */
+static void
+DecodeDictionary(StringInfo encodedBuffer, bool *existsArray, uint32 datumCount,
+				 uint32 valueCount, Form_pg_attribute attributeForm,
+				 Datum *datumArray, ChunkColumnDictionary *dictionary)
+{
+	uint32 offset = 0;
+	uint32 entryCount = ReadUInt32(encodedBuffer, &offset);
+	uint32 entriesLength = ReadUInt32(encodedBuffer, &offset);
+
+	DecodeDictionaryEntries(encodedBuffer, &offset, entryCount, entriesLength,
+							attributeForm, dictionary);
+
+	uint32 codeWidth = entryCount <= DICTIONARY_SMALL_CODE_ENTRIES ?
+					   sizeof(uint8) : sizeof(uint16);
+	if ((uint64) offset + (uint64) valueCount * codeWidth > encodedBuffer->len)
+	{
+		ereport(ERROR, (errmsg(INSUFFICIENT_ENCODED_DATA_ERR_MSG)));
+	}
+
+	const unsigned char *codes = (unsigned char *) encodedBuffer->data + offset;
+	dictionary->entryIndexes = palloc0(datumCount * sizeof(uint32));
+
+	for (uint32 datumIndex = 0; datumIndex < datumCount; datumIndex++)
+	{
+		if (!existsArray[datumIndex])
+		{
+			continue;
+		}
+
+		uint32 code = 0;
+		if (codeWidth == sizeof(uint8))
+		{
+			code = *codes;
+		}
+		else
+		{
+			uint16 wideCode = 0;
+			memcpy(&wideCode, codes, sizeof(uint16)); /* IGNORE-BANNED */
+			code = wideCode;
+		}
+
+		codes += codeWidth;
+
+		if (code >= entryCount)
+		{
+			ereport(ERROR, (errmsg("invalid columnar dictionary code %u", code)));
+		}
+
+		datumArray[datumIndex] = dictionary->entries[code];
+		dictionary->entryIndexes[datumIndex] = code;
+	}
+}
+
+
+/*
+ * DecodeRunLength decodes a run-length encoded buffer, see EncodeRunLength.
+ * The runs are returned as the entries of dictionary.
+ */
+static void
+DecodeRunLength(StringInfo encodedBuffer, bool *existsArray, uint32 datumCount,
+				Form_pg_attribute attributeForm, Datum *datumArray,
+				ChunkColumnDictionary *dictionary)
+{
+	uint32 offset = 0;
+	uint32 runCount = ReadUInt32(encodedBuffer, &offset);
+	uint32 runValuesLength = ReadUInt32(encodedBuffer, &offset);
+
+	DecodeDictionaryEntries(encodedBuffer, &offset, runCount, runValuesLength,
+							attributeForm, dictionary);
+
+	if ((uint64) offset + (uint64) runCount * sizeof(uint32) > encodedBuffer->len)
+	{
+		ereport(ERROR, (errmsg(INSUFFICIENT_ENCODED_DATA_ERR_MSG)));
+	}
+
+	dictionary->entryIndexes = palloc0(datumCount * sizeof(uint32));
+
+	int64 runIndex = -1;
+	uint32 remainingRunLength = 0;
+
+	for (uint32 datumIndex = 0; datumIndex < datumCount; datumIndex++)
+	{
+		if (!existsArray[datumIndex])
+		{
+			continue;
+		}
+
+		while (remainingRunLength == 0)
+		{
+			runIndex++;
+			if (runIndex >= runCount)
+			{
+				ereport(ERROR, (errmsg(INSUFFICIENT_ENCODED_DATA_ERR_MSG)));
+			}
+
+			remainingRunLength = ReadUInt32(encodedBuffer, &offset);
+		}
+
+		datumArray[datumIndex] = dictionary->entries[runIndex];
+		dictionary->entryIndexes[datumIndex] = runIndex;
+		remainingRunLength--;
+	}
+}
+
+
+/*
+ * DecodeIntegers decodes a delta or frame-of-reference encoded buffer, see
+ * EncodeDelta and EncodeFrameOfReference.
+ */
+static void
+DecodeIntegers(StringInfo encodedBuffer, EncodingType encodingType,
+			   bool *existsArray, uint32 datumCount, int16 typeLength,
+			   Datum *datumArray)
+{
+	uint32 offset = 0;
+	uint64 currentValue = (uint64) ReadInt64(encodedBuffer, &offset);
+	uint64 minDelta = 0;
+
+	if (encodingType == ENCODING_DELTA)
+	{
+		minDelta = (uint64) ReadInt64(encodedBuffer, &offset);
+	}
+
+	if (offset >= encodedBuffer->len)
+	{
+		ereport(ERROR, (errmsg(INSUFFICIENT_ENCODED_DATA_ERR_MSG)));
+	}
+
+	int bitWidth = (uint8) encodedBuffer->data[offset];
+	offset++;
+
+	if (bitWidth > 64)
+	{
+		ereport(ERROR, (errmsg("invalid columnar bit width %d", bitWidth)));
+	}
+
+	BitReader reader = {
+		.current = (unsigned char *) encodedBuffer->data + offset,
+		.end = (unsigned char *) encodedBuffer->data + encodedBuffer->len
+	};
+
+	bool firstValue = true;
+	for (uint32 datumIndex = 0; datumIndex < datumCount; datumIndex++)
+	{
+		if (!existsArray[datumIndex])
+		{
+			continue;
+		}
+
+		if (encodingType == ENCODING_FOR)
+		{
+			uint64 reference = currentValue;
+			datumArray[datumIndex] =
+				IntegerGetDatum(reference + BitReaderRead(&reader, bitWidth),
+								typeLength);
+			continue;
+		}
+
+		if (!firstValue)
+		{
+			currentValue += minDelta + BitReaderRead(&reader, bitWidth);
+		}
+
+		datumArray[datumIndex] = IntegerGetDatum(currentValue, typeLength);
+		firstValue = false;
+	}
+}
+
+
+/*
+ * IntegerGetDatum converts the given sign-extended integer back to a datum of
+ * the given length, the same way fetch_att does.
+ */
+static Datum
+IntegerGetDatum(int64 value, int16 typeLength)
+{
+	switch (typeLength)
+	{
+		case sizeof(int16):
+		{
+			return Int16GetDatum((int16) value);
+		}
+
+		case sizeof(int32):
+		{
+			return Int32GetDatum((int32) value);
+		}
+
+		default:
+		{
+			return Int64GetDatum(value);
+		}
+	}
+}
+
+
+/*
+ * AppendUInt32 appends the given integer to buffer.
+ */
+static void
+AppendUInt32(StringInfo buffer, uint32 value)
+{
+	appendBinaryStringInfo(buffer, (char *) &value, sizeof(uint32));
+}
+
+
+/*
+ * AppendInt64 appends the given integer to buffer.
+ */
+static void
+AppendInt64(StringInfo buffer, int64 value)
+{
+	appendBinaryStringInfo(buffer, (char *) &value, sizeof(int64));
+}
+
+
+/*
+ * ReadUInt32 reads an integer from the given offset of buffer, and advances
+ * offset past it.
+ */
+static uint32
+ReadUInt32(StringInfo buffer, uint32 *offset)
+{
+	uint32 value = 0;
+
+	if ((uint64) *offset + sizeof(uint32) > buffer->len)
+	{
+		ereport(ERROR, (errmsg(INSUFFICIENT_ENCODED_DATA_ERR_MSG)));
+	}
+
+	memcpy(&value, buffer->data + *offset, sizeof(uint32)); /* IGNORE-BANNED */
+	*offset += sizeof(uint32);
+
+	return value;
+}
+
+
+/*
+ * ReadInt64 reads an integer from the given offset of buffer, and advances
+ * offset past it.
+ */
+static int64
+ReadInt64(StringInfo buffer, uint32 *offset)
+{
+	int64 value = 0;
+
+	if ((uint64) *offset + sizeof(int64) > buffer->len)
+	{
+		ereport(ERROR, (errmsg(INSUFFICIENT_ENCODED_DATA_ERR_MSG)));
+	}
+
+	memcpy(&value, buffer->data + *offset, sizeof(int64)); /* IGNORE-BANNED */
+	*offset += sizeof(int64);
+
+	return value;
+}
+
+
+/*
+ * BitWriterAppend appends the lowest bitWidth bits of value.
+ */
+static void
+BitWriterAppend(BitWriter *writer, uint64 value, int bitWidth)
+{
+	while (bitWidth > 0)
+	{
+		int bitCount = Min(8 - writer->pendingBits, bitWidth);
+		uint8 bits = value & ((1 << bitCount) - 1);
+
+		writer->pendingByte |= bits << writer->pendingBits;
+		writer->pendingBits += bitCount;
+
+		value >>= bitCount;
+		bitWidth -= bitCount;
+
+		if (writer->pendingBits == 8)
+		{
+			appendStringInfoChar(writer->buffer, (char) writer->pendingByte);
+			writer->pendingByte = 0;
+			writer->pendingBits = 0;
+		}
+	}
+}
+
+
+/*
+ * BitWriterFlush appends the last partially filled byte, if any.
+ */
+static void
+BitWriterFlush(BitWriter *writer)
+{
+	if (writer->pendingBits > 0)
+	{
+		appendStringInfoChar(writer->buffer, (char) writer->pendingByte);
+		writer->pendingByte = 0;
+		writer->pendingBits = 0;
+	}
+}
+
+
+/*
+ * BitReaderRead reads the next value of the given bit width. We buffer up to
+ * 64 bits at a time, so most values are extracted with a shift and a mask.
+ */
+static inline uint64
+BitReaderRead(BitReader *reader, int bitWidth)
+{
+	if (bitWidth == 0)
+	{
+		return 0;
+	}
+
+	while (reader->pendingBitCount < bitWidth && reader->pendingBitCount <= 56)
+	{
+		if (reader->current >= reader->end)
+		{
+			ereport(ERROR, (errmsg(INSUFFICIENT_ENCODED_DATA_ERR_MSG)));
+		}
+
+		reader->pendingBits |= (uint64) *reader->current << reader->pendingBitCount;
+		reader->current++;
+		reader->pendingBitCount += 8;
+	}
+
+	if (reader->pendingBitCount >= bitWidth)
+	{
+		uint64 value = reader->pendingBits;
+		if (bitWidth < 64)
+		{
+			value &= (UINT64CONST(1) << bitWidth) - 1;
+			reader->pendingBits >>= bitWidth;
+		}
+		else
+		{
+			reader->pendingBits = 0;
+		}
+
+		reader->pendingBitCount -= bitWidth;
+		return value;
+	}
+
+	/* a wide value that doesn't fit into the buffered bits with another byte */
+	if (reader->current >= reader->end)
+	{
+		ereport(ERROR, (errmsg(INSUFFICIENT_ENCODED_DATA_ERR_MSG)));
+	}
+
+	int missingBitCount = bitWidth - reader->pendingBitCount;
+	uint64 nextByte = *reader->current;
+	reader->current++;
+
+	uint64 value = reader->pendingBits |
+				   ((nextByte & ((1 << missingBitCount) - 1)) <<
+					reader->pendingBitCount);
+
+	reader->pendingBits = nextByte >> missingBitCount;
+	reader->pendingBitCount = 8 - missingBitCount;
+
+	return value;
+}
@@ -13,7 +13,7 @@
  *   * useful for fast VACUUM operations (e.g. reporting with VACUUM VERBOSE)
  *   * useful for stats/costing
  *   * maps logical row numbers to stripe IDs
- *   * TODO: visibility information
+ *   * holds the masks of the deleted rows of stripes
  *
  *-------------------------------------------------------------------------
  */
@@ -49,17 +49,21 @@
 #include "storage/procarray.h"
 #include "storage/relfilelocator.h"
 #include "storage/smgr.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/relfilenumbermap.h"
+#include "utils/syscache.h"
 
 #include "citus_version.h"
 #include "pg_version_constants.h"
 
 #include "columnar/columnar.h"
+#include "columnar/columnar_bloom_filter.h"
+#include "columnar/columnar_row_mask.h"
 #include "columnar/columnar_storage.h"
 #include "columnar/columnar_version_compat.h"
 
@@ -100,6 +104,12 @@ static void InsertEmptyStripeMetadataRow(uint64 storageId, uint64 stripeId,
 static void GetHighestUsedAddressAndId(uint64 storageId,
 									   uint64 *highestUsedAddress,
 									   uint64 *highestUsedId);
+static List * ReadNonVacuumableStripeList(uint64 storageId);
+static List * ReadUnprunedStripeList(uint64 storageId);
+static int CompareStripesByFileOffset(const ListCell *leftCell,
+									  const ListCell *rightCell);
+static uint64 TakeReusableDataRange(List *rangeList, uint64 amount);
+static uint64 AlignOffsetToPage(uint64 logicalOffset);
 static StripeMetadata * UpdateStripeMetadataRow(uint64 storageId, uint64 stripeId,
 												uint64 fileOffset, uint64 dataLength,
 												uint64 rowCount, uint64 chunkCount);
@@ -119,9 +129,21 @@ static Oid ColumnarChunkRelationId(void);
 static Oid ColumnarChunkGroupRelationId(void);
 static Oid ColumnarChunkIndexRelationId(void);
 static Oid ColumnarChunkGroupIndexRelationId(void);
+static Oid ColumnarStripeSummaryRelationId(void);
+static Oid ColumnarStripeSummaryIndexRelationId(void);
+static Oid ColumnarRowMaskRelationId(void);
+static Oid ColumnarRowMaskIndexRelationId(void);
 static Oid ColumnarNamespaceId(void);
 static uint64 LookupStorageId(Oid relationId, RelFileLocator relfilelocator);
 static uint64 GetHighestUsedRowNumber(uint64 storageId);
+static void DeleteStripeFromColumnarMetadataTable(Oid metadataTableId,
+												  AttrNumber storageIdAtrrNumber,
+												  AttrNumber stripeAttrNumber,
+												  Oid storageIdIndexId, uint64 storageId,
+												  uint64 stripe);
+static void DeleteRowsFromColumnarMetadataTable(Oid metadataTableId,
+												Oid storageIdIndexId,
+												int nkeys, ScanKey scanKey);
 static void DeleteStorageFromColumnarMetadataTable(Oid metadataTableId,
 												   AttrNumber storageIdAtrrNumber,
 												   Oid storageIdIndexId,
@@ -143,12 +165,13 @@ static void CheckStripeMetadataConsistency(StripeMetadata *stripeMetadata);
 PG_FUNCTION_INFO_V1(columnar_relation_storageid);
 
 /* constants for columnar.options */
-#define Natts_columnar_options 5
+#define Natts_columnar_options 6
 #define Anum_columnar_options_regclass 1
 #define Anum_columnar_options_chunk_group_row_limit 2
 #define Anum_columnar_options_stripe_row_limit 3
 #define Anum_columnar_options_compression_level 4
 #define Anum_columnar_options_compression 5
+#define Anum_columnar_options_bloom_filter_columns 6
 
 /* ----------------
  *		columnar.options definition.
@@ -163,10 +186,16 @@ typedef struct FormData_columnar_options
 	NameData compression;
 
 #ifdef CATALOG_VARLEN           /* variable-length fields start here */
+	int16 bloom_filter_columns[1];
 #endif
 } FormData_columnar_options;
 typedef FormData_columnar_options *Form_columnar_options;
 
+static int GetBloomFilterColumnsAttrIndexInColumnarOptions(TupleDesc tupleDesc);
+static ArrayType * BloomFilterColumnAttrNumbers(Oid regclass,
+												const char *bloomFilterColumns);
+static char * BloomFilterColumnNames(Oid regclass, ArrayType *attrNumberArray);
+
 
 /* constants for columnar.stripe */
 #define Natts_columnar_stripe 9
@@ -190,7 +219,7 @@ static int GetFirstRowNumberAttrIndexInColumnarStripe(TupleDesc tupleDesc);
 #define Anum_columnar_chunkgroup_row_count 4
 
 /* constants for columnar.chunk */
-#define Natts_columnar_chunk 14
+#define Natts_columnar_chunk 16
 #define Anum_columnar_chunk_storageid 1
 #define Anum_columnar_chunk_stripe 2
 #define Anum_columnar_chunk_attr 3
@@ -205,6 +234,25 @@ static int GetFirstRowNumberAttrIndexInColumnarStripe(TupleDesc tupleDesc);
 #define Anum_columnar_chunk_value_compression_level 12
 #define Anum_columnar_chunk_value_decompressed_size 13
 #define Anum_columnar_chunk_value_count 14
+#define Anum_columnar_chunk_value_encoding_type 15
+#define Anum_columnar_chunk_bloom_filter 16
+
+static int GetAttrIndexInColumnarChunk(TupleDesc tupleDesc, AttrNumber attrNumber);
+
+/* constants for columnar.stripe_summary */
+#define Natts_columnar_stripe_summary 5
+#define Anum_columnar_stripe_summary_storageid 1
+#define Anum_columnar_stripe_summary_stripe 2
+#define Anum_columnar_stripe_summary_attr 3
+#define Anum_columnar_stripe_summary_minimum_value 4
+#define Anum_columnar_stripe_summary_maximum_value 5
+
+/* constants for columnar.row_mask */
+#define Natts_columnar_row_mask 4
+#define Anum_columnar_row_mask_storageid 1
+#define Anum_columnar_row_mask_stripe 2
+#define Anum_columnar_row_mask_deleted_row_count 3
+#define Anum_columnar_row_mask_mask 4
 
 
 /*
@@ -227,7 +275,8 @@ InitColumnarOptions(Oid regclass)
 		.chunkRowCount = columnar_chunk_group_row_limit,
 		.stripeRowCount = columnar_stripe_row_limit,
 		.compressionType = columnar_compression,
-		.compressionLevel = columnar_compression_level
+		.compressionLevel = columnar_compression_level,
+		.bloomFilterColumns = NULL
 	};
 
 	WriteColumnarOptions(regclass, &defaultOptions, false);
@@ -309,6 +358,17 @@ ParseColumnarRelOptions(List *reloptions, ColumnarOptions *options)
 										COMPRESSION_LEVEL_MAX)));
 			}
 		}
+		else if (strcmp(elem->defname, "bloom_filter_columns") == 0)
+		{
+			options->bloomFilterColumns = NULL;
+
+			/* columns are resolved when writing the options, only check syntax */
+			if (elem->arg != NULL &&
+				ParseBloomFilterColumnList(defGetString(elem)) != NIL)
+			{
+				options->bloomFilterColumns = defGetString(elem);
+			}
+		}
 		else
 		{
 			ereport(ERROR, (errmsg("unrecognized columnar storage parameter \"%s\"",
@@ -413,23 +473,55 @@ WriteColumnarOptions(Oid regclass, ColumnarOptions *options, bool overwrite)
 
 	bool written = false;
 
-	bool nulls[Natts_columnar_options] = { 0 };
-	Datum values[Natts_columnar_options] = {
-		ObjectIdGetDatum(regclass),
-		Int32GetDatum(options->chunkRowCount),
-		Int32GetDatum(options->stripeRowCount),
-		Int32GetDatum(options->compressionLevel),
-		0, /* to be filled below */
-	};
+	/* create heap tuple and insert into catalog table */
+	Relation columnarOptions = relation_open(ColumnarOptionsRelationId(),
+											 RowExclusiveLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(columnarOptions);
+
+	Datum *values = (Datum *) palloc0(tupleDescriptor->natts * sizeof(Datum));
+	bool *nulls = (bool *) palloc(tupleDescriptor->natts * sizeof(bool));
+	bool *update = (bool *) palloc0(tupleDescriptor->natts * sizeof(bool));
+
+	/* columns dropped by a downgrade are left NULL */
+	memset(nulls, true, tupleDescriptor->natts * sizeof(bool));
+
+	values[Anum_columnar_options_regclass - 1] = ObjectIdGetDatum(regclass);
+	values[Anum_columnar_options_chunk_group_row_limit - 1] =
+		Int32GetDatum(options->chunkRowCount);
+	values[Anum_columnar_options_stripe_row_limit - 1] =
+		Int32GetDatum(options->stripeRowCount);
+	values[Anum_columnar_options_compression_level - 1] =
+		Int32GetDatum(options->compressionLevel);
 
 	NameData compressionName = { 0 };
 	namestrcpy(&compressionName, CompressionTypeStr(options->compressionType));
 	values[Anum_columnar_options_compression - 1] = NameGetDatum(&compressionName);
 
-	/* create heap tuple and insert into catalog table */
-	Relation columnarOptions = relation_open(ColumnarOptionsRelationId(),
-											 RowExclusiveLock);
-	TupleDesc tupleDescriptor = RelationGetDescr(columnarOptions);
+	for (int attrIndex = 0; attrIndex < Anum_columnar_options_compression; attrIndex++)
+	{
+		nulls[attrIndex] = false;
+	}
+
+	update[Anum_columnar_options_chunk_group_row_limit - 1] = true;
+	update[Anum_columnar_options_stripe_row_limit - 1] = true;
+	update[Anum_columnar_options_compression_level - 1] = true;
+	update[Anum_columnar_options_compression - 1] = true;
+
+	int bloomFilterColumnsIndex =
+		GetBloomFilterColumnsAttrIndexInColumnarOptions(tupleDescriptor);
+	if (bloomFilterColumnsIndex >= 0)
+	{
+		ArrayType *bloomFilterAttrNumbers = NULL;
+		if (options->bloomFilterColumns != NULL)
+		{
+			bloomFilterAttrNumbers =
+				BloomFilterColumnAttrNumbers(regclass, options->bloomFilterColumns);
+		}
+
+		values[bloomFilterColumnsIndex] = PointerGetDatum(bloomFilterAttrNumbers);
+		nulls[bloomFilterColumnsIndex] = (bloomFilterAttrNumbers == NULL);
+		update[bloomFilterColumnsIndex] = true;
+	}
 
 	/* find existing item to perform update if exist */
 	ScanKeyData scanKey[1] = { 0 };
@@ -448,12 +540,6 @@ WriteColumnarOptions(Oid regclass, ColumnarOptions *options, bool overwrite)
 		{
 			/* TODO check if the options are actually different, skip if not changed */
 			/* update existing record */
-			bool update[Natts_columnar_options] = { 0 };
-			update[Anum_columnar_options_chunk_group_row_limit - 1] = true;
-			update[Anum_columnar_options_stripe_row_limit - 1] = true;
-			update[Anum_columnar_options_compression_level - 1] = true;
-			update[Anum_columnar_options_compression - 1] = true;
-
 			HeapTuple tuple = heap_modify_tuple(heapTuple, tupleDescriptor,
 												values, nulls, update);
 			CatalogTupleUpdate(columnarOptions, &tuple->t_self, tuple);
@@ -477,6 +563,10 @@ WriteColumnarOptions(Oid regclass, ColumnarOptions *options, bool overwrite)
 	index_close(index, AccessShareLock);
 	relation_close(columnarOptions, RowExclusiveLock);
 
+	pfree(values);
+	pfree(nulls);
+	pfree(update);
+
 	return written;
 }
 
@@ -578,6 +668,24 @@ ReadColumnarOptions(Oid regclass, ColumnarOptions *options)
 		options->stripeRowCount = tupOptions->stripe_row_limit;
 		options->compressionLevel = tupOptions->compressionLevel;
 		options->compressionType = ParseCompressionType(NameStr(tupOptions->compression));
+		options->bloomFilterColumns = NULL;
+
+		TupleDesc tupleDescriptor = RelationGetDescr(columnarOptions);
+		int bloomFilterColumnsIndex =
+			GetBloomFilterColumnsAttrIndexInColumnarOptions(tupleDescriptor);
+		if (bloomFilterColumnsIndex >= 0)
+		{
+			bool isNull = false;
+			Datum bloomFilterColumnsDatum = heap_getattr(heapTuple,
+														 bloomFilterColumnsIndex + 1,
+														 tupleDescriptor, &isNull);
+			if (!isNull)
+			{
+				options->bloomFilterColumns =
+					BloomFilterColumnNames(regclass,
+										   DatumGetArrayTypeP(bloomFilterColumnsDatum));
+			}
+		}
 	}
 	else
 	{
@@ -586,6 +694,7 @@ ReadColumnarOptions(Oid regclass, ColumnarOptions *options)
 		options->stripeRowCount = columnar_stripe_row_limit;
 		options->chunkRowCount = columnar_chunk_group_row_limit;
 		options->compressionLevel = columnar_compression_level;
+		options->bloomFilterColumns = NULL;
 	}
 
 	systable_endscan_ordered(scanDescriptor);
@@ -612,9 +721,18 @@ SaveStripeSkipList(Oid relid, RelFileLocator relfilelocator, uint64 stripe,
 	uint64 storageId = LookupStorageId(relid, relfilelocator);
 	Oid columnarChunkOid = ColumnarChunkRelationId();
 	Relation columnarChunk = table_open(columnarChunkOid, RowExclusiveLock);
+	TupleDesc chunkTupleDesc = RelationGetDescr(columnarChunk);
 	ModifyState *modifyState = StartModifyRelation(columnarChunk);
 	bool pushed_snapshot = false;
 
+	Datum *values = (Datum *) palloc0(chunkTupleDesc->natts * sizeof(Datum));
+	bool *nulls = (bool *) palloc0(chunkTupleDesc->natts * sizeof(bool));
+	int valueEncodingTypeIndex =
+		GetAttrIndexInColumnarChunk(chunkTupleDesc,
+									Anum_columnar_chunk_value_encoding_type);
+	int bloomFilterIndex =
+		GetAttrIndexInColumnarChunk(chunkTupleDesc, Anum_columnar_chunk_bloom_filter);
+
 	if (!ActiveSnapshotSet())
 	{
 		PushActiveSnapshot(GetTransactionSnapshot());
@@ -627,24 +745,42 @@ SaveStripeSkipList(Oid relid, RelFileLocator relfilelocator, uint64 stripe,
 			ColumnChunkSkipNode *chunk =
 				&chunkList->chunkSkipNodeArray[columnIndex][chunkIndex];
 
-			Datum values[Natts_columnar_chunk] = {
-				UInt64GetDatum(storageId),
-				Int64GetDatum(stripe),
-				Int32GetDatum(columnIndex + 1),
-				Int32GetDatum(chunkIndex),
-				0, /* to be filled below */
-				0, /* to be filled below */
-				Int64GetDatum(chunk->valueChunkOffset),
-				Int64GetDatum(chunk->valueLength),
-				Int64GetDatum(chunk->existsChunkOffset),
-				Int64GetDatum(chunk->existsLength),
-				Int32GetDatum(chunk->valueCompressionType),
-				Int32GetDatum(chunk->valueCompressionLevel),
-				Int64GetDatum(chunk->decompressedValueSize),
-				Int64GetDatum(chunk->rowCount)
-			};
-
-			bool nulls[Natts_columnar_chunk] = { false };
+			/* columns dropped by a downgrade are left NULL */
+			for (int attrIndex = 0; attrIndex < chunkTupleDesc->natts; attrIndex++)
+			{
+				nulls[attrIndex] = TupleDescAttr(chunkTupleDesc, attrIndex)->attisdropped;
+			}
+
+			values[Anum_columnar_chunk_storageid - 1] = UInt64GetDatum(storageId);
+			values[Anum_columnar_chunk_stripe - 1] = Int64GetDatum(stripe);
+			values[Anum_columnar_chunk_attr - 1] = Int32GetDatum(columnIndex + 1);
+			values[Anum_columnar_chunk_chunk - 1] = Int32GetDatum(chunkIndex);
+			values[Anum_columnar_chunk_value_stream_offset - 1] =
+				Int64GetDatum(chunk->valueChunkOffset);
+			values[Anum_columnar_chunk_value_stream_length - 1] =
+				Int64GetDatum(chunk->valueLength);
+			values[Anum_columnar_chunk_exists_stream_offset - 1] =
+				Int64GetDatum(chunk->existsChunkOffset);
+			values[Anum_columnar_chunk_exists_stream_length - 1] =
+				Int64GetDatum(chunk->existsLength);
+			values[Anum_columnar_chunk_value_compression_type - 1] =
+				Int32GetDatum(chunk->valueCompressionType);
+			values[Anum_columnar_chunk_value_compression_level - 1] =
+				Int32GetDatum(chunk->valueCompressionLevel);
+			values[Anum_columnar_chunk_value_decompressed_size - 1] =
+				Int64GetDatum(chunk->decompressedValueSize);
+			values[Anum_columnar_chunk_value_count - 1] =
+				Int64GetDatum(chunk->rowCount);
+			values[valueEncodingTypeIndex] = Int32GetDatum(chunk->valueEncodingType);
+
+			if (chunk->bloomFilter != NULL)
+			{
+				values[bloomFilterIndex] = PointerGetDatum(chunk->bloomFilter);
+			}
+			else
+			{
+				nulls[bloomFilterIndex] = true;
+			}
 
 			if (chunk->hasMinMax)
 			{
@@ -672,6 +808,9 @@ SaveStripeSkipList(Oid relid, RelFileLocator relfilelocator, uint64 stripe,
 
 	FinishModifyRelation(modifyState);
 	table_close(columnarChunk, RowExclusiveLock);
+
+	pfree(values);
+	pfree(nulls);
 }
 
 
@@ -711,6 +850,162 @@ SaveChunkGroups(Oid relid, RelFileLocator relfilelocator, uint64 stripe,
 }
 
 
+/*
+ * SaveStripeSummary saves the minimum and maximum values of the columns of a
+ * given stripe as rows of columnar.stripe_summary. Columns without min/max
+ * values are not saved.
+ */
+void
+SaveStripeSummary(Oid relid, RelFileLocator relfilelocator, uint64 stripe,
+				  StripeSummary *stripeSummary, TupleDesc tupleDescriptor)
+{
+	Oid columnarStripeSummaryOid = ColumnarStripeSummaryRelationId();
+	if (!OidIsValid(columnarStripeSummaryOid))
+	{
+		/* catalog table is created in 15.0-1 */
+		return;
+	}
+
+	uint64 storageId = LookupStorageId(relid, relfilelocator);
+	Relation columnarStripeSummary = table_open(columnarStripeSummaryOid,
+												RowExclusiveLock);
+	ModifyState *modifyState = StartModifyRelation(columnarStripeSummary);
+	bool pushed_snapshot = false;
+
+	if (!ActiveSnapshotSet())
+	{
+		PushActiveSnapshot(GetTransactionSnapshot());
+		pushed_snapshot = true;
+	}
+
+	for (uint32 columnIndex = 0; columnIndex < stripeSummary->columnCount; columnIndex++)
+	{
+		if (!stripeSummary->hasMinMax[columnIndex])
+		{
+			continue;
+		}
+
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+		Datum values[Natts_columnar_stripe_summary] = {
+			UInt64GetDatum(storageId),
+			Int64GetDatum(stripe),
+			Int32GetDatum(columnIndex + 1),
+			PointerGetDatum(DatumToBytea(stripeSummary->minimumValues[columnIndex],
+										 attributeForm)),
+			PointerGetDatum(DatumToBytea(stripeSummary->maximumValues[columnIndex],
+										 attributeForm))
+		};
+
+		bool nulls[Natts_columnar_stripe_summary] = { false };
+
+		InsertTupleAndEnforceConstraints(modifyState, values, nulls);
+	}
+
+	if (pushed_snapshot)
+	{
+		PopActiveSnapshot();
+	}
+
+	FinishModifyRelation(modifyState);
+	table_close(columnarStripeSummary, RowExclusiveLock);
+}
+
+
+/*
+ * SaveStripeRowMask marks the rows that are set in the given row mask as
+ * deleted in the columnar.row_mask entry of the given stripe, creating the
+ * entry if the stripe doesn't have one yet.
+ *
+ * Callers serialize the deletes on a relation, so we merge the given rows
+ * into the latest committed (or our own) version of the entry.
+ */
+void
+SaveStripeRowMask(Oid relid, RelFileLocator relfilelocator, uint64 stripe,
+				  uint64 stripeRowCount, bytea *deletedRows)
+{
+	Oid columnarRowMaskOid = ColumnarRowMaskRelationId();
+	if (!OidIsValid(columnarRowMaskOid))
+	{
+		/* catalog table is created in 15.0-1 */
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("deleting from columnar tables requires a newer "
+							   "version of citus_columnar"),
+						errhint("Run ALTER EXTENSION citus_columnar UPDATE and "
+								"try again.")));
+	}
+
+	uint64 storageId = LookupStorageId(relid, relfilelocator);
+	Relation columnarRowMask = table_open(columnarRowMaskOid, RowExclusiveLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(columnarRowMask);
+
+	ScanKeyData scanKey[2];
+	ScanKeyInit(&scanKey[0], Anum_columnar_row_mask_storageid,
+				BTEqualStrategyNumber, F_INT8EQ, Int64GetDatum(storageId));
+	ScanKeyInit(&scanKey[1], Anum_columnar_row_mask_stripe,
+				BTEqualStrategyNumber, F_INT8EQ, Int64GetDatum(stripe));
+
+	Oid indexId = ColumnarRowMaskIndexRelationId();
+	bool indexOk = OidIsValid(indexId);
+	SysScanDesc scanDescriptor = systable_beginscan(columnarRowMask, indexId,
+													indexOk, SnapshotSelf, 2, scanKey);
+
+	static bool loggedSlowMetadataAccessWarning = false;
+	if (!indexOk && !loggedSlowMetadataAccessWarning)
+	{
+		ereport(WARNING, (errmsg(SLOW_METADATA_ACCESS_WARNING, "row_mask_pkey")));
+		loggedSlowMetadataAccessWarning = true;
+	}
+
+	bytea *rowMask = NULL;
+	HeapTuple oldTuple = systable_getnext(scanDescriptor);
+	if (HeapTupleIsValid(oldTuple))
+	{
+		Datum datumArray[Natts_columnar_row_mask];
+		bool isNullArray[Natts_columnar_row_mask];
+
+		heap_deform_tuple(oldTuple, tupleDescriptor, datumArray, isNullArray);
+		rowMask = DatumGetByteaPCopy(datumArray[Anum_columnar_row_mask_mask - 1]);
+	}
+	else
+	{
+		rowMask = CreateRowMask(stripeRowCount);
+	}
+
+	RowMaskUnion(rowMask, deletedRows);
+	uint64 deletedRowCount = RowMaskCountRows(rowMask, 0, stripeRowCount);
+
+	Datum values[Natts_columnar_row_mask] = {
+		UInt64GetDatum(storageId),
+		Int64GetDatum(stripe),
+		Int64GetDatum(deletedRowCount),
+		PointerGetDatum(rowMask)
+	};
+
+	bool nulls[Natts_columnar_row_mask] = { false };
+
+	if (HeapTupleIsValid(oldTuple))
+	{
+		bool update[Natts_columnar_row_mask] = { false };
+		update[Anum_columnar_row_mask_deleted_row_count - 1] = true;
+		update[Anum_columnar_row_mask_mask - 1] = true;
+
+		HeapTuple newTuple = heap_modify_tuple(oldTuple, tupleDescriptor,
+											   values, nulls, update);
+		CatalogTupleUpdate(columnarRowMask, &oldTuple->t_self, newTuple);
+	}
+	else
+	{
+		HeapTuple newTuple = heap_form_tuple(tupleDescriptor, values, nulls);
+		CatalogTupleInsert(columnarRowMask, newTuple);
+	}
+
+	CommandCounterIncrement();
+
+	systable_endscan(scanDescriptor);
+	table_close(columnarRowMask, RowExclusiveLock);
+}
+
+
 /*
  * ReadStripeSkipList fetches chunk metadata for a given stripe.
  */
@@ -729,6 +1024,7 @@ ReadStripeSkipList(Relation rel, uint64 stripe,
 
 	Oid columnarChunkOid = ColumnarChunkRelationId();
 	Relation columnarChunk = table_open(columnarChunkOid, AccessShareLock);
+	TupleDesc chunkTupleDesc = RelationGetDescr(columnarChunk);
 
 	ScanKeyInit(&scanKey[0], Anum_columnar_chunk_storageid,
 				BTEqualStrategyNumber, F_INT8EQ, Int64GetDatum(storageId));
@@ -757,13 +1053,17 @@ ReadStripeSkipList(Relation rel, uint64 stripe,
 			palloc0(chunkCount * sizeof(ColumnChunkSkipNode));
 	}
 
+	Datum *datumArray = (Datum *) palloc(chunkTupleDesc->natts * sizeof(Datum));
+	bool *isNullArray = (bool *) palloc(chunkTupleDesc->natts * sizeof(bool));
+	int valueEncodingTypeIndex =
+		GetAttrIndexInColumnarChunk(chunkTupleDesc,
+									Anum_columnar_chunk_value_encoding_type);
+	int bloomFilterIndex =
+		GetAttrIndexInColumnarChunk(chunkTupleDesc, Anum_columnar_chunk_bloom_filter);
+
 	while (HeapTupleIsValid(heapTuple = systable_getnext(scanDescriptor)))
 	{
-		Datum datumArray[Natts_columnar_chunk];
-		bool isNullArray[Natts_columnar_chunk];
-
-		heap_deform_tuple(heapTuple, RelationGetDescr(columnarChunk), datumArray,
-						  isNullArray);
+		heap_deform_tuple(heapTuple, chunkTupleDesc, datumArray, isNullArray);
 
 		int32 attr = DatumGetInt32(datumArray[Anum_columnar_chunk_attr - 1]);
 		int32 chunkIndex = DatumGetInt32(datumArray[Anum_columnar_chunk_chunk - 1]);
@@ -800,6 +1100,13 @@ ReadStripeSkipList(Relation rel, uint64 stripe,
 			DatumGetInt32(datumArray[Anum_columnar_chunk_value_compression_level - 1]);
 		chunk->decompressedValueSize =
 			DatumGetInt64(datumArray[Anum_columnar_chunk_value_decompressed_size - 1]);
+		chunk->valueEncodingType =
+			DatumGetInt32(datumArray[valueEncodingTypeIndex]);
+
+		if (!isNullArray[bloomFilterIndex])
+		{
+			chunk->bloomFilter = DatumGetByteaPCopy(datumArray[bloomFilterIndex]);
+		}
 
 		if (isNullArray[Anum_columnar_chunk_minimum_value - 1] ||
 			isNullArray[Anum_columnar_chunk_maximum_value - 1])
@@ -822,6 +1129,9 @@ ReadStripeSkipList(Relation rel, uint64 stripe,
 		}
 	}
 
+	pfree(datumArray);
+	pfree(isNullArray);
+
 	systable_endscan(scanDescriptor);
 	table_close(columnarChunk, AccessShareLock);
 
@@ -832,6 +1142,220 @@ ReadStripeSkipList(Relation rel, uint64 stripe,
 }
 
 
+/*
+ * ReadStripeSummary fetches the minimum and maximum values of the columns of
+ * a given stripe. Returns NULL if the stripe summaries are not available.
+ */
+StripeSummary *
+ReadStripeSummary(Relation rel, uint64 stripe, TupleDesc tupleDescriptor,
+				  Snapshot snapshot)
+{
+	Oid columnarStripeSummaryOid = ColumnarStripeSummaryRelationId();
+	if (!OidIsValid(columnarStripeSummaryOid))
+	{
+		/* catalog table is created in 15.0-1 */
+		return NULL;
+	}
+
+	uint32 columnCount = tupleDescriptor->natts;
+	ScanKeyData scanKey[2];
+
+	uint64 storageId = LookupStorageId(RelationPrecomputeOid(rel),
+									   rel->rd_locator);
+
+	Relation columnarStripeSummary = table_open(columnarStripeSummaryOid,
+												AccessShareLock);
+
+	ScanKeyInit(&scanKey[0], Anum_columnar_stripe_summary_storageid,
+				BTEqualStrategyNumber, F_INT8EQ, Int64GetDatum(storageId));
+	ScanKeyInit(&scanKey[1], Anum_columnar_stripe_summary_stripe,
+				BTEqualStrategyNumber, F_INT8EQ, Int64GetDatum(stripe));
+
+	Oid indexId = ColumnarStripeSummaryIndexRelationId();
+	bool indexOk = OidIsValid(indexId);
+	SysScanDesc scanDescriptor = systable_beginscan(columnarStripeSummary, indexId,
+													indexOk, snapshot, 2, scanKey);
+
+	static bool loggedSlowMetadataAccessWarning = false;
+	if (!indexOk && !loggedSlowMetadataAccessWarning)
+	{
+		ereport(WARNING, (errmsg(SLOW_METADATA_ACCESS_WARNING,
+								 "stripe_summary_pkey")));
+		loggedSlowMetadataAccessWarning = true;
+	}
+
+	StripeSummary *stripeSummary = palloc0(sizeof(StripeSummary));
+	stripeSummary->columnCount = columnCount;
+	stripeSummary->hasMinMax = palloc0(columnCount * sizeof(bool));
+	stripeSummary->minimumValues = palloc0(columnCount * sizeof(Datum));
+	stripeSummary->maximumValues = palloc0(columnCount * sizeof(Datum));
+
+	HeapTuple heapTuple = NULL;
+	while (HeapTupleIsValid(heapTuple = systable_getnext(scanDescriptor)))
+	{
+		Datum datumArray[Natts_columnar_stripe_summary];
+		bool isNullArray[Natts_columnar_stripe_summary];
+
+		heap_deform_tuple(heapTuple, RelationGetDescr(columnarStripeSummary),
+						  datumArray, isNullArray);
+
+		int32 attr = DatumGetInt32(datumArray[Anum_columnar_stripe_summary_attr - 1]);
+		if (attr <= 0 || attr > columnCount)
+		{
+			ereport(ERROR, (errmsg("invalid columnar stripe summary entry"),
+							errdetail("Attribute number out of range: %d", attr)));
+		}
+
+		uint32 columnIndex = attr - 1;
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		bytea *minValue = DatumGetByteaP(
+			datumArray[Anum_columnar_stripe_summary_minimum_value - 1]);
+		bytea *maxValue = DatumGetByteaP(
+			datumArray[Anum_columnar_stripe_summary_maximum_value - 1]);
+
+		stripeSummary->minimumValues[columnIndex] = ByteaToDatum(minValue,
+																 attributeForm);
+		stripeSummary->maximumValues[columnIndex] = ByteaToDatum(maxValue,
+																 attributeForm);
+		stripeSummary->hasMinMax[columnIndex] = true;
+	}
+
+	systable_endscan(scanDescriptor);
+	table_close(columnarStripeSummary, AccessShareLock);
+
+	return stripeSummary;
+}
+
+
+/*
+ * ReadStripeRowMask fetches the mask of the deleted rows of a given stripe.
+ * Returns NULL if none of its rows are deleted.
+ *
+ * SnapshotAny sees all rows, including the deleted ones. The other non-MVCC
+ * snapshots that are used for reading columnar tables, e.g. the dirty
+ * snapshots that are used when checking for unique constraint violations,
+ * don't see the rows whose deletion was committed or done by us. Rows that
+ * are being deleted by other transactions are not taken into account by
+ * those snapshots since deletes don't block unique checks.
+ */
+bytea *
+ReadStripeRowMask(Relation rel, uint64 stripe, Snapshot snapshot)
+{
+	Oid columnarRowMaskOid = ColumnarRowMaskRelationId();
+	if (!OidIsValid(columnarRowMaskOid))
+	{
+		/* catalog table is created in 15.0-1 */
+		return NULL;
+	}
+
+	if (snapshot != InvalidSnapshot && !IsMVCCSnapshot(snapshot))
+	{
+		if (snapshot->snapshot_type == SNAPSHOT_ANY)
+		{
+			return NULL;
+		}
+
+		snapshot = SnapshotSelf;
+	}
+
+	ScanKeyData scanKey[2];
+
+	uint64 storageId = LookupStorageId(RelationPrecomputeOid(rel),
+									   rel->rd_locator);
+
+	Relation columnarRowMask = table_open(columnarRowMaskOid, AccessShareLock);
+
+	ScanKeyInit(&scanKey[0], Anum_columnar_row_mask_storageid,
+				BTEqualStrategyNumber, F_INT8EQ, Int64GetDatum(storageId));
+	ScanKeyInit(&scanKey[1], Anum_columnar_row_mask_stripe,
+				BTEqualStrategyNumber, F_INT8EQ, Int64GetDatum(stripe));
+
+	Oid indexId = ColumnarRowMaskIndexRelationId();
+	bool indexOk = OidIsValid(indexId);
+	SysScanDesc scanDescriptor = systable_beginscan(columnarRowMask, indexId,
+													indexOk, snapshot, 2, scanKey);
+
+	static bool loggedSlowMetadataAccessWarning = false;
+	if (!indexOk && !loggedSlowMetadataAccessWarning)
+	{
+		ereport(WARNING, (errmsg(SLOW_METADATA_ACCESS_WARNING, "row_mask_pkey")));
+		loggedSlowMetadataAccessWarning = true;
+	}
+
+	bytea *rowMask = NULL;
+	HeapTuple heapTuple = systable_getnext(scanDescriptor);
+	if (HeapTupleIsValid(heapTuple))
+	{
+		Datum datumArray[Natts_columnar_row_mask];
+		bool isNullArray[Natts_columnar_row_mask];
+
+		heap_deform_tuple(heapTuple, RelationGetDescr(columnarRowMask),
+						  datumArray, isNullArray);
+
+		int64 deletedRowCount =
+			DatumGetInt64(datumArray[Anum_columnar_row_mask_deleted_row_count - 1]);
+		if (deletedRowCount > 0)
+		{
+			rowMask = DatumGetByteaPCopy(datumArray[Anum_columnar_row_mask_mask - 1]);
+		}
+	}
+
+	systable_endscan(scanDescriptor);
+	table_close(columnarRowMask, AccessShareLock);
+
+	return rowMask;
+}
+
+
+/*
+ * ReadDeletedRowCount returns the number of deleted rows of the given
+ * relation in the given snapshot.
+ */
+uint64
+ReadDeletedRowCount(Relation rel, Snapshot snapshot)
+{
+	Oid columnarRowMaskOid = ColumnarRowMaskRelationId();
+	if (!OidIsValid(columnarRowMaskOid))
+	{
+		/* catalog table is created in 15.0-1 */
+		return 0;
+	}
+
+	ScanKeyData scanKey[1];
+
+	uint64 storageId = LookupStorageId(RelationPrecomputeOid(rel),
+									   rel->rd_locator);
+
+	Relation columnarRowMask = table_open(columnarRowMaskOid, AccessShareLock);
+
+	ScanKeyInit(&scanKey[0], Anum_columnar_row_mask_storageid,
+				BTEqualStrategyNumber, F_INT8EQ, Int64GetDatum(storageId));
+
+	Oid indexId = ColumnarRowMaskIndexRelationId();
+	bool indexOk = OidIsValid(indexId);
+	SysScanDesc scanDescriptor = systable_beginscan(columnarRowMask, indexId,
+													indexOk, snapshot, 1, scanKey);
+
+	uint64 deletedRowCount = 0;
+	HeapTuple heapTuple = NULL;
+	while (HeapTupleIsValid(heapTuple = systable_getnext(scanDescriptor)))
+	{
+		bool isNull = false;
+		Datum deletedRowCountDatum =
+			heap_getattr(heapTuple, Anum_columnar_row_mask_deleted_row_count,
+						 RelationGetDescr(columnarRowMask), &isNull);
+
+		deletedRowCount += DatumGetInt64(deletedRowCountDatum);
+	}
+
+	systable_endscan(scanDescriptor);
+	table_close(columnarRowMask, AccessShareLock);
+
+	return deletedRowCount;
+}
+
+
 /*
  * FindStripeByRowNumber returns StripeMetadata for the stripe that has the
  * smallest firstRowNumber among the stripes whose firstRowNumber is grater
@@ -1341,10 +1865,7 @@ GetHighestUsedAddressAndId(uint64 storageId,
 {
 	ListCell *stripeMetadataCell = NULL;
 
-	SnapshotData SnapshotDirty;
-	InitDirtySnapshot(SnapshotDirty);
-
-	List *stripeMetadataList = ReadDataFileStripeList(storageId, &SnapshotDirty);
+	List *stripeMetadataList = ReadNonVacuumableStripeList(storageId);
 
 	*highestUsedId = 0;
 
@@ -1361,6 +1882,194 @@ GetHighestUsedAddressAndId(uint64 storageId,
 }
 
 
+/*
+ * ReadNonVacuumableStripeList returns the stripes of the given storage that
+ * are not yet vacuumable.
+ */
+static List *
+ReadNonVacuumableStripeList(uint64 storageId)
+{
+	/*
+	 * Unlike a dirty snapshot, a non-vacuumable snapshot also sees the
+	 * stripes that the current transaction removed, and the removed stripes
+	 * that are still visible to the snapshots of other transactions, whose
+	 * data must not be truncated or overwritten.
+	 */
+	Relation columnarStripes = table_open(ColumnarStripeRelationId(), AccessShareLock);
+	SnapshotData SnapshotNonVacuumable;
+	InitNonVacuumableSnapshot(SnapshotNonVacuumable,
+							  GlobalVisTestFor(columnarStripes));
+	table_close(columnarStripes, AccessShareLock);
+
+	return ReadDataFileStripeList(storageId, &SnapshotNonVacuumable);
+}
+
+
+/*
+ * ReadUnprunedStripeList returns the stripes of the given storage whose
+ * metadata rows are still physically present, including the dead ones.
+ *
+ * A stripe row that is dead to a non-vacuumable snapshot might still be
+ * visible to queries on a hot standby, which only get cancelled by the
+ * recovery conflict that is emitted once the row is pruned. Hence, the data
+ * of a stripe must be kept until its row is gone. We scan the heap rather
+ * than the index, since the index scan skips entries that were marked as
+ * dead before the rows were pruned.
+ */
+static List *
+ReadUnprunedStripeList(uint64 storageId)
+{
+	List *stripeMetadataList = NIL;
+	ScanKeyData scanKey[1];
+	HeapTuple heapTuple;
+
+	ScanKeyInit(&scanKey[0], Anum_columnar_stripe_storageid,
+				BTEqualStrategyNumber, F_INT8EQ, Int64GetDatum(storageId));
+
+	Relation columnarStripes = table_open(ColumnarStripeRelationId(), AccessShareLock);
+	SysScanDesc scanDescriptor = systable_beginscan(columnarStripes, InvalidOid,
+													false, SnapshotAny, 1, scanKey);
+
+	while (HeapTupleIsValid(heapTuple = systable_getnext(scanDescriptor)))
+	{
+		StripeMetadata *stripeMetadata = BuildStripeMetadata(columnarStripes, heapTuple);
+		stripeMetadataList = lappend(stripeMetadataList, stripeMetadata);
+	}
+
+	systable_endscan(scanDescriptor);
+	table_close(columnarStripes, AccessShareLock);
+
+	return stripeMetadataList;
+}
+
+
+/*
+ * ReusableDataRanges returns the page-aligned ranges of logical offsets
+ * between the stripes of the given relation that no stripe uses anymore, in
+ * ascending order. Those ranges hold the data of the stripes that compaction
+ * or VACUUM rewrote, and whose metadata rows VACUUM has pruned since, so no
+ * snapshot can read them anymore, not even on a hot standby.
+ *
+ * The ranges above the highest stripe are never returned, since concurrent
+ * writers might have reserved them without having recorded their stripes
+ * yet.
+ */
+List *
+ReusableDataRanges(Relation rel)
+{
+	uint64 storageId = LookupStorageId(RelationPrecomputeOid(rel),
+									   rel->rd_locator);
+	List *stripeMetadataList = ReadUnprunedStripeList(storageId);
+	list_sort(stripeMetadataList, CompareStripesByFileOffset);
+
+	List *rangeList = NIL;
+	uint64 unusedOffset = ColumnarFirstLogicalOffset;
+
+	StripeMetadata *stripeMetadata = NULL;
+	foreach_declared_ptr(stripeMetadata, stripeMetadataList)
+	{
+		if (stripeMetadata->dataLength == 0)
+		{
+			/* stripe reservations that are not flushed yet don't have data */
+			continue;
+		}
+
+		/*
+		 * Stripes written by older versions might not start on a page
+		 * boundary, and writing to the start of a page overwrites the rest
+		 * of it, so the page that the stripe starts on is never reused.
+		 */
+		uint64 rangeStart = AlignOffsetToPage(unusedOffset);
+		uint64 rangeEnd = stripeMetadata->fileOffset -
+						  stripeMetadata->fileOffset % COLUMNAR_BYTES_PER_PAGE;
+
+		if (rangeEnd > rangeStart)
+		{
+			ColumnarDataRange *range = palloc0(sizeof(ColumnarDataRange));
+			range->logicalOffset = rangeStart;
+			range->length = rangeEnd - rangeStart;
+
+			rangeList = lappend(rangeList, range);
+		}
+
+		unusedOffset = Max(unusedOffset,
+						   stripeMetadata->fileOffset + stripeMetadata->dataLength);
+	}
+
+	return rangeList;
+}
+
+
+/*
+ * TakeReusableDataRange returns the start of the first range in the given
+ * list that has room for the given amount of data, and removes that amount
+ * of data from the range, or ColumnarInvalidLogicalOffset if no range has
+ * room for it.
+ */
+static uint64
+TakeReusableDataRange(List *rangeList, uint64 amount)
+{
+	if (amount == 0)
+	{
+		return ColumnarInvalidLogicalOffset;
+	}
+
+	ColumnarDataRange *range = NULL;
+	foreach_declared_ptr(range, rangeList)
+	{
+		if (range->length < amount)
+		{
+			continue;
+		}
+
+		/* like ColumnarStorageReserveData, start the next data on a new page */
+		uint64 logicalOffset = range->logicalOffset;
+		uint64 nextOffset = Min(AlignOffsetToPage(logicalOffset + amount),
+								range->logicalOffset + range->length);
+
+		range->length -= nextOffset - logicalOffset;
+		range->logicalOffset = nextOffset;
+
+		return logicalOffset;
+	}
+
+	return ColumnarInvalidLogicalOffset;
+}
+
+
+/*
+ * CompareStripesByFileOffset is a comparator for sorting a list of stripes
+ * by the logical offsets of their data.
+ */
+static int
+CompareStripesByFileOffset(const ListCell *leftCell, const ListCell *rightCell)
+{
+	StripeMetadata *leftStripe = lfirst(leftCell);
+	StripeMetadata *rightStripe = lfirst(rightCell);
+
+	if (leftStripe->fileOffset < rightStripe->fileOffset)
+	{
+		return -1;
+	}
+
+	return leftStripe->fileOffset > rightStripe->fileOffset ? 1 : 0;
+}
+
+
+/*
+ * AlignOffsetToPage returns the given logical offset if it is the first
+ * offset on its page, or the first offset on the next page otherwise.
+ */
+static uint64
+AlignOffsetToPage(uint64 logicalOffset)
+{
+	uint64 pageOffset = logicalOffset % COLUMNAR_BYTES_PER_PAGE;
+
+	return pageOffset == 0 ? logicalOffset :
+		   logicalOffset + COLUMNAR_BYTES_PER_PAGE - pageOffset;
+}
+
+
 /*
  * ReserveEmptyStripe reserves an empty stripe for given relation
  * and inserts it into columnar.stripe. It is guaranteed that concurrent
@@ -1394,13 +2103,19 @@ ReserveEmptyStripe(Relation rel, uint64 columnCount, uint64 chunkGroupRowCount,
 /*
  * CompleteStripeReservation completes reservation of the stripe with
  * stripeId for given size and in-place updates related stripe metadata tuple
- * to complete reservation.
+ * to complete reservation. The data is placed into one of the given
+ * reusable ranges (see ReusableDataRanges) if one has room for it, and at
+ * the end of the relation otherwise.
  */
 StripeMetadata *
 CompleteStripeReservation(Relation rel, uint64 stripeId, uint64 sizeBytes,
-						  uint64 rowCount, uint64 chunkCount)
+						  uint64 rowCount, uint64 chunkCount, List *reusableDataRanges)
 {
-	uint64 resLogicalStart = ColumnarStorageReserveData(rel, sizeBytes);
+	uint64 resLogicalStart = TakeReusableDataRange(reusableDataRanges, sizeBytes);
+	if (!ColumnarLogicalOffsetIsValid(resLogicalStart))
+	{
+		resLogicalStart = ColumnarStorageReserveData(rel, sizeBytes);
+	}
 	uint64 storageId = ColumnarStorageGetStorageId(rel, false);
 
 	return UpdateStripeMetadataRow(storageId, stripeId, resLogicalStart,
@@ -1631,6 +2346,64 @@ DeleteMetadataRows(Relation rel)
 										   Anum_columnar_chunk_storageid,
 										   ColumnarChunkIndexRelationId(),
 										   storageId);
+
+	/* catalog table is created in 15.0-1 */
+	Oid columnarStripeSummaryOid = ColumnarStripeSummaryRelationId();
+	if (OidIsValid(columnarStripeSummaryOid))
+	{
+		DeleteStorageFromColumnarMetadataTable(columnarStripeSummaryOid,
+											   Anum_columnar_stripe_summary_storageid,
+											   ColumnarStripeSummaryIndexRelationId(),
+											   storageId);
+	}
+
+	Oid columnarRowMaskOid = ColumnarRowMaskRelationId();
+	if (OidIsValid(columnarRowMaskOid))
+	{
+		DeleteStorageFromColumnarMetadataTable(columnarRowMaskOid,
+											   Anum_columnar_row_mask_storageid,
+											   ColumnarRowMaskIndexRelationId(),
+											   storageId);
+	}
+}
+
+
+/*
+ * DeleteStripeMetadataRows removes the rows of the given stripe from columnar
+ * metadata tables, so that the stripe is not visible to the transactions
+ * that start after we commit. The data of the stripe is left in the storage.
+ */
+void
+DeleteStripeMetadataRows(Relation rel, uint64 stripe)
+{
+	uint64 storageId = LookupStorageId(RelationPrecomputeOid(rel),
+									   rel->rd_locator);
+
+	DeleteStripeFromColumnarMetadataTable(ColumnarStripeRelationId(),
+										  Anum_columnar_stripe_storageid,
+										  Anum_columnar_stripe_stripe,
+										  ColumnarStripePKeyIndexRelationId(),
+										  storageId, stripe);
+	DeleteStripeFromColumnarMetadataTable(ColumnarChunkGroupRelationId(),
+										  Anum_columnar_chunkgroup_storageid,
+										  Anum_columnar_chunkgroup_stripe,
+										  ColumnarChunkGroupIndexRelationId(),
+										  storageId, stripe);
+	DeleteStripeFromColumnarMetadataTable(ColumnarChunkRelationId(),
+										  Anum_columnar_chunk_storageid,
+										  Anum_columnar_chunk_stripe,
+										  ColumnarChunkIndexRelationId(),
+										  storageId, stripe);
+	DeleteStripeFromColumnarMetadataTable(ColumnarStripeSummaryRelationId(),
+										  Anum_columnar_stripe_summary_storageid,
+										  Anum_columnar_stripe_summary_stripe,
+										  ColumnarStripeSummaryIndexRelationId(),
+										  storageId, stripe);
+	DeleteStripeFromColumnarMetadataTable(ColumnarRowMaskRelationId(),
+										  Anum_columnar_row_mask_storageid,
+										  Anum_columnar_row_mask_stripe,
+										  ColumnarRowMaskIndexRelationId(),
+										  storageId, stripe);
 }
 
 
@@ -1647,6 +2420,48 @@ DeleteStorageFromColumnarMetadataTable(Oid metadataTableId,
 	ScanKeyInit(&scanKey[0], storageIdAtrrNumber, BTEqualStrategyNumber,
 				F_INT8EQ, Int64GetDatum(storageId));
 
+	DeleteRowsFromColumnarMetadataTable(metadataTableId, storageIdIndexId,
+										1, scanKey);
+}
+
+
+/*
+ * DeleteStripeFromColumnarMetadataTable removes the rows of the stripe with
+ * given storageId and stripe id from given columnar metadata table.
+ */
+static void
+DeleteStripeFromColumnarMetadataTable(Oid metadataTableId,
+									  AttrNumber storageIdAtrrNumber,
+									  AttrNumber stripeAttrNumber,
+									  Oid storageIdIndexId, uint64 storageId,
+									  uint64 stripe)
+{
+	if (!OidIsValid(metadataTableId))
+	{
+		/* catalog table is created in a later version */
+		return;
+	}
+
+	ScanKeyData scanKey[2];
+	ScanKeyInit(&scanKey[0], storageIdAtrrNumber, BTEqualStrategyNumber,
+				F_INT8EQ, Int64GetDatum(storageId));
+	ScanKeyInit(&scanKey[1], stripeAttrNumber, BTEqualStrategyNumber,
+				F_INT8EQ, Int64GetDatum(stripe));
+
+	DeleteRowsFromColumnarMetadataTable(metadataTableId, storageIdIndexId,
+										2, scanKey);
+}
+
+
+/*
+ * DeleteRowsFromColumnarMetadataTable removes the rows that match the given
+ * scan keys from given columnar metadata table. The index is expected to
+ * start with the storage id.
+ */
+static void
+DeleteRowsFromColumnarMetadataTable(Oid metadataTableId, Oid storageIdIndexId,
+									int nkeys, ScanKey scanKey)
+{
 	Relation metadataTable = try_relation_open(metadataTableId, AccessShareLock);
 	if (metadataTable == NULL)
 	{
@@ -1656,7 +2471,7 @@ DeleteStorageFromColumnarMetadataTable(Oid metadataTableId,
 
 	bool indexOk = OidIsValid(storageIdIndexId);
 	SysScanDesc scanDescriptor = systable_beginscan(metadataTable, storageIdIndexId,
-													indexOk, NULL, 1, scanKey);
+													indexOk, NULL, nkeys, scanKey);
 
 	static bool loggedSlowMetadataAccessWarning = false;
 	if (!indexOk && !loggedSlowMetadataAccessWarning)
@@ -1983,6 +2798,49 @@ ColumnarChunkGroupIndexRelationId(void)
 }
 
 
+/*
+ * ColumnarStripeSummaryRelationId returns relation id of columnar.stripe_summary,
+ * or InvalidOid if it doesn't exist.
+ */
+static Oid
+ColumnarStripeSummaryRelationId(void)
+{
+	return get_relname_relid("stripe_summary", ColumnarNamespaceId());
+}
+
+
+/*
+ * ColumnarStripeSummaryIndexRelationId returns relation id of
+ * columnar.stripe_summary_pkey.
+ */
+static Oid
+ColumnarStripeSummaryIndexRelationId(void)
+{
+	return get_relname_relid("stripe_summary_pkey", ColumnarNamespaceId());
+}
+
+
+/*
+ * ColumnarRowMaskRelationId returns relation id of columnar.row_mask, or
+ * InvalidOid if it doesn't exist.
+ */
+static Oid
+ColumnarRowMaskRelationId(void)
+{
+	return get_relname_relid("row_mask", ColumnarNamespaceId());
+}
+
+
+/*
+ * ColumnarRowMaskIndexRelationId returns relation id of columnar.row_mask_pkey.
+ */
+static Oid
+ColumnarRowMaskIndexRelationId(void)
+{
+	return get_relname_relid("row_mask_pkey", ColumnarNamespaceId());
+}
+
+
 /*
  * ColumnarNamespaceId returns namespace id of the schema we store columnar
  * related tables.
@@ -2137,3 +2995,143 @@ GetFirstRowNumberAttrIndexInColumnarStripe(TupleDesc tupleDesc)
 		   ? (Anum_columnar_stripe_first_row_number - 1)
 		   : tupleDesc->natts - 1;
 }
+
+
+/*
+ * GetAttrIndexInColumnarChunk returns attrnum for one of the attrs that were
+ * added to table columnar.chunk in 15.0-1, i.e.: value_encoding_type and
+ * bloom_filter.
+ *
+ * Similar to first_row_number in columnar.stripe, these attrs were added using
+ * alter operations in the same script, so they're the last attrs of the table
+ * in the order of their Anum_ constants, even after a downgrade + upgrade.
+ */
+static int
+GetAttrIndexInColumnarChunk(TupleDesc tupleDesc, AttrNumber attrNumber)
+{
+	return tupleDesc->natts - (Natts_columnar_chunk - attrNumber) - 1;
+}
+
+
+/*
+ * GetBloomFilterColumnsAttrIndexInColumnarOptions returns attrnum for
+ * bloom_filter_columns attr, or -1 if the catalog table doesn't have it yet.
+ *
+ * Similar to first_row_number in columnar.stripe, bloom_filter_columns attr was
+ * added to table columnar.options using alter operation, so it's the last attr
+ * of the table, even after a downgrade + upgrade.
+ */
+static int
+GetBloomFilterColumnsAttrIndexInColumnarOptions(TupleDesc tupleDesc)
+{
+	if (tupleDesc->natts < Natts_columnar_options)
+	{
+		return -1;
+	}
+
+	return tupleDesc->natts == Natts_columnar_options
+		   ? (Anum_columnar_options_bloom_filter_columns - 1)
+		   : tupleDesc->natts - 1;
+}
+
+
+/*
+ * BloomFilterColumnAttrNumbers resolves the columns in the given value of the
+ * bloom_filter_columns option and returns their attribute numbers as an int2
+ * array, or NULL if there are no columns. Errors out if a column doesn't exist
+ * or if its data type cannot be hashed.
+ */
+static ArrayType *
+BloomFilterColumnAttrNumbers(Oid regclass, const char *bloomFilterColumns)
+{
+	List *columnNameList = ParseBloomFilterColumnList(bloomFilterColumns);
+	Datum *attrNumberDatums = palloc0(list_length(columnNameList) * sizeof(Datum));
+	int attrNumberCount = 0;
+
+	char *columnName = NULL;
+	foreach_declared_ptr(columnName, columnNameList)
+	{
+		AttrNumber attrNumber = get_attnum(regclass, columnName);
+		if (attrNumber <= InvalidAttrNumber)
+		{
+			ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+							errmsg("column \"%s\" does not exist", columnName)));
+		}
+
+		Oid typeId = get_atttype(regclass, attrNumber);
+		if (BloomFilterHashFunctionOrNull(typeId) == NULL)
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("cannot build bloom filters for column \"%s\"",
+								   columnName),
+							errdetail("Data type %s has no default hash operator "
+									  "class.", format_type_be(typeId))));
+		}
+
+		bool duplicate = false;
+		for (int attrNumberIndex = 0; attrNumberIndex < attrNumberCount; attrNumberIndex++)
+		{
+			if (DatumGetInt16(attrNumberDatums[attrNumberIndex]) == attrNumber)
+			{
+				duplicate = true;
+				break;
+			}
+		}
+
+		if (!duplicate)
+		{
+			attrNumberDatums[attrNumberCount++] = Int16GetDatum(attrNumber);
+		}
+	}
+
+	if (attrNumberCount == 0)
+	{
+		return NULL;
+	}
+
+	return construct_array(attrNumberDatums, attrNumberCount, INT2OID,
+						   sizeof(int16), true, TYPALIGN_SHORT);
+}
+
+
+/*
+ * BloomFilterColumnNames returns the value of the bloom_filter_columns option
+ * for the given attribute numbers, skipping the columns that were dropped, or
+ * NULL if there are no such columns.
+ */
+static char *
+BloomFilterColumnNames(Oid regclass, ArrayType *attrNumberArray)
+{
+	Datum *attrNumberDatums = NULL;
+	int attrNumberCount = 0;
+	deconstruct_array(attrNumberArray, INT2OID, sizeof(int16), true, TYPALIGN_SHORT,
+					  &attrNumberDatums, NULL, &attrNumberCount);
+
+	StringInfo columnNames = makeStringInfo();
+	for (int attrNumberIndex = 0; attrNumberIndex < attrNumberCount; attrNumberIndex++)
+	{
+		AttrNumber attrNumber = DatumGetInt16(attrNumberDatums[attrNumberIndex]);
+		HeapTuple attributeTuple = SearchSysCache2(ATTNUM, ObjectIdGetDatum(regclass),
+												   Int16GetDatum(attrNumber));
+		if (!HeapTupleIsValid(attributeTuple))
+		{
+			continue;
+		}
+
+		Form_pg_attribute attributeForm = (Form_pg_attribute) GETSTRUCT(attributeTuple);
+		if (!attributeForm->attisdropped)
+		{
+			if (columnNames->len > 0)
+			{
+				appendStringInfoString(columnNames, ", ");
+			}
+
+			appendStringInfoString(columnNames,
+								   quote_identifier(NameStr(attributeForm->attname)));
+		}
+
+		ReleaseSysCache(attributeTuple);
+	}
+
+	return columnNames->len > 0 ? columnNames->data : NULL;
+}
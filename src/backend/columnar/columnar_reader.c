@@ -18,6 +18,7 @@
 
 #include "safe_lib.h"
 
+#include "access/hash.h"
 #include "access/nbtree.h"
 #include "access/xact.h"
 #include "catalog/pg_am.h"
@@ -27,13 +28,19 @@
 #include "optimizer/clauses.h"
 #include "optimizer/optimizer.h"
 #include "optimizer/restrictinfo.h"
+#include "storage/bufmgr.h"
 #include "storage/fd.h"
+#include "utils/array.h"
 #include "utils/guc.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
+#include "utils/typcache.h"
 
 #include "columnar/columnar.h"
+#include "columnar/columnar_bloom_filter.h"
+#include "columnar/columnar_chunk_cache.h"
+#include "columnar/columnar_row_mask.h"
 #include "columnar/columnar_storage.h"
 #include "columnar/columnar_tableam.h"
 #include "columnar/columnar_version_compat.h"
@@ -51,6 +58,13 @@ typedef struct ChunkGroupReadState
 	int columnCount;
 	List *projectedColumnList;  /* borrowed reference */
 	ChunkData *chunkGroupData;
+
+	/* rows that passed the vector filters, NULL if there are no filters */
+	bool *selectedRows;
+	int64 vectorFilteredRows;
+
+	/* whether no rows passed, in which case only the filter columns are read */
+	bool allRowsFiltered;
 } ChunkGroupReadState;
 
 typedef struct StripeReadState
@@ -62,12 +76,31 @@ typedef struct StripeReadState
 	Relation relation;
 	int chunkGroupIndex;
 	int64 chunkGroupsFiltered;
+	int64 chunkGroupsCovered;
 	MemoryContext stripeReadContext;
 	StripeBuffers *stripeBuffers;   /* allocated in stripeReadContext */
+	bytea *rowMask;                 /* deleted rows, NULL if there are none */
 	List *projectedColumnList;      /* borrowed reference */
+	List *vectorFilterList;         /* borrowed reference */
+	List *filterColumnList;         /* projected columns of the vector filters */
+	List *lateColumnList;           /* the other projected columns */
+	int64 vectorFilteredRows;
+	int64 chunkGroupsVectorFiltered;
 	ChunkGroupReadState *chunkGroupReadState; /* owned */
 } StripeReadState;
 
+/*
+ * BloomFilterQual represents a qual in the form of "column = constant" or
+ * "column = ANY(constant array)" that chunk bloom filters can refute, along
+ * with the hashes of the non-NULL constants.
+ */
+typedef struct BloomFilterQual
+{
+	uint32 columnIndex;
+	uint64 *hashArray;
+	uint32 hashCount;
+} BloomFilterQual;
+
 struct ColumnarReadState
 {
 	TupleDesc tupleDescriptor;
@@ -76,6 +109,26 @@ struct ColumnarReadState
 	StripeMetadata *currentStripeMetadata;
 	StripeReadState *stripeReadState;
 
+	/*
+	 * Metadata of the stripe to read after the current one, if it was
+	 * already looked up to prefetch its data, see PrefetchNextStripe.
+	 */
+	StripeMetadata *nextStripeMetadata;
+	bool nextStripeFound;
+
+	/*
+	 * Skip list of the next stripe that PrefetchNextStripe read, so that
+	 * BeginStripeRead doesn't read it again. It is allocated in
+	 * nextStripeSkipListContext. Once the next stripe is being read, its
+	 * skip list moves to stripeSkipListContext, and the two contexts swap.
+	 */
+	StripeSkipList *nextStripeSkipList;
+	MemoryContext nextStripeSkipListContext;
+	MemoryContext stripeSkipListContext;
+
+	/* memory for checking the stripe summaries, reset after each stripe */
+	MemoryContext stripeSummaryContext;
+
 	/*
 	 * Integer list of attribute numbers (1-indexed) for columns needed by the
 	 * query.
@@ -85,8 +138,26 @@ struct ColumnarReadState
 	List *whereClauseList;
 	List *whereClauseVars;
 
+	/* pushed-down quals that can be evaluated over column vectors */
+	List *vectorFilterList;
+
 	MemoryContext stripeReadContext;
 	int64 chunkGroupsFiltered;
+	int64 vectorFilteredRows;
+	int64 chunkGroupsVectorFiltered;
+
+	/* number of stripes skipped using stripe summaries, read and prefetched */
+	int64 stripesFiltered;
+	int64 stripesRead;
+	int64 stripesPrefetched;
+
+	/*
+	 * If set, called for the chunk groups whose rows all satisfy the where
+	 * clauses, see ColumnarReadSetCoveredChunkGroupCallback.
+	 */
+	ColumnarCoveredChunkGroupCallback coveredChunkGroupCallback;
+	void *coveredChunkGroupCallbackArg;
+	int64 chunkGroupsCovered;
 
 	/*
 	 * Memory context guaranteed to be not freed during scan so we can
@@ -97,6 +168,20 @@ struct ColumnarReadState
 
 	Snapshot snapshot;
 	bool snapshotRegisteredByUs;
+
+	/*
+	 * Ordinal of the next stripe to be claimed, shared by all participants
+	 * of a parallel scan. NULL if we are not doing a parallel scan.
+	 */
+	pg_atomic_uint64 *parallelStripeCursor;
+
+	/*
+	 * Position of the participant in the stripe sequence during a parallel
+	 * scan, i.e.: ordinal of the next stripe that it will visit and the
+	 * highest row number of the last stripe that it visited.
+	 */
+	uint64 parallelNextStripeOrdinal;
+	uint64 parallelLastRowNumber;
 };
 
 /* static function declarations */
@@ -110,24 +195,49 @@ static void ReadStripeRowByRowNumber(ColumnarReadState *readState,
 static bool StripeReadIsCurrentChunkGroup(StripeReadState *stripeReadState,
 										  int chunkGroupIndex);
 static void ReadChunkGroupRowByRowOffset(ChunkGroupReadState *chunkGroupReadState,
-										 StripeMetadata *stripeMetadata,
+										 uint64 chunkGroupRowOffset,
 										 uint64 stripeRowOffset, Datum *columnValues,
 										 bool *columnNulls);
 static bool StripeReadInProgress(ColumnarReadState *readState);
 static bool HasUnreadStripe(ColumnarReadState *readState);
+static StripeMetadata * FindNextStripeToRead(ColumnarReadState *readState,
+											 uint64 lastReadRowNumber);
+static void PrefetchNextStripe(ColumnarReadState *readState);
+static StripeSkipList * TakeNextStripeSkipList(ColumnarReadState *readState);
+static void PrefetchColumnChunks(Relation relation, uint64 stripeOffset,
+								 ColumnChunkSkipNode *chunkSkipNodeArray,
+								 uint32 chunkCount, bool *selectedChunkMask);
+static void ExtendPrefetchRange(Relation relation, uint64 offset, uint64 length,
+								uint64 *rangeOffset, uint64 *rangeLength);
+static StripeMetadata * FindNextFlushedStripe(ColumnarReadState *readState,
+											  uint64 lastReadRowNumber);
+static StripeMetadata * ClaimNextParallelStripe(ColumnarReadState *readState);
+static bool StripeRefutedBySummary(ColumnarReadState *readState,
+								   StripeMetadata *stripeMetadata);
 static StripeReadState * BeginStripeRead(StripeMetadata *stripeMetadata, Relation rel,
 										 TupleDesc tupleDesc, List *projectedColumnList,
 										 List *whereClauseList, List *whereClauseVars,
+										 List *vectorFilterList,
+										 ColumnarCoveredChunkGroupCallback
+										 coveredChunkGroupCallback,
+										 void *coveredChunkGroupCallbackArg,
+										 StripeSkipList *stripeSkipList,
 										 MemoryContext stripeReadContext,
 										 Snapshot snapshot);
 static void AdvanceStripeRead(ColumnarReadState *readState);
 static bool SnapshotMightSeeUnflushedStripes(Snapshot snapshot);
 static bool ReadStripeNextRow(StripeReadState *stripeReadState, Datum *columnValues,
 							  bool *columnNulls);
+static int FindSelectedChunkGroup(StripeBuffers *stripeBuffers,
+								  uint64 stripeRowOffset);
 static ChunkGroupReadState * BeginChunkGroupRead(StripeBuffers *stripeBuffers, int
 												 chunkIndex,
 												 TupleDesc tupleDesc,
 												 List *projectedColumnList,
+												 List *filterColumnList,
+												 List *lateColumnList,
+												 List *vectorFilterList,
+												 bytea *rowMask,
 												 MemoryContext cxt);
 static void EndChunkGroupRead(ChunkGroupReadState *chunkGroupReadState);
 static bool ReadChunkGroupNextRow(ChunkGroupReadState *chunkGroupReadState,
@@ -140,14 +250,43 @@ static StripeBuffers * LoadFilteredStripeBuffers(Relation relation,
 												 List *whereClauseList,
 												 List *whereClauseVars,
 												 int64 *chunkGroupsFiltered,
+												 ColumnarCoveredChunkGroupCallback
+												 coveredChunkGroupCallback,
+												 void *coveredChunkGroupCallbackArg,
+												 int64 *chunkGroupsCovered,
+												 bytea *rowMask,
+												 StripeSkipList *stripeSkipList,
 												 Snapshot snapshot);
 static ColumnBuffers * LoadColumnBuffers(Relation relation,
 										 ColumnChunkSkipNode *chunkSkipNodeArray,
 										 uint32 chunkCount, uint64 stripeOffset,
-										 Form_pg_attribute attributeForm);
+										 Form_pg_attribute attributeForm,
+										 StripeBuffers *stripeBuffers);
+static void DeselectDeletedChunkGroups(StripeSkipList *stripeSkipList,
+									   bool *selectedChunkMask, bytea *rowMask);
 static bool * SelectedChunkMask(StripeSkipList *stripeSkipList,
 								List *whereClauseList, List *whereClauseVars,
 								int64 *chunkGroupsFiltered);
+static void ProcessCoveredChunkGroups(Relation relation,
+									  StripeMetadata *stripeMetadata,
+									  StripeSkipList *stripeSkipList,
+									  bool *selectedChunkMask, bytea *rowMask,
+									  List *whereClauseList, List *whereClauseVars,
+									  ColumnarCoveredChunkGroupCallback
+									  coveredChunkGroupCallback,
+									  void *coveredChunkGroupCallbackArg,
+									  int64 *chunkGroupsCovered);
+static bool ChunkGroupCoveredByQuals(Relation relation, StripeMetadata *stripeMetadata,
+									 StripeSkipList *stripeSkipList, uint32 chunkIndex,
+									 List *whereClauseList, List *whereClauseVars);
+static bool ColumnChunkHasNulls(Relation relation, StripeMetadata *stripeMetadata,
+								ColumnChunkSkipNode *chunkSkipNode);
+static List * BuildBloomFilterQualList(List *whereClauseList);
+static BloomFilterQual * BuildBloomFilterQual(Oid operatorId, Oid inputCollation,
+											  Node *leftOperand, Node *rightOperand,
+											  bool isArray);
+static bool BloomFilterQualRefuted(BloomFilterQual *bloomFilterQual,
+								   bytea *bloomFilter);
 static Node * BuildBaseConstraint(Var *variable);
 static List * GetClauseVars(List *clauses, int natts);
 static OpExpr * MakeOpExpression(Var *variable, int16 strategyNumber);
@@ -160,13 +299,13 @@ static uint32 StripeSkipListRowCount(StripeSkipList *stripeSkipList);
 static bool * ProjectedColumnMask(uint32 columnCount, List *projectedColumnList);
 static void DeserializeBoolArray(StringInfo boolArrayBuffer, bool *boolArray,
 								 uint32 boolArrayLength);
-static void DeserializeDatumArray(StringInfo datumBuffer, bool *existsArray,
-								  uint32 datumCount, bool datumTypeByValue,
-								  int datumTypeLength, char datumTypeAlign,
-								  Datum *datumArray);
-static ChunkData * DeserializeChunkData(StripeBuffers *stripeBuffers, uint64 chunkIndex,
-										uint32 rowCount, TupleDesc tupleDescriptor,
-										List *projectedColumnList);
+static void DeserializeDatumArray(StringInfo datumBuffer, EncodingType encodingType,
+								  bool *existsArray, uint32 datumCount,
+								  Form_pg_attribute attributeForm, Datum *datumArray,
+								  ChunkColumnDictionary **dictionary);
+static void DeserializeChunkColumns(StripeBuffers *stripeBuffers, uint64 chunkIndex,
+									TupleDesc tupleDescriptor, List *columnList,
+									ChunkData *chunkData);
 static Datum ColumnDefaultValue(TupleConstr *tupleConstraints,
 								Form_pg_attribute attributeForm);
 
@@ -175,12 +314,16 @@ static Datum ColumnDefaultValue(TupleConstr *tupleConstraints,
  * read handle that's used during reading rows and finishing the read operation.
  *
  * projectedColumnList is an integer list of attribute numbers (1-indexed).
+ *
+ * If parallelStripeCursor is not NULL, then the stripes are distributed
+ * among the participants of a parallel scan that share the same cursor and
+ * snapshot, and we only read the stripes that we claim from the cursor.
  */
 ColumnarReadState *
 ColumnarBeginRead(Relation relation, TupleDesc tupleDescriptor,
 				  List *projectedColumnList, List *whereClauseList,
 				  MemoryContext scanContext, Snapshot snapshot,
-				  bool randomAccess)
+				  bool randomAccess, pg_atomic_uint64 *parallelStripeCursor)
 {
 	/*
 	 * We allocate all stripe specific data in the stripeReadContext, and reset
@@ -194,11 +337,35 @@ ColumnarBeginRead(Relation relation, TupleDesc tupleDescriptor,
 	readState->projectedColumnList = projectedColumnList;
 	readState->whereClauseList = whereClauseList;
 	readState->whereClauseVars = GetClauseVars(whereClauseList, tupleDescriptor->natts);
+	readState->vectorFilterList = NIL;
 	readState->chunkGroupsFiltered = 0;
+	readState->vectorFilteredRows = 0;
+	readState->chunkGroupsVectorFiltered = 0;
+	readState->stripesFiltered = 0;
+	readState->stripesRead = 0;
+	readState->stripesPrefetched = 0;
+	readState->coveredChunkGroupCallback = NULL;
+	readState->coveredChunkGroupCallbackArg = NULL;
+	readState->chunkGroupsCovered = 0;
 	readState->tupleDescriptor = tupleDescriptor;
 	readState->stripeReadContext = stripeReadContext;
 	readState->stripeReadState = NULL;
+	readState->nextStripeMetadata = NULL;
+	readState->nextStripeFound = false;
+	readState->nextStripeSkipList = NULL;
+	readState->nextStripeSkipListContext = NULL;
+	readState->stripeSkipListContext = NULL;
+	readState->stripeSummaryContext = NULL;
 	readState->scanContext = scanContext;
+	readState->parallelStripeCursor = parallelStripeCursor;
+	readState->parallelNextStripeOrdinal = 0;
+	readState->parallelLastRowNumber = COLUMNAR_INVALID_ROW_NUMBER;
+
+	if (columnar_enable_vector_filter)
+	{
+		readState->vectorFilterList = BuildColumnarVectorFilters(whereClauseList,
+																 tupleDescriptor);
+	}
 
 	/*
 	 * Note that ColumnarReadFlushPendingWrites might update those two by
@@ -213,8 +380,15 @@ ColumnarBeginRead(Relation relation, TupleDesc tupleDescriptor,
 		 * When doing random access (i.e.: index scan), we don't need to flush
 		 * pending writes until we need to read them.
 		 * columnar_index_fetch_tuple would do so when needed.
+		 *
+		 * Pending writes cannot be flushed in parallel mode either, but the
+		 * leader already flushed them before starting a parallel scan, see
+		 * ColumnarScan_BeginCustomScan.
 		 */
-		ColumnarReadFlushPendingWrites(readState);
+		if (parallelStripeCursor == NULL)
+		{
+			ColumnarReadFlushPendingWrites(readState);
+		}
 
 		/*
 		 * AdvanceStripeRead sets currentStripeMetadata for the first stripe
@@ -327,6 +501,12 @@ ColumnarReadNextRow(ColumnarReadState *readState, Datum *columnValues, bool *col
 	{
 		if (!StripeReadInProgress(readState))
 		{
+			if (readState->parallelStripeCursor != NULL &&
+				readState->currentStripeMetadata == NULL)
+			{
+				readState->currentStripeMetadata = ClaimNextParallelStripe(readState);
+			}
+
 			if (!HasUnreadStripe(readState))
 			{
 				return false;
@@ -338,8 +518,25 @@ ColumnarReadNextRow(ColumnarReadState *readState, Datum *columnValues, bool *col
 														 readState->projectedColumnList,
 														 readState->whereClauseList,
 														 readState->whereClauseVars,
+														 readState->vectorFilterList,
+														 readState->
+														 coveredChunkGroupCallback,
+														 readState->
+														 coveredChunkGroupCallbackArg,
+														 TakeNextStripeSkipList(
+															 readState),
 														 readState->stripeReadContext,
 														 readState->snapshot);
+			readState->stripesRead++;
+
+			/*
+			 * Parallel scans claim their next stripe only once they are done
+			 * with the current one, so they don't know what to prefetch.
+			 */
+			if (readState->parallelStripeCursor == NULL)
+			{
+				PrefetchNextStripe(readState);
+			}
 		}
 
 		if (!ReadStripeNextRow(readState->stripeReadState, columnValues, columnNulls))
@@ -350,8 +547,17 @@ ColumnarReadNextRow(ColumnarReadState *readState, Datum *columnValues, bool *col
 
 		if (rowNumber)
 		{
+			/*
+			 * Chunk groups that were skipped are not counted in the current
+			 * row of the stripe, so compute the row number from the offset
+			 * of the chunk group being read.
+			 */
+			StripeReadState *stripeReadState = readState->stripeReadState;
+			StripeBuffers *stripeBuffers = stripeReadState->stripeBuffers;
 			*rowNumber = readState->currentStripeMetadata->firstRowNumber +
-						 readState->stripeReadState->currentRow - 1;
+						 stripeBuffers->selectedChunkGroupRowOffsets[
+				stripeReadState->chunkGroupIndex] +
+						 stripeReadState->chunkGroupReadState->currentRow - 1;
 		}
 
 		return true;
@@ -422,6 +628,7 @@ ColumnarReadRowByRowNumber(ColumnarReadState *readState,
 		TupleDesc relationTupleDesc = RelationGetDescr(columnarRelation);
 		List *whereClauseList = NIL;
 		List *whereClauseVars = NIL;
+		List *vectorFilterList = NIL;
 		MemoryContext stripeReadContext = readState->stripeReadContext;
 		readState->stripeReadState = BeginStripeRead(stripeMetadata,
 													 columnarRelation,
@@ -429,12 +636,21 @@ ColumnarReadRowByRowNumber(ColumnarReadState *readState,
 													 readState->projectedColumnList,
 													 whereClauseList,
 													 whereClauseVars,
+													 vectorFilterList,
+													 NULL, NULL, NULL,
 													 stripeReadContext,
 													 snapshot);
 
 		readState->currentStripeMetadata = stripeMetadata;
 	}
 
+	uint64 stripeRowOffset = rowNumber - readState->currentStripeMetadata->firstRowNumber;
+	if (RowMaskContainsRow(readState->stripeReadState->rowMask, stripeRowOffset))
+	{
+		/* row is deleted */
+		return false;
+	}
+
 	ReadStripeRowByRowNumber(readState, rowNumber, columnValues, columnNulls);
 
 	return true;
@@ -496,7 +712,14 @@ ReadStripeRowByRowNumber(ColumnarReadState *readState,
 
 	/* find the exact chunk group to be read */
 	uint64 stripeRowOffset = rowNumber - stripeMetadata->firstRowNumber;
-	int chunkGroupIndex = stripeRowOffset / stripeMetadata->chunkGroupRowCount;
+	int chunkGroupIndex = FindSelectedChunkGroup(stripeReadState->stripeBuffers,
+												 stripeRowOffset);
+	if (chunkGroupIndex < 0)
+	{
+		/* not expected but be on the safe side */
+		ereport(ERROR, (errmsg("could not find the row in stripe")));
+	}
+
 	if (!StripeReadIsCurrentChunkGroup(stripeReadState, chunkGroupIndex))
 	{
 		if (stripeReadState->chunkGroupReadState)
@@ -510,12 +733,44 @@ ReadStripeRowByRowNumber(ColumnarReadState *readState,
 			stripeReadState->chunkGroupIndex,
 			stripeReadState->tupleDescriptor,
 			stripeReadState->projectedColumnList,
+			stripeReadState->filterColumnList,
+			stripeReadState->lateColumnList,
+			stripeReadState->vectorFilterList,
+			stripeReadState->rowMask,
 			stripeReadState->stripeReadContext);
 	}
 
 	ReadChunkGroupRowByRowOffset(stripeReadState->chunkGroupReadState,
-								 stripeMetadata, stripeRowOffset,
-								 columnValues, columnNulls);
+								 stripeReadState->stripeBuffers->
+								 selectedChunkGroupRowOffsets[chunkGroupIndex],
+								 stripeRowOffset, columnValues, columnNulls);
+}
+
+
+/*
+ * FindSelectedChunkGroup returns the index of the selected chunk group that
+ * contains the row with given offset within its stripe, or -1 if the row is
+ * not in any of the selected chunk groups.
+ */
+static int
+FindSelectedChunkGroup(StripeBuffers *stripeBuffers, uint64 stripeRowOffset)
+{
+	for (uint32 chunkIndex = 0; chunkIndex < stripeBuffers->selectedChunkGroupCount;
+		 chunkIndex++)
+	{
+		uint64 chunkGroupRowOffset =
+			stripeBuffers->selectedChunkGroupRowOffsets[chunkIndex];
+		uint32 chunkGroupRowCount =
+			stripeBuffers->selectedChunkGroupRowCounts[chunkIndex];
+
+		if (stripeRowOffset >= chunkGroupRowOffset &&
+			stripeRowOffset < chunkGroupRowOffset + chunkGroupRowCount)
+		{
+			return chunkIndex;
+		}
+	}
+
+	return -1;
 }
 
 
@@ -537,18 +792,18 @@ StripeReadIsCurrentChunkGroup(StripeReadState *stripeReadState, int chunkGroupIn
 
 /*
  * ReadChunkGroupRowByRowOffset reads row with stripeRowOffset from given
- * chunkGroupReadState into columnValues and columnNulls.
+ * chunkGroupReadState, whose first row is at chunkGroupRowOffset within the
+ * stripe, into columnValues and columnNulls.
  * Errors out if no such row exists in the chunk group being read.
  */
 static void
 ReadChunkGroupRowByRowOffset(ChunkGroupReadState *chunkGroupReadState,
-							 StripeMetadata *stripeMetadata,
+							 uint64 chunkGroupRowOffset,
 							 uint64 stripeRowOffset, Datum *columnValues,
 							 bool *columnNulls)
 {
 	/* set the exact row number to be read from given chunk roup */
-	chunkGroupReadState->currentRow = stripeRowOffset %
-									  stripeMetadata->chunkGroupRowCount;
+	chunkGroupReadState->currentRow = stripeRowOffset - chunkGroupRowOffset;
 	if (!ReadChunkGroupNextRow(chunkGroupReadState, columnValues, columnNulls))
 	{
 		/* not expected but be on the safe side */
@@ -589,12 +844,30 @@ ColumnarRescan(ColumnarReadState *readState, List *scanQual)
 
 	ColumnarResetRead(readState);
 
-	/* set currentStripeMetadata for the first stripe to read */
-	AdvanceStripeRead(readState);
+	readState->whereClauseList = copyObject(scanQual);
+	readState->vectorFilterList = NIL;
+
+	if (columnar_enable_vector_filter)
+	{
+		readState->vectorFilterList =
+			BuildColumnarVectorFilters(readState->whereClauseList,
+									   readState->tupleDescriptor);
+	}
 
 	readState->chunkGroupsFiltered = 0;
+	readState->vectorFilteredRows = 0;
+	readState->chunkGroupsVectorFiltered = 0;
+	readState->stripesFiltered = 0;
+	readState->stripesRead = 0;
+	readState->stripesPrefetched = 0;
+	readState->chunkGroupsCovered = 0;
+
+	/*
+	 * Set currentStripeMetadata for the first stripe to read. This needs the
+	 * new quals since it might skip stripes based on stripe summaries.
+	 */
+	AdvanceStripeRead(readState);
 
-	readState->whereClauseList = copyObject(scanQual);
 	MemoryContextSwitchTo(oldContext);
 }
 
@@ -615,11 +888,28 @@ ColumnarEndRead(ColumnarReadState *readState)
 	}
 
 	MemoryContextDelete(readState->stripeReadContext);
+
+	if (readState->nextStripeSkipListContext != NULL)
+	{
+		MemoryContextDelete(readState->nextStripeSkipListContext);
+		MemoryContextDelete(readState->stripeSkipListContext);
+	}
+
+	if (readState->stripeSummaryContext != NULL)
+	{
+		MemoryContextDelete(readState->stripeSummaryContext);
+	}
+
 	if (readState->currentStripeMetadata)
 	{
 		pfree(readState->currentStripeMetadata);
 	}
 
+	if (readState->nextStripeMetadata)
+	{
+		pfree(readState->nextStripeMetadata);
+	}
+
 	pfree(readState);
 }
 
@@ -639,15 +929,30 @@ ColumnarResetRead(ColumnarReadState *readState)
 		readState->stripeReadState = NULL;
 		MemoryContextReset(readState->stripeReadContext);
 	}
+
+	if (readState->nextStripeMetadata)
+	{
+		pfree(readState->nextStripeMetadata);
+		readState->nextStripeMetadata = NULL;
+	}
+
+	readState->nextStripeSkipList = NULL;
+
+	readState->nextStripeFound = false;
 }
 
 
 /*
- * BeginStripeRead allocates state for reading a stripe.
+ * BeginStripeRead allocates state for reading a stripe. If the caller already
+ * read the skip list of the stripe, it is passed in stripeSkipList, and it
+ * must stay valid until the stripe is read. Otherwise, stripeSkipList is NULL.
  */
 static StripeReadState *
 BeginStripeRead(StripeMetadata *stripeMetadata, Relation rel, TupleDesc tupleDesc,
 				List *projectedColumnList, List *whereClauseList, List *whereClauseVars,
+				List *vectorFilterList,
+				ColumnarCoveredChunkGroupCallback coveredChunkGroupCallback,
+				void *coveredChunkGroupCallbackArg, StripeSkipList *stripeSkipList,
 				MemoryContext stripeReadContext, Snapshot snapshot)
 {
 	MemoryContext oldContext = MemoryContextSwitchTo(stripeReadContext);
@@ -659,7 +964,13 @@ BeginStripeRead(StripeMetadata *stripeMetadata, Relation rel, TupleDesc tupleDes
 	stripeReadState->columnCount = tupleDesc->natts;
 	stripeReadState->chunkGroupReadState = NULL;
 	stripeReadState->projectedColumnList = projectedColumnList;
+	stripeReadState->vectorFilterList = vectorFilterList;
+	stripeReadState->filterColumnList =
+		ColumnarVectorFilterColumnList(vectorFilterList, projectedColumnList);
+	stripeReadState->lateColumnList =
+		list_difference_int(projectedColumnList, stripeReadState->filterColumnList);
 	stripeReadState->stripeReadContext = stripeReadContext;
+	stripeReadState->rowMask = ReadStripeRowMask(rel, stripeMetadata->id, snapshot);
 
 	stripeReadState->stripeBuffers = LoadFilteredStripeBuffers(rel,
 															   stripeMetadata,
@@ -669,6 +980,12 @@ BeginStripeRead(StripeMetadata *stripeMetadata, Relation rel, TupleDesc tupleDes
 															   whereClauseVars,
 															   &stripeReadState->
 															   chunkGroupsFiltered,
+															   coveredChunkGroupCallback,
+															   coveredChunkGroupCallbackArg,
+															   &stripeReadState->
+															   chunkGroupsCovered,
+															   stripeReadState->rowMask,
+															   stripeSkipList,
 															   snapshot);
 
 	stripeReadState->rowCount = stripeReadState->stripeBuffers->rowCount;
@@ -683,6 +1000,10 @@ BeginStripeRead(StripeMetadata *stripeMetadata, Relation rel, TupleDesc tupleDes
 /*
  * AdvanceStripeRead updates chunkGroupsFiltered and sets
  * currentStripeMetadata for next stripe read.
+ *
+ * During a parallel scan, the next stripe is instead claimed lazily by
+ * ColumnarReadNextRow. This is because a rescan resets the read state
+ * before the shared cursor is reset for the next round of the scan.
  */
 static void
 AdvanceStripeRead(ColumnarReadState *readState)
@@ -698,33 +1019,34 @@ AdvanceStripeRead(ColumnarReadState *readState)
 
 		readState->chunkGroupsFiltered +=
 			readState->stripeReadState->chunkGroupsFiltered;
+		readState->vectorFilteredRows +=
+			readState->stripeReadState->vectorFilteredRows;
+		readState->chunkGroupsVectorFiltered +=
+			readState->stripeReadState->chunkGroupsVectorFiltered;
+		readState->chunkGroupsCovered +=
+			readState->stripeReadState->chunkGroupsCovered;
 	}
-
-	readState->currentStripeMetadata = FindNextStripeByRowNumber(readState->relation,
-																 lastReadRowNumber,
-																 readState->snapshot);
-
-	if (readState->currentStripeMetadata &&
-		StripeWriteState(readState->currentStripeMetadata) != STRIPE_WRITE_FLUSHED &&
-		!SnapshotMightSeeUnflushedStripes(readState->snapshot))
+	else if (readState->parallelStripeCursor != NULL)
 	{
-		/*
-		 * To be on the safe side, error out if we don't expect to encounter
-		 * with an un-flushed stripe. Otherwise, we will skip such stripes
-		 * until finding a flushed one.
-		 */
-		ereport(ERROR, (errmsg(UNEXPECTED_STRIPE_READ_ERR_MSG,
-							   RelationGetRelationName(readState->relation),
-							   readState->currentStripeMetadata->id)));
+		readState->parallelNextStripeOrdinal = 0;
+		readState->parallelLastRowNumber = COLUMNAR_INVALID_ROW_NUMBER;
 	}
 
-	while (readState->currentStripeMetadata &&
-		   StripeWriteState(readState->currentStripeMetadata) != STRIPE_WRITE_FLUSHED)
+	if (readState->parallelStripeCursor != NULL)
+	{
+		readState->currentStripeMetadata = NULL;
+	}
+	else if (readState->nextStripeFound)
+	{
+		/* PrefetchNextStripe already looked up the next stripe */
+		readState->currentStripeMetadata = readState->nextStripeMetadata;
+		readState->nextStripeMetadata = NULL;
+		readState->nextStripeFound = false;
+	}
+	else
 	{
-		readState->currentStripeMetadata =
-			FindNextStripeByRowNumber(readState->relation,
-									  readState->currentStripeMetadata->firstRowNumber,
-									  readState->snapshot);
+		readState->currentStripeMetadata = FindNextStripeToRead(readState,
+																lastReadRowNumber);
 	}
 
 	readState->stripeReadState = NULL;
@@ -735,183 +1057,796 @@ AdvanceStripeRead(ColumnarReadState *readState)
 
 
 /*
- * SnapshotMightSeeUnflushedStripes returns true if given snapshot is
- * expected to see un-flushed stripes either because of other backends'
- * pending writes or aborted transactions.
+ * FindNextStripeToRead returns the metadata of the first flushed stripe that
+ * comes after the given row number and that is not refuted by its stripe
+ * summary, or NULL if there is no such stripe.
  */
-static bool
-SnapshotMightSeeUnflushedStripes(Snapshot snapshot)
+static StripeMetadata *
+FindNextStripeToRead(ColumnarReadState *readState, uint64 lastReadRowNumber)
 {
-	if (snapshot == InvalidSnapshot)
+	StripeMetadata *stripeMetadata = FindNextFlushedStripe(readState,
+														   lastReadRowNumber);
+	while (stripeMetadata != NULL &&
+		   StripeRefutedBySummary(readState, stripeMetadata))
 	{
-		return false;
+		StripeMetadata *skippedStripeMetadata = stripeMetadata;
+		stripeMetadata = FindNextFlushedStripe(readState,
+											   StripeGetHighestRowNumber(
+												   skippedStripeMetadata));
+		pfree(skippedStripeMetadata);
 	}
 
-	switch (snapshot->snapshot_type)
-	{
-		case SNAPSHOT_ANY:
-		case SNAPSHOT_DIRTY:
-		case SNAPSHOT_NON_VACUUMABLE:
-		{
-			return true;
-		}
-
-		default:
-		{
-			return false;
-		}
-	}
+	return stripeMetadata;
 }
 
 
 /*
- * ReadStripeNextRow: If more rows can be read from the current stripe, fill
- * in non-NULL columnValues and return true. Otherwise, return false.
- *
- * On entry, all entries in columnNulls should be true; this function only
- * sets non-NULL entries.
+ * PrefetchNextStripe looks up the stripe that will be read after the current
+ * one and issues read-ahead for the chunks of the projected columns that its
+ * skip list doesn't refute. This way, the I/O for the next stripe overlaps
+ * with decompressing and returning the rows of the current one, rather than
+ * the scan stalling on it once the current stripe is exhausted.
  *
+ * Like bitmap heap scans, we only prefetch if effective_io_concurrency allows
+ * asynchronous I/O.
  */
-static bool
-ReadStripeNextRow(StripeReadState *stripeReadState, Datum *columnValues,
-				  bool *columnNulls)
+static void
+PrefetchNextStripe(ColumnarReadState *readState)
 {
-	if (stripeReadState->currentRow >= stripeReadState->rowCount)
+	if (effective_io_concurrency == 0 || readState->projectedColumnList == NIL)
 	{
-		Assert(stripeReadState->currentRow == stripeReadState->rowCount);
-		return false;
+		return;
 	}
 
-	while (true)
+	MemoryContext oldContext = MemoryContextSwitchTo(readState->scanContext);
+
+	uint64 lastReadRowNumber =
+		StripeGetHighestRowNumber(readState->currentStripeMetadata);
+	StripeMetadata *stripeMetadata = FindNextStripeToRead(readState,
+														  lastReadRowNumber);
+
+	readState->nextStripeMetadata = stripeMetadata;
+	readState->nextStripeFound = true;
+
+	MemoryContextSwitchTo(oldContext);
+
+	if (stripeMetadata == NULL)
 	{
-		if (stripeReadState->chunkGroupReadState == NULL)
-		{
-			stripeReadState->chunkGroupReadState = BeginChunkGroupRead(
-				stripeReadState->stripeBuffers,
-				stripeReadState->
-				chunkGroupIndex,
-				stripeReadState->
-				tupleDescriptor,
-				stripeReadState->
-				projectedColumnList,
-				stripeReadState->
-				stripeReadContext);
-		}
+		return;
+	}
 
-		if (!ReadChunkGroupNextRow(stripeReadState->chunkGroupReadState, columnValues,
-								   columnNulls))
+	if (readState->nextStripeSkipListContext == NULL)
+	{
+		readState->nextStripeSkipListContext =
+			AllocSetContextCreate(readState->scanContext,
+								  "Next Stripe Skip List Memory Context",
+								  ALLOCSET_DEFAULT_SIZES);
+		readState->stripeSkipListContext =
+			AllocSetContextCreate(readState->scanContext,
+								  "Stripe Skip List Memory Context",
+								  ALLOCSET_DEFAULT_SIZES);
+	}
+
+	/* BeginStripeRead reuses the skip list when it reads the stripe */
+	oldContext = MemoryContextSwitchTo(readState->nextStripeSkipListContext);
+
+	StripeSkipList *stripeSkipList = ReadStripeSkipList(readState->relation,
+														stripeMetadata->id,
+														readState->tupleDescriptor,
+														stripeMetadata->chunkCount,
+														readState->snapshot);
+	readState->nextStripeSkipList = stripeSkipList;
+
+	/* the chunk groups are counted as filtered when the stripe is read */
+	int64 chunkGroupsFiltered = 0;
+	bool *selectedChunkMask = SelectedChunkMask(stripeSkipList,
+												readState->whereClauseList,
+												readState->whereClauseVars,
+												&chunkGroupsFiltered);
+
+	int attno;
+	foreach_declared_int(attno, readState->projectedColumnList)
+	{
+		/* attno is 1-indexed; chunkSkipNodeArray is 0-indexed */
+		uint32 columnIndex = attno - 1;
+
+		/* columns added after the stripe was written are not stored */
+		if (columnIndex >= stripeMetadata->columnCount)
 		{
-			/* if this chunk group is exhausted, fetch the next one and loop */
-			EndChunkGroupRead(stripeReadState->chunkGroupReadState);
-			stripeReadState->chunkGroupReadState = NULL;
-			stripeReadState->chunkGroupIndex++;
 			continue;
 		}
 
-		stripeReadState->currentRow++;
-		return true;
+		PrefetchColumnChunks(readState->relation, stripeMetadata->fileOffset,
+							 stripeSkipList->chunkSkipNodeArray[columnIndex],
+							 stripeSkipList->chunkCount, selectedChunkMask);
 	}
 
-	Assert(stripeReadState->currentRow == stripeReadState->rowCount);
-	return false;
+	readState->stripesPrefetched++;
+
+	MemoryContextSwitchTo(oldContext);
 }
 
 
 /*
- * BeginChunkGroupRead allocates state for reading a chunk.
+ * TakeNextStripeSkipList returns the skip list that PrefetchNextStripe read
+ * for the stripe that is about to be read, or NULL if it didn't read one. The
+ * returned skip list stays valid until the skip list of the stripe after it
+ * is taken, at which point it is freed.
  */
-static ChunkGroupReadState *
-BeginChunkGroupRead(StripeBuffers *stripeBuffers, int chunkIndex, TupleDesc tupleDesc,
-					List *projectedColumnList, MemoryContext cxt)
+static StripeSkipList *
+TakeNextStripeSkipList(ColumnarReadState *readState)
 {
-	uint32 chunkGroupRowCount =
-		stripeBuffers->selectedChunkGroupRowCounts[chunkIndex];
-
-	MemoryContext oldContext = MemoryContextSwitchTo(cxt);
-
-	ChunkGroupReadState *chunkGroupReadState = palloc0(sizeof(ChunkGroupReadState));
+	StripeSkipList *stripeSkipList = readState->nextStripeSkipList;
+	if (stripeSkipList == NULL)
+	{
+		return NULL;
+	}
 
-	chunkGroupReadState->currentRow = 0;
-	chunkGroupReadState->rowCount = chunkGroupRowCount;
-	chunkGroupReadState->columnCount = tupleDesc->natts;
-	chunkGroupReadState->projectedColumnList = projectedColumnList;
+	MemoryContext skipListContext = readState->nextStripeSkipListContext;
+	readState->nextStripeSkipListContext = readState->stripeSkipListContext;
+	readState->stripeSkipListContext = skipListContext;
 
-	chunkGroupReadState->chunkGroupData = DeserializeChunkData(stripeBuffers, chunkIndex,
-															   chunkGroupRowCount,
-															   tupleDesc,
-															   projectedColumnList);
-	MemoryContextSwitchTo(oldContext);
+	/* the previous stripe is done, so its skip list is no longer needed */
+	MemoryContextReset(readState->nextStripeSkipListContext);
+	readState->nextStripeSkipList = NULL;
 
-	return chunkGroupReadState;
+	return stripeSkipList;
 }
 
 
 /*
- * EndChunkRead finishes a chunk read.
+ * PrefetchColumnChunks issues read-ahead for the "exists" and "values" chunks
+ * of the selected chunk groups of a column. Like LoadColumnBuffers, we visit
+ * them in the order they are stored on disk, so that adjacent chunks are
+ * prefetched as a single range.
  */
 static void
-EndChunkGroupRead(ChunkGroupReadState *chunkGroupReadState)
+PrefetchColumnChunks(Relation relation, uint64 stripeOffset,
+					 ColumnChunkSkipNode *chunkSkipNodeArray, uint32 chunkCount,
+					 bool *selectedChunkMask)
 {
-	FreeChunkData(chunkGroupReadState->chunkGroupData);
-	pfree(chunkGroupReadState);
-}
+	uint64 rangeOffset = 0;
+	uint64 rangeLength = 0;
 
-
-/*
- * ReadChunkGroupNextRow: if more rows can be read from the current chunk
- * group, fill in non-NULL columnValues and return true. Otherwise, return
- * false.
- *
- * On entry, all entries in columnNulls should be true; this function only
- * sets non-NULL entries.
- */
-static bool
-ReadChunkGroupNextRow(ChunkGroupReadState *chunkGroupReadState, Datum *columnValues,
-					  bool *columnNulls)
-{
-	if (chunkGroupReadState->currentRow >= chunkGroupReadState->rowCount)
+	for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
 	{
-		Assert(chunkGroupReadState->currentRow == chunkGroupReadState->rowCount);
-		return false;
+		if (selectedChunkMask[chunkIndex])
+		{
+			ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
+			ExtendPrefetchRange(relation,
+								stripeOffset + chunkSkipNode->existsChunkOffset,
+								chunkSkipNode->existsLength,
+								&rangeOffset, &rangeLength);
+		}
 	}
 
-	/*
-	 * Initialize to all-NULL. Only non-NULL projected attributes will be set.
-	 */
-	memset(columnNulls, true, sizeof(bool) * chunkGroupReadState->columnCount);
-
-	int attno;
-	foreach_declared_int(attno, chunkGroupReadState->projectedColumnList)
+	for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
 	{
-		const ChunkData *chunkGroupData = chunkGroupReadState->chunkGroupData;
-		const int rowIndex = chunkGroupReadState->currentRow;
-
-		/* attno is 1-indexed; existsArray is 0-indexed */
-		const uint32 columnIndex = attno - 1;
-
-		if (chunkGroupData->existsArray[columnIndex][rowIndex])
+		if (selectedChunkMask[chunkIndex])
 		{
-			columnValues[columnIndex] = chunkGroupData->valueArray[columnIndex][rowIndex];
-			columnNulls[columnIndex] = false;
+			ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
+			ExtendPrefetchRange(relation,
+								stripeOffset + chunkSkipNode->valueChunkOffset,
+								chunkSkipNode->valueLength,
+								&rangeOffset, &rangeLength);
 		}
 	}
 
-	chunkGroupReadState->currentRow++;
-	return true;
+	ColumnarStoragePrefetch(relation, rangeOffset, rangeLength);
 }
 
 
 /*
- * ColumnarReadChunkGroupsFiltered
- *
- * Return the number of chunk groups filtered during this read operation.
+ * ExtendPrefetchRange extends the range that is about to be prefetched with
+ * the given one if they are adjacent. Otherwise, it prefetches the range and
+ * starts a new one.
  */
-int64
-ColumnarReadChunkGroupsFiltered(ColumnarReadState *state)
+static void
+ExtendPrefetchRange(Relation relation, uint64 offset, uint64 length,
+					uint64 *rangeOffset, uint64 *rangeLength)
 {
-	return state->chunkGroupsFiltered;
-}
-
+	if (length == 0)
+	{
+		return;
+	}
+
+	if (*rangeLength > 0 && *rangeOffset + *rangeLength == offset)
+	{
+		*rangeLength += length;
+		return;
+	}
+
+	ColumnarStoragePrefetch(relation, *rangeOffset, *rangeLength);
+
+	*rangeOffset = offset;
+	*rangeLength = length;
+}
+
+
+/*
+ * FindNextFlushedStripe returns the metadata of the first flushed stripe
+ * that comes after the given row number, or NULL if there is no such stripe.
+ */
+static StripeMetadata *
+FindNextFlushedStripe(ColumnarReadState *readState, uint64 lastReadRowNumber)
+{
+	StripeMetadata *stripeMetadata = FindNextStripeByRowNumber(readState->relation,
+															   lastReadRowNumber,
+															   readState->snapshot);
+
+	if (stripeMetadata &&
+		StripeWriteState(stripeMetadata) != STRIPE_WRITE_FLUSHED &&
+		!SnapshotMightSeeUnflushedStripes(readState->snapshot))
+	{
+		/*
+		 * To be on the safe side, error out if we don't expect to encounter
+		 * with an un-flushed stripe. Otherwise, we will skip such stripes
+		 * until finding a flushed one.
+		 */
+		ereport(ERROR, (errmsg(UNEXPECTED_STRIPE_READ_ERR_MSG,
+							   RelationGetRelationName(readState->relation),
+							   stripeMetadata->id)));
+	}
+
+	while (stripeMetadata &&
+		   StripeWriteState(stripeMetadata) != STRIPE_WRITE_FLUSHED)
+	{
+		stripeMetadata = FindNextStripeByRowNumber(readState->relation,
+												   stripeMetadata->firstRowNumber,
+												   readState->snapshot);
+	}
+
+	return stripeMetadata;
+}
+
+
+/*
+ * ClaimNextParallelStripe claims the next stripe from the cursor shared by
+ * the participants of a parallel scan and returns its metadata, or NULL if
+ * all the stripes were already claimed.
+ *
+ * All participants use the same snapshot, so they see the same sequence of
+ * flushed stripes and only need to agree on the ordinal of the stripe that
+ * each of them reads. Since the claimed ordinals only increase, we find the
+ * claimed stripe by walking forward from the last stripe that we visited.
+ *
+ * Claimed stripes that are refuted by their stripe summaries are skipped by
+ * claiming another one.
+ */
+static StripeMetadata *
+ClaimNextParallelStripe(ColumnarReadState *readState)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(readState->scanContext);
+
+	StripeMetadata *stripeMetadata = NULL;
+	do {
+		uint64 claimedStripeOrdinal =
+			pg_atomic_fetch_add_u64(readState->parallelStripeCursor, 1);
+
+		while (readState->parallelNextStripeOrdinal <= claimedStripeOrdinal)
+		{
+			if (stripeMetadata != NULL)
+			{
+				pfree(stripeMetadata);
+			}
+
+			stripeMetadata = FindNextFlushedStripe(readState,
+												   readState->parallelLastRowNumber);
+			if (stripeMetadata == NULL)
+			{
+				break;
+			}
+
+			readState->parallelNextStripeOrdinal++;
+			readState->parallelLastRowNumber =
+				StripeGetHighestRowNumber(stripeMetadata);
+		}
+	} while (stripeMetadata != NULL &&
+			 StripeRefutedBySummary(readState, stripeMetadata));
+
+	MemoryContextSwitchTo(oldContext);
+
+	return stripeMetadata;
+}
+
+
+/*
+ * StripeRefutedBySummary returns true if the minimum and maximum values that
+ * the stripe summary records for the given stripe prove that none of its rows
+ * can satisfy the where clauses. In that case, the stripe and its chunk groups
+ * are counted as filtered.
+ *
+ * We check this before reading the stripe's skip list, so a stripe can be
+ * skipped at the cost of a single catalog lookup. Stripes written before
+ * stripe summaries were introduced don't have a summary, and are never
+ * refuted.
+ */
+static bool
+StripeRefutedBySummary(ColumnarReadState *readState, StripeMetadata *stripeMetadata)
+{
+	if (readState->whereClauseVars == NIL)
+	{
+		return false;
+	}
+
+	/*
+	 * The summary is only needed for this check. We might be reading another
+	 * stripe while looking for the next one to prefetch, so don't use the
+	 * stripe read context.
+	 */
+	if (readState->stripeSummaryContext == NULL)
+	{
+		readState->stripeSummaryContext =
+			AllocSetContextCreate(readState->scanContext,
+								  "Stripe Summary Memory Context",
+								  ALLOCSET_SMALL_SIZES);
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(readState->stripeSummaryContext);
+
+	StripeSummary *stripeSummary = ReadStripeSummary(readState->relation,
+													 stripeMetadata->id,
+													 readState->tupleDescriptor,
+													 readState->snapshot);
+
+	bool stripeRefuted = false;
+	ListCell *columnCell = NULL;
+	foreach(columnCell, readState->whereClauseVars)
+	{
+		if (stripeSummary == NULL)
+		{
+			break;
+		}
+
+		Var *column = lfirst(columnCell);
+		uint32 columnIndex = column->varattno - 1;
+
+		/*
+		 * Summary can miss min/max values if the column doesn't have a
+		 * comparator or if all values in the stripe are NULL.
+		 */
+		if (columnIndex >= stripeSummary->columnCount ||
+			!stripeSummary->hasMinMax[columnIndex])
+		{
+			continue;
+		}
+
+		/* if this column's data type doesn't have a comparator, skip it */
+		FmgrInfo *comparisonFunction = GetFunctionInfoOrNull(column->vartype,
+															 BTREE_AM_OID,
+															 BTORDER_PROC);
+		if (comparisonFunction == NULL)
+		{
+			continue;
+		}
+
+		Node *baseConstraint = BuildBaseConstraint(column);
+		UpdateConstraint(baseConstraint, stripeSummary->minimumValues[columnIndex],
+						 stripeSummary->maximumValues[columnIndex]);
+
+		List *constraintList = list_make1(baseConstraint);
+		if (predicate_refuted_by(constraintList, readState->whereClauseList, false))
+		{
+			stripeRefuted = true;
+			break;
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextReset(readState->stripeSummaryContext);
+
+	if (stripeRefuted)
+	{
+		readState->stripesFiltered++;
+		readState->chunkGroupsFiltered += stripeMetadata->chunkCount;
+	}
+
+	return stripeRefuted;
+}
+
+
+/*
+ * SnapshotMightSeeUnflushedStripes returns true if given snapshot is
+ * expected to see un-flushed stripes either because of other backends'
+ * pending writes or aborted transactions.
+ */
+static bool
+SnapshotMightSeeUnflushedStripes(Snapshot snapshot)
+{
+	if (snapshot == InvalidSnapshot)
+	{
+		return false;
+	}
+
+	switch (snapshot->snapshot_type)
+	{
+		case SNAPSHOT_ANY:
+		case SNAPSHOT_DIRTY:
+		case SNAPSHOT_NON_VACUUMABLE:
+		{
+			return true;
+		}
+
+		default:
+		{
+			return false;
+		}
+	}
+}
+
+
+/*
+ * ReadStripeNextRow: If more rows can be read from the current stripe, fill
+ * in non-NULL columnValues and return true. Otherwise, return false.
+ *
+ * On entry, all entries in columnNulls should be true; this function only
+ * sets non-NULL entries.
+ *
+ */
+static bool
+ReadStripeNextRow(StripeReadState *stripeReadState, Datum *columnValues,
+				  bool *columnNulls)
+{
+	while (true)
+	{
+		if (stripeReadState->currentRow >= stripeReadState->rowCount)
+		{
+			Assert(stripeReadState->currentRow == stripeReadState->rowCount);
+			return false;
+		}
+
+		if (stripeReadState->chunkGroupReadState == NULL)
+		{
+			stripeReadState->chunkGroupReadState = BeginChunkGroupRead(
+				stripeReadState->stripeBuffers,
+				stripeReadState->
+				chunkGroupIndex,
+				stripeReadState->
+				tupleDescriptor,
+				stripeReadState->
+				projectedColumnList,
+				stripeReadState->
+				filterColumnList,
+				stripeReadState->
+				lateColumnList,
+				stripeReadState->
+				vectorFilterList,
+				stripeReadState->rowMask,
+				stripeReadState->
+				stripeReadContext);
+
+			stripeReadState->vectorFilteredRows +=
+				stripeReadState->chunkGroupReadState->vectorFilteredRows;
+
+			if (stripeReadState->chunkGroupReadState->allRowsFiltered)
+			{
+				stripeReadState->chunkGroupsVectorFiltered++;
+			}
+		}
+
+		/*
+		 * Rows that were removed by the vector filters are skipped, but we
+		 * still count them to keep track of the row number.
+		 */
+		ChunkGroupReadState *chunkGroupReadState = stripeReadState->chunkGroupReadState;
+		int64 chunkGroupRowBefore = chunkGroupReadState->currentRow;
+		bool rowRead = ReadChunkGroupNextRow(chunkGroupReadState, columnValues,
+											 columnNulls);
+		stripeReadState->currentRow += chunkGroupReadState->currentRow -
+									   chunkGroupRowBefore;
+
+		if (!rowRead)
+		{
+			/* if this chunk group is exhausted, fetch the next one and loop */
+			EndChunkGroupRead(stripeReadState->chunkGroupReadState);
+			stripeReadState->chunkGroupReadState = NULL;
+			stripeReadState->chunkGroupIndex++;
+			continue;
+		}
+
+		return true;
+	}
+}
+
+
+/*
+ * BeginChunkGroupRead allocates state for reading a chunk.
+ *
+ * If there are vector filters, we first deserialize only the columns that
+ * they are applied on and evaluate them, and deserialize the other projected
+ * columns only if some rows of the chunk group pass the filters. That way we
+ * don't decompress wide columns for chunk groups that have no matching rows.
+ */
+static ChunkGroupReadState *
+BeginChunkGroupRead(StripeBuffers *stripeBuffers, int chunkIndex, TupleDesc tupleDesc,
+					List *projectedColumnList, List *filterColumnList,
+					List *lateColumnList, List *vectorFilterList,
+					bytea *rowMask, MemoryContext cxt)
+{
+	uint32 chunkGroupRowCount =
+		stripeBuffers->selectedChunkGroupRowCounts[chunkIndex];
+	uint64 chunkGroupRowOffset =
+		stripeBuffers->selectedChunkGroupRowOffsets[chunkIndex];
+	bool hasDeletedRows =
+		RowMaskCountRows(rowMask, chunkGroupRowOffset, chunkGroupRowCount) > 0;
+
+	MemoryContext oldContext = MemoryContextSwitchTo(cxt);
+
+	ChunkGroupReadState *chunkGroupReadState = palloc0(sizeof(ChunkGroupReadState));
+
+	chunkGroupReadState->currentRow = 0;
+	chunkGroupReadState->rowCount = chunkGroupRowCount;
+	chunkGroupReadState->columnCount = tupleDesc->natts;
+	chunkGroupReadState->projectedColumnList = projectedColumnList;
+
+	bool *projectedColumnMask = ProjectedColumnMask(tupleDesc->natts,
+													projectedColumnList);
+	ChunkData *chunkGroupData = CreateEmptyChunkData(tupleDesc->natts,
+													 projectedColumnMask,
+													 chunkGroupRowCount);
+	chunkGroupReadState->chunkGroupData = chunkGroupData;
+
+	DeserializeChunkColumns(stripeBuffers, chunkIndex, tupleDesc, filterColumnList,
+							chunkGroupData);
+
+	if (vectorFilterList != NIL)
+	{
+		chunkGroupReadState->selectedRows = palloc(chunkGroupRowCount * sizeof(bool));
+		chunkGroupReadState->vectorFilteredRows =
+			ApplyColumnarVectorFilters(vectorFilterList,
+									   chunkGroupReadState->chunkGroupData,
+									   chunkGroupReadState->selectedRows);
+	}
+
+	if (hasDeletedRows)
+	{
+		/* deleted rows are skipped the same way as the filtered ones */
+		if (chunkGroupReadState->selectedRows == NULL)
+		{
+			chunkGroupReadState->selectedRows = palloc(chunkGroupRowCount *
+													   sizeof(bool));
+			memset(chunkGroupReadState->selectedRows, true,
+				   chunkGroupRowCount * sizeof(bool));
+		}
+
+		for (uint32 rowIndex = 0; rowIndex < chunkGroupRowCount; rowIndex++)
+		{
+			if (RowMaskContainsRow(rowMask, chunkGroupRowOffset + rowIndex))
+			{
+				chunkGroupReadState->selectedRows[rowIndex] = false;
+			}
+		}
+	}
+
+	if (vectorFilterList != NIL)
+	{
+		chunkGroupReadState->allRowsFiltered = true;
+
+		for (uint32 rowIndex = 0; rowIndex < chunkGroupRowCount; rowIndex++)
+		{
+			if (chunkGroupReadState->selectedRows[rowIndex])
+			{
+				chunkGroupReadState->allRowsFiltered = false;
+				break;
+			}
+		}
+	}
+
+	if (!chunkGroupReadState->allRowsFiltered)
+	{
+		DeserializeChunkColumns(stripeBuffers, chunkIndex, tupleDesc, lateColumnList,
+								chunkGroupData);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	return chunkGroupReadState;
+}
+
+
+/*
+ * EndChunkRead finishes a chunk read.
+ */
+static void
+EndChunkGroupRead(ChunkGroupReadState *chunkGroupReadState)
+{
+	FreeChunkData(chunkGroupReadState->chunkGroupData);
+	if (chunkGroupReadState->selectedRows != NULL)
+	{
+		pfree(chunkGroupReadState->selectedRows);
+	}
+	pfree(chunkGroupReadState);
+}
+
+
+/*
+ * ReadChunkGroupNextRow: if more rows can be read from the current chunk
+ * group, fill in non-NULL columnValues and return true. Otherwise, return
+ * false.
+ *
+ * Rows that were removed by the vector filters of the chunk group are
+ * skipped.
+ *
+ * On entry, all entries in columnNulls should be true; this function only
+ * sets non-NULL entries.
+ */
+static bool
+ReadChunkGroupNextRow(ChunkGroupReadState *chunkGroupReadState, Datum *columnValues,
+					  bool *columnNulls)
+{
+	if (chunkGroupReadState->selectedRows != NULL)
+	{
+		while (chunkGroupReadState->currentRow < chunkGroupReadState->rowCount &&
+			   !chunkGroupReadState->selectedRows[chunkGroupReadState->currentRow])
+		{
+			chunkGroupReadState->currentRow++;
+		}
+	}
+
+	if (chunkGroupReadState->currentRow >= chunkGroupReadState->rowCount)
+	{
+		Assert(chunkGroupReadState->currentRow == chunkGroupReadState->rowCount);
+		return false;
+	}
+
+	/*
+	 * Initialize to all-NULL. Only non-NULL projected attributes will be set.
+	 */
+	memset(columnNulls, true, sizeof(bool) * chunkGroupReadState->columnCount);
+
+	int attno;
+	foreach_declared_int(attno, chunkGroupReadState->projectedColumnList)
+	{
+		const ChunkData *chunkGroupData = chunkGroupReadState->chunkGroupData;
+		const int rowIndex = chunkGroupReadState->currentRow;
+
+		/* attno is 1-indexed; existsArray is 0-indexed */
+		const uint32 columnIndex = attno - 1;
+
+		if (chunkGroupData->existsArray[columnIndex][rowIndex])
+		{
+			columnValues[columnIndex] = chunkGroupData->valueArray[columnIndex][rowIndex];
+			columnNulls[columnIndex] = false;
+		}
+	}
+
+	chunkGroupReadState->currentRow++;
+	return true;
+}
+
+
+/*
+ * ColumnarReadChunkGroupsFiltered
+ *
+ * Return the number of chunk groups filtered during this read operation.
+ */
+int64
+ColumnarReadChunkGroupsFiltered(ColumnarReadState *state)
+{
+	return state->chunkGroupsFiltered;
+}
+
+
+/*
+ * ColumnarReadStripesFiltered
+ *
+ * Return the number of stripes skipped using stripe summaries during this
+ * read operation.
+ */
+int64
+ColumnarReadStripesFiltered(ColumnarReadState *state)
+{
+	return state->stripesFiltered;
+}
+
+
+/*
+ * ColumnarReadStripesRead
+ *
+ * Return the number of stripes read during this read operation.
+ */
+int64
+ColumnarReadStripesRead(ColumnarReadState *state)
+{
+	return state->stripesRead;
+}
+
+
+/*
+ * ColumnarReadStripesPrefetched
+ *
+ * Return the number of stripes for which read-ahead was issued during this
+ * read operation.
+ */
+int64
+ColumnarReadStripesPrefetched(ColumnarReadState *state)
+{
+	return state->stripesPrefetched;
+}
+
+
+/*
+ * ColumnarReadChunkGroupsVectorFiltered
+ *
+ * Return the number of chunk groups whose rows were all removed by vector
+ * filters during this read operation, including the chunk groups of the
+ * stripe that is being read. We only deserialized the filter columns of
+ * such chunk groups.
+ */
+int64
+ColumnarReadChunkGroupsVectorFiltered(ColumnarReadState *state)
+{
+	int64 chunkGroupsVectorFiltered = state->chunkGroupsVectorFiltered;
+
+	if (StripeReadInProgress(state))
+	{
+		chunkGroupsVectorFiltered += state->stripeReadState->chunkGroupsVectorFiltered;
+	}
+
+	return chunkGroupsVectorFiltered;
+}
+
+
+/*
+ * ColumnarReadVectorFilteredRows
+ *
+ * Return the number of rows removed by vector filters during this read
+ * operation, including the rows of the stripe that is being read.
+ */
+int64
+ColumnarReadVectorFilteredRows(ColumnarReadState *state)
+{
+	int64 vectorFilteredRows = state->vectorFilteredRows;
+
+	if (StripeReadInProgress(state))
+	{
+		vectorFilteredRows += state->stripeReadState->vectorFilteredRows;
+	}
+
+	return vectorFilteredRows;
+}
+
+
+/*
+ * ColumnarReadSetCoveredChunkGroupCallback sets the callback to be called for
+ * the chunk groups whose rows are all known to satisfy the where clauses of
+ * the read, based on the minimum and maximum values of their columns. The
+ * chunk groups that the callback processes are not read, so the caller must
+ * account for their rows itself.
+ *
+ * This needs to be called before reading the first row.
+ */
+void
+ColumnarReadSetCoveredChunkGroupCallback(ColumnarReadState *readState,
+										 ColumnarCoveredChunkGroupCallback callback,
+										 void *callbackArg)
+{
+	Assert(readState->stripeReadState == NULL);
+
+	readState->coveredChunkGroupCallback = callback;
+	readState->coveredChunkGroupCallbackArg = callbackArg;
+}
+
+
+/*
+ * ColumnarReadChunkGroupsCovered
+ *
+ * Return the number of chunk groups that the covered chunk group callback
+ * processed instead of being read during this read operation.
+ */
+int64
+ColumnarReadChunkGroupsCovered(ColumnarReadState *state)
+{
+	int64 chunkGroupsCovered = state->chunkGroupsCovered;
+
+	if (StripeReadInProgress(state))
+	{
+		chunkGroupsCovered += state->stripeReadState->chunkGroupsCovered;
+	}
+
+	return chunkGroupsCovered;
+}
+
 
 /*
  * CreateEmptyChunkDataArray creates data buffers to keep deserialized exist and
@@ -926,6 +1861,7 @@ CreateEmptyChunkData(uint32 columnCount, bool *columnMask, uint32 chunkGroupRowC
 	chunkData->existsArray = palloc0(columnCount * sizeof(bool *));
 	chunkData->valueArray = palloc0(columnCount * sizeof(Datum *));
 	chunkData->valueBufferArray = palloc0(columnCount * sizeof(StringInfo));
+	chunkData->dictionaryArray = palloc0(columnCount * sizeof(ChunkColumnDictionary *));
 	chunkData->columnCount = columnCount;
 	chunkData->rowCount = chunkGroupRowCount;
 
@@ -973,10 +1909,19 @@ FreeChunkData(ChunkData *chunkData)
 		{
 			pfree(chunkData->valueArray[columnIndex]);
 		}
+
+		ChunkColumnDictionary *dictionary = chunkData->dictionaryArray[columnIndex];
+		if (dictionary != NULL)
+		{
+			pfree(dictionary->entries);
+			pfree(dictionary->entryIndexes);
+			pfree(dictionary);
+		}
 	}
 
 	pfree(chunkData->existsArray);
 	pfree(chunkData->valueArray);
+	pfree(chunkData->dictionaryArray);
 	pfree(chunkData);
 }
 
@@ -1008,26 +1953,77 @@ static StripeBuffers *
 LoadFilteredStripeBuffers(Relation relation, StripeMetadata *stripeMetadata,
 						  TupleDesc tupleDescriptor, List *projectedColumnList,
 						  List *whereClauseList, List *whereClauseVars,
-						  int64 *chunkGroupsFiltered, Snapshot snapshot)
+						  int64 *chunkGroupsFiltered,
+						  ColumnarCoveredChunkGroupCallback coveredChunkGroupCallback,
+						  void *coveredChunkGroupCallbackArg,
+						  int64 *chunkGroupsCovered, bytea *rowMask,
+						  StripeSkipList *stripeSkipList, Snapshot snapshot)
 {
 	uint32 columnIndex = 0;
 	uint32 columnCount = tupleDescriptor->natts;
 
 	bool *projectedColumnMask = ProjectedColumnMask(columnCount, projectedColumnList);
 
-	StripeSkipList *stripeSkipList = ReadStripeSkipList(relation,
-														stripeMetadata->id,
-														tupleDescriptor,
-														stripeMetadata->chunkCount,
-														snapshot);
+	if (stripeSkipList == NULL)
+	{
+		stripeSkipList = ReadStripeSkipList(relation, stripeMetadata->id,
+											tupleDescriptor, stripeMetadata->chunkCount,
+											snapshot);
+	}
 
 	bool *selectedChunkMask = SelectedChunkMask(stripeSkipList, whereClauseList,
 												whereClauseVars, chunkGroupsFiltered);
 
+	DeselectDeletedChunkGroups(stripeSkipList, selectedChunkMask, rowMask);
+
+	if (coveredChunkGroupCallback != NULL)
+	{
+		ProcessCoveredChunkGroups(relation, stripeMetadata, stripeSkipList,
+								  selectedChunkMask, rowMask,
+								  whereClauseList, whereClauseVars,
+								  coveredChunkGroupCallback,
+								  coveredChunkGroupCallbackArg, chunkGroupsCovered);
+	}
+
 	StripeSkipList *selectedChunkSkipList =
 		SelectedChunkSkipList(stripeSkipList, projectedColumnMask,
 							  selectedChunkMask);
 
+	/* indexes and offsets of the selected chunk groups within the stripe */
+	uint32 *selectedChunkGroupIndexes =
+		palloc0(Max(selectedChunkSkipList->chunkCount, 1) * sizeof(uint32));
+	uint64 *selectedChunkGroupRowOffsets =
+		palloc0(Max(selectedChunkSkipList->chunkCount, 1) * sizeof(uint64));
+	uint64 chunkGroupRowOffset = 0;
+	uint32 selectedChunkIndex = 0;
+	for (uint32 chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+	{
+		if (selectedChunkMask[chunkIndex])
+		{
+			selectedChunkGroupIndexes[selectedChunkIndex] = chunkIndex;
+			selectedChunkGroupRowOffsets[selectedChunkIndex] = chunkGroupRowOffset;
+			selectedChunkIndex++;
+		}
+
+		chunkGroupRowOffset += stripeSkipList->chunkGroupRowCounts[chunkIndex];
+	}
+
+	StripeBuffers *stripeBuffers = palloc0(sizeof(StripeBuffers));
+	stripeBuffers->columnCount = columnCount;
+	stripeBuffers->rowCount = StripeSkipListRowCount(selectedChunkSkipList);
+	stripeBuffers->selectedChunkGroupCount = selectedChunkSkipList->chunkCount;
+	stripeBuffers->selectedChunkGroupRowCounts =
+		selectedChunkSkipList->chunkGroupRowCounts;
+	stripeBuffers->selectedChunkGroupIndexes = selectedChunkGroupIndexes;
+	stripeBuffers->selectedChunkGroupRowOffsets = selectedChunkGroupRowOffsets;
+	stripeBuffers->stripeId = stripeMetadata->id;
+
+	if (ColumnarChunkCacheEnabled())
+	{
+		stripeBuffers->useChunkCache = true;
+		stripeBuffers->storageId = ColumnarStorageGetStorageId(relation, false);
+	}
+
 	/* load column data for projected columns */
 	ColumnBuffers **columnBuffersArray = palloc0(columnCount * sizeof(ColumnBuffers *));
 
@@ -1043,18 +2039,14 @@ LoadFilteredStripeBuffers(Relation relation, StripeMetadata *stripeMetadata,
 			ColumnBuffers *columnBuffers = LoadColumnBuffers(relation, chunkSkipNode,
 															 chunkCount,
 															 stripeMetadata->fileOffset,
-															 attributeForm);
+															 attributeForm,
+															 stripeBuffers);
 
 			columnBuffersArray[columnIndex] = columnBuffers;
 		}
 	}
 
-	StripeBuffers *stripeBuffers = palloc0(sizeof(StripeBuffers));
-	stripeBuffers->columnCount = columnCount;
-	stripeBuffers->rowCount = StripeSkipListRowCount(selectedChunkSkipList);
 	stripeBuffers->columnBuffersArray = columnBuffersArray;
-	stripeBuffers->selectedChunkGroupRowCounts =
-		selectedChunkSkipList->chunkGroupRowCounts;
 
 	return stripeBuffers;
 }
@@ -1064,11 +2056,15 @@ LoadFilteredStripeBuffers(Relation relation, StripeMetadata *stripeMetadata,
  * LoadColumnBuffers reads serialized column data from the given file. These
  * column data are laid out as sequential chunks in the file; and chunk positions
  * and lengths are retrieved from the column chunk skip node array.
+ *
+ * If the chunk cache is enabled, compressed "values" chunks that are in the
+ * cache are not read from the file, and the ones that aren't are marked to be
+ * added to the cache once they are decompressed.
  */
 static ColumnBuffers *
 LoadColumnBuffers(Relation relation, ColumnChunkSkipNode *chunkSkipNodeArray,
 				  uint32 chunkCount, uint64 stripeOffset,
-				  Form_pg_attribute attributeForm)
+				  Form_pg_attribute attributeForm, StripeBuffers *stripeBuffers)
 {
 	uint32 chunkIndex = 0;
 	ColumnChunkBuffers **chunkBuffersArray =
@@ -1104,15 +2100,43 @@ LoadColumnBuffers(Relation relation, ColumnChunkSkipNode *chunkSkipNodeArray,
 		ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
 		CompressionType compressionType = chunkSkipNode->valueCompressionType;
 		uint64 valueOffset = stripeOffset + chunkSkipNode->valueChunkOffset;
-		StringInfo rawValueBuffer = makeStringInfo();
 
-		enlargeStringInfo(rawValueBuffer, chunkSkipNode->valueLength);
-		rawValueBuffer->len = chunkSkipNode->valueLength;
-		ColumnarStorageRead(relation, valueOffset, rawValueBuffer->data,
-							chunkSkipNode->valueLength);
+		if (stripeBuffers->useChunkCache && compressionType != COMPRESSION_NONE)
+		{
+			uint32 chunkGroupIndex = stripeBuffers->selectedChunkGroupIndexes[chunkIndex];
+			StringInfo cachedValueBuffer =
+				ColumnarChunkCacheLookup(stripeBuffers->storageId,
+										 stripeBuffers->stripeId,
+										 attributeForm->attnum - 1,
+										 chunkGroupIndex);
+
+			if (cachedValueBuffer != NULL)
+			{
+				/* the cached buffer is already decompressed */
+				compressionType = COMPRESSION_NONE;
+				chunkBuffersArray[chunkIndex]->valueBuffer = cachedValueBuffer;
+			}
+			else
+			{
+				chunkBuffersArray[chunkIndex]->cacheValueBuffer = true;
+			}
+		}
+
+		if (chunkBuffersArray[chunkIndex]->valueBuffer == NULL)
+		{
+			StringInfo rawValueBuffer = makeStringInfo();
+
+			enlargeStringInfo(rawValueBuffer, chunkSkipNode->valueLength);
+			rawValueBuffer->len = chunkSkipNode->valueLength;
+			ColumnarStorageRead(relation, valueOffset, rawValueBuffer->data,
+								chunkSkipNode->valueLength);
+
+			chunkBuffersArray[chunkIndex]->valueBuffer = rawValueBuffer;
+		}
 
-		chunkBuffersArray[chunkIndex]->valueBuffer = rawValueBuffer;
 		chunkBuffersArray[chunkIndex]->valueCompressionType = compressionType;
+		chunkBuffersArray[chunkIndex]->valueEncodingType =
+			chunkSkipNode->valueEncodingType;
 		chunkBuffersArray[chunkIndex]->decompressedValueSize =
 			chunkSkipNode->decompressedValueSize;
 	}
@@ -1124,6 +2148,34 @@ LoadColumnBuffers(Relation relation, ColumnChunkSkipNode *chunkSkipNodeArray,
 }
 
 
+/*
+ * DeselectDeletedChunkGroups deselects the chunk groups whose rows are all
+ * deleted according to the given row mask, so that we don't read them.
+ */
+static void
+DeselectDeletedChunkGroups(StripeSkipList *stripeSkipList, bool *selectedChunkMask,
+						   bytea *rowMask)
+{
+	if (rowMask == NULL)
+	{
+		return;
+	}
+
+	uint64 chunkGroupRowOffset = 0;
+	for (uint32 chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+	{
+		uint32 chunkGroupRowCount = stripeSkipList->chunkGroupRowCounts[chunkIndex];
+		if (RowMaskCountRows(rowMask, chunkGroupRowOffset, chunkGroupRowCount) ==
+			chunkGroupRowCount)
+		{
+			selectedChunkMask[chunkIndex] = false;
+		}
+
+		chunkGroupRowOffset += chunkGroupRowCount;
+	}
+}
+
+
 /*
  * SelectedChunkMask walks over each column's chunks and checks if a chunk can
  * be filtered without reading its data. The filtering happens when all rows in
@@ -1183,10 +2235,360 @@ SelectedChunkMask(StripeSkipList *stripeSkipList, List *whereClauseList,
 		}
 	}
 
+	/*
+	 * Then check the equality quals against the bloom filters of the remaining
+	 * chunks. These are useful for the columns whose min/max values cannot
+	 * refute much, e.g.: unsorted, high-cardinality columns.
+	 */
+	List *bloomFilterQualList = BuildBloomFilterQualList(whereClauseList);
+
+	BloomFilterQual *bloomFilterQual = NULL;
+	foreach_declared_ptr(bloomFilterQual, bloomFilterQualList)
+	{
+		ColumnChunkSkipNode *chunkSkipNodeArray =
+			stripeSkipList->chunkSkipNodeArray[bloomFilterQual->columnIndex];
+
+		for (chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+		{
+			bytea *bloomFilter = chunkSkipNodeArray[chunkIndex].bloomFilter;
+			if (!selectedChunkMask[chunkIndex] || bloomFilter == NULL)
+			{
+				continue;
+			}
+
+			if (BloomFilterQualRefuted(bloomFilterQual, bloomFilter))
+			{
+				selectedChunkMask[chunkIndex] = false;
+				*chunkGroupsFiltered += 1;
+			}
+		}
+	}
+
 	return selectedChunkMask;
 }
 
 
+/*
+ * ProcessCoveredChunkGroups passes the selected chunk groups whose rows are
+ * all known to satisfy the where clauses to the given callback, and deselects
+ * the ones that the callback processed so that they are not read.
+ *
+ * The metadata of the chunk groups that have deleted rows also describes the
+ * deleted rows, so such chunk groups are always read.
+ */
+static void
+ProcessCoveredChunkGroups(Relation relation, StripeMetadata *stripeMetadata,
+						  StripeSkipList *stripeSkipList, bool *selectedChunkMask,
+						  bytea *rowMask, List *whereClauseList, List *whereClauseVars,
+						  ColumnarCoveredChunkGroupCallback coveredChunkGroupCallback,
+						  void *coveredChunkGroupCallbackArg,
+						  int64 *chunkGroupsCovered)
+{
+	uint64 chunkGroupRowOffset = 0;
+	for (uint32 chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+	{
+		uint32 chunkGroupRowCount = stripeSkipList->chunkGroupRowCounts[chunkIndex];
+		uint64 firstRowOffset = chunkGroupRowOffset;
+		chunkGroupRowOffset += chunkGroupRowCount;
+
+		if (!selectedChunkMask[chunkIndex])
+		{
+			continue;
+		}
+
+		if (RowMaskCountRows(rowMask, firstRowOffset, chunkGroupRowCount) > 0)
+		{
+			continue;
+		}
+
+		if (!ChunkGroupCoveredByQuals(relation, stripeMetadata, stripeSkipList,
+									  chunkIndex, whereClauseList, whereClauseVars))
+		{
+			continue;
+		}
+
+		if (coveredChunkGroupCallback(stripeMetadata, stripeSkipList, chunkIndex,
+									  coveredChunkGroupCallbackArg))
+		{
+			selectedChunkMask[chunkIndex] = false;
+			*chunkGroupsCovered += 1;
+		}
+	}
+}
+
+
+/*
+ * ChunkGroupCoveredByQuals returns true if the minimum and maximum values of
+ * the columns in the given chunk group prove that all of its rows satisfy the
+ * where clauses.
+ *
+ * The minimum and maximum values don't tell whether a column chunk has NULLs,
+ * which wouldn't satisfy the where clauses, so we also check the exists
+ * stream of the columns that can be NULL. We do that last since it needs to
+ * read the stream, though that is much cheaper than reading the values.
+ */
+static bool
+ChunkGroupCoveredByQuals(Relation relation, StripeMetadata *stripeMetadata,
+						 StripeSkipList *stripeSkipList, uint32 chunkIndex,
+						 List *whereClauseList, List *whereClauseVars)
+{
+	List *constraintList = NIL;
+
+	Var *column = NULL;
+	foreach_declared_ptr(column, whereClauseVars)
+	{
+		uint32 columnIndex = column->varattno - 1;
+
+		/* columns added after the stripe was written use the default value */
+		if (columnIndex >= stripeMetadata->columnCount)
+		{
+			return false;
+		}
+
+		ColumnChunkSkipNode *chunkSkipNode =
+			&stripeSkipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+		if (!chunkSkipNode->hasMinMax)
+		{
+			return false;
+		}
+
+		Node *baseConstraint = BuildBaseConstraint(column);
+		UpdateConstraint(baseConstraint, chunkSkipNode->minimumValue,
+						 chunkSkipNode->maximumValue);
+
+		constraintList = lappend(constraintList, baseConstraint);
+	}
+
+	if (!predicate_implied_by(whereClauseList, constraintList, false))
+	{
+		return false;
+	}
+
+	foreach_declared_ptr(column, whereClauseVars)
+	{
+		uint32 columnIndex = column->varattno - 1;
+		Form_pg_attribute attributeForm =
+			TupleDescAttr(RelationGetDescr(relation), columnIndex);
+		if (attributeForm->attnotnull)
+		{
+			continue;
+		}
+
+		ColumnChunkSkipNode *chunkSkipNode =
+			&stripeSkipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+		if (ColumnChunkHasNulls(relation, stripeMetadata, chunkSkipNode))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * ColumnChunkHasNulls reads the exists stream of the given column chunk and
+ * returns true if any of its values is NULL.
+ */
+static bool
+ColumnChunkHasNulls(Relation relation, StripeMetadata *stripeMetadata,
+					ColumnChunkSkipNode *chunkSkipNode)
+{
+	StringInfo existsBuffer = makeStringInfo();
+	enlargeStringInfo(existsBuffer, chunkSkipNode->existsLength);
+	existsBuffer->len = chunkSkipNode->existsLength;
+	ColumnarStorageRead(relation,
+						stripeMetadata->fileOffset + chunkSkipNode->existsChunkOffset,
+						existsBuffer->data, chunkSkipNode->existsLength);
+
+	bool *existsArray = palloc0(chunkSkipNode->rowCount * sizeof(bool));
+	DeserializeBoolArray(existsBuffer, existsArray, chunkSkipNode->rowCount);
+
+	bool hasNulls = false;
+	for (uint64 rowIndex = 0; rowIndex < chunkSkipNode->rowCount; rowIndex++)
+	{
+		if (!existsArray[rowIndex])
+		{
+			hasNulls = true;
+			break;
+		}
+	}
+
+	pfree(existsArray);
+	pfree(existsBuffer->data);
+	pfree(existsBuffer);
+
+	return hasNulls;
+}
+
+
+/*
+ * BuildBloomFilterQualList returns the quals in the given list that compare a
+ * column with constants using an equality operator, which the bloom filters of
+ * the column's chunks can refute.
+ */
+static List *
+BuildBloomFilterQualList(List *whereClauseList)
+{
+	List *bloomFilterQualList = NIL;
+
+	Node *clause = NULL;
+	foreach_declared_ptr(clause, whereClauseList)
+	{
+		BloomFilterQual *bloomFilterQual = NULL;
+
+		if (IsA(clause, OpExpr) && list_length(((OpExpr *) clause)->args) == 2)
+		{
+			OpExpr *opExpr = (OpExpr *) clause;
+			Node *leftOperand = linitial(opExpr->args);
+			Node *rightOperand = lsecond(opExpr->args);
+
+			bloomFilterQual = BuildBloomFilterQual(opExpr->opno, opExpr->inputcollid,
+												   leftOperand, rightOperand, false);
+			if (bloomFilterQual == NULL)
+			{
+				bloomFilterQual = BuildBloomFilterQual(opExpr->opno,
+													   opExpr->inputcollid,
+													   rightOperand, leftOperand,
+													   false);
+			}
+		}
+		else if (IsA(clause, ScalarArrayOpExpr) && ((ScalarArrayOpExpr *) clause)->useOr)
+		{
+			ScalarArrayOpExpr *arrayOpExpr = (ScalarArrayOpExpr *) clause;
+
+			bloomFilterQual = BuildBloomFilterQual(arrayOpExpr->opno,
+												   arrayOpExpr->inputcollid,
+												   linitial(arrayOpExpr->args),
+												   lsecond(arrayOpExpr->args),
+												   true);
+		}
+
+		if (bloomFilterQual != NULL)
+		{
+			bloomFilterQualList = lappend(bloomFilterQualList, bloomFilterQual);
+		}
+	}
+
+	return bloomFilterQualList;
+}
+
+
+/*
+ * BuildBloomFilterQual returns a BloomFilterQual for "leftOperand operator
+ * rightOperand" if leftOperand is a column, rightOperand is a constant (or a
+ * constant array if isArray is true), and the operator is in the hash operator
+ * family that we build the bloom filters of the column with. Otherwise, returns
+ * NULL.
+ */
+static BloomFilterQual *
+BuildBloomFilterQual(Oid operatorId, Oid inputCollation, Node *leftOperand,
+					 Node *rightOperand, bool isArray)
+{
+	leftOperand = strip_implicit_coercions(leftOperand);
+	rightOperand = strip_implicit_coercions(rightOperand);
+
+	if (!IsA(leftOperand, Var) || !IsA(rightOperand, Const))
+	{
+		return NULL;
+	}
+
+	Var *column = (Var *) leftOperand;
+	Const *constant = (Const *) rightOperand;
+	if (column->varattno <= 0 || constant->constisnull)
+	{
+		return NULL;
+	}
+
+	/* the bloom filters are built using the column's collation */
+	if (inputCollation != column->varcollid)
+	{
+		return NULL;
+	}
+
+	TypeCacheEntry *typeEntry = lookup_type_cache(column->vartype,
+												  TYPECACHE_HASH_OPFAMILY);
+	if (!OidIsValid(typeEntry->hash_opf) ||
+		!op_in_opfamily(operatorId, typeEntry->hash_opf))
+	{
+		return NULL;
+	}
+
+	Datum *constantValues = &constant->constvalue;
+	bool *constantNulls = &constant->constisnull;
+	int constantCount = 1;
+	Oid constantType = constant->consttype;
+
+	if (isArray)
+	{
+		ArrayType *constantArray = DatumGetArrayTypeP(constant->constvalue);
+		int16 elementLength = 0;
+		bool elementByValue = false;
+		char elementAlign = 0;
+
+		constantType = ARR_ELEMTYPE(constantArray);
+		get_typlenbyvalalign(constantType, &elementLength, &elementByValue,
+							 &elementAlign);
+		deconstruct_array(constantArray, constantType, elementLength, elementByValue,
+						  elementAlign, &constantValues, &constantNulls,
+						  &constantCount);
+	}
+
+	/*
+	 * Values of different types that are equal have the same hash if their
+	 * hash functions are in the same operator family, so we can look up
+	 * constants of another type in the family.
+	 */
+	Oid hashFunctionId = get_opfamily_proc(typeEntry->hash_opf, constantType,
+										   constantType, HASHEXTENDED_PROC);
+	if (!OidIsValid(hashFunctionId))
+	{
+		return NULL;
+	}
+
+	FmgrInfo hashFunction;
+	fmgr_info(hashFunctionId, &hashFunction);
+
+	BloomFilterQual *bloomFilterQual = palloc0(sizeof(BloomFilterQual));
+	bloomFilterQual->columnIndex = column->varattno - 1;
+	bloomFilterQual->hashArray = palloc0(Max(constantCount, 1) * sizeof(uint64));
+
+	for (int constantIndex = 0; constantIndex < constantCount; constantIndex++)
+	{
+		/* a NULL never equals the column, so it cannot match any chunk */
+		if (constantNulls[constantIndex])
+		{
+			continue;
+		}
+
+		bloomFilterQual->hashArray[bloomFilterQual->hashCount++] =
+			BloomFilterHashDatum(&hashFunction, column->varcollid,
+								 constantValues[constantIndex]);
+	}
+
+	return bloomFilterQual;
+}
+
+
+/*
+ * BloomFilterQualRefuted returns true if none of the constants of the given
+ * qual can be in the chunk with the given bloom filter.
+ */
+static bool
+BloomFilterQualRefuted(BloomFilterQual *bloomFilterQual, bytea *bloomFilter)
+{
+	for (uint32 hashIndex = 0; hashIndex < bloomFilterQual->hashCount; hashIndex++)
+	{
+		if (BloomFilterMightContain(bloomFilter, bloomFilterQual->hashArray[hashIndex]))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
 /*
  * GetFunctionInfoOrNull first resolves the operator for the given data type,
  * access method, and support procedure. The function then uses the resolved
@@ -1538,14 +2940,31 @@ DeserializeBoolArray(StringInfo boolArrayBuffer, bool *boolArray,
  * DeserializeDatumArray reads an array of datums from the given buffer and stores
  * them in provided datumArray. If a value is marked as false in the exists array,
  * the function assumes that the datum isn't in the buffer, and simply skips it.
+ *
+ * If the buffer is encoded, the datums are decoded from it instead. For
+ * dictionary and run-length encoded buffers, dictionary is set to the distinct
+ * values that the datums map to, otherwise it is set to NULL.
  */
 static void
-DeserializeDatumArray(StringInfo datumBuffer, bool *existsArray, uint32 datumCount,
-					  bool datumTypeByValue, int datumTypeLength,
-					  char datumTypeAlign, Datum *datumArray)
+DeserializeDatumArray(StringInfo datumBuffer, EncodingType encodingType,
+					  bool *existsArray, uint32 datumCount,
+					  Form_pg_attribute attributeForm, Datum *datumArray,
+					  ChunkColumnDictionary **dictionary)
 {
 	uint32 datumIndex = 0;
 	uint32 currentDatumDataOffset = 0;
+	bool datumTypeByValue = attributeForm->attbyval;
+	int datumTypeLength = attributeForm->attlen;
+	char datumTypeAlign = attributeForm->attalign;
+
+	*dictionary = NULL;
+
+	if (encodingType != ENCODING_NONE)
+	{
+		DecodeDatumArray(datumBuffer, encodingType, existsArray, datumCount,
+						 attributeForm, datumArray, dictionary);
+		return;
+	}
 
 	for (datumIndex = 0; datumIndex < datumCount; datumIndex++)
 	{
@@ -1573,33 +2992,27 @@ DeserializeDatumArray(StringInfo datumBuffer, bool *existsArray, uint32 datumCou
 
 
 /*
- * DeserializeChunkGroupData deserializes requested data chunk for all columns and
- * stores in chunkDataArray. It uncompresses serialized data if necessary. The
- * function also deallocates data buffers used for previous chunk, and compressed
- * data buffers for the current chunk which will not be needed again. If a column
- * data is not present serialized buffer, then default value (or null) is used
- * to fill value array.
+ * DeserializeChunkColumns deserializes the data of the given chunk group for
+ * the columns in columnList (an integer list of 1-indexed attribute numbers)
+ * into chunkData, whose arrays for these columns must have been allocated by
+ * CreateEmptyChunkData. It uncompresses serialized data if necessary. If a
+ * column's data is not present in the serialized buffers, then the default
+ * value (or null) is used to fill its value array.
  */
-static ChunkData *
-DeserializeChunkData(StripeBuffers *stripeBuffers, uint64 chunkIndex,
-					 uint32 rowCount, TupleDesc tupleDescriptor,
-					 List *projectedColumnList)
+static void
+DeserializeChunkColumns(StripeBuffers *stripeBuffers, uint64 chunkIndex,
+						TupleDesc tupleDescriptor, List *columnList,
+						ChunkData *chunkData)
 {
-	int columnIndex = 0;
-	bool *columnMask = ProjectedColumnMask(tupleDescriptor->natts, projectedColumnList);
-	ChunkData *chunkData = CreateEmptyChunkData(tupleDescriptor->natts, columnMask,
-												rowCount);
+	uint32 rowCount = chunkData->rowCount;
 
-	for (columnIndex = 0; columnIndex < stripeBuffers->columnCount; columnIndex++)
+	int attno;
+	foreach_declared_int(attno, columnList)
 	{
+		/* attno is 1-indexed; columnBuffersArray is 0-indexed */
+		int columnIndex = attno - 1;
 		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
 		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
-		bool columnAdded = false;
-
-		if (columnBuffers == NULL && columnMask[columnIndex])
-		{
-			columnAdded = true;
-		}
 
 		if (columnBuffers != NULL)
 		{
@@ -1612,18 +3025,28 @@ DeserializeChunkData(StripeBuffers *stripeBuffers, uint64 chunkIndex,
 								 chunkBuffers->valueCompressionType,
 								 chunkBuffers->decompressedValueSize);
 
+			if (chunkBuffers->cacheValueBuffer)
+			{
+				ColumnarChunkCacheInsert(stripeBuffers->storageId,
+										 stripeBuffers->stripeId, columnIndex,
+										 stripeBuffers->selectedChunkGroupIndexes[
+											 chunkIndex],
+										 valueBuffer);
+				chunkBuffers->cacheValueBuffer = false;
+			}
+
 			DeserializeBoolArray(chunkBuffers->existsBuffer,
 								 chunkData->existsArray[columnIndex],
 								 rowCount);
-			DeserializeDatumArray(valueBuffer, chunkData->existsArray[columnIndex],
-								  rowCount, attributeForm->attbyval,
-								  attributeForm->attlen, attributeForm->attalign,
-								  chunkData->valueArray[columnIndex]);
+			DeserializeDatumArray(valueBuffer, chunkBuffers->valueEncodingType,
+								  chunkData->existsArray[columnIndex], rowCount,
+								  attributeForm, chunkData->valueArray[columnIndex],
+								  &chunkData->dictionaryArray[columnIndex]);
 
 			/* store current chunk's data buffer to be freed at next chunk read */
 			chunkData->valueBufferArray[columnIndex] = valueBuffer;
 		}
-		else if (columnAdded)
+		else
 		{
 			/*
 			 * This is a column that was added after creation of this stripe.
@@ -1649,8 +3072,6 @@ DeserializeChunkData(StripeBuffers *stripeBuffers, uint64 chunkIndex,
 			}
 		}
 	}
-
-	return chunkData;
 }
 
 
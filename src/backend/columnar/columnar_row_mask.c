@@ -0,0 +1,146 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_row_mask.c
+ *
+ * This file contains the row masks that columnar uses to record the deleted
+ * rows of a stripe. Since stripes are immutable, a DELETE doesn't touch the
+ * stripe itself but sets the bits of the deleted rows in the row mask of the
+ * stripe, and an UPDATE additionally inserts the new version of the row into
+ * a new stripe.
+ *
+ * A row mask is stored as a bytea, where the bit (offset % 8) of the byte
+ * (offset / 8) is set if the row at the given offset within the stripe is
+ * deleted. Row masks are stored in columnar_internal.row_mask, which users
+ * can query through the columnar.row_mask view, see columnar_metadata.c.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "port/pg_bitutils.h"
+
+#include "columnar/columnar_row_mask.h"
+
+
+/*
+ * CreateRowMask returns a row mask for a stripe with the given number of rows,
+ * in which no rows are deleted.
+ */
+bytea *
+CreateRowMask(uint64 rowCount)
+{
+	uint64 byteCount = (rowCount + 7) / 8;
+	Size rowMaskSize = VARHDRSZ + byteCount;
+
+	bytea *rowMask = palloc0(rowMaskSize);
+	SET_VARSIZE(rowMask, rowMaskSize);
+
+	return rowMask;
+}
+
+
+/*
+ * RowMaskSetRow marks the row at the given offset within the stripe as
+ * deleted.
+ */
+void
+RowMaskSetRow(bytea *rowMask, uint64 rowOffset)
+{
+	uint64 byteCount = VARSIZE_ANY_EXHDR(rowMask);
+	if (rowOffset / 8 >= byteCount)
+	{
+		ereport(ERROR, (errmsg("row offset " UINT64_FORMAT " is out of the range "
+							   "of the columnar row mask", rowOffset)));
+	}
+
+	uint8 *bits = (uint8 *) VARDATA_ANY(rowMask);
+	bits[rowOffset / 8] |= (1 << (rowOffset % 8));
+}
+
+
+/*
+ * RowMaskContainsRow returns true if the row at the given offset within the
+ * stripe is deleted according to the given row mask.
+ */
+bool
+RowMaskContainsRow(bytea *rowMask, uint64 rowOffset)
+{
+	if (rowMask == NULL)
+	{
+		return false;
+	}
+
+	uint64 byteCount = VARSIZE_ANY_EXHDR(rowMask);
+	if (rowOffset / 8 >= byteCount)
+	{
+		return false;
+	}
+
+	uint8 *bits = (uint8 *) VARDATA_ANY(rowMask);
+	return (bits[rowOffset / 8] & (1 << (rowOffset % 8))) != 0;
+}
+
+
+/*
+ * RowMaskUnion marks the rows that are deleted in the source row mask as
+ * deleted in the target row mask too.
+ */
+void
+RowMaskUnion(bytea *targetRowMask, bytea *sourceRowMask)
+{
+	uint64 byteCount = Min(VARSIZE_ANY_EXHDR(targetRowMask),
+						   VARSIZE_ANY_EXHDR(sourceRowMask));
+
+	uint8 *targetBits = (uint8 *) VARDATA_ANY(targetRowMask);
+	uint8 *sourceBits = (uint8 *) VARDATA_ANY(sourceRowMask);
+
+	for (uint64 byteIndex = 0; byteIndex < byteCount; byteIndex++)
+	{
+		targetBits[byteIndex] |= sourceBits[byteIndex];
+	}
+}
+
+
+/*
+ * RowMaskCountRows returns the number of deleted rows among the given number
+ * of rows that start at the given offset within the stripe.
+ */
+uint64
+RowMaskCountRows(bytea *rowMask, uint64 firstRowOffset, uint64 rowCount)
+{
+	if (rowMask == NULL)
+	{
+		return 0;
+	}
+
+	uint8 *bits = (uint8 *) VARDATA_ANY(rowMask);
+	uint64 endRowOffset = Min(firstRowOffset + rowCount,
+							  (uint64) VARSIZE_ANY_EXHDR(rowMask) * 8);
+	uint64 deletedRowCount = 0;
+	uint64 rowOffset = firstRowOffset;
+
+	/* count bit by bit until we reach a byte boundary ... */
+	while (rowOffset < endRowOffset && rowOffset % 8 != 0)
+	{
+		deletedRowCount += (bits[rowOffset / 8] >> (rowOffset % 8)) & 1;
+		rowOffset++;
+	}
+
+	/* ... then byte by byte ... */
+	while (rowOffset + 8 <= endRowOffset)
+	{
+		deletedRowCount += pg_number_of_ones[bits[rowOffset / 8]];
+		rowOffset += 8;
+	}
+
+	/* ... and bit by bit for the rest */
+	while (rowOffset < endRowOffset)
+	{
+		deletedRowCount += (bits[rowOffset / 8] >> (rowOffset % 8)) & 1;
+		rowOffset++;
+	}
+
+	return deletedRowCount;
+}
@@ -492,6 +492,29 @@ ColumnarStorageRead(Relation rel, uint64 logicalOffset, char *data, uint32 amoun
 }
 
 
+/*
+ * ColumnarStoragePrefetch - issue asynchronous read-ahead for the blocks that
+ * hold the given logical range, so that a later ColumnarStorageRead of the
+ * range doesn't have to wait for the I/O.
+ */
+void
+ColumnarStoragePrefetch(Relation rel, uint64 logicalOffset, uint64 amount)
+{
+	if (amount == 0 || !ColumnarLogicalOffsetIsValid(logicalOffset))
+	{
+		return;
+	}
+
+	BlockNumber firstBlockno = LogicalToPhysical(logicalOffset).blockno;
+	BlockNumber lastBlockno = LogicalToPhysical(logicalOffset + amount - 1).blockno;
+
+	for (BlockNumber blockno = firstBlockno; blockno <= lastBlockno; blockno++)
+	{
+		PrefetchBuffer(rel, MAIN_FORKNUM, blockno);
+	}
+}
+
+
 /*
  * ColumnarStorageWrite - map the logical offset to a block and offset, then
  * write the buffer across multiple blocks if necessary.
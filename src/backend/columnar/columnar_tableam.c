@@ -30,14 +30,17 @@
 #include "commands/vacuum.h"
 #include "executor/executor.h"
 #include "nodes/makefuncs.h"
+#include "nodes/tidbitmap.h"
 #include "optimizer/plancat.h"
 #include "storage/bufmgr.h"
 #include "storage/bufpage.h"
 #include "storage/lmgr.h"
 #include "storage/predicate.h"
+#include "storage/proc.h"
 #include "storage/procarray.h"
 #include "storage/smgr.h"
 #include "tcop/utility.h"
+#include "utils/acl.h"
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
 #include "utils/lsyscache.h"
@@ -46,12 +49,14 @@
 #include "utils/rel.h"
 #include "utils/relcache.h"
 #include "utils/syscache.h"
+#include "utils/tuplesort.h"
 
 #include "citus_version.h"
 #include "pg_version_compat.h"
 
 #include "columnar/columnar.h"
 #include "columnar/columnar_customscan.h"
+#include "columnar/columnar_row_mask.h"
 #include "columnar/columnar_storage.h"
 #include "columnar/columnar_tableam.h"
 #include "columnar/columnar_version_compat.h"
@@ -82,9 +87,31 @@ typedef struct ColumnarScanDescData
 	MemoryContext scanContext;
 	Bitmapset *attr_needed;
 	List *scanQual;
+
+	/*
+	 * Row numbers of the current page of a bitmap heap scan, and the index
+	 * of the next one to read, see ColumnarBitmapCollectRowNumbers.
+	 */
+	uint64 *bitmapRowNumbers;
+	int bitmapRowCount;
+	int bitmapRowIndex;
 } ColumnarScanDescData;
 
 
+/*
+ * ParallelColumnarScanDescData is the shared state of a parallel scan on a
+ * columnar table. Participants of the scan read whole stripes and claim the
+ * next stripe to read from nextStripeOrdinal.
+ */
+typedef struct ParallelColumnarScanDescData
+{
+	ParallelTableScanDescData base;
+	pg_atomic_uint64 nextStripeOrdinal;
+} ParallelColumnarScanDescData;
+
+typedef struct ParallelColumnarScanDescData *ParallelColumnarScanDesc;
+
+
 /*
  * IndexFetchColumnarData is the scan state passed between index_fetch_begin,
  * index_fetch_reset, index_fetch_end, index_fetch_tuple calls.
@@ -103,6 +130,68 @@ typedef struct IndexFetchColumnarData
 	MemoryContext scanContext;
 } IndexFetchColumnarData;
 
+/*
+ * FetchRowVersionState is the read state that columnar_fetch_row_version
+ * keeps across calls when fetching with SnapshotAny. The executor fetches the
+ * old version of each row that an UPDATE changes this way, so we avoid
+ * reading the same stripe again for each row.
+ */
+typedef struct FetchRowVersionState
+{
+	RelFileNumber relfilenumber;
+	Relation relation;
+	TupleDesc tupleDescriptor;
+	ColumnarReadState *readState;
+	MemoryContext context;
+	MemoryContextCallback resetCallback;
+} FetchRowVersionState;
+
+static FetchRowVersionState *CachedFetchRowVersionState = NULL;
+
+/*
+ * StripeRewritePredicate decides whether a stripe should be rewritten, given
+ * its number of deleted rows.
+ */
+typedef bool (*StripeRewritePredicate)(StripeMetadata *stripeMetadata,
+									   uint64 deletedRowCount, void *arg);
+
+/*
+ * StripeRewriteState is the state for writing the rows of the rewritten
+ * stripes into new stripes and inserting their index entries.
+ */
+typedef struct StripeRewriteState
+{
+	Relation relation;
+	ColumnarWriteState *writeState;
+	EState *estate;
+	TupleTableSlot *slot;
+	int indexCount;
+	Relation *indexRelationArray;
+	IndexInfo **indexInfoArray;
+	ExprState **predicateArray;
+} StripeRewriteState;
+
+/*
+ * SmallStripeSelection is the state of StripeIsSmall while selecting the
+ * stripes to compact.
+ */
+typedef struct SmallStripeSelection
+{
+	uint64 stripeRowLimit;
+	uint64 smallStripeRowLimit;
+
+	/* number of small stripes and their live rows seen so far */
+	int smallStripeCount;
+	uint64 smallStripeRowCount;
+
+	/*
+	 * Length of the longest prefix of the small stripes that merges into
+	 * stripes that are not small, and its number of live rows.
+	 */
+	int compactStripeCount;
+	uint64 compactRowCount;
+} SmallStripeSelection;
+
 static object_access_hook_type PrevObjectAccessHook = NULL;
 static ProcessUtility_hook_type PrevProcessUtilityHook = NULL;
 
@@ -128,8 +217,26 @@ static bool ConditionalLockRelationWithTimeout(Relation rel, LOCKMODE lockMode,
 static List * NeededColumnsList(TupleDesc tupdesc, Bitmapset *attr_needed);
 static void LogRelationStats(Relation rel, int elevel);
 static void TruncateColumnar(Relation rel, int elevel);
+static void RewriteStripesWithDeletedRows(Relation rel, int elevel);
+static bool StripeHasManyDeletedRows(StripeMetadata *stripeMetadata,
+									 uint64 deletedRowCount, void *arg);
+static int CompactStripes(Relation rel, int elevel);
+static bool StripeIsSmall(StripeMetadata *stripeMetadata, uint64 deletedRowCount,
+						  void *arg);
+static List * SelectStripesToRewrite(Relation rel, Snapshot snapshot,
+									 StripeRewritePredicate predicate,
+									 void *predicateArg, uint64 *liveRowCount);
+static void RewriteStripes(Relation rel, List *stripeList, Snapshot snapshot);
+static void RewriteRow(StripeRewriteState *rewriteState);
+static void ClearVacuumFlag(void);
 static HeapTuple ColumnarSlotCopyHeapTuple(TupleTableSlot *slot);
-static void ColumnarCheckLogicalReplication(Relation rel);
+static void ColumnarCheckLogicalReplication(Relation rel, CmdType operation);
+static bool ColumnarFetchRowVersion(Relation relation, ColumnarReadState *readState,
+									uint64 rowNumber, Snapshot snapshot,
+									TupleTableSlot *slot);
+static ColumnarReadState * CachedFetchRowVersionReadState(Relation relation,
+														  TupleDesc tupleDescriptor);
+static void ResetCachedFetchRowVersionState(void *arg);
 static Datum * detoast_values(TupleDesc tupleDesc, Datum *orig_values, bool *isnull);
 static ItemPointerData row_number_to_tid(uint64 rowNumber);
 static uint64 tid_to_row_number(ItemPointerData tid);
@@ -271,14 +378,22 @@ CreateColumnarScanMemoryContext(void)
 static ColumnarReadState *
 init_columnar_read_state(Relation relation, TupleDesc tupdesc, Bitmapset *attr_needed,
 						 List *scanQual, MemoryContext scanContext, Snapshot snapshot,
-						 bool randomAccess)
+						 bool randomAccess, ParallelTableScanDesc parallelScan)
 {
 	MemoryContext oldContext = MemoryContextSwitchTo(scanContext);
 
+	pg_atomic_uint64 *parallelStripeCursor = NULL;
+	if (parallelScan != NULL)
+	{
+		ParallelColumnarScanDesc parallelColumnarScan =
+			(ParallelColumnarScanDesc) parallelScan;
+		parallelStripeCursor = &parallelColumnarScan->nextStripeOrdinal;
+	}
+
 	List *neededColumnList = NeededColumnsList(tupdesc, attr_needed);
 	ColumnarReadState *readState = ColumnarBeginRead(relation, tupdesc, neededColumnList,
 													 scanQual, scanContext, snapshot,
-													 randomAccess);
+													 randomAccess, parallelStripeCursor);
 
 	MemoryContextSwitchTo(oldContext);
 
@@ -312,7 +427,19 @@ columnar_rescan(TableScanDesc sscan, ScanKey key, bool set_params,
 	/* XXX: hack to pass in new quals that aren't actually scan keys */
 	List *scanQual = (List *) key;
 
-	if (scan->cs_readState != NULL)
+	if (scan->cs_base.rs_flags & SO_TYPE_BITMAPSCAN)
+	{
+		/* bitmap heap scans read rows by row number, start over */
+		if (scan->cs_readState != NULL)
+		{
+			ColumnarEndRead(scan->cs_readState);
+			scan->cs_readState = NULL;
+		}
+
+		scan->bitmapRowCount = 0;
+		scan->bitmapRowIndex = 0;
+	}
+	else if (scan->cs_readState != NULL)
 	{
 		ColumnarRescan(scan->cs_readState, scanQual);
 	}
@@ -334,7 +461,7 @@ columnar_getnextslot(TableScanDesc sscan, ScanDirection direction, TupleTableSlo
 			init_columnar_read_state(scan->cs_base.rs_rd, slot->tts_tupleDescriptor,
 									 scan->attr_needed, scan->scanQual,
 									 scan->scanContext, scan->cs_base.rs_snapshot,
-									 randomAccess);
+									 randomAccess, scan->cs_base.rs_parallel);
 	}
 
 	ExecClearTuple(slot);
@@ -350,6 +477,7 @@ columnar_getnextslot(TableScanDesc sscan, ScanDirection direction, TupleTableSlo
 
 	ExecStoreVirtualTuple(slot);
 
+	slot->tts_tableOid = RelationGetRelid(scan->cs_base.rs_rd);
 	slot->tts_tid = row_number_to_tid(rowNumber);
 
 	return true;
@@ -413,21 +541,63 @@ ErrorIfInvalidRowNumber(uint64 rowNumber)
 static Size
 columnar_parallelscan_estimate(Relation rel)
 {
-	elog(ERROR, "columnar_parallelscan_estimate not implemented");
+	return sizeof(ParallelColumnarScanDescData);
 }
 
 
 static Size
 columnar_parallelscan_initialize(Relation rel, ParallelTableScanDesc pscan)
 {
-	elog(ERROR, "columnar_parallelscan_initialize not implemented");
+	ParallelColumnarScanDesc parallelColumnarScan = (ParallelColumnarScanDesc) pscan;
+
+	parallelColumnarScan->base.phs_locator = rel->rd_locator;
+	parallelColumnarScan->base.phs_syncscan = false;
+	pg_atomic_init_u64(&parallelColumnarScan->nextStripeOrdinal, 0);
+
+	return sizeof(ParallelColumnarScanDescData);
 }
 
 
 static void
 columnar_parallelscan_reinitialize(Relation rel, ParallelTableScanDesc pscan)
 {
-	elog(ERROR, "columnar_parallelscan_reinitialize not implemented");
+	ParallelColumnarScanDesc parallelColumnarScan = (ParallelColumnarScanDesc) pscan;
+
+	pg_atomic_write_u64(&parallelColumnarScan->nextStripeOrdinal, 0);
+}
+
+
+/*
+ * columnar_beginscan_parallel_extended is the counterpart of
+ * table_beginscan_parallel for columnar_beginscan_extended. It starts the
+ * scan of a participant of a parallel scan using the snapshot that was
+ * serialized into the shared scan descriptor.
+ */
+TableScanDesc
+columnar_beginscan_parallel_extended(Relation relation,
+									 ParallelTableScanDesc parallel_scan,
+									 Bitmapset *attr_needed, List *scanQual)
+{
+	Snapshot snapshot = NULL;
+	uint32 flags = 0;
+
+	Assert(RelFileLocatorEquals(relation->rd_locator, parallel_scan->phs_locator));
+
+	if (!parallel_scan->phs_snapshot_any)
+	{
+		/* snapshot was serialized by table_parallelscan_initialize */
+		snapshot = RestoreSnapshot((char *) parallel_scan +
+								   parallel_scan->phs_snapshot_off);
+		RegisterSnapshot(snapshot);
+		flags |= SO_TEMP_SNAPSHOT;
+	}
+	else
+	{
+		snapshot = SnapshotAny;
+	}
+
+	return columnar_beginscan_extended(relation, snapshot, 0, NULL, parallel_scan,
+									   flags, attr_needed, scanQual);
 }
 
 
@@ -521,7 +691,7 @@ columnar_index_fetch_tuple(struct IndexFetchTableData *sscan,
 													  slot->tts_tupleDescriptor,
 													  attr_needed, scanQual,
 													  scan->scanContext,
-													  snapshot, randomAccess);
+													  snapshot, randomAccess, NULL);
 	}
 
 	uint64 rowNumber = tid_to_row_number(*tid);
@@ -533,6 +703,13 @@ columnar_index_fetch_tuple(struct IndexFetchTableData *sscan,
 		return false;
 	}
 
+	if (snapshot->snapshot_type != SNAPSHOT_ANY &&
+		PendingDeleteInTransaction(columnarRelation->rd_locator.relNumber, rowNumber))
+	{
+		/* row is deleted by the current transaction, but not flushed yet */
+		return false;
+	}
+
 	StripeWriteStateEnum stripeWriteState = StripeWriteState(stripeMetadata);
 	if (stripeWriteState == STRIPE_WRITE_FLUSHED &&
 		!ColumnarReadRowByRowNumber(scan->cs_readState, rowNumber,
@@ -542,6 +719,7 @@ columnar_index_fetch_tuple(struct IndexFetchTableData *sscan,
 		 * FindStripeWithMatchingFirstRowNumber doesn't verify upper row
 		 * number boundary of found stripe. For this reason, we didn't
 		 * certainly know if given row number belongs to one of the stripes.
+		 * Also, the row might be deleted.
 		 */
 		return false;
 	}
@@ -636,7 +814,157 @@ columnar_fetch_row_version(Relation relation,
 						   Snapshot snapshot,
 						   TupleTableSlot *slot)
 {
-	elog(ERROR, "columnar_fetch_row_version not implemented");
+	CheckCitusColumnarVersion(ERROR);
+
+	uint64 rowNumber = tid_to_row_number(*tid);
+
+	if (snapshot->snapshot_type != SNAPSHOT_ANY &&
+		PendingDeleteInTransaction(relation->rd_locator.relNumber, rowNumber))
+	{
+		/* row is deleted by the current transaction, but not flushed yet */
+		return false;
+	}
+
+	if (snapshot->snapshot_type == SNAPSHOT_ANY)
+	{
+		ColumnarReadState *readState =
+			CachedFetchRowVersionReadState(relation, slot->tts_tupleDescriptor);
+		return ColumnarFetchRowVersion(relation, readState, rowNumber, snapshot, slot);
+	}
+
+	/* we need all columns */
+	int natts = relation->rd_att->natts;
+	Bitmapset *attr_needed = bms_add_range(NULL, 0, natts - 1);
+
+	/* no quals when fetching a single row */
+	List *scanQual = NIL;
+
+	bool randomAccess = true;
+	MemoryContext scanContext = CreateColumnarScanMemoryContext();
+	ColumnarReadState *readState = init_columnar_read_state(relation,
+															slot->tts_tupleDescriptor,
+															attr_needed, scanQual,
+															scanContext, snapshot,
+															randomAccess, NULL);
+
+	bool rowFound = ColumnarFetchRowVersion(relation, readState, rowNumber, snapshot,
+											slot);
+
+	ColumnarEndRead(readState);
+	MemoryContextDelete(scanContext);
+
+	return rowFound;
+}
+
+
+/*
+ * ColumnarFetchRowVersion reads the row with given row number into given
+ * slot using given random access read state, and returns true if the row is
+ * visible to given snapshot, which is the snapshot of the read state.
+ *
+ * Rows of the stripes that are not flushed yet are not fetched, the executor
+ * only fetches the rows that its scans returned, which were flushed before
+ * being scanned.
+ */
+static bool
+ColumnarFetchRowVersion(Relation relation, ColumnarReadState *readState,
+						uint64 rowNumber, Snapshot snapshot, TupleTableSlot *slot)
+{
+	ExecClearTuple(slot);
+
+	StripeMetadata *stripeMetadata = FindStripeByRowNumber(relation, rowNumber,
+														   snapshot);
+	if (stripeMetadata == NULL ||
+		StripeWriteState(stripeMetadata) != STRIPE_WRITE_FLUSHED)
+	{
+		return false;
+	}
+
+	if (!ColumnarReadRowByRowNumber(readState, rowNumber, slot->tts_values,
+									slot->tts_isnull))
+	{
+		return false;
+	}
+
+	slot->tts_tableOid = RelationGetRelid(relation);
+	slot->tts_tid = row_number_to_tid(rowNumber);
+	ExecStoreVirtualTuple(slot);
+
+	/* values point into the stripe buffers of the read state */
+	ExecMaterializeSlot(slot);
+
+	return true;
+}
+
+
+/*
+ * CachedFetchRowVersionReadState returns the read state that we use to fetch
+ * the rows of given relation with SnapshotAny, creating it if the one we
+ * cached is for another relation. The read state lives until the end of the
+ * transaction.
+ */
+static ColumnarReadState *
+CachedFetchRowVersionReadState(Relation relation, TupleDesc tupleDescriptor)
+{
+	FetchRowVersionState *fetchState = CachedFetchRowVersionState;
+	if (fetchState != NULL &&
+		fetchState->relation == relation &&
+		fetchState->relfilenumber == relation->rd_locator.relNumber &&
+		equalTupleDescs(fetchState->tupleDescriptor, tupleDescriptor))
+	{
+		return fetchState->readState;
+	}
+
+	if (fetchState != NULL)
+	{
+		/* resets CachedFetchRowVersionState via the reset callback */
+		MemoryContextDelete(fetchState->context);
+	}
+
+	MemoryContext context = AllocSetContextCreate(TopTransactionContext,
+												  "Columnar Fetch Row Version Context",
+												  ALLOCSET_DEFAULT_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(context);
+
+	fetchState = palloc0(sizeof(FetchRowVersionState));
+	fetchState->relfilenumber = relation->rd_locator.relNumber;
+	fetchState->relation = relation;
+	fetchState->tupleDescriptor = CreateTupleDescCopy(tupleDescriptor);
+	fetchState->context = context;
+
+	/* we need all columns */
+	int natts = relation->rd_att->natts;
+	Bitmapset *attr_needed = bms_add_range(NULL, 0, natts - 1);
+
+	/* no quals when fetching a single row */
+	List *scanQual = NIL;
+
+	bool randomAccess = true;
+	fetchState->readState = init_columnar_read_state(relation,
+													 fetchState->tupleDescriptor,
+													 attr_needed, scanQual, context,
+													 SnapshotAny, randomAccess, NULL);
+
+	fetchState->resetCallback.func = ResetCachedFetchRowVersionState;
+	fetchState->resetCallback.arg = NULL;
+	MemoryContextRegisterResetCallback(context, &fetchState->resetCallback);
+
+	MemoryContextSwitchTo(oldContext);
+
+	CachedFetchRowVersionState = fetchState;
+
+	return fetchState->readState;
+}
+
+
+/*
+ * ResetCachedFetchRowVersionState forgets the cached read state when its
+ * memory context goes away.
+ */
+static void
+ResetCachedFetchRowVersionState(void *arg)
+{
+	CachedFetchRowVersionState = NULL;
 }
 
 
@@ -651,7 +979,17 @@ columnar_get_latest_tid(TableScanDesc sscan,
 static bool
 columnar_tuple_tid_valid(TableScanDesc scan, ItemPointer tid)
 {
-	elog(ERROR, "columnar_tuple_tid_valid not implemented");
+	if (!ItemPointerIsValid(tid) ||
+		ItemPointerGetOffsetNumber(tid) > VALID_ITEMPOINTER_OFFSETS)
+	{
+		return false;
+	}
+
+	/* rows that don't exist are skipped by columnar_fetch_row_version */
+	uint64 rowNumber = ItemPointerGetBlockNumber(tid) * VALID_ITEMPOINTER_OFFSETS +
+					   ItemPointerGetOffsetNumber(tid) - FirstOffsetNumber;
+	return rowNumber >= COLUMNAR_FIRST_ROW_NUMBER &&
+		   rowNumber <= COLUMNAR_MAX_ROW_NUMBER;
 }
 
 
@@ -663,7 +1001,19 @@ columnar_tuple_satisfies_snapshot(Relation rel, TupleTableSlot *slot,
 
 	uint64 rowNumber = tid_to_row_number(slot->tts_tid);
 	StripeMetadata *stripeMetadata = FindStripeByRowNumber(rel, rowNumber, snapshot);
-	return stripeMetadata != NULL;
+	if (stripeMetadata == NULL)
+	{
+		return false;
+	}
+
+	if (snapshot->snapshot_type != SNAPSHOT_ANY &&
+		PendingDeleteInTransaction(rel->rd_locator.relNumber, rowNumber))
+	{
+		return false;
+	}
+
+	bytea *rowMask = ReadStripeRowMask(rel, stripeMetadata->id, snapshot);
+	return !RowMaskContainsRow(rowMask, rowNumber - stripeMetadata->firstRowNumber);
 }
 
 
@@ -733,7 +1083,7 @@ columnar_tuple_insert(Relation relation, TupleTableSlot *slot, CommandId cid,
 	MemoryContext oldContext = MemoryContextSwitchTo(ColumnarWritePerTupleContext(
 														 writeState));
 
-	ColumnarCheckLogicalReplication(relation);
+	ColumnarCheckLogicalReplication(relation, CMD_INSERT);
 
 	slot_getallattrs(slot);
 
@@ -781,7 +1131,7 @@ columnar_multi_insert(Relation relation, TupleTableSlot **slots, int ntuples,
 															   RelationGetRelid(relation),
 															   GetCurrentSubTransactionId());
 
-	ColumnarCheckLogicalReplication(relation);
+	ColumnarCheckLogicalReplication(relation, CMD_INSERT);
 
 	MemoryContext oldContext = MemoryContextSwitchTo(ColumnarWritePerTupleContext(
 														 writeState));
@@ -811,7 +1161,45 @@ columnar_tuple_delete(Relation relation, ItemPointer tid, CommandId cid,
 					  Snapshot snapshot, Snapshot crosscheck, bool wait,
 					  TM_FailureData *tmfd, bool changingPart)
 {
-	elog(ERROR, "columnar_tuple_delete not implemented");
+	CheckCitusColumnarVersion(ERROR);
+
+	ColumnarCheckLogicalReplication(relation, CMD_DELETE);
+
+	/*
+	 * Deleting a row changes the row mask of its stripe, so we serialize the
+	 * deletes on the relation to make sure that the row masks don't change
+	 * while we keep the deleted rows in memory. This lock doesn't conflict
+	 * with the lock that the inserts take.
+	 */
+	LockRelation(relation, ShareUpdateExclusiveLock);
+
+	uint64 rowNumber = tid_to_row_number(*tid);
+	ColumnarDeleteResult deleteResult =
+		ColumnarMarkRowDeleted(relation, rowNumber, GetCurrentSubTransactionId());
+
+	if (deleteResult == COLUMNAR_DELETE_SELF_DELETED)
+	{
+		/* executor skips the rows that the current command already deleted */
+		tmfd->ctid = *tid;
+		tmfd->xmax = GetCurrentTransactionId();
+		tmfd->cmax = cid;
+		return TM_SelfModified;
+	}
+	else if (deleteResult == COLUMNAR_DELETE_ALREADY_DELETED)
+	{
+		/*
+		 * We cannot follow the update chain of the row to re-check the quals
+		 * against its new version as heapAM does, so give up.
+		 */
+		ereport(ERROR, (errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
+						errmsg("could not serialize access due to concurrent "
+							   "delete or update on columnar table \"%s\"",
+							   RelationGetRelationName(relation))));
+	}
+
+	pgstat_count_heap_delete(relation);
+
+	return TM_Ok;
 }
 
 
@@ -821,7 +1209,28 @@ columnar_tuple_update(Relation relation, ItemPointer otid, TupleTableSlot *slot,
 					  bool wait, TM_FailureData *tmfd,
 					  LockTupleMode *lockmode, TU_UpdateIndexes *update_indexes)
 {
-	elog(ERROR, "columnar_tuple_update not implemented");
+	CheckCitusColumnarVersion(ERROR);
+
+	ColumnarCheckLogicalReplication(relation, CMD_UPDATE);
+
+	/* stripes are immutable, so we delete the old version and insert the new one */
+	bool changingPart = false;
+	TM_Result result = columnar_tuple_delete(relation, otid, cid, snapshot, crosscheck,
+											 wait, tmfd, changingPart);
+	if (result != TM_Ok)
+	{
+		return result;
+	}
+
+	int options = 0;
+	BulkInsertState bistate = NULL;
+	columnar_tuple_insert(relation, slot, cid, options, bistate);
+
+	/* new version has a new row number, so all indexes need new entries */
+	*update_indexes = TU_All;
+	*lockmode = LockTupleExclusive;
+
+	return TM_Ok;
 }
 
 
@@ -831,7 +1240,8 @@ columnar_tuple_lock(Relation relation, ItemPointer tid, Snapshot snapshot,
 					LockWaitPolicy wait_policy, uint8 flags,
 					TM_FailureData *tmfd)
 {
-	elog(ERROR, "columnar_tuple_lock not implemented");
+	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("row-level locks are not supported on columnar tables")));
 }
 
 
@@ -969,15 +1379,20 @@ columnar_relation_copy_for_cluster(Relation OldHeap, Relation NewHeap,
 	/* no quals for table rewrite */
 	List *scanQual = NIL;
 
-	/* use SnapshotAny when re-writing table as heapAM does */
-	Snapshot snapshot = SnapshotAny;
+	/*
+	 * Unlike heapAM, we don't use SnapshotAny when re-writing the table since
+	 * SnapshotAny ignores the row masks and would bring the deleted rows
+	 * back. Rewrites hold an AccessExclusiveLock, so SnapshotSelf sees the
+	 * same stripes as SnapshotAny would, except the aborted ones.
+	 */
+	Snapshot snapshot = SnapshotSelf;
 
 	MemoryContext scanContext = CreateColumnarScanMemoryContext();
 	bool randomAccess = false;
 	ColumnarReadState *readState = init_columnar_read_state(OldHeap, sourceDesc,
 															attr_needed, scanQual,
 															scanContext, snapshot,
-															randomAccess);
+															randomAccess, NULL);
 
 	Datum *values = palloc0(sourceDesc->natts * sizeof(Datum));
 	bool *nulls = palloc0(sourceDesc->natts * sizeof(bool));
@@ -991,7 +1406,8 @@ columnar_relation_copy_for_cluster(Relation OldHeap, Relation NewHeap,
 		(*num_tuples)++;
 	}
 
-	*tups_vacuumed = 0;
+	/* the deleted rows that we skipped aren't in the new table anymore */
+	*tups_vacuumed = ReadDeletedRowCount(OldHeap, snapshot);
 
 	ColumnarEndWrite(writeState);
 	ColumnarEndRead(readState);
@@ -1028,7 +1444,7 @@ NeededColumnsList(TupleDesc tupdesc, Bitmapset *attr_needed)
 
 /*
  * ColumnarTableTupleCount returns the number of tuples that columnar
- * table with relationId has by using stripe metadata.
+ * table with relationId has by using stripe metadata and row masks.
  */
 static uint64
 ColumnarTableTupleCount(Relation relation)
@@ -1043,7 +1459,11 @@ ColumnarTableTupleCount(Relation relation)
 		tupleCount += stripe->rowCount;
 	}
 
-	return tupleCount;
+	Snapshot snapshot = RegisterSnapshot(GetTransactionSnapshot());
+	uint64 deletedRowCount = ReadDeletedRowCount(relation, snapshot);
+	UnregisterSnapshot(snapshot);
+
+	return tupleCount - Min(deletedRowCount, tupleCount);
 }
 
 
@@ -1081,9 +1501,12 @@ columnar_vacuum_rel(Relation rel, VacuumParams *params,
 
 	LogRelationStats(rel, elevel);
 
+	RewriteStripesWithDeletedRows(rel, elevel);
+
 	/*
-	 * We don't have updates, deletes, or concurrent updates, so all we
-	 * care for now is truncating the unused space at the end of storage.
+	 * Stripes are never modified in place, so apart from rewriting the
+	 * stripes with many deleted rows, all we care for is truncating the
+	 * unused space at the end of storage.
 	 */
 	if (params->truncate == VACOPTVALUE_ENABLED)
 	{
@@ -1155,77 +1578,478 @@ columnar_vacuum_rel(Relation rel, VacuumParams *params,
 
 
 /*
- * LogRelationStats logs statistics as the output of the VACUUM VERBOSE.
+ * RewriteStripesWithDeletedRows rewrites the stripes in which the fraction of
+ * deleted rows is at least columnar.vacuum_rewrite_threshold, so that the
+ * scans don't need to skip their deleted rows anymore and the new stripes
+ * have tighter min/max values.
  */
 static void
-LogRelationStats(Relation rel, int elevel)
+RewriteStripesWithDeletedRows(Relation rel, int elevel)
 {
-	ListCell *stripeMetadataCell = NULL;
-	StringInfo infoBuf = makeStringInfo();
+	if (columnar_vacuum_rewrite_threshold <= 0.0)
+	{
+		return;
+	}
 
-	int compressionStats[COMPRESSION_COUNT] = { 0 };
-	uint64 totalStripeLength = 0;
-	uint64 tupleCount = 0;
-	uint64 chunkCount = 0;
-	TupleDesc tupdesc = RelationGetDescr(rel);
-	uint64 droppedChunksWithData = 0;
-	uint64 totalDecompressedLength = 0;
+	/*
+	 * Lazy VACUUM holds a ShareUpdateExclusiveLock, which blocks the deletes
+	 * but not the inserts, so the row masks cannot change under us.
+	 */
+	ClearVacuumFlag();
 
-	List *stripeList = StripesForRelfilelocator(rel);
-	int stripeCount = list_length(stripeList);
+	Snapshot snapshot = RegisterSnapshot(GetLatestSnapshot());
 
-	foreach(stripeMetadataCell, stripeList)
+	uint64 liveRowCount = 0;
+	List *rewriteStripeList = SelectStripesToRewrite(rel, snapshot,
+													 StripeHasManyDeletedRows, NULL,
+													 &liveRowCount);
+	if (rewriteStripeList != NIL)
 	{
-		StripeMetadata *stripe = lfirst(stripeMetadataCell);
+		RewriteStripes(rel, rewriteStripeList, snapshot);
 
-		Snapshot snapshot = RegisterSnapshot(GetTransactionSnapshot());
-		StripeSkipList *skiplist = ReadStripeSkipList(rel, stripe->id,
-													  RelationGetDescr(rel),
-													  stripe->chunkCount,
-													  snapshot);
-		UnregisterSnapshot(snapshot);
+		ereport(elevel,
+				(errmsg("\"%s\": rewrote %d stripes with deleted rows into "
+						UINT64_FORMAT " rows",
+						RelationGetRelationName(rel), list_length(rewriteStripeList),
+						liveRowCount)));
+	}
 
-		for (uint32 column = 0; column < skiplist->columnCount; column++)
-		{
-			bool attrDropped = TupleDescAttr(tupdesc, column)->attisdropped;
-			for (uint32 chunk = 0; chunk < skiplist->chunkCount; chunk++)
-			{
-				ColumnChunkSkipNode *skipnode =
-					&skiplist->chunkSkipNodeArray[column][chunk];
+	UnregisterSnapshot(snapshot);
+}
 
-				/* ignore zero length chunks for dropped attributes */
-				if (skipnode->valueLength > 0)
-				{
-					compressionStats[skipnode->valueCompressionType]++;
-					chunkCount++;
 
-					if (attrDropped)
-					{
-						droppedChunksWithData++;
-					}
-				}
+/*
+ * StripeHasManyDeletedRows is a StripeRewritePredicate that returns true if
+ * the fraction of deleted rows of the stripe is at least
+ * columnar.vacuum_rewrite_threshold.
+ */
+static bool
+StripeHasManyDeletedRows(StripeMetadata *stripeMetadata, uint64 deletedRowCount,
+						 void *arg)
+{
+	return deletedRowCount > 0 &&
+		   deletedRowCount >= columnar_vacuum_rewrite_threshold *
+		   stripeMetadata->rowCount;
+}
 
-				/*
-				 * We don't compress exists buffer, so its compressed & decompressed
-				 * lengths are the same.
-				 */
-				totalDecompressedLength += skipnode->existsLength;
-				totalDecompressedLength += skipnode->decompressedValueSize;
-			}
-		}
 
-		tupleCount += stripe->rowCount;
-		totalStripeLength += stripe->dataLength;
-	}
+/*
+ * CompactStripes merges the small stripes of the given relation, which are
+ * the stripes with fewer live rows than half of the stripe_row_limit of the
+ * relation, into full stripes. Such stripes are typically written by small
+ * transactions, and make the scans pay for many metadata lookups and compress
+ * poorly. Returns the number of stripes that were merged.
+ *
+ * Only as many small stripes are merged as can be written without leaving a
+ * small stripe behind, since the next compaction would otherwise rewrite the
+ * last stripe of this one again, over and over for tables with frequent small
+ * inserts. The remaining small stripes are merged once more rows arrive.
+ *
+ * The caller should hold a ShareUpdateExclusiveLock on the relation, which
+ * blocks the deletes and the other compactions but not the reads and the
+ * inserts. The old stripes are replaced by the new ones when the transaction
+ * commits, and the concurrent reads keep reading the old ones until then.
+ */
+static int
+CompactStripes(Relation rel, int elevel)
+{
+	ColumnarOptions columnarOptions = { 0 };
+	ReadColumnarOptions(RelationGetRelid(rel), &columnarOptions);
 
-	uint64 relPages = smgrnblocks(RelationGetSmgr(rel), MAIN_FORKNUM);
-	RelationCloseSmgr(rel);
+	SmallStripeSelection selection = { 0 };
+	selection.stripeRowLimit = columnarOptions.stripeRowLimit;
+	selection.smallStripeRowLimit = columnarOptions.stripeRowLimit / 2;
 
-	Datum storageId = DirectFunctionCall1(columnar_relation_storageid,
-										  ObjectIdGetDatum(RelationGetRelid(rel)));
+	Snapshot snapshot = RegisterSnapshot(GetLatestSnapshot());
 
-	double compressionRate = totalStripeLength ?
-							 (double) totalDecompressedLength / totalStripeLength :
+	uint64 smallStripeRowCount = 0;
+	List *smallStripeList = SelectStripesToRewrite(rel, snapshot, StripeIsSmall,
+												   &selection, &smallStripeRowCount);
+	smallStripeList = list_truncate(smallStripeList, selection.compactStripeCount);
+
+	/* merging a single stripe would just rewrite it */
+	int compactedStripeCount = 0;
+	if (list_length(smallStripeList) > 1)
+	{
+		RewriteStripes(rel, smallStripeList, snapshot);
+		compactedStripeCount = list_length(smallStripeList);
+
+		ereport(elevel,
+				(errmsg("\"%s\": compacted %d stripes into " UINT64_FORMAT " rows",
+						RelationGetRelationName(rel), compactedStripeCount,
+						selection.compactRowCount)));
+	}
+
+	UnregisterSnapshot(snapshot);
+
+	return compactedStripeCount;
+}
+
+
+/*
+ * StripeIsSmall is a StripeRewritePredicate that returns true if the stripe
+ * has fewer live rows than the small stripe row limit of the selection that
+ * arg points to. It also keeps track of the longest prefix of the small
+ * stripes whose rows fill full stripes, plus a last stripe that is not small.
+ */
+static bool
+StripeIsSmall(StripeMetadata *stripeMetadata, uint64 deletedRowCount, void *arg)
+{
+	SmallStripeSelection *selection = (SmallStripeSelection *) arg;
+	uint64 liveRowCount = stripeMetadata->rowCount - deletedRowCount;
+
+	if (liveRowCount >= selection->smallStripeRowLimit)
+	{
+		return false;
+	}
+
+	selection->smallStripeCount++;
+	selection->smallStripeRowCount += liveRowCount;
+
+	uint64 lastStripeRowCount =
+		selection->smallStripeRowCount % selection->stripeRowLimit;
+	if (lastStripeRowCount == 0 ||
+		lastStripeRowCount >= selection->smallStripeRowLimit)
+	{
+		selection->compactStripeCount = selection->smallStripeCount;
+		selection->compactRowCount = selection->smallStripeRowCount;
+	}
+
+	return true;
+}
+
+
+/*
+ * SelectStripesToRewrite returns the flushed stripes of the given relation
+ * that are visible to the given snapshot and that the given predicate returns
+ * true for. It also sets liveRowCount to the number of rows that are not
+ * deleted in the returned stripes.
+ */
+static List *
+SelectStripesToRewrite(Relation rel, Snapshot snapshot,
+					   StripeRewritePredicate predicate, void *predicateArg,
+					   uint64 *liveRowCount)
+{
+	List *stripeList = NIL;
+	uint64 lastRowNumber = COLUMNAR_INVALID_ROW_NUMBER;
+
+	*liveRowCount = 0;
+
+	StripeMetadata *stripeMetadata = NULL;
+	while ((stripeMetadata = FindNextStripeByRowNumber(rel, lastRowNumber,
+														snapshot)) != NULL)
+	{
+		if (StripeWriteState(stripeMetadata) != STRIPE_WRITE_FLUSHED)
+		{
+			lastRowNumber = stripeMetadata->firstRowNumber;
+			continue;
+		}
+
+		lastRowNumber = StripeGetHighestRowNumber(stripeMetadata);
+
+		bytea *rowMask = ReadStripeRowMask(rel, stripeMetadata->id, snapshot);
+		uint64 deletedRowCount = RowMaskCountRows(rowMask, 0,
+												  stripeMetadata->rowCount);
+		if (predicate(stripeMetadata, deletedRowCount, predicateArg))
+		{
+			stripeList = lappend(stripeList, stripeMetadata);
+			*liveRowCount += stripeMetadata->rowCount - deletedRowCount;
+		}
+	}
+
+	return stripeList;
+}
+
+
+/*
+ * RewriteStripes writes the rows of the given stripes that are not deleted
+ * into new stripes together with their index entries, and then removes the
+ * metadata of the given stripes. If the relation has a clustered index (see
+ * ALTER TABLE .. CLUSTER ON), the rows are sorted by the clustered index, so
+ * that the min/max values of the new stripes and chunk groups can be used to
+ * skip them when filtering on the index columns.
+ *
+ * The new stripes are written into the space of stripes that were rewritten
+ * earlier when it is no longer visible to anyone (see ReusableDataRanges),
+ * so repeated rewrites don't grow the relation. The space of the given
+ * stripes becomes reusable once their removed metadata is vacuumed.
+ */
+static void
+RewriteStripes(Relation rel, List *stripeList, Snapshot snapshot)
+{
+	TupleDesc tupleDesc = RelationGetDescr(rel);
+
+	/* evaluating index expressions and predicates needs an active snapshot */
+	PushActiveSnapshot(snapshot);
+
+	StripeRewriteState *rewriteState = palloc0(sizeof(StripeRewriteState));
+	rewriteState->relation = rel;
+
+	ColumnarOptions columnarOptions = { 0 };
+	ReadColumnarOptions(RelationGetRelid(rel), &columnarOptions);
+	rewriteState->writeState = ColumnarBeginWrite(rel, columnarOptions, tupleDesc);
+
+	/* fill the space of the stripes that were rewritten before, if possible */
+	ColumnarWriteReuseDataRanges(rewriteState->writeState, ReusableDataRanges(rel));
+
+	/* we need all columns */
+	Bitmapset *attr_needed = bms_add_range(NULL, 0, tupleDesc->natts - 1);
+	List *scanQual = NIL;
+	bool randomAccess = true;
+	MemoryContext scanContext = CreateColumnarScanMemoryContext();
+	ColumnarReadState *readState = init_columnar_read_state(rel, tupleDesc,
+															attr_needed, scanQual,
+															scanContext, snapshot,
+															randomAccess, NULL);
+
+	rewriteState->estate = CreateExecutorState();
+	rewriteState->slot = MakeSingleTupleTableSlot(tupleDesc, &TTSOpsVirtual);
+
+	ExprContext *econtext = GetPerTupleExprContext(rewriteState->estate);
+	econtext->ecxt_scantuple = rewriteState->slot;
+
+	List *indexIdList = RelationGetIndexList(rel);
+	int indexCount = list_length(indexIdList);
+	rewriteState->indexCount = indexCount;
+	rewriteState->indexRelationArray = palloc0(indexCount * sizeof(Relation));
+	rewriteState->indexInfoArray = palloc0(indexCount * sizeof(IndexInfo *));
+	rewriteState->predicateArray = palloc0(indexCount * sizeof(ExprState *));
+
+	Relation clusteredIndex = NULL;
+	int indexIndex = 0;
+	Oid indexId = InvalidOid;
+	foreach_declared_oid(indexId, indexIdList)
+	{
+		Relation indexRelation = index_open(indexId, RowExclusiveLock);
+		IndexInfo *indexInfo = BuildIndexInfo(indexRelation);
+
+		rewriteState->indexRelationArray[indexIndex] = indexRelation;
+		rewriteState->indexInfoArray[indexIndex] = indexInfo;
+		rewriteState->predicateArray[indexIndex] =
+			ExecPrepareQual(indexInfo->ii_Predicate, rewriteState->estate);
+		indexIndex++;
+
+		if (indexRelation->rd_index->indisclustered &&
+			indexRelation->rd_index->indisvalid &&
+			indexRelation->rd_rel->relam == BTREE_AM_OID)
+		{
+			clusteredIndex = indexRelation;
+		}
+	}
+
+	Tuplesortstate *sortState = NULL;
+	if (clusteredIndex != NULL)
+	{
+		sortState = tuplesort_begin_cluster(tupleDesc, clusteredIndex,
+											maintenance_work_mem, NULL,
+											TUPLESORT_NONE);
+	}
+
+	Datum *values = rewriteState->slot->tts_values;
+	bool *nulls = rewriteState->slot->tts_isnull;
+
+	StripeMetadata *stripeMetadata = NULL;
+	foreach_declared_ptr(stripeMetadata, stripeList)
+	{
+		uint64 highestRowNumber = StripeGetHighestRowNumber(stripeMetadata);
+		for (uint64 rowNumber = stripeMetadata->firstRowNumber;
+			 rowNumber <= highestRowNumber; rowNumber++)
+		{
+			CHECK_FOR_INTERRUPTS();
+
+			ExecClearTuple(rewriteState->slot);
+			if (!ColumnarReadRowByRowNumber(readState, rowNumber, values, nulls))
+			{
+				/* row is deleted */
+				continue;
+			}
+
+			if (sortState != NULL)
+			{
+				HeapTuple heapTuple = heap_form_tuple(tupleDesc, values, nulls);
+				tuplesort_putheaptuple(sortState, heapTuple);
+				heap_freetuple(heapTuple);
+			}
+			else
+			{
+				RewriteRow(rewriteState);
+			}
+		}
+	}
+
+	if (sortState != NULL)
+	{
+		tuplesort_performsort(sortState);
+
+		HeapTuple heapTuple = NULL;
+		while ((heapTuple = tuplesort_getheaptuple(sortState, true)) != NULL)
+		{
+			CHECK_FOR_INTERRUPTS();
+
+			ExecClearTuple(rewriteState->slot);
+			heap_deform_tuple(heapTuple, tupleDesc, values, nulls);
+			RewriteRow(rewriteState);
+
+			heap_freetuple(heapTuple);
+		}
+
+		tuplesort_end(sortState);
+	}
+
+	ColumnarEndWrite(rewriteState->writeState);
+	ColumnarEndRead(readState);
+
+	/*
+	 * The index entries that point to the old stripes are left behind, but
+	 * the index scans cannot find a stripe for them anymore, so they don't
+	 * return such rows.
+	 */
+	foreach_declared_ptr(stripeMetadata, stripeList)
+	{
+		DeleteStripeMetadataRows(rel, stripeMetadata->id);
+	}
+
+	CommandCounterIncrement();
+
+	for (indexIndex = 0; indexIndex < indexCount; indexIndex++)
+	{
+		index_close(rewriteState->indexRelationArray[indexIndex], NoLock);
+	}
+
+	ExecDropSingleTupleTableSlot(rewriteState->slot);
+	FreeExecutorState(rewriteState->estate);
+	MemoryContextDelete(scanContext);
+
+	PopActiveSnapshot();
+}
+
+
+/*
+ * RewriteRow writes the row in the slot of the given rewrite state into the
+ * new stripes, and inserts its index entries.
+ */
+static void
+RewriteRow(StripeRewriteState *rewriteState)
+{
+	TupleTableSlot *slot = rewriteState->slot;
+	ExecStoreVirtualTuple(slot);
+
+	uint64 newRowNumber = ColumnarWriteRow(rewriteState->writeState, slot->tts_values,
+										   slot->tts_isnull);
+	slot->tts_tid = row_number_to_tid(newRowNumber);
+
+	ExprContext *econtext = GetPerTupleExprContext(rewriteState->estate);
+	ResetExprContext(econtext);
+
+	for (int indexIndex = 0; indexIndex < rewriteState->indexCount; indexIndex++)
+	{
+		if (!ExecQual(rewriteState->predicateArray[indexIndex], econtext))
+		{
+			continue;
+		}
+
+		Datum indexValues[INDEX_MAX_KEYS];
+		bool indexNulls[INDEX_MAX_KEYS];
+		FormIndexDatum(rewriteState->indexInfoArray[indexIndex], slot,
+					   rewriteState->estate, indexValues, indexNulls);
+
+		/* the rows are already known to be unique */
+		index_insert(rewriteState->indexRelationArray[indexIndex], indexValues,
+					 indexNulls, &slot->tts_tid, rewriteState->relation,
+					 UNIQUE_CHECK_NO, false, rewriteState->indexInfoArray[indexIndex]);
+	}
+}
+
+
+/*
+ * ClearVacuumFlag stops advertising that the current backend is running a
+ * lazy VACUUM. The other backends ignore the snapshots of the backends that
+ * run a lazy VACUUM when deciding which tuples are dead, which is fine as
+ * long as VACUUM doesn't read the tables with MVCC snapshots, but we read
+ * and write the columnar metadata when rewriting stripes.
+ */
+static void
+ClearVacuumFlag(void)
+{
+	LWLockAcquire(ProcArrayLock, LW_EXCLUSIVE);
+	MyProc->statusFlags &= ~PROC_IN_VACUUM;
+	ProcGlobal->statusFlags[MyProc->pgxactoff] = MyProc->statusFlags;
+	LWLockRelease(ProcArrayLock);
+}
+
+
+/*
+ * LogRelationStats logs statistics as the output of the VACUUM VERBOSE.
+ */
+static void
+LogRelationStats(Relation rel, int elevel)
+{
+	ListCell *stripeMetadataCell = NULL;
+	StringInfo infoBuf = makeStringInfo();
+
+	int compressionStats[COMPRESSION_COUNT] = { 0 };
+	uint64 totalStripeLength = 0;
+	uint64 tupleCount = 0;
+	uint64 chunkCount = 0;
+	TupleDesc tupdesc = RelationGetDescr(rel);
+	uint64 droppedChunksWithData = 0;
+	uint64 totalDecompressedLength = 0;
+
+	List *stripeList = StripesForRelfilelocator(rel);
+	int stripeCount = list_length(stripeList);
+
+	foreach(stripeMetadataCell, stripeList)
+	{
+		StripeMetadata *stripe = lfirst(stripeMetadataCell);
+
+		Snapshot snapshot = RegisterSnapshot(GetTransactionSnapshot());
+		StripeSkipList *skiplist = ReadStripeSkipList(rel, stripe->id,
+													  RelationGetDescr(rel),
+													  stripe->chunkCount,
+													  snapshot);
+		UnregisterSnapshot(snapshot);
+
+		for (uint32 column = 0; column < skiplist->columnCount; column++)
+		{
+			bool attrDropped = TupleDescAttr(tupdesc, column)->attisdropped;
+			for (uint32 chunk = 0; chunk < skiplist->chunkCount; chunk++)
+			{
+				ColumnChunkSkipNode *skipnode =
+					&skiplist->chunkSkipNodeArray[column][chunk];
+
+				/* ignore zero length chunks for dropped attributes */
+				if (skipnode->valueLength > 0)
+				{
+					compressionStats[skipnode->valueCompressionType]++;
+					chunkCount++;
+
+					if (attrDropped)
+					{
+						droppedChunksWithData++;
+					}
+				}
+
+				/*
+				 * We don't compress exists buffer, so its compressed & decompressed
+				 * lengths are the same.
+				 */
+				totalDecompressedLength += skipnode->existsLength;
+				totalDecompressedLength += skipnode->decompressedValueSize;
+			}
+		}
+
+		tupleCount += stripe->rowCount;
+		totalStripeLength += stripe->dataLength;
+	}
+
+	uint64 relPages = smgrnblocks(RelationGetSmgr(rel), MAIN_FORKNUM);
+	RelationCloseSmgr(rel);
+
+	Datum storageId = DirectFunctionCall1(columnar_relation_storageid,
+										  ObjectIdGetDatum(RelationGetRelid(rel)));
+
+	double compressionRate = totalStripeLength ?
+							 (double) totalDecompressedLength / totalStripeLength :
 							 1.0;
 
 	appendStringInfo(infoBuf, "storage id: %ld\n", DatumGetInt64(storageId));
@@ -1237,6 +2061,16 @@ LogRelationStats(Relation rel, int elevel)
 					 "average rows per stripe: %ld\n",
 					 tupleCount, stripeCount,
 					 stripeCount ? tupleCount / stripeCount : 0);
+
+	Snapshot snapshot = RegisterSnapshot(GetTransactionSnapshot());
+	uint64 deletedRowCount = ReadDeletedRowCount(rel, snapshot);
+	UnregisterSnapshot(snapshot);
+
+	if (deletedRowCount > 0)
+	{
+		appendStringInfo(infoBuf, "deleted row count: %ld\n", deletedRowCount);
+	}
+
 	appendStringInfo(infoBuf,
 					 "chunk count: %ld"
 					 ", containing data for dropped columns: %ld",
@@ -1475,9 +2309,13 @@ columnar_index_build_range_scan(Relation columnarRelation,
 	}
 
 	/*
-	 * In a normal index build, we use SnapshotAny to retrieve all tuples. In
-	 * a concurrent build or during bootstrap, we take a regular MVCC snapshot
-	 * and index whatever's live according to that.
+	 * In a normal index build, heapAM uses SnapshotAny to retrieve all tuples,
+	 * but SnapshotAny would also retrieve the deleted rows of columnar tables
+	 * and cause false unique violations. Since the ShareLock that the index
+	 * build holds blocks the deletes, we instead use SnapshotSelf to retrieve
+	 * all rows except the deleted ones. In a concurrent build or during
+	 * bootstrap, we take a regular MVCC snapshot and index whatever's live
+	 * according to that.
 	 */
 	TransactionId OldestXmin = InvalidTransactionId;
 	if (!IsBootstrapProcessingMode() && !indexInfo->ii_Concurrent)
@@ -1500,7 +2338,7 @@ columnar_index_build_range_scan(Relation columnarRelation,
 	}
 	else
 	{
-		snapshot = SnapshotAny;
+		snapshot = SnapshotSelf;
 	}
 
 	int nkeys = 0;
@@ -1676,7 +2514,7 @@ ColumnarReadRowsIntoIndex(TableScanDesc scan, Relation indexRelation,
 
 		ItemPointerData itemPointerData = slot->tts_tid;
 
-		/* currently, columnar tables can't have dead tuples */
+		/* deleted rows are already skipped by the scan */
 		bool tupleIsAlive = true;
 		indexCallback(indexRelation, &itemPointerData, indexValues, indexNulls,
 					  tupleIsAlive, indexCallbackState);
@@ -1917,6 +2755,193 @@ columnar_estimate_rel_size(Relation rel, int32 *attr_widths,
 }
 
 
+/*
+ * ColumnarBitmapCollectRowNumbers collects the row numbers that the TIDs of
+ * the given bitmap page map to, such that ColumnarBitmapNextRow reads them.
+ * Since a bitmap heap scan visits the pages in TID order, consecutive rows
+ * are read from the same chunk group, and ColumnarReadRowByRowNumber
+ * decompresses each chunk group only once for all the matching rows in it.
+ *
+ * Pages of columnar TIDs are virtual, so the rows of a lossy page, for which
+ * offsetCount is negative, are all the row numbers that map to it.
+ */
+static void
+ColumnarBitmapCollectRowNumbers(ColumnarScanDesc scan, BlockNumber blockNumber,
+								OffsetNumber *offsets, int offsetCount)
+{
+	if (scan->bitmapRowNumbers == NULL)
+	{
+		scan->bitmapRowNumbers =
+			MemoryContextAlloc(scan->scanContext,
+							   VALID_ITEMPOINTER_OFFSETS * sizeof(uint64));
+	}
+
+	scan->bitmapRowCount = 0;
+	scan->bitmapRowIndex = 0;
+
+	uint64 firstRowNumber = (uint64) blockNumber * VALID_ITEMPOINTER_OFFSETS;
+	bool lossyPage = (offsetCount < 0);
+	int tupleCount = lossyPage ? VALID_ITEMPOINTER_OFFSETS : offsetCount;
+
+	for (int tupleIndex = 0; tupleIndex < tupleCount; tupleIndex++)
+	{
+		OffsetNumber offset = lossyPage ? tupleIndex + FirstOffsetNumber :
+							  offsets[tupleIndex];
+		if (offset > VALID_ITEMPOINTER_OFFSETS)
+		{
+			continue;
+		}
+
+		uint64 rowNumber = firstRowNumber + offset - FirstOffsetNumber;
+		if (rowNumber < COLUMNAR_FIRST_ROW_NUMBER || rowNumber > COLUMNAR_MAX_ROW_NUMBER)
+		{
+			continue;
+		}
+
+		scan->bitmapRowNumbers[scan->bitmapRowCount++] = rowNumber;
+	}
+}
+
+
+/*
+ * ColumnarBitmapNextRow returns the next visible row among the ones that
+ * ColumnarBitmapCollectRowNumbers collected for the current bitmap page.
+ */
+static bool
+ColumnarBitmapNextRow(ColumnarScanDesc scan, TupleTableSlot *slot)
+{
+	Relation relation = scan->cs_base.rs_rd;
+
+	if (scan->cs_readState == NULL)
+	{
+		/* no quals, the executor rechecks the bitmap quals if needed */
+		List *scanQual = NIL;
+
+		bool randomAccess = true;
+		scan->cs_readState =
+			init_columnar_read_state(relation, slot->tts_tupleDescriptor,
+									 scan->attr_needed, scanQual, scan->scanContext,
+									 scan->cs_base.rs_snapshot, randomAccess, NULL);
+
+		/*
+		 * Unlike index scans, we read all the rows of the bitmap by their row
+		 * numbers, so flush our pending writes upfront.
+		 */
+		ColumnarReadFlushPendingWrites(scan->cs_readState);
+	}
+
+	while (scan->bitmapRowIndex < scan->bitmapRowCount)
+	{
+		uint64 rowNumber = scan->bitmapRowNumbers[scan->bitmapRowIndex++];
+
+		if (PendingDeleteInTransaction(relation->rd_locator.relNumber, rowNumber))
+		{
+			/* row is deleted by the current transaction, but not flushed yet */
+			continue;
+		}
+
+		ExecClearTuple(slot);
+
+		if (!ColumnarReadRowByRowNumber(scan->cs_readState, rowNumber,
+										slot->tts_values, slot->tts_isnull))
+		{
+			/* no such row, or it is deleted */
+			continue;
+		}
+
+		ExecStoreVirtualTuple(slot);
+
+		slot->tts_tableOid = RelationGetRelid(relation);
+		slot->tts_tid = row_number_to_tid(rowNumber);
+
+		return true;
+	}
+
+	return false;
+}
+
+
+#if PG_VERSION_NUM >= PG_VERSION_18
+
+/*
+ * columnar_scan_bitmap_next_tuple returns the next visible row of the bitmap
+ * heap scan. Since PG 18, the table AM iterates over the bitmap itself, and
+ * prefetching the pages is left to the table AM, which columnar does not
+ * need since its pages are virtual.
+ */
+static bool
+columnar_scan_bitmap_next_tuple(TableScanDesc sscan, TupleTableSlot *slot,
+								bool *recheck, uint64 *lossy_pages,
+								uint64 *exact_pages)
+{
+	ColumnarScanDesc scan = (ColumnarScanDesc) sscan;
+
+	while (!ColumnarBitmapNextRow(scan, slot))
+	{
+		TBMIterateResult tbmres;
+		OffsetNumber offsets[TBM_MAX_TUPLES_PER_PAGE];
+		int offsetCount = -1;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (!tbm_iterate(&sscan->st.rs_tbmiterator, &tbmres))
+		{
+			return false;
+		}
+
+		if (tbmres.lossy)
+		{
+			(*lossy_pages)++;
+		}
+		else
+		{
+			offsetCount = tbm_extract_page_tuple(&tbmres, offsets,
+												 TBM_MAX_TUPLES_PER_PAGE);
+			(*exact_pages)++;
+		}
+
+		*recheck = tbmres.recheck;
+
+		ColumnarBitmapCollectRowNumbers(scan, tbmres.blockno, offsets, offsetCount);
+	}
+
+	return true;
+}
+
+
+#else
+
+/*
+ * columnar_scan_bitmap_next_block collects the row numbers of the given
+ * bitmap page, see ColumnarBitmapCollectRowNumbers.
+ */
+static bool
+columnar_scan_bitmap_next_block(TableScanDesc sscan, TBMIterateResult *tbmres)
+{
+	ColumnarScanDesc scan = (ColumnarScanDesc) sscan;
+
+	ColumnarBitmapCollectRowNumbers(scan, tbmres->blockno, tbmres->offsets,
+									tbmres->ntuples);
+
+	return scan->bitmapRowCount > 0;
+}
+
+
+/*
+ * columnar_scan_bitmap_next_tuple returns the next visible row among the ones
+ * that columnar_scan_bitmap_next_block collected for the current page.
+ */
+static bool
+columnar_scan_bitmap_next_tuple(TableScanDesc sscan, TBMIterateResult *tbmres,
+								TupleTableSlot *slot)
+{
+	return ColumnarBitmapNextRow((ColumnarScanDesc) sscan, slot);
+}
+
+
+#endif
+
+
 static bool
 columnar_scan_sample_next_block(TableScanDesc scan, SampleScanState *scanstate)
 {
@@ -2041,6 +3066,107 @@ ColumnarScanChunkGroupsFiltered(ColumnarScanDesc columnarScanDesc)
 }
 
 
+/*
+ * Get the number of stripes skipped using stripe summaries during the given scan.
+ */
+int64
+ColumnarScanStripesFiltered(ColumnarScanDesc columnarScanDesc)
+{
+	ColumnarReadState *readState = columnarScanDesc->cs_readState;
+
+	/* readState is initialized lazily */
+	if (readState != NULL)
+	{
+		return ColumnarReadStripesFiltered(readState);
+	}
+	else
+	{
+		return 0;
+	}
+}
+
+
+/*
+ * Get the number of stripes read during the given scan.
+ */
+int64
+ColumnarScanStripesRead(ColumnarScanDesc columnarScanDesc)
+{
+	ColumnarReadState *readState = columnarScanDesc->cs_readState;
+
+	/* readState is initialized lazily */
+	if (readState != NULL)
+	{
+		return ColumnarReadStripesRead(readState);
+	}
+	else
+	{
+		return 0;
+	}
+}
+
+
+/*
+ * Get the number of stripes prefetched during the given scan.
+ */
+int64
+ColumnarScanStripesPrefetched(ColumnarScanDesc columnarScanDesc)
+{
+	ColumnarReadState *readState = columnarScanDesc->cs_readState;
+
+	/* readState is initialized lazily */
+	if (readState != NULL)
+	{
+		return ColumnarReadStripesPrefetched(readState);
+	}
+	else
+	{
+		return 0;
+	}
+}
+
+
+/*
+ * Get the number of chunk groups whose rows were all removed by vector
+ * filters during the given scan.
+ */
+int64
+ColumnarScanChunkGroupsVectorFiltered(ColumnarScanDesc columnarScanDesc)
+{
+	ColumnarReadState *readState = columnarScanDesc->cs_readState;
+
+	/* readState is initialized lazily */
+	if (readState != NULL)
+	{
+		return ColumnarReadChunkGroupsVectorFiltered(readState);
+	}
+	else
+	{
+		return 0;
+	}
+}
+
+
+/*
+ * Get the number of rows removed by vector filters during the given scan.
+ */
+int64
+ColumnarScanVectorFilteredRows(ColumnarScanDesc columnarScanDesc)
+{
+	ColumnarReadState *readState = columnarScanDesc->cs_readState;
+
+	/* readState is initialized lazily */
+	if (readState != NULL)
+	{
+		return ColumnarReadVectorFilteredRows(readState);
+	}
+	else
+	{
+		return 0;
+	}
+}
+
+
 /*
  * Implementation of TupleTableSlotOps.copy_heap_tuple for TTSOpsColumnar.
  */
@@ -2522,11 +3648,11 @@ static const TableAmRoutine columnar_am_methods = {
 
 	.relation_estimate_size = columnar_estimate_rel_size,
 
-#if PG_VERSION_NUM < PG_VERSION_18
-
-	/* these two fields were removed in PG 18 */
-	.scan_bitmap_next_block = NULL,
-	.scan_bitmap_next_tuple = NULL,
+#if PG_VERSION_NUM >= PG_VERSION_18
+	.scan_bitmap_next_tuple = columnar_scan_bitmap_next_tuple,
+#else
+	.scan_bitmap_next_block = columnar_scan_bitmap_next_block,
+	.scan_bitmap_next_tuple = columnar_scan_bitmap_next_tuple,
 #endif
 
 	.scan_sample_next_block = columnar_scan_sample_next_block,
@@ -2595,34 +3721,40 @@ detoast_values(TupleDesc tupleDesc, Datum *orig_values, bool *isnull)
 
 /*
  * ColumnarCheckLogicalReplication throws an error if the relation is
- * part of any publication. This should be called before any write to
- * a columnar table, because columnar changes are not replicated with
- * logical replication (similar to a row table without a replica
- * identity).
+ * part of any publication that publishes the given operation. This should
+ * be called before any write to a columnar table, because columnar changes
+ * are not replicated with logical replication (similar to a row table
+ * without a replica identity).
  */
 static void
-ColumnarCheckLogicalReplication(Relation rel)
+ColumnarCheckLogicalReplication(Relation rel, CmdType operation)
 {
-	bool pubActionInsert = false;
-
 	if (!is_publishable_relation(rel))
 	{
 		return;
 	}
 
-	{
-		PublicationDesc pubdesc;
-
-		RelationBuildPublicationDesc(rel, &pubdesc);
-		pubActionInsert = pubdesc.pubactions.pubinsert;
-	}
+	PublicationDesc pubdesc;
+	RelationBuildPublicationDesc(rel, &pubdesc);
 
-	if (pubActionInsert)
+	if (operation == CMD_INSERT && pubdesc.pubactions.pubinsert)
 	{
 		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 						errmsg(
 							"cannot insert into columnar table that is a part of a publication")));
 	}
+	else if (operation == CMD_UPDATE && pubdesc.pubactions.pubupdate)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg(
+							"cannot update columnar table that is a part of a publication")));
+	}
+	else if (operation == CMD_DELETE && pubdesc.pubactions.pubdelete)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg(
+							"cannot delete from columnar table that is a part of a publication")));
+	}
 }
 
 
@@ -2732,6 +3864,148 @@ downgrade_columnar_storage(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * columnar_compact_stripes merges the small stripes of the given columnar
+ * table into full stripes, and returns the number of stripes that were
+ * merged.
+ *
+ * DDL:
+ *   CREATE FUNCTION columnar.compact_stripes(table_name regclass)
+ *     RETURNS integer
+ *     STRICT
+ *     LANGUAGE c AS 'MODULE_PATHNAME', 'columnar_compact_stripes';
+ */
+PG_FUNCTION_INFO_V1(columnar_compact_stripes);
+Datum
+columnar_compact_stripes(PG_FUNCTION_ARGS)
+{
+	Oid relid = PG_GETARG_OID(0);
+
+	CheckCitusColumnarVersion(ERROR);
+
+	/* blocks the deletes and the other compactions, but not reads and inserts */
+	Relation rel = table_open(relid, ShareUpdateExclusiveLock);
+
+	if (!object_ownercheck(RelationRelationId, relid, GetUserId()))
+	{
+		aclcheck_error(ACLCHECK_NOT_OWNER, OBJECT_TABLE,
+					   RelationGetRelationName(rel));
+	}
+
+	if (!IsColumnarTableAmTable(relid))
+	{
+		ereport(ERROR, (errmsg("table %s is not a columnar table",
+							   quote_identifier(RelationGetRelationName(rel)))));
+	}
+
+	/* the rows that the current transaction deleted must not be rewritten */
+	FlushWriteStateForRelfilenumber(rel->rd_locator.relNumber,
+									GetCurrentSubTransactionId());
+
+	int compactedStripeCount = CompactStripes(rel, DEBUG1);
+
+	table_close(rel, NoLock);
+
+	PG_RETURN_INT32(compactedStripeCount);
+}
+
+
+/*
+ * TryCompactColumnarTables merges the small stripes of the columnar tables in
+ * the current database into full stripes, and returns the number of tables
+ * whose stripes were merged. The tables that others hold conflicting locks on
+ * are skipped until the next call.
+ *
+ * It is called periodically by the maintenance daemon of citus, so errors
+ * while compacting a table are reported as warnings, and don't prevent
+ * compacting the other tables.
+ */
+int
+TryCompactColumnarTables(void)
+{
+	if (!CitusColumnarHasBeenLoaded() || !CheckCitusColumnarVersion(DEBUG1))
+	{
+		return 0;
+	}
+
+	Oid columnarAmId = get_table_am_oid(COLUMNAR_AM_NAME, true);
+	if (!OidIsValid(columnarAmId))
+	{
+		return 0;
+	}
+
+	List *relationIdList = NIL;
+	Relation pgClass = table_open(RelationRelationId, AccessShareLock);
+	TableScanDesc scanDesc = table_beginscan_catalog(pgClass, 0, NULL);
+
+	HeapTuple heapTuple = NULL;
+	while ((heapTuple = heap_getnext(scanDesc, ForwardScanDirection)) != NULL)
+	{
+		Form_pg_class classForm = (Form_pg_class) GETSTRUCT(heapTuple);
+
+		/* we cannot access the temporary tables of other sessions */
+		if (classForm->relam == columnarAmId &&
+			classForm->relpersistence != RELPERSISTENCE_TEMP)
+		{
+			relationIdList = lappend_oid(relationIdList, classForm->oid);
+		}
+	}
+
+	table_endscan(scanDesc);
+	table_close(pgClass, AccessShareLock);
+
+	int compactedTableCount = 0;
+	MemoryContext savedContext = CurrentMemoryContext;
+
+	Oid relationId = InvalidOid;
+	foreach_declared_oid(relationId, relationIdList)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		/* roll back only the current table in case of an error */
+		BeginInternalSubTransaction(NULL);
+
+		PG_TRY();
+		{
+			if (ConditionalLockRelationOid(relationId, ShareUpdateExclusiveLock))
+			{
+				/* the table might have been dropped in the meantime */
+				Relation rel = try_relation_open(relationId, NoLock);
+				if (rel != NULL)
+				{
+					if (ColumnarStorageIsCurrent(rel) &&
+						CompactStripes(rel, DEBUG1) > 0)
+					{
+						compactedTableCount++;
+					}
+
+					relation_close(rel, NoLock);
+				}
+			}
+
+			ReleaseCurrentSubTransaction();
+		}
+		PG_CATCH();
+		{
+			MemoryContextSwitchTo(savedContext);
+			ErrorData *edata = CopyErrorData();
+			FlushErrorState();
+
+			RollbackAndReleaseCurrentSubTransaction();
+
+			/* rethrow as WARNING */
+			edata->elevel = WARNING;
+			ThrowErrorData(edata);
+		}
+		PG_END_TRY();
+
+		MemoryContextSwitchTo(savedContext);
+	}
+
+	return compactedTableCount;
+}
+
+
 /*
  * Code to check the Citus Version, helps remove dependency from Citus
  */
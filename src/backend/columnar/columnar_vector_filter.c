@@ -0,0 +1,714 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_vector_filter.c
+ *
+ * This file contains the logic for evaluating simple pushed-down quals over
+ * the deserialized column vectors of a chunk group. Rows that don't pass the
+ * quals are removed from the selection vector of the chunk group, so we don't
+ * have to materialize them in a tuple slot and evaluate the quals row by row
+ * in the executor. The executor still evaluates all scan quals on the rows
+ * that pass.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+
+#include "postgres.h"
+
+#include "fmgr.h"
+
+#include "access/nbtree.h"
+#include "catalog/pg_am.h"
+#include "catalog/pg_type.h"
+#include "commands/defrem.h"
+#include "nodes/nodeFuncs.h"
+#include "utils/array.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+
+#include "columnar/columnar.h"
+
+#include "distributed/listutils.h"
+
+
+/*
+ * ColumnarVectorFilterMethod determines how a filter compares the values of
+ * a column vector against its constants.
+ */
+typedef enum ColumnarVectorFilterMethod
+{
+	/* compare the integer values in the column vector directly */
+	VECTOR_FILTER_INTEGER,
+
+	/* call the operator function for each value in the column vector */
+	VECTOR_FILTER_FUNCTION
+} ColumnarVectorFilterMethod;
+
+
+/*
+ * ColumnarVectorFilter is a qual of the form "column <op> constant" or
+ * "column <op> ANY/ALL (constant array)" that can be evaluated over a column
+ * vector. NULL column values never pass a filter.
+ */
+typedef struct ColumnarVectorFilter
+{
+	/* 0-indexed column that the filter is applied on */
+	int columnIndex;
+
+	ColumnarVectorFilterMethod method;
+
+	/* whether a row passes if any (true) or all (false) comparisons are true */
+	bool useOr;
+
+	/* constants to compare against, more than one for ANY/ALL */
+	int constCount;
+	Datum *constValues;
+
+	/* VECTOR_FILTER_INTEGER: column width and strategy of "column <op> constant" */
+	int16 columnLength;
+	int16 strategy;
+	Oid constTypeId;
+
+	/* VECTOR_FILTER_FUNCTION: operator and whether the column is its left argument */
+	FmgrInfo operatorFunction;
+	Oid collationId;
+	bool columnIsLeftArg;
+} ColumnarVectorFilter;
+
+
+/*
+ * FOLD_INTEGER_COMPARISON combines the result of comparing each value in the
+ * column vector against constValue into rowMatches. The loops are kept free
+ * of branches, such that the compiler can vectorize them.
+ */
+#define FOLD_INTEGER_COMPARISON(getter, op) \
+	do { \
+		if (filter->useOr) \
+		{ \
+			for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++) \
+			{ \
+				rowMatches[rowIndex] |= (getter(values[rowIndex]) op constValue); \
+			} \
+		} \
+		else \
+		{ \
+			for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++) \
+			{ \
+				rowMatches[rowIndex] &= (getter(values[rowIndex]) op constValue); \
+			} \
+		} \
+	} while (0)
+
+#define FOLD_INTEGER_COMPARISON_BY_STRATEGY(getter) \
+	do { \
+		switch (filter->strategy) \
+		{ \
+			case BTLessStrategyNumber: \
+			{ \
+				FOLD_INTEGER_COMPARISON(getter, <); \
+				break; \
+			} \
+			case BTLessEqualStrategyNumber: \
+			{ \
+				FOLD_INTEGER_COMPARISON(getter, <=); \
+				break; \
+			} \
+			case BTEqualStrategyNumber: \
+			{ \
+				FOLD_INTEGER_COMPARISON(getter, ==); \
+				break; \
+			} \
+			case BTGreaterEqualStrategyNumber: \
+			{ \
+				FOLD_INTEGER_COMPARISON(getter, >=); \
+				break; \
+			} \
+			case BTGreaterStrategyNumber: \
+			{ \
+				FOLD_INTEGER_COMPARISON(getter, >); \
+				break; \
+			} \
+			default: \
+			{ \
+				elog(ERROR, "unexpected strategy number %d", filter->strategy); \
+			} \
+		} \
+	} while (0)
+
+
+static ColumnarVectorFilter * BuildOpExprVectorFilter(OpExpr *opExpr,
+													  TupleDesc tupleDescriptor);
+static ColumnarVectorFilter * BuildScalarArrayOpExprVectorFilter(
+	ScalarArrayOpExpr *arrayOpExpr, TupleDesc tupleDescriptor);
+static bool IsVectorFilterColumn(Node *node, TupleDesc tupleDescriptor);
+static ColumnarVectorFilter * CreateVectorFilter(Var *column, Oid operatorId,
+												 Oid collationId, Oid constTypeId,
+												 bool columnIsLeftArg);
+static int64 IntegerConstValue(Datum constValue, Oid constTypeId);
+static void ApplyIntegerVectorFilter(ColumnarVectorFilter *filter, const Datum *values,
+									 bool *rowMatches, uint32 rowCount);
+static void ApplyDictionaryVectorFilter(ColumnarVectorFilter *filter,
+										ChunkColumnDictionary *dictionary,
+										const bool *exists, bool *rowMatches,
+										uint32 rowCount);
+static bool FilterMatchesValue(ColumnarVectorFilter *filter, Datum value);
+static void ApplyFunctionVectorFilter(ColumnarVectorFilter *filter, const Datum *values,
+									  const bool *exists, const bool *selectedRows,
+									  bool *rowMatches, uint32 rowCount);
+
+
+/*
+ * BuildColumnarVectorFilters returns the list of filters that can be
+ * evaluated over column vectors for the given pushed-down quals. Quals that
+ * cannot be evaluated this way are skipped, which is fine since the executor
+ * evaluates all of them on the rows that pass the filters anyway.
+ */
+List *
+BuildColumnarVectorFilters(List *whereClauseList, TupleDesc tupleDescriptor)
+{
+	List *vectorFilterList = NIL;
+
+	Node *clause = NULL;
+	foreach_declared_ptr(clause, whereClauseList)
+	{
+		ColumnarVectorFilter *vectorFilter = NULL;
+
+		if (is_andclause(clause))
+		{
+			List *andFilterList =
+				BuildColumnarVectorFilters(((BoolExpr *) clause)->args,
+										   tupleDescriptor);
+			vectorFilterList = list_concat(vectorFilterList, andFilterList);
+		}
+		else if (IsA(clause, OpExpr))
+		{
+			vectorFilter = BuildOpExprVectorFilter((OpExpr *) clause, tupleDescriptor);
+		}
+		else if (IsA(clause, ScalarArrayOpExpr))
+		{
+			vectorFilter = BuildScalarArrayOpExprVectorFilter(
+				(ScalarArrayOpExpr *) clause, tupleDescriptor);
+		}
+
+		if (vectorFilter != NULL)
+		{
+			vectorFilterList = lappend(vectorFilterList, vectorFilter);
+		}
+	}
+
+	return vectorFilterList;
+}
+
+
+/*
+ * ApplyColumnarVectorFilters clears the entries of selectedRows for the rows
+ * of the chunk group that don't pass all filters and returns the number of
+ * rows that were removed. Filters on columns that are not projected are
+ * ignored.
+ */
+uint32
+ApplyColumnarVectorFilters(List *vectorFilterList, ChunkData *chunkData,
+						   bool *selectedRows)
+{
+	uint32 rowCount = chunkData->rowCount;
+	uint32 removedRowCount = 0;
+
+	memset(selectedRows, true, rowCount * sizeof(bool));
+
+	if (vectorFilterList == NIL || rowCount == 0)
+	{
+		return 0;
+	}
+
+	/* operator functions might allocate memory, don't leak it per row */
+	MemoryContext filterContext = AllocSetContextCreate(CurrentMemoryContext,
+														"Columnar Vector Filter",
+														ALLOCSET_DEFAULT_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(filterContext);
+
+	bool *rowMatches = palloc(rowCount * sizeof(bool));
+
+	ColumnarVectorFilter *filter = NULL;
+	foreach_declared_ptr(filter, vectorFilterList)
+	{
+		const bool *exists = chunkData->existsArray[filter->columnIndex];
+		const Datum *values = chunkData->valueArray[filter->columnIndex];
+		ChunkColumnDictionary *dictionary =
+			chunkData->dictionaryArray[filter->columnIndex];
+
+		if (exists == NULL)
+		{
+			continue;
+		}
+
+		memset(rowMatches, !filter->useOr, rowCount * sizeof(bool));
+
+		if (filter->method == VECTOR_FILTER_INTEGER)
+		{
+			ApplyIntegerVectorFilter(filter, values, rowMatches, rowCount);
+		}
+		else if (dictionary != NULL && dictionary->entryCount < rowCount)
+		{
+			ApplyDictionaryVectorFilter(filter, dictionary, exists, rowMatches,
+										rowCount);
+		}
+		else
+		{
+			ApplyFunctionVectorFilter(filter, values, exists, selectedRows,
+									  rowMatches, rowCount);
+		}
+
+		for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		{
+			selectedRows[rowIndex] &= exists[rowIndex] & rowMatches[rowIndex];
+		}
+	}
+
+	for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		removedRowCount += !selectedRows[rowIndex];
+	}
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(filterContext);
+
+	return removedRowCount;
+}
+
+
+/*
+ * ColumnarVectorFilterColumnList returns the integer list of attribute numbers
+ * (1-indexed) of the columns in projectedColumnList that at least one of the
+ * given filters is applied on.
+ */
+List *
+ColumnarVectorFilterColumnList(List *vectorFilterList, List *projectedColumnList)
+{
+	List *filterColumnList = NIL;
+
+	ColumnarVectorFilter *filter = NULL;
+	foreach_declared_ptr(filter, vectorFilterList)
+	{
+		/* columnIndex is 0-indexed; attribute numbers are 1-indexed */
+		int attno = filter->columnIndex + 1;
+
+		if (list_member_int(projectedColumnList, attno))
+		{
+			filterColumnList = list_append_unique_int(filterColumnList, attno);
+		}
+	}
+
+	return filterColumnList;
+}
+
+
+/*
+ * BuildOpExprVectorFilter builds a filter for a qual of the form
+ * "column <op> constant" or "constant <op> column", or returns NULL if the
+ * qual has a different form.
+ */
+static ColumnarVectorFilter *
+BuildOpExprVectorFilter(OpExpr *opExpr, TupleDesc tupleDescriptor)
+{
+	if (list_length(opExpr->args) != 2)
+	{
+		return NULL;
+	}
+
+	Node *leftArg = linitial(opExpr->args);
+	Node *rightArg = lsecond(opExpr->args);
+	bool columnIsLeftArg = true;
+
+	if (IsVectorFilterColumn(leftArg, tupleDescriptor) && IsA(rightArg, Const))
+	{
+		columnIsLeftArg = true;
+	}
+	else if (IsVectorFilterColumn(rightArg, tupleDescriptor) && IsA(leftArg, Const))
+	{
+		columnIsLeftArg = false;
+	}
+	else
+	{
+		return NULL;
+	}
+
+	Var *column = (Var *) (columnIsLeftArg ? leftArg : rightArg);
+	Const *constant = (Const *) (columnIsLeftArg ? rightArg : leftArg);
+
+	ColumnarVectorFilter *filter = CreateVectorFilter(column, opExpr->opno,
+													  opExpr->inputcollid,
+													  constant->consttype,
+													  columnIsLeftArg);
+	if (filter == NULL)
+	{
+		return NULL;
+	}
+
+	/* strict operators never return true for a NULL constant */
+	filter->useOr = true;
+	filter->constCount = constant->constisnull ? 0 : 1;
+	filter->constValues = palloc(sizeof(Datum));
+	filter->constValues[0] = constant->constvalue;
+
+	return filter;
+}
+
+
+/*
+ * BuildScalarArrayOpExprVectorFilter builds a filter for a qual of the form
+ * "column <op> ANY/ALL (constant array)", which is what IN lists turn into,
+ * or returns NULL if the qual has a different form.
+ */
+static ColumnarVectorFilter *
+BuildScalarArrayOpExprVectorFilter(ScalarArrayOpExpr *arrayOpExpr,
+								   TupleDesc tupleDescriptor)
+{
+	if (list_length(arrayOpExpr->args) != 2)
+	{
+		return NULL;
+	}
+
+	Node *leftArg = linitial(arrayOpExpr->args);
+	Node *rightArg = lsecond(arrayOpExpr->args);
+
+	if (!IsVectorFilterColumn(leftArg, tupleDescriptor) || !IsA(rightArg, Const))
+	{
+		return NULL;
+	}
+
+	Var *column = (Var *) leftArg;
+	Const *arrayConst = (Const *) rightArg;
+	Oid elementTypeId = get_element_type(arrayConst->consttype);
+
+	if (!OidIsValid(elementTypeId))
+	{
+		return NULL;
+	}
+
+	bool columnIsLeftArg = true;
+	ColumnarVectorFilter *filter = CreateVectorFilter(column, arrayOpExpr->opno,
+													  arrayOpExpr->inputcollid,
+													  elementTypeId, columnIsLeftArg);
+	if (filter == NULL)
+	{
+		return NULL;
+	}
+
+	filter->useOr = arrayOpExpr->useOr;
+	filter->constCount = 0;
+
+	if (arrayConst->constisnull)
+	{
+		/* comparing to a NULL array never returns true */
+		filter->useOr = true;
+		return filter;
+	}
+
+	ArrayType *array = DatumGetArrayTypeP(arrayConst->constvalue);
+	int16 elementLength = 0;
+	bool elementByValue = false;
+	char elementAlign = 0;
+	Datum *elementValues = NULL;
+	bool *elementNulls = NULL;
+	int elementCount = 0;
+
+	get_typlenbyvalalign(elementTypeId, &elementLength, &elementByValue,
+						 &elementAlign);
+	deconstruct_array(array, elementTypeId, elementLength, elementByValue,
+					  elementAlign, &elementValues, &elementNulls, &elementCount);
+
+	if (elementCount == 0 && !filter->useOr)
+	{
+		/* ALL over an empty array is true even for NULL column values */
+		pfree(filter);
+		return NULL;
+	}
+
+	filter->constValues = palloc(Max(elementCount, 1) * sizeof(Datum));
+
+	for (int elementIndex = 0; elementIndex < elementCount; elementIndex++)
+	{
+		if (elementNulls[elementIndex])
+		{
+			if (!filter->useOr)
+			{
+				/* ALL with a NULL element is never true */
+				filter->useOr = true;
+				filter->constCount = 0;
+				break;
+			}
+
+			/* ANY ignores NULL elements, since they never match */
+			continue;
+		}
+
+		filter->constValues[filter->constCount++] = elementValues[elementIndex];
+	}
+
+	return filter;
+}
+
+
+/*
+ * IsVectorFilterColumn returns whether the node is a plain reference to a
+ * column of the relation that is being scanned.
+ */
+static bool
+IsVectorFilterColumn(Node *node, TupleDesc tupleDescriptor)
+{
+	if (!IsA(node, Var))
+	{
+		return false;
+	}
+
+	Var *column = (Var *) node;
+	if (column->varattno <= 0 || column->varattno > tupleDescriptor->natts)
+	{
+		return false;
+	}
+
+	Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor,
+													column->varattno - 1);
+
+	return !attributeForm->attisdropped && attributeForm->atttypid == column->vartype;
+}
+
+
+/*
+ * CreateVectorFilter creates a filter for comparing the given column to
+ * constants of the given type using the given operator. Comparisons between
+ * integers and between date/time values of the same type are done directly
+ * on the column vector, other strict operators are evaluated by calling the
+ * operator function. Returns NULL if the operator is not strict, since then
+ * NULL column values could pass the qual.
+ */
+static ColumnarVectorFilter *
+CreateVectorFilter(Var *column, Oid operatorId, Oid collationId, Oid constTypeId,
+				   bool columnIsLeftArg)
+{
+	RegProcedure operatorFunctionId = get_opcode(operatorId);
+	if (!RegProcedureIsValid(operatorFunctionId) || !func_strict(operatorFunctionId))
+	{
+		return NULL;
+	}
+
+	ColumnarVectorFilter *filter = palloc0(sizeof(ColumnarVectorFilter));
+	filter->columnIndex = column->varattno - 1;
+	filter->method = VECTOR_FILTER_FUNCTION;
+	filter->collationId = collationId;
+	filter->columnIsLeftArg = columnIsLeftArg;
+	fmgr_info(operatorFunctionId, &filter->operatorFunction);
+
+	Oid columnTypeId = column->vartype;
+	bool isIntegerComparison =
+		(columnTypeId == INT2OID || columnTypeId == INT4OID ||
+		 columnTypeId == INT8OID) &&
+		(constTypeId == INT2OID || constTypeId == INT4OID || constTypeId == INT8OID);
+	bool isDateTimeComparison =
+		(columnTypeId == DATEOID || columnTypeId == TIMESTAMPOID ||
+		 columnTypeId == TIMESTAMPTZOID) && constTypeId == columnTypeId;
+
+	if (!isIntegerComparison && !isDateTimeComparison)
+	{
+		return filter;
+	}
+
+	int16 columnLength = 0;
+	bool columnByValue = false;
+	get_typlenbyval(columnTypeId, &columnLength, &columnByValue);
+
+	int16 constLength = 0;
+	bool constByValue = false;
+	get_typlenbyval(constTypeId, &constLength, &constByValue);
+
+	/* int8 and timestamps are passed by reference on some platforms */
+	if (!columnByValue || !constByValue)
+	{
+		return filter;
+	}
+
+	Oid operatorClassId = GetDefaultOpClass(columnTypeId, BTREE_AM_OID);
+	if (!OidIsValid(operatorClassId))
+	{
+		return filter;
+	}
+
+	Oid operatorFamilyId = get_opclass_family(operatorClassId);
+	int strategy = get_op_opfamily_strategy(operatorId, operatorFamilyId);
+	if (strategy == InvalidStrategy)
+	{
+		return filter;
+	}
+
+	if (!columnIsLeftArg)
+	{
+		/* "constant < column" is the same as "column > constant" */
+		strategy = BTCommuteStrategyNumber(strategy);
+	}
+
+	filter->method = VECTOR_FILTER_INTEGER;
+	filter->columnLength = columnLength;
+	filter->strategy = strategy;
+	filter->constTypeId = constTypeId;
+
+	return filter;
+}
+
+
+/*
+ * IntegerConstValue returns the value of an integer or date/time constant of
+ * the given type as an int64.
+ */
+static int64
+IntegerConstValue(Datum constValue, Oid constTypeId)
+{
+	switch (constTypeId)
+	{
+		case INT2OID:
+		{
+			return DatumGetInt16(constValue);
+		}
+
+		case INT4OID:
+		case DATEOID:
+		{
+			return DatumGetInt32(constValue);
+		}
+
+		default:
+		{
+			return DatumGetInt64(constValue);
+		}
+	}
+}
+
+
+/*
+ * ApplyIntegerVectorFilter folds the comparisons of all values in the column
+ * vector against the constants of the filter into rowMatches. Values of rows
+ * where the column is NULL are compared as well, the caller ignores them.
+ */
+static void
+ApplyIntegerVectorFilter(ColumnarVectorFilter *filter, const Datum *values,
+						 bool *rowMatches, uint32 rowCount)
+{
+	for (int constIndex = 0; constIndex < filter->constCount; constIndex++)
+	{
+		int64 constValue = IntegerConstValue(filter->constValues[constIndex],
+											 filter->constTypeId);
+
+		switch (filter->columnLength)
+		{
+			case sizeof(int16):
+			{
+				FOLD_INTEGER_COMPARISON_BY_STRATEGY(DatumGetInt16);
+				break;
+			}
+
+			case sizeof(int32):
+			{
+				FOLD_INTEGER_COMPARISON_BY_STRATEGY(DatumGetInt32);
+				break;
+			}
+
+			default:
+			{
+				FOLD_INTEGER_COMPARISON_BY_STRATEGY(DatumGetInt64);
+				break;
+			}
+		}
+	}
+}
+
+
+/*
+ * ApplyDictionaryVectorFilter evaluates the filter on the distinct values of
+ * a dictionary or run-length encoded column chunk, and sets rowMatches of each
+ * row to the result for the value that it maps to. This calls the operator
+ * once per distinct value rather than once per row.
+ */
+static void
+ApplyDictionaryVectorFilter(ColumnarVectorFilter *filter,
+							ChunkColumnDictionary *dictionary, const bool *exists,
+							bool *rowMatches, uint32 rowCount)
+{
+	bool *entryMatches = palloc(dictionary->entryCount * sizeof(bool));
+
+	for (uint32 entryIndex = 0; entryIndex < dictionary->entryCount; entryIndex++)
+	{
+		entryMatches[entryIndex] =
+			FilterMatchesValue(filter, dictionary->entries[entryIndex]);
+	}
+
+	for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		if (exists[rowIndex])
+		{
+			rowMatches[rowIndex] = entryMatches[dictionary->entryIndexes[rowIndex]];
+		}
+	}
+
+	pfree(entryMatches);
+}
+
+
+/*
+ * FilterMatchesValue returns whether the given column value passes the filter.
+ * Strict operators can still return NULL, which we treat as false like the
+ * executor does for quals.
+ */
+static bool
+FilterMatchesValue(ColumnarVectorFilter *filter, Datum value)
+{
+	LOCAL_FCINFO(fcinfo, 2);
+
+	InitFunctionCallInfoData(*fcinfo, &filter->operatorFunction, 2,
+							 filter->collationId, NULL, NULL);
+
+	for (int constIndex = 0; constIndex < filter->constCount; constIndex++)
+	{
+		Datum constValue = filter->constValues[constIndex];
+
+		fcinfo->args[0].value = filter->columnIsLeftArg ? value : constValue;
+		fcinfo->args[0].isnull = false;
+		fcinfo->args[1].value = filter->columnIsLeftArg ? constValue : value;
+		fcinfo->args[1].isnull = false;
+		fcinfo->isnull = false;
+
+		Datum result = FunctionCallInvoke(fcinfo);
+		bool comparisonIsTrue = !fcinfo->isnull && DatumGetBool(result);
+
+		if (comparisonIsTrue == filter->useOr)
+		{
+			/* first true comparison for ANY, or first false (or NULL) for ALL */
+			return filter->useOr;
+		}
+	}
+
+	return !filter->useOr;
+}
+
+
+/*
+ * ApplyFunctionVectorFilter folds the results of calling the operator on the
+ * values in the column vector and the constants of the filter into
+ * rowMatches. Rows that are already removed or where the column is NULL are
+ * skipped.
+ */
+static void
+ApplyFunctionVectorFilter(ColumnarVectorFilter *filter, const Datum *values,
+						  const bool *exists, const bool *selectedRows,
+						  bool *rowMatches, uint32 rowCount)
+{
+	for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		if (!selectedRows[rowIndex] || !exists[rowIndex])
+		{
+			continue;
+		}
+
+		rowMatches[rowIndex] = FilterMatchesValue(filter, values[rowIndex]);
+	}
+}
@@ -34,6 +34,7 @@
 #include "pg_version_constants.h"
 
 #include "columnar/columnar.h"
+#include "columnar/columnar_bloom_filter.h"
 #include "columnar/columnar_storage.h"
 #include "columnar/columnar_version_compat.h"
 
@@ -43,6 +44,14 @@ struct ColumnarWriteState
 	FmgrInfo **comparisonFunctionArray;
 	RelFileLocator relfilelocator;
 
+	/*
+	 * Hash functions of the columns that we build bloom filters for, NULL for
+	 * the other columns, and the hashes of the values in the current chunk.
+	 */
+	FmgrInfo **bloomFilterHashFunctionArray;
+	uint64 **bloomFilterHashArray;
+	uint32 *bloomFilterHashCountArray;
+
 	/*
 	 * We can't rely on RelidByRelfilenumber for temp tables since
 	 * PG18(it was backpatched through PG13).
@@ -66,6 +75,12 @@ struct ColumnarWriteState
 	 * deallocated when memory context is reset.
 	 */
 	StringInfo compressionBuffer;
+
+	/* likewise, temporary storage for encoding the values of a chunk */
+	StringInfo encodingBuffer;
+
+	/* unused ranges of the storage that the stripes are written to, if any */
+	List *reusableDataRanges;
 };
 
 static StripeBuffers * CreateEmptyStripeBuffers(uint32 stripeMaxRowCount,
@@ -75,6 +90,7 @@ static StripeSkipList * CreateEmptyStripeSkipList(uint32 stripeMaxRowCount,
 												  uint32 chunkRowCount,
 												  uint32 columnCount);
 static void FlushStripe(ColumnarWriteState *writeState);
+static StripeSummary * BuildStripeSummary(ColumnarWriteState *writeState);
 static StringInfo SerializeBoolArray(bool *boolArray, uint32 boolArrayLength);
 static void SerializeSingleDatum(StringInfo datumBuffer, Datum datum,
 								 bool datumTypeByValue, int datumTypeLength,
@@ -87,6 +103,8 @@ static void UpdateChunkSkipNodeMinMax(ColumnChunkSkipNode *chunkSkipNode,
 									  FmgrInfo *comparisonFunction);
 static Datum DatumCopy(Datum datum, bool datumTypeByValue, int datumTypeLength);
 static StringInfo CopyStringInfo(StringInfo sourceString);
+static FmgrInfo ** BloomFilterHashFunctionArray(const char *bloomFilterColumns,
+												TupleDesc tupleDescriptor);
 
 /*
  * ColumnarBeginWrite initializes a columnar data load operation and returns a table
@@ -120,6 +138,18 @@ ColumnarBeginWrite(Relation rel,
 		comparisonFunctionArray[columnIndex] = comparisonFunction;
 	}
 
+	FmgrInfo **bloomFilterHashFunctionArray =
+		BloomFilterHashFunctionArray(options.bloomFilterColumns, tupleDescriptor);
+	uint64 **bloomFilterHashArray = palloc0(columnCount * sizeof(uint64 *));
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		if (bloomFilterHashFunctionArray[columnIndex] != NULL)
+		{
+			bloomFilterHashArray[columnIndex] =
+				palloc(options.chunkRowCount * sizeof(uint64));
+		}
+	}
+
 	/*
 	 * We allocate all stripe specific data in the stripeWriteContext, and
 	 * reset this memory context once we have flushed the stripe to the file.
@@ -141,12 +171,17 @@ ColumnarBeginWrite(Relation rel,
 	writeState->options = options;
 	writeState->tupleDescriptor = CreateTupleDescCopy(tupleDescriptor);
 	writeState->comparisonFunctionArray = comparisonFunctionArray;
+	writeState->bloomFilterHashFunctionArray = bloomFilterHashFunctionArray;
+	writeState->bloomFilterHashArray = bloomFilterHashArray;
+	writeState->bloomFilterHashCountArray = palloc0(columnCount * sizeof(uint32));
 	writeState->stripeBuffers = NULL;
 	writeState->stripeSkipList = NULL;
 	writeState->emptyStripeReservation = NULL;
 	writeState->stripeWriteContext = stripeWriteContext;
 	writeState->chunkData = chunkData;
 	writeState->compressionBuffer = NULL;
+	writeState->encodingBuffer = NULL;
+	writeState->reusableDataRanges = NIL;
 	writeState->perTupleContext = AllocSetContextCreate(CurrentMemoryContext,
 														"Columnar per tuple context",
 														ALLOCSET_DEFAULT_SIZES);
@@ -186,6 +221,7 @@ ColumnarWriteRow(ColumnarWriteState *writeState, Datum *columnValues, bool *colu
 		writeState->stripeBuffers = stripeBuffers;
 		writeState->stripeSkipList = stripeSkipList;
 		writeState->compressionBuffer = makeStringInfo();
+		writeState->encodingBuffer = makeStringInfo();
 
 		Oid relationId = ColumnarRelationId(writeState->temp_relid,
 											writeState->relfilelocator);
@@ -239,6 +275,16 @@ ColumnarWriteRow(ColumnarWriteState *writeState, Datum *columnValues, bool *colu
 			UpdateChunkSkipNodeMinMax(chunkSkipNode, columnValues[columnIndex],
 									  columnTypeByValue, columnTypeLength,
 									  columnCollation, comparisonFunction);
+
+			FmgrInfo *bloomFilterHashFunction =
+				writeState->bloomFilterHashFunctionArray[columnIndex];
+			if (bloomFilterHashFunction != NULL)
+			{
+				uint32 hashIndex = writeState->bloomFilterHashCountArray[columnIndex]++;
+				writeState->bloomFilterHashArray[columnIndex][hashIndex] =
+					BloomFilterHashDatum(bloomFilterHashFunction, columnCollation,
+										 columnValues[columnIndex]);
+			}
 		}
 
 		chunkSkipNode->rowCount++;
@@ -277,6 +323,19 @@ ColumnarEndWrite(ColumnarWriteState *writeState)
 
 	MemoryContextDelete(writeState->stripeWriteContext);
 	pfree(writeState->comparisonFunctionArray);
+
+	uint32 columnCount = writeState->tupleDescriptor->natts;
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		if (writeState->bloomFilterHashArray[columnIndex] != NULL)
+		{
+			pfree(writeState->bloomFilterHashArray[columnIndex]);
+		}
+	}
+
+	pfree(writeState->bloomFilterHashFunctionArray);
+	pfree(writeState->bloomFilterHashArray);
+	pfree(writeState->bloomFilterHashCountArray);
 	FreeChunkData(writeState->chunkData);
 	pfree(writeState);
 }
@@ -314,6 +373,21 @@ ColumnarWritePerTupleContext(ColumnarWriteState *state)
 }
 
 
+/*
+ * ColumnarWriteReuseDataRanges makes the write operation write the stripes
+ * into the given unused ranges of the storage (see ReusableDataRanges) when
+ * they fit, instead of extending the relation.
+ *
+ * The caller must make sure that no one else writes into these ranges, which
+ * is the case when it holds a ShareUpdateExclusiveLock on the relation.
+ */
+void
+ColumnarWriteReuseDataRanges(ColumnarWriteState *state, List *rangeList)
+{
+	state->reusableDataRanges = rangeList;
+}
+
+
 /*
  * CreateEmptyStripeBuffers allocates an empty StripeBuffers structure with the given
  * column count.
@@ -338,6 +412,7 @@ CreateEmptyStripeBuffers(uint32 stripeMaxRowCount, uint32 chunkRowCount,
 			chunkBuffersArray[chunkIndex]->existsBuffer = NULL;
 			chunkBuffersArray[chunkIndex]->valueBuffer = NULL;
 			chunkBuffersArray[chunkIndex]->valueCompressionType = COMPRESSION_NONE;
+			chunkBuffersArray[chunkIndex]->valueEncodingType = ENCODING_NONE;
 		}
 
 		columnBuffersArray[columnIndex] = palloc0(sizeof(ColumnBuffers));
@@ -452,6 +527,7 @@ FlushStripe(ColumnarWriteState *writeState)
 			chunkSkipNode->valueCompressionType = valueCompressionType;
 			chunkSkipNode->valueCompressionLevel = writeState->options.compressionLevel;
 			chunkSkipNode->decompressedValueSize = chunkBuffers->decompressedValueSize;
+			chunkSkipNode->valueEncodingType = chunkBuffers->valueEncodingType;
 
 			stripeSize += valueBufferSize;
 		}
@@ -459,7 +535,8 @@ FlushStripe(ColumnarWriteState *writeState)
 
 	StripeMetadata *stripeMetadata =
 		CompleteStripeReservation(relation, writeState->emptyStripeReservation->stripeId,
-								  stripeSize, stripeRowCount, chunkCount);
+								  stripeSize, stripeRowCount, chunkCount,
+								  writeState->reusableDataRanges);
 
 	uint64 currentFileOffset = stripeMetadata->fileOffset;
 
@@ -509,6 +586,10 @@ FlushStripe(ColumnarWriteState *writeState)
 					   writeState->relfilelocator,
 					   stripeMetadata->id,
 					   stripeSkipList, tupleDescriptor);
+	SaveStripeSummary(writeState->temp_relid,
+					  writeState->relfilelocator,
+					  stripeMetadata->id,
+					  BuildStripeSummary(writeState), tupleDescriptor);
 
 	writeState->chunkGroupRowCounts = NIL;
 
@@ -516,6 +597,75 @@ FlushStripe(ColumnarWriteState *writeState)
 }
 
 
+/*
+ * BuildStripeSummary computes the minimum and maximum values of each column in
+ * the current stripe from the min/max values of its chunks.
+ */
+static StripeSummary *
+BuildStripeSummary(ColumnarWriteState *writeState)
+{
+	StripeSkipList *stripeSkipList = writeState->stripeSkipList;
+	TupleDesc tupleDescriptor = writeState->tupleDescriptor;
+	uint32 columnCount = tupleDescriptor->natts;
+
+	StripeSummary *stripeSummary = palloc0(sizeof(StripeSummary));
+	stripeSummary->columnCount = columnCount;
+	stripeSummary->hasMinMax = palloc0(columnCount * sizeof(bool));
+	stripeSummary->minimumValues = palloc0(columnCount * sizeof(Datum));
+	stripeSummary->maximumValues = palloc0(columnCount * sizeof(Datum));
+
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		FmgrInfo *comparisonFunction = writeState->comparisonFunctionArray[columnIndex];
+		Oid columnCollation = TupleDescAttr(tupleDescriptor, columnIndex)->attcollation;
+		ColumnChunkSkipNode *chunkSkipNodeArray =
+			stripeSkipList->chunkSkipNodeArray[columnIndex];
+
+		if (comparisonFunction == NULL)
+		{
+			continue;
+		}
+
+		for (uint32 chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+		{
+			ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
+			if (!chunkSkipNode->hasMinMax)
+			{
+				continue;
+			}
+
+			if (!stripeSummary->hasMinMax[columnIndex])
+			{
+				stripeSummary->minimumValues[columnIndex] = chunkSkipNode->minimumValue;
+				stripeSummary->maximumValues[columnIndex] = chunkSkipNode->maximumValue;
+				stripeSummary->hasMinMax[columnIndex] = true;
+				continue;
+			}
+
+			Datum minimumComparisonDatum =
+				FunctionCall2Coll(comparisonFunction, columnCollation,
+								  chunkSkipNode->minimumValue,
+								  stripeSummary->minimumValues[columnIndex]);
+			if (DatumGetInt32(minimumComparisonDatum) < 0)
+			{
+				stripeSummary->minimumValues[columnIndex] = chunkSkipNode->minimumValue;
+			}
+
+			Datum maximumComparisonDatum =
+				FunctionCall2Coll(comparisonFunction, columnCollation,
+								  chunkSkipNode->maximumValue,
+								  stripeSummary->maximumValues[columnIndex]);
+			if (DatumGetInt32(maximumComparisonDatum) > 0)
+			{
+				stripeSummary->maximumValues[columnIndex] = chunkSkipNode->maximumValue;
+			}
+		}
+	}
+
+	return stripeSummary;
+}
+
+
 /*
  * SerializeBoolArray serializes the given boolean array and returns the result
  * as a StringInfo. This function packs every 8 boolean values into one byte.
@@ -586,8 +736,8 @@ SerializeSingleDatum(StringInfo datumBuffer, Datum datum, bool datumTypeByValue,
 
 
 /*
- * SerializeChunkData serializes and compresses chunk data at given chunk index with given
- * compression type for every column.
+ * SerializeChunkData serializes, encodes and compresses chunk data at given chunk
+ * index with given compression type for every column.
  */
 static void
 SerializeChunkData(ColumnarWriteState *writeState, uint32 chunkIndex, uint32 rowCount)
@@ -599,6 +749,7 @@ SerializeChunkData(ColumnarWriteState *writeState, uint32 chunkIndex, uint32 row
 	int compressionLevel = writeState->options.compressionLevel;
 	const uint32 columnCount = stripeBuffers->columnCount;
 	StringInfo compressionBuffer = writeState->compressionBuffer;
+	StringInfo encodingBuffer = writeState->encodingBuffer;
 
 	writeState->chunkGroupRowCounts =
 		lappend_int(writeState->chunkGroupRowCounts, rowCount);
@@ -613,6 +764,22 @@ SerializeChunkData(ColumnarWriteState *writeState, uint32 chunkIndex, uint32 row
 			SerializeBoolArray(chunkData->existsArray[columnIndex], rowCount);
 	}
 
+	/* build bloom filters from the hashes of the chunk's values */
+	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		if (writeState->bloomFilterHashFunctionArray[columnIndex] == NULL)
+		{
+			continue;
+		}
+
+		ColumnChunkSkipNode *chunkSkipNode =
+			&writeState->stripeSkipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+		chunkSkipNode->bloomFilter =
+			BuildBloomFilter(writeState->bloomFilterHashArray[columnIndex],
+							 writeState->bloomFilterHashCountArray[columnIndex]);
+		writeState->bloomFilterHashCountArray[columnIndex] = 0;
+	}
+
 	/*
 	 * check and compress value buffers, if a value buffer is not compressable
 	 * then keep it as uncompressed, store compression information.
@@ -622,14 +789,37 @@ SerializeChunkData(ColumnarWriteState *writeState, uint32 chunkIndex, uint32 row
 		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
 		ColumnChunkBuffers *chunkBuffers = columnBuffers->chunkBuffersArray[chunkIndex];
 		CompressionType actualCompressionType = COMPRESSION_NONE;
+		EncodingType encodingType = ENCODING_NONE;
 
 		StringInfo serializedValueBuffer = chunkData->valueBufferArray[columnIndex];
 
 		Assert(requestedCompressionType >= 0 &&
 			   requestedCompressionType < COMPRESSION_COUNT);
 
-		chunkBuffers->decompressedValueSize =
-			chunkData->valueBufferArray[columnIndex]->len;
+		/*
+		 * Encode the values if that makes them smaller. The encoded values
+		 * usually compress well too, so we compress them as before.
+		 */
+		if (columnar_enable_column_encodings)
+		{
+			uint32 valueCount = 0;
+			for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+			{
+				valueCount += chunkData->existsArray[columnIndex][rowIndex];
+			}
+
+			Form_pg_attribute attributeForm =
+				TupleDescAttr(writeState->tupleDescriptor, columnIndex);
+			encodingType = EncodeValueBuffer(serializedValueBuffer, valueCount,
+											 attributeForm, encodingBuffer);
+			if (encodingType != ENCODING_NONE)
+			{
+				serializedValueBuffer = encodingBuffer;
+			}
+		}
+
+		chunkBuffers->valueEncodingType = encodingType;
+		chunkBuffers->decompressedValueSize = serializedValueBuffer->len;
 
 		/*
 		 * if serializedValueBuffer is be compressed, update serializedValueBuffer
@@ -777,3 +967,45 @@ ContainsPendingWrites(ColumnarWriteState *state)
 {
 	return state->stripeBuffers != NULL && state->stripeBuffers->rowCount != 0;
 }
+
+
+/*
+ * BloomFilterHashFunctionArray returns the hash functions to build bloom
+ * filters with for each of the columns in the given value of the
+ * bloom_filter_columns option, and NULL for the other columns. Columns that
+ * no longer exist or whose type can no longer be hashed are skipped.
+ */
+static FmgrInfo **
+BloomFilterHashFunctionArray(const char *bloomFilterColumns, TupleDesc tupleDescriptor)
+{
+	uint32 columnCount = tupleDescriptor->natts;
+	FmgrInfo **hashFunctionArray = palloc0(columnCount * sizeof(FmgrInfo *));
+
+	if (bloomFilterColumns == NULL)
+	{
+		return hashFunctionArray;
+	}
+
+	List *columnNameList = ParseBloomFilterColumnList(bloomFilterColumns);
+
+	ListCell *columnNameCell = NULL;
+	foreach(columnNameCell, columnNameList)
+	{
+		char *columnName = (char *) lfirst(columnNameCell);
+
+		for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor,
+															columnIndex);
+			if (!attributeForm->attisdropped &&
+				strcmp(NameStr(attributeForm->attname), columnName) == 0)
+			{
+				hashFunctionArray[columnIndex] =
+					BloomFilterHashFunctionOrNull(attributeForm->atttypid);
+				break;
+			}
+		}
+	}
+
+	return hashFunctionArray;
+}
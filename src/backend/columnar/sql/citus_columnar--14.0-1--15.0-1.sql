@@ -1,2 +1,86 @@
 -- citus_columnar--14.0-1--15.0-1
 -- bump version to 15.0-1
+
+CREATE TABLE columnar_internal.stripe_summary (
+    storage_id bigint NOT NULL,
+    stripe_num bigint NOT NULL,
+    attr_num int NOT NULL,
+    minimum_value bytea NOT NULL,
+    maximum_value bytea NOT NULL,
+    PRIMARY KEY (storage_id, stripe_num, attr_num)
+) WITH (user_catalog_table = true);
+
+COMMENT ON TABLE columnar_internal.stripe_summary IS 'Columnar per stripe minimum and maximum values of columns';
+
+CREATE VIEW columnar.stripe_summary WITH (security_barrier) AS
+  SELECT relation, storage.storage_id, stripe_num, attr_num,
+         minimum_value, maximum_value
+    FROM columnar_internal.stripe_summary stripe_summary, columnar.storage storage
+    WHERE stripe_summary.storage_id = storage.storage_id;
+COMMENT ON VIEW columnar.stripe_summary
+  IS 'Columnar stripe summaries for tables on which the current user has ownership privileges.';
+GRANT SELECT ON columnar.stripe_summary TO PUBLIC;
+
+CREATE TABLE columnar_internal.row_mask (
+    storage_id bigint NOT NULL,
+    stripe_num bigint NOT NULL,
+    deleted_row_count bigint NOT NULL,
+    mask bytea NOT NULL,
+    PRIMARY KEY (storage_id, stripe_num)
+) WITH (user_catalog_table = true);
+
+COMMENT ON TABLE columnar_internal.row_mask IS 'Columnar per stripe bitmaps of deleted rows';
+
+CREATE VIEW columnar.row_mask WITH (security_barrier) AS
+  SELECT relation, storage.storage_id, stripe_num, deleted_row_count
+    FROM columnar_internal.row_mask row_mask, columnar.storage storage
+    WHERE row_mask.storage_id = storage.storage_id;
+COMMENT ON VIEW columnar.row_mask
+  IS 'Columnar deleted row counts for tables on which the current user has ownership privileges.';
+GRANT SELECT ON columnar.row_mask TO PUBLIC;
+
+ALTER TABLE columnar_internal.chunk ADD COLUMN value_encoding_type int NOT NULL DEFAULT 0;
+
+CREATE OR REPLACE VIEW columnar.chunk WITH (security_barrier) AS
+  SELECT relation, storage.storage_id, stripe_num, attr_num, chunk_group_num,
+         minimum_value, maximum_value, value_stream_offset, value_stream_length,
+         exists_stream_offset, exists_stream_length, value_compression_type,
+         value_compression_level, value_decompressed_length, value_count,
+         value_encoding_type
+    FROM columnar_internal.chunk chunk, columnar.storage storage
+    WHERE chunk.storage_id = storage.storage_id;
+
+ALTER TABLE columnar_internal.chunk ADD COLUMN bloom_filter bytea;
+ALTER TABLE columnar_internal.options ADD COLUMN bloom_filter_columns int2[];
+
+CREATE OR REPLACE VIEW columnar.options WITH (security_barrier) AS
+  SELECT regclass AS relation, chunk_group_row_limit,
+         stripe_row_limit, compression, compression_level,
+         (SELECT string_agg(quote_ident(a.attname), ', ' ORDER BY k.ord)
+            FROM unnest(o.bloom_filter_columns) WITH ORDINALITY k(attnum, ord)
+            JOIN pg_attribute a ON a.attrelid = o.regclass AND a.attnum = k.attnum
+            WHERE NOT a.attisdropped) AS bloom_filter_columns
+    FROM columnar_internal.options o, pg_class c
+    WHERE o.regclass = c.oid
+      AND pg_has_role(c.relowner, 'USAGE');
+
+CREATE FUNCTION columnar.compact_stripes(table_name regclass) RETURNS integer
+    LANGUAGE C STRICT
+    AS 'citus_columnar', $$columnar_compact_stripes$$;
+COMMENT ON FUNCTION columnar.compact_stripes(regclass)
+  IS 'merges the small stripes of a columnar table into full stripes';
+
+CREATE FUNCTION columnar.chunk_cache_stats(
+    OUT hits bigint,
+    OUT misses bigint,
+    OUT evictions bigint,
+    OUT cached_chunks bigint,
+    OUT cached_bytes bigint)
+    LANGUAGE C STRICT
+    AS 'citus_columnar', $$columnar_chunk_cache_stats$$;
+COMMENT ON FUNCTION columnar.chunk_cache_stats()
+  IS 'returns the statistics of the shared cache of decompressed columnar chunks';
+
+#include "udfs/columnar_ensure_am_depends_catalog/15.0-1.sql"
+
+SELECT columnar_internal.columnar_ensure_am_depends_catalog();
@@ -1,2 +1,70 @@
 -- citus_columnar--15.0-1--14.0-1
 -- downgrade version to 14.0-1
+
+DO $$
+BEGIN
+    IF EXISTS (SELECT 1 FROM columnar_internal.chunk WHERE value_encoding_type <> 0) THEN
+        RAISE EXCEPTION 'cannot downgrade citus_columnar while there are encoded column chunks'
+        USING HINT = 'Rewrite the columnar tables with columnar.enable_column_encodings '
+                     'disabled, e.g. using VACUUM FULL, and try again.';
+    END IF;
+END;
+$$;
+
+DO $$
+BEGIN
+    IF EXISTS (SELECT 1 FROM columnar_internal.row_mask WHERE deleted_row_count > 0) THEN
+        RAISE EXCEPTION 'cannot downgrade citus_columnar while there are deleted rows in columnar tables'
+        USING HINT = 'Rewrite the columnar tables, e.g. using VACUUM FULL, and try again.';
+    END IF;
+END;
+$$;
+
+DROP FUNCTION columnar.compact_stripes(regclass);
+DROP FUNCTION columnar.chunk_cache_stats();
+
+DELETE FROM pg_depend
+WHERE classid = 'pg_am'::regclass::oid
+    AND objid IN (select oid from pg_am where amname = 'columnar')
+    AND objsubid = 0
+    AND refclassid = 'pg_class'::regclass::oid
+    AND refobjid IN ('columnar_internal.stripe_summary'::regclass::oid,
+                     'columnar_internal.row_mask'::regclass::oid)
+    AND refobjsubid = 0
+    AND deptype = 'n';
+
+DROP VIEW columnar.chunk;
+CREATE VIEW columnar.chunk WITH (security_barrier) AS
+  SELECT relation, storage.storage_id, stripe_num, attr_num, chunk_group_num,
+         minimum_value, maximum_value, value_stream_offset, value_stream_length,
+         exists_stream_offset, exists_stream_length, value_compression_type,
+         value_compression_level, value_decompressed_length, value_count
+    FROM columnar_internal.chunk chunk, columnar.storage storage
+    WHERE chunk.storage_id = storage.storage_id;
+COMMENT ON VIEW columnar.chunk
+  IS 'Columnar chunk information for tables on which the current user has ownership privileges.';
+GRANT SELECT ON columnar.chunk TO PUBLIC;
+
+ALTER TABLE columnar_internal.chunk DROP COLUMN value_encoding_type;
+ALTER TABLE columnar_internal.chunk DROP COLUMN bloom_filter;
+
+DROP VIEW columnar.options;
+CREATE VIEW columnar.options WITH (security_barrier) AS
+  SELECT regclass AS relation, chunk_group_row_limit,
+         stripe_row_limit, compression, compression_level
+    FROM columnar_internal.options o, pg_class c
+    WHERE o.regclass = c.oid
+      AND pg_has_role(c.relowner, 'USAGE');
+COMMENT ON VIEW columnar.options
+  IS 'Columnar options for tables on which the current user has ownership privileges.';
+GRANT SELECT ON columnar.options TO PUBLIC;
+
+ALTER TABLE columnar_internal.options DROP COLUMN bloom_filter_columns;
+
+DROP VIEW columnar.row_mask;
+DROP TABLE columnar_internal.row_mask;
+
+DROP VIEW columnar.stripe_summary;
+DROP TABLE columnar_internal.stripe_summary;
+
+#include "../udfs/columnar_ensure_am_depends_catalog/11.2-1.sql"
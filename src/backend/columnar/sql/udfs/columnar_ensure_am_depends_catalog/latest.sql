@@ -15,8 +15,10 @@ BEGIN
         AND relname IN ('chunk',
                         'chunk_group',
                         'options',
+                        'row_mask',
                         'storageid_seq',
-                        'stripe')
+                        'stripe',
+                        'stripe_summary')
   )
   SELECT -- Define a dependency edge from "columnar table access method" ..
          'pg_am'::regclass::oid as classid,
@@ -43,6 +43,7 @@
 
 #include "columnar/columnar.h"
 #include "columnar/columnar_customscan.h"
+#include "columnar/columnar_row_mask.h"
 #include "columnar/columnar_tableam.h"
 #include "columnar/columnar_version_compat.h"
 
@@ -70,6 +71,51 @@ typedef struct SubXidWriteState
 } SubXidWriteState;
 
 
+/*
+ * StripeDeleteState keeps the rows of a stripe that were deleted in a
+ * subtransaction but are not flushed to the row mask of the stripe yet.
+ */
+typedef struct StripeDeleteState
+{
+	uint64 stripeId;
+	uint64 firstRowNumber;
+	uint64 rowCount;
+
+	/*
+	 * Rows whose deletion was committed or flushed by us before we started
+	 * deleting from the stripe in this subtransaction, NULL if there are none.
+	 * Since deletes on a relation are serialized, this cannot change until
+	 * we flush our deletes.
+	 */
+	bytea *flushedDeletedRows;
+
+	bytea *pendingDeletedRows;
+	uint64 pendingDeletedRowCount;
+} StripeDeleteState;
+
+
+/*
+ * Each member of the deleteStateStack in WriteStateMapEntry. This means that
+ * we deleted some rows in the subtransaction subXid, and those deletes are
+ * kept in stripeDeleteStateList until they are flushed.
+ */
+typedef struct SubXidDeleteState
+{
+	SubTransactionId subXid;
+
+	/* we might not have the relation at hand when flushing the deletes */
+	Oid temp_relid;
+	RelFileLocator relfilelocator;
+
+	List *stripeDeleteStateList;
+
+	/* stripe of the last deleted row, deletes usually come in row order */
+	StripeDeleteState *lastStripeDeleteState;
+
+	struct SubXidDeleteState *next;
+} SubXidDeleteState;
+
+
 /*
  * An entry in WriteStateMap.
  */
@@ -93,6 +139,9 @@ typedef struct WriteStateMapEntry
 	 * the stack, and forward writes to that.
 	 */
 	SubXidWriteState *writeStateStack;
+
+	/* similar to writeStateStack, but for the deleted rows */
+	SubXidDeleteState *deleteStateStack;
 } WriteStateMapEntry;
 
 
@@ -110,10 +159,21 @@ CleanupWriteStateMap(void *arg)
 }
 
 
-ColumnarWriteState *
-columnar_init_write_state(Relation relation, TupleDesc tupdesc,
-						  Oid tupSlotRelationId,
-						  SubTransactionId currentSubXid)
+static WriteStateMapEntry * FindOrCreateWriteStateMapEntry(RelFileNumber
+															relfilenumber);
+static StripeDeleteState * FindStripeDeleteState(SubXidDeleteState *deleteState,
+												 uint64 rowNumber);
+static bool ContainsPendingDeletes(SubXidDeleteState *deleteState);
+static void FlushPendingDeletes(SubXidDeleteState *deleteState);
+
+
+/*
+ * FindOrCreateWriteStateMapEntry returns the WriteStateMap entry for the
+ * given relfilenode, creating the entry, and the hash table itself if this is
+ * the first call in current transaction.
+ */
+static WriteStateMapEntry *
+FindOrCreateWriteStateMapEntry(RelFileNumber relfilenumber)
 {
 	bool found;
 
@@ -145,15 +205,27 @@ columnar_init_write_state(Relation relation, TupleDesc tupdesc,
 		MemoryContextRegisterResetCallback(WriteStateContext, &cleanupCallback);
 	}
 
-	WriteStateMapEntry *hashEntry = hash_search(WriteStateMap,
-												&(relation->rd_locator.relNumber),
+	WriteStateMapEntry *hashEntry = hash_search(WriteStateMap, &relfilenumber,
 												HASH_ENTER, &found);
 	if (!found)
 	{
 		hashEntry->writeStateStack = NULL;
+		hashEntry->deleteStateStack = NULL;
 		hashEntry->dropped = false;
 	}
 
+	return hashEntry;
+}
+
+
+ColumnarWriteState *
+columnar_init_write_state(Relation relation, TupleDesc tupdesc,
+						  Oid tupSlotRelationId,
+						  SubTransactionId currentSubXid)
+{
+	WriteStateMapEntry *hashEntry =
+		FindOrCreateWriteStateMapEntry(relation->rd_locator.relNumber);
+
 	Assert(!hashEntry->dropped);
 
 	/*
@@ -227,6 +299,15 @@ FlushWriteStateForRelfilenumber(RelFileNumber relfilenumber,
 			ColumnarFlushPendingWrites(stackEntry->writeState);
 		}
 	}
+
+	if (entry && entry->deleteStateStack != NULL)
+	{
+		SubXidDeleteState *deleteStackEntry = entry->deleteStateStack;
+		if (deleteStackEntry->subXid == currentSubXid)
+		{
+			FlushPendingDeletes(deleteStackEntry);
+		}
+	}
 }
 
 
@@ -252,7 +333,7 @@ PopWriteStateForAllRels(SubTransactionId currentSubXid, SubTransactionId parentS
 	hash_seq_init(&status, WriteStateMap);
 	while ((entry = hash_seq_search(&status)) != 0)
 	{
-		if (entry->writeStateStack == NULL)
+		if (entry->writeStateStack == NULL && entry->deleteStateStack == NULL)
 		{
 			continue;
 		}
@@ -284,7 +365,7 @@ PopWriteStateForAllRels(SubTransactionId currentSubXid, SubTransactionId parentS
 		else
 		{
 			SubXidWriteState *stackHead = entry->writeStateStack;
-			if (stackHead->subXid == currentSubXid)
+			if (stackHead != NULL && stackHead->subXid == currentSubXid)
 			{
 				if (commit)
 				{
@@ -293,6 +374,17 @@ PopWriteStateForAllRels(SubTransactionId currentSubXid, SubTransactionId parentS
 
 				entry->writeStateStack = stackHead->next;
 			}
+
+			SubXidDeleteState *deleteStackHead = entry->deleteStateStack;
+			if (deleteStackHead != NULL && deleteStackHead->subXid == currentSubXid)
+			{
+				if (commit)
+				{
+					FlushPendingDeletes(deleteStackHead);
+				}
+
+				entry->deleteStateStack = deleteStackHead->next;
+			}
 		}
 	}
 }
@@ -385,10 +477,284 @@ PendingWritesInUpperTransactions(RelFileNumber relfilenumber,
 		}
 	}
 
+	if (entry)
+	{
+		for (SubXidDeleteState *deleteStackEntry = entry->deleteStateStack;
+			 deleteStackEntry != NULL;
+			 deleteStackEntry = deleteStackEntry->next)
+		{
+			if (deleteStackEntry->subXid != currentSubXid &&
+				ContainsPendingDeletes(deleteStackEntry))
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * Returns true if there are any pending writes in the given subtransaction.
+ */
+bool
+PendingWritesInSubTransaction(RelFileNumber relfilenumber, SubTransactionId subXid)
+{
+	if (WriteStateMap == NULL)
+	{
+		return false;
+	}
+
+	WriteStateMapEntry *entry = hash_search(WriteStateMap, &relfilenumber, HASH_FIND,
+											NULL);
+
+	if (entry && entry->writeStateStack != NULL)
+	{
+		SubXidWriteState *stackEntry = entry->writeStateStack;
+
+		while (stackEntry != NULL)
+		{
+			if (stackEntry->subXid == subXid &&
+				ContainsPendingWrites(stackEntry->writeState))
+			{
+				return true;
+			}
+
+			stackEntry = stackEntry->next;
+		}
+	}
+
+	if (entry)
+	{
+		for (SubXidDeleteState *deleteStackEntry = entry->deleteStateStack;
+			 deleteStackEntry != NULL;
+			 deleteStackEntry = deleteStackEntry->next)
+		{
+			if (deleteStackEntry->subXid == subXid &&
+				ContainsPendingDeletes(deleteStackEntry))
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * ColumnarMarkRowDeleted records that the row with given row number is
+ * deleted by the given subtransaction. The delete is kept in memory until
+ * it is flushed to the row mask of the stripe, similar to the inserts.
+ *
+ * Callers are expected to hold a lock that serializes the deletes on the
+ * relation, so that no other transaction can change the row masks of the
+ * relation in the meantime.
+ */
+ColumnarDeleteResult
+ColumnarMarkRowDeleted(Relation relation, uint64 rowNumber,
+					   SubTransactionId currentSubXid)
+{
+	WriteStateMapEntry *hashEntry =
+		FindOrCreateWriteStateMapEntry(relation->rd_locator.relNumber);
+
+	Assert(!hashEntry->dropped);
+
+	for (SubXidDeleteState *deleteStackEntry = hashEntry->deleteStateStack;
+		 deleteStackEntry != NULL;
+		 deleteStackEntry = deleteStackEntry->next)
+	{
+		StripeDeleteState *stripeDeleteState =
+			FindStripeDeleteState(deleteStackEntry, rowNumber);
+		if (stripeDeleteState != NULL &&
+			RowMaskContainsRow(stripeDeleteState->pendingDeletedRows,
+							   rowNumber - stripeDeleteState->firstRowNumber))
+		{
+			return COLUMNAR_DELETE_SELF_DELETED;
+		}
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(WriteStateContext);
+
+	SubXidDeleteState *deleteState = hashEntry->deleteStateStack;
+	if (deleteState == NULL || deleteState->subXid != currentSubXid)
+	{
+		deleteState = palloc0(sizeof(SubXidDeleteState));
+		deleteState->subXid = currentSubXid;
+		deleteState->temp_relid = RelationPrecomputeOid(relation);
+		deleteState->relfilelocator = relation->rd_locator;
+		deleteState->stripeDeleteStateList = NIL;
+		deleteState->next = hashEntry->deleteStateStack;
+		hashEntry->deleteStateStack = deleteState;
+	}
+
+	StripeDeleteState *stripeDeleteState = FindStripeDeleteState(deleteState,
+																  rowNumber);
+	if (stripeDeleteState == NULL)
+	{
+		/* look at the latest version of the stripe metadata */
+		StripeMetadata *stripeMetadata = FindStripeByRowNumber(relation, rowNumber,
+															   SnapshotSelf);
+		if (stripeMetadata == NULL ||
+			StripeWriteState(stripeMetadata) != STRIPE_WRITE_FLUSHED)
+		{
+			/* stripe was removed by a concurrent VACUUM */
+			MemoryContextSwitchTo(oldContext);
+			return COLUMNAR_DELETE_ALREADY_DELETED;
+		}
+
+		stripeDeleteState = palloc0(sizeof(StripeDeleteState));
+		stripeDeleteState->stripeId = stripeMetadata->id;
+		stripeDeleteState->firstRowNumber = stripeMetadata->firstRowNumber;
+		stripeDeleteState->rowCount = stripeMetadata->rowCount;
+		stripeDeleteState->flushedDeletedRows =
+			ReadStripeRowMask(relation, stripeMetadata->id, SnapshotSelf);
+		stripeDeleteState->pendingDeletedRows = CreateRowMask(stripeMetadata->rowCount);
+		stripeDeleteState->pendingDeletedRowCount = 0;
+
+		deleteState->stripeDeleteStateList =
+			lappend(deleteState->stripeDeleteStateList, stripeDeleteState);
+
+		pfree(stripeMetadata);
+	}
+
+	deleteState->lastStripeDeleteState = stripeDeleteState;
+
+	MemoryContextSwitchTo(oldContext);
+
+	uint64 rowOffset = rowNumber - stripeDeleteState->firstRowNumber;
+	if (RowMaskContainsRow(stripeDeleteState->flushedDeletedRows, rowOffset))
+	{
+		return COLUMNAR_DELETE_ALREADY_DELETED;
+	}
+
+	RowMaskSetRow(stripeDeleteState->pendingDeletedRows, rowOffset);
+	stripeDeleteState->pendingDeletedRowCount++;
+
+	return COLUMNAR_DELETE_OK;
+}
+
+
+/*
+ * PendingDeleteInTransaction returns true if the row with given row number
+ * was deleted by any subtransaction of the current transaction, and the
+ * delete is not flushed yet.
+ */
+bool
+PendingDeleteInTransaction(RelFileNumber relfilenumber, uint64 rowNumber)
+{
+	if (WriteStateMap == NULL)
+	{
+		return false;
+	}
+
+	WriteStateMapEntry *entry = hash_search(WriteStateMap, &relfilenumber, HASH_FIND,
+											NULL);
+	if (entry == NULL)
+	{
+		return false;
+	}
+
+	for (SubXidDeleteState *deleteStackEntry = entry->deleteStateStack;
+		 deleteStackEntry != NULL;
+		 deleteStackEntry = deleteStackEntry->next)
+	{
+		StripeDeleteState *stripeDeleteState =
+			FindStripeDeleteState(deleteStackEntry, rowNumber);
+		if (stripeDeleteState != NULL &&
+			RowMaskContainsRow(stripeDeleteState->pendingDeletedRows,
+							   rowNumber - stripeDeleteState->firstRowNumber))
+		{
+			return true;
+		}
+	}
+
 	return false;
 }
 
 
+/*
+ * FindStripeDeleteState returns the delete state of the stripe that contains
+ * the row with given row number in the given subtransaction's deletes, or
+ * NULL if the subtransaction didn't delete from that stripe.
+ */
+static StripeDeleteState *
+FindStripeDeleteState(SubXidDeleteState *deleteState, uint64 rowNumber)
+{
+	StripeDeleteState *stripeDeleteState = deleteState->lastStripeDeleteState;
+	if (stripeDeleteState != NULL &&
+		rowNumber >= stripeDeleteState->firstRowNumber &&
+		rowNumber < stripeDeleteState->firstRowNumber + stripeDeleteState->rowCount)
+	{
+		return stripeDeleteState;
+	}
+
+	foreach_declared_ptr(stripeDeleteState, deleteState->stripeDeleteStateList)
+	{
+		if (rowNumber >= stripeDeleteState->firstRowNumber &&
+			rowNumber < stripeDeleteState->firstRowNumber + stripeDeleteState->rowCount)
+		{
+			return stripeDeleteState;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * ContainsPendingDeletes returns true if the given subtransaction deleted
+ * rows that are not flushed yet.
+ */
+static bool
+ContainsPendingDeletes(SubXidDeleteState *deleteState)
+{
+	StripeDeleteState *stripeDeleteState = NULL;
+	foreach_declared_ptr(stripeDeleteState, deleteState->stripeDeleteStateList)
+	{
+		if (stripeDeleteState->pendingDeletedRowCount > 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * FlushPendingDeletes saves the rows deleted by the given subtransaction into
+ * the row masks of their stripes.
+ */
+static void
+FlushPendingDeletes(SubXidDeleteState *deleteState)
+{
+	StripeDeleteState *stripeDeleteState = NULL;
+	foreach_declared_ptr(stripeDeleteState, deleteState->stripeDeleteStateList)
+	{
+		if (stripeDeleteState->pendingDeletedRowCount > 0)
+		{
+			SaveStripeRowMask(deleteState->temp_relid, deleteState->relfilelocator,
+							  stripeDeleteState->stripeId,
+							  stripeDeleteState->rowCount,
+							  stripeDeleteState->pendingDeletedRows);
+		}
+
+		if (stripeDeleteState->flushedDeletedRows != NULL)
+		{
+			pfree(stripeDeleteState->flushedDeletedRows);
+		}
+
+		pfree(stripeDeleteState->pendingDeletedRows);
+	}
+
+	list_free_deep(deleteState->stripeDeleteStateList);
+	deleteState->stripeDeleteStateList = NIL;
+	deleteState->lastStripeDeleteState = NULL;
+}
+
+
 /*
  * GetWriteContextForDebug exposes WriteStateContext for debugging
  * purposes.
@@ -79,6 +79,7 @@
 #include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/syscache.h"
+#include "utils/typcache.h"
 
 #include "pg_version_constants.h"
 
@@ -119,6 +120,9 @@ static const char BinarySignature[11] = "PGCOPY\n\377\r\n\0";
 /* if true, skip validation of JSONB columns during COPY */
 bool SkipJsonbValidationInCopy = true;
 
+/* if true, pass columns through to the shards without parsing them during COPY */
+bool EnableCopyPassThrough = false;
+
 /* custom Citus option for appending to a shard */
 #define APPEND_TO_SHARD_OPTION "append_to_shard"
 
@@ -236,6 +240,12 @@ typedef enum LocalCopyStatus
 static void CopyToExistingShards(CopyStmt *copyStatement,
 								 QueryCompletion *completionTag);
 static bool IsCopyInBinaryFormat(CopyStmt *copyStatement);
+static bool CanPassThroughCopyColumns(CopyStmt *copyStatement,
+									  TupleDesc tupleDescriptor,
+									  int partitionColumnIndex);
+static bool IsPassThroughSafeType(Oid typeId);
+static List * FindInputColumns(TupleDesc tupleDescriptor, Oid columnTypeId,
+							   List *inputColumnNameList);
 static List * FindJsonbInputColumns(TupleDesc tupleDescriptor,
 									List *inputColumnNameList);
 static List * RemoveOptionFromList(List *optionList, char *optionName);
@@ -314,6 +324,8 @@ static void CopyAttributeOutText(CopyOutState outputState, char *string);
 static inline void CopyFlushOutput(CopyOutState outputState, char *start, char *pointer);
 static bool CitusSendTupleToPlacements(TupleTableSlot *slot,
 									   CitusCopyDestReceiver *copyDest);
+static StringInfo SerializeTupleForPlacements(CitusCopyDestReceiver *copyDest,
+											  Datum *columnValues, bool *columnNulls);
 static void AddPlacementStateToCopyConnectionStateBuffer(CopyConnectionState *
 														 connectionState,
 														 CopyPlacementState *
@@ -510,6 +522,15 @@ CopyToExistingShards(CopyStmt *copyStatement, QueryCompletion *completionTag)
 		copyDest->appendShardId = appendShardId;
 	}
 
+	/*
+	 * In pass-through mode, only the partition column is parsed on the
+	 * coordinator and all other columns are forwarded to the shards as text.
+	 */
+	bool copyPassThrough = EnableCopyPassThrough && !isInputFormatBinary &&
+						   CanPassThroughCopyColumns(copyStatement, tupleDescriptor,
+													 partitionColumnIndex);
+	copyDest->passThroughTextColumns = copyPassThrough;
+
 	DestReceiver *dest = (DestReceiver *) copyDest;
 	dest->rStartup(dest, 0, tupleDescriptor);
 
@@ -555,7 +576,41 @@ CopyToExistingShards(CopyStmt *copyStatement, QueryCompletion *completionTag)
 	 * until the object is parsed by the worker, which is unable to give an accurate
 	 * line number.
 	 */
-	if (SkipJsonbValidationInCopy && !isInputFormatBinary)
+	if (copyPassThrough)
+	{
+		Oid textoutFunctionId = TextOutFunctionId();
+		ListCell *inputColumnIndexCell = NULL;
+
+		/* get the column indices for all columns that appear in the input */
+		List *inputColumnIndexList = FindInputColumns(copiedDistributedRelation->rd_att,
+													  InvalidOid,
+													  copyStatement->attlist);
+
+		ereport(DEBUG1, (errmsg("passing COPY columns through to the shards without "
+								"parsing")));
+
+		foreach(inputColumnIndexCell, inputColumnIndexList)
+		{
+			int inputColumnIndex = lfirst_int(inputColumnIndexCell);
+			Form_pg_attribute currentColumn =
+				TupleDescAttr(copiedDistributedRelation->rd_att, inputColumnIndex);
+
+			if (inputColumnIndex == partitionColumnIndex)
+			{
+				/* we need the actual value to find the shard */
+				continue;
+			}
+
+			/*
+			 * Parse the column as text and send it in text format, such that
+			 * the shard parses the original input.
+			 */
+			currentColumn->atttypid = TEXTOID;
+			fmgr_info(textoutFunctionId,
+					  &copyDest->columnOutputFunctions[inputColumnIndex]);
+		}
+	}
+	else if (SkipJsonbValidationInCopy && !isInputFormatBinary)
 	{
 		CopyOutState copyOutState = copyDest->copyOutState;
 		ListCell *jsonbColumnIndexCell = NULL;
@@ -698,6 +753,129 @@ IsCopyInBinaryFormat(CopyStmt *copyStatement)
 }
 
 
+/*
+ * CanPassThroughCopyColumns returns whether the columns of a text or CSV
+ * COPY can be forwarded to the shards without parsing them. That is only
+ * the case when parsing the columns on the shards gives the same result as
+ * parsing them on the coordinator, and when NextCopyFrom does not need the
+ * actual column types to handle the COPY options.
+ */
+static bool
+CanPassThroughCopyColumns(CopyStmt *copyStatement, TupleDesc tupleDescriptor,
+						  int partitionColumnIndex)
+{
+	ListCell *optionCell = NULL;
+
+	if (copyStatement->whereClause != NULL)
+	{
+		return false;
+	}
+
+	foreach(optionCell, copyStatement->options)
+	{
+		DefElem *defel = (DefElem *) lfirst(optionCell);
+
+		/* options like default and on_error need the actual column types */
+		if (strcmp(defel->defname, "format") != 0 &&
+			strcmp(defel->defname, "delimiter") != 0 &&
+			strcmp(defel->defname, "null") != 0 &&
+			strcmp(defel->defname, "header") != 0 &&
+			strcmp(defel->defname, "quote") != 0 &&
+			strcmp(defel->defname, "escape") != 0 &&
+			strcmp(defel->defname, "encoding") != 0 &&
+			strcmp(defel->defname, "force_not_null") != 0 &&
+			strcmp(defel->defname, "force_null") != 0)
+		{
+			return false;
+		}
+	}
+
+	/*
+	 * All columns are sent in text format, including the partition column and
+	 * columns that get a default value, so all of them need to be safe.
+	 */
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute currentColumn = TupleDescAttr(tupleDescriptor, columnIndex);
+		Oid columnTypeId = currentColumn->atttypid;
+
+		if (IsDroppedOrGenerated(currentColumn))
+		{
+			continue;
+		}
+
+		if (!IsPassThroughSafeType(columnTypeId))
+		{
+			return false;
+		}
+
+		/* the partition column is parsed and sent using its output function */
+		if (columnIndex == partitionColumnIndex &&
+			(getBaseType(columnTypeId) == FLOAT4OID ||
+			 getBaseType(columnTypeId) == FLOAT8OID))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * IsPassThroughSafeType returns whether the text input function of the type
+ * (or of the element type for arrays) does not depend on settings like
+ * DateStyle, TimeZone or search_path, which may differ between the session
+ * on the coordinator and the connections to the workers.
+ */
+static bool
+IsPassThroughSafeType(Oid typeId)
+{
+	Oid baseTypeId = getBaseType(typeId);
+	Oid elementTypeId = get_element_type(baseTypeId);
+
+	if (OidIsValid(elementTypeId))
+	{
+		baseTypeId = getBaseType(elementTypeId);
+	}
+
+	switch (baseTypeId)
+	{
+		case BOOLOID:
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		case FLOAT4OID:
+		case FLOAT8OID:
+		case NUMERICOID:
+		case OIDOID:
+		case CHAROID:
+		case NAMEOID:
+		case TEXTOID:
+		case BPCHAROID:
+		case VARCHAROID:
+		case BYTEAOID:
+		case UUIDOID:
+		case JSONOID:
+		case JSONBOID:
+		case INETOID:
+		case CIDROID:
+		case MACADDROID:
+		case MACADDR8OID:
+		case BITOID:
+		case VARBITOID:
+		{
+			return true;
+		}
+
+		default:
+		{
+			return type_is_enum(baseTypeId);
+		}
+	}
+}
+
+
 /*
  * FindJsonbInputColumns finds columns in the tuple descriptor that have
  * the JSONB type and appear in inputColumnNameList. If the list is empty then
@@ -706,18 +884,31 @@ IsCopyInBinaryFormat(CopyStmt *copyStatement)
 static List *
 FindJsonbInputColumns(TupleDesc tupleDescriptor, List *inputColumnNameList)
 {
-	List *jsonbColumnIndexList = NIL;
+	return FindInputColumns(tupleDescriptor, JSONBOID, inputColumnNameList);
+}
+
+
+/*
+ * FindInputColumns finds columns in the tuple descriptor that have the given
+ * type and appear in inputColumnNameList. If columnTypeId is InvalidOid,
+ * columns of any type are returned. If the list is empty then all columns
+ * that are not generated are returned.
+ */
+static List *
+FindInputColumns(TupleDesc tupleDescriptor, Oid columnTypeId, List *inputColumnNameList)
+{
+	List *inputColumnIndexList = NIL;
 	int columnCount = tupleDescriptor->natts;
 
 	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
 	{
 		Form_pg_attribute currentColumn = TupleDescAttr(tupleDescriptor, columnIndex);
-		if (currentColumn->attisdropped)
+		if (IsDroppedOrGenerated(currentColumn))
 		{
 			continue;
 		}
 
-		if (currentColumn->atttypid != JSONBOID)
+		if (OidIsValid(columnTypeId) && currentColumn->atttypid != columnTypeId)
 		{
 			continue;
 		}
@@ -744,10 +935,10 @@ FindJsonbInputColumns(TupleDesc tupleDescriptor, List *inputColumnNameList)
 			}
 		}
 
-		jsonbColumnIndexList = lappend_int(jsonbColumnIndexList, columnIndex);
+		inputColumnIndexList = lappend_int(inputColumnIndexList, columnIndex);
 	}
 
-	return jsonbColumnIndexList;
+	return inputColumnIndexList;
 }
 
 
@@ -781,11 +972,9 @@ RemoveOptionFromList(List *optionList, char *optionName)
 
 
 /*
- * CanUseBinaryCopyFormat iterates over columns of the relation and looks for a
- * column whose type is array of user-defined type or composite type. If it finds
- * such column, that means we cannot use binary format for COPY, because binary
- * format sends Oid of the types, which are generally not same in master and
- * worker nodes for user-defined types. If the function can not detect a binary
+ * CanUseBinaryCopyFormat iterates over columns of the relation and checks
+ * whether all of them can be sent in binary format, see
+ * CanUseBinaryCopyFormatForType. If the function can not detect a binary
  * output function for any of the column, it returns false.
  */
 bool
@@ -864,25 +1053,27 @@ CanUseBinaryCopyFormatForType(Oid typeId)
 	if (type_is_rowtype(typeId))
 	{
 		/*
-		 * TODO: Inspect the types inside the record and check if all of them
-		 * can be binary encoded. If so, it's safe to use binary encoding.
-		 *
-		 * IMPORTANT: When implementing this todo keep the following in mind:
-		 *
-		 * In PG versions before PG14 the record_recv function would error out
-		 * more than necessary.
-		 *
-		 * It errors out when any of the columns in the row have a type oid
-		 * that doesn't match with the oid in the received data. This happens
-		 * pretty much always for non built in types, because their oids differ
-		 * between postgres intallations. So for those Postgres versions we
-		 * would need a check like the following for each column:
-		 *
-		 * if (columnType >= FirstNormalObjectId) {
-		 *     return false
-		 * }
+		 * Anonymous records are encoded using a typmod that only exists in
+		 * the backend that registered the record type, so they can only be
+		 * sent as text.
 		 */
-		return false;
+		if (typeId == RECORDOID)
+		{
+			return false;
+		}
+
+		/*
+		 * record_send includes the type OIDs of the columns, which are
+		 * generally not the same across nodes for user-defined types. Since
+		 * PG14, record_recv only rejects a mismatch when both OIDs belong to
+		 * built-in types, hence named composite types can be sent in binary
+		 * as long as all of their columns can.
+		 */
+		TupleDesc rowTupleDescriptor = lookup_rowtype_tupdesc(getBaseType(typeId), -1);
+		bool canUseBinaryFormat = CanUseBinaryCopyFormat(rowTupleDescriptor);
+		ReleaseTupleDesc(rowTupleDescriptor);
+
+		return canUseBinaryFormat;
 	}
 
 	HeapTuple typeTup = typeidType(typeId);
@@ -2056,10 +2247,12 @@ CitusCopyDestReceiverStartup(DestReceiver *dest, int operation,
 	copyOutState->delim = (char *) delimiterCharacter;
 	copyOutState->null_print = (char *) nullPrintCharacter;
 	copyOutState->null_print_client = (char *) nullPrintCharacter;
-	copyOutState->binary = CanUseBinaryCopyFormat(inputTupleDescriptor);
+	copyOutState->binary = !copyDest->passThroughTextColumns &&
+						   CanUseBinaryCopyFormat(inputTupleDescriptor);
 	copyOutState->fe_msgbuf = makeStringInfo();
 	copyOutState->rowcontext = GetPerTupleMemoryContext(copyDest->executorState);
 	copyDest->copyOutState = copyOutState;
+	copyDest->rowBuffer = makeStringInfo();
 	copyDest->multiShardCopy = false;
 
 	/* prepare functions to call on received tuples */
@@ -2257,12 +2450,9 @@ CitusCopyDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 static bool
 CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest)
 {
-	TupleDesc tupleDescriptor = copyDest->tupleDescriptor;
 	CopyStmt *copyStatement = copyDest->copyStatement;
 
 	CopyOutState copyOutState = copyDest->copyOutState;
-	FmgrInfo *columnOutputFunctions = copyDest->columnOutputFunctions;
-	CopyCoercionData *columnCoercionPaths = copyDest->columnCoercionPaths;
 	ListCell *placementStateCell = NULL;
 	bool cachedShardStateFound = false;
 	bool firstTupleInShard = false;
@@ -2328,6 +2518,17 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 		WriteTupleToLocalShard(slot, copyDest, shardId, shardState->copyOutState);
 	}
 
+	/*
+	 * Serialize the tuple only once for all remote placements, since calling
+	 * the output functions dominates the cost of routing a tuple and reference
+	 * tables have a placement on every node.
+	 */
+	StringInfo rowBuffer = NULL;
+	if (shardState->placementStateList != NIL)
+	{
+		rowBuffer = SerializeTupleForPlacements(copyDest, columnValues, columnNulls);
+	}
+
 	foreach(placementStateCell, shardState->placementStateList)
 	{
 		CopyPlacementState *currentPlacementState = lfirst(placementStateCell);
@@ -2372,13 +2573,8 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 		else if (currentPlacementState != activePlacementState)
 		{
 			/* buffer data */
-			StringInfo copyBuffer = copyOutState->fe_msgbuf;
-			resetStringInfo(copyBuffer);
-			AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
-							  copyOutState, columnOutputFunctions,
-							  columnCoercionPaths);
-			appendBinaryStringInfo(currentPlacementState->data, copyBuffer->data,
-								   copyBuffer->len);
+			appendBinaryStringInfo(currentPlacementState->data, rowBuffer->data,
+								   rowBuffer->len);
 		}
 		else
 		{
@@ -2388,11 +2584,7 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 
 		if (sendTupleOverConnection)
 		{
-			resetStringInfo(copyOutState->fe_msgbuf);
-			AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
-							  copyOutState, columnOutputFunctions, columnCoercionPaths);
-			SendCopyDataToPlacement(copyOutState->fe_msgbuf, shardId,
-									connectionState->connection);
+			SendCopyDataToPlacement(rowBuffer, shardId, connectionState->connection);
 		}
 	}
 
@@ -2412,6 +2604,32 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 }
 
 
+/*
+ * SerializeTupleForPlacements serializes the tuple in COPY format into the
+ * row buffer of the CitusCopyDestReceiver and returns the buffer. We do not
+ * serialize into fe_msgbuf directly, because fe_msgbuf is also used to send
+ * binary headers and footers when switching between placements.
+ */
+static StringInfo
+SerializeTupleForPlacements(CitusCopyDestReceiver *copyDest, Datum *columnValues,
+							bool *columnNulls)
+{
+	CopyOutState copyOutState = copyDest->copyOutState;
+	StringInfo messageBuffer = copyOutState->fe_msgbuf;
+	StringInfo rowBuffer = copyDest->rowBuffer;
+
+	resetStringInfo(rowBuffer);
+
+	copyOutState->fe_msgbuf = rowBuffer;
+	AppendCopyRowData(columnValues, columnNulls, copyDest->tupleDescriptor,
+					  copyOutState, copyDest->columnOutputFunctions,
+					  copyDest->columnCoercionPaths);
+	copyOutState->fe_msgbuf = messageBuffer;
+
+	return rowBuffer;
+}
+
+
 /*
  * AddPlacementStateToCopyConnectionStateBuffer is a helper function to add a placement
  * state to connection state's placement buffer. In addition to that, keep the counter
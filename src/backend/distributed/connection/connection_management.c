@@ -25,9 +25,11 @@
 #include "utils/hsearch.h"
 #include "utils/memutils.h"
 
+#include "distributed/async_commit.h"
 #include "distributed/backend_data.h"
 #include "distributed/cancel_utils.h"
 #include "distributed/connection_management.h"
+#include "distributed/connection_warmup.h"
 #include "distributed/error_codes.h"
 #include "distributed/errormessage.h"
 #include "distributed/hash_helpers.h"
@@ -37,6 +39,7 @@
 #include "distributed/metadata_cache.h"
 #include "distributed/placement_connection.h"
 #include "distributed/remote_commands.h"
+#include "distributed/remote_prepared_statements.h"
 #include "distributed/run_from_same_connection.h"
 #include "distributed/shared_connection_stats.h"
 #include "distributed/stats/stat_counters.h"
@@ -63,7 +66,8 @@ static void ErrorIfMultipleMetadataConnectionExists(dlist_head *connections);
 static void FreeConnParamsHashEntryFields(ConnParamsHashEntry *entry);
 static void AfterXactHostConnectionHandling(ConnectionHashEntry *entry, bool isCommit);
 static bool ShouldShutdownConnection(MultiConnection *connection, const int
-									 cachedConnectionCount);
+									 cachedConnectionCount, const int
+									 cachedConnectionLimit);
 static bool RemoteTransactionIdle(MultiConnection *connection);
 static int EventSetSizeForConnectionList(List *connections);
 
@@ -279,6 +283,9 @@ StartNodeUserDatabaseConnection(uint32 flags, const char *hostname, int32 port,
 	ConnectionHashKey key;
 	bool found;
 
+	/* make sure we see the writes of our previous transaction on the workers */
+	WaitForAsyncCommitPrepared();
+
 	/* do some minimal input checks */
 	if (strlen(hostname) > MAX_NODE_LENGTH)
 	{
@@ -1238,6 +1245,9 @@ CitusPQFinish(MultiConnection *connection)
 		connection->pgConn = NULL;
 	}
 
+	/* statements prepared over the connection are gone with it */
+	FreeWorkerPreparedStatements(connection);
+
 	/* behave idempotently, there is no gurantee that CitusPQFinish() is called once */
 	if (connection->initializationState >= POOL_STATE_COUNTER_INCREMENTED)
 	{
@@ -1473,6 +1483,20 @@ AfterXactHostConnectionHandling(ConnectionHashEntry *entry, bool isCommit)
 	dlist_mutable_iter iter;
 	int cachedConnectionCount = 0;
 
+	/*
+	 * With connection warm-up, keep as many connections as the recent
+	 * executions could use at the same time on the node, such that the next
+	 * burst of tasks does not have to establish them again.
+	 */
+	int cachedConnectionLimit = MaxCachedConnectionsPerWorker;
+	if (MaxWarmConnectionsPerWorker > 0 && !entry->key.replicationConnParam &&
+		!dlist_is_empty(entry->connections))
+	{
+		cachedConnectionLimit = Max(cachedConnectionLimit,
+									WarmConnectionCount(entry->key.hostname,
+														entry->key.port));
+	}
+
 	dlist_foreach_modify(iter, entry->connections)
 	{
 		MultiConnection *connection =
@@ -1491,7 +1515,8 @@ AfterXactHostConnectionHandling(ConnectionHashEntry *entry, bool isCommit)
 		}
 
 
-		if (ShouldShutdownConnection(connection, cachedConnectionCount))
+		if (ShouldShutdownConnection(connection, cachedConnectionCount,
+									 cachedConnectionLimit))
 		{
 			ShutdownConnection(connection);
 
@@ -1512,6 +1537,8 @@ AfterXactHostConnectionHandling(ConnectionHashEntry *entry, bool isCommit)
 
 			UnclaimConnection(connection);
 
+			connection->keptWarm =
+				cachedConnectionCount >= MaxCachedConnectionsPerWorker;
 
 			cachedConnectionCount++;
 		}
@@ -1522,15 +1549,18 @@ AfterXactHostConnectionHandling(ConnectionHashEntry *entry, bool isCommit)
 /*
  * ShouldShutdownConnection returns true if either one of the followings is true:
  * - The connection is citus initiated.
- * - Current cached connections is already at MaxCachedConnectionsPerWorker
+ * - Current cached connections is already at cachedConnectionLimit, which is
+ *   MaxCachedConnectionsPerWorker unless connections are kept warm
  * - Connection is forced to close at the end of transaction
  * - Connection is not in OK state
+ * - Connection is still in pipeline mode (usually because a pipelined execution failed)
  * - Connection has a replication origin setup
  * - A transaction is still in progress (usually because we are cancelling a distributed transaction)
  * - A connection reached its maximum lifetime
  */
 static bool
-ShouldShutdownConnection(MultiConnection *connection, const int cachedConnectionCount)
+ShouldShutdownConnection(MultiConnection *connection, const int cachedConnectionCount,
+						 const int cachedConnectionLimit)
 {
 	/*
 	 * When we are in a backend that was created to serve an internal connection
@@ -1540,9 +1570,10 @@ ShouldShutdownConnection(MultiConnection *connection, const int cachedConnection
 	 */
 	return (IsCitusInternalBackend() || IsRebalancerInternalBackend()) ||
 		   connection->initializationState != POOL_STATE_INITIALIZED ||
-		   cachedConnectionCount >= MaxCachedConnectionsPerWorker ||
+		   cachedConnectionCount >= cachedConnectionLimit ||
 		   connection->forceCloseAtTransactionEnd ||
 		   PQstatus(connection->pgConn) != CONNECTION_OK ||
+		   PQpipelineStatus(connection->pgConn) != PQ_PIPELINE_OFF ||
 		   !RemoteTransactionIdle(connection) ||
 		   connection->requiresReplication ||
 		   connection->isReplicationOriginSessionSetup ||
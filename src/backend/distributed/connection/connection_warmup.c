@@ -0,0 +1,416 @@
+/*-------------------------------------------------------------------------
+ *
+ * connection_warmup.c
+ *   Keeps track of how many connections the adaptive executor could use in
+ *   parallel per worker node in the recent executions. Backends use that
+ *   number to keep connections warm across transactions and to open them
+ *   all at once at the start of the next execution, instead of paying for
+ *   the connection establishments one slow start cycle at a time.
+ *
+ *   Connections cannot be handed over between backends, so each backend
+ *   keeps its own warm connections. The statistics are shared such that a
+ *   backend that has just started also benefits from what the others saw.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <math.h>
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+
+#include "access/hash.h"
+#include "common/hashfn.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+
+#include "distributed/connection_management.h"
+#include "distributed/connection_warmup.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/tuplestore.h"
+#include "distributed/worker_manager.h"
+
+
+#define CONNECTION_WARMUP_STATS_COLUMNS 9
+
+/*
+ * Weight of the parallelism of an execution when it is lower than the
+ * recorded parallelism of the node. Higher parallelism is adopted right
+ * away, such that a single burst warms up connections for the next one,
+ * while the warm connections only go away after a series of smaller
+ * executions.
+ */
+#define PARALLELISM_DECAY_WEIGHT 0.1
+
+
+/*
+ * ConnectionWarmupSharedData holds the lock for the hash of connection warm-up
+ * statistics, which is allocated separately in shared memory.
+ */
+typedef struct ConnectionWarmupSharedData
+{
+	int trancheId;
+	char *trancheName;
+
+	LWLock lock;
+} ConnectionWarmupSharedData;
+
+
+typedef struct ConnectionWarmupHashKey
+{
+	/* same as shared connection stats, we use hostname/port over nodeId */
+	char hostname[MAX_NODE_LENGTH];
+	int32 port;
+	Oid databaseOid;
+} ConnectionWarmupHashKey;
+
+
+/* hash entry for per worker connection warm-up statistics */
+typedef struct ConnectionWarmupHashEntry
+{
+	ConnectionWarmupHashKey key;
+
+	/* number of connections the recent executions used in parallel */
+	double parallelism;
+
+	/* number of recorded executions */
+	uint64 executionCount;
+
+	/* connections established by the recorded executions */
+	uint64 connectionsEstablished;
+	uint64 establishmentTime;
+
+	/* warm connections used by the recorded executions */
+	uint64 warmConnectionsReused;
+	uint64 establishmentTimeAvoided;
+} ConnectionWarmupHashEntry;
+
+
+/* GUC, 0 disables connection warm-up */
+int MaxWarmConnectionsPerWorker = 0;
+
+
+static HTAB *ConnectionWarmupHash = NULL;
+static ConnectionWarmupSharedData *ConnectionWarmupSharedState = NULL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+
+/* local function declarations */
+static void ConnectionWarmupShmemInit(void);
+static void BuildConnectionWarmupHashKey(ConnectionWarmupHashKey *key,
+										 const char *hostname, int port);
+static uint32 ConnectionWarmupHashHash(const void *key, Size keysize);
+static int ConnectionWarmupHashCompare(const void *a, const void *b, Size keysize);
+
+
+PG_FUNCTION_INFO_V1(citus_stat_connection_warmup);
+
+
+/*
+ * citus_stat_connection_warmup returns the connection warm-up statistics of
+ * the worker nodes, with times in milliseconds.
+ *
+ * Similar to citus_remote_connection_stats, we do not enforce any access
+ * privileges as the statistics do not reveal anything about the queries.
+ */
+Datum
+citus_stat_connection_warmup(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	/* copy the entries such that we do not build tuples while holding the lock */
+	LWLockAcquire(&ConnectionWarmupSharedState->lock, LW_SHARED);
+
+	long entryCount = hash_get_num_entries(ConnectionWarmupHash);
+	ConnectionWarmupHashEntry *entryArray =
+		palloc0(Max(entryCount, 1) * sizeof(ConnectionWarmupHashEntry));
+	int entryIndex = 0;
+
+	HASH_SEQ_STATUS status;
+	ConnectionWarmupHashEntry *entry = NULL;
+
+	hash_seq_init(&status, ConnectionWarmupHash);
+	while ((entry = (ConnectionWarmupHashEntry *) hash_seq_search(&status)) != NULL)
+	{
+		entryArray[entryIndex++] = *entry;
+	}
+
+	LWLockRelease(&ConnectionWarmupSharedState->lock);
+
+	for (int index = 0; index < entryIndex; index++)
+	{
+		Datum values[CONNECTION_WARMUP_STATS_COLUMNS];
+		bool isNulls[CONNECTION_WARMUP_STATS_COLUMNS];
+
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		entry = &entryArray[index];
+
+		double avgEstablishmentTime = 0.0;
+		if (entry->connectionsEstablished > 0)
+		{
+			avgEstablishmentTime = (double) entry->establishmentTime /
+								   entry->connectionsEstablished;
+		}
+
+		values[0] = ObjectIdGetDatum(entry->key.databaseOid);
+		values[1] = PointerGetDatum(cstring_to_text(entry->key.hostname));
+		values[2] = Int32GetDatum(entry->key.port);
+		values[3] = Float8GetDatum(entry->parallelism);
+		values[4] = Int64GetDatum(entry->executionCount);
+		values[5] = Int64GetDatum(entry->connectionsEstablished);
+		values[6] = Float8GetDatum(avgEstablishmentTime / 1000.0);
+		values[7] = Int64GetDatum(entry->warmConnectionsReused);
+		values[8] = Float8GetDatum(entry->establishmentTimeAvoided / 1000.0);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * WarmConnectionCount returns the number of connections to keep warm to the
+ * given node, which is the recent parallelism of the executions on the node
+ * in the current database capped by citus.max_warm_conns_per_worker.
+ */
+int
+WarmConnectionCount(const char *hostname, int port)
+{
+	if (MaxWarmConnectionsPerWorker == 0)
+	{
+		return 0;
+	}
+
+	ConnectionWarmupHashKey key;
+	BuildConnectionWarmupHashKey(&key, hostname, port);
+
+	double parallelism = 0.0;
+
+	LWLockAcquire(&ConnectionWarmupSharedState->lock, LW_SHARED);
+
+	bool entryFound = false;
+	ConnectionWarmupHashEntry *entry =
+		hash_search(ConnectionWarmupHash, &key, HASH_FIND, &entryFound);
+	if (entryFound)
+	{
+		parallelism = entry->parallelism;
+	}
+
+	LWLockRelease(&ConnectionWarmupSharedState->lock);
+
+	/* round to the nearest connection, decayed values should go away eventually */
+	return Min((int) rint(parallelism), MaxWarmConnectionsPerWorker);
+}
+
+
+/*
+ * RecordWorkerPoolConnectionUsage records the number of connections that an
+ * execution could use at the same time on the given node, and the connections
+ * it established or got from the warm connections. The establishment time is
+ * in microseconds.
+ */
+void
+RecordWorkerPoolConnectionUsage(const char *hostname, int port, int parallelism,
+								int newConnectionCount, uint64 establishmentTime,
+								int warmConnectionCount)
+{
+	ConnectionWarmupHashKey key;
+	BuildConnectionWarmupHashKey(&key, hostname, port);
+
+	LWLockAcquire(&ConnectionWarmupSharedState->lock, LW_EXCLUSIVE);
+
+	/*
+	 * Similar to shared connection stats, we prefer to skip the statistics
+	 * over throwing an error when there is no space left in the hash.
+	 */
+	bool entryFound = false;
+	ConnectionWarmupHashEntry *entry =
+		hash_search(ConnectionWarmupHash, &key, HASH_ENTER_NULL, &entryFound);
+	if (entry == NULL)
+	{
+		LWLockRelease(&ConnectionWarmupSharedState->lock);
+		return;
+	}
+
+	if (!entryFound)
+	{
+		memset(((char *) entry) + sizeof(ConnectionWarmupHashKey), 0,
+			   sizeof(ConnectionWarmupHashEntry) - sizeof(ConnectionWarmupHashKey));
+	}
+
+	if (parallelism >= entry->parallelism)
+	{
+		entry->parallelism = parallelism;
+	}
+	else
+	{
+		entry->parallelism += (parallelism - entry->parallelism) *
+							  PARALLELISM_DECAY_WEIGHT;
+	}
+
+	entry->executionCount++;
+	entry->connectionsEstablished += newConnectionCount;
+	entry->establishmentTime += establishmentTime;
+
+	/*
+	 * Each warm connection saved an establishment, which we estimate by the
+	 * average establishment time to the node.
+	 */
+	entry->warmConnectionsReused += warmConnectionCount;
+
+	if (warmConnectionCount > 0 && entry->connectionsEstablished > 0)
+	{
+		entry->establishmentTimeAvoided +=
+			warmConnectionCount * entry->establishmentTime /
+			entry->connectionsEstablished;
+	}
+
+	LWLockRelease(&ConnectionWarmupSharedState->lock);
+}
+
+
+/*
+ * BuildConnectionWarmupHashKey fills the hash key for the given node in the
+ * current database.
+ */
+static void
+BuildConnectionWarmupHashKey(ConnectionWarmupHashKey *key, const char *hostname,
+							 int port)
+{
+	if (strlen(hostname) > MAX_NODE_LENGTH)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("hostname exceeds the maximum length of %d",
+							   MAX_NODE_LENGTH)));
+	}
+
+	memset(key, 0, sizeof(ConnectionWarmupHashKey));
+	strlcpy(key->hostname, hostname, MAX_NODE_LENGTH);
+	key->port = port;
+	key->databaseOid = MyDatabaseId;
+}
+
+
+/*
+ * InitializeConnectionWarmup sets up the shared memory startup hook for
+ * the connection warm-up statistics.
+ */
+void
+InitializeConnectionWarmup(void)
+{
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = ConnectionWarmupShmemInit;
+}
+
+
+/*
+ * ConnectionWarmupShmemSize returns the size that should be allocated on the
+ * shared memory for the connection warm-up statistics.
+ */
+size_t
+ConnectionWarmupShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(ConnectionWarmupSharedData));
+	size = add_size(size, hash_estimate_size(MaxWorkerNodesTracked,
+											 sizeof(ConnectionWarmupHashEntry)));
+
+	return size;
+}
+
+
+/*
+ * ConnectionWarmupShmemInit initializes the shared memory used for keeping
+ * track of the connection warm-up statistics across backends.
+ */
+static void
+ConnectionWarmupShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	/* create (hostname, port, database) -> [statistics] */
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(ConnectionWarmupHashKey);
+	info.entrysize = sizeof(ConnectionWarmupHashEntry);
+	info.hash = ConnectionWarmupHashHash;
+	info.match = ConnectionWarmupHashCompare;
+	uint32 hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_COMPARE);
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	ConnectionWarmupSharedState =
+		(ConnectionWarmupSharedData *) ShmemInitStruct(
+			"Connection Warmup Data",
+			sizeof(ConnectionWarmupSharedData),
+			&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		ConnectionWarmupSharedState->trancheId = LWLockNewTrancheId();
+		ConnectionWarmupSharedState->trancheName = "Connection Warmup Tranche";
+		LWLockRegisterTranche(ConnectionWarmupSharedState->trancheId,
+							  ConnectionWarmupSharedState->trancheName);
+
+		LWLockInitialize(&ConnectionWarmupSharedState->lock,
+						 ConnectionWarmupSharedState->trancheId);
+	}
+
+	ConnectionWarmupHash =
+		ShmemInitHash("Connection Warmup Hash", MaxWorkerNodesTracked,
+					  MaxWorkerNodesTracked, &info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	Assert(ConnectionWarmupHash != NULL);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+static uint32
+ConnectionWarmupHashHash(const void *key, Size keysize)
+{
+	ConnectionWarmupHashKey *entry = (ConnectionWarmupHashKey *) key;
+
+	uint32 hash = string_hash(entry->hostname, NAMEDATALEN);
+	hash = hash_combine(hash, hash_uint32(entry->port));
+	hash = hash_combine(hash, hash_uint32(entry->databaseOid));
+
+	return hash;
+}
+
+
+static int
+ConnectionWarmupHashCompare(const void *a, const void *b, Size keysize)
+{
+	ConnectionWarmupHashKey *ca = (ConnectionWarmupHashKey *) a;
+	ConnectionWarmupHashKey *cb = (ConnectionWarmupHashKey *) b;
+
+	if (strncmp(ca->hostname, cb->hostname, MAX_NODE_LENGTH) != 0 ||
+		ca->port != cb->port ||
+		ca->databaseOid != cb->databaseOid)
+	{
+		return 1;
+	}
+	else
+	{
+		return 0;
+	}
+}
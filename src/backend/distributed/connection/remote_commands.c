@@ -124,9 +124,30 @@ ClearResultsInternal(MultiConnection *connection, bool raiseErrors, bool discard
 		PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
 		if (result == NULL)
 		{
+			/*
+			 * In pipeline mode, a NULL result only ends the results of a
+			 * single command, so keep going until we can leave pipeline mode.
+			 * We give up if the wait for results got cancelled.
+			 */
+			if (PQpipelineStatus(connection->pgConn) != PQ_PIPELINE_OFF &&
+				PQstatus(connection->pgConn) == CONNECTION_OK &&
+				!IsHoldOffCancellationReceived() &&
+				PQexitPipelineMode(connection->pgConn) == 0)
+			{
+				continue;
+			}
+
 			break;
 		}
 
+		/* the results of pipelined commands end with a sync result */
+		if (PQresultStatus(result) == PGRES_PIPELINE_SYNC ||
+			PQresultStatus(result) == PGRES_PIPELINE_ABORTED)
+		{
+			PQclear(result);
+			continue;
+		}
+
 		/*
 		 * End any pending copy operation. Transaction will be marked
 		 * as failed by the following part.
@@ -147,8 +168,13 @@ ClearResultsInternal(MultiConnection *connection, bool raiseErrors, bool discard
 
 			success = false;
 
-			/* an error happened, there is nothing we can do more */
-			if (PQresultStatus(result) == PGRES_FATAL_ERROR)
+			/*
+			 * An error happened, there is nothing we can do more. In pipeline
+			 * mode the remaining commands are skipped and we still need to
+			 * consume their results up to the sync.
+			 */
+			if (PQresultStatus(result) == PGRES_FATAL_ERROR &&
+				PQpipelineStatus(connection->pgConn) == PQ_PIPELINE_OFF)
 			{
 				PQclear(result);
 
@@ -180,6 +206,16 @@ ClearResultsIfReady(MultiConnection *connection)
 
 	Assert(PQisnonblocking(pgConn));
 
+	if (PQpipelineStatus(pgConn) != PQ_PIPELINE_OFF)
+	{
+		/*
+		 * An error or cancellation interrupted a pipeline. We could only
+		 * recover the connection by draining the remaining results, which
+		 * might block.
+		 */
+		return false;
+	}
+
 	while (true)
 	{
 		/*
@@ -0,0 +1,321 @@
+/*-------------------------------------------------------------------------
+ *
+ * remote_prepared_statements.c
+ *   Per-connection cache of statements that are prepared on remote nodes.
+ *
+ * When the same parameterized shard query is sent over a connection many
+ * times, we prepare it once as a named statement on the remote node and
+ * afterwards only send the parameters, such that the remote node can skip
+ * parsing and reuse its plan.
+ *
+ * The cache lives in the MultiConnection and therefore disappears together
+ * with the connection. Whenever the metadata of a distributed table changes
+ * (e.g. due to DDL or shard moves), all caches are invalidated and the
+ * statements are deallocated on the remote node the next time the connection
+ * is used to send a prepared statement.
+ *
+ * Preparing never waits for the remote node. The DEALLOCATE, the PREPARE and
+ * the execution of the statement are sent in a single libpq pipeline, and the
+ * caller clears the results of the commands that precede the execution, such
+ * that the adaptive executor's event loop is never blocked.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "libpq-fe.h"
+
+#include "common/hashfn.h"
+#include "lib/stringinfo.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+#include "distributed/citus_safe_lib.h"
+#include "distributed/connection_management.h"
+#include "distributed/remote_commands.h"
+#include "distributed/remote_prepared_statements.h"
+
+
+/*
+ * WorkerPreparedStatementEntry maps the parameter types and the query string
+ * of a command to the name of the statement on the remote node.
+ */
+typedef struct WorkerPreparedStatementEntry
+{
+	/* hash key, the parameter types followed by the query string */
+	const char *statementKey;
+
+	char statementName[NAMEDATALEN];
+} WorkerPreparedStatementEntry;
+
+
+/* GUC, determining whether shard queries are prepared on workers */
+bool EnableWorkerPreparedStatements = false;
+
+/* GUC, maximum number of statements prepared over a single connection */
+int MaxWorkerPreparedStatementsPerConnection = 1000;
+
+/* bumped whenever the prepared statements on workers may be stale */
+static uint64 WorkerPreparedStatementGeneration = 0;
+
+
+static void CreateWorkerPreparedStatementHash(MultiConnection *connection);
+static char * WorkerPreparedStatementKey(const char *command, int parameterCount,
+										 const Oid *parameterTypes);
+static int SendPrepareAndExecutePipelined(MultiConnection *connection,
+										  bool deallocateRequired,
+										  const char *statementName,
+										  const char *command, int parameterCount,
+										  const Oid *parameterTypes,
+										  const char *const *parameterValues,
+										  bool binaryResults, int *setupCommandCount);
+static uint32 WorkerPreparedStatementHashHash(const void *key, Size keysize);
+static int WorkerPreparedStatementHashCompare(const void *a, const void *b,
+											  Size keysize);
+
+
+/*
+ * SendRemoteCommandPrepared sends a single parameterized command over the
+ * connection using a statement that is prepared on the remote node.
+ *
+ * If the command was not yet prepared on the connection, the connection is
+ * put in pipeline mode and the PREPARE (preceded by a DEALLOCATE ALL if the
+ * cached statements are stale) is sent ahead of the execution, followed by a
+ * pipeline sync. setupCommandCount is set to the number of commands whose
+ * results the caller needs to clear before the results of the command
+ * follow, and the caller is expected to leave pipeline mode once it gets the
+ * pipeline sync. If the statement was already prepared, setupCommandCount is
+ * set to 0 and the connection stays out of pipeline mode.
+ *
+ * The statement is added to the cache right away. If the PREPARE fails, the
+ * connection is left in pipeline mode with an aborted pipeline, and such
+ * connections are closed at the end of the transaction together with their
+ * cache.
+ *
+ * The connection should be idle and not in pipeline mode. The return value
+ * follows the conventions of SendRemoteCommandParams.
+ */
+int
+SendRemoteCommandPrepared(MultiConnection *connection, const char *command,
+						  int parameterCount, const Oid *parameterTypes,
+						  const char *const *parameterValues, bool binaryResults,
+						  int *setupCommandCount)
+{
+	PGconn *pgConn = connection->pgConn;
+
+	*setupCommandCount = 0;
+
+	if (!pgConn || PQstatus(pgConn) != CONNECTION_OK)
+	{
+		return 0;
+	}
+
+	Assert(PQpipelineStatus(pgConn) == PQ_PIPELINE_OFF);
+
+	bool deallocateRequired = false;
+
+	if (connection->preparedStatementHash != NULL &&
+		(connection->preparedStatementGeneration != WorkerPreparedStatementGeneration ||
+		 hash_get_num_entries(connection->preparedStatementHash) >=
+		 MaxWorkerPreparedStatementsPerConnection))
+	{
+		/* forget the statements now, they are deallocated in the pipeline below */
+		FreeWorkerPreparedStatements(connection);
+		deallocateRequired = true;
+	}
+
+	if (connection->preparedStatementHash == NULL)
+	{
+		CreateWorkerPreparedStatementHash(connection);
+	}
+
+	char *statementKey = WorkerPreparedStatementKey(command, parameterCount,
+													parameterTypes);
+	bool found = false;
+
+	WorkerPreparedStatementEntry *entry =
+		hash_search(connection->preparedStatementHash, &statementKey, HASH_ENTER,
+					&found);
+	if (found)
+	{
+		pfree(statementKey);
+
+		LogRemoteCommand(connection, command);
+
+		return PQsendQueryPrepared(pgConn, entry->statementName, parameterCount,
+								   parameterValues, NULL, NULL, binaryResults ? 1 : 0);
+	}
+
+	entry->statementKey =
+		MemoryContextStrdup(connection->preparedStatementContext, statementKey);
+
+	/* statement names are never reused, even after a reset */
+	SafeSnprintf(entry->statementName, NAMEDATALEN, "citus_stmt_%u",
+				 ++connection->preparedStatementCounter);
+
+	pfree(statementKey);
+
+	return SendPrepareAndExecutePipelined(connection, deallocateRequired,
+										  entry->statementName, command,
+										  parameterCount, parameterTypes,
+										  parameterValues, binaryResults,
+										  setupCommandCount);
+}
+
+
+/*
+ * InvalidateWorkerPreparedStatements marks the statements that are prepared
+ * over all connections as stale. They are deallocated the next time the
+ * connection sends a prepared statement.
+ */
+void
+InvalidateWorkerPreparedStatements(void)
+{
+	WorkerPreparedStatementGeneration++;
+}
+
+
+/*
+ * FreeWorkerPreparedStatements releases the memory used to track prepared
+ * statements of a connection that is being closed. The statements on the
+ * remote node disappear together with the connection.
+ */
+void
+FreeWorkerPreparedStatements(MultiConnection *connection)
+{
+	if (connection->preparedStatementContext != NULL)
+	{
+		MemoryContextDelete(connection->preparedStatementContext);
+		connection->preparedStatementContext = NULL;
+		connection->preparedStatementHash = NULL;
+	}
+}
+
+
+/*
+ * CreateWorkerPreparedStatementHash creates the hash that maps commands to
+ * statement names in a memory context that lives as long as the connection.
+ */
+static void
+CreateWorkerPreparedStatementHash(MultiConnection *connection)
+{
+	HASHCTL info;
+
+	connection->preparedStatementContext =
+		AllocSetContextCreate(ConnectionContext, "Worker Prepared Statements",
+							  ALLOCSET_SMALL_SIZES);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(char *);
+	info.entrysize = sizeof(WorkerPreparedStatementEntry);
+	info.hash = WorkerPreparedStatementHashHash;
+	info.match = WorkerPreparedStatementHashCompare;
+	info.hcxt = connection->preparedStatementContext;
+	uint32 hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT | HASH_COMPARE);
+
+	connection->preparedStatementHash =
+		hash_create("citus worker prepared statements", 32, &info, hashFlags);
+	connection->preparedStatementGeneration = WorkerPreparedStatementGeneration;
+}
+
+
+/*
+ * WorkerPreparedStatementKey returns the key under which the statement for
+ * the given command is cached. The parameter types are part of the key,
+ * since they determine how the remote node parses the query.
+ */
+static char *
+WorkerPreparedStatementKey(const char *command, int parameterCount,
+						   const Oid *parameterTypes)
+{
+	StringInfo statementKey = makeStringInfo();
+
+	for (int parameterIndex = 0; parameterIndex < parameterCount; parameterIndex++)
+	{
+		appendStringInfo(statementKey, "%u,", parameterTypes[parameterIndex]);
+	}
+
+	appendStringInfo(statementKey, ";%s", command);
+
+	return statementKey->data;
+}
+
+
+/*
+ * SendPrepareAndExecutePipelined puts the connection in pipeline mode and
+ * sends DEALLOCATE ALL (if required), the PREPARE of the command and the
+ * execution of the prepared statement, followed by a pipeline sync.
+ */
+static int
+SendPrepareAndExecutePipelined(MultiConnection *connection, bool deallocateRequired,
+							   const char *statementName, const char *command,
+							   int parameterCount, const Oid *parameterTypes,
+							   const char *const *parameterValues, bool binaryResults,
+							   int *setupCommandCount)
+{
+	PGconn *pgConn = connection->pgConn;
+
+	if (PQenterPipelineMode(pgConn) == 0)
+	{
+		return 0;
+	}
+
+	if (deallocateRequired)
+	{
+		if (SendRemoteCommand(connection, "DEALLOCATE ALL") == 0)
+		{
+			return 0;
+		}
+
+		(*setupCommandCount)++;
+	}
+
+	LogRemoteCommand(connection, psprintf("PREPARE %s AS %s", statementName, command));
+
+	if (PQsendPrepare(pgConn, statementName, command, parameterCount,
+					  parameterTypes) == 0)
+	{
+		return 0;
+	}
+
+	(*setupCommandCount)++;
+
+	LogRemoteCommand(connection, command);
+
+	if (PQsendQueryPrepared(pgConn, statementName, parameterCount, parameterValues,
+							NULL, NULL, binaryResults ? 1 : 0) == 0)
+	{
+		return 0;
+	}
+
+	return PQpipelineSync(pgConn);
+}
+
+
+/*
+ * WorkerPreparedStatementHashHash hashes the string that the key points to.
+ */
+static uint32
+WorkerPreparedStatementHashHash(const void *key, Size keysize)
+{
+	const char *statementKey = *((const char *const *) key);
+
+	return hash_bytes((const unsigned char *) statementKey, strlen(statementKey));
+}
+
+
+/*
+ * WorkerPreparedStatementHashCompare compares the strings that the keys
+ * point to.
+ */
+static int
+WorkerPreparedStatementHashCompare(const void *a, const void *b, Size keysize)
+{
+	const char *statementKeyA = *((const char *const *) a);
+	const char *statementKeyB = *((const char *const *) b);
+
+	return strcmp(statementKeyA, statementKeyB);
+}
@@ -0,0 +1,2058 @@
+/*-------------------------------------------------------------------------
+ *
+ * worker_connection_pool.c
+ *   Multiplexes the read-only tasks of many backends onto a bounded set of
+ *   worker connections that a per-database background worker owns.
+ *
+ * Each backend normally opens its own connections to the worker nodes, and
+ * shared_connection_stats.c merely throttles their number. With thousands of
+ * client sessions, the worker nodes then spend memory and fork cost on many
+ * mostly idle backends. When citus.worker_connection_pool_size is set, the
+ * maintenance daemon of each database starts a "worker connection pooler"
+ * that keeps at most that many connections per worker node, and the
+ * adaptive executor hands it the tasks of read-only queries that run outside
+ * of transaction blocks.
+ *
+ * A backend submits its tasks by serializing them into a DSM segment, which
+ * also holds a shm_mq for the results, and publishing the segment in its
+ * slot in shared memory. The pooler claims the segment, runs each task on
+ * an idle pooled connection as a single statement in its own remote
+ * transaction, and streams the rows back through the queue.
+ *
+ * Pooled connections never start remote transaction blocks, hence anything
+ * that needs RemoteTransactionBegin, such as writes and queries in
+ * transaction blocks, keeps using the connections of the backend.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "libpq-fe.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include "access/xact.h"
+#include "libpq/pqformat.h"
+#include "port/atomics.h"
+#include "postmaster/bgworker.h"
+#include "storage/dsm.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lwlock.h"
+#include "storage/proc.h"
+#include "storage/shm_mq.h"
+#include "storage/shm_toc.h"
+#include "storage/shmem.h"
+#include "tcop/tcopprot.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+
+#include "distributed/async_commit.h"
+#include "distributed/backend_data.h"
+#include "distributed/background_worker_utils.h"
+#include "distributed/citus_safe_lib.h"
+#include "distributed/connection_management.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/metadata_utility.h"
+#include "distributed/remote_commands.h"
+#include "distributed/version_compat.h"
+#include "distributed/worker_connection_pool.h"
+
+
+#define POOLED_EXECUTION_MAGIC 0x50a1c0de
+#define POOLED_EXECUTION_KEY_HEADER 0
+#define POOLED_EXECUTION_KEY_REQUEST 1
+#define POOLED_EXECUTION_KEY_RESPONSE_QUEUE 2
+#define POOLED_EXECUTION_NKEYS 3
+
+#define POOLED_EXECUTION_QUEUE_SIZE (256 * 1024)
+
+/* how long to sleep when waiting for a connection slot or for the pooler */
+#define POOLER_RETRY_INTERVAL_MS 100
+
+/* messages sent from the pooler to the backend */
+#define POOLED_MESSAGE_ROW 'D'
+#define POOLED_MESSAGE_TASK_DONE 'C'
+#define POOLED_MESSAGE_ERROR 'E'
+
+
+/*
+ * WorkerConnectionPooler is the shared memory entry of the pooler of a
+ * database.
+ */
+typedef struct WorkerConnectionPooler
+{
+	/* InvalidOid when the entry is not used */
+	Oid databaseId;
+	pid_t pid;
+	Latch *latch;
+
+	/* incremented whenever a backend submits a request */
+	uint64 submittedRequestCount;
+} WorkerConnectionPooler;
+
+
+/*
+ * PooledRequestSlot is the shared memory slot through which a backend
+ * submits its requests. Each backend has its own slot, since it has at most
+ * one request at a time.
+ */
+typedef struct PooledRequestSlot
+{
+	Oid databaseId;
+
+	/* DSM segment of the request, DSM_HANDLE_INVALID if there is none */
+	dsm_handle segmentHandle;
+
+	/* whether the pooler has taken the request already */
+	bool claimed;
+} PooledRequestSlot;
+
+
+/*
+ * WorkerConnectionPoolSharedData is the header of the shared memory of the
+ * worker connection pool, which is followed by poolerCount poolers and
+ * slotCount request slots.
+ */
+typedef struct WorkerConnectionPoolSharedData
+{
+	int trancheId;
+	char *lockTrancheName;
+	LWLock lock;
+
+	int poolerCount;
+	int slotCount;
+} WorkerConnectionPoolSharedData;
+
+
+/*
+ * PooledRequestHeader is stored in the DSM segment of a request, next to
+ * the serialized tasks.
+ */
+typedef struct PooledRequestHeader
+{
+	char userName[NAMEDATALEN];
+	Size requestSize;
+
+	/* set by the backend when it gives up on the request before it is done */
+	pg_atomic_uint32 cancelled;
+} PooledRequestHeader;
+
+
+/*
+ * PooledExecution is the backend's side of a request.
+ */
+struct PooledExecution
+{
+	dsm_segment *segment;
+	PooledRequestHeader *header;
+	shm_mq_handle *responseQueue;
+	int taskCount;
+	int unfinishedTaskCount;
+};
+
+
+/*
+ * PooledRequest is the pooler's side of a request. It lives in its own
+ * memory context, together with its tasks.
+ */
+typedef struct PooledRequest
+{
+	MemoryContext context;
+	dsm_segment *segment;
+	PooledRequestHeader *header;
+	shm_mq_handle *responseQueue;
+	char userName[NAMEDATALEN];
+	int unfinishedTaskCount;
+
+	/*
+	 * PooledMessage's that did not fit into the queue yet. The first one
+	 * might be partially sent already. While a request has buffered
+	 * messages, we stop reading the results of its tasks, so that a slow
+	 * backend only holds up its own tasks.
+	 */
+	List *bufferedMessageList;
+
+	/* the backend detached from the queue, or one of the tasks failed */
+	bool abandoned;
+} PooledRequest;
+
+
+/*
+ * PooledMessage is a message to the backend of a request that is waiting for
+ * room in the queue.
+ */
+typedef struct PooledMessage
+{
+	StringInfoData data;
+	bool forceFlush;
+} PooledMessage;
+
+
+/*
+ * PooledTaskExecution is a task of a request in the pooler.
+ */
+typedef struct PooledTaskExecution
+{
+	PooledRequest *request;
+	int taskIndex;
+
+	char *queryString;
+	int parameterCount;
+	Oid *parameterTypes;
+	char **parameterValues;
+
+	int placementCount;
+	char **nodeNames;
+	int *nodePorts;
+
+	/* placement that the task runs on, incremented on connection failures */
+	int placementIndex;
+
+	/* once rows are sent, we cannot fail over to another placement */
+	bool rowsSent;
+
+	/* an error was reported, or the query was cancelled */
+	bool failed;
+} PooledTaskExecution;
+
+
+/*
+ * PooledConnection is a connection in the pool, which runs at most one task
+ * at a time.
+ */
+typedef struct PooledConnection
+{
+	MultiConnection *connection;
+
+	/* NULL when the connection is idle */
+	PooledTaskExecution *taskExecution;
+} PooledConnection;
+
+
+/*
+ * WorkerConnectionPoolerState is the state of the pooler's main loop.
+ */
+typedef struct WorkerConnectionPoolerState
+{
+	MemoryContext context;
+	uint64 claimedRequestCount;
+	List *requestList;
+	List *pendingTaskList;
+	List *connectionList;
+} WorkerConnectionPoolerState;
+
+
+/* config variable managed via guc.c */
+int WorkerConnectionPoolSize = 0;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static WorkerConnectionPoolSharedData *WorkerConnectionPoolShared = NULL;
+static WorkerConnectionPooler *WorkerConnectionPoolers = NULL;
+static PooledRequestSlot *PooledRequestSlots = NULL;
+
+static volatile sig_atomic_t got_SIGHUP = false;
+static volatile sig_atomic_t got_SIGTERM = false;
+
+
+static void WorkerConnectionPoolShmemInit(void);
+static WorkerConnectionPooler * FindWorkerConnectionPooler(Oid databaseId);
+static PooledRequestSlot * MyPooledRequestSlot(void);
+static void SerializePooledTask(StringInfo buffer, PooledTask *pooledTask);
+static void SendPooledString(StringInfo buffer, const char *value);
+static char * GetPooledString(StringInfo buffer);
+static void ReportPooledTaskError(StringInfo message);
+static bool RegisterWorkerConnectionPooler(void);
+static void WorkerConnectionPoolerShmemExit(int code, Datum arg);
+static void SetPooledConnectionCachingSettings(void);
+static void ClaimPooledRequests(WorkerConnectionPoolerState *poolerState);
+static void AttachPooledRequest(WorkerConnectionPoolerState *poolerState,
+								dsm_handle segmentHandle);
+static void AssignPendingTasks(WorkerConnectionPoolerState *poolerState);
+static PooledConnection * FindIdlePooledConnection(WorkerConnectionPoolerState *
+												   poolerState, char *nodeName,
+												   int nodePort, char *userName);
+static bool MakeRoomForPooledConnection(WorkerConnectionPoolerState *poolerState,
+										char *nodeName, int nodePort);
+static PooledConnection * OpenPooledConnection(WorkerConnectionPoolerState *
+											   poolerState, char *nodeName,
+											   int nodePort, char *userName,
+											   PooledTaskExecution *taskExecution);
+static bool StartPooledTask(PooledConnection *pooledConnection,
+							PooledTaskExecution *taskExecution);
+static void WaitForPooledConnections(WorkerConnectionPoolerState *poolerState);
+static void ProcessPooledConnection(WorkerConnectionPoolerState *poolerState,
+									PooledConnection *pooledConnection);
+static void PooledConnectionFailed(WorkerConnectionPoolerState *poolerState,
+								   PooledConnection *pooledConnection);
+static void ClosePooledConnection(WorkerConnectionPoolerState *poolerState,
+								  PooledConnection *pooledConnection);
+static void CloseFailedPooledConnections(WorkerConnectionPoolerState *poolerState);
+static void PooledTaskConnectionFailed(WorkerConnectionPoolerState *poolerState,
+									   PooledTaskExecution *taskExecution,
+									   MultiConnection *connection);
+static void SendPooledRow(PooledTaskExecution *taskExecution, PGresult *result);
+static void SendPooledResultError(PooledTaskExecution *taskExecution,
+								  MultiConnection *connection, PGresult *result);
+static void SendPooledConnectionError(PooledTaskExecution *taskExecution,
+									  char *nodeName, int nodePort,
+									  const char *errorMessage);
+static void SendPooledMessage(PooledRequest *request, StringInfo message,
+							  bool forceFlush);
+static void FlushPooledRequests(WorkerConnectionPoolerState *poolerState);
+static void FlushPooledMessages(PooledRequest *request);
+static bool PooledRequestBlocked(PooledRequest *request);
+static void CancelAbandonedTasks(WorkerConnectionPoolerState *poolerState);
+static void PooledTaskFinished(WorkerConnectionPoolerState *poolerState,
+							   PooledTaskExecution *taskExecution);
+static void ReleasePooledRequest(WorkerConnectionPoolerState *poolerState,
+								 PooledRequest *request);
+static void WorkerConnectionPoolerSigTermHandler(SIGNAL_ARGS);
+static void WorkerConnectionPoolerSigHupHandler(SIGNAL_ARGS);
+
+
+/*
+ * InitializeWorkerConnectionPool sets up the shared memory startup hook of
+ * the worker connection pool.
+ */
+void
+InitializeWorkerConnectionPool(void)
+{
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = WorkerConnectionPoolShmemInit;
+}
+
+
+/*
+ * WorkerConnectionPoolShmemSize returns the size that should be allocated
+ * on the shared memory for the worker connection pool.
+ */
+size_t
+WorkerConnectionPoolShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, MAXALIGN(sizeof(WorkerConnectionPoolSharedData)));
+	size = add_size(size, MAXALIGN(mul_size(sizeof(WorkerConnectionPooler),
+											max_worker_processes)));
+	size = add_size(size, mul_size(sizeof(PooledRequestSlot), TotalProcCount()));
+
+	return size;
+}
+
+
+/*
+ * WorkerConnectionPoolShmemInit initializes the shared memory through which
+ * the backends submit requests to the poolers.
+ */
+static void
+WorkerConnectionPoolShmemInit(void)
+{
+	bool alreadyInitialized = false;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	char *sharedMemory = ShmemInitStruct("Worker Connection Pool Data",
+										 WorkerConnectionPoolShmemSize(),
+										 &alreadyInitialized);
+
+	WorkerConnectionPoolShared = (WorkerConnectionPoolSharedData *) sharedMemory;
+	WorkerConnectionPoolers = (WorkerConnectionPooler *)
+							  (sharedMemory +
+							   MAXALIGN(sizeof(WorkerConnectionPoolSharedData)));
+	PooledRequestSlots = (PooledRequestSlot *)
+						 ((char *) WorkerConnectionPoolers +
+						  MAXALIGN(mul_size(sizeof(WorkerConnectionPooler),
+											max_worker_processes)));
+
+	if (!alreadyInitialized)
+	{
+		memset(sharedMemory, 0, WorkerConnectionPoolShmemSize());
+
+		WorkerConnectionPoolShared->trancheId = LWLockNewTrancheId();
+		WorkerConnectionPoolShared->lockTrancheName = "Worker Connection Pool Tranche";
+		LWLockRegisterTranche(WorkerConnectionPoolShared->trancheId,
+							  WorkerConnectionPoolShared->lockTrancheName);
+		LWLockInitialize(&WorkerConnectionPoolShared->lock,
+						 WorkerConnectionPoolShared->trancheId);
+
+		WorkerConnectionPoolShared->poolerCount = max_worker_processes;
+		WorkerConnectionPoolShared->slotCount = TotalProcCount();
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * WorkerConnectionPoolAvailable returns true if the pool is enabled and the
+ * pooler of the current database is running.
+ */
+bool
+WorkerConnectionPoolAvailable(void)
+{
+	if (WorkerConnectionPoolSize <= 0 || WorkerConnectionPoolShared == NULL)
+	{
+		return false;
+	}
+
+	return WorkerConnectionPoolerRunning(MyDatabaseId);
+}
+
+
+/*
+ * WorkerConnectionPoolerRunning returns true if the pooler of the given
+ * database is running.
+ */
+bool
+WorkerConnectionPoolerRunning(Oid database)
+{
+	LWLockAcquire(&WorkerConnectionPoolShared->lock, LW_SHARED);
+	bool poolerRunning = FindWorkerConnectionPooler(database) != NULL;
+	LWLockRelease(&WorkerConnectionPoolShared->lock);
+
+	return poolerRunning;
+}
+
+
+/*
+ * FindWorkerConnectionPooler returns the pooler entry of the given database,
+ * or NULL if there is none. The caller should hold the lock.
+ */
+static WorkerConnectionPooler *
+FindWorkerConnectionPooler(Oid databaseId)
+{
+	for (int poolerIndex = 0; poolerIndex < WorkerConnectionPoolShared->poolerCount;
+		 poolerIndex++)
+	{
+		WorkerConnectionPooler *pooler = &WorkerConnectionPoolers[poolerIndex];
+		if (pooler->databaseId == databaseId)
+		{
+			return pooler;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * MyPooledRequestSlot returns the request slot of the current backend.
+ */
+static PooledRequestSlot *
+MyPooledRequestSlot(void)
+{
+	int pgprocno = getProcNo_compat(MyProc);
+	Assert(pgprocno < WorkerConnectionPoolShared->slotCount);
+
+	return &PooledRequestSlots[pgprocno];
+}
+
+
+/*
+ * StartPooledExecution submits the given list of PooledTask's to the pooler
+ * of the current database. The results are received via
+ * ReceivePooledExecutionMessage.
+ */
+PooledExecution *
+StartPooledExecution(List *pooledTaskList)
+{
+	/* the pooler does not know about our previous transaction */
+	WaitForAsyncCommitPrepared();
+
+	StringInfoData request;
+	initStringInfo(&request);
+
+	pq_sendint32(&request, list_length(pooledTaskList));
+
+	PooledTask *pooledTask = NULL;
+	foreach_declared_ptr(pooledTask, pooledTaskList)
+	{
+		SerializePooledTask(&request, pooledTask);
+	}
+
+	shm_toc_estimator estimator;
+	shm_toc_initialize_estimator(&estimator);
+	shm_toc_estimate_chunk(&estimator, sizeof(PooledRequestHeader));
+	shm_toc_estimate_chunk(&estimator, request.len);
+	shm_toc_estimate_chunk(&estimator, POOLED_EXECUTION_QUEUE_SIZE);
+	shm_toc_estimate_keys(&estimator, POOLED_EXECUTION_NKEYS);
+	Size segmentSize = shm_toc_estimate(&estimator);
+
+	dsm_segment *segment = dsm_create(segmentSize, 0);
+	shm_toc *toc = shm_toc_create(POOLED_EXECUTION_MAGIC, dsm_segment_address(segment),
+								  segmentSize);
+
+	PooledRequestHeader *header = shm_toc_allocate(toc, sizeof(PooledRequestHeader));
+	strlcpy(header->userName, CurrentUserName(), NAMEDATALEN);
+	header->requestSize = request.len;
+	pg_atomic_init_u32(&header->cancelled, 0);
+	shm_toc_insert(toc, POOLED_EXECUTION_KEY_HEADER, header);
+
+	char *requestData = shm_toc_allocate(toc, request.len);
+	memcpy_s(requestData, request.len, request.data, request.len);
+	shm_toc_insert(toc, POOLED_EXECUTION_KEY_REQUEST, requestData);
+
+	shm_mq *responseQueue = shm_mq_create(shm_toc_allocate(toc,
+														   POOLED_EXECUTION_QUEUE_SIZE),
+										  POOLED_EXECUTION_QUEUE_SIZE);
+	shm_toc_insert(toc, POOLED_EXECUTION_KEY_RESPONSE_QUEUE, responseQueue);
+	shm_mq_set_receiver(responseQueue, MyProc);
+
+	PooledExecution *pooledExecution = palloc0(sizeof(PooledExecution));
+	pooledExecution->segment = segment;
+	pooledExecution->header = header;
+	pooledExecution->responseQueue = shm_mq_attach(responseQueue, segment, NULL);
+	pooledExecution->taskCount = list_length(pooledTaskList);
+	pooledExecution->unfinishedTaskCount = pooledExecution->taskCount;
+
+	pfree(request.data);
+
+	/* publish the request and wake up the pooler */
+	Latch *poolerLatch = NULL;
+
+	LWLockAcquire(&WorkerConnectionPoolShared->lock, LW_EXCLUSIVE);
+
+	WorkerConnectionPooler *pooler = FindWorkerConnectionPooler(MyDatabaseId);
+	if (pooler != NULL)
+	{
+		PooledRequestSlot *slot = MyPooledRequestSlot();
+		slot->databaseId = MyDatabaseId;
+		slot->segmentHandle = dsm_segment_handle(segment);
+		slot->claimed = false;
+
+		pooler->submittedRequestCount++;
+		poolerLatch = pooler->latch;
+	}
+
+	LWLockRelease(&WorkerConnectionPoolShared->lock);
+
+	if (poolerLatch == NULL)
+	{
+		ereport(ERROR, (errmsg("worker connection pooler is not running")));
+	}
+
+	SetLatch(poolerLatch);
+
+	return pooledExecution;
+}
+
+
+/*
+ * SerializePooledTask appends the given task to the request buffer.
+ */
+static void
+SerializePooledTask(StringInfo buffer, PooledTask *pooledTask)
+{
+	SendPooledString(buffer, pooledTask->queryString);
+
+	pq_sendint32(buffer, pooledTask->parameterCount);
+	for (int parameterIndex = 0; parameterIndex < pooledTask->parameterCount;
+		 parameterIndex++)
+	{
+		pq_sendint32(buffer, pooledTask->parameterTypes[parameterIndex]);
+		SendPooledString(buffer, pooledTask->parameterValues[parameterIndex]);
+	}
+
+	pq_sendint32(buffer, list_length(pooledTask->placementList));
+
+	ShardPlacement *placement = NULL;
+	foreach_declared_ptr(placement, pooledTask->placementList)
+	{
+		SendPooledString(buffer, placement->nodeName);
+		pq_sendint32(buffer, placement->nodePort);
+	}
+}
+
+
+/*
+ * SendPooledString appends a length-prefixed string to the buffer. Unlike
+ * pq_sendstring, it does not convert the string to the client encoding,
+ * since both ends of the queue use the database encoding.
+ */
+static void
+SendPooledString(StringInfo buffer, const char *value)
+{
+	if (value == NULL)
+	{
+		pq_sendint32(buffer, -1);
+		return;
+	}
+
+	int valueLength = strlen(value);
+	pq_sendint32(buffer, valueLength);
+	pq_sendbytes(buffer, value, valueLength);
+}
+
+
+/*
+ * GetPooledString reads a string written by SendPooledString into a newly
+ * allocated buffer.
+ */
+static char *
+GetPooledString(StringInfo buffer)
+{
+	int valueLength = (int) pq_getmsgint(buffer, 4);
+	if (valueLength < 0)
+	{
+		return NULL;
+	}
+
+	const char *value = pq_getmsgbytes(buffer, valueLength);
+	return pnstrdup(value, valueLength);
+}
+
+
+/*
+ * ReceivePooledExecutionMessage waits for the next row or task completion
+ * of the given execution and returns it in message. The column values are
+ * allocated in the current memory context. It returns false once all the
+ * tasks are done, and throws the errors that the tasks ran into.
+ */
+bool
+ReceivePooledExecutionMessage(PooledExecution *pooledExecution,
+							  PooledExecutionMessage *message)
+{
+	if (pooledExecution->unfinishedTaskCount == 0)
+	{
+		return false;
+	}
+
+	Size messageSize = 0;
+	void *messageData = NULL;
+
+	while (true)
+	{
+		bool noWait = true;
+		shm_mq_result result = shm_mq_receive(pooledExecution->responseQueue,
+											  &messageSize, &messageData, noWait);
+		if (result == SHM_MQ_SUCCESS)
+		{
+			break;
+		}
+		else if (result == SHM_MQ_DETACHED)
+		{
+			ereport(ERROR, (errmsg("worker connection pooler exited while executing "
+								   "the query")));
+		}
+
+		/*
+		 * The queue doesn't know about the pooler before it attaches, so make
+		 * sure we don't wait forever for a pooler that exited meanwhile.
+		 */
+		if (!WorkerConnectionPoolerRunning(MyDatabaseId))
+		{
+			ereport(ERROR, (errmsg("worker connection pooler exited while executing "
+								   "the query")));
+		}
+
+		int rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+						   POOLER_RETRY_INTERVAL_MS, PG_WAIT_EXTENSION);
+		if (rc & WL_LATCH_SET)
+		{
+			ResetLatch(MyLatch);
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	StringInfoData messageBuffer;
+	messageBuffer.data = (char *) messageData;
+	messageBuffer.len = messageSize;
+	messageBuffer.maxlen = messageSize;
+	messageBuffer.cursor = 0;
+
+	char messageType = pq_getmsgbyte(&messageBuffer);
+
+	memset(message, 0, sizeof(PooledExecutionMessage));
+	message->taskIndex = (int) pq_getmsgint(&messageBuffer, 4);
+
+	if (message->taskIndex < 0 || message->taskIndex >= pooledExecution->taskCount)
+	{
+		ereport(ERROR, (errmsg("unexpected task index %d from worker connection "
+							   "pooler", message->taskIndex)));
+	}
+
+	switch (messageType)
+	{
+		case POOLED_MESSAGE_ROW:
+		{
+			message->type = POOLED_EXECUTION_ROW;
+			message->columnCount = (int) pq_getmsgint(&messageBuffer, 4);
+			message->columnValues = palloc0(message->columnCount * sizeof(char *));
+
+			for (int columnIndex = 0; columnIndex < message->columnCount;
+				 columnIndex++)
+			{
+				message->columnValues[columnIndex] = GetPooledString(&messageBuffer);
+				if (message->columnValues[columnIndex] != NULL)
+				{
+					message->rowSize += strlen(message->columnValues[columnIndex]);
+				}
+			}
+
+			break;
+		}
+
+		case POOLED_MESSAGE_TASK_DONE:
+		{
+			message->type = POOLED_EXECUTION_TASK_DONE;
+			pooledExecution->unfinishedTaskCount--;
+			break;
+		}
+
+		case POOLED_MESSAGE_ERROR:
+		{
+			ReportPooledTaskError(&messageBuffer);
+			break;
+		}
+
+		default:
+		{
+			ereport(ERROR, (errmsg("unexpected message type %c from worker "
+								   "connection pooler", messageType)));
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * ReportPooledTaskError throws the error that the pooler sent, the same way
+ * ReportResultError throws errors of remote commands.
+ */
+static void
+ReportPooledTaskError(StringInfo message)
+{
+	char *sqlStateString = GetPooledString(message);
+	char *messagePrimary = GetPooledString(message);
+	char *messageDetail = GetPooledString(message);
+	char *messageHint = GetPooledString(message);
+	char *messageContext = GetPooledString(message);
+	char *nodeName = GetPooledString(message);
+	int nodePort = (int) pq_getmsgint(message, 4);
+	int sqlState = ERRCODE_INTERNAL_ERROR;
+
+	if (sqlStateString != NULL && strlen(sqlStateString) == 5)
+	{
+		sqlState = MAKE_SQLSTATE(sqlStateString[0],
+								 sqlStateString[1],
+								 sqlStateString[2],
+								 sqlStateString[3],
+								 sqlStateString[4]);
+	}
+
+	ereport(ERROR, (errcode(sqlState), errmsg("%s", messagePrimary ? messagePrimary : ""),
+					messageDetail ? errdetail("%s", messageDetail) : 0,
+					messageHint ? errhint("%s", messageHint) : 0,
+					messageContext ? errcontext("%s", messageContext) : 0,
+					errcontext("while executing command on %s:%d",
+							   nodeName, nodePort)));
+}
+
+
+/*
+ * FinishPooledExecution releases the request slot and the DSM segment of the
+ * given execution. If some of its tasks are not done, for instance because
+ * the query was cancelled, the pooler cancels them.
+ */
+void
+FinishPooledExecution(PooledExecution *pooledExecution)
+{
+	dsm_handle segmentHandle = dsm_segment_handle(pooledExecution->segment);
+	bool cancelTasks = pooledExecution->unfinishedTaskCount > 0;
+	Latch *poolerLatch = NULL;
+
+	if (cancelTasks)
+	{
+		/*
+		 * The pooler only notices that we detached from the queue when it
+		 * sends the next row, which might take long for a slow query.
+		 */
+		pg_atomic_write_u32(&pooledExecution->header->cancelled, 1);
+	}
+
+	LWLockAcquire(&WorkerConnectionPoolShared->lock, LW_EXCLUSIVE);
+
+	PooledRequestSlot *slot = MyPooledRequestSlot();
+	if (slot->segmentHandle == segmentHandle)
+	{
+		slot->segmentHandle = DSM_HANDLE_INVALID;
+		slot->databaseId = InvalidOid;
+		slot->claimed = false;
+	}
+
+	WorkerConnectionPooler *pooler = FindWorkerConnectionPooler(MyDatabaseId);
+	if (pooler != NULL)
+	{
+		poolerLatch = pooler->latch;
+	}
+
+	LWLockRelease(&WorkerConnectionPoolShared->lock);
+
+	dsm_detach(pooledExecution->segment);
+	pfree(pooledExecution);
+
+	if (cancelTasks && poolerLatch != NULL)
+	{
+		SetLatch(poolerLatch);
+	}
+}
+
+
+/*
+ * StartWorkerConnectionPooler spawns the worker connection pooler of the
+ * current database.
+ */
+BackgroundWorkerHandle *
+StartWorkerConnectionPooler(Oid database, Oid extensionOwner)
+{
+	char workerName[BGW_MAXLEN];
+
+	SafeSnprintf(workerName, BGW_MAXLEN,
+				 "Citus Worker Connection Pooler: %u/%u",
+				 database, extensionOwner);
+
+	CitusBackgroundWorkerConfig config = {
+		.workerName = workerName,
+		.functionName = "WorkerConnectionPoolerMain",
+		.mainArg = ObjectIdGetDatum(database),
+		.extensionOwner = extensionOwner,
+		.needsNotification = true,
+		.waitForStartup = false,
+		.restartTime = CITUS_BGW_NEVER_RESTART,
+		.startTime = CITUS_BGW_DEFAULT_START_TIME,
+		.workerType = NULL, /* use default */
+		.extraData = NULL,
+		.extraDataSize = 0
+	};
+	return RegisterCitusBackgroundWorker(&config);
+}
+
+
+/*
+ * WorkerConnectionPoolerMain is the main routine of the worker connection
+ * pooler. The maintenance daemon starts it whenever it is not running and
+ * citus.worker_connection_pool_size is set, and it exits once the setting
+ * is reset.
+ */
+void
+WorkerConnectionPoolerMain(Datum arg)
+{
+	Oid databaseOid = DatumGetObjectId(arg);
+
+	pqsignal(SIGTERM, WorkerConnectionPoolerSigTermHandler);
+	pqsignal(SIGHUP, WorkerConnectionPoolerSigHupHandler);
+	BackgroundWorkerUnblockSignals();
+
+	/* extension owner is passed via bgw_extra */
+	Oid extensionOwner = InvalidOid;
+	memcpy_s(&extensionOwner, sizeof(extensionOwner),
+			 MyBgworkerEntry->bgw_extra, sizeof(Oid));
+
+	/* connect to database, after that we can actually access catalogs */
+	BackgroundWorkerInitializeConnectionByOid(databaseOid, extensionOwner, 0);
+
+	/* make worker recognizable in pg_stat_activity */
+	pgstat_report_appname("Citus Worker Connection Pooler");
+
+	if (!RegisterWorkerConnectionPooler())
+	{
+		ereport(LOG, (errmsg("worker connection pooler already running for "
+							 "database %u", databaseOid)));
+		proc_exit(0);
+	}
+
+	SetPooledConnectionCachingSettings();
+
+	WorkerConnectionPoolerState poolerState;
+	memset_struct_0(poolerState);
+	poolerState.context = AllocSetContextCreate(TopMemoryContext,
+												"Worker Connection Pooler",
+												ALLOCSET_DEFAULT_SIZES);
+	MemoryContextSwitchTo(poolerState.context);
+
+	ereport(DEBUG1, (errmsg("started worker connection pooler")));
+
+	while (!got_SIGTERM)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		if (got_SIGHUP)
+		{
+			got_SIGHUP = false;
+			ProcessConfigFile(PGC_SIGHUP);
+			SetPooledConnectionCachingSettings();
+		}
+
+		if (WorkerConnectionPoolSize <= 0)
+		{
+			/* the pool was disabled, backends use their own connections again */
+			break;
+		}
+
+		ClaimPooledRequests(&poolerState);
+		FlushPooledRequests(&poolerState);
+		CancelAbandonedTasks(&poolerState);
+		AssignPendingTasks(&poolerState);
+		WaitForPooledConnections(&poolerState);
+	}
+
+	PooledConnection *pooledConnection = NULL;
+	foreach_declared_ptr(pooledConnection, poolerState.connectionList)
+	{
+		CloseConnection(pooledConnection->connection);
+	}
+
+	proc_exit(0);
+}
+
+
+/*
+ * RegisterWorkerConnectionPooler publishes the current process as the pooler
+ * of its database. It returns false if the database already has a pooler.
+ */
+static bool
+RegisterWorkerConnectionPooler(void)
+{
+	bool registered = false;
+
+	LWLockAcquire(&WorkerConnectionPoolShared->lock, LW_EXCLUSIVE);
+
+	if (FindWorkerConnectionPooler(MyDatabaseId) == NULL)
+	{
+		WorkerConnectionPooler *pooler = FindWorkerConnectionPooler(InvalidOid);
+		if (pooler != NULL)
+		{
+			pooler->databaseId = MyDatabaseId;
+			pooler->pid = MyProcPid;
+			pooler->latch = MyLatch;
+			pooler->submittedRequestCount = 0;
+
+			registered = true;
+		}
+	}
+
+	LWLockRelease(&WorkerConnectionPoolShared->lock);
+
+	if (registered)
+	{
+		on_shmem_exit(WorkerConnectionPoolerShmemExit, 0);
+	}
+
+	return registered;
+}
+
+
+/*
+ * WorkerConnectionPoolerShmemExit removes the pooler from shared memory when
+ * it exits, such that the backends stop waiting for it.
+ */
+static void
+WorkerConnectionPoolerShmemExit(int code, Datum arg)
+{
+	LWLockAcquire(&WorkerConnectionPoolShared->lock, LW_EXCLUSIVE);
+
+	WorkerConnectionPooler *pooler = FindWorkerConnectionPooler(MyDatabaseId);
+	if (pooler != NULL && pooler->pid == MyProcPid)
+	{
+		pooler->databaseId = InvalidOid;
+		pooler->pid = 0;
+		pooler->latch = NULL;
+	}
+
+	LWLockRelease(&WorkerConnectionPoolShared->lock);
+}
+
+
+/*
+ * SetPooledConnectionCachingSettings makes sure that the connection
+ * management does not close the pooled connections at the end of the
+ * transactions that the pooler uses to establish new connections.
+ */
+static void
+SetPooledConnectionCachingSettings(void)
+{
+	char poolSizeString[12];
+	SafeSnprintf(poolSizeString, sizeof(poolSizeString), "%d",
+				 Max(WorkerConnectionPoolSize, 1));
+
+	SetConfigOption("citus.max_cached_conns_per_worker", poolSizeString,
+					PGC_SUSET, PGC_S_OVERRIDE);
+	SetConfigOption("citus.max_cached_connection_lifetime", "-1",
+					PGC_SUSET, PGC_S_OVERRIDE);
+}
+
+
+/*
+ * ClaimPooledRequests attaches to the requests that the backends submitted
+ * since the last call.
+ */
+static void
+ClaimPooledRequests(WorkerConnectionPoolerState *poolerState)
+{
+	int claimedHandleCount = 0;
+	dsm_handle *claimedHandles = NULL;
+
+	LWLockAcquire(&WorkerConnectionPoolShared->lock, LW_EXCLUSIVE);
+
+	WorkerConnectionPooler *pooler = FindWorkerConnectionPooler(MyDatabaseId);
+	if (pooler != NULL &&
+		pooler->submittedRequestCount != poolerState->claimedRequestCount)
+	{
+		int slotCount = WorkerConnectionPoolShared->slotCount;
+		claimedHandles = palloc(slotCount * sizeof(dsm_handle));
+
+		for (int slotIndex = 0; slotIndex < slotCount; slotIndex++)
+		{
+			PooledRequestSlot *slot = &PooledRequestSlots[slotIndex];
+			if (slot->databaseId != MyDatabaseId ||
+				slot->segmentHandle == DSM_HANDLE_INVALID ||
+				slot->claimed)
+			{
+				continue;
+			}
+
+			slot->claimed = true;
+			claimedHandles[claimedHandleCount++] = slot->segmentHandle;
+		}
+
+		poolerState->claimedRequestCount = pooler->submittedRequestCount;
+	}
+
+	LWLockRelease(&WorkerConnectionPoolShared->lock);
+
+	for (int handleIndex = 0; handleIndex < claimedHandleCount; handleIndex++)
+	{
+		AttachPooledRequest(poolerState, claimedHandles[handleIndex]);
+	}
+
+	if (claimedHandles != NULL)
+	{
+		pfree(claimedHandles);
+	}
+}
+
+
+/*
+ * AttachPooledRequest attaches to the DSM segment of a request, and adds its
+ * tasks to the pending tasks.
+ */
+static void
+AttachPooledRequest(WorkerConnectionPoolerState *poolerState,
+					dsm_handle segmentHandle)
+{
+	dsm_segment *segment = dsm_attach(segmentHandle);
+	if (segment == NULL)
+	{
+		/* the backend already gave up on the request */
+		return;
+	}
+
+	/* the mapping should outlive the transactions that we start */
+	dsm_pin_mapping(segment);
+
+	shm_toc *toc = shm_toc_attach(POOLED_EXECUTION_MAGIC, dsm_segment_address(segment));
+	if (toc == NULL)
+	{
+		dsm_detach(segment);
+		return;
+	}
+
+	PooledRequestHeader *header =
+		shm_toc_lookup(toc, POOLED_EXECUTION_KEY_HEADER, false);
+	char *requestData = shm_toc_lookup(toc, POOLED_EXECUTION_KEY_REQUEST, false);
+	shm_mq *responseQueue =
+		shm_toc_lookup(toc, POOLED_EXECUTION_KEY_RESPONSE_QUEUE, false);
+
+	MemoryContext requestContext = AllocSetContextCreate(poolerState->context,
+														 "Pooled Request",
+														 ALLOCSET_SMALL_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(requestContext);
+
+	PooledRequest *request = palloc0(sizeof(PooledRequest));
+	request->context = requestContext;
+	request->segment = segment;
+	request->header = header;
+	strlcpy(request->userName, header->userName, NAMEDATALEN);
+
+	shm_mq_set_sender(responseQueue, MyProc);
+	request->responseQueue = shm_mq_attach(responseQueue, segment, NULL);
+
+	StringInfoData requestBuffer;
+	requestBuffer.data = requestData;
+	requestBuffer.len = header->requestSize;
+	requestBuffer.maxlen = header->requestSize;
+	requestBuffer.cursor = 0;
+
+	int taskCount = (int) pq_getmsgint(&requestBuffer, 4);
+	List *taskList = NIL;
+
+	for (int taskIndex = 0; taskIndex < taskCount; taskIndex++)
+	{
+		PooledTaskExecution *taskExecution = palloc0(sizeof(PooledTaskExecution));
+		taskExecution->request = request;
+		taskExecution->taskIndex = taskIndex;
+		taskExecution->queryString = GetPooledString(&requestBuffer);
+
+		int parameterCount = (int) pq_getmsgint(&requestBuffer, 4);
+		taskExecution->parameterCount = parameterCount;
+		taskExecution->parameterTypes = palloc0(Max(parameterCount, 1) * sizeof(Oid));
+		taskExecution->parameterValues = palloc0(Max(parameterCount, 1) *
+												 sizeof(char *));
+
+		for (int parameterIndex = 0; parameterIndex < parameterCount; parameterIndex++)
+		{
+			taskExecution->parameterTypes[parameterIndex] =
+				(Oid) pq_getmsgint(&requestBuffer, 4);
+			taskExecution->parameterValues[parameterIndex] =
+				GetPooledString(&requestBuffer);
+		}
+
+		int placementCount = (int) pq_getmsgint(&requestBuffer, 4);
+		taskExecution->placementCount = placementCount;
+		taskExecution->nodeNames = palloc0(Max(placementCount, 1) * sizeof(char *));
+		taskExecution->nodePorts = palloc0(Max(placementCount, 1) * sizeof(int));
+
+		for (int placementIndex = 0; placementIndex < placementCount; placementIndex++)
+		{
+			taskExecution->nodeNames[placementIndex] = GetPooledString(&requestBuffer);
+			taskExecution->nodePorts[placementIndex] =
+				(int) pq_getmsgint(&requestBuffer, 4);
+		}
+
+		/* the request context might be gone before we are done with the list */
+		MemoryContextSwitchTo(poolerState->context);
+		taskList = lappend(taskList, taskExecution);
+		MemoryContextSwitchTo(requestContext);
+	}
+
+	request->unfinishedTaskCount = taskCount;
+
+	/* the lists of the pooler outlive the request */
+	MemoryContextSwitchTo(poolerState->context);
+
+	poolerState->requestList = lappend(poolerState->requestList, request);
+
+	PooledTaskExecution *taskExecution = NULL;
+	foreach_declared_ptr(taskExecution, taskList)
+	{
+		if (taskExecution->placementCount == 0)
+		{
+			SendPooledConnectionError(taskExecution, "", 0,
+									  "task has no placements");
+			PooledTaskFinished(poolerState, taskExecution);
+			continue;
+		}
+
+		poolerState->pendingTaskList = lappend(poolerState->pendingTaskList,
+											   taskExecution);
+	}
+
+	list_free(taskList);
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * AssignPendingTasks starts the pending tasks on idle pooled connections,
+ * and opens new connections for them as long as the pool size allows.
+ */
+static void
+AssignPendingTasks(WorkerConnectionPoolerState *poolerState)
+{
+	List *stillPendingTaskList = NIL;
+	bool inTransaction = false;
+
+	/*
+	 * The connection management closes broken connections at the end of the
+	 * transactions below, so we drop those from the pool first. Their tasks
+	 * become pending again.
+	 */
+	CloseFailedPooledConnections(poolerState);
+
+	PooledTaskExecution *taskExecution = NULL;
+	foreach_declared_ptr(taskExecution, poolerState->pendingTaskList)
+	{
+		PooledRequest *request = taskExecution->request;
+		if (request->abandoned)
+		{
+			PooledTaskFinished(poolerState, taskExecution);
+			continue;
+		}
+
+		char *nodeName = taskExecution->nodeNames[taskExecution->placementIndex];
+		int nodePort = taskExecution->nodePorts[taskExecution->placementIndex];
+
+		PooledConnection *pooledConnection =
+			FindIdlePooledConnection(poolerState, nodeName, nodePort,
+									 request->userName);
+
+		if (pooledConnection == NULL &&
+			MakeRoomForPooledConnection(poolerState, nodeName, nodePort))
+		{
+			if (!inTransaction)
+			{
+				/* connection establishment reads the catalogs */
+				StartTransactionCommand();
+				PushActiveSnapshot(GetTransactionSnapshot());
+				MemoryContextSwitchTo(poolerState->context);
+				inTransaction = true;
+			}
+
+			pooledConnection = OpenPooledConnection(poolerState, nodeName, nodePort,
+													request->userName, taskExecution);
+			if (pooledConnection == NULL && taskExecution->failed)
+			{
+				/* OpenPooledConnection reported the error */
+				PooledTaskFinished(poolerState, taskExecution);
+				continue;
+			}
+		}
+
+		if (pooledConnection == NULL)
+		{
+			stillPendingTaskList = lappend(stillPendingTaskList, taskExecution);
+			continue;
+		}
+
+		if (!StartPooledTask(pooledConnection, taskExecution))
+		{
+			MultiConnection *connection = pooledConnection->connection;
+			PooledTaskConnectionFailed(poolerState, taskExecution, connection);
+			ClosePooledConnection(poolerState, pooledConnection);
+
+			if (!taskExecution->failed)
+			{
+				stillPendingTaskList = lappend(stillPendingTaskList, taskExecution);
+			}
+			else
+			{
+				PooledTaskFinished(poolerState, taskExecution);
+			}
+		}
+	}
+
+	if (inTransaction)
+	{
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+		MemoryContextSwitchTo(poolerState->context);
+	}
+
+	list_free(poolerState->pendingTaskList);
+	poolerState->pendingTaskList = stillPendingTaskList;
+}
+
+
+/*
+ * FindIdlePooledConnection returns an idle connection to the given node as
+ * the given user, or NULL if there is none.
+ */
+static PooledConnection *
+FindIdlePooledConnection(WorkerConnectionPoolerState *poolerState, char *nodeName,
+						 int nodePort, char *userName)
+{
+	PooledConnection *pooledConnection = NULL;
+	foreach_declared_ptr(pooledConnection, poolerState->connectionList)
+	{
+		MultiConnection *connection = pooledConnection->connection;
+
+		if (pooledConnection->taskExecution == NULL &&
+			connection->port == nodePort &&
+			strncmp(connection->hostname, nodeName, MAX_NODE_LENGTH) == 0 &&
+			strncmp(connection->user, userName, NAMEDATALEN) == 0)
+		{
+			return pooledConnection;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * MakeRoomForPooledConnection returns true if the pool of the given node can
+ * take another connection. If the pool is full but some of its connections
+ * are idle, they belong to other users, so we close one of them.
+ */
+static bool
+MakeRoomForPooledConnection(WorkerConnectionPoolerState *poolerState,
+							char *nodeName, int nodePort)
+{
+	int connectionCount = 0;
+	PooledConnection *idleConnection = NULL;
+
+	PooledConnection *pooledConnection = NULL;
+	foreach_declared_ptr(pooledConnection, poolerState->connectionList)
+	{
+		MultiConnection *connection = pooledConnection->connection;
+
+		if (connection->port != nodePort ||
+			strncmp(connection->hostname, nodeName, MAX_NODE_LENGTH) != 0)
+		{
+			continue;
+		}
+
+		connectionCount++;
+
+		if (pooledConnection->taskExecution == NULL)
+		{
+			idleConnection = pooledConnection;
+		}
+	}
+
+	if (connectionCount < WorkerConnectionPoolSize)
+	{
+		return true;
+	}
+
+	if (idleConnection != NULL)
+	{
+		ClosePooledConnection(poolerState, idleConnection);
+		return true;
+	}
+
+	return false;
+}
+
+
+/*
+ * OpenPooledConnection establishes a new pooled connection to the given node
+ * as the given user. It returns NULL if the shared pool does not allow
+ * another connection right now, or if the connection failed, in which case
+ * the task fails over to its next placement or reports an error.
+ */
+static PooledConnection *
+OpenPooledConnection(WorkerConnectionPoolerState *poolerState, char *nodeName,
+					 int nodePort, char *userName, PooledTaskExecution *taskExecution)
+{
+	/* the pooled connections count against citus.max_shared_pool_size too */
+	int connectionFlags = FORCE_NEW_CONNECTION | OPTIONAL_CONNECTION;
+
+	MultiConnection *connection =
+		StartNodeUserDatabaseConnection(connectionFlags, nodeName, nodePort,
+										userName, NULL);
+	if (connection == NULL)
+	{
+		return NULL;
+	}
+
+	FinishConnectionEstablishment(connection);
+
+	if (PQstatus(connection->pgConn) != CONNECTION_OK)
+	{
+		PooledTaskConnectionFailed(poolerState, taskExecution, connection);
+		CloseConnection(connection);
+
+		return NULL;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(poolerState->context);
+
+	PooledConnection *pooledConnection = palloc0(sizeof(PooledConnection));
+	pooledConnection->connection = connection;
+
+	poolerState->connectionList = lappend(poolerState->connectionList,
+										  pooledConnection);
+	MemoryContextSwitchTo(oldContext);
+
+	return pooledConnection;
+}
+
+
+/*
+ * StartPooledTask sends the query of the given task over the given
+ * connection.
+ */
+static bool
+StartPooledTask(PooledConnection *pooledConnection, PooledTaskExecution *taskExecution)
+{
+	MultiConnection *connection = pooledConnection->connection;
+	int querySent = 0;
+
+	if (taskExecution->parameterCount > 0)
+	{
+		bool binaryResults = false;
+		querySent = SendRemoteCommandParams(connection, taskExecution->queryString,
+											taskExecution->parameterCount,
+											taskExecution->parameterTypes,
+											(const char *const *) taskExecution->
+											parameterValues,
+											binaryResults);
+	}
+	else
+	{
+		querySent = SendRemoteCommand(connection, taskExecution->queryString);
+	}
+
+	if (querySent == 0 || PQsetSingleRowMode(connection->pgConn) == 0)
+	{
+		return false;
+	}
+
+	pooledConnection->taskExecution = taskExecution;
+
+	return true;
+}
+
+
+/*
+ * WaitForPooledConnections waits until a busy pooled connection has results
+ * or a backend submits a request, and processes the connections that are
+ * ready.
+ */
+static void
+WaitForPooledConnections(WorkerConnectionPoolerState *poolerState)
+{
+	List *busyConnectionList = NIL;
+
+	PooledConnection *pooledConnection = NULL;
+	foreach_declared_ptr(pooledConnection, poolerState->connectionList)
+	{
+		if (pooledConnection->taskExecution != NULL)
+		{
+			busyConnectionList = lappend(busyConnectionList, pooledConnection);
+		}
+	}
+
+	/* room for the latch and postmaster death events */
+	int eventSetSize = list_length(busyConnectionList) + 2;
+	WaitEventSet *waitEventSet = CreateWaitEventSet(WaitEventSetTracker_compat,
+													eventSetSize);
+	AddWaitEventToSet(waitEventSet, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
+	AddWaitEventToSet(waitEventSet, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL, NULL);
+
+	List *failedConnectionList = NIL;
+	List *readyConnectionList = NIL;
+
+	foreach_declared_ptr(pooledConnection, busyConnectionList)
+	{
+		PGconn *pgConn = pooledConnection->connection->pgConn;
+		PooledRequest *request = pooledConnection->taskExecution->request;
+
+		/* the connections are non-blocking, the query might not be sent yet */
+		int flushResult = PQflush(pgConn);
+		if (flushResult == -1)
+		{
+			failedConnectionList = lappend(failedConnectionList, pooledConnection);
+			continue;
+		}
+
+		uint32 waitFlags = 0;
+		if (flushResult == 1)
+		{
+			waitFlags |= WL_SOCKET_WRITEABLE;
+		}
+
+		/* leave the results in the socket until the backend catches up */
+		if (!PooledRequestBlocked(request))
+		{
+			if (!PQisBusy(pgConn))
+			{
+				/* we stopped reading results while the request was blocked */
+				readyConnectionList = lappend(readyConnectionList, pooledConnection);
+				continue;
+			}
+
+			waitFlags |= WL_SOCKET_READABLE;
+		}
+
+		if (waitFlags == 0)
+		{
+			continue;
+		}
+
+		int eventIndex = CitusAddWaitEventSetToSet(waitEventSet, waitFlags,
+												   PQsocket(pgConn), NULL,
+												   (void *) pooledConnection);
+		if (eventIndex < 0)
+		{
+			failedConnectionList = lappend(failedConnectionList, pooledConnection);
+		}
+	}
+
+	/*
+	 * Retry pending tasks in a while, since connection slots of the shared pool
+	 * do not wake us up when they become available. Backends set our latch when
+	 * they read from or detach from a queue, so blocked requests need no timeout.
+	 */
+	long timeout = poolerState->pendingTaskList != NIL ? POOLER_RETRY_INTERVAL_MS :
+				   -1;
+	if (failedConnectionList != NIL || readyConnectionList != NIL)
+	{
+		timeout = 0;
+	}
+
+	WaitEvent *events = palloc0(eventSetSize * sizeof(WaitEvent));
+	int eventCount = WaitEventSetWait(waitEventSet, timeout, events, eventSetSize,
+									  PG_WAIT_EXTENSION);
+
+	for (int eventIndex = 0; eventIndex < eventCount; eventIndex++)
+	{
+		WaitEvent *event = &events[eventIndex];
+
+		if (event->events & WL_POSTMASTER_DEATH)
+		{
+			proc_exit(1);
+		}
+
+		if (event->events & WL_LATCH_SET)
+		{
+			ResetLatch(MyLatch);
+			continue;
+		}
+
+		if (event->user_data != NULL)
+		{
+			readyConnectionList = lappend(readyConnectionList, event->user_data);
+		}
+	}
+
+	FreeWaitEventSet(waitEventSet);
+	pfree(events);
+
+	foreach_declared_ptr(pooledConnection, failedConnectionList)
+	{
+		PooledConnectionFailed(poolerState, pooledConnection);
+	}
+
+	foreach_declared_ptr(pooledConnection, readyConnectionList)
+	{
+		ProcessPooledConnection(poolerState, pooledConnection);
+	}
+
+	list_free(busyConnectionList);
+	list_free(failedConnectionList);
+	list_free(readyConnectionList);
+}
+
+
+/*
+ * ProcessPooledConnection forwards the results that arrived on the given
+ * connection to the backend of its task.
+ */
+static void
+ProcessPooledConnection(WorkerConnectionPoolerState *poolerState,
+						PooledConnection *pooledConnection)
+{
+	MultiConnection *connection = pooledConnection->connection;
+	PGconn *pgConn = connection->pgConn;
+	PooledTaskExecution *taskExecution = pooledConnection->taskExecution;
+
+	if (PQflush(pgConn) == -1 || PQconsumeInput(pgConn) == 0)
+	{
+		PooledConnectionFailed(poolerState, pooledConnection);
+		return;
+	}
+
+	while (!PQisBusy(pgConn))
+	{
+		if (PooledRequestBlocked(taskExecution->request))
+		{
+			/* WaitForPooledConnections comes back once the queue has room */
+			return;
+		}
+
+		PGresult *result = PQgetResult(pgConn);
+		if (result == NULL)
+		{
+			/* the connection is idle again */
+			pooledConnection->taskExecution = NULL;
+
+			if (!taskExecution->failed)
+			{
+				StringInfoData message;
+				initStringInfo(&message);
+				pq_sendbyte(&message, POOLED_MESSAGE_TASK_DONE);
+				pq_sendint32(&message, taskExecution->taskIndex);
+
+				bool forceFlush = true;
+				SendPooledMessage(taskExecution->request, &message, forceFlush);
+				pfree(message.data);
+			}
+
+			PooledTaskFinished(poolerState, taskExecution);
+			return;
+		}
+
+		ExecStatusType resultStatus = PQresultStatus(result);
+		if (resultStatus == PGRES_SINGLE_TUPLE)
+		{
+			if (!taskExecution->failed)
+			{
+				SendPooledRow(taskExecution, result);
+			}
+
+			taskExecution->rowsSent = true;
+		}
+		else if (resultStatus != PGRES_TUPLES_OK && resultStatus != PGRES_COMMAND_OK)
+		{
+			if (!taskExecution->failed)
+			{
+				SendPooledResultError(taskExecution, connection, result);
+			}
+
+			taskExecution->failed = true;
+		}
+
+		PQclear(result);
+	}
+}
+
+
+/*
+ * PooledConnectionFailed handles a pooled connection that broke while it ran
+ * a task: the task fails over to its next placement or reports an error,
+ * and the connection is removed from the pool.
+ */
+static void
+PooledConnectionFailed(WorkerConnectionPoolerState *poolerState,
+					   PooledConnection *pooledConnection)
+{
+	PooledTaskExecution *taskExecution = pooledConnection->taskExecution;
+
+	if (taskExecution != NULL)
+	{
+		PooledTaskConnectionFailed(poolerState, taskExecution,
+								   pooledConnection->connection);
+
+		if (taskExecution->failed)
+		{
+			PooledTaskFinished(poolerState, taskExecution);
+		}
+		else
+		{
+			MemoryContext oldContext = MemoryContextSwitchTo(poolerState->context);
+			poolerState->pendingTaskList = lappend(poolerState->pendingTaskList,
+												   taskExecution);
+			MemoryContextSwitchTo(oldContext);
+		}
+	}
+
+	ClosePooledConnection(poolerState, pooledConnection);
+}
+
+
+/*
+ * ClosePooledConnection closes the given connection and removes it from the
+ * pool.
+ */
+static void
+ClosePooledConnection(WorkerConnectionPoolerState *poolerState,
+					  PooledConnection *pooledConnection)
+{
+	poolerState->connectionList = list_delete_ptr(poolerState->connectionList,
+												  pooledConnection);
+	CloseConnection(pooledConnection->connection);
+	pfree(pooledConnection);
+}
+
+
+/*
+ * CloseFailedPooledConnections removes the idle connections that broke from
+ * the pool.
+ */
+static void
+CloseFailedPooledConnections(WorkerConnectionPoolerState *poolerState)
+{
+	List *failedConnectionList = NIL;
+
+	PooledConnection *pooledConnection = NULL;
+	foreach_declared_ptr(pooledConnection, poolerState->connectionList)
+	{
+		if (PQstatus(pooledConnection->connection->pgConn) != CONNECTION_OK)
+		{
+			failedConnectionList = lappend(failedConnectionList, pooledConnection);
+		}
+	}
+
+	foreach_declared_ptr(pooledConnection, failedConnectionList)
+	{
+		PooledConnectionFailed(poolerState, pooledConnection);
+	}
+
+	list_free(failedConnectionList);
+}
+
+
+/*
+ * PooledTaskConnectionFailed moves the given task to its next placement
+ * after its connection failed, or reports the connection error if it
+ * already sent rows or there are no placements left. In the latter case it
+ * marks the task as failed.
+ */
+static void
+PooledTaskConnectionFailed(WorkerConnectionPoolerState *poolerState,
+						   PooledTaskExecution *taskExecution,
+						   MultiConnection *connection)
+{
+	if (!taskExecution->rowsSent &&
+		taskExecution->placementIndex + 1 < taskExecution->placementCount)
+	{
+		taskExecution->placementIndex++;
+		return;
+	}
+
+	if (!taskExecution->failed)
+	{
+		char *errorMessage = pchomp(PQerrorMessage(connection->pgConn));
+		if (errorMessage == NULL || errorMessage[0] == '\0')
+		{
+			errorMessage = "connection not open";
+		}
+
+		SendPooledConnectionError(taskExecution, connection->hostname,
+								  connection->port, errorMessage);
+	}
+
+	taskExecution->failed = true;
+}
+
+
+/*
+ * SendPooledRow sends the row in the given single-row result to the backend
+ * of the task.
+ */
+static void
+SendPooledRow(PooledTaskExecution *taskExecution, PGresult *result)
+{
+	int columnCount = PQnfields(result);
+
+	StringInfoData message;
+	initStringInfo(&message);
+	pq_sendbyte(&message, POOLED_MESSAGE_ROW);
+	pq_sendint32(&message, taskExecution->taskIndex);
+	pq_sendint32(&message, columnCount);
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		if (PQgetisnull(result, 0, columnIndex))
+		{
+			pq_sendint32(&message, -1);
+			continue;
+		}
+
+		int valueLength = PQgetlength(result, 0, columnIndex);
+		pq_sendint32(&message, valueLength);
+		pq_sendbytes(&message, PQgetvalue(result, 0, columnIndex), valueLength);
+	}
+
+	/* rows are flushed once the queue fills up, or with the next done message */
+	bool forceFlush = false;
+	SendPooledMessage(taskExecution->request, &message, forceFlush);
+	pfree(message.data);
+}
+
+
+/*
+ * SendPooledResultError sends the error in the given result to the backend
+ * of the task, which throws it.
+ */
+static void
+SendPooledResultError(PooledTaskExecution *taskExecution, MultiConnection *connection,
+					  PGresult *result)
+{
+	char *messagePrimary = PQresultErrorField(result, PG_DIAG_MESSAGE_PRIMARY);
+	if (messagePrimary == NULL)
+	{
+		messagePrimary = pchomp(PQerrorMessage(connection->pgConn));
+	}
+
+	StringInfoData message;
+	initStringInfo(&message);
+	pq_sendbyte(&message, POOLED_MESSAGE_ERROR);
+	pq_sendint32(&message, taskExecution->taskIndex);
+	SendPooledString(&message, PQresultErrorField(result, PG_DIAG_SQLSTATE));
+	SendPooledString(&message, messagePrimary);
+	SendPooledString(&message, PQresultErrorField(result, PG_DIAG_MESSAGE_DETAIL));
+	SendPooledString(&message, PQresultErrorField(result, PG_DIAG_MESSAGE_HINT));
+	SendPooledString(&message, PQresultErrorField(result, PG_DIAG_CONTEXT));
+	SendPooledString(&message, connection->hostname);
+	pq_sendint32(&message, connection->port);
+
+	bool forceFlush = true;
+	SendPooledMessage(taskExecution->request, &message, forceFlush);
+	pfree(message.data);
+
+	/* the backend throws the error, so the other tasks are not needed */
+	taskExecution->request->abandoned = true;
+}
+
+
+/*
+ * SendPooledConnectionError sends a connection failure to the backend of the
+ * task, in the same format as ReportConnectionError.
+ */
+static void
+SendPooledConnectionError(PooledTaskExecution *taskExecution, char *nodeName,
+						  int nodePort, const char *errorMessage)
+{
+	StringInfoData messagePrimary;
+	initStringInfo(&messagePrimary);
+	appendStringInfo(&messagePrimary,
+					 "connection to the remote node %s@%s:%d failed with the "
+					 "following error: %s", taskExecution->request->userName,
+					 nodeName, nodePort, errorMessage);
+
+	StringInfoData message;
+	initStringInfo(&message);
+	pq_sendbyte(&message, POOLED_MESSAGE_ERROR);
+	pq_sendint32(&message, taskExecution->taskIndex);
+	SendPooledString(&message, "08006");
+	SendPooledString(&message, messagePrimary.data);
+	SendPooledString(&message, NULL);
+	SendPooledString(&message, NULL);
+	SendPooledString(&message, NULL);
+	SendPooledString(&message, nodeName);
+	pq_sendint32(&message, nodePort);
+
+	bool forceFlush = true;
+	SendPooledMessage(taskExecution->request, &message, forceFlush);
+	pfree(message.data);
+	pfree(messagePrimary.data);
+
+	taskExecution->request->abandoned = true;
+}
+
+
+/*
+ * SendPooledMessage sends the given message to the backend of the request.
+ * We never wait for room in the queue, since that would hold up the tasks
+ * of all other backends and keep us from noticing SIGTERM. Instead, the
+ * message is buffered, and FlushPooledRequests sends it once the backend
+ * has read from the queue. If the backend is gone, the request is marked as
+ * abandoned.
+ */
+static void
+SendPooledMessage(PooledRequest *request, StringInfo message, bool forceFlush)
+{
+	if (request->abandoned)
+	{
+		return;
+	}
+
+	if (request->bufferedMessageList == NIL)
+	{
+		bool noWait = true;
+		shm_mq_result result = shm_mq_send(request->responseQueue, message->len,
+										   message->data, noWait, forceFlush);
+		if (result == SHM_MQ_SUCCESS)
+		{
+			return;
+		}
+		else if (result == SHM_MQ_DETACHED)
+		{
+			request->abandoned = true;
+			return;
+		}
+
+		/*
+		 * Part of the message might be in the queue already, the rest is sent
+		 * by calling shm_mq_send again with the same message.
+		 */
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(request->context);
+
+	PooledMessage *bufferedMessage = palloc0(sizeof(PooledMessage));
+	initStringInfo(&bufferedMessage->data);
+	appendBinaryStringInfo(&bufferedMessage->data, message->data, message->len);
+	bufferedMessage->forceFlush = forceFlush;
+
+	request->bufferedMessageList = lappend(request->bufferedMessageList,
+										   bufferedMessage);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * FlushPooledRequests sends the buffered messages of the requests, abandons
+ * the requests that the backends gave up on, and releases the requests whose
+ * tasks are finished once all of their messages are sent.
+ */
+static void
+FlushPooledRequests(WorkerConnectionPoolerState *poolerState)
+{
+	/* ReleasePooledRequest removes requests from the list */
+	List *requestList = list_copy(poolerState->requestList);
+
+	PooledRequest *request = NULL;
+	foreach_declared_ptr(request, requestList)
+	{
+		if (pg_atomic_read_u32(&request->header->cancelled) != 0)
+		{
+			/* the backend is gone, the messages are freed with the request */
+			request->abandoned = true;
+			request->bufferedMessageList = NIL;
+		}
+
+		FlushPooledMessages(request);
+
+		if (request->unfinishedTaskCount == 0 && request->bufferedMessageList == NIL)
+		{
+			ReleasePooledRequest(poolerState, request);
+		}
+	}
+
+	list_free(requestList);
+}
+
+
+/*
+ * FlushPooledMessages sends as many of the buffered messages of the given
+ * request as fit into its queue. If the backend is gone, the messages are
+ * dropped.
+ */
+static void
+FlushPooledMessages(PooledRequest *request)
+{
+	while (request->bufferedMessageList != NIL)
+	{
+		PooledMessage *bufferedMessage = linitial(request->bufferedMessageList);
+
+		bool noWait = true;
+		shm_mq_result result = shm_mq_send(request->responseQueue,
+										   bufferedMessage->data.len,
+										   bufferedMessage->data.data, noWait,
+										   bufferedMessage->forceFlush);
+		if (result == SHM_MQ_WOULD_BLOCK)
+		{
+			return;
+		}
+		else if (result == SHM_MQ_DETACHED)
+		{
+			/* the messages are freed with the request */
+			request->abandoned = true;
+			request->bufferedMessageList = NIL;
+			return;
+		}
+
+		request->bufferedMessageList = list_delete_first(request->bufferedMessageList);
+		pfree(bufferedMessage->data.data);
+		pfree(bufferedMessage);
+	}
+}
+
+
+/*
+ * PooledRequestBlocked returns true if we should not read further results
+ * of the tasks of the given request, because the backend did not read the
+ * previous ones yet. Abandoned requests do not send results, hence they are
+ * never blocked.
+ */
+static bool
+PooledRequestBlocked(PooledRequest *request)
+{
+	return !request->abandoned && request->bufferedMessageList != NIL;
+}
+
+
+/*
+ * CancelAbandonedTasks cancels the running tasks of abandoned requests, since
+ * nobody is waiting for the rest of their rows.
+ */
+static void
+CancelAbandonedTasks(WorkerConnectionPoolerState *poolerState)
+{
+	PooledConnection *pooledConnection = NULL;
+	foreach_declared_ptr(pooledConnection, poolerState->connectionList)
+	{
+		PooledTaskExecution *taskExecution = pooledConnection->taskExecution;
+		if (taskExecution == NULL || taskExecution->failed ||
+			!taskExecution->request->abandoned)
+		{
+			continue;
+		}
+
+		SendCancelationRequest(pooledConnection->connection);
+		taskExecution->failed = true;
+	}
+}
+
+
+/*
+ * PooledTaskFinished accounts for a task that will not use a connection
+ * anymore, and releases its request once all of its tasks are finished and
+ * all of its messages are sent. Otherwise, FlushPooledRequests releases it
+ * later. The task must not be used afterwards.
+ */
+static void
+PooledTaskFinished(WorkerConnectionPoolerState *poolerState,
+				   PooledTaskExecution *taskExecution)
+{
+	PooledRequest *request = taskExecution->request;
+
+	request->unfinishedTaskCount--;
+	if (request->unfinishedTaskCount > 0 || request->bufferedMessageList != NIL)
+	{
+		return;
+	}
+
+	ReleasePooledRequest(poolerState, request);
+}
+
+
+/*
+ * ReleasePooledRequest detaches from the queue and the DSM segment of the
+ * given request, and frees it.
+ */
+static void
+ReleasePooledRequest(WorkerConnectionPoolerState *poolerState, PooledRequest *request)
+{
+	poolerState->requestList = list_delete_ptr(poolerState->requestList, request);
+
+	shm_mq_detach(request->responseQueue);
+	dsm_detach(request->segment);
+	MemoryContextDelete(request->context);
+}
+
+
+/*
+ * WorkerConnectionPoolerSigTermHandler sets a flag to request termination of
+ * the pooler.
+ */
+static void
+WorkerConnectionPoolerSigTermHandler(SIGNAL_ARGS)
+{
+	int save_errno = errno;
+
+	got_SIGTERM = true;
+	if (MyProc != NULL)
+	{
+		SetLatch(&MyProc->procLatch);
+	}
+
+	errno = save_errno;
+}
+
+
+/*
+ * WorkerConnectionPoolerSigHupHandler sets a flag to re-read the config file
+ * at the next convenient time.
+ */
+static void
+WorkerConnectionPoolerSigHupHandler(SIGNAL_ARGS)
+{
+	int save_errno = errno;
+
+	got_SIGHUP = true;
+	if (MyProc != NULL)
+	{
+		SetLatch(&MyProc->procLatch);
+	}
+
+	errno = save_errno;
+}
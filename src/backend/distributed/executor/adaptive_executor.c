@@ -84,6 +84,13 @@
  * own readyTaskQueue and otherwise takes a task from the worker pool's
  * readyTaskQueue (on a first-come-first-serve basis).
  *
+ * When citus.enable_pipelined_execution is enabled, a session that is ready
+ * to execute tasks instead takes all of its assigned tasks and a fair share of
+ * the unassigned tasks, and sends them (preceded by BEGIN when the session
+ * still needs to open a transaction block) in a single libpq pipeline. The
+ * results are then received in order, which saves a network round trip per
+ * task when multiple tasks run over the same connection.
+ *
  * In cases where the tasks finish quickly (e.g. <1ms), a single
  * connection will often be sufficient to finish all tasks. It is
  * therefore not necessary that all connections are established
@@ -115,6 +122,11 @@
  * Execution finishes when all tasks are done, the query errors out, or
  * the user cancels the query.
  *
+ * When citus.enable_streaming_results is enabled, simple read-only queries
+ * do not run the execution to completion in AdaptiveExecutor. Instead, the
+ * custom scan runs the event loop until some rows arrive whenever it has
+ * returned all rows in its tuple store.
+ *
  *-------------------------------------------------------------------------
  */
 
@@ -142,6 +154,7 @@
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/portal.h"
 #include "utils/syscache.h"
 #include "utils/timestamp.h"
 
@@ -152,6 +165,7 @@
 #include "distributed/citus_safe_lib.h"
 #include "distributed/commands/multi_copy.h"
 #include "distributed/connection_management.h"
+#include "distributed/connection_warmup.h"
 #include "distributed/deparse_shard_query.h"
 #include "distributed/distributed_execution_locks.h"
 #include "distributed/executor_util.h"
@@ -168,6 +182,7 @@
 #include "distributed/placement_connection.h"
 #include "distributed/relation_access_tracking.h"
 #include "distributed/remote_commands.h"
+#include "distributed/remote_prepared_statements.h"
 #include "distributed/repartition_join_execution.h"
 #include "distributed/resource_lock.h"
 #include "distributed/shared_connection_stats.h"
@@ -177,6 +192,7 @@
 #include "distributed/transaction_management.h"
 #include "distributed/tuple_destination.h"
 #include "distributed/version_compat.h"
+#include "distributed/worker_connection_pool.h"
 #include "distributed/worker_protocol.h"
 
 #define SLOW_START_DISABLED 0
@@ -315,6 +331,22 @@ typedef struct DistributedExecution
 	 * fail, such as CREATE INDEX CONCURRENTLY.
 	 */
 	bool localExecutionSupported;
+
+	/*
+	 * Indicates whether the tasks can be sent to the workers in libpq
+	 * pipeline mode, which requires every query to be a single statement.
+	 */
+	bool pipeliningSupported;
+
+	/*
+	 * When results are streamed, the custom scan steps the execution whenever
+	 * it runs out of rows, so the execution outlives AdaptiveExecutor() in
+	 * executionContext.
+	 */
+	MemoryContext executionContext;
+
+	/* set when the event loop was interrupted by a cancellation */
+	bool cancellationReceived;
 } DistributedExecution;
 
 
@@ -437,6 +469,14 @@ typedef struct WorkerPool
 	/* execution statistics per pool, in microseconds */
 	uint64 totalTaskExecutionTime;
 	int totalExecutedTasks;
+
+	/* connection statistics per pool for connection warm-up */
+	int newConnectionCount;
+	uint64 totalConnectionEstablishmentTime;
+	int warmConnectionCount;
+
+	/* highest number of tasks that were running or ready to run at the same time */
+	int peakTaskDemand;
 } WorkerPool;
 
 struct TaskPlacementExecution;
@@ -473,6 +513,19 @@ typedef struct WorkerSession
 	/* task the worker should work on or NULL */
 	struct TaskPlacementExecution *currentTask;
 
+	/*
+	 * Tasks that are already sent in the current pipeline after currentTask,
+	 * in the order in which their results will arrive.
+	 */
+	dlist_head pipelinedTaskQueue;
+
+	/*
+	 * Number of commands pipelined ahead of the current task, such as BEGIN or
+	 * the PREPARE of a worker prepared statement, whose results are not yet
+	 * cleared.
+	 */
+	int pipelinedSetupCommandCount;
+
 	/*
 	 * The number of commands sent to the worker over the session. Excludes
 	 * distributed transaction related commands such as BEGIN/COMMIT etc.
@@ -498,6 +551,16 @@ bool ForceMaxQueryParallelization = false;
 int MaxAdaptiveExecutorPoolSize = 16;
 bool EnableBinaryProtocol = true;
 
+/* GUC, determining whether sessions send multiple tasks in a libpq pipeline */
+bool EnablePipelinedExecution = false;
+bool EnableStreamingResults = false;
+
+/*
+ * The scan state whose results are currently being streamed, if any. Its
+ * connections are busy until all results are received.
+ */
+static CitusScanState *ActiveStreamingScanState = NULL;
+
 /* GUC, number of ms to wait between opening connections to the same worker */
 int ExecutorSlowStartInterval = 10;
 bool EnableCostBasedConnectionEstablishment = true;
@@ -616,6 +679,9 @@ typedef struct TaskPlacementExecution
 	/* membership in ready-to-start assigned task queue of a particular session */
 	dlist_node sessionReadyQueueNode;
 
+	/* membership in the queue of tasks pipelined on a particular session */
+	dlist_node sessionPipelineQueueNode;
+
 	/* membership in assigned task queue of worker */
 	dlist_node workerPendingQueueNode;
 
@@ -651,8 +717,21 @@ static void StartDistributedExecution(DistributedExecution *execution);
 static void RunLocalExecution(CitusScanState *scanState, DistributedExecution *execution);
 static void RunDistributedExecution(DistributedExecution *execution);
 static void SequentialRunDistributedExecution(DistributedExecution *execution);
+static bool DistributedExecutionFinished(DistributedExecution *execution);
+static void RunDistributedExecutionIteration(DistributedExecution *execution);
+static bool ShouldExecuteViaWorkerConnectionPool(CitusScanState *scanState,
+												DistributedExecution *execution);
+static void RunDistributedExecutionViaConnectionPool(DistributedExecution *execution);
+static bool ShouldStreamDistributedExecution(CitusScanState *scanState,
+											 DistributedExecution *execution);
+static void StartStreamingDistributedExecution(CitusScanState *scanState,
+											   DistributedExecution *execution);
+static void StepStreamingDistributedExecution(CitusScanState *scanState);
+static void FinishActiveStreamingExecution(void);
 static void FinishDistributedExecution(DistributedExecution *execution);
 static void CleanUpSessions(DistributedExecution *execution);
+static void RecordConnectionWarmupStats(DistributedExecution *execution);
+static void UpdatePeakTaskDemand(WorkerPool *workerPool);
 
 static bool DistributedExecutionModifiesDatabase(DistributedExecution *execution);
 static void AssignTasksToConnectionsOrWorkerPool(DistributedExecution *execution);
@@ -687,6 +766,16 @@ static TaskPlacementExecution * PopAssignedPlacementExecution(WorkerSession *ses
 static TaskPlacementExecution * PopUnassignedPlacementExecution(WorkerPool *workerPool);
 static bool StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
 											 WorkerSession *session);
+static bool ShouldUseWorkerPreparedStatement(DistributedExecution *execution,
+											 WorkerSession *session);
+static bool TaskListCanBePipelined(List *taskList);
+static bool ShouldPipelineSession(WorkerSession *session, bool beginRequired);
+static List * PopPipelinedPlacementExecutions(WorkerSession *session);
+static bool StartPipelinedExecutionOnSession(WorkerSession *session,
+											 bool beginRequired);
+static bool AddPlacementExecutionToPipeline(TaskPlacementExecution *placementExecution,
+											WorkerSession *session);
+static bool AdvancePipelinedExecution(WorkerSession *session);
 static bool SendNextQuery(TaskPlacementExecution *placementExecution,
 						  WorkerSession *session);
 static void ConnectionStateMachine(WorkerSession *session);
@@ -790,6 +879,9 @@ AdaptiveExecutor(CitusScanState *scanState)
 	/* we should only call this once before the scan finished */
 	Assert(!scanState->finishedRemoteScan);
 
+	/* the connections of a streamed execution cannot be shared */
+	FinishActiveStreamingExecution();
+
 	MemoryContext localContext = AllocSetContextCreate(CurrentMemoryContext,
 													   "AdaptiveExecutor",
 													   ALLOCSET_DEFAULT_SIZES);
@@ -867,12 +959,48 @@ AdaptiveExecutor(CitusScanState *scanState)
 		jobIdList,
 		localExecutionSupported);
 
+	/*
+	 * Tasks of EXPLAIN ANALYZE consist of multiple queries that we cannot
+	 * send in pipeline mode, ExplainAnalyzeTaskList already reflects that
+	 * in the queryCount of the tasks.
+	 */
+	execution->pipeliningSupported = EnablePipelinedExecution &&
+									 TaskListCanBePipelined(execution->remoteTaskList);
+
 	/*
 	 * Make sure that we acquire the appropriate locks even if the local tasks
 	 * are going to be executed with local execution.
 	 */
 	StartDistributedExecution(execution);
 
+	if (ShouldExecuteViaWorkerConnectionPool(scanState, execution))
+	{
+		RunDistributedExecutionViaConnectionPool(execution);
+
+		/* execute tasks local to the node (if any) */
+		if (list_length(execution->localTaskList) > 0)
+		{
+			RunLocalExecution(scanState, execution);
+		}
+
+		FinishDistributedExecution(execution);
+
+		MemoryContextSwitchTo(oldContext);
+
+		return resultSlot;
+	}
+
+	if (ShouldStreamDistributedExecution(scanState, execution))
+	{
+		/* results are received while the custom scan returns rows */
+		execution->executionContext = localContext;
+		StartStreamingDistributedExecution(scanState, execution);
+
+		MemoryContextSwitchTo(oldContext);
+
+		return resultSlot;
+	}
+
 	if (ShouldRunTasksSequentially(execution->remoteTaskList))
 	{
 		SequentialRunDistributedExecution(execution);
@@ -1095,6 +1223,9 @@ ExecuteTaskListExtended(ExecutionParams *executionParams)
 
 	TupleDestination *defaultTupleDest = executionParams->tupleDestination;
 
+	/* the connections of a streamed execution cannot be shared */
+	FinishActiveStreamingExecution();
+
 	if (MultiShardConnectionType == SEQUENTIAL_CONNECTION)
 	{
 		executionParams->targetPoolSize = 1;
@@ -1200,6 +1331,9 @@ CreateDistributedExecution(RowModifyLevel modLevel, List *taskList,
 
 	execution->localExecutionSupported = localExecutionSupported;
 
+	/* only enabled for plain distributed queries, see AdaptiveExecutor */
+	execution->pipeliningSupported = false;
+
 	/*
 	 * Since task can have multiple queries, we are not sure how many columns we should
 	 * allocate for. We start with 16, and reallocate when we need more.
@@ -1554,6 +1688,7 @@ AssignTasksToConnectionsOrWorkerPool(DistributedExecution *execution)
 									&placementExecution->workerReadyQueueNode);
 
 					workerPool->readyTaskCount++;
+					UpdatePeakTaskDemand(workerPool);
 				}
 				else
 				{
@@ -1742,6 +1877,22 @@ FindOrCreateWorkerPool(DistributedExecution *execution, char *nodeName, int node
 
 	/* "open" connections aggressively when there are cached connections */
 	int nodeConnectionCount = MaxCachedConnectionsPerWorker;
+
+	/*
+	 * With connection warm-up, open as many connections as the recent
+	 * executions could use in parallel on the node in the first cycle. Most of them
+	 * are typically warm connections, the rest is established in parallel
+	 * instead of one slow start interval after the other. Single-task
+	 * executions only ever use a single connection, so do not take the
+	 * lock on the shared statistics for them.
+	 */
+	if (MaxWarmConnectionsPerWorker > 0 &&
+		list_length(execution->remoteTaskList) > 1)
+	{
+		nodeConnectionCount = Max(nodeConnectionCount,
+								  WarmConnectionCount(nodeName, nodePort));
+	}
+
 	workerPool->maxNewConnectionsPerCycle = Max(1, nodeConnectionCount);
 
 	dlist_init(&workerPool->pendingTaskQueue);
@@ -1788,6 +1939,7 @@ FindOrCreateWorkerSession(WorkerPool *workerPool, MultiConnection *connection)
 
 	dlist_init(&session->pendingTaskQueue);
 	dlist_init(&session->readyTaskQueue);
+	dlist_init(&session->pipelinedTaskQueue);
 
 	if (connection->connectionState == MULTI_CONNECTION_CONNECTED)
 	{
@@ -1899,6 +2051,8 @@ RunDistributedExecution(DistributedExecution *execution)
 {
 	AssignTasksToConnectionsOrWorkerPool(execution);
 
+	execution->cancellationReceived = false;
+
 	PG_TRY();
 	{
 		/* Preemptively step state machines in case of immediate errors */
@@ -1908,8 +2062,6 @@ RunDistributedExecution(DistributedExecution *execution)
 			ConnectionStateMachine(session);
 		}
 
-		bool cancellationReceived = false;
-
 		/* always (re)build the wait event set the first time */
 		execution->rebuildWaitEventSet = true;
 
@@ -1930,65 +2082,16 @@ RunDistributedExecution(DistributedExecution *execution)
 		 * cancellation to the query. In that case, we terminate the execution
 		 * irrespective of the current status of the tasks or the connections.
 		 */
-		while (!cancellationReceived &&
-			   (execution->unfinishedTaskCount > 0 ||
-				HasIncompleteConnectionEstablishment(execution)))
+		while (!DistributedExecutionFinished(execution))
 		{
-			WorkerPool *workerPool = NULL;
-			foreach_declared_ptr(workerPool, execution->workerList)
-			{
-				ManageWorkerPool(workerPool);
-			}
-
-			bool skipWaitEvents = false;
-			if (execution->remoteTaskList == NIL)
-			{
-				/*
-				 * All the tasks are failed over to the local execution, no need
-				 * to wait for any connection activity.
-				 */
-				continue;
-			}
-			else if (execution->rebuildWaitEventSet)
-			{
-				RebuildWaitEventSet(execution);
-
-				skipWaitEvents =
-					ProcessSessionsWithFailedWaitEventSetOperations(execution);
-			}
-			else if (execution->waitFlagsChanged)
-			{
-				RebuildWaitEventSetFlags(execution->waitEventSet, execution->sessionList);
-				execution->waitFlagsChanged = false;
-
-				skipWaitEvents =
-					ProcessSessionsWithFailedWaitEventSetOperations(execution);
-			}
-
-			if (skipWaitEvents)
-			{
-				/*
-				 * Some operation on the wait event set is failed, retry
-				 * as we already removed the problematic connections.
-				 */
-				execution->rebuildWaitEventSet = true;
-
-				continue;
-			}
-
-			/* wait for I/O events */
-			long timeout = NextEventTimeout(execution);
-			int eventCount =
-				WaitEventSetWait(execution->waitEventSet, timeout, execution->events,
-								 execution->eventSetSize, WAIT_EVENT_CLIENT_READ);
-
-			ProcessWaitEvents(execution, execution->events, eventCount,
-							  &cancellationReceived);
+			RunDistributedExecutionIteration(execution);
 		}
 
 		FreeExecutionWaitEvents(execution);
 
 		CleanUpSessions(execution);
+
+		RecordConnectionWarmupStats(execution);
 	}
 	PG_CATCH();
 	{
@@ -2007,1242 +2110,2254 @@ RunDistributedExecution(DistributedExecution *execution)
 
 
 /*
- * ProcessSessionsWithFailedWaitEventSetOperations goes over the session list
- * and processes sessions with failed wait event set operations.
- *
- * Failed sessions are not going to generate any further events, so it is our
- * only chance to process the failure by calling into `ConnectionStateMachine`.
+ * ShouldExecuteViaWorkerConnectionPool returns whether the remote tasks of
+ * the given execution can be handed to the worker connection pooler.
  *
- * The function returns true if any session failed.
+ * The pooler runs each task as a single statement on a connection that is
+ * shared with other backends, so we only use it for read-only queries that
+ * do not need a coordinated transaction and that have no ordering
+ * requirements between the tasks.
  */
 static bool
-ProcessSessionsWithFailedWaitEventSetOperations(DistributedExecution *execution)
+ShouldExecuteViaWorkerConnectionPool(CitusScanState *scanState,
+									 DistributedExecution *execution)
 {
-	bool foundFailedSession = false;
-	WorkerSession *session = NULL;
-	foreach_declared_ptr(session, execution->sessionList)
+	if (!WorkerConnectionPoolAvailable())
 	{
-		if (session->waitEventSetIndex == WAIT_EVENT_SET_INDEX_FAILED)
-		{
-			/*
-			 * We can only lost only already connected connections,
-			 * others are regular failures.
-			 */
-			MultiConnection *connection = session->connection;
-			if (connection->connectionState == MULTI_CONNECTION_CONNECTED)
-			{
-				connection->connectionState = MULTI_CONNECTION_LOST;
-			}
-			else
-			{
-				connection->connectionState = MULTI_CONNECTION_FAILED;
-				IncrementStatCounterForMyDb(STAT_CONNECTION_ESTABLISHMENT_FAILED);
-			}
-
-
-			ConnectionStateMachine(session);
-
-			session->waitEventSetIndex = WAIT_EVENT_SET_INDEX_NOT_INITIALIZED;
-
-			foundFailedSession = true;
-		}
+		return false;
 	}
 
-	return foundFailedSession;
-}
+	if (IsMultiStatementTransaction() || InCoordinatedTransaction())
+	{
+		return false;
+	}
 
+	if (execution->modLevel != ROW_MODIFY_READONLY ||
+		execution->transactionProperties->useRemoteTransactionBlocks ==
+		TRANSACTION_BLOCKS_REQUIRED ||
+		execution->remoteTaskList == NIL ||
+		execution->jobIdList != NIL)
+	{
+		return false;
+	}
 
-/*
- * HasIncompleteConnectionEstablishment returns true if any of the connections
- * that has been initiated by the executor is in initialization stage.
- */
-static bool
-HasIncompleteConnectionEstablishment(DistributedExecution *execution)
-{
-	if (!PreventIncompleteConnectionEstablishment)
+	if (RequestedForExplainAnalyze(scanState) ||
+		MultiShardConnectionType == SEQUENTIAL_CONNECTION)
 	{
 		return false;
 	}
 
-	WorkerSession *session = NULL;
-	foreach_declared_ptr(session, execution->sessionList)
+	Task *task = NULL;
+	foreach_declared_ptr(task, execution->remoteTaskList)
 	{
-		MultiConnection *connection = session->connection;
-		if (connection->connectionState == MULTI_CONNECTION_INITIAL ||
-			connection->connectionState == MULTI_CONNECTION_CONNECTING)
+		if (task->queryCount != 1)
 		{
-			return true;
+			return false;
 		}
 	}
 
-	return false;
+	return true;
 }
 
 
 /*
- * RebuildWaitEventSet updates the waitEventSet for the distributed execution.
- * This happens when the connection set for the distributed execution is changed,
- * which means that we need to update which connections we wait on for events.
+ * RunDistributedExecutionViaConnectionPool runs the remote tasks of the given
+ * execution via the worker connection pooler, and writes the rows to the
+ * tuple destinations of the tasks. The results are always received in text
+ * format.
  */
 static void
-RebuildWaitEventSet(DistributedExecution *execution)
+RunDistributedExecutionViaConnectionPool(DistributedExecution *execution)
 {
-	RebuildWaitEventSetForSessions(execution);
-
-	AddLatchWaitEventToExecution(execution);
-}
+	ParamListInfo paramListInfo = execution->paramListInfo;
+	List *pooledTaskList = NIL;
+	int parameterCount = 0;
+	Oid *parameterTypes = NULL;
+	const char **parameterValues = NULL;
 
+	if (paramListInfo != NULL)
+	{
+		/* force evaluation of bound params */
+		ParamListInfo copiedParamListInfo = copyParamList(paramListInfo);
 
-/*
- * AddLatchWaitEventToExecution is a helper function that adds the latch
- * wait event to the execution->waitEventSet. Note that this function assumes
- * that execution->waitEventSet has already allocated enough slot for latch
- * event.
- */
-static void
-AddLatchWaitEventToExecution(DistributedExecution *execution)
-{
-	CitusAddWaitEventSetToSet(execution->waitEventSet, WL_LATCH_SET, PGINVALID_SOCKET,
-							  MyLatch, NULL);
-}
+		parameterCount = copiedParamListInfo->numParams;
+		ExtractParametersForRemoteExecution(copiedParamListInfo, &parameterTypes,
+											&parameterValues);
+	}
 
+	int taskCount = list_length(execution->remoteTaskList);
+	Task **taskArray = palloc0(taskCount * sizeof(Task *));
+	AttInMetadata **attInMetadataArray = palloc0(taskCount * sizeof(AttInMetadata *));
 
-/*
- * RebuildWaitEventSetForSessions re-creates the waitEventSet for the
- * sessions involved in the distributed execution.
- *
- * Most of the time you need RebuildWaitEventSet() which also includes
- * adds the Latch wait event to the set.
- */
-static void
-RebuildWaitEventSetForSessions(DistributedExecution *execution)
-{
-	FreeExecutionWaitEvents(execution);
+	Task *task = NULL;
+	foreach_declared_ptr(task, execution->remoteTaskList)
+	{
+		int taskIndex = list_length(pooledTaskList);
+		TupleDestination *tupleDest = task->tupleDest ?
+									  task->tupleDest :
+									  execution->defaultTupleDest;
+		uint32 queryIndex = 0;
+		TupleDesc tupleDescriptor = tupleDest->tupleDescForQuery(tupleDest, queryIndex);
 
-	execution->waitEventSet = BuildWaitEventSet(execution->sessionList);
+		taskArray[taskIndex] = task;
+		if (tupleDescriptor != NULL)
+		{
+			attInMetadataArray[taskIndex] = TupleDescGetAttInMetadata(tupleDescriptor);
+		}
 
-	execution->eventSetSize = GetEventSetSize(execution->sessionList);
-	execution->events = palloc0(execution->eventSetSize * sizeof(WaitEvent));
+		PooledTask *pooledTask = palloc0(sizeof(PooledTask));
+		pooledTask->queryString = TaskQueryStringAtIndex(task, queryIndex);
+		pooledTask->placementList = task->taskPlacementList;
 
-	CitusAddWaitEventSetToSet(execution->waitEventSet, WL_POSTMASTER_DEATH,
-							  PGINVALID_SOCKET, NULL, NULL);
+		if (paramListInfo != NULL && !task->parametersInQueryStringResolved)
+		{
+			pooledTask->parameterCount = parameterCount;
+			pooledTask->parameterTypes = parameterTypes;
+			pooledTask->parameterValues = parameterValues;
+		}
 
-	execution->rebuildWaitEventSet = false;
-	execution->waitFlagsChanged = false;
-}
+		pooledTaskList = lappend(pooledTaskList, pooledTask);
+	}
 
+	MemoryContext rowContext = AllocSetContextCreate(CurrentMemoryContext,
+													 "RowContext",
+													 ALLOCSET_DEFAULT_SIZES);
 
-/*
- * ProcessWaitEvents processes the received events from connections.
- */
-static void
-ProcessWaitEvents(DistributedExecution *execution, WaitEvent *events, int eventCount,
-				  bool *cancellationReceived)
-{
-	int eventIndex = 0;
+	PooledExecution *pooledExecution = StartPooledExecution(pooledTaskList);
 
-	/* process I/O events */
-	for (; eventIndex < eventCount; eventIndex++)
+	PG_TRY();
 	{
-		WaitEvent *event = &events[eventIndex];
+		PooledExecutionMessage message;
 
-		if (event->events & WL_POSTMASTER_DEATH)
+		while (true)
 		{
-			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
-		}
+			MemoryContext oldContext = MemoryContextSwitchTo(rowContext);
 
-		if (event->events & WL_LATCH_SET)
-		{
-			ResetLatch(MyLatch);
+			bool received = ReceivePooledExecutionMessage(pooledExecution, &message);
 
-			if (execution->raiseInterrupts)
+			MemoryContextSwitchTo(oldContext);
+
+			if (!received)
 			{
-				CHECK_FOR_INTERRUPTS();
+				break;
 			}
 
-			if (IsHoldOffCancellationReceived())
+			AttInMetadata *attInMetadata = attInMetadataArray[message.taskIndex];
+			if (message.type != POOLED_EXECUTION_ROW || attInMetadata == NULL)
 			{
-				/*
-				 * Break out of event loop immediately in case of cancellation.
-				 * We cannot use "return" here inside a PG_TRY() block since
-				 * then the exception stack won't be reset.
-				 */
-				*cancellationReceived = true;
+				MemoryContextReset(rowContext);
+				continue;
 			}
 
-			continue;
-		}
+			task = taskArray[message.taskIndex];
 
-		WorkerSession *session = (WorkerSession *) event->user_data;
-		session->latestUnconsumedWaitEvents = event->events;
+			if (message.columnCount != attInMetadata->tupdesc->natts)
+			{
+				ereport(ERROR, (errmsg("unexpected number of columns from worker: %d, "
+									   "expected %d", message.columnCount,
+									   attInMetadata->tupdesc->natts)));
+			}
 
-		ConnectionStateMachine(session);
+			oldContext = MemoryContextSwitchTo(rowContext);
+
+			HeapTuple heapTuple = BuildTupleFromCStrings(attInMetadata,
+														 message.columnValues);
+
+			MemoryContextSwitchTo(oldContext);
+
+			TupleDestination *tupleDest = task->tupleDest ?
+										  task->tupleDest :
+										  execution->defaultTupleDest;
+			int placementExecutionIndex = 0;
+			uint32 queryIndex = 0;
+			tupleDest->putTuple(tupleDest, task, placementExecutionIndex, queryIndex,
+								heapTuple, message.rowSize);
+
+			MemoryContextReset(rowContext);
+
+			execution->rowsProcessed++;
+		}
+	}
+	PG_CATCH();
+	{
+		FinishPooledExecution(pooledExecution);
+
+		PG_RE_THROW();
 	}
+	PG_END_TRY();
+
+	FinishPooledExecution(pooledExecution);
+	MemoryContextDelete(rowContext);
 }
 
 
 /*
- * ProcessWaitEventsForSocketClosed mainly checks for WL_SOCKET_CLOSED event.
- * If WL_SOCKET_CLOSED is found, the function sets the underlying connection's
- * state as MULTI_CONNECTION_LOST.
+ * ShouldStreamDistributedExecution returns whether the results of the given
+ * execution can be returned by the custom scan while they are being received,
+ * instead of after the execution is finished.
+ *
+ * While the results are streamed, the executor yields control back to the
+ * postgres executor with queries in flight on the connections of the
+ * execution. We therefore only stream in the simple cases: read-only queries
+ * outside of transaction blocks in the top-level, unnamed portal, where no
+ * other command can use the connections before the portal is dropped. Scans
+ * that might be rewound or scanned backwards always materialize their results.
  */
-static void
-ProcessWaitEventsForSocketClosed(WaitEvent *events, int eventCount)
+static bool
+ShouldStreamDistributedExecution(CitusScanState *scanState,
+								 DistributedExecution *execution)
 {
-	int eventIndex = 0;
-
-	/* process I/O events */
-	for (; eventIndex < eventCount; eventIndex++)
+	if (!EnableStreamingResults)
 	{
-		WaitEvent *event = &events[eventIndex];
+		return false;
+	}
 
-		if (event->events & WL_POSTMASTER_DEATH)
-		{
-			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
-		}
+	if (scanState->eflags & (EXEC_FLAG_REWIND | EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK))
+	{
+		return false;
+	}
 
-		WorkerSession *session = (WorkerSession *) event->user_data;
-		session->latestUnconsumedWaitEvents = event->events;
+	if (ExecutorLevel != 1 || ActivePortal == NULL || ActivePortal->name[0] != '\0')
+	{
+		/* cursors and nested executions may interleave with other commands */
+		return false;
+	}
 
-		if (session->latestUnconsumedWaitEvents & WL_SOCKET_CLOSED)
-		{
-			/* let the ConnectionStateMachine handle the rest */
-			session->connection->connectionState = MULTI_CONNECTION_LOST;
-		}
+	if (IsTransactionBlock() || InCoordinatedTransaction())
+	{
+		return false;
+	}
+
+	if (execution->modLevel != ROW_MODIFY_READONLY ||
+		execution->localTaskList != NIL ||
+		execution->remoteTaskList == NIL ||
+		execution->jobIdList != NIL)
+	{
+		return false;
+	}
+
+	if (RequestedForExplainAnalyze(scanState) ||
+		ShouldRunTasksSequentially(execution->remoteTaskList))
+	{
+		return false;
 	}
+
+	return ActiveStreamingScanState == NULL;
 }
 
 
 /*
- * ManageWorkerPool ensures the worker pool has the appropriate number of connections
- * based on the number of pending tasks.
+ * StartStreamingDistributedExecution starts the given execution without
+ * waiting for any results. The custom scan calls into
+ * AdaptiveExecutorFetchNextBatch whenever it runs out of rows.
  */
 static void
-ManageWorkerPool(WorkerPool *workerPool)
+StartStreamingDistributedExecution(CitusScanState *scanState,
+								   DistributedExecution *execution)
 {
-	DistributedExecution *execution = workerPool->distributedExecution;
+	execution->cancellationReceived = false;
 
-	/* we do not expand the pool further if there was any failure */
-	if (HasAnyConnectionFailure(workerPool))
-	{
-		return;
-	}
+	scanState->streamingExecution = execution;
+	scanState->resultsStreamed = true;
+	ActiveStreamingScanState = scanState;
 
-	/* we wait until a slow start interval has passed before expanding the pool */
-	if (ShouldWaitForSlowStart(workerPool))
+	AssignTasksToConnectionsOrWorkerPool(execution);
+
+	PG_TRY();
 	{
-		return;
-	}
+		/* Preemptively step state machines in case of immediate errors */
+		WorkerSession *session = NULL;
+		foreach_declared_ptr(session, execution->sessionList)
+		{
+			ConnectionStateMachine(session);
+		}
 
-	int newConnectionCount = CalculateNewConnectionCount(workerPool);
-	if (newConnectionCount <= 0)
+		/* always (re)build the wait event set the first time */
+		execution->rebuildWaitEventSet = true;
+	}
+	PG_CATCH();
 	{
-		return;
+		UnclaimAllSessionConnections(execution->sessionList);
+
+		FreeExecutionWaitEvents(execution);
+
+		PG_RE_THROW();
 	}
+	PG_END_TRY();
+}
 
-	/* increase the open rate every cycle (like TCP slow start) */
-	workerPool->maxNewConnectionsPerCycle += 1;
 
-	OpenNewConnections(workerPool, newConnectionCount, execution->transactionProperties);
+/*
+ * StepStreamingDistributedExecution runs the event loop of the execution that
+ * streams its results into the tuple store of the scan state until new rows
+ * arrive or the execution is finished. Since we only wait for I/O when the
+ * consumer asks for more rows, a slow consumer causes the workers to block on
+ * sending results.
+ */
+static void
+StepStreamingDistributedExecution(CitusScanState *scanState)
+{
+	DistributedExecution *execution = scanState->streamingExecution;
+	Tuplestorestate *tupleStore = scanState->tuplestorestate;
+	int64 initialTupleCount = tuplestore_tuple_count(tupleStore);
+	bool executionFinished = false;
 
-	/*
-	 * Cannot establish new connections to the local host, most probably because the
-	 * local node cannot accept new connections (e.g., hit max_connections). Switch
-	 * the tasks to the local execution.
-	 *
-	 * We prefer initiatedConnectionCount over the new connection establishments happen
-	 * in this iteration via OpenNewConnections(). The reason is that it is expected for
-	 * OpenNewConnections() to not open any new connections as long as the connections
-	 * are optional (e.g., the second or later connections in the pool). But, for
-	 * initiatedConnectionCount to be zero, the connection to the local pool should have
-	 * been failed.
-	 */
-	int initiatedConnectionCount = list_length(workerPool->sessionList);
-	if (initiatedConnectionCount == 0)
+	MemoryContext oldContext = MemoryContextSwitchTo(execution->executionContext);
+
+	PG_TRY();
 	{
-		/*
-		 * Only the pools to the local node are allowed to have optional
-		 * connections for the first connection. Hence, initiatedConnectionCount
-		 * could only be zero for poolToLocalNode. For other pools, the connection
-		 * manager would wait until it gets at least one connection.
-		 */
-		Assert(workerPool->poolToLocalNode);
+		while (!DistributedExecutionFinished(execution))
+		{
+			RunDistributedExecutionIteration(execution);
 
-		WorkerPoolFailed(workerPool);
+			if (tuplestore_tuple_count(tupleStore) > initialTupleCount)
+			{
+				break;
+			}
+		}
 
-		if (execution->failed)
+		executionFinished = DistributedExecutionFinished(execution);
+		if (executionFinished)
 		{
-			const char *errHint =
-				execution->localExecutionSupported ?
-				"This command supports local execution. Consider enabling "
-				"local execution using SET citus.enable_local_execution "
-				"TO true;" :
-				"Consider using a higher value for max_connections";
+			FreeExecutionWaitEvents(execution);
 
-			ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
-							errmsg("the total number of connections on the "
-								   "server is more than max_connections(%d)",
-								   MaxConnections),
-							errhint("%s", errHint)));
+			CleanUpSessions(execution);
+
+			RecordConnectionWarmupStats(execution);
 		}
+	}
+	PG_CATCH();
+	{
+		UnclaimAllSessionConnections(execution->sessionList);
 
-		return;
+		FreeExecutionWaitEvents(execution);
+
+		scanState->streamingExecution = NULL;
+		ActiveStreamingScanState = NULL;
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	if (executionFinished)
+	{
+		FinishDistributedExecution(execution);
+
+		scanState->streamingExecution = NULL;
+		ActiveStreamingScanState = NULL;
 	}
 
-	INSTR_TIME_SET_CURRENT(workerPool->lastConnectionOpenTime);
+	MemoryContextSwitchTo(oldContext);
 }
 
 
 /*
- * HasAnyConnectionFailure returns true if worker pool has failed,
- * or connection timed out or we have a failure in connections.
+ * AdaptiveExecutorFetchNextBatch is called by the custom scan when it read all
+ * the rows in its tuple store while the results are being streamed. It
+ * discards the rows that were already returned and waits for the next batch
+ * of rows.
  */
-static bool
-HasAnyConnectionFailure(WorkerPool *workerPool)
+void
+AdaptiveExecutorFetchNextBatch(CitusScanState *scanState)
 {
-	if (workerPool->failureState == WORKER_POOL_FAILED ||
-		workerPool->failureState == WORKER_POOL_FAILED_OVER_TO_LOCAL)
-	{
-		/* connection pool failed */
-		return true;
-	}
+	Assert(scanState->streamingExecution != NULL);
 
-	/* we might fail the execution or warn the user about connection timeouts */
-	if (workerPool->checkForPoolTimeout)
-	{
-		CheckConnectionTimeout(workerPool);
-	}
+	tuplestore_clear(scanState->tuplestorestate);
 
-	int failedConnectionCount = workerPool->failedConnectionCount;
-	if (failedConnectionCount >= 1)
-	{
-		/* do not attempt to open more connections after one failed */
-		return true;
-	}
-	return false;
+	StepStreamingDistributedExecution(scanState);
 }
 
 
 /*
- * ShouldWaitForSlowStart returns true if we should wait before
- * opening a new connection because of slow start algorithm.
+ * AdaptiveExecutorFinishStreaming receives the remaining results of a streamed
+ * execution. If discardRows is true, the rows are thrown away, which is the
+ * case when the scan ends early (e.g. due to a LIMIT) or is rescanned.
+ * Otherwise, the rows are added to the tuple store such that the scan can
+ * still return them.
  */
-static bool
-ShouldWaitForSlowStart(WorkerPool *workerPool)
+void
+AdaptiveExecutorFinishStreaming(CitusScanState *scanState, bool discardRows)
 {
-	/* if we can use a connection per placement, we don't need to wait for slowstart */
-	if (UseConnectionPerPlacement())
+	while (scanState->streamingExecution != NULL)
 	{
-		return false;
-	}
+		if (discardRows)
+		{
+			tuplestore_clear(scanState->tuplestorestate);
+		}
 
-	/* if slow start is disabled, we can open new connections */
-	if (ExecutorSlowStartInterval == SLOW_START_DISABLED)
-	{
-		return false;
+		StepStreamingDistributedExecution(scanState);
 	}
 
-	double milliSecondsPassedSince = MillisecondsPassedSince(
-		workerPool->lastConnectionOpenTime);
-	if (milliSecondsPassedSince < ExecutorSlowStartInterval)
+	if (discardRows)
 	{
-		return true;
+		tuplestore_clear(scanState->tuplestorestate);
 	}
+}
 
-	/*
-	 * Refrain from establishing new connections unless we have already
-	 * finalized all the earlier connection attempts. This prevents unnecessary
-	 * load on the remote nodes and emulates the TCP slow-start algorithm.
-	 */
-	int initiatedConnectionCount = list_length(workerPool->sessionList);
-	int finalizedConnectionCount =
-		workerPool->activeConnectionCount + workerPool->failedConnectionCount;
-	if (finalizedConnectionCount < initiatedConnectionCount)
+
+/*
+ * FinishActiveStreamingExecution receives the remaining results of the
+ * execution that is being streamed, if any, such that its connections can be
+ * used by another execution.
+ */
+static void
+FinishActiveStreamingExecution(void)
+{
+	if (ActiveStreamingScanState != NULL)
 	{
-		return true;
+		bool discardRows = false;
+		AdaptiveExecutorFinishStreaming(ActiveStreamingScanState, discardRows);
 	}
-
-	return false;
 }
 
 
 /*
- * CalculateNewConnectionCount returns the amount of connections
- * that we can currently open.
+ * ResetStreamingExecution forgets about the execution that is being streamed
+ * at the end of the transaction. On commit, the portal that owns the execution
+ * was already dropped. On abort, the connections are cleaned up separately.
  */
-static int
-CalculateNewConnectionCount(WorkerPool *workerPool)
+void
+ResetStreamingExecution(void)
 {
-	DistributedExecution *execution = workerPool->distributedExecution;
-
-	int targetPoolSize = execution->targetPoolSize;
-	int initiatedConnectionCount = list_length(workerPool->sessionList);
-	int activeConnectionCount PG_USED_FOR_ASSERTS_ONLY =
-		workerPool->activeConnectionCount;
-	int idleConnectionCount PG_USED_FOR_ASSERTS_ONLY =
-		workerPool->idleConnectionCount;
-	int readyTaskCount = workerPool->readyTaskCount;
-	int newConnectionCount = 0;
+	ActiveStreamingScanState = NULL;
+}
 
 
-	/* we should always have more (or equal) active connections than idle connections */
-	Assert(activeConnectionCount >= idleConnectionCount);
+/*
+ * DistributedExecutionFinished returns whether the event loop of the given
+ * execution is done, see RunDistributedExecution for the rules.
+ */
+static bool
+DistributedExecutionFinished(DistributedExecution *execution)
+{
+	if (execution->cancellationReceived)
+	{
+		return true;
+	}
 
-	/* we should always have more (or equal) initiated connections than active connections */
-	Assert(initiatedConnectionCount >= activeConnectionCount);
+	return execution->unfinishedTaskCount == 0 &&
+		   !HasIncompleteConnectionEstablishment(execution);
+}
 
-	/* we should never have less than 0 connections ever */
-	Assert(activeConnectionCount >= 0 && idleConnectionCount >= 0);
 
-	if (UseConnectionPerPlacement())
+/*
+ * RunDistributedExecutionIteration runs a single iteration of the event loop
+ * of the execution: it manages the worker pools, waits for I/O events and
+ * processes them.
+ */
+static void
+RunDistributedExecutionIteration(DistributedExecution *execution)
+{
+	WorkerPool *workerPool = NULL;
+	foreach_declared_ptr(workerPool, execution->workerList)
 	{
-		int unusedConnectionCount = workerPool->unusedConnectionCount;
+		ManageWorkerPool(workerPool);
+	}
 
+	bool skipWaitEvents = false;
+	if (execution->remoteTaskList == NIL)
+	{
 		/*
-		 * If force_max_query_parallelization is enabled then we ignore pool size
-		 * and idle connections. Instead, we open new connections as long as there
-		 * are more tasks than unused connections.
+		 * All the tasks are failed over to the local execution, no need
+		 * to wait for any connection activity.
 		 */
+		return;
+	}
+	else if (execution->rebuildWaitEventSet)
+	{
+		RebuildWaitEventSet(execution);
 
-		newConnectionCount = Max(readyTaskCount - unusedConnectionCount, 0);
+		skipWaitEvents =
+			ProcessSessionsWithFailedWaitEventSetOperations(execution);
 	}
-	else
+	else if (execution->waitFlagsChanged)
 	{
-		/* cannot open more than targetPoolSize connections */
-		int maxNewConnectionCount = targetPoolSize - initiatedConnectionCount;
+		RebuildWaitEventSetFlags(execution->waitEventSet, execution->sessionList);
+		execution->waitFlagsChanged = false;
 
-		/* total number of connections that are (almost) available for tasks */
-		int usableConnectionCount = UsableConnectionCount(workerPool);
+		skipWaitEvents =
+			ProcessSessionsWithFailedWaitEventSetOperations(execution);
+	}
 
+	if (skipWaitEvents)
+	{
 		/*
-		 * Number of additional connections we would need to run all ready tasks in
-		 * parallel.
+		 * Some operation on the wait event set is failed, retry
+		 * as we already removed the problematic connections.
 		 */
-		int newConnectionsForReadyTasks = Max(0, readyTaskCount - usableConnectionCount);
+		execution->rebuildWaitEventSet = true;
 
-		/* If Slow start is enabled we need to update the maxNewConnection to the current cycle's maximum.*/
-		if (ExecutorSlowStartInterval != SLOW_START_DISABLED)
-		{
-			maxNewConnectionCount = Min(workerPool->maxNewConnectionsPerCycle,
-										maxNewConnectionCount);
-		}
-
-		/*
-		 * Open enough connections to handle all tasks that are ready, but no more
-		 * than the target pool size.
-		 */
-		newConnectionCount = Min(newConnectionsForReadyTasks, maxNewConnectionCount);
-		if (EnableCostBasedConnectionEstablishment && newConnectionCount > 0 &&
-			initiatedConnectionCount <= MaxCachedConnectionsPerWorker &&
-			UsingExistingSessionsCheaperThanEstablishingNewConnections(
-				readyTaskCount, workerPool))
-		{
-			/*
-			 * Before giving the decision, we do one more check. If the cost of
-			 * executing the remaining tasks over the existing sessions in the
-			 * pool is cheaper than establishing new connections and executing
-			 * the tasks over the new connections, we prefer the former.
-			 *
-			 * For cached connections we should ignore any optimizations as
-			 * cached connections are almost free to get. In other words,
-			 * as long as there are cached connections that the pool has
-			 * not used yet, aggressively use these already established
-			 * connections.
-			 *
-			 * Note that until MaxCachedConnectionsPerWorker has already been
-			 * established within the session, we still need to establish
-			 * the connections right now.
-			 *
-			 * Also remember that we are not trying to find the optimal number
-			 * of connections for the remaining tasks here. Our goal is to prevent
-			 * connection establishments that are absolutely unnecessary. In the
-			 * future, we may improve the calculations below to find the optimal
-			 * number of new connections required.
-			 */
-			return 0;
-		}
+		return;
 	}
 
-	return newConnectionCount;
+	/* wait for I/O events */
+	long timeout = NextEventTimeout(execution);
+	int eventCount =
+		WaitEventSetWait(execution->waitEventSet, timeout, execution->events,
+						 execution->eventSetSize, WAIT_EVENT_CLIENT_READ);
+
+	ProcessWaitEvents(execution, execution->events, eventCount,
+					  &execution->cancellationReceived);
 }
 
 
 /*
- * UsingExistingSessionsCheaperThanEstablishingNewConnections returns true if
- * using the already established connections takes less time compared to opening
- * new connections based on the current execution's stats.
+ * ProcessSessionsWithFailedWaitEventSetOperations goes over the session list
+ * and processes sessions with failed wait event set operations.
  *
- * The function returns false if the current execution has not established any connections
- * or finished any tasks (e.g., no stats to act on).
+ * Failed sessions are not going to generate any further events, so it is our
+ * only chance to process the failure by calling into `ConnectionStateMachine`.
+ *
+ * The function returns true if any session failed.
  */
 static bool
-UsingExistingSessionsCheaperThanEstablishingNewConnections(int readyTaskCount,
-														   WorkerPool *workerPool)
+ProcessSessionsWithFailedWaitEventSetOperations(DistributedExecution *execution)
 {
-	int activeConnectionCount = workerPool->activeConnectionCount;
-	if (workerPool->totalExecutedTasks < 1 || activeConnectionCount < 1)
+	bool foundFailedSession = false;
+	WorkerSession *session = NULL;
+	foreach_declared_ptr(session, execution->sessionList)
 	{
-		/*
-		 * The pool has not finished any connection establishment or
-		 * task yet. So, we refrain from optimizing the execution.
-		 */
-		return false;
-	}
-
-	double avgTaskExecutionTime = AvgTaskExecutionTimeApproximation(workerPool);
-	double avgConnectionEstablishmentTime = AvgConnectionEstablishmentTime(workerPool);
-
-	/* we assume that we are halfway through the execution */
-	double remainingTimeForActiveTaskExecutionsToFinish = avgTaskExecutionTime / 2;
+		if (session->waitEventSetIndex == WAIT_EVENT_SET_INDEX_FAILED)
+		{
+			/*
+			 * We can only lost only already connected connections,
+			 * others are regular failures.
+			 */
+			MultiConnection *connection = session->connection;
+			if (connection->connectionState == MULTI_CONNECTION_CONNECTED)
+			{
+				connection->connectionState = MULTI_CONNECTION_LOST;
+			}
+			else
+			{
+				connection->connectionState = MULTI_CONNECTION_FAILED;
+				IncrementStatCounterForMyDb(STAT_CONNECTION_ESTABLISHMENT_FAILED);
+			}
 
-	/*
-	 * We use "newConnectionCount" as if it is the task count as
-	 * we are only interested in this iteration of CalculateNewConnectionCount().
-	 */
-	double totalTimeToExecuteNewTasks = avgTaskExecutionTime * readyTaskCount;
 
-	double estimatedExecutionTimeForNewTasks =
-		floor(totalTimeToExecuteNewTasks / activeConnectionCount);
+			ConnectionStateMachine(session);
 
-	/*
-	 * First finish the already running tasks, and then use the connections
-	 * to execute the new tasks.
-	 */
-	double costOfExecutingTheTasksOverExistingConnections =
-		remainingTimeForActiveTaskExecutionsToFinish +
-		estimatedExecutionTimeForNewTasks;
+			session->waitEventSetIndex = WAIT_EVENT_SET_INDEX_NOT_INITIALIZED;
 
-	/*
-	 * For every task, the executor is supposed to establish one
-	 * connection and then execute the task over the connection.
-	 */
-	double costOfExecutingTheTasksOverNewConnection =
-		(avgTaskExecutionTime + avgConnectionEstablishmentTime);
+			foundFailedSession = true;
+		}
+	}
 
-	return (costOfExecutingTheTasksOverExistingConnections <=
-			costOfExecutingTheTasksOverNewConnection);
+	return foundFailedSession;
 }
 
 
 /*
- * AvgTaskExecutionTimeApproximation returns the approximation of the average task
- * execution times on the workerPool.
+ * HasIncompleteConnectionEstablishment returns true if any of the connections
+ * that has been initiated by the executor is in initialization stage.
  */
-static double
-AvgTaskExecutionTimeApproximation(WorkerPool *workerPool)
+static bool
+HasIncompleteConnectionEstablishment(DistributedExecution *execution)
 {
-	uint64 totalTaskExecutionTime = workerPool->totalTaskExecutionTime;
-	int taskCount = workerPool->totalExecutedTasks;
-
-	instr_time now;
-	INSTR_TIME_SET_CURRENT(now);
+	if (!PreventIncompleteConnectionEstablishment)
+	{
+		return false;
+	}
 
 	WorkerSession *session = NULL;
-	foreach_declared_ptr(session, workerPool->sessionList)
+	foreach_declared_ptr(session, execution->sessionList)
 	{
-		/*
-		 * Involve the tasks that are currently running. We do this to
-		 * make sure that the execution responds with new connections
-		 * quickly if the actively running tasks
-		 */
-		TaskPlacementExecution *placementExecution = session->currentTask;
-		if (placementExecution != NULL &&
-			placementExecution->executionState == PLACEMENT_EXECUTION_RUNNING)
+		MultiConnection *connection = session->connection;
+		if (connection->connectionState == MULTI_CONNECTION_INITIAL ||
+			connection->connectionState == MULTI_CONNECTION_CONNECTING)
 		{
-			uint64 durationInMicroSecs =
-				MicrosecondsBetweenTimestamps(placementExecution->startTime, now);
-
-			/*
-			 * Our approximation is that we assume that the task execution is
-			 * just in the halfway through.
-			 */
-			totalTaskExecutionTime += (2 * durationInMicroSecs);
-			taskCount += 1;
+			return true;
 		}
 	}
 
-	return taskCount == 0 ? 0 : ((double) totalTaskExecutionTime / taskCount);
+	return false;
 }
 
 
 /*
- * AvgConnectionEstablishmentTime calculates the average connection establishment times
- * for the input workerPool.
+ * RebuildWaitEventSet updates the waitEventSet for the distributed execution.
+ * This happens when the connection set for the distributed execution is changed,
+ * which means that we need to update which connections we wait on for events.
  */
-static double
-AvgConnectionEstablishmentTime(WorkerPool *workerPool)
+static void
+RebuildWaitEventSet(DistributedExecution *execution)
 {
-	double totalTimeMicrosec = 0;
-	int sessionCount = 0;
+	RebuildWaitEventSetForSessions(execution);
 
-	WorkerSession *session = NULL;
-	foreach_declared_ptr(session, workerPool->sessionList)
-	{
-		MultiConnection *connection = session->connection;
+	AddLatchWaitEventToExecution(execution);
+}
 
-		/*
-		 * There could be MaxCachedConnectionsPerWorker connections that are
-		 * already connected. Those connections might skew the average
-		 * connection establishment times for the current execution. The reason
-		 * is that they are established earlier and the connection establishment
-		 * times might be different at the moment those connections are established.
-		 */
-		if (connection->connectionState == MULTI_CONNECTION_CONNECTED)
-		{
-			long connectionEstablishmentTime =
-				MicrosecondsBetweenTimestamps(connection->connectionEstablishmentStart,
-											  connection->connectionEstablishmentEnd);
 
-			totalTimeMicrosec += connectionEstablishmentTime;
-			++sessionCount;
-		}
-	}
+/*
+ * AddLatchWaitEventToExecution is a helper function that adds the latch
+ * wait event to the execution->waitEventSet. Note that this function assumes
+ * that execution->waitEventSet has already allocated enough slot for latch
+ * event.
+ */
+static void
+AddLatchWaitEventToExecution(DistributedExecution *execution)
+{
+	CitusAddWaitEventSetToSet(execution->waitEventSet, WL_LATCH_SET, PGINVALID_SOCKET,
+							  MyLatch, NULL);
+}
 
-	return (sessionCount == 0) ? 0 : (totalTimeMicrosec / sessionCount);
+
+/*
+ * RebuildWaitEventSetForSessions re-creates the waitEventSet for the
+ * sessions involved in the distributed execution.
+ *
+ * Most of the time you need RebuildWaitEventSet() which also includes
+ * adds the Latch wait event to the set.
+ */
+static void
+RebuildWaitEventSetForSessions(DistributedExecution *execution)
+{
+	FreeExecutionWaitEvents(execution);
+
+	execution->waitEventSet = BuildWaitEventSet(execution->sessionList);
+
+	execution->eventSetSize = GetEventSetSize(execution->sessionList);
+	execution->events = palloc0(execution->eventSetSize * sizeof(WaitEvent));
+
+	CitusAddWaitEventSetToSet(execution->waitEventSet, WL_POSTMASTER_DEATH,
+							  PGINVALID_SOCKET, NULL, NULL);
+
+	execution->rebuildWaitEventSet = false;
+	execution->waitFlagsChanged = false;
 }
 
 
 /*
- * OpenNewConnections opens the given amount of connections for the given workerPool.
+ * ProcessWaitEvents processes the received events from connections.
  */
 static void
-OpenNewConnections(WorkerPool *workerPool, int newConnectionCount,
-				   TransactionProperties *transactionProperties)
+ProcessWaitEvents(DistributedExecution *execution, WaitEvent *events, int eventCount,
+				  bool *cancellationReceived)
 {
-	ereport(DEBUG4, (errmsg("opening %d new connections to %s:%d", newConnectionCount,
-							workerPool->nodeName, workerPool->nodePort)));
+	int eventIndex = 0;
 
-	List *newSessionsList = NIL;
-	for (int connectionIndex = 0; connectionIndex < newConnectionCount; connectionIndex++)
+	/* process I/O events */
+	for (; eventIndex < eventCount; eventIndex++)
 	{
-		/* experimental: just to see the perf benefits of caching connections */
-		int connectionFlags = 0;
+		WaitEvent *event = &events[eventIndex];
 
-		if (transactionProperties->useRemoteTransactionBlocks ==
-			TRANSACTION_BLOCKS_DISALLOWED)
+		if (event->events & WL_POSTMASTER_DEATH)
 		{
-			connectionFlags |= OUTSIDE_TRANSACTION;
+			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
 		}
 
-		/*
-		 * Enforce the requirements for adaptive connection management (a.k.a.,
-		 * throttle connections if citus.max_shared_pool_size reached)
-		 */
-		int adaptiveConnectionManagementFlag =
-			AdaptiveConnectionManagementFlag(workerPool->poolToLocalNode,
-											 list_length(workerPool->sessionList));
-		connectionFlags |= adaptiveConnectionManagementFlag;
-
-		/* open a new connection to the worker */
-		MultiConnection *connection = StartNodeUserDatabaseConnection(
-			connectionFlags, workerPool->nodeName, workerPool->nodePort, NULL, NULL);
-		if (!connection)
+		if (event->events & WL_LATCH_SET)
 		{
-			/* connection can only be NULL for optional connections */
-			Assert((connectionFlags & OPTIONAL_CONNECTION));
-			continue;
-		}
+			ResetLatch(MyLatch);
 
-		/*
-		 * Assign the initial state in the connection state machine. The connection
-		 * may already be open, but ConnectionStateMachine will immediately detect
-		 * this.
-		 */
-		connection->connectionState = MULTI_CONNECTION_CONNECTING;
+			if (execution->raiseInterrupts)
+			{
+				CHECK_FOR_INTERRUPTS();
+			}
 
-		/*
-		 * Ensure that subsequent calls to StartNodeUserDatabaseConnection get a
-		 * different connection.
-		 */
-		connection->claimedExclusively = true;
+			if (IsHoldOffCancellationReceived())
+			{
+				/*
+				 * Break out of event loop immediately in case of cancellation.
+				 * We cannot use "return" here inside a PG_TRY() block since
+				 * then the exception stack won't be reset.
+				 */
+				*cancellationReceived = true;
+			}
 
-		if (list_length(workerPool->sessionList) == 0)
-		{
-			/*
-			 * The worker pool has just started to establish connections. We need to
-			 * defer this initialization after StartNodeUserDatabaseConnection()
-			 * because for non-optional connections, we have some logic to wait
-			 * until a connection is allowed to be established.
-			 */
-			INSTR_TIME_SET_ZERO(workerPool->poolStartTime);
+			continue;
 		}
 
-		/* create a session for the connection */
-		WorkerSession *session = FindOrCreateWorkerSession(workerPool, connection);
-		newSessionsList = lappend(newSessionsList, session);
-	}
+		WorkerSession *session = (WorkerSession *) event->user_data;
+		session->latestUnconsumedWaitEvents = event->events;
 
-	if (list_length(newSessionsList) == 0)
-	{
-		/* nothing to do as no new connections happened */
-		return;
+		ConnectionStateMachine(session);
 	}
+}
 
-	DistributedExecution *execution = workerPool->distributedExecution;
 
-	/* we added new connections, rebuild the waitEventSet */
-	RebuildWaitEventSetForSessions(execution);
+/*
+ * ProcessWaitEventsForSocketClosed mainly checks for WL_SOCKET_CLOSED event.
+ * If WL_SOCKET_CLOSED is found, the function sets the underlying connection's
+ * state as MULTI_CONNECTION_LOST.
+ */
+static void
+ProcessWaitEventsForSocketClosed(WaitEvent *events, int eventCount)
+{
+	int eventIndex = 0;
 
-	/*
-	 * If there are any closed sockets, mark connection lost such that
-	 * we can re-connect.
-	 */
-	RemoteSocketClosedForAnySession(execution);
+	/* process I/O events */
+	for (; eventIndex < eventCount; eventIndex++)
+	{
+		WaitEvent *event = &events[eventIndex];
 
-	/*
-	 * For RemoteSocketClosedForAnySession() purposes, we explicitly skip
-	 * the latch because we want to handle all cancellations to be caught
-	 * on the main execution loop, not here. We mostly skip cancellations
-	 * on RemoteSocketClosedForAnySession() for simplicity. Handling
-	 * cancellations on the main execution loop much easier to break out
-	 * of the execution.
-	 */
-	AddLatchWaitEventToExecution(execution);
+		if (event->events & WL_POSTMASTER_DEATH)
+		{
+			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+		}
 
-	WorkerSession *session = NULL;
-	foreach_declared_ptr(session, newSessionsList)
-	{
-		/* immediately run the state machine to handle potential failure */
-		ConnectionStateMachine(session);
+		WorkerSession *session = (WorkerSession *) event->user_data;
+		session->latestUnconsumedWaitEvents = event->events;
+
+		if (session->latestUnconsumedWaitEvents & WL_SOCKET_CLOSED)
+		{
+			/* let the ConnectionStateMachine handle the rest */
+			session->connection->connectionState = MULTI_CONNECTION_LOST;
+		}
 	}
 }
 
 
 /*
- * CheckConnectionTimeout makes sure that the execution enforces the connection
- * establishment timeout defined by the user (NodeConnectionTimeout).
- *
- * The rule is that if a worker pool has already initiated connection establishment
- * and has not succeeded to finish establishments that are necessary to execute tasks,
- * take an action. For the types of actions, see the comments in the function.
- *
- * Enforcing the timeout per pool (over per session) helps the execution to continue
- * even if we can establish a single connection as we expect to have target pool size
- * number of connections. In the end, the executor is capable of using one connection
- * to execute multiple tasks.
+ * ManageWorkerPool ensures the worker pool has the appropriate number of connections
+ * based on the number of pending tasks.
  */
 static void
-CheckConnectionTimeout(WorkerPool *workerPool)
+ManageWorkerPool(WorkerPool *workerPool)
 {
 	DistributedExecution *execution = workerPool->distributedExecution;
-	instr_time poolStartTime = workerPool->poolStartTime;
-	instr_time now;
-	INSTR_TIME_SET_CURRENT(now);
-
-	int initiatedConnectionCount = list_length(workerPool->sessionList);
-	int activeConnectionCount = workerPool->activeConnectionCount;
-	int requiredActiveConnectionCount = 1;
 
-	if (initiatedConnectionCount == 0)
+	/* we do not expand the pool further if there was any failure */
+	if (HasAnyConnectionFailure(workerPool))
 	{
-		/* no connection has been planned for the pool yet */
-		Assert(INSTR_TIME_IS_ZERO(poolStartTime));
 		return;
 	}
 
-	/*
-	 * This is a special case where we assign tasks to sessions even before
-	 * the connections are established. So, make sure to apply similar
-	 * restrictions. In this case, make sure that we get all the connections
-	 * established.
-	 */
-	if (UseConnectionPerPlacement())
+	/* we wait until a slow start interval has passed before expanding the pool */
+	if (ShouldWaitForSlowStart(workerPool))
 	{
-		requiredActiveConnectionCount = initiatedConnectionCount;
+		return;
 	}
 
-	if (MillisecondsBetweenTimestamps(poolStartTime, now) >= NodeConnectionTimeout)
+	int newConnectionCount = CalculateNewConnectionCount(workerPool);
+	if (newConnectionCount <= 0)
 	{
-		if (activeConnectionCount < requiredActiveConnectionCount)
-		{
-			int logLevel = WARNING;
+		return;
+	}
 
-			/*
-			 * First fail the pool and create an opportunity to execute tasks
-			 * over other pools when tasks have more than one placement to execute.
-			 */
-			WorkerPoolFailed(workerPool);
+	/* increase the open rate every cycle (like TCP slow start) */
+	workerPool->maxNewConnectionsPerCycle += 1;
 
-			if (workerPool->failureState == WORKER_POOL_FAILED_OVER_TO_LOCAL)
-			{
-				/*
-				 *
-				 * When the pool is failed over to local execution, warning
-				 * the user just creates chatter as the executor is capable of
-				 * finishing the execution.
-				 */
-				logLevel = DEBUG1;
-			}
-			else if (execution->transactionProperties->errorOnAnyFailure ||
-					 execution->failed)
-			{
-				/*
-				 * The enforcement is not always erroring out. For example, if a SELECT task
-				 * has two different placements, we'd warn the user, fail the pool and continue
-				 * with the next placement.
-				 */
-				logLevel = ERROR;
-			}
+	OpenNewConnections(workerPool, newConnectionCount, execution->transactionProperties);
 
-			/*
-			 * We hit the connection timeout. In that case, we should not let the
-			 * connection establishment to continue because the execution logic
-			 * pretends that failed sessions are not going to be used anymore.
-			 *
-			 * That's why we mark the connection as timed out to trigger the state
-			 * changes in the executor, if we don't throw an error below.
-			 */
-			MarkEstablishingSessionsTimedOut(workerPool);
+	/*
+	 * Cannot establish new connections to the local host, most probably because the
+	 * local node cannot accept new connections (e.g., hit max_connections). Switch
+	 * the tasks to the local execution.
+	 *
+	 * We prefer initiatedConnectionCount over the new connection establishments happen
+	 * in this iteration via OpenNewConnections(). The reason is that it is expected for
+	 * OpenNewConnections() to not open any new connections as long as the connections
+	 * are optional (e.g., the second or later connections in the pool). But, for
+	 * initiatedConnectionCount to be zero, the connection to the local pool should have
+	 * been failed.
+	 */
+	int initiatedConnectionCount = list_length(workerPool->sessionList);
+	if (initiatedConnectionCount == 0)
+	{
+		/*
+		 * Only the pools to the local node are allowed to have optional
+		 * connections for the first connection. Hence, initiatedConnectionCount
+		 * could only be zero for poolToLocalNode. For other pools, the connection
+		 * manager would wait until it gets at least one connection.
+		 */
+		Assert(workerPool->poolToLocalNode);
 
-			ereport(logLevel, (errcode(ERRCODE_CONNECTION_FAILURE),
-							   errmsg("could not establish any connections to the node "
-									  "%s:%d after %u ms", workerPool->nodeName,
-									  workerPool->nodePort,
-									  NodeConnectionTimeout)));
-		}
-		else
+		WorkerPoolFailed(workerPool);
+
+		if (execution->failed)
 		{
-			/* stop interrupting WaitEventSetWait for timeouts */
-			workerPool->checkForPoolTimeout = false;
+			const char *errHint =
+				execution->localExecutionSupported ?
+				"This command supports local execution. Consider enabling "
+				"local execution using SET citus.enable_local_execution "
+				"TO true;" :
+				"Consider using a higher value for max_connections";
+
+			ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+							errmsg("the total number of connections on the "
+								   "server is more than max_connections(%d)",
+								   MaxConnections),
+							errhint("%s", errHint)));
 		}
+
+		return;
 	}
+
+	INSTR_TIME_SET_CURRENT(workerPool->lastConnectionOpenTime);
 }
 
 
 /*
- * MarkEstablishingSessionsTimedOut goes over the sessions in the given
- * workerPool and marks them timed out. ConnectionStateMachine()
- * later cleans up the sessions.
+ * HasAnyConnectionFailure returns true if worker pool has failed,
+ * or connection timed out or we have a failure in connections.
  */
-static void
-MarkEstablishingSessionsTimedOut(WorkerPool *workerPool)
+static bool
+HasAnyConnectionFailure(WorkerPool *workerPool)
 {
-	WorkerSession *session = NULL;
-	foreach_declared_ptr(session, workerPool->sessionList)
+	if (workerPool->failureState == WORKER_POOL_FAILED ||
+		workerPool->failureState == WORKER_POOL_FAILED_OVER_TO_LOCAL)
 	{
-		MultiConnection *connection = session->connection;
+		/* connection pool failed */
+		return true;
+	}
 
-		if (connection->connectionState == MULTI_CONNECTION_CONNECTING ||
-			connection->connectionState == MULTI_CONNECTION_INITIAL)
-		{
-			connection->connectionState = MULTI_CONNECTION_TIMED_OUT;
-			IncrementStatCounterForMyDb(STAT_CONNECTION_ESTABLISHMENT_FAILED);
-		}
+	/* we might fail the execution or warn the user about connection timeouts */
+	if (workerPool->checkForPoolTimeout)
+	{
+		CheckConnectionTimeout(workerPool);
 	}
+
+	int failedConnectionCount = workerPool->failedConnectionCount;
+	if (failedConnectionCount >= 1)
+	{
+		/* do not attempt to open more connections after one failed */
+		return true;
+	}
+	return false;
 }
 
 
 /*
- * UsableConnectionCount returns the number of connections in the worker pool
- * that are (soon to be) usable for sending commands, this includes both idle
- * connections and connections that are still establishing.
+ * ShouldWaitForSlowStart returns true if we should wait before
+ * opening a new connection because of slow start algorithm.
  */
-static int
-UsableConnectionCount(WorkerPool *workerPool)
+static bool
+ShouldWaitForSlowStart(WorkerPool *workerPool)
 {
-	int initiatedConnectionCount = list_length(workerPool->sessionList);
-	int activeConnectionCount = workerPool->activeConnectionCount;
-	int failedConnectionCount = workerPool->failedConnectionCount;
-	int idleConnectionCount = workerPool->idleConnectionCount;
+	/* if we can use a connection per placement, we don't need to wait for slowstart */
+	if (UseConnectionPerPlacement())
+	{
+		return false;
+	}
 
-	/* connections that are still establishing will soon be available for tasks */
-	int establishingConnectionCount =
-		initiatedConnectionCount - activeConnectionCount - failedConnectionCount;
+	/* if slow start is disabled, we can open new connections */
+	if (ExecutorSlowStartInterval == SLOW_START_DISABLED)
+	{
+		return false;
+	}
 
-	int usableConnectionCount = idleConnectionCount + establishingConnectionCount;
+	double milliSecondsPassedSince = MillisecondsPassedSince(
+		workerPool->lastConnectionOpenTime);
+	if (milliSecondsPassedSince < ExecutorSlowStartInterval)
+	{
+		return true;
+	}
 
-	return usableConnectionCount;
+	/*
+	 * Refrain from establishing new connections unless we have already
+	 * finalized all the earlier connection attempts. This prevents unnecessary
+	 * load on the remote nodes and emulates the TCP slow-start algorithm.
+	 */
+	int initiatedConnectionCount = list_length(workerPool->sessionList);
+	int finalizedConnectionCount =
+		workerPool->activeConnectionCount + workerPool->failedConnectionCount;
+	if (finalizedConnectionCount < initiatedConnectionCount)
+	{
+		return true;
+	}
+
+	return false;
 }
 
 
 /*
- * NextEventTimeout finds the earliest time at which we need to interrupt
- * WaitEventSetWait because of a timeout and returns the number of milliseconds
- * until that event with a minimum of 1ms and a maximum of 1000ms.
- *
- * This code may be sensitive to clock jumps, but only has the effect of waking
- * up WaitEventSetWait slightly earlier to later.
+ * CalculateNewConnectionCount returns the amount of connections
+ * that we can currently open.
  */
-static long
-NextEventTimeout(DistributedExecution *execution)
+static int
+CalculateNewConnectionCount(WorkerPool *workerPool)
 {
-	instr_time now;
-	INSTR_TIME_SET_CURRENT(now);
-	long eventTimeout = 1000; /* milliseconds */
+	DistributedExecution *execution = workerPool->distributedExecution;
 
-	WorkerPool *workerPool = NULL;
-	foreach_declared_ptr(workerPool, execution->workerList)
-	{
-		if (workerPool->failureState == WORKER_POOL_FAILED)
-		{
-			/* worker pool may have already timed out */
-			continue;
-		}
+	int targetPoolSize = execution->targetPoolSize;
+	int initiatedConnectionCount = list_length(workerPool->sessionList);
+	int activeConnectionCount PG_USED_FOR_ASSERTS_ONLY =
+		workerPool->activeConnectionCount;
+	int idleConnectionCount PG_USED_FOR_ASSERTS_ONLY =
+		workerPool->idleConnectionCount;
+	int readyTaskCount = workerPool->readyTaskCount;
+	int newConnectionCount = 0;
 
-		if (!INSTR_TIME_IS_ZERO(workerPool->poolStartTime) &&
-			workerPool->checkForPoolTimeout)
-		{
-			long timeSincePoolStartMs =
-				MillisecondsBetweenTimestamps(workerPool->poolStartTime, now);
 
-			/*
-			 * This could go into the negative if the connection timeout just passed.
-			 * In that case we want to wake up as soon as possible. Once the timeout
-			 * has been processed, checkForPoolTimeout will be false so we will skip
-			 * this check.
-			 */
-			long timeUntilConnectionTimeoutMs =
-				NodeConnectionTimeout - timeSincePoolStartMs;
+	/* we should always have more (or equal) active connections than idle connections */
+	Assert(activeConnectionCount >= idleConnectionCount);
 
-			if (timeUntilConnectionTimeoutMs < eventTimeout)
-			{
-				eventTimeout = timeUntilConnectionTimeoutMs;
-			}
-		}
+	/* we should always have more (or equal) initiated connections than active connections */
+	Assert(initiatedConnectionCount >= activeConnectionCount);
 
-		int initiatedConnectionCount = list_length(workerPool->sessionList);
+	/* we should never have less than 0 connections ever */
+	Assert(activeConnectionCount >= 0 && idleConnectionCount >= 0);
+
+	if (UseConnectionPerPlacement())
+	{
+		int unusedConnectionCount = workerPool->unusedConnectionCount;
 
 		/*
-		 * If there are connections to open we wait at most up to the end of the
-		 * current slow start interval.
+		 * If force_max_query_parallelization is enabled then we ignore pool size
+		 * and idle connections. Instead, we open new connections as long as there
+		 * are more tasks than unused connections.
 		 */
-		if (workerPool->readyTaskCount > UsableConnectionCount(workerPool) &&
-			initiatedConnectionCount < execution->targetPoolSize)
-		{
-			long timeSinceLastConnectMs =
-				MillisecondsBetweenTimestamps(workerPool->lastConnectionOpenTime, now);
-			long timeUntilSlowStartInterval =
-				ExecutorSlowStartInterval - timeSinceLastConnectMs;
 
-			if (timeUntilSlowStartInterval < eventTimeout)
-			{
-				eventTimeout = timeUntilSlowStartInterval;
-			}
-		}
+		newConnectionCount = Max(readyTaskCount - unusedConnectionCount, 0);
 	}
+	else
+	{
+		/* cannot open more than targetPoolSize connections */
+		int maxNewConnectionCount = targetPoolSize - initiatedConnectionCount;
 
-	return Max(1, eventTimeout);
-}
+		/* total number of connections that are (almost) available for tasks */
+		int usableConnectionCount = UsableConnectionCount(workerPool);
 
+		/*
+		 * Number of additional connections we would need to run all ready tasks in
+		 * parallel.
+		 */
+		int newConnectionsForReadyTasks = Max(0, readyTaskCount - usableConnectionCount);
 
-/*
- * MillisecondsBetweenTimestamps is a helper to get the number of milliseconds
- * between timestamps when it is expected to be small enough to fit in a
- * long.
- */
-static long
-MillisecondsBetweenTimestamps(instr_time startTime, instr_time endTime)
-{
-	INSTR_TIME_SUBTRACT(endTime, startTime);
-	return INSTR_TIME_GET_MILLISEC(endTime);
-}
+		/* If Slow start is enabled we need to update the maxNewConnection to the current cycle's maximum.*/
+		if (ExecutorSlowStartInterval != SLOW_START_DISABLED)
+		{
+			maxNewConnectionCount = Min(workerPool->maxNewConnectionsPerCycle,
+										maxNewConnectionCount);
+		}
 
+		/*
+		 * Open enough connections to handle all tasks that are ready, but no more
+		 * than the target pool size.
+		 */
+		newConnectionCount = Min(newConnectionsForReadyTasks, maxNewConnectionCount);
+		if (EnableCostBasedConnectionEstablishment && newConnectionCount > 0 &&
+			initiatedConnectionCount <= MaxCachedConnectionsPerWorker &&
+			UsingExistingSessionsCheaperThanEstablishingNewConnections(
+				readyTaskCount, workerPool))
+		{
+			/*
+			 * Before giving the decision, we do one more check. If the cost of
+			 * executing the remaining tasks over the existing sessions in the
+			 * pool is cheaper than establishing new connections and executing
+			 * the tasks over the new connections, we prefer the former.
+			 *
+			 * For cached connections we should ignore any optimizations as
+			 * cached connections are almost free to get. In other words,
+			 * as long as there are cached connections that the pool has
+			 * not used yet, aggressively use these already established
+			 * connections.
+			 *
+			 * Note that until MaxCachedConnectionsPerWorker has already been
+			 * established within the session, we still need to establish
+			 * the connections right now.
+			 *
+			 * Also remember that we are not trying to find the optimal number
+			 * of connections for the remaining tasks here. Our goal is to prevent
+			 * connection establishments that are absolutely unnecessary. In the
+			 * future, we may improve the calculations below to find the optimal
+			 * number of new connections required.
+			 */
+			return 0;
+		}
+	}
 
-/*
- * MicrosecondsBetweenTimestamps is a helper to get the number of microseconds
- * between timestamps.
- */
-static uint64
-MicrosecondsBetweenTimestamps(instr_time startTime, instr_time endTime)
-{
-	INSTR_TIME_SUBTRACT(endTime, startTime);
-	return INSTR_TIME_GET_MICROSEC(endTime);
+	return newConnectionCount;
 }
 
 
 /*
- * ConnectionStateMachine opens a connection and descends into the transaction
- * state machine when ready.
+ * UsingExistingSessionsCheaperThanEstablishingNewConnections returns true if
+ * using the already established connections takes less time compared to opening
+ * new connections based on the current execution's stats.
+ *
+ * The function returns false if the current execution has not established any connections
+ * or finished any tasks (e.g., no stats to act on).
  */
-static void
-ConnectionStateMachine(WorkerSession *session)
+static bool
+UsingExistingSessionsCheaperThanEstablishingNewConnections(int readyTaskCount,
+														   WorkerPool *workerPool)
 {
-	WorkerPool *workerPool = session->workerPool;
-	DistributedExecution *execution = workerPool->distributedExecution;
+	int activeConnectionCount = workerPool->activeConnectionCount;
+	if (workerPool->totalExecutedTasks < 1 || activeConnectionCount < 1)
+	{
+		/*
+		 * The pool has not finished any connection establishment or
+		 * task yet. So, we refrain from optimizing the execution.
+		 */
+		return false;
+	}
 
-	MultiConnection *connection = session->connection;
-	MultiConnectionState currentState;
+	double avgTaskExecutionTime = AvgTaskExecutionTimeApproximation(workerPool);
+	double avgConnectionEstablishmentTime = AvgConnectionEstablishmentTime(workerPool);
 
-	do {
-		currentState = connection->connectionState;
+	/* we assume that we are halfway through the execution */
+	double remainingTimeForActiveTaskExecutionsToFinish = avgTaskExecutionTime / 2;
+
+	/*
+	 * We use "newConnectionCount" as if it is the task count as
+	 * we are only interested in this iteration of CalculateNewConnectionCount().
+	 */
+	double totalTimeToExecuteNewTasks = avgTaskExecutionTime * readyTaskCount;
+
+	double estimatedExecutionTimeForNewTasks =
+		floor(totalTimeToExecuteNewTasks / activeConnectionCount);
+
+	/*
+	 * First finish the already running tasks, and then use the connections
+	 * to execute the new tasks.
+	 */
+	double costOfExecutingTheTasksOverExistingConnections =
+		remainingTimeForActiveTaskExecutionsToFinish +
+		estimatedExecutionTimeForNewTasks;
+
+	/*
+	 * For every task, the executor is supposed to establish one
+	 * connection and then execute the task over the connection.
+	 */
+	double costOfExecutingTheTasksOverNewConnection =
+		(avgTaskExecutionTime + avgConnectionEstablishmentTime);
+
+	return (costOfExecutingTheTasksOverExistingConnections <=
+			costOfExecutingTheTasksOverNewConnection);
+}
+
+
+/*
+ * AvgTaskExecutionTimeApproximation returns the approximation of the average task
+ * execution times on the workerPool.
+ */
+static double
+AvgTaskExecutionTimeApproximation(WorkerPool *workerPool)
+{
+	uint64 totalTaskExecutionTime = workerPool->totalTaskExecutionTime;
+	int taskCount = workerPool->totalExecutedTasks;
+
+	instr_time now;
+	INSTR_TIME_SET_CURRENT(now);
+
+	WorkerSession *session = NULL;
+	foreach_declared_ptr(session, workerPool->sessionList)
+	{
+		/*
+		 * Involve the tasks that are currently running. We do this to
+		 * make sure that the execution responds with new connections
+		 * quickly if the actively running tasks
+		 */
+		TaskPlacementExecution *placementExecution = session->currentTask;
+		if (placementExecution != NULL &&
+			placementExecution->executionState == PLACEMENT_EXECUTION_RUNNING)
+		{
+			uint64 durationInMicroSecs =
+				MicrosecondsBetweenTimestamps(placementExecution->startTime, now);
+
+			/*
+			 * Our approximation is that we assume that the task execution is
+			 * just in the halfway through.
+			 */
+			totalTaskExecutionTime += (2 * durationInMicroSecs);
+			taskCount += 1;
+		}
+	}
+
+	return taskCount == 0 ? 0 : ((double) totalTaskExecutionTime / taskCount);
+}
+
+
+/*
+ * AvgConnectionEstablishmentTime calculates the average connection establishment times
+ * for the input workerPool.
+ */
+static double
+AvgConnectionEstablishmentTime(WorkerPool *workerPool)
+{
+	double totalTimeMicrosec = 0;
+	int sessionCount = 0;
+
+	WorkerSession *session = NULL;
+	foreach_declared_ptr(session, workerPool->sessionList)
+	{
+		MultiConnection *connection = session->connection;
+
+		/*
+		 * There could be MaxCachedConnectionsPerWorker connections that are
+		 * already connected. Those connections might skew the average
+		 * connection establishment times for the current execution. The reason
+		 * is that they are established earlier and the connection establishment
+		 * times might be different at the moment those connections are established.
+		 */
+		if (connection->connectionState == MULTI_CONNECTION_CONNECTED)
+		{
+			long connectionEstablishmentTime =
+				MicrosecondsBetweenTimestamps(connection->connectionEstablishmentStart,
+											  connection->connectionEstablishmentEnd);
+
+			totalTimeMicrosec += connectionEstablishmentTime;
+			++sessionCount;
+		}
+	}
+
+	return (sessionCount == 0) ? 0 : (totalTimeMicrosec / sessionCount);
+}
+
+
+/*
+ * OpenNewConnections opens the given amount of connections for the given workerPool.
+ */
+static void
+OpenNewConnections(WorkerPool *workerPool, int newConnectionCount,
+				   TransactionProperties *transactionProperties)
+{
+	ereport(DEBUG4, (errmsg("opening %d new connections to %s:%d", newConnectionCount,
+							workerPool->nodeName, workerPool->nodePort)));
+
+	List *newSessionsList = NIL;
+	for (int connectionIndex = 0; connectionIndex < newConnectionCount; connectionIndex++)
+	{
+		/* experimental: just to see the perf benefits of caching connections */
+		int connectionFlags = 0;
+
+		if (transactionProperties->useRemoteTransactionBlocks ==
+			TRANSACTION_BLOCKS_DISALLOWED)
+		{
+			connectionFlags |= OUTSIDE_TRANSACTION;
+		}
+
+		/*
+		 * Enforce the requirements for adaptive connection management (a.k.a.,
+		 * throttle connections if citus.max_shared_pool_size reached)
+		 */
+		int adaptiveConnectionManagementFlag =
+			AdaptiveConnectionManagementFlag(workerPool->poolToLocalNode,
+											 list_length(workerPool->sessionList));
+		connectionFlags |= adaptiveConnectionManagementFlag;
+
+		/* open a new connection to the worker */
+		MultiConnection *connection = StartNodeUserDatabaseConnection(
+			connectionFlags, workerPool->nodeName, workerPool->nodePort, NULL, NULL);
+		if (!connection)
+		{
+			/* connection can only be NULL for optional connections */
+			Assert((connectionFlags & OPTIONAL_CONNECTION));
+			continue;
+		}
+
+		/*
+		 * Assign the initial state in the connection state machine. The connection
+		 * may already be open, but ConnectionStateMachine will immediately detect
+		 * this.
+		 */
+		connection->connectionState = MULTI_CONNECTION_CONNECTING;
+
+		/*
+		 * Ensure that subsequent calls to StartNodeUserDatabaseConnection get a
+		 * different connection.
+		 */
+		connection->claimedExclusively = true;
+
+		if (list_length(workerPool->sessionList) == 0)
+		{
+			/*
+			 * The worker pool has just started to establish connections. We need to
+			 * defer this initialization after StartNodeUserDatabaseConnection()
+			 * because for non-optional connections, we have some logic to wait
+			 * until a connection is allowed to be established.
+			 */
+			INSTR_TIME_SET_ZERO(workerPool->poolStartTime);
+		}
+
+		/* create a session for the connection */
+		WorkerSession *session = FindOrCreateWorkerSession(workerPool, connection);
+		newSessionsList = lappend(newSessionsList, session);
+	}
+
+	if (list_length(newSessionsList) == 0)
+	{
+		/* nothing to do as no new connections happened */
+		return;
+	}
+
+	DistributedExecution *execution = workerPool->distributedExecution;
+
+	/* we added new connections, rebuild the waitEventSet */
+	RebuildWaitEventSetForSessions(execution);
+
+	/*
+	 * If there are any closed sockets, mark connection lost such that
+	 * we can re-connect.
+	 */
+	RemoteSocketClosedForAnySession(execution);
+
+	/*
+	 * For RemoteSocketClosedForAnySession() purposes, we explicitly skip
+	 * the latch because we want to handle all cancellations to be caught
+	 * on the main execution loop, not here. We mostly skip cancellations
+	 * on RemoteSocketClosedForAnySession() for simplicity. Handling
+	 * cancellations on the main execution loop much easier to break out
+	 * of the execution.
+	 */
+	AddLatchWaitEventToExecution(execution);
+
+	WorkerSession *session = NULL;
+	foreach_declared_ptr(session, newSessionsList)
+	{
+		/* immediately run the state machine to handle potential failure */
+		ConnectionStateMachine(session);
+	}
+}
+
+
+/*
+ * CheckConnectionTimeout makes sure that the execution enforces the connection
+ * establishment timeout defined by the user (NodeConnectionTimeout).
+ *
+ * The rule is that if a worker pool has already initiated connection establishment
+ * and has not succeeded to finish establishments that are necessary to execute tasks,
+ * take an action. For the types of actions, see the comments in the function.
+ *
+ * Enforcing the timeout per pool (over per session) helps the execution to continue
+ * even if we can establish a single connection as we expect to have target pool size
+ * number of connections. In the end, the executor is capable of using one connection
+ * to execute multiple tasks.
+ */
+static void
+CheckConnectionTimeout(WorkerPool *workerPool)
+{
+	DistributedExecution *execution = workerPool->distributedExecution;
+	instr_time poolStartTime = workerPool->poolStartTime;
+	instr_time now;
+	INSTR_TIME_SET_CURRENT(now);
+
+	int initiatedConnectionCount = list_length(workerPool->sessionList);
+	int activeConnectionCount = workerPool->activeConnectionCount;
+	int requiredActiveConnectionCount = 1;
+
+	if (initiatedConnectionCount == 0)
+	{
+		/* no connection has been planned for the pool yet */
+		Assert(INSTR_TIME_IS_ZERO(poolStartTime));
+		return;
+	}
+
+	/*
+	 * This is a special case where we assign tasks to sessions even before
+	 * the connections are established. So, make sure to apply similar
+	 * restrictions. In this case, make sure that we get all the connections
+	 * established.
+	 */
+	if (UseConnectionPerPlacement())
+	{
+		requiredActiveConnectionCount = initiatedConnectionCount;
+	}
+
+	if (MillisecondsBetweenTimestamps(poolStartTime, now) >= NodeConnectionTimeout)
+	{
+		if (activeConnectionCount < requiredActiveConnectionCount)
+		{
+			int logLevel = WARNING;
+
+			/*
+			 * First fail the pool and create an opportunity to execute tasks
+			 * over other pools when tasks have more than one placement to execute.
+			 */
+			WorkerPoolFailed(workerPool);
+
+			if (workerPool->failureState == WORKER_POOL_FAILED_OVER_TO_LOCAL)
+			{
+				/*
+				 *
+				 * When the pool is failed over to local execution, warning
+				 * the user just creates chatter as the executor is capable of
+				 * finishing the execution.
+				 */
+				logLevel = DEBUG1;
+			}
+			else if (execution->transactionProperties->errorOnAnyFailure ||
+					 execution->failed)
+			{
+				/*
+				 * The enforcement is not always erroring out. For example, if a SELECT task
+				 * has two different placements, we'd warn the user, fail the pool and continue
+				 * with the next placement.
+				 */
+				logLevel = ERROR;
+			}
+
+			/*
+			 * We hit the connection timeout. In that case, we should not let the
+			 * connection establishment to continue because the execution logic
+			 * pretends that failed sessions are not going to be used anymore.
+			 *
+			 * That's why we mark the connection as timed out to trigger the state
+			 * changes in the executor, if we don't throw an error below.
+			 */
+			MarkEstablishingSessionsTimedOut(workerPool);
+
+			ereport(logLevel, (errcode(ERRCODE_CONNECTION_FAILURE),
+							   errmsg("could not establish any connections to the node "
+									  "%s:%d after %u ms", workerPool->nodeName,
+									  workerPool->nodePort,
+									  NodeConnectionTimeout)));
+		}
+		else
+		{
+			/* stop interrupting WaitEventSetWait for timeouts */
+			workerPool->checkForPoolTimeout = false;
+		}
+	}
+}
+
+
+/*
+ * MarkEstablishingSessionsTimedOut goes over the sessions in the given
+ * workerPool and marks them timed out. ConnectionStateMachine()
+ * later cleans up the sessions.
+ */
+static void
+MarkEstablishingSessionsTimedOut(WorkerPool *workerPool)
+{
+	WorkerSession *session = NULL;
+	foreach_declared_ptr(session, workerPool->sessionList)
+	{
+		MultiConnection *connection = session->connection;
+
+		if (connection->connectionState == MULTI_CONNECTION_CONNECTING ||
+			connection->connectionState == MULTI_CONNECTION_INITIAL)
+		{
+			connection->connectionState = MULTI_CONNECTION_TIMED_OUT;
+			IncrementStatCounterForMyDb(STAT_CONNECTION_ESTABLISHMENT_FAILED);
+		}
+	}
+}
+
+
+/*
+ * UsableConnectionCount returns the number of connections in the worker pool
+ * that are (soon to be) usable for sending commands, this includes both idle
+ * connections and connections that are still establishing.
+ */
+static int
+UsableConnectionCount(WorkerPool *workerPool)
+{
+	int initiatedConnectionCount = list_length(workerPool->sessionList);
+	int activeConnectionCount = workerPool->activeConnectionCount;
+	int failedConnectionCount = workerPool->failedConnectionCount;
+	int idleConnectionCount = workerPool->idleConnectionCount;
+
+	/* connections that are still establishing will soon be available for tasks */
+	int establishingConnectionCount =
+		initiatedConnectionCount - activeConnectionCount - failedConnectionCount;
+
+	int usableConnectionCount = idleConnectionCount + establishingConnectionCount;
+
+	return usableConnectionCount;
+}
+
+
+/*
+ * NextEventTimeout finds the earliest time at which we need to interrupt
+ * WaitEventSetWait because of a timeout and returns the number of milliseconds
+ * until that event with a minimum of 1ms and a maximum of 1000ms.
+ *
+ * This code may be sensitive to clock jumps, but only has the effect of waking
+ * up WaitEventSetWait slightly earlier to later.
+ */
+static long
+NextEventTimeout(DistributedExecution *execution)
+{
+	instr_time now;
+	INSTR_TIME_SET_CURRENT(now);
+	long eventTimeout = 1000; /* milliseconds */
+
+	WorkerPool *workerPool = NULL;
+	foreach_declared_ptr(workerPool, execution->workerList)
+	{
+		if (workerPool->failureState == WORKER_POOL_FAILED)
+		{
+			/* worker pool may have already timed out */
+			continue;
+		}
+
+		if (!INSTR_TIME_IS_ZERO(workerPool->poolStartTime) &&
+			workerPool->checkForPoolTimeout)
+		{
+			long timeSincePoolStartMs =
+				MillisecondsBetweenTimestamps(workerPool->poolStartTime, now);
+
+			/*
+			 * This could go into the negative if the connection timeout just passed.
+			 * In that case we want to wake up as soon as possible. Once the timeout
+			 * has been processed, checkForPoolTimeout will be false so we will skip
+			 * this check.
+			 */
+			long timeUntilConnectionTimeoutMs =
+				NodeConnectionTimeout - timeSincePoolStartMs;
+
+			if (timeUntilConnectionTimeoutMs < eventTimeout)
+			{
+				eventTimeout = timeUntilConnectionTimeoutMs;
+			}
+		}
+
+		int initiatedConnectionCount = list_length(workerPool->sessionList);
+
+		/*
+		 * If there are connections to open we wait at most up to the end of the
+		 * current slow start interval.
+		 */
+		if (workerPool->readyTaskCount > UsableConnectionCount(workerPool) &&
+			initiatedConnectionCount < execution->targetPoolSize)
+		{
+			long timeSinceLastConnectMs =
+				MillisecondsBetweenTimestamps(workerPool->lastConnectionOpenTime, now);
+			long timeUntilSlowStartInterval =
+				ExecutorSlowStartInterval - timeSinceLastConnectMs;
+
+			if (timeUntilSlowStartInterval < eventTimeout)
+			{
+				eventTimeout = timeUntilSlowStartInterval;
+			}
+		}
+	}
+
+	return Max(1, eventTimeout);
+}
+
+
+/*
+ * MillisecondsBetweenTimestamps is a helper to get the number of milliseconds
+ * between timestamps when it is expected to be small enough to fit in a
+ * long.
+ */
+static long
+MillisecondsBetweenTimestamps(instr_time startTime, instr_time endTime)
+{
+	INSTR_TIME_SUBTRACT(endTime, startTime);
+	return INSTR_TIME_GET_MILLISEC(endTime);
+}
+
+
+/*
+ * MicrosecondsBetweenTimestamps is a helper to get the number of microseconds
+ * between timestamps.
+ */
+static uint64
+MicrosecondsBetweenTimestamps(instr_time startTime, instr_time endTime)
+{
+	INSTR_TIME_SUBTRACT(endTime, startTime);
+	return INSTR_TIME_GET_MICROSEC(endTime);
+}
+
+
+/*
+ * ConnectionStateMachine opens a connection and descends into the transaction
+ * state machine when ready.
+ */
+static void
+ConnectionStateMachine(WorkerSession *session)
+{
+	WorkerPool *workerPool = session->workerPool;
+	DistributedExecution *execution = workerPool->distributedExecution;
+
+	MultiConnection *connection = session->connection;
+	MultiConnectionState currentState;
+
+	do {
+		currentState = connection->connectionState;
+
+		switch (currentState)
+		{
+			case MULTI_CONNECTION_INITIAL:
+			{
+				/* simply iterate the state machine */
+				connection->connectionState = MULTI_CONNECTION_CONNECTING;
+				break;
+			}
+
+			case MULTI_CONNECTION_TIMED_OUT:
+			{
+				/*
+				 * When the connection timeout happens, the connection
+				 * might still be able to successfuly established. However,
+				 * the executor should not try to use this connection as
+				 * the state machines might have already progressed and used
+				 * new pools/sessions instead. That's why we terminate the
+				 * connection, clear any state associated with it.
+				 *
+				 * Note that here we don't increment the failed connection
+				 * stat counter because MarkEstablishingSessionsTimedOut()
+				 * already did that.
+				 */
+				connection->connectionState = MULTI_CONNECTION_FAILED;
+				break;
+			}
+
+			case MULTI_CONNECTION_CONNECTING:
+			{
+				ConnStatusType status = PQstatus(connection->pgConn);
+				if (status == CONNECTION_OK)
+				{
+					/*
+					 * Connection was already established, possibly a cached
+					 * connection.
+					 */
+					bool newConnection = false;
+					HandleMultiConnectionSuccess(session, newConnection);
+					UpdateConnectionWaitFlags(session,
+											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+					break;
+				}
+				else if (status == CONNECTION_BAD)
+				{
+					connection->connectionState = MULTI_CONNECTION_FAILED;
+					IncrementStatCounterForMyDb(STAT_CONNECTION_ESTABLISHMENT_FAILED);
+					break;
+				}
+
+				int beforePollSocket = PQsocket(connection->pgConn);
+				PostgresPollingStatusType pollMode = PQconnectPoll(connection->pgConn);
+
+				if (beforePollSocket != PQsocket(connection->pgConn))
+				{
+					/* rebuild the wait events if PQconnectPoll() changed the socket */
+					execution->rebuildWaitEventSet = true;
+				}
+
+				if (pollMode == PGRES_POLLING_FAILED)
+				{
+					connection->connectionState = MULTI_CONNECTION_FAILED;
+					IncrementStatCounterForMyDb(STAT_CONNECTION_ESTABLISHMENT_FAILED);
+				}
+				else if (pollMode == PGRES_POLLING_READING)
+				{
+					UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
+
+					/* we should have a valid socket */
+					Assert(PQsocket(connection->pgConn) != -1);
+				}
+				else if (pollMode == PGRES_POLLING_WRITING)
+				{
+					UpdateConnectionWaitFlags(session, WL_SOCKET_WRITEABLE);
+
+					/* we should have a valid socket */
+					Assert(PQsocket(connection->pgConn) != -1);
+				}
+				else
+				{
+					/*
+					 * Connection was not established befoore (!= CONNECTION_OK)
+					 * but PQconnectPoll() did so now.
+					 */
+					bool newConnection = true;
+					HandleMultiConnectionSuccess(session, newConnection);
+					UpdateConnectionWaitFlags(session,
+											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+
+					/* we should have a valid socket */
+					Assert(PQsocket(connection->pgConn) != -1);
+				}
+
+				break;
+			}
+
+			case MULTI_CONNECTION_CONNECTED:
+			{
+				if (HasUnfinishedTaskForSession(session))
+				{
+					/*
+					 * Connection is ready, and we have unfinished tasks.
+					 * So, run the transaction state machine.
+					 */
+					TransactionStateMachine(session);
+				}
+				else
+				{
+					/*
+					 * Connection is ready, but we don't have any unfinished
+					 * tasks that this session can execute.
+					 *
+					 * Note that we can be in a situation where the executor
+					 * decides to establish a connection, but not need to
+					 * use it at the time the connection is established. This could
+					 * happen when the earlier connections manages to finish all the
+					 * tasks after this connection
+					 *
+					 * As no tasks are ready to be executed at the moment, we
+					 * mark the socket readable to get any notices if exists.
+					 */
+					UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
+				}
+
+				break;
+			}
+
+			case MULTI_CONNECTION_LOST:
+			{
+				/*
+				 * If a connection is lost, we retry the connection for some
+				 * very restricted scenarios. The main use case is to retry
+				 * connection establishment when a cached connection is used
+				 * in the executor while remote server has restarted / failedover
+				 * etc.
+				 *
+				 * For simplicity, we only allow retrying connection establishment
+				 * a single time.
+				 *
+				 * We can only retry connection when the remote transaction has
+				 * not started over the connection. Otherwise, we'd have to deal
+				 * with restoring the transaction state, which is beyond our
+				 * purpose at this time.
+				 */
+				RemoteTransaction *transaction = &connection->remoteTransaction;
+				if (!session->connectionRetried &&
+					transaction->transactionState == REMOTE_TRANS_NOT_STARTED)
+				{
+					/*
+					 * Try to connect again, we will reuse the same MultiConnection
+					 * and keep it as claimed.
+					 */
+					RestartConnection(connection);
+
+					/* socket have changed */
+					execution->rebuildWaitEventSet = true;
+					session->latestUnconsumedWaitEvents = 0;
+
+					session->connectionRetried = true;
+
+					break;
+				}
+
+				/*
+				 * Here we don't increment the connection stat counter for failed
+				 * connections because we don't track the connections that we could
+				 * establish but lost later.
+				 */
+				connection->connectionState = MULTI_CONNECTION_FAILED;
+				break;
+			}
+
+			case MULTI_CONNECTION_FAILED:
+			{
+				/* managed to connect, but connection was lost */
+				if (session->sessionHasActiveConnection)
+				{
+					workerPool->activeConnectionCount--;
+
+					if (session->currentTask == NULL)
+					{
+						/* this was an idle connection */
+						workerPool->idleConnectionCount--;
+					}
+
+					session->sessionHasActiveConnection = false;
+				}
+
+				/* connection failed or was lost */
+				int totalConnectionCount = list_length(workerPool->sessionList);
+
+				workerPool->failedConnectionCount++;
+
+				/* if the connection executed a critical command it should fail */
+				MarkRemoteTransactionFailed(connection, false);
+
+				/* mark all assigned placement executions as failed */
+				WorkerSessionFailed(session);
+
+				if (workerPool->failedConnectionCount >= totalConnectionCount)
+				{
+					/*
+					 * All current connection attempts have failed.
+					 * Mark all unassigned placement executions as failed.
+					 *
+					 * We do not currently retry if the first connection
+					 * attempt fails.
+					 */
+					WorkerPoolFailed(workerPool);
+				}
+
+				/*
+				 * The execution may have failed as a result of WorkerSessionFailed
+				 * or WorkerPoolFailed.
+				 *
+				 * Even if this execution has not failed -- but just a single session is
+				 * failed -- and an earlier execution in this transaction which marked
+				 * the remote transaction as critical, we should fail right away as the
+				 * transaction will fail anyway on PREPARE/COMMIT time.
+				 */
+				RemoteTransaction *transaction = &connection->remoteTransaction;
+
+				if (transaction->transactionCritical ||
+					execution->failed ||
+					(execution->transactionProperties->errorOnAnyFailure &&
+					 workerPool->failureState != WORKER_POOL_FAILED_OVER_TO_LOCAL))
+				{
+					/* a task has failed due to this connection failure */
+					ReportConnectionError(connection, ERROR);
+				}
+				else if (workerPool->activeConnectionCount > 0 ||
+						 workerPool->failureState == WORKER_POOL_FAILED_OVER_TO_LOCAL)
+				{
+					/*
+					 * We already have active connection(s) to the node, and the
+					 * executor is capable of using those connections to successfully
+					 * finish the execution. So, there is not much value in warning
+					 * the user.
+					 *
+					 * Similarly when the pool is failed over to local execution, warning
+					 * the user just creates chatter.
+					 */
+					ReportConnectionError(connection, DEBUG1);
+				}
+				else
+				{
+					ReportConnectionError(connection, WARNING);
+				}
+
+				/* remove the connection */
+				UnclaimConnection(connection);
+
+				/*
+				 * We forcefully close the underlying libpq connection because
+				 * we don't want any subsequent execution (either subPlan executions
+				 * or new command executions within a transaction block) use the
+				 * connection.
+				 *
+				 * However, we prefer to keep the MultiConnection around until
+				 * the end of FinishDistributedExecution() to simplify the code.
+				 * Thus, we prefer ShutdownConnection() over CloseConnection().
+				 */
+				ShutdownConnection(connection);
+
+				/* remove connection from wait event set */
+				execution->rebuildWaitEventSet = true;
+
+				/*
+				 * Reset the transaction state machine since CloseConnection()
+				 * relies on it and even if we're not inside a distributed transaction
+				 * we set the transaction state (e.g., REMOTE_TRANS_SENT_COMMAND).
+				 */
+				if (!connection->remoteTransaction.beginSent)
+				{
+					connection->remoteTransaction.transactionState =
+						REMOTE_TRANS_NOT_STARTED;
+				}
 
-		switch (currentState)
-		{
-			case MULTI_CONNECTION_INITIAL:
-			{
-				/* simply iterate the state machine */
-				connection->connectionState = MULTI_CONNECTION_CONNECTING;
 				break;
 			}
 
-			case MULTI_CONNECTION_TIMED_OUT:
-			{
-				/*
-				 * When the connection timeout happens, the connection
-				 * might still be able to successfuly established. However,
-				 * the executor should not try to use this connection as
-				 * the state machines might have already progressed and used
-				 * new pools/sessions instead. That's why we terminate the
-				 * connection, clear any state associated with it.
-				 *
-				 * Note that here we don't increment the failed connection
-				 * stat counter because MarkEstablishingSessionsTimedOut()
-				 * already did that.
-				 */
-				connection->connectionState = MULTI_CONNECTION_FAILED;
+			default:
+			{
+				break;
+			}
+		}
+	} while (connection->connectionState != currentState);
+}
+
+
+/*
+ * HasUnfinishedTaskForSession gets a session and returns true if there
+ * are any tasks that this session can execute.
+ */
+static bool
+HasUnfinishedTaskForSession(WorkerSession *session)
+{
+	if (session->currentTask != NULL)
+	{
+		/* the session is executing a command right now */
+		return true;
+	}
+
+	dlist_head *sessionReadyTaskQueue = &(session->readyTaskQueue);
+	if (!dlist_is_empty(sessionReadyTaskQueue))
+	{
+		/* session has an assigned task, which is ready for execution */
+		return true;
+	}
+
+	WorkerPool *workerPool = session->workerPool;
+	dlist_head *poolReadyTaskQueue = &(workerPool->readyTaskQueue);
+	if (!dlist_is_empty(poolReadyTaskQueue))
+	{
+		/*
+		 * Pool has unassigned tasks that can be executed
+		 * by the input session.
+		 */
+		return true;
+	}
+
+	return false;
+}
+
+
+/*
+ * HandleMultiConnectionSuccess logs the established connection and updates
+ * connection's state.
+ */
+static void
+HandleMultiConnectionSuccess(WorkerSession *session, bool newConnection)
+{
+	MultiConnection *connection = session->connection;
+	WorkerPool *workerPool = session->workerPool;
+
+	MarkConnectionConnected(connection, newConnection);
+
+	uint64 connectionEstablishmentTime =
+		MicrosecondsBetweenTimestamps(connection->connectionEstablishmentStart,
+									  connection->connectionEstablishmentEnd);
+
+	ereport(DEBUG4, (errmsg("established connection to %s:%d for "
+							"session %ld in %ld microseconds",
+							connection->hostname, connection->port,
+							session->sessionId, connectionEstablishmentTime)));
+
+	if (newConnection)
+	{
+		workerPool->newConnectionCount++;
+		workerPool->totalConnectionEstablishmentTime += connectionEstablishmentTime;
+	}
+	else if (connection->keptWarm)
+	{
+		/* count each warm connection once, even if used by several executions */
+		connection->keptWarm = false;
+		workerPool->warmConnectionCount++;
+	}
+
+	workerPool->activeConnectionCount++;
+	workerPool->idleConnectionCount++;
+	session->sessionHasActiveConnection = true;
+}
+
+
+/*
+ * Activate2PCIfModifyingTransactionExpandsToNewNode sets the coordinated
+ * transaction to use 2PC under the following circumstances:
+ *     - We're already in a transaction block
+ *     - At least one of the previous commands in the transaction block
+ *       made a modification, which have not set 2PC itself because it
+ *       was a single shard command
+ *     - The input "session" is used for a distributed execution which
+ *       modifies the database. However, the session (and hence the
+ *       connection) is established to a different worker than the ones
+ *       that is used previously in the transaction.
+ *
+ *  To give an example,
+ *      BEGIN;
+ *          -- assume that the following INSERT goes to worker-A
+ *          -- also note that this single command does not activate
+ *          -- 2PC itself since it is a single shard modification
+ *          INSERT INTO distributed_table (dist_key) VALUES (1);
+ *
+ *          -- do one more single shard UPDATE hitting the same
+ *          shard (or worker node in general)
+ *          -- this wouldn't activate 2PC, since we're operating on the
+ *          -- same worker node that we've modified earlier
+ *          -- so the executor would use the same connection
+ *			UPDATE distributed_table SET value = 10 WHERE dist_key = 1;
+ *
+ *          -- now, do one more INSERT, which goes to worker-B
+ *          -- At this point, this function would activate 2PC
+ *          -- since we're now expanding to a new node
+ *          -- for example, if this command were a SELECT, we wouldn't
+ *          -- activate 2PC since we're only interested in modifications/DDLs
+ *          INSERT INTO distributed_table (dist_key) VALUES (2);
+ */
+static void
+Activate2PCIfModifyingTransactionExpandsToNewNode(WorkerSession *session)
+{
+	DistributedExecution *execution = session->workerPool->distributedExecution;
+	if (TransactionModifiedDistributedTable(execution) &&
+		DistributedExecutionModifiesDatabase(execution) &&
+		!ConnectionModifiedPlacement(session->connection))
+	{
+		/*
+		 * We already did a modification, but not on the connection that we
+		 * just opened, which means we're now going to make modifications
+		 * over multiple connections. Activate 2PC!
+		 */
+		Use2PCForCoordinatedTransaction();
+	}
+}
+
+
+/*
+ * TransactionModifiedDistributedTable returns true if the current transaction already
+ * executed a command which modified at least one distributed table in the current
+ * transaction.
+ */
+static bool
+TransactionModifiedDistributedTable(DistributedExecution *execution)
+{
+	/*
+	 * We need to explicitly check for TRANSACTION_BLOCKS_REQUIRED due to
+	 * citus.function_opens_transaction_block flag. When set to false, we
+	 * should not be pretending that we're in a coordinated transaction even
+	 * if XACT_MODIFICATION_DATA is set. That's why we implemented this workaround.
+	 */
+	return execution->transactionProperties->useRemoteTransactionBlocks ==
+		   TRANSACTION_BLOCKS_REQUIRED &&
+		   XactModificationLevel == XACT_MODIFICATION_DATA;
+}
+
+
+/*
+ * TransactionStateMachine manages the execution of tasks over a connection.
+ */
+static void
+TransactionStateMachine(WorkerSession *session)
+{
+	WorkerPool *workerPool = session->workerPool;
+	DistributedExecution *execution = workerPool->distributedExecution;
+	TransactionBlocksUsage useRemoteTransactionBlocks =
+		execution->transactionProperties->useRemoteTransactionBlocks;
+
+	MultiConnection *connection = session->connection;
+	RemoteTransaction *transaction = &(connection->remoteTransaction);
+	RemoteTransactionState currentState;
+
+	do {
+		currentState = transaction->transactionState;
+
+		if (!CheckConnectionReady(session))
+		{
+			/* connection is busy, no state transitions to make */
+			break;
+		}
+
+		switch (currentState)
+		{
+			case REMOTE_TRANS_NOT_STARTED:
+			{
+				if (useRemoteTransactionBlocks == TRANSACTION_BLOCKS_REQUIRED)
+				{
+					/* if we're expanding the nodes in a transaction, use 2PC */
+					Activate2PCIfModifyingTransactionExpandsToNewNode(session);
+
+					bool beginRequired = true;
+					if (ShouldPipelineSession(session, beginRequired))
+					{
+						/* send BEGIN and the tasks in a single pipeline */
+						bool pipelineStarted =
+							StartPipelinedExecutionOnSession(session, beginRequired);
+						if (!pipelineStarted)
+						{
+							/* no need to continue, connection is lost */
+							Assert(session->connection->connectionState ==
+								   MULTI_CONNECTION_LOST);
+
+							return;
+						}
+					}
+					else
+					{
+						/* need to open a transaction block first */
+						StartRemoteTransactionBegin(connection);
+					}
+
+					transaction->transactionState = REMOTE_TRANS_CLEARING_RESULTS;
+				}
+				else
+				{
+					bool beginRequired = false;
+					if (ShouldPipelineSession(session, beginRequired))
+					{
+						bool pipelineStarted =
+							StartPipelinedExecutionOnSession(session, beginRequired);
+						if (!pipelineStarted)
+						{
+							/* no need to continue, connection is lost */
+							Assert(session->connection->connectionState ==
+								   MULTI_CONNECTION_LOST);
+
+							return;
+						}
+
+						transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
+						UpdateConnectionWaitFlags(session,
+												  WL_SOCKET_READABLE |
+												  WL_SOCKET_WRITEABLE);
+						break;
+					}
+
+					TaskPlacementExecution *placementExecution = PopPlacementExecution(
+						session);
+					if (placementExecution == NULL)
+					{
+						/*
+						 * No tasks are ready to be executed at the moment. But we
+						 * still mark the socket readable to get any notices if exists.
+						 */
+						UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
+
+						break;
+					}
+
+					bool placementExecutionStarted =
+						StartPlacementExecutionOnSession(placementExecution, session);
+					if (!placementExecutionStarted)
+					{
+						/* no need to continue, connection is lost */
+						Assert(session->connection->connectionState ==
+							   MULTI_CONNECTION_LOST);
+
+						return;
+					}
+
+					transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
+				}
+
+				UpdateConnectionWaitFlags(session,
+										  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
 				break;
 			}
 
-			case MULTI_CONNECTION_CONNECTING:
+			case REMOTE_TRANS_SENT_BEGIN:
+			case REMOTE_TRANS_CLEARING_RESULTS:
 			{
-				ConnStatusType status = PQstatus(connection->pgConn);
-				if (status == CONNECTION_OK)
+				PGresult *result = PQgetResult(connection->pgConn);
+				if (result != NULL)
 				{
-					/*
-					 * Connection was already established, possibly a cached
-					 * connection.
-					 */
-					bool newConnection = false;
-					HandleMultiConnectionSuccess(session, newConnection);
+					if (PQresultStatus(result) == PGRES_PIPELINE_SYNC)
+					{
+						/* all pipelined commands are done, leave pipeline mode */
+						PQclear(result);
+
+						if (PQexitPipelineMode(connection->pgConn) == 0)
+						{
+							connection->connectionState = MULTI_CONNECTION_LOST;
+							return;
+						}
+
+						/* wake up WaitEventSetWait */
+						UpdateConnectionWaitFlags(session,
+												  WL_SOCKET_READABLE |
+												  WL_SOCKET_WRITEABLE);
+
+						break;
+					}
+
+					if (!IsResponseOK(result))
+					{
+						/* query failures are always hard errors */
+						ReportResultError(connection, result, ERROR);
+					}
+
+					PQclear(result);
+
+					/* wake up WaitEventSetWait */
 					UpdateConnectionWaitFlags(session,
 											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+
 					break;
 				}
-				else if (status == CONNECTION_BAD)
+
+				if (session->pipelinedSetupCommandCount > 0)
 				{
-					connection->connectionState = MULTI_CONNECTION_FAILED;
-					IncrementStatCounterForMyDb(STAT_CONNECTION_ESTABLISHMENT_FAILED);
-					break;
-				}
+					/*
+					 * In pipeline mode, a NULL result only ends the results of
+					 * a single command. Once all setup commands are cleared, the
+					 * results of the pipelined tasks follow.
+					 */
+					session->pipelinedSetupCommandCount--;
 
-				int beforePollSocket = PQsocket(connection->pgConn);
-				PostgresPollingStatusType pollMode = PQconnectPoll(connection->pgConn);
+					if (session->pipelinedSetupCommandCount == 0)
+					{
+						/* must happen before any result of the task is parsed */
+						if (PQsetSingleRowMode(connection->pgConn) == 0)
+						{
+							connection->connectionState = MULTI_CONNECTION_LOST;
+							return;
+						}
 
-				if (beforePollSocket != PQsocket(connection->pgConn))
-				{
-					/* rebuild the wait events if PQconnectPoll() changed the socket */
-					execution->rebuildWaitEventSet = true;
-				}
+						transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
+					}
 
-				if (pollMode == PGRES_POLLING_FAILED)
-				{
-					connection->connectionState = MULTI_CONNECTION_FAILED;
-					IncrementStatCounterForMyDb(STAT_CONNECTION_ESTABLISHMENT_FAILED);
+					UpdateConnectionWaitFlags(session,
+											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+					break;
 				}
-				else if (pollMode == PGRES_POLLING_READING)
-				{
-					UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
 
-					/* we should have a valid socket */
-					Assert(PQsocket(connection->pgConn) != -1);
-				}
-				else if (pollMode == PGRES_POLLING_WRITING)
+				if (session->currentTask != NULL)
 				{
-					UpdateConnectionWaitFlags(session, WL_SOCKET_WRITEABLE);
+					TaskPlacementExecution *placementExecution = session->currentTask;
+					bool succeeded = true;
 
-					/* we should have a valid socket */
-					Assert(PQsocket(connection->pgConn) != -1);
-				}
-				else
-				{
 					/*
-					 * Connection was not established befoore (!= CONNECTION_OK)
-					 * but PQconnectPoll() did so now.
+					 * Once we finished a task on a connection, we no longer
+					 * allow that connection to fail.
 					 */
-					bool newConnection = true;
-					HandleMultiConnectionSuccess(session, newConnection);
-					UpdateConnectionWaitFlags(session,
-											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+					MarkRemoteTransactionCritical(connection);
 
-					/* we should have a valid socket */
-					Assert(PQsocket(connection->pgConn) != -1);
+					session->currentTask = NULL;
+
+					PlacementExecutionDone(placementExecution, succeeded);
+
+					/* connection is ready to use for executing commands */
+					workerPool->idleConnectionCount++;
 				}
 
-				break;
-			}
+				/* connection needs to be writeable to send next command */
+				UpdateConnectionWaitFlags(session,
+										  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
 
-			case MULTI_CONNECTION_CONNECTED:
-			{
-				if (HasUnfinishedTaskForSession(session))
+				if (transaction->beginSent)
 				{
-					/*
-					 * Connection is ready, and we have unfinished tasks.
-					 * So, run the transaction state machine.
-					 */
-					TransactionStateMachine(session);
+					transaction->transactionState = REMOTE_TRANS_STARTED;
 				}
 				else
 				{
-					/*
-					 * Connection is ready, but we don't have any unfinished
-					 * tasks that this session can execute.
-					 *
-					 * Note that we can be in a situation where the executor
-					 * decides to establish a connection, but not need to
-					 * use it at the time the connection is established. This could
-					 * happen when the earlier connections manages to finish all the
-					 * tasks after this connection
-					 *
-					 * As no tasks are ready to be executed at the moment, we
-					 * mark the socket readable to get any notices if exists.
-					 */
-					UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
+					transaction->transactionState = REMOTE_TRANS_NOT_STARTED;
 				}
-
 				break;
 			}
 
-			case MULTI_CONNECTION_LOST:
+			case REMOTE_TRANS_STARTED:
 			{
-				/*
-				 * If a connection is lost, we retry the connection for some
-				 * very restricted scenarios. The main use case is to retry
-				 * connection establishment when a cached connection is used
-				 * in the executor while remote server has restarted / failedover
-				 * etc.
-				 *
-				 * For simplicity, we only allow retrying connection establishment
-				 * a single time.
-				 *
-				 * We can only retry connection when the remote transaction has
-				 * not started over the connection. Otherwise, we'd have to deal
-				 * with restoring the transaction state, which is beyond our
-				 * purpose at this time.
-				 */
-				RemoteTransaction *transaction = &connection->remoteTransaction;
-				if (!session->connectionRetried &&
-					transaction->transactionState == REMOTE_TRANS_NOT_STARTED)
+				bool beginRequired = false;
+				if (ShouldPipelineSession(session, beginRequired))
 				{
-					/*
-					 * Try to connect again, we will reuse the same MultiConnection
-					 * and keep it as claimed.
-					 */
-					RestartConnection(connection);
-
-					/* socket have changed */
-					execution->rebuildWaitEventSet = true;
-					session->latestUnconsumedWaitEvents = 0;
+					bool pipelineStarted =
+						StartPipelinedExecutionOnSession(session, beginRequired);
+					if (!pipelineStarted)
+					{
+						/* no need to continue, connection is lost */
+						Assert(session->connection->connectionState ==
+							   MULTI_CONNECTION_LOST);
 
-					session->connectionRetried = true;
+						return;
+					}
 
+					transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
 					break;
 				}
 
-				/*
-				 * Here we don't increment the connection stat counter for failed
-				 * connections because we don't track the connections that we could
-				 * establish but lost later.
-				 */
-				connection->connectionState = MULTI_CONNECTION_FAILED;
-				break;
-			}
-
-			case MULTI_CONNECTION_FAILED:
-			{
-				/* managed to connect, but connection was lost */
-				if (session->sessionHasActiveConnection)
+				TaskPlacementExecution *placementExecution = PopPlacementExecution(
+					session);
+				if (placementExecution == NULL)
 				{
-					workerPool->activeConnectionCount--;
-
-					if (session->currentTask == NULL)
-					{
-						/* this was an idle connection */
-						workerPool->idleConnectionCount--;
-					}
-
-					session->sessionHasActiveConnection = false;
+					/* no tasks are ready to be executed at the moment */
+					UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
+					break;
 				}
 
-				/* connection failed or was lost */
-				int totalConnectionCount = list_length(workerPool->sessionList);
+				bool placementExecutionStarted =
+					StartPlacementExecutionOnSession(placementExecution, session);
+				if (!placementExecutionStarted)
+				{
+					/* no need to continue, connection is lost */
+					Assert(session->connection->connectionState == MULTI_CONNECTION_LOST);
 
-				workerPool->failedConnectionCount++;
+					return;
+				}
 
-				/* if the connection executed a critical command it should fail */
-				MarkRemoteTransactionFailed(connection, false);
+				transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
+				break;
+			}
 
-				/* mark all assigned placement executions as failed */
-				WorkerSessionFailed(session);
+			case REMOTE_TRANS_SENT_COMMAND:
+			{
+				if (session->pipelinedSetupCommandCount > 0)
+				{
+					/* the task's PREPARE was pipelined, clear its result first */
+					transaction->transactionState = REMOTE_TRANS_CLEARING_RESULTS;
+					break;
+				}
 
-				if (workerPool->failedConnectionCount >= totalConnectionCount)
+				TaskPlacementExecution *placementExecution = session->currentTask;
+				if (placementExecution == NULL)
 				{
 					/*
-					 * All current connection attempts have failed.
-					 * Mark all unassigned placement executions as failed.
+					 * We have seen accounts in production where the placementExecution
+					 * could inadvertently be not set. Investigation documented on
+					 * https://github.com/citusdata/citus-enterprise/issues/493
+					 * (due to sensitive data in the initial report it is not discussed
+					 * in our community repository)
 					 *
-					 * We do not currently retry if the first connection
-					 * attempt fails.
+					 * Currently we don't have a reliable way of reproducing this issue.
+					 * Erroring here seems to be a more desirable approach compared to a
+					 * SEGFAULT on the dereference of placementExecution, with a possible
+					 * crash recovery as a result.
 					 */
-					WorkerPoolFailed(workerPool);
+					ereport(ERROR, (errmsg(
+										"unable to recover from inconsistent state in "
+										"the connection state machine on coordinator")));
 				}
 
+				ShardCommandExecution *shardCommandExecution =
+					placementExecution->shardCommandExecution;
+				Task *task = shardCommandExecution->task;
+
 				/*
-				 * The execution may have failed as a result of WorkerSessionFailed
-				 * or WorkerPoolFailed.
-				 *
-				 * Even if this execution has not failed -- but just a single session is
-				 * failed -- and an earlier execution in this transaction which marked
-				 * the remote transaction as critical, we should fail right away as the
-				 * transaction will fail anyway on PREPARE/COMMIT time.
+				 * In EXPLAIN ANALYZE we need to store results except for multiple placements,
+				 * regardless of query type. In other cases, doing the same doesn't seem to have
+				 * a drawback.
 				 */
-				RemoteTransaction *transaction = &connection->remoteTransaction;
+				bool storeRows = true;
 
-				if (transaction->transactionCritical ||
-					execution->failed ||
-					(execution->transactionProperties->errorOnAnyFailure &&
-					 workerPool->failureState != WORKER_POOL_FAILED_OVER_TO_LOCAL))
+				if (shardCommandExecution->gotResults)
 				{
-					/* a task has failed due to this connection failure */
-					ReportConnectionError(connection, ERROR);
+					/* already received results from another replica */
+					storeRows = false;
 				}
-				else if (workerPool->activeConnectionCount > 0 ||
-						 workerPool->failureState == WORKER_POOL_FAILED_OVER_TO_LOCAL)
+				else if (task->partiallyLocalOrRemote)
 				{
 					/*
-					 * We already have active connection(s) to the node, and the
-					 * executor is capable of using those connections to successfully
-					 * finish the execution. So, there is not much value in warning
-					 * the user.
-					 *
-					 * Similarly when the pool is failed over to local execution, warning
-					 * the user just creates chatter.
+					 * For the tasks that involves placements from both
+					 * remote and local placments, such as modifications
+					 * to reference tables, we store the rows during the
+					 * local placement/execution.
 					 */
-					ReportConnectionError(connection, DEBUG1);
+					storeRows = false;
 				}
-				else
+
+				bool fetchDone = ReceiveResults(session, storeRows);
+				if (!fetchDone)
 				{
-					ReportConnectionError(connection, WARNING);
+					break;
 				}
 
-				/* remove the connection */
-				UnclaimConnection(connection);
+				/* if this is a multi-query task, send the next query */
+				if (placementExecution->queryIndex < task->queryCount)
+				{
+					bool querySent = SendNextQuery(placementExecution, session);
+					if (!querySent)
+					{
+						/* no need to continue, connection is lost */
+						Assert(session->connection->connectionState ==
+							   MULTI_CONNECTION_LOST);
 
-				/*
-				 * We forcefully close the underlying libpq connection because
-				 * we don't want any subsequent execution (either subPlan executions
-				 * or new command executions within a transaction block) use the
-				 * connection.
-				 *
-				 * However, we prefer to keep the MultiConnection around until
-				 * the end of FinishDistributedExecution() to simplify the code.
-				 * Thus, we prefer ShutdownConnection() over CloseConnection().
-				 */
-				ShutdownConnection(connection);
+						return;
+					}
 
-				/* remove connection from wait event set */
-				execution->rebuildWaitEventSet = true;
+					/*
+					 * At this point the query might be just in pgconn buffers. We
+					 * need to wait until it becomes writeable to actually send
+					 * the query.
+					 */
+					UpdateConnectionWaitFlags(session,
+											  WL_SOCKET_WRITEABLE | WL_SOCKET_READABLE);
 
-				/*
-				 * Reset the transaction state machine since CloseConnection()
-				 * relies on it and even if we're not inside a distributed transaction
-				 * we set the transaction state (e.g., REMOTE_TRANS_SENT_COMMAND).
-				 */
-				if (!connection->remoteTransaction.beginSent)
+					transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
+
+					break;
+				}
+
+				shardCommandExecution->gotResults = true;
+
+				if (!dlist_is_empty(&session->pipelinedTaskQueue))
 				{
-					connection->remoteTransaction.transactionState =
-						REMOTE_TRANS_NOT_STARTED;
+					/* the results of the next pipelined task follow right away */
+					bool advanced = AdvancePipelinedExecution(session);
+					if (!advanced)
+					{
+						/* no need to continue, connection is lost */
+						Assert(session->connection->connectionState ==
+							   MULTI_CONNECTION_LOST);
+
+						return;
+					}
+
+					UpdateConnectionWaitFlags(session,
+											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+					break;
 				}
 
+				transaction->transactionState = REMOTE_TRANS_CLEARING_RESULTS;
 				break;
 			}
 
@@ -3251,581 +4366,613 @@ ConnectionStateMachine(WorkerSession *session)
 				break;
 			}
 		}
-	} while (connection->connectionState != currentState);
+	}
+	/* iterate in case we can perform multiple transitions at once */
+	while (transaction->transactionState != currentState);
 }
 
 
 /*
- * HasUnfinishedTaskForSession gets a session and returns true if there
- * are any tasks that this session can execute.
+ * UpdateConnectionWaitFlags is a wrapper around setting waitFlags of the connection.
+ *
+ * This function might further improved in a sense that to use use ModifyWaitEvent on
+ * waitFlag changes as opposed to what we do now: always rebuild the wait event sets.
+ * Our initial benchmarks didn't show any significant performance improvements, but
+ * good to keep in mind the potential improvements.
  */
-static bool
-HasUnfinishedTaskForSession(WorkerSession *session)
+static void
+UpdateConnectionWaitFlags(WorkerSession *session, int waitFlags)
 {
-	if (session->currentTask != NULL)
-	{
-		/* the session is executing a command right now */
-		return true;
-	}
+	MultiConnection *connection = session->connection;
+	DistributedExecution *execution = session->workerPool->distributedExecution;
 
-	dlist_head *sessionReadyTaskQueue = &(session->readyTaskQueue);
-	if (!dlist_is_empty(sessionReadyTaskQueue))
+	/* do not take any actions if the flags not changed */
+	if (connection->waitFlags == waitFlags)
 	{
-		/* session has an assigned task, which is ready for execution */
-		return true;
+		return;
 	}
 
-	WorkerPool *workerPool = session->workerPool;
-	dlist_head *poolReadyTaskQueue = &(workerPool->readyTaskQueue);
-	if (!dlist_is_empty(poolReadyTaskQueue))
-	{
-		/*
-		 * Pool has unassigned tasks that can be executed
-		 * by the input session.
-		 */
-		return true;
-	}
+	/* always detect closed sockets */
+	connection->waitFlags = waitFlags | WL_SOCKET_CLOSED;
 
-	return false;
+	/* without signalling the execution, the flag changes won't be reflected */
+	execution->waitFlagsChanged = true;
 }
 
 
 /*
- * HandleMultiConnectionSuccess logs the established connection and updates
- * connection's state.
+ * CheckConnectionReady returns true if the connection is ready to
+ * read or write, or false if it still has bytes to send/receive.
  */
-static void
-HandleMultiConnectionSuccess(WorkerSession *session, bool newConnection)
+static bool
+CheckConnectionReady(WorkerSession *session)
 {
 	MultiConnection *connection = session->connection;
-	WorkerPool *workerPool = session->workerPool;
-
-	MarkConnectionConnected(connection, newConnection);
-
-	ereport(DEBUG4, (errmsg("established connection to %s:%d for "
-							"session %ld in %ld microseconds",
-							connection->hostname, connection->port,
-							session->sessionId,
-							MicrosecondsBetweenTimestamps(
-								connection->connectionEstablishmentStart,
-								connection->connectionEstablishmentEnd))));
+	int waitFlags = WL_SOCKET_READABLE;
+	bool connectionReady = false;
 
-	workerPool->activeConnectionCount++;
-	workerPool->idleConnectionCount++;
-	session->sessionHasActiveConnection = true;
-}
+	ConnStatusType status = PQstatus(connection->pgConn);
+	if (status == CONNECTION_BAD)
+	{
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
+	}
 
+	if ((session->latestUnconsumedWaitEvents & WL_SOCKET_CLOSED) != 0)
+	{
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
+	}
 
-/*
- * Activate2PCIfModifyingTransactionExpandsToNewNode sets the coordinated
- * transaction to use 2PC under the following circumstances:
- *     - We're already in a transaction block
- *     - At least one of the previous commands in the transaction block
- *       made a modification, which have not set 2PC itself because it
- *       was a single shard command
- *     - The input "session" is used for a distributed execution which
- *       modifies the database. However, the session (and hence the
- *       connection) is established to a different worker than the ones
- *       that is used previously in the transaction.
- *
- *  To give an example,
- *      BEGIN;
- *          -- assume that the following INSERT goes to worker-A
- *          -- also note that this single command does not activate
- *          -- 2PC itself since it is a single shard modification
- *          INSERT INTO distributed_table (dist_key) VALUES (1);
- *
- *          -- do one more single shard UPDATE hitting the same
- *          shard (or worker node in general)
- *          -- this wouldn't activate 2PC, since we're operating on the
- *          -- same worker node that we've modified earlier
- *          -- so the executor would use the same connection
- *			UPDATE distributed_table SET value = 10 WHERE dist_key = 1;
- *
- *          -- now, do one more INSERT, which goes to worker-B
- *          -- At this point, this function would activate 2PC
- *          -- since we're now expanding to a new node
- *          -- for example, if this command were a SELECT, we wouldn't
- *          -- activate 2PC since we're only interested in modifications/DDLs
- *          INSERT INTO distributed_table (dist_key) VALUES (2);
- */
-static void
-Activate2PCIfModifyingTransactionExpandsToNewNode(WorkerSession *session)
-{
-	DistributedExecution *execution = session->workerPool->distributedExecution;
-	if (TransactionModifiedDistributedTable(execution) &&
-		DistributedExecutionModifiesDatabase(execution) &&
-		!ConnectionModifiedPlacement(session->connection))
+	/* try to send all pending data */
+	int sendStatus = PQflush(connection->pgConn);
+	if (sendStatus == -1)
+	{
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
+	}
+	else if (sendStatus == 1)
 	{
-		/*
-		 * We already did a modification, but not on the connection that we
-		 * just opened, which means we're now going to make modifications
-		 * over multiple connections. Activate 2PC!
-		 */
-		Use2PCForCoordinatedTransaction();
+		/* more data to send, wait for socket to become writable */
+		waitFlags = waitFlags | WL_SOCKET_WRITEABLE;
 	}
-}
 
+	if ((session->latestUnconsumedWaitEvents & WL_SOCKET_READABLE) != 0)
+	{
+		if (PQconsumeInput(connection->pgConn) == 0)
+		{
+			connection->connectionState = MULTI_CONNECTION_LOST;
+			return false;
+		}
+	}
 
-/*
- * TransactionModifiedDistributedTable returns true if the current transaction already
- * executed a command which modified at least one distributed table in the current
- * transaction.
- */
-static bool
-TransactionModifiedDistributedTable(DistributedExecution *execution)
-{
-	/*
-	 * We need to explicitly check for TRANSACTION_BLOCKS_REQUIRED due to
-	 * citus.function_opens_transaction_block flag. When set to false, we
-	 * should not be pretending that we're in a coordinated transaction even
-	 * if XACT_MODIFICATION_DATA is set. That's why we implemented this workaround.
-	 */
-	return execution->transactionProperties->useRemoteTransactionBlocks ==
-		   TRANSACTION_BLOCKS_REQUIRED &&
-		   XactModificationLevel == XACT_MODIFICATION_DATA;
+	if (!PQisBusy(connection->pgConn))
+	{
+		connectionReady = true;
+	}
+
+	UpdateConnectionWaitFlags(session, waitFlags);
+
+	/* don't consume input redundantly if we cycle back into CheckConnectionReady */
+	session->latestUnconsumedWaitEvents = 0;
+
+	return connectionReady;
 }
 
 
 /*
- * TransactionStateMachine manages the execution of tasks over a connection.
+ * PopPlacementExecution returns the next available assigned or unassigned
+ * placement execution for the given session.
  */
-static void
-TransactionStateMachine(WorkerSession *session)
+static TaskPlacementExecution *
+PopPlacementExecution(WorkerSession *session)
 {
 	WorkerPool *workerPool = session->workerPool;
-	DistributedExecution *execution = workerPool->distributedExecution;
-	TransactionBlocksUsage useRemoteTransactionBlocks =
-		execution->transactionProperties->useRemoteTransactionBlocks;
-
-	MultiConnection *connection = session->connection;
-	RemoteTransaction *transaction = &(connection->remoteTransaction);
-	RemoteTransactionState currentState;
-
-	do {
-		currentState = transaction->transactionState;
 
-		if (!CheckConnectionReady(session))
+	TaskPlacementExecution *placementExecution = PopAssignedPlacementExecution(session);
+	if (placementExecution == NULL)
+	{
+		if (session->commandsSent > 0 && UseConnectionPerPlacement())
 		{
-			/* connection is busy, no state transitions to make */
-			break;
+			/*
+			 * Only send one command per connection if force_max_query_parallelisation
+			 * is enabled, unless it's an assigned placement execution.
+			 */
+			return NULL;
 		}
 
-		switch (currentState)
-		{
-			case REMOTE_TRANS_NOT_STARTED:
-			{
-				if (useRemoteTransactionBlocks == TRANSACTION_BLOCKS_REQUIRED)
-				{
-					/* if we're expanding the nodes in a transaction, use 2PC */
-					Activate2PCIfModifyingTransactionExpandsToNewNode(session);
-
-					/* need to open a transaction block first */
-					StartRemoteTransactionBegin(connection);
-
-					transaction->transactionState = REMOTE_TRANS_CLEARING_RESULTS;
-				}
-				else
-				{
-					TaskPlacementExecution *placementExecution = PopPlacementExecution(
-						session);
-					if (placementExecution == NULL)
-					{
-						/*
-						 * No tasks are ready to be executed at the moment. But we
-						 * still mark the socket readable to get any notices if exists.
-						 */
-						UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
-
-						break;
-					}
-
-					bool placementExecutionStarted =
-						StartPlacementExecutionOnSession(placementExecution, session);
-					if (!placementExecutionStarted)
-					{
-						/* no need to continue, connection is lost */
-						Assert(session->connection->connectionState ==
-							   MULTI_CONNECTION_LOST);
-
-						return;
-					}
+		/* no more assigned tasks, pick an unassigned task */
+		placementExecution = PopUnassignedPlacementExecution(workerPool);
+	}
 
-					transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
-				}
+	return placementExecution;
+}
 
-				UpdateConnectionWaitFlags(session,
-										  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
-				break;
-			}
 
-			case REMOTE_TRANS_SENT_BEGIN:
-			case REMOTE_TRANS_CLEARING_RESULTS:
-			{
-				PGresult *result = PQgetResult(connection->pgConn);
-				if (result != NULL)
-				{
-					if (!IsResponseOK(result))
-					{
-						/* query failures are always hard errors */
-						ReportResultError(connection, result, ERROR);
-					}
+/*
+ * PopAssignedPlacementExecution finds an executable task from the queue of assigned tasks.
+ */
+static TaskPlacementExecution *
+PopAssignedPlacementExecution(WorkerSession *session)
+{
+	dlist_head *readyTaskQueue = &(session->readyTaskQueue);
 
-					PQclear(result);
+	if (dlist_is_empty(readyTaskQueue))
+	{
+		return NULL;
+	}
 
-					/* wake up WaitEventSetWait */
-					UpdateConnectionWaitFlags(session,
-											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+	TaskPlacementExecution *placementExecution = dlist_container(TaskPlacementExecution,
+																 sessionReadyQueueNode,
+																 dlist_pop_head_node(
+																	 readyTaskQueue));
 
-					break;
-				}
+	return placementExecution;
+}
 
-				if (session->currentTask != NULL)
-				{
-					TaskPlacementExecution *placementExecution = session->currentTask;
-					bool succeeded = true;
 
-					/*
-					 * Once we finished a task on a connection, we no longer
-					 * allow that connection to fail.
-					 */
-					MarkRemoteTransactionCritical(connection);
+/*
+ * PopUnAssignedPlacementExecution finds an executable task from the queue of unassigned tasks.
+ */
+static TaskPlacementExecution *
+PopUnassignedPlacementExecution(WorkerPool *workerPool)
+{
+	dlist_head *readyTaskQueue = &(workerPool->readyTaskQueue);
 
-					session->currentTask = NULL;
+	if (dlist_is_empty(readyTaskQueue))
+	{
+		return NULL;
+	}
 
-					PlacementExecutionDone(placementExecution, succeeded);
+	TaskPlacementExecution *placementExecution = dlist_container(TaskPlacementExecution,
+																 workerReadyQueueNode,
+																 dlist_pop_head_node(
+																	 readyTaskQueue));
 
-					/* connection is ready to use for executing commands */
-					workerPool->idleConnectionCount++;
-				}
+	workerPool->readyTaskCount--;
 
-				/* connection needs to be writeable to send next command */
-				UpdateConnectionWaitFlags(session,
-										  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+	return placementExecution;
+}
 
-				if (transaction->beginSent)
-				{
-					transaction->transactionState = REMOTE_TRANS_STARTED;
-				}
-				else
-				{
-					transaction->transactionState = REMOTE_TRANS_NOT_STARTED;
-				}
-				break;
-			}
 
-			case REMOTE_TRANS_STARTED:
-			{
-				TaskPlacementExecution *placementExecution = PopPlacementExecution(
-					session);
-				if (placementExecution == NULL)
-				{
-					/* no tasks are ready to be executed at the moment */
-					UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
-					break;
-				}
+/*
+ * StartPlacementExecutionOnSession gets a TaskPlacementExecution and
+ * WorkerSession, the task's query is sent to the worker via the session.
+ *
+ * The function does some bookkeeping such as associating the placement
+ * accesses with the connection and updating session's local variables. For
+ * details read the comments in the function.
+ *
+ * The function returns true if the query is successfully sent over the
+ * connection, otherwise false.
+ */
+static bool
+StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
+								 WorkerSession *session)
+{
+	WorkerPool *workerPool = session->workerPool;
+	DistributedExecution *execution = workerPool->distributedExecution;
+	MultiConnection *connection = session->connection;
+	ShardCommandExecution *shardCommandExecution =
+		placementExecution->shardCommandExecution;
+	Task *task = shardCommandExecution->task;
+	ShardPlacement *taskPlacement = placementExecution->shardPlacement;
+	List *placementAccessList = PlacementAccessListForTask(task, taskPlacement);
 
-				bool placementExecutionStarted =
-					StartPlacementExecutionOnSession(placementExecution, session);
-				if (!placementExecutionStarted)
-				{
-					/* no need to continue, connection is lost */
-					Assert(session->connection->connectionState == MULTI_CONNECTION_LOST);
+	if (execution->transactionProperties->useRemoteTransactionBlocks !=
+		TRANSACTION_BLOCKS_DISALLOWED)
+	{
+		/*
+		 * Make sure that subsequent commands on the same placement
+		 * use the same connection.
+		 */
+		AssignPlacementListToConnection(placementAccessList, connection);
+	}
 
-					return;
-				}
+	if (session->commandsSent == 0)
+	{
+		/* first time we send a command, consider the connection used (not unused) */
+		workerPool->unusedConnectionCount--;
+	}
 
-				transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
-				break;
-			}
+	/* connection is going to be in use */
+	workerPool->idleConnectionCount--;
+	session->currentTask = placementExecution;
+	UpdatePeakTaskDemand(workerPool);
+	placementExecution->executionState = PLACEMENT_EXECUTION_RUNNING;
 
-			case REMOTE_TRANS_SENT_COMMAND:
-			{
-				TaskPlacementExecution *placementExecution = session->currentTask;
-				if (placementExecution == NULL)
-				{
-					/*
-					 * We have seen accounts in production where the placementExecution
-					 * could inadvertently be not set. Investigation documented on
-					 * https://github.com/citusdata/citus-enterprise/issues/493
-					 * (due to sensitive data in the initial report it is not discussed
-					 * in our community repository)
-					 *
-					 * Currently we don't have a reliable way of reproducing this issue.
-					 * Erroring here seems to be a more desirable approach compared to a
-					 * SEGFAULT on the dereference of placementExecution, with a possible
-					 * crash recovery as a result.
-					 */
-					ereport(ERROR, (errmsg(
-										"unable to recover from inconsistent state in "
-										"the connection state machine on coordinator")));
-				}
+	Assert(INSTR_TIME_IS_ZERO(placementExecution->startTime));
 
-				ShardCommandExecution *shardCommandExecution =
-					placementExecution->shardCommandExecution;
-				Task *task = shardCommandExecution->task;
+	/*
+	 * The same TaskPlacementExecution can be used to have
+	 * call SendNextQuery() several times if queryIndex is
+	 * non-zero. Still, all are executed under the current
+	 * placementExecution, so we can start the timer right
+	 * now.
+	 */
+	INSTR_TIME_SET_CURRENT(placementExecution->startTime);
 
-				/*
-				 * In EXPLAIN ANALYZE we need to store results except for multiple placements,
-				 * regardless of query type. In other cases, doing the same doesn't seem to have
-				 * a drawback.
-				 */
-				bool storeRows = true;
+	bool querySent = SendNextQuery(placementExecution, session);
+	if (querySent)
+	{
+		session->commandsSent++;
 
-				if (shardCommandExecution->gotResults)
-				{
-					/* already received results from another replica */
-					storeRows = false;
-				}
-				else if (task->partiallyLocalOrRemote)
-				{
-					/*
-					 * For the tasks that involves placements from both
-					 * remote and local placments, such as modifications
-					 * to reference tables, we store the rows during the
-					 * local placement/execution.
-					 */
-					storeRows = false;
-				}
+		if (workerPool->poolToLocalNode)
+		{
+			/*
+			 * As we started remote execution to the local node,
+			 * we cannot switch back to local execution as that
+			 * would cause self-deadlocks and breaking
+			 * read-your-own-writes consistency.
+			 */
+			SetLocalExecutionStatus(LOCAL_EXECUTION_DISABLED);
+		}
+	}
 
-				bool fetchDone = ReceiveResults(session, storeRows);
-				if (!fetchDone)
-				{
-					break;
-				}
+	return querySent;
+}
 
-				/* if this is a multi-query task, send the next query */
-				if (placementExecution->queryIndex < task->queryCount)
-				{
-					bool querySent = SendNextQuery(placementExecution, session);
-					if (!querySent)
-					{
-						/* no need to continue, connection is lost */
-						Assert(session->connection->connectionState ==
-							   MULTI_CONNECTION_LOST);
 
-						return;
-					}
+/*
+ * SendNextQuery sends the next query for placementExecution on the given
+ * session.
+ */
+static bool
+SendNextQuery(TaskPlacementExecution *placementExecution,
+			  WorkerSession *session)
+{
+	WorkerPool *workerPool = session->workerPool;
+	DistributedExecution *execution = workerPool->distributedExecution;
+	MultiConnection *connection = session->connection;
+	ShardCommandExecution *shardCommandExecution =
+		placementExecution->shardCommandExecution;
+	bool binaryResults = shardCommandExecution->binaryResults;
+	Task *task = shardCommandExecution->task;
+	ParamListInfo paramListInfo = execution->paramListInfo;
+	int querySent = 0;
+	uint32 queryIndex = placementExecution->queryIndex;
 
-					/*
-					 * At this point the query might be just in pgconn buffers. We
-					 * need to wait until it becomes writeable to actually send
-					 * the query.
-					 */
-					UpdateConnectionWaitFlags(session,
-											  WL_SOCKET_WRITEABLE | WL_SOCKET_READABLE);
+	Assert(queryIndex < task->queryCount);
+	char *queryString = TaskQueryStringAtIndex(task, queryIndex);
 
-					transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
+	if (paramListInfo != NULL && !task->parametersInQueryStringResolved)
+	{
+		int parameterCount = paramListInfo->numParams;
+		Oid *parameterTypes = NULL;
+		const char **parameterValues = NULL;
 
-					break;
-				}
+		/* force evaluation of bound params */
+		paramListInfo = copyParamList(paramListInfo);
 
-				shardCommandExecution->gotResults = true;
-				transaction->transactionState = REMOTE_TRANS_CLEARING_RESULTS;
-				break;
-			}
+		ExtractParametersForRemoteExecution(paramListInfo, &parameterTypes,
+											&parameterValues);
 
-			default:
-			{
-				break;
-			}
+		if (ShouldUseWorkerPreparedStatement(execution, session))
+		{
+			querySent = SendRemoteCommandPrepared(connection, queryString,
+												  parameterCount, parameterTypes,
+												  parameterValues, binaryResults,
+												  &session->pipelinedSetupCommandCount);
+		}
+		else
+		{
+			querySent = SendRemoteCommandParams(connection, queryString,
+												parameterCount, parameterTypes,
+												parameterValues, binaryResults);
 		}
 	}
-	/* iterate in case we can perform multiple transitions at once */
-	while (transaction->transactionState != currentState);
+	else
+	{
+		/*
+		 * We only need to use SendRemoteCommandParams when we desire
+		 * binaryResults. One downside of SendRemoteCommandParams is that it
+		 * only supports one query in the query string. In some cases we have
+		 * more than one query. In those cases we already make sure before that
+		 * binaryResults is false.
+		 *
+		 * XXX: It also seems that SendRemoteCommandParams does something
+		 * strange/incorrectly with select statements. In
+		 * isolation_select_vs_all.spec, when doing an s1-router-select in one
+		 * session blocked an s2-ddl-create-index-concurrently in another.
+		 */
+		if (!binaryResults)
+		{
+			querySent = SendRemoteCommand(connection, queryString);
+		}
+		else
+		{
+			querySent = SendRemoteCommandParams(connection, queryString, 0, NULL, NULL,
+												binaryResults);
+		}
+	}
+
+	if (querySent == 0)
+	{
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
+	}
+
+	/*
+	 * In pipeline mode, single-row mode applies to the command whose results
+	 * are received next. Hence we leave it to AdvancePipelinedExecution to
+	 * set it for tasks that are queued behind the current task, and to the
+	 * transaction state machine once the results of the commands pipelined
+	 * ahead of the current task are cleared.
+	 */
+	if (placementExecution != session->currentTask ||
+		session->pipelinedSetupCommandCount > 0)
+	{
+		return true;
+	}
+
+	int singleRowMode = PQsetSingleRowMode(connection->pgConn);
+	if (singleRowMode == 0)
+	{
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
+	}
+
+	return true;
 }
 
 
 /*
- * UpdateConnectionWaitFlags is a wrapper around setting waitFlags of the connection.
- *
- * This function might further improved in a sense that to use use ModifyWaitEvent on
- * waitFlag changes as opposed to what we do now: always rebuild the wait event sets.
- * Our initial benchmarks didn't show any significant performance improvements, but
- * good to keep in mind the potential improvements.
+ * ShouldUseWorkerPreparedStatement returns whether the parameterized query of
+ * a single task execution should be sent as a statement that is prepared on
+ * the worker. We only do so for executions with a single task, since those are
+ * the ones that benefit from skipping parsing on the worker. Statements are
+ * prepared in a pipeline of their own, so not while the session is already
+ * pipelining.
  */
-static void
-UpdateConnectionWaitFlags(WorkerSession *session, int waitFlags)
+static bool
+ShouldUseWorkerPreparedStatement(DistributedExecution *execution,
+								 WorkerSession *session)
 {
-	MultiConnection *connection = session->connection;
-	DistributedExecution *execution = session->workerPool->distributedExecution;
+	if (!EnableWorkerPreparedStatements)
+	{
+		return false;
+	}
 
-	/* do not take any actions if the flags not changed */
-	if (connection->waitFlags == waitFlags)
+	if (list_length(execution->remoteTaskList) != 1)
 	{
-		return;
+		return false;
 	}
 
-	/* always detect closed sockets */
-	connection->waitFlags = waitFlags | WL_SOCKET_CLOSED;
+	Task *task = linitial(execution->remoteTaskList);
+	if (task->queryCount != 1)
+	{
+		return false;
+	}
 
-	/* without signalling the execution, the flag changes won't be reflected */
-	execution->waitFlagsChanged = true;
+	return PQpipelineStatus(session->connection->pgConn) == PQ_PIPELINE_OFF;
 }
 
 
 /*
- * CheckConnectionReady returns true if the connection is ready to
- * read or write, or false if it still has bytes to send/receive.
+ * TaskListCanBePipelined returns whether all tasks in the list can be sent to
+ * the workers in libpq pipeline mode. Pipeline mode uses the extended query
+ * protocol for every command, which does not allow multiple statements in a
+ * single query string. We therefore restrict pipelining to tasks that the
+ * planner generates for a single SELECT or DML statement.
  */
 static bool
-CheckConnectionReady(WorkerSession *session)
+TaskListCanBePipelined(List *taskList)
+{
+	Task *task = NULL;
+	foreach_declared_ptr(task, taskList)
+	{
+		if (task->queryCount != 1)
+		{
+			return false;
+		}
+
+		if (task->taskType != READ_TASK && task->taskType != MODIFY_TASK)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * ShouldPipelineSession returns whether the session should send its next
+ * tasks in a libpq pipeline rather than one at a time. A pipeline only pays
+ * off when it saves a round trip, which is when BEGIN can be sent along with
+ * the first task or when there is more than one task to send.
+ */
+static bool
+ShouldPipelineSession(WorkerSession *session, bool beginRequired)
 {
+	WorkerPool *workerPool = session->workerPool;
+	DistributedExecution *execution = workerPool->distributedExecution;
 	MultiConnection *connection = session->connection;
-	int waitFlags = WL_SOCKET_READABLE;
-	bool connectionReady = false;
 
-	ConnStatusType status = PQstatus(connection->pgConn);
-	if (status == CONNECTION_BAD)
+	if (!execution->pipeliningSupported)
 	{
-		connection->connectionState = MULTI_CONNECTION_LOST;
 		return false;
 	}
 
-	if ((session->latestUnconsumedWaitEvents & WL_SOCKET_CLOSED) != 0)
+	if (UseConnectionPerPlacement())
 	{
-		connection->connectionState = MULTI_CONNECTION_LOST;
+		/* we send only one command per connection in that case */
 		return false;
 	}
 
-	/* try to send all pending data */
-	int sendStatus = PQflush(connection->pgConn);
-	if (sendStatus == -1)
+	if (PQpipelineStatus(connection->pgConn) != PQ_PIPELINE_OFF)
 	{
-		connection->connectionState = MULTI_CONNECTION_LOST;
 		return false;
 	}
-	else if (sendStatus == 1)
+
+	if (beginRequired && !RemoteTransactionBeginCanBePipelined())
 	{
-		/* more data to send, wait for socket to become writable */
-		waitFlags = waitFlags | WL_SOCKET_WRITEABLE;
+		return false;
 	}
 
-	if ((session->latestUnconsumedWaitEvents & WL_SOCKET_READABLE) != 0)
+	int readyTaskCount = workerPool->readyTaskCount;
+	dlist_head *sessionReadyTaskQueue = &(session->readyTaskQueue);
+	if (!dlist_is_empty(sessionReadyTaskQueue))
 	{
-		if (PQconsumeInput(connection->pgConn) == 0)
+		readyTaskCount++;
+
+		if (dlist_has_next(sessionReadyTaskQueue, dlist_head_node(sessionReadyTaskQueue)))
 		{
-			connection->connectionState = MULTI_CONNECTION_LOST;
-			return false;
+			readyTaskCount++;
 		}
 	}
 
-	if (!PQisBusy(connection->pgConn))
+	if (beginRequired)
 	{
-		connectionReady = true;
+		return readyTaskCount >= 1;
 	}
 
-	UpdateConnectionWaitFlags(session, waitFlags);
-
-	/* don't consume input redundantly if we cycle back into CheckConnectionReady */
-	session->latestUnconsumedWaitEvents = 0;
-
-	return connectionReady;
+	return readyTaskCount >= 2;
 }
 
 
 /*
- * PopPlacementExecution returns the next available assigned or unassigned
- * placement execution for the given session.
+ * PopPipelinedPlacementExecutions pops the placement executions that the
+ * session sends in a single pipeline. Those are all tasks assigned to the
+ * session and a fair share of the unassigned tasks of the worker pool, such
+ * that the other usable connections to the worker still get some tasks.
  */
-static TaskPlacementExecution *
-PopPlacementExecution(WorkerSession *session)
+static List *
+PopPipelinedPlacementExecutions(WorkerSession *session)
 {
 	WorkerPool *workerPool = session->workerPool;
+	List *placementExecutionList = NIL;
 
-	TaskPlacementExecution *placementExecution = PopAssignedPlacementExecution(session);
-	if (placementExecution == NULL)
+	while (true)
 	{
-		if (session->commandsSent > 0 && UseConnectionPerPlacement())
+		TaskPlacementExecution *placementExecution =
+			PopAssignedPlacementExecution(session);
+		if (placementExecution == NULL)
 		{
-			/*
-			 * Only send one command per connection if force_max_query_parallelisation
-			 * is enabled, unless it's an assigned placement execution.
-			 */
-			return NULL;
+			break;
 		}
 
-		/* no more assigned tasks, pick an unassigned task */
-		placementExecution = PopUnassignedPlacementExecution(workerPool);
+		placementExecutionList = lappend(placementExecutionList, placementExecution);
 	}
 
-	return placementExecution;
+	int usableConnectionCount = Max(UsableConnectionCount(workerPool), 1);
+	int unassignedTaskCount =
+		(workerPool->readyTaskCount + usableConnectionCount - 1) /
+		usableConnectionCount;
+
+	for (int taskIndex = 0; taskIndex < unassignedTaskCount; taskIndex++)
+	{
+		TaskPlacementExecution *placementExecution =
+			PopUnassignedPlacementExecution(workerPool);
+		if (placementExecution == NULL)
+		{
+			break;
+		}
+
+		placementExecutionList = lappend(placementExecutionList, placementExecution);
+	}
+
+	return placementExecutionList;
 }
 
 
 /*
- * PopAssignedPlacementExecution finds an executable task from the queue of assigned tasks.
+ * StartPipelinedExecutionOnSession puts the connection of the session in
+ * pipeline mode and sends BEGIN (if required) followed by all the tasks that
+ * the session picks up, terminated by a single pipeline sync. The first task
+ * becomes the current task of the session and the others are queued in
+ * pipelinedTaskQueue, in the order in which their results arrive.
+ *
+ * The function returns true if all commands are successfully sent over the
+ * connection, otherwise false.
  */
-static TaskPlacementExecution *
-PopAssignedPlacementExecution(WorkerSession *session)
+static bool
+StartPipelinedExecutionOnSession(WorkerSession *session, bool beginRequired)
 {
-	dlist_head *readyTaskQueue = &(session->readyTaskQueue);
+	MultiConnection *connection = session->connection;
+	List *placementExecutionList = PopPipelinedPlacementExecutions(session);
 
-	if (dlist_is_empty(readyTaskQueue))
+	/* ShouldPipelineSession made sure that there is at least one task */
+	Assert(placementExecutionList != NIL);
+
+	/*
+	 * Queue all tasks on the session before sending anything, such that
+	 * WorkerSessionFailed finds them if the connection is lost halfway.
+	 */
+	TaskPlacementExecution *placementExecution = NULL;
+	foreach_declared_ptr(placementExecution, placementExecutionList)
 	{
-		return NULL;
+		dlist_push_tail(&session->pipelinedTaskQueue,
+						&placementExecution->sessionPipelineQueueNode);
 	}
 
-	TaskPlacementExecution *placementExecution = dlist_container(TaskPlacementExecution,
-																 sessionReadyQueueNode,
-																 dlist_pop_head_node(
-																	 readyTaskQueue));
-
-	return placementExecution;
-}
+	if (PQenterPipelineMode(connection->pgConn) == 0)
+	{
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
+	}
 
+	if (beginRequired)
+	{
+		session->pipelinedSetupCommandCount =
+			StartRemoteTransactionBeginPipelined(connection);
+	}
 
-/*
- * PopUnAssignedPlacementExecution finds an executable task from the queue of unassigned tasks.
- */
-static TaskPlacementExecution *
-PopUnassignedPlacementExecution(WorkerPool *workerPool)
-{
-	dlist_head *readyTaskQueue = &(workerPool->readyTaskQueue);
+	dlist_node *firstNode = dlist_pop_head_node(&session->pipelinedTaskQueue);
+	placementExecution =
+		dlist_container(TaskPlacementExecution, sessionPipelineQueueNode, firstNode);
 
-	if (dlist_is_empty(readyTaskQueue))
+	bool placementExecutionStarted =
+		StartPlacementExecutionOnSession(placementExecution, session);
+	if (!placementExecutionStarted)
 	{
-		return NULL;
+		return false;
 	}
 
-	TaskPlacementExecution *placementExecution = dlist_container(TaskPlacementExecution,
-																 workerReadyQueueNode,
-																 dlist_pop_head_node(
-																	 readyTaskQueue));
+	dlist_iter iter;
+	dlist_foreach(iter, &session->pipelinedTaskQueue)
+	{
+		placementExecution =
+			dlist_container(TaskPlacementExecution, sessionPipelineQueueNode, iter.cur);
 
-	workerPool->readyTaskCount--;
+		bool querySent = AddPlacementExecutionToPipeline(placementExecution, session);
+		if (!querySent)
+		{
+			return false;
+		}
+	}
 
-	return placementExecution;
+	if (PQpipelineSync(connection->pgConn) == 0)
+	{
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
+	}
+
+	return true;
 }
 
 
 /*
- * StartPlacementExecutionOnSession gets a TaskPlacementExecution and
- * WorkerSession, the task's query is sent to the worker via the session.
- *
- * The function does some bookkeeping such as associating the placement
- * accesses with the connection and updating session's local variables. For
- * details read the comments in the function.
- *
- * The function returns true if the query is successfully sent over the
- * connection, otherwise false.
+ * AddPlacementExecutionToPipeline sends the query of a placement execution
+ * that is queued behind the current task of the session in the pipeline. It
+ * does the same bookkeeping as StartPlacementExecutionOnSession, except for
+ * the parts that only apply to the task that the session is working on.
  */
 static bool
-StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
-								 WorkerSession *session)
+AddPlacementExecutionToPipeline(TaskPlacementExecution *placementExecution,
+								WorkerSession *session)
 {
 	WorkerPool *workerPool = session->workerPool;
 	DistributedExecution *execution = workerPool->distributedExecution;
 	MultiConnection *connection = session->connection;
-	ShardCommandExecution *shardCommandExecution =
-		placementExecution->shardCommandExecution;
-	Task *task = shardCommandExecution->task;
+	Task *task = placementExecution->shardCommandExecution->task;
 	ShardPlacement *taskPlacement = placementExecution->shardPlacement;
-	List *placementAccessList = PlacementAccessListForTask(task, taskPlacement);
 
 	if (execution->transactionProperties->useRemoteTransactionBlocks !=
 		TRANSACTION_BLOCKS_DISALLOWED)
 	{
+		List *placementAccessList = PlacementAccessListForTask(task, taskPlacement);
+
 		/*
 		 * Make sure that subsequent commands on the same placement
 		 * use the same connection.
@@ -3833,43 +4980,12 @@ StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
 		AssignPlacementListToConnection(placementAccessList, connection);
 	}
 
-	if (session->commandsSent == 0)
-	{
-		/* first time we send a command, consider the connection used (not unused) */
-		workerPool->unusedConnectionCount--;
-	}
-
-	/* connection is going to be in use */
-	workerPool->idleConnectionCount--;
-	session->currentTask = placementExecution;
 	placementExecution->executionState = PLACEMENT_EXECUTION_RUNNING;
 
-	Assert(INSTR_TIME_IS_ZERO(placementExecution->startTime));
-
-	/*
-	 * The same TaskPlacementExecution can be used to have
-	 * call SendNextQuery() several times if queryIndex is
-	 * non-zero. Still, all are executed under the current
-	 * placementExecution, so we can start the timer right
-	 * now.
-	 */
-	INSTR_TIME_SET_CURRENT(placementExecution->startTime);
-
 	bool querySent = SendNextQuery(placementExecution, session);
 	if (querySent)
 	{
 		session->commandsSent++;
-
-		if (workerPool->poolToLocalNode)
-		{
-			/*
-			 * As we started remote execution to the local node,
-			 * we cannot switch back to local execution as that
-			 * would cause self-deadlocks and breaking
-			 * read-your-own-writes consistency.
-			 */
-			SetLocalExecutionStatus(LOCAL_EXECUTION_DISABLED);
-		}
 	}
 
 	return querySent;
@@ -3877,75 +4993,38 @@ StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
 
 
 /*
- * SendNextQuery sends the next query for placementExecution on the given
- * session.
+ * AdvancePipelinedExecution marks the current task of the session as done
+ * and makes the next task in the pipeline the current task. The connection
+ * stays busy, so unlike the regular path we do not consider it idle.
+ *
+ * The function returns false if the connection turned out to be unusable.
  */
 static bool
-SendNextQuery(TaskPlacementExecution *placementExecution,
-			  WorkerSession *session)
+AdvancePipelinedExecution(WorkerSession *session)
 {
-	WorkerPool *workerPool = session->workerPool;
-	DistributedExecution *execution = workerPool->distributedExecution;
 	MultiConnection *connection = session->connection;
-	ShardCommandExecution *shardCommandExecution =
-		placementExecution->shardCommandExecution;
-	bool binaryResults = shardCommandExecution->binaryResults;
-	Task *task = shardCommandExecution->task;
-	ParamListInfo paramListInfo = execution->paramListInfo;
-	int querySent = 0;
-	uint32 queryIndex = placementExecution->queryIndex;
+	TaskPlacementExecution *placementExecution = session->currentTask;
+	bool succeeded = true;
 
-	Assert(queryIndex < task->queryCount);
-	char *queryString = TaskQueryStringAtIndex(task, queryIndex);
+	/*
+	 * Once we finished a task on a connection, we no longer
+	 * allow that connection to fail.
+	 */
+	MarkRemoteTransactionCritical(connection);
 
-	if (paramListInfo != NULL && !task->parametersInQueryStringResolved)
-	{
-		int parameterCount = paramListInfo->numParams;
-		Oid *parameterTypes = NULL;
-		const char **parameterValues = NULL;
+	session->currentTask = NULL;
 
-		/* force evaluation of bound params */
-		paramListInfo = copyParamList(paramListInfo);
+	PlacementExecutionDone(placementExecution, succeeded);
 
-		ExtractParametersForRemoteExecution(paramListInfo, &parameterTypes,
-											&parameterValues);
-		querySent = SendRemoteCommandParams(connection, queryString, parameterCount,
-											parameterTypes, parameterValues,
-											binaryResults);
-	}
-	else
-	{
-		/*
-		 * We only need to use SendRemoteCommandParams when we desire
-		 * binaryResults. One downside of SendRemoteCommandParams is that it
-		 * only supports one query in the query string. In some cases we have
-		 * more than one query. In those cases we already make sure before that
-		 * binaryResults is false.
-		 *
-		 * XXX: It also seems that SendRemoteCommandParams does something
-		 * strange/incorrectly with select statements. In
-		 * isolation_select_vs_all.spec, when doing an s1-router-select in one
-		 * session blocked an s2-ddl-create-index-concurrently in another.
-		 */
-		if (!binaryResults)
-		{
-			querySent = SendRemoteCommand(connection, queryString);
-		}
-		else
-		{
-			querySent = SendRemoteCommandParams(connection, queryString, 0, NULL, NULL,
-												binaryResults);
-		}
-	}
+	dlist_node *nextNode = dlist_pop_head_node(&session->pipelinedTaskQueue);
+	placementExecution =
+		dlist_container(TaskPlacementExecution, sessionPipelineQueueNode, nextNode);
 
-	if (querySent == 0)
-	{
-		connection->connectionState = MULTI_CONNECTION_LOST;
-		return false;
-	}
+	session->currentTask = placementExecution;
+	INSTR_TIME_SET_CURRENT(placementExecution->startTime);
 
-	int singleRowMode = PQsetSingleRowMode(connection->pgConn);
-	if (singleRowMode == 0)
+	/* must happen before any result of the next task is parsed */
+	if (PQsetSingleRowMode(connection->pgConn) == 0)
 	{
 		connection->connectionState = MULTI_CONNECTION_LOST;
 		return false;
@@ -4303,6 +5382,14 @@ WorkerSessionFailed(WorkerSession *session)
 
 		PlacementExecutionDone(placementExecution, succeeded);
 	}
+
+	dlist_foreach(iter, &session->pipelinedTaskQueue)
+	{
+		placementExecution =
+			dlist_container(TaskPlacementExecution, sessionPipelineQueueNode, iter.cur);
+
+		PlacementExecutionDone(placementExecution, succeeded);
+	}
 }
 
 
@@ -4601,6 +5688,7 @@ PlacementExecutionReady(TaskPlacementExecution *placementExecution)
 		}
 
 		workerPool->readyTaskCount++;
+		UpdatePeakTaskDemand(workerPool);
 
 		/* wake up an idle connection by checking whether the connection is writeable */
 		WorkerSession *session = NULL;
@@ -4956,6 +6044,74 @@ CleanUpSessions(DistributedExecution *execution)
 }
 
 
+/*
+ * RecordConnectionWarmupStats records the parallelism that the tasks used
+ * on each worker in the finished execution and the connections they used, for
+ * keeping connections warm in this and other backends.
+ */
+static void
+RecordConnectionWarmupStats(DistributedExecution *execution)
+{
+	if (MaxWarmConnectionsPerWorker == 0)
+	{
+		return;
+	}
+
+	/*
+	 * Single-task executions, which are the bulk of the executions in many
+	 * workloads, tell nothing about the parallelism. Skip them to avoid the
+	 * contention on the shared statistics.
+	 */
+	if (list_length(execution->remoteTaskList) <= 1)
+	{
+		return;
+	}
+
+	WorkerPool *workerPool = NULL;
+	foreach_declared_ptr(workerPool, execution->workerList)
+	{
+		if (workerPool->failureState != WORKER_POOL_NOT_FAILED)
+		{
+			continue;
+		}
+
+		/*
+		 * Record how many tasks could have used a connection at the same
+		 * time rather than how many connections were open. The latter
+		 * includes the warm connections that the execution opened up front,
+		 * so the recorded parallelism would never go down.
+		 */
+		int parallelism = workerPool->peakTaskDemand;
+		if (parallelism == 0)
+		{
+			/* tasks of the pool executed locally */
+			continue;
+		}
+
+		RecordWorkerPoolConnectionUsage(workerPool->nodeName, workerPool->nodePort,
+										parallelism, workerPool->newConnectionCount,
+										workerPool->totalConnectionEstablishmentTime,
+										workerPool->warmConnectionCount);
+	}
+}
+
+
+/*
+ * UpdatePeakTaskDemand keeps track of the highest number of tasks that were
+ * running or ready to run on the pool at the same time, which is the number
+ * of connections the execution could have used in parallel.
+ */
+static void
+UpdatePeakTaskDemand(WorkerPool *workerPool)
+{
+	int runningTaskCount = workerPool->activeConnectionCount -
+						   workerPool->idleConnectionCount;
+	int taskDemand = runningTaskCount + workerPool->readyTaskCount;
+
+	workerPool->peakTaskDemand = Max(workerPool->peakTaskDemand, taskDemand);
+}
+
+
 /*
  * UnclaimAllSessionConnections unclaims all of the connections for the given
  * sessionList.
@@ -45,6 +45,7 @@
 #include "distributed/multi_executor.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/multi_server_executor.h"
+#include "distributed/remote_prepared_statements.h"
 #include "distributed/shard_utils.h"
 #include "distributed/stats/query_stats.h"
 #include "distributed/stats/stat_counters.h"
@@ -67,7 +68,7 @@ static void CitusBeginReadOnlyScan(CustomScanState *node, EState *estate, int ef
 static void CitusBeginModifyScan(CustomScanState *node, EState *estate, int eflags);
 static void CitusPreExecScan(CitusScanState *scanState);
 static bool ModifyJobNeedsEvaluation(Job *workerJob);
-static void RegenerateTaskForFasthPathQuery(Job *workerJob);
+static void RegenerateTaskForFasthPathQuery(Job *workerJob, Query *pruningQuery);
 static void RegenerateTaskListForInsert(Job *workerJob);
 static DistributedPlan * CopyDistributedPlanWithoutCache(DistributedPlan *
 														 originalDistributedPlan);
@@ -181,6 +182,8 @@ CitusBeginScan(CustomScanState *node, EState *estate, int eflags)
 {
 	CitusScanState *scanState = (CitusScanState *) node;
 
+	scanState->eflags = eflags;
+
 	/*
 	 * Make sure we can see notices during regular queries, which would typically
 	 * be the result of a function that raises a notices being called.
@@ -282,7 +285,17 @@ CitusExecScan(CustomScanState *node)
 		scanState->finishedRemoteScan = true;
 	}
 
-	return ReturnTupleFromTuplestore(scanState);
+	TupleTableSlot *resultSlot = ReturnTupleFromTuplestore(scanState);
+
+	/* when streaming results, wait for more rows once we returned all of them */
+	while (TupIsNull(resultSlot) && scanState->streamingExecution != NULL)
+	{
+		AdaptiveExecutorFetchNextBatch(scanState);
+
+		resultSlot = ReturnTupleFromTuplestore(scanState);
+	}
+
+	return resultSlot;
 }
 
 
@@ -336,13 +349,29 @@ CitusBeginReadOnlyScan(CustomScanState *node, EState *estate, int eflags)
 	 *
 	 * TODO: evaluate stable functions
 	 */
-	ExecuteCoordinatorEvaluableExpressions(jobQuery, planState);
+	if (EnableWorkerPreparedStatements && estate->es_param_list_info != NULL)
+	{
+		/*
+		 * Prune on a copy of the query in which the parameters are evaluated,
+		 * but keep the parameters in the shard query. That way, the query
+		 * string is the same for every execution on a given shard and the
+		 * worker can reuse the statement that it prepared for it.
+		 */
+		Query *evaluatedQuery = copyObject(jobQuery);
+		ExecuteCoordinatorEvaluableExpressions(evaluatedQuery, planState);
+
+		RegenerateTaskForFasthPathQuery(workerJob, evaluatedQuery);
+	}
+	else
+	{
+		ExecuteCoordinatorEvaluableExpressions(jobQuery, planState);
 
-	/* job query no longer has parameters, so we should not send any */
-	workerJob->parametersInJobQueryResolved = true;
+		/* job query no longer has parameters, so we should not send any */
+		workerJob->parametersInJobQueryResolved = true;
 
-	/* parameters are filled in, so we can generate a task for this execution */
-	RegenerateTaskForFasthPathQuery(workerJob);
+		/* parameters are filled in, so we can generate a task for this execution */
+		RegenerateTaskForFasthPathQuery(workerJob, jobQuery);
+	}
 
 	if (IsLocalPlanCachingSupported(workerJob, originalDistributedPlan))
 	{
@@ -421,7 +450,7 @@ CitusBeginModifyScan(CustomScanState *node, EState *estate, int eflags)
 		}
 		else
 		{
-			RegenerateTaskForFasthPathQuery(workerJob);
+			RegenerateTaskForFasthPathQuery(workerJob, workerJob->jobQuery);
 		}
 	}
 	else if (workerJob->requiresCoordinatorEvaluation)
@@ -649,13 +678,15 @@ RegenerateTaskListForInsert(Job *workerJob)
 /*
  * RegenerateTaskForFasthPathQuery does the shard pruning for
  * UPDATE/DELETE/SELECT fast path router queries and rebuilds the query strings.
+ * Pruning is done on pruningQuery, which is either the job query itself or a
+ * copy of it in which the parameters are evaluated.
  */
 static void
-RegenerateTaskForFasthPathQuery(Job *workerJob)
+RegenerateTaskForFasthPathQuery(Job *workerJob, Query *pruningQuery)
 {
 	bool isMultiShardQuery = false;
 	List *shardIntervalList =
-		TargetShardIntervalForFastPathQuery(workerJob->jobQuery,
+		TargetShardIntervalForFastPathQuery(pruningQuery,
 											&isMultiShardQuery, NULL,
 											&workerJob->partitionKeyValue);
 
@@ -802,6 +833,13 @@ CitusEndScan(CustomScanState *node)
 	Const *partitionKeyConst = NULL;
 	char *partitionKeyString = NULL;
 
+	/* the scan may end before all streamed results are received, e.g. on LIMIT */
+	if (scanState->streamingExecution != NULL)
+	{
+		bool discardRows = true;
+		AdaptiveExecutorFinishStreaming(scanState, discardRows);
+	}
+
 	/* stop propagating notices */
 	DisableWorkerMessagePropagation();
 
@@ -854,7 +892,21 @@ CitusReScan(CustomScanState *node)
 	ExecScanReScan(&node->ss);
 
 	CitusScanState *scanState = (CitusScanState *) node;
-	if (scanState->tuplestorestate)
+	if (scanState->resultsStreamed)
+	{
+		/*
+		 * Streamed rows are discarded once they are returned, so we cannot
+		 * rewind the tuple store. Instead, we execute the query again.
+		 */
+		bool discardRows = true;
+		AdaptiveExecutorFinishStreaming(scanState, discardRows);
+
+		tuplestore_end(scanState->tuplestorestate);
+		scanState->tuplestorestate = NULL;
+		scanState->resultsStreamed = false;
+		scanState->finishedRemoteScan = false;
+	}
+	else if (scanState->tuplestorestate)
 	{
 		tuplestore_rescan(scanState->tuplestorestate);
 	}
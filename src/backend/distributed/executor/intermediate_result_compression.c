@@ -0,0 +1,496 @@
+/*-------------------------------------------------------------------------
+ *
+ * intermediate_result_compression.c
+ *   Functions for compressing and decompressing intermediate result files.
+ *
+ * A compressed intermediate result file starts with a signature that begins
+ * with a zero byte, which can never be the first byte of a text or binary
+ * COPY file. The signature is followed by a series of chunks, each of which
+ * consists of a header with the compression method, the uncompressed length
+ * and the compressed length, followed by the compressed bytes. Together, the
+ * uncompressed chunks form a regular COPY file.
+ *
+ * Since files are transferred between nodes byte-for-byte, compressed files
+ * are also compressed on the wire. Readers recognize compressed files by the
+ * signature, such that they can read files regardless of the compression
+ * setting of the node that wrote the file.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include "port/pg_bswap.h"
+#include "storage/fd.h"
+
+#include "citus_version.h"
+
+#include "distributed/intermediate_result_compression.h"
+#include "distributed/transmit.h"
+#include "distributed/version_compat.h"
+
+#if HAVE_CITUS_LIBLZ4
+#include <lz4.h>
+#endif
+
+#if HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+
+/* prefer compression speed over ratio, since results are short-lived */
+#define INTERMEDIATE_RESULT_ZSTD_LEVEL 1
+
+#define COMPRESSED_RESULT_SIGNATURE_SIZE 8
+#define COMPRESSED_RESULT_CHUNK_HEADER_SIZE 9
+
+
+/*
+ * CompressedResultReadState keeps track of the progress of reading a
+ * compressed intermediate result file.
+ */
+typedef struct CompressedResultReadState
+{
+	FileCompat fileCompat;
+
+	/* uncompressed contents of the current chunk */
+	StringInfo chunk;
+	int chunkOffset;
+} CompressedResultReadState;
+
+
+/* GUC, determining how intermediate result files are compressed */
+int IntermediateResultCompression = INTERMEDIATE_RESULT_COMPRESSION_NONE;
+
+static const char CompressedResultSignature[COMPRESSED_RESULT_SIGNATURE_SIZE] = {
+	'\0', 'C', 'I', 'T', 'U', 'S', 'Z', '\n'
+};
+
+/* state of the compressed file that is currently being read */
+static CompressedResultReadState *CompressedResultReader = NULL;
+
+
+static int CompressChunk(const char *data, int length, int compressionType,
+						 char *compressedData, int compressedCapacity);
+static int CompressedChunkBound(int length, int compressionType);
+static void DecompressChunk(const char *compressedData, int compressedLength,
+							int compressionType, StringInfo chunk, int rawLength);
+static bool ReadNextCompressedChunk(CompressedResultReadState *readState);
+static void ReadExactly(FileCompat *fileCompat, char *buffer, int length);
+
+
+/*
+ * AppendCompressedResultSignature appends the signature that marks the
+ * beginning of a compressed intermediate result file to the buffer.
+ */
+void
+AppendCompressedResultSignature(StringInfo buffer)
+{
+	appendBinaryStringInfo(buffer, CompressedResultSignature,
+						   COMPRESSED_RESULT_SIGNATURE_SIZE);
+}
+
+
+/*
+ * AppendCompressedResultChunk compresses the given COPY data using the given
+ * compression method and appends it as a chunk to the buffer. If compressing
+ * does not make the data smaller, the data is stored uncompressed.
+ */
+void
+AppendCompressedResultChunk(StringInfo buffer, const char *data, int length,
+							int compressionType)
+{
+	int headerOffset = buffer->len;
+	int compressedLength = 0;
+
+	/* reserve space for the header, we fill it in below */
+	appendStringInfoSpaces(buffer, COMPRESSED_RESULT_CHUNK_HEADER_SIZE);
+
+	if (compressionType != INTERMEDIATE_RESULT_COMPRESSION_NONE)
+	{
+		int compressedCapacity = CompressedChunkBound(length, compressionType);
+
+		enlargeStringInfo(buffer, compressedCapacity);
+
+		compressedLength = CompressChunk(data, length, compressionType,
+										 buffer->data + buffer->len,
+										 compressedCapacity);
+	}
+
+	if (compressedLength <= 0 || compressedLength >= length)
+	{
+		compressionType = INTERMEDIATE_RESULT_COMPRESSION_NONE;
+		compressedLength = length;
+
+		appendBinaryStringInfo(buffer, data, length);
+	}
+	else
+	{
+		buffer->len += compressedLength;
+		buffer->data[buffer->len] = '\0';
+	}
+
+	uint32 rawLengthNetwork = pg_hton32((uint32) length);
+	uint32 compressedLengthNetwork = pg_hton32((uint32) compressedLength);
+	char *header = buffer->data + headerOffset;
+
+	header[0] = (char) compressionType;
+	memcpy(header + 1, &rawLengthNetwork, sizeof(uint32));
+	memcpy(header + 5, &compressedLengthNetwork, sizeof(uint32));
+}
+
+
+/*
+ * CompressedChunkBound returns the maximum number of bytes that compressing
+ * length bytes with the given method can produce.
+ */
+static int
+CompressedChunkBound(int length, int compressionType)
+{
+	switch (compressionType)
+	{
+#if HAVE_CITUS_LIBLZ4
+		case INTERMEDIATE_RESULT_COMPRESSION_LZ4:
+		{
+			return LZ4_compressBound(length);
+		}
+#endif
+
+#if HAVE_LIBZSTD
+		case INTERMEDIATE_RESULT_COMPRESSION_ZSTD:
+		{
+			return ZSTD_compressBound(length);
+		}
+#endif
+
+		default:
+		{
+			return length;
+		}
+	}
+}
+
+
+/*
+ * CompressChunk compresses the data into compressedData and returns the
+ * compressed length, or 0 if the data could not be compressed.
+ */
+static int
+CompressChunk(const char *data, int length, int compressionType,
+			  char *compressedData, int compressedCapacity)
+{
+	switch (compressionType)
+	{
+#if HAVE_CITUS_LIBLZ4
+		case INTERMEDIATE_RESULT_COMPRESSION_LZ4:
+		{
+			return LZ4_compress_default(data, compressedData, length,
+										compressedCapacity);
+		}
+#endif
+
+#if HAVE_LIBZSTD
+		case INTERMEDIATE_RESULT_COMPRESSION_ZSTD:
+		{
+			size_t compressedSize = ZSTD_compress(compressedData, compressedCapacity,
+												  data, length,
+												  INTERMEDIATE_RESULT_ZSTD_LEVEL);
+			if (ZSTD_isError(compressedSize))
+			{
+				return 0;
+			}
+
+			return (int) compressedSize;
+		}
+#endif
+
+		default:
+		{
+			return 0;
+		}
+	}
+}
+
+
+/*
+ * BeginCompressedResultRead opens the given intermediate result file and
+ * checks whether it starts with the signature of a compressed file. If so,
+ * it prepares for ReadCompressedResultData to return the uncompressed COPY
+ * data and returns true. Otherwise, the file is closed and false is returned.
+ */
+bool
+BeginCompressedResultRead(const char *fileName)
+{
+	char signature[COMPRESSED_RESULT_SIGNATURE_SIZE];
+	const int fileFlags = (O_RDONLY | PG_BINARY);
+
+	File fileDesc = FileOpenForTransmit(fileName, fileFlags);
+	FileCompat fileCompat = FileCompatFromFileStart(fileDesc);
+
+	int bytesRead = FileReadCompat(&fileCompat, signature,
+								   COMPRESSED_RESULT_SIGNATURE_SIZE, PG_WAIT_IO);
+	if (bytesRead < 0)
+	{
+		int readErrno = errno;
+
+		FileClose(fileDesc);
+
+		errno = readErrno;
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not read file \"%s\": %m", fileName)));
+	}
+
+	if (bytesRead != COMPRESSED_RESULT_SIGNATURE_SIZE ||
+		memcmp(signature, CompressedResultSignature,
+			   COMPRESSED_RESULT_SIGNATURE_SIZE) != 0)
+	{
+		FileClose(fileDesc);
+		return false;
+	}
+
+	/* the caller ends every read, also when it errors out */
+	Assert(CompressedResultReader == NULL);
+
+	CompressedResultReader = palloc0(sizeof(CompressedResultReadState));
+	CompressedResultReader->fileCompat = fileCompat;
+	CompressedResultReader->chunk = makeStringInfo();
+	CompressedResultReader->chunkOffset = 0;
+
+	return true;
+}
+
+
+/*
+ * ReadCompressedResultData implements the data source callback of
+ * BeginCopyFrom for the file opened by BeginCompressedResultRead. It copies
+ * at least minread and at most maxread bytes of uncompressed data to outbuf,
+ * unless the end of the file is reached.
+ */
+int
+ReadCompressedResultData(void *outbuf, int minread, int maxread)
+{
+	CompressedResultReadState *readState = CompressedResultReader;
+	char *output = (char *) outbuf;
+	int bytesCopied = 0;
+
+	Assert(readState != NULL);
+
+	while (bytesCopied < minread)
+	{
+		StringInfo chunk = readState->chunk;
+
+		if (readState->chunkOffset >= chunk->len)
+		{
+			if (!ReadNextCompressedChunk(readState))
+			{
+				break;
+			}
+
+			continue;
+		}
+
+		int bytesToCopy = Min(maxread - bytesCopied,
+							  chunk->len - readState->chunkOffset);
+
+		memcpy(output + bytesCopied, chunk->data + readState->chunkOffset,
+			   bytesToCopy);
+
+		readState->chunkOffset += bytesToCopy;
+		bytesCopied += bytesToCopy;
+	}
+
+	return bytesCopied;
+}
+
+
+/*
+ * EndCompressedResultRead closes the file that was opened by
+ * BeginCompressedResultRead and resets the read state. The caller should
+ * also call it when reading errors out, since the file is not tracked by
+ * the resource owner.
+ */
+void
+EndCompressedResultRead(void)
+{
+	CompressedResultReadState *readState = CompressedResultReader;
+
+	if (readState == NULL)
+	{
+		return;
+	}
+
+	FileClose(readState->fileCompat.fd);
+
+	pfree(readState->chunk->data);
+	pfree(readState->chunk);
+	pfree(readState);
+
+	CompressedResultReader = NULL;
+}
+
+
+/*
+ * ReadNextCompressedChunk reads and decompresses the next chunk of the file
+ * into the chunk buffer of the read state. It returns false when the end of
+ * the file is reached.
+ */
+static bool
+ReadNextCompressedChunk(CompressedResultReadState *readState)
+{
+	char header[COMPRESSED_RESULT_CHUNK_HEADER_SIZE];
+	uint32 rawLength = 0;
+	uint32 compressedLength = 0;
+
+	int bytesRead = FileReadCompat(&readState->fileCompat, header,
+								   COMPRESSED_RESULT_CHUNK_HEADER_SIZE, PG_WAIT_IO);
+	if (bytesRead == 0)
+	{
+		return false;
+	}
+	else if (bytesRead < 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not read intermediate result file: %m")));
+	}
+	else if (bytesRead < COMPRESSED_RESULT_CHUNK_HEADER_SIZE)
+	{
+		ReadExactly(&readState->fileCompat, header + bytesRead,
+					COMPRESSED_RESULT_CHUNK_HEADER_SIZE - bytesRead);
+	}
+
+	int compressionType = (unsigned char) header[0];
+	memcpy(&rawLength, header + 1, sizeof(uint32));
+	memcpy(&compressedLength, header + 5, sizeof(uint32));
+	rawLength = pg_ntoh32(rawLength);
+	compressedLength = pg_ntoh32(compressedLength);
+
+	if (rawLength >= MaxAllocSize || compressedLength >= MaxAllocSize)
+	{
+		ereport(ERROR, (errmsg("intermediate result file is corrupt"),
+						errdetail("Chunk of %u bytes exceeds the maximum size.",
+								  Max(rawLength, compressedLength))));
+	}
+
+	StringInfo chunk = readState->chunk;
+	resetStringInfo(chunk);
+	readState->chunkOffset = 0;
+
+	if (compressionType == INTERMEDIATE_RESULT_COMPRESSION_NONE)
+	{
+		enlargeStringInfo(chunk, rawLength);
+		ReadExactly(&readState->fileCompat, chunk->data, rawLength);
+		chunk->len = rawLength;
+		chunk->data[chunk->len] = '\0';
+
+		return true;
+	}
+
+	char *compressedData = palloc(compressedLength);
+	ReadExactly(&readState->fileCompat, compressedData, compressedLength);
+
+	DecompressChunk(compressedData, compressedLength, compressionType, chunk,
+					rawLength);
+
+	pfree(compressedData);
+
+	return true;
+}
+
+
+/*
+ * DecompressChunk decompresses compressedLength bytes into the chunk buffer
+ * and errors out if the result is not exactly rawLength bytes.
+ */
+static void
+DecompressChunk(const char *compressedData, int compressedLength,
+				int compressionType, StringInfo chunk, int rawLength)
+{
+	enlargeStringInfo(chunk, rawLength);
+
+	switch (compressionType)
+	{
+#if HAVE_CITUS_LIBLZ4
+		case INTERMEDIATE_RESULT_COMPRESSION_LZ4:
+		{
+			int decompressedSize = LZ4_decompress_safe(compressedData, chunk->data,
+													   compressedLength, rawLength);
+			if (decompressedSize != rawLength)
+			{
+				ereport(ERROR, (errmsg("cannot decompress intermediate result"),
+								errdetail("Expected %d bytes, but received %d bytes",
+										  rawLength, decompressedSize)));
+			}
+
+			break;
+		}
+#endif
+
+#if HAVE_LIBZSTD
+		case INTERMEDIATE_RESULT_COMPRESSION_ZSTD:
+		{
+			size_t decompressedSize = ZSTD_decompress(chunk->data, rawLength,
+													  compressedData,
+													  compressedLength);
+			if (ZSTD_isError(decompressedSize))
+			{
+				ereport(ERROR, (errmsg("cannot decompress intermediate result"),
+								errdetail("%s", ZSTD_getErrorName(decompressedSize))));
+			}
+
+			if (decompressedSize != rawLength)
+			{
+				ereport(ERROR, (errmsg("cannot decompress intermediate result"),
+								errdetail("Expected %d bytes, but received %zu bytes",
+										  rawLength, decompressedSize)));
+			}
+
+			break;
+		}
+#endif
+
+		default:
+		{
+			ereport(ERROR, (errmsg("cannot decompress intermediate result"),
+							errdetail("Compression method %d is not supported by "
+									  "this build of Citus.", compressionType)));
+		}
+	}
+
+	chunk->len = rawLength;
+	chunk->data[chunk->len] = '\0';
+}
+
+
+/*
+ * ReadExactly reads length bytes from the file and errors out if the file
+ * ends before that.
+ */
+static void
+ReadExactly(FileCompat *fileCompat, char *buffer, int length)
+{
+	int totalBytesRead = 0;
+
+	while (totalBytesRead < length)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		int bytesRead = FileReadCompat(fileCompat, buffer + totalBytesRead,
+									   length - totalBytesRead, PG_WAIT_IO);
+		if (bytesRead < 0)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not read intermediate result file: %m")));
+		}
+		else if (bytesRead == 0)
+		{
+			ereport(ERROR, (errmsg("intermediate result file is truncated")));
+		}
+
+		totalBytesRead += bytesRead;
+	}
+}
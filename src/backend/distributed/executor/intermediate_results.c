@@ -33,6 +33,7 @@
 #include "distributed/commands/multi_copy.h"
 #include "distributed/connection_management.h"
 #include "distributed/error_codes.h"
+#include "distributed/intermediate_result_compression.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/listutils.h"
 #include "distributed/metadata_cache.h"
@@ -80,6 +81,10 @@ typedef struct RemoteFileDestReceiver
 	CopyOutState copyOutState;
 	FmgrInfo *columnOutputFunctions;
 
+	/* compression method and COPY data that is not yet compressed */
+	int compressionType;
+	StringInfo compressionBuffer;
+
 	/* statistics */
 	uint64 tuplesSent;
 	uint64 bytesSent;
@@ -100,6 +105,9 @@ static void RemoteFileDestReceiverStartup(DestReceiver *dest, int operation,
 static void PrepareIntermediateResultBroadcast(RemoteFileDestReceiver *resultDest);
 static StringInfo ConstructCopyResultStatement(const char *resultId);
 static bool RemoteFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest);
+static void BufferCompressedResultData(RemoteFileDestReceiver *resultDest,
+									   StringInfo copyData);
+static void FlushCompressedResultData(RemoteFileDestReceiver *resultDest);
 static void BroadcastCopyData(StringInfo dataBuffer, List *connectionList);
 static void SendCopyDataOverConnection(StringInfo dataBuffer,
 									   MultiConnection *connection);
@@ -248,6 +256,19 @@ RemoteFileDestReceiverBytesSent(DestReceiver *destReceiver)
 }
 
 
+/*
+ * RemoteFileDestReceiverUsesBinaryFormat returns whether the intermediate
+ * result is encoded in the binary copy format.
+ */
+bool
+RemoteFileDestReceiverUsesBinaryFormat(DestReceiver *destReceiver)
+{
+	RemoteFileDestReceiver *remoteDestReceiver = (RemoteFileDestReceiver *) destReceiver;
+	return remoteDestReceiver->copyOutState != NULL &&
+		   remoteDestReceiver->copyOutState->binary;
+}
+
+
 /*
  * RemoteFileDestReceiverStartup implements the rStartup interface of
  * RemoteFileDestReceiver. It opens connections to the nodes in initialNodeList,
@@ -276,6 +297,12 @@ RemoteFileDestReceiverStartup(DestReceiver *dest, int operation,
 
 	resultDest->columnOutputFunctions = ColumnOutputFunctions(inputTupleDescriptor,
 															  copyOutState->binary);
+
+	resultDest->compressionType = IntermediateResultCompression;
+	if (resultDest->compressionType != INTERMEDIATE_RESULT_COMPRESSION_NONE)
+	{
+		resultDest->compressionBuffer = makeStringInfo();
+	}
 }
 
 
@@ -350,11 +377,13 @@ PrepareIntermediateResultBroadcast(RemoteFileDestReceiver *resultDest)
 		PQclear(result);
 	}
 
-	if (copyOutState->binary)
+	resultDest->connectionList = connectionList;
+
+	if (resultDest->compressionBuffer != NULL)
 	{
-		/* send headers when using binary encoding */
+		/* mark the file as compressed, the COPY data follows in chunks */
 		resetStringInfo(copyOutState->fe_msgbuf);
-		AppendCopyBinaryHeaders(copyOutState);
+		AppendCompressedResultSignature(copyOutState->fe_msgbuf);
 		BroadcastCopyData(copyOutState->fe_msgbuf, connectionList);
 
 		if (resultDest->writeLocalFile)
@@ -363,7 +392,26 @@ PrepareIntermediateResultBroadcast(RemoteFileDestReceiver *resultDest)
 		}
 	}
 
-	resultDest->connectionList = connectionList;
+	if (copyOutState->binary)
+	{
+		/* send headers when using binary encoding */
+		resetStringInfo(copyOutState->fe_msgbuf);
+		AppendCopyBinaryHeaders(copyOutState);
+
+		if (resultDest->compressionBuffer != NULL)
+		{
+			BufferCompressedResultData(resultDest, copyOutState->fe_msgbuf);
+		}
+		else
+		{
+			BroadcastCopyData(copyOutState->fe_msgbuf, connectionList);
+
+			if (resultDest->writeLocalFile)
+			{
+				WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
+			}
+		}
+	}
 }
 
 
@@ -425,19 +473,28 @@ RemoteFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 	AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
 					  copyOutState, columnOutputFunctions, NULL);
 
-	/* send row to nodes */
-	BroadcastCopyData(copyData, connectionList);
-
-	/* write to local file (if applicable) */
-	if (resultDest->writeLocalFile)
+	if (resultDest->compressionBuffer != NULL)
 	{
-		WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
+		/* rows are sent in compressed chunks */
+		BufferCompressedResultData(resultDest, copyData);
+	}
+	else
+	{
+		/* send row to nodes */
+		BroadcastCopyData(copyData, connectionList);
+
+		/* write to local file (if applicable) */
+		if (resultDest->writeLocalFile)
+		{
+			WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
+		}
+
+		resultDest->bytesSent += copyData->len;
 	}
 
 	MemoryContextSwitchTo(oldContext);
 
 	resultDest->tuplesSent++;
-	resultDest->bytesSent += copyData->len;
 
 	ResetPerTupleExprContext(executorState);
 
@@ -491,14 +548,28 @@ RemoteFileDestReceiverShutdown(DestReceiver *destReceiver)
 		/* send footers when using binary encoding */
 		resetStringInfo(copyOutState->fe_msgbuf);
 		AppendCopyBinaryFooters(copyOutState);
-		BroadcastCopyData(copyOutState->fe_msgbuf, connectionList);
 
-		if (resultDest->writeLocalFile)
+		if (resultDest->compressionBuffer != NULL)
 		{
-			WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
+			BufferCompressedResultData(resultDest, copyOutState->fe_msgbuf);
+		}
+		else
+		{
+			BroadcastCopyData(copyOutState->fe_msgbuf, connectionList);
+
+			if (resultDest->writeLocalFile)
+			{
+				WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
+			}
 		}
 	}
 
+	if (resultDest->compressionBuffer != NULL)
+	{
+		/* send the last chunk */
+		FlushCompressedResultData(resultDest);
+	}
+
 	/* close the COPY input */
 	EndRemoteCopy(0, connectionList);
 
@@ -509,6 +580,58 @@ RemoteFileDestReceiverShutdown(DestReceiver *destReceiver)
 }
 
 
+/*
+ * BufferCompressedResultData appends COPY data to the buffer of data that is
+ * yet to be compressed, and sends a compressed chunk once the buffer is full.
+ */
+static void
+BufferCompressedResultData(RemoteFileDestReceiver *resultDest, StringInfo copyData)
+{
+	StringInfo compressionBuffer = resultDest->compressionBuffer;
+
+	appendBinaryStringInfo(compressionBuffer, copyData->data, copyData->len);
+
+	if (compressionBuffer->len >= INTERMEDIATE_RESULT_COMPRESSION_CHUNK_SIZE)
+	{
+		FlushCompressedResultData(resultDest);
+	}
+}
+
+
+/*
+ * FlushCompressedResultData compresses the buffered COPY data into a chunk,
+ * and sends the chunk to all nodes and writes it to the local file (if
+ * applicable). The size of the compressed chunk counts towards bytesSent.
+ */
+static void
+FlushCompressedResultData(RemoteFileDestReceiver *resultDest)
+{
+	StringInfo compressionBuffer = resultDest->compressionBuffer;
+
+	if (compressionBuffer->len == 0)
+	{
+		return;
+	}
+
+	StringInfo chunk = makeStringInfo();
+	AppendCompressedResultChunk(chunk, compressionBuffer->data, compressionBuffer->len,
+								resultDest->compressionType);
+
+	BroadcastCopyData(chunk, resultDest->connectionList);
+
+	if (resultDest->writeLocalFile)
+	{
+		WriteToLocalFile(chunk, &resultDest->fileCompat);
+	}
+
+	resultDest->bytesSent += chunk->len;
+
+	resetStringInfo(compressionBuffer);
+	pfree(chunk->data);
+	pfree(chunk);
+}
+
+
 /*
  * BroadcastCopyData sends copy data to all connections in a list.
  */
@@ -556,6 +679,12 @@ RemoteFileDestReceiverDestroy(DestReceiver *destReceiver)
 		pfree(resultDest->columnOutputFunctions);
 	}
 
+	if (resultDest->compressionBuffer)
+	{
+		pfree(resultDest->compressionBuffer->data);
+		pfree(resultDest->compressionBuffer);
+	}
+
 	pfree(resultDest);
 }
 
@@ -43,6 +43,7 @@
 #include "distributed/function_call_delegation.h"
 #include "distributed/insert_select_executor.h"
 #include "distributed/insert_select_planner.h"
+#include "distributed/intermediate_result_compression.h"
 #include "distributed/listutils.h"
 #include "distributed/local_executor.h"
 #include "distributed/multi_executor.h"
@@ -468,28 +469,59 @@ ReadFileIntoTupleStore(char *fileName, char *copyFormat, TupleDesc tupleDescript
 									  location);
 	copyOptions = lappend(copyOptions, copyOption);
 
-	CopyFromState copyState = BeginCopyFrom(NULL, stubRelation, NULL,
-											fileName, false, NULL,
-											NULL, copyOptions);
+	/* compressed files are decompressed chunk by chunk while parsing */
+	bool compressedFile = BeginCompressedResultRead(fileName);
+	const char *copyFileName = compressedFile ? NULL : fileName;
+	copy_data_source_cb dataSourceCallback =
+		compressedFile ? ReadCompressedResultData : NULL;
 
-	while (true)
+	/*
+	 * The file that BeginCompressedResultRead opened is not tracked by the
+	 * resource owner, so make sure it is closed when reading errors out.
+	 */
+	PG_TRY();
 	{
-		ResetPerTupleExprContext(executorState);
-		MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+		CopyFromState copyState = BeginCopyFrom(NULL, stubRelation, NULL,
+												copyFileName, false,
+												dataSourceCallback, NULL,
+												copyOptions);
 
-		bool nextRowFound = NextCopyFrom(copyState, executorExpressionContext,
-										 columnValues, columnNulls);
-		if (!nextRowFound)
+		while (true)
 		{
+			ResetPerTupleExprContext(executorState);
+			MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+
+			bool nextRowFound = NextCopyFrom(copyState, executorExpressionContext,
+											 columnValues, columnNulls);
+			if (!nextRowFound)
+			{
+				MemoryContextSwitchTo(oldContext);
+				break;
+			}
+
+			tuplestore_putvalues(tupstore, tupleDescriptor, columnValues,
+								 columnNulls);
 			MemoryContextSwitchTo(oldContext);
-			break;
 		}
 
-		tuplestore_putvalues(tupstore, tupleDescriptor, columnValues, columnNulls);
-		MemoryContextSwitchTo(oldContext);
+		EndCopyFrom(copyState);
+	}
+	PG_CATCH();
+	{
+		if (compressedFile)
+		{
+			EndCompressedResultRead();
+		}
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	if (compressedFile)
+	{
+		EndCompressedResultRead();
 	}
 
-	EndCopyFrom(copyState);
 	pfree(columnValues);
 	pfree(columnNulls);
 }
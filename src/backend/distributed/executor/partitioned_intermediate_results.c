@@ -225,6 +225,9 @@ worker_partition_query_result(PG_FUNCTION_ARGS)
 		dests[partitionIndex] = partitionDest;
 	}
 
+	/* bound the memory for buffering and compressing the partitions together */
+	ShareFileDestReceiverBuffers(dests, partitionCount);
+
 	/*
 	 * If we are asked to generated empty results, use non-lazy startup.
 	 *
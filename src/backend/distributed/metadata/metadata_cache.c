@@ -80,8 +80,10 @@
 #include "distributed/pg_dist_placement.h"
 #include "distributed/pg_dist_shard.h"
 #include "distributed/remote_commands.h"
+#include "distributed/remote_prepared_statements.h"
 #include "distributed/shardinterval_utils.h"
 #include "distributed/shared_library_init.h"
+#include "distributed/shared_metadata_cache.h"
 #include "distributed/utils/array_type.h"
 #include "distributed/utils/function.h"
 #include "distributed/version_compat.h"
@@ -279,6 +281,10 @@ static HeapTuple PgDistPartitionTupleViaCatalog(Oid relationId);
 static ShardIdCacheEntry * LookupShardIdCacheEntry(int64 shardId, bool missingOk);
 static CitusTableCacheEntry * BuildCitusTableCacheEntry(Oid relationId);
 static void BuildCachedShardList(CitusTableCacheEntry *cacheEntry);
+static ShardInterval * SharedShardIntervalToShardInterval(
+	SharedShardInterval *sharedShardInterval, Oid relationId, Oid intervalTypeId);
+static GroupShardPlacement * SharedShardPlacementsToPlacementArray(
+	SharedShardPlacement *sharedPlacements, int placementCount, uint64 shardId);
 static void PrepareWorkerNodeCache(void);
 static bool CheckInstalledVersion(int elevel);
 static char * AvailableExtensionVersion(void);
@@ -1930,9 +1936,71 @@ BuildCachedShardList(CitusTableCacheEntry *cacheEntry)
 							  &intervalTypeId,
 							  &intervalTypeMod);
 
-	List *distShardTupleList = LookupDistShardTuples(cacheEntry->relationId);
-	int shardIntervalArrayLength = list_length(distShardTupleList);
-	if (shardIntervalArrayLength > 0)
+	SharedShardList *sharedShardList = NULL;
+	uint64 sharedShardListGeneration = 0;
+
+	/*
+	 * A transaction that wrote to the catalogs (e.g. a shard move or split)
+	 * would publish its uncommitted shards and placements, which other
+	 * backends could then use until it commits or aborts, and it would miss
+	 * its own changes in a shard list published by others. The generation
+	 * does not protect against either, since the transaction already bumped
+	 * it at the command counter increment. Hence, bypass the shared cache
+	 * once the transaction has an xid.
+	 */
+	bool useSharedMetadataCache = EnableSharedMetadataCache &&
+								  !TransactionIdIsValid(GetTopTransactionIdIfAny()) &&
+								  ((cacheEntry->partitionMethod == DISTRIBUTE_BY_HASH &&
+									intervalTypeId == INT4OID) ||
+								   cacheEntry->partitionMethod == DISTRIBUTE_BY_NONE);
+
+	if (useSharedMetadataCache)
+	{
+		sharedShardList = LookupSharedShardList(cacheEntry->relationId);
+		if (sharedShardList == NULL)
+		{
+			sharedShardListGeneration =
+				SharedShardListGeneration(cacheEntry->relationId);
+		}
+	}
+
+	List *distShardTupleList = NIL;
+	int shardIntervalArrayLength = 0;
+
+	if (sharedShardList != NULL)
+	{
+		shardIntervalArrayLength = sharedShardList->shardCount;
+	}
+	else
+	{
+		distShardTupleList = LookupDistShardTuples(cacheEntry->relationId);
+		shardIntervalArrayLength = list_length(distShardTupleList);
+	}
+
+	if (sharedShardList != NULL && shardIntervalArrayLength > 0)
+	{
+		shardIntervalArray = MemoryContextAllocZero(MetadataCacheMemoryContext,
+													shardIntervalArrayLength *
+													sizeof(ShardInterval *));
+
+		cacheEntry->arrayOfPlacementArrays =
+			MemoryContextAllocZero(MetadataCacheMemoryContext,
+								   shardIntervalArrayLength *
+								   sizeof(GroupShardPlacement *));
+		cacheEntry->arrayOfPlacementArrayLengths =
+			MemoryContextAllocZero(MetadataCacheMemoryContext,
+								   shardIntervalArrayLength *
+								   sizeof(int));
+
+		for (int shardIndex = 0; shardIndex < shardIntervalArrayLength; shardIndex++)
+		{
+			shardIntervalArray[shardIndex] =
+				SharedShardIntervalToShardInterval(
+					&sharedShardList->shardIntervals[shardIndex],
+					cacheEntry->relationId, intervalTypeId);
+		}
+	}
+	else if (shardIntervalArrayLength > 0)
 	{
 		Relation distShardRelation = table_open(DistShardRelationId(), AccessShareLock);
 		TupleDesc distShardTupleDesc = RelationGetDescr(distShardRelation);
@@ -2024,6 +2092,21 @@ BuildCachedShardList(CitusTableCacheEntry *cacheEntry)
 		/* since there is a zero or one shard, it is already sorted */
 		sortedShardIntervalArray = shardIntervalArray;
 	}
+	else if (sharedShardList != NULL)
+	{
+		/* shard lists are published in sorted order */
+		sortedShardIntervalArray = shardIntervalArray;
+
+		cacheEntry->hasUninitializedShardInterval =
+			HasUninitializedShardInterval(sortedShardIntervalArray,
+										  shardIntervalArrayLength);
+		cacheEntry->hasOverlappingShardInterval =
+			cacheEntry->hasUninitializedShardInterval ||
+			HasOverlappingShardInterval(sortedShardIntervalArray,
+										shardIntervalArrayLength,
+										cacheEntry->partitionColumn->varcollid,
+										shardIntervalCompareFunction);
+	}
 	else
 	{
 		/* sort the interval array */
@@ -2081,21 +2164,37 @@ BuildCachedShardList(CitusTableCacheEntry *cacheEntry)
 		 */
 		cacheEntry->shardIntervalArrayLength++;
 
-		/* build list of shard placements */
-		List *placementList = BuildShardPlacementList(shardId);
-		int numberOfPlacements = list_length(placementList);
+		GroupShardPlacement *placementArray = NULL;
+		int numberOfPlacements = 0;
 
-		/* and copy that list into the cache entry */
-		MemoryContext oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
-		GroupShardPlacement *placementArray = palloc0(numberOfPlacements *
-													  sizeof(GroupShardPlacement));
-		GroupShardPlacement *srcPlacement = NULL;
-		foreach_declared_ptr(srcPlacement, placementList)
+		if (sharedShardList != NULL)
 		{
-			placementArray[placementOffset] = *srcPlacement;
-			placementOffset++;
+			SharedShardInterval *sharedShardInterval =
+				&sharedShardList->shardIntervals[shardIndex];
+
+			numberOfPlacements = sharedShardInterval->placementCount;
+			placementArray = SharedShardPlacementsToPlacementArray(
+				&sharedShardList->placements[sharedShardInterval->placementOffset],
+				numberOfPlacements, shardId);
+		}
+		else
+		{
+			/* build list of shard placements */
+			List *placementList = BuildShardPlacementList(shardId);
+			numberOfPlacements = list_length(placementList);
+
+			/* and copy that list into the cache entry */
+			MemoryContext oldContext =
+				MemoryContextSwitchTo(MetadataCacheMemoryContext);
+			placementArray = palloc0(numberOfPlacements * sizeof(GroupShardPlacement));
+			GroupShardPlacement *srcPlacement = NULL;
+			foreach_declared_ptr(srcPlacement, placementList)
+			{
+				placementArray[placementOffset] = *srcPlacement;
+				placementOffset++;
+			}
+			MemoryContextSwitchTo(oldContext);
 		}
-		MemoryContextSwitchTo(oldContext);
 
 		cacheEntry->arrayOfPlacementArrays[shardIndex] = placementArray;
 		cacheEntry->arrayOfPlacementArrayLengths[shardIndex] = numberOfPlacements;
@@ -2106,6 +2205,82 @@ BuildCachedShardList(CitusTableCacheEntry *cacheEntry)
 
 	cacheEntry->shardColumnCompareFunction = shardColumnCompareFunction;
 	cacheEntry->shardIntervalCompareFunction = shardIntervalCompareFunction;
+
+	if (useSharedMetadataCache && sharedShardList == NULL)
+	{
+		PublishSharedShardList(cacheEntry->relationId, sharedShardListGeneration,
+							   sortedShardIntervalArray,
+							   cacheEntry->shardIntervalArrayLength,
+							   cacheEntry->arrayOfPlacementArrays,
+							   cacheEntry->arrayOfPlacementArrayLengths);
+	}
+}
+
+
+/*
+ * SharedShardIntervalToShardInterval builds a ShardInterval in the metadata
+ * cache context from a shard that was found in the shared metadata cache.
+ * Only int4 shard intervals are shared, hence the values are stored inline.
+ */
+static ShardInterval *
+SharedShardIntervalToShardInterval(SharedShardInterval *sharedShardInterval,
+								   Oid relationId, Oid intervalTypeId)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
+
+	ShardInterval *shardInterval = CitusMakeNode(ShardInterval);
+	shardInterval->relationId = relationId;
+	shardInterval->storageType = sharedShardInterval->storageType;
+	shardInterval->valueTypeId = intervalTypeId;
+	shardInterval->shardId = sharedShardInterval->shardId;
+
+	if (sharedShardInterval->hasValues)
+	{
+		shardInterval->valueTypeLen = sizeof(int32);
+		shardInterval->valueByVal = true;
+		shardInterval->minValueExists = true;
+		shardInterval->maxValueExists = true;
+		shardInterval->minValue = Int32GetDatum(sharedShardInterval->minValue);
+		shardInterval->maxValue = Int32GetDatum(sharedShardInterval->maxValue);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	return shardInterval;
+}
+
+
+/*
+ * SharedShardPlacementsToPlacementArray builds a placement array in the
+ * metadata cache context from the placements of a shard that were found in
+ * the shared metadata cache.
+ */
+static GroupShardPlacement *
+SharedShardPlacementsToPlacementArray(SharedShardPlacement *sharedPlacements,
+									  int placementCount, uint64 shardId)
+{
+	GroupShardPlacement *placementArray =
+		MemoryContextAllocZero(MetadataCacheMemoryContext,
+							   placementCount * sizeof(GroupShardPlacement));
+
+	/* node header that is copied into every placement */
+	GroupShardPlacement *placementTemplate = CitusMakeNode(GroupShardPlacement);
+
+	for (int placementIndex = 0; placementIndex < placementCount; placementIndex++)
+	{
+		GroupShardPlacement *placement = &placementArray[placementIndex];
+		SharedShardPlacement *sharedPlacement = &sharedPlacements[placementIndex];
+
+		*placement = *placementTemplate;
+		placement->placementId = sharedPlacement->placementId;
+		placement->shardId = shardId;
+		placement->shardLength = sharedPlacement->shardLength;
+		placement->groupId = sharedPlacement->groupId;
+	}
+
+	pfree(placementTemplate);
+
+	return placementArray;
 }
 
 
@@ -4889,12 +5064,16 @@ InvalidateForeignKeyGraph(void)
 void
 InvalidateDistRelationCacheCallback(Datum argument, Oid relationId)
 {
+	/* other backends may not have the relation in their local cache */
+	InvalidateSharedShardList(relationId);
+
 	/* invalidate either entire cache or a specific entry */
 	if (relationId == InvalidOid)
 	{
 		InvalidateDistTableCache();
 		InvalidateDistObjectCache();
 		InvalidateMetadataSystemCache();
+		InvalidateWorkerPreparedStatements();
 	}
 	else
 	{
@@ -4911,6 +5090,9 @@ InvalidateDistRelationCacheCallback(Datum argument, Oid relationId)
 		if (foundInCache)
 		{
 			InvalidateCitusTableCacheEntrySlot(cacheSlot);
+
+			/* shard queries prepared on workers may refer to stale definitions */
+			InvalidateWorkerPreparedStatements();
 		}
 
 		/*
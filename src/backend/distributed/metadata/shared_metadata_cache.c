@@ -0,0 +1,578 @@
+/*-------------------------------------------------------------------------
+ *
+ * shared_metadata_cache.c
+ *   Cache of shard and placement metadata that is shared between backends.
+ *
+ * Every backend builds its own CitusTableCacheEntry for the distributed
+ * tables it uses, which requires scanning pg_dist_shard and pg_dist_placement
+ * and sorting the shard intervals. For tables with many shards, and with many
+ * short-lived backends, that work is repeated over and over again. When
+ * citus.enable_shared_metadata_cache is enabled, the first backend that
+ * builds the shard list of a hash distributed table (or a table without a
+ * distribution key) publishes it in a dynamic shared memory area, such that
+ * other backends can build their cache entry without accessing the catalogs.
+ *
+ * Entries are validated using generation numbers in the main shared memory
+ * segment. Each relation maps to one of a fixed number of buckets, and every
+ * relcache invalidation of a relation bumps the generation of its bucket.
+ * An entry is only used if it was built in the current generation of its
+ * bucket. Since a backend always processes pending invalidations (and
+ * thereby bumps the generation) before it rebuilds its local cache entry,
+ * it never uses an entry that was built before a change it has seen.
+ * Transactions that have an xid neither use nor publish entries, since they
+ * might have changed the catalogs themselves and already bumped the
+ * generation before their changes are visible to others.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+
+#include "common/hashfn.h"
+#include "lib/dshash.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/dsa.h"
+#include "utils/inval.h"
+#include "utils/memutils.h"
+
+#include "pg_version_constants.h"
+
+#include "distributed/shared_metadata_cache.h"
+
+
+/* number of generation buckets that relations are mapped to */
+#define SHARED_METADATA_CACHE_BUCKETS 1024
+
+
+/*
+ * SharedMetadataCacheData is stored in the main shared memory segment and
+ * allows backends to find the dynamic shared memory area of the cache.
+ */
+typedef struct SharedMetadataCacheData
+{
+	int trancheId;
+	char *lockTrancheName;
+
+	/* protects the creation of the area and the hash */
+	LWLock lock;
+
+	dsa_handle areaHandle;
+	dshash_table_handle hashHandle;
+
+	/* generations of the relations that map to each bucket */
+	pg_atomic_uint64 bucketGenerations[SHARED_METADATA_CACHE_BUCKETS];
+} SharedMetadataCacheData;
+
+
+/* relation OIDs are only unique within a database */
+typedef struct SharedShardListKey
+{
+	Oid databaseId;
+	Oid relationId;
+} SharedShardListKey;
+
+
+/*
+ * SharedShardListEntry points to the shard intervals of a relation, followed
+ * by the placements of all shards.
+ */
+typedef struct SharedShardListEntry
+{
+	SharedShardListKey key;
+
+	/* generation of the bucket at the time the shard list was built */
+	uint64 generation;
+
+	int shardCount;
+	int placementCount;
+	dsa_pointer shardList;
+} SharedShardListEntry;
+
+
+/* GUC, determining whether shard metadata is shared between backends */
+bool EnableSharedMetadataCache = false;
+
+/* GUC, maximum size of the shared metadata cache in kilobytes */
+int SharedMetadataCacheSize = 65536;
+
+static SharedMetadataCacheData *SharedMetadataCacheState = NULL;
+static dsa_area *SharedMetadataCacheArea = NULL;
+static dshash_table *SharedShardListHash = NULL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+
+static void SharedMetadataCacheShmemInit(void);
+static bool AttachSharedMetadataCache(void);
+static dshash_parameters SharedShardListHashParameters(void);
+static void InitSharedShardListKey(SharedShardListKey *key, Oid relationId);
+static pg_atomic_uint64 * SharedShardListBucket(Oid databaseId, Oid relationId);
+static bool SharedShardListEntryIsValid(SharedShardListEntry *entry);
+static dsa_pointer AllocateSharedShardList(Size size);
+static void RemoveInvalidSharedShardLists(void);
+
+
+/*
+ * InitializeSharedMetadataCache sets up the shared memory startup hook of
+ * the shared metadata cache.
+ */
+void
+InitializeSharedMetadataCache(void)
+{
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = SharedMetadataCacheShmemInit;
+}
+
+
+/*
+ * SharedMetadataCacheShmemSize returns the size of the part of the shared
+ * metadata cache that lives in the main shared memory segment. The cache
+ * entries themselves are allocated in dynamic shared memory.
+ */
+size_t
+SharedMetadataCacheShmemSize(void)
+{
+	return sizeof(SharedMetadataCacheData);
+}
+
+
+/*
+ * SharedMetadataCacheShmemInit initializes the shared memory that is used to
+ * find and validate the shared metadata cache.
+ */
+static void
+SharedMetadataCacheShmemInit(void)
+{
+	bool alreadyInitialized = false;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	SharedMetadataCacheState =
+		(SharedMetadataCacheData *) ShmemInitStruct("Shared Metadata Cache Data",
+													sizeof(SharedMetadataCacheData),
+													&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		SharedMetadataCacheState->trancheId = LWLockNewTrancheId();
+		SharedMetadataCacheState->lockTrancheName = "Shared Metadata Cache Tranche";
+		LWLockRegisterTranche(SharedMetadataCacheState->trancheId,
+							  SharedMetadataCacheState->lockTrancheName);
+
+		LWLockInitialize(&SharedMetadataCacheState->lock,
+						 SharedMetadataCacheState->trancheId);
+
+		SharedMetadataCacheState->areaHandle = DSA_HANDLE_INVALID;
+		SharedMetadataCacheState->hashHandle = DSHASH_HANDLE_INVALID;
+
+		for (int bucketIndex = 0; bucketIndex < SHARED_METADATA_CACHE_BUCKETS;
+			 bucketIndex++)
+		{
+			pg_atomic_init_u64(&SharedMetadataCacheState->bucketGenerations[bucketIndex],
+							   0);
+		}
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * LookupSharedShardList returns a copy of the shard list of the given relation
+ * if it is in the shared metadata cache and still valid, or NULL otherwise.
+ */
+SharedShardList *
+LookupSharedShardList(Oid relationId)
+{
+	SharedShardListKey key;
+
+	if (!AttachSharedMetadataCache())
+	{
+		return NULL;
+	}
+
+	InitSharedShardListKey(&key, relationId);
+
+	SharedShardListEntry *entry = dshash_find(SharedShardListHash, &key, false);
+	if (entry == NULL)
+	{
+		return NULL;
+	}
+
+	if (!SharedShardListEntryIsValid(entry))
+	{
+		dshash_release_lock(SharedShardListHash, entry);
+		return NULL;
+	}
+
+	Size shardIntervalsSize = entry->shardCount * sizeof(SharedShardInterval);
+	Size placementsSize = entry->placementCount * sizeof(SharedShardPlacement);
+	char *sharedData = dsa_get_address(SharedMetadataCacheArea, entry->shardList);
+
+	SharedShardList *shardList = palloc0(sizeof(SharedShardList));
+	shardList->shardCount = entry->shardCount;
+	shardList->shardIntervals = palloc(shardIntervalsSize);
+	shardList->placements = palloc(placementsSize);
+
+	memcpy(shardList->shardIntervals, sharedData, shardIntervalsSize);
+	memcpy(shardList->placements, sharedData + shardIntervalsSize, placementsSize);
+
+	dshash_release_lock(SharedShardListHash, entry);
+
+	return shardList;
+}
+
+
+/*
+ * SharedShardListGeneration returns the generation that a shard list of the
+ * given relation needs to be published with. It first processes pending
+ * invalidations, such that the catalog snapshot that is used to build the
+ * shard list afterwards includes all changes that happened before the
+ * generation was last bumped.
+ */
+uint64
+SharedShardListGeneration(Oid relationId)
+{
+	if (SharedMetadataCacheState == NULL)
+	{
+		return 0;
+	}
+
+	AcceptInvalidationMessages();
+
+	return pg_atomic_read_u64(SharedShardListBucket(MyDatabaseId, relationId));
+}
+
+
+/*
+ * PublishSharedShardList stores the shards and placements of a relation in
+ * the shared metadata cache, unless the relation was invalidated after the
+ * generation was obtained via SharedShardListGeneration. If the cache is
+ * full, the shard list is silently not published.
+ */
+void
+PublishSharedShardList(Oid relationId, uint64 generation,
+					   ShardInterval **sortedShardIntervalArray, int shardCount,
+					   GroupShardPlacement **arrayOfPlacementArrays,
+					   int *arrayOfPlacementArrayLengths)
+{
+	SharedShardListKey key;
+	int placementCount = 0;
+	bool found = false;
+
+	if (!AttachSharedMetadataCache() ||
+		pg_atomic_read_u64(SharedShardListBucket(MyDatabaseId, relationId)) != generation)
+	{
+		return;
+	}
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		placementCount += arrayOfPlacementArrayLengths[shardIndex];
+	}
+
+	Size shardIntervalsSize = shardCount * sizeof(SharedShardInterval);
+	Size placementsSize = placementCount * sizeof(SharedShardPlacement);
+
+	dsa_pointer shardListPointer =
+		AllocateSharedShardList(shardIntervalsSize + placementsSize);
+	if (!DsaPointerIsValid(shardListPointer))
+	{
+		return;
+	}
+
+	char *sharedData = dsa_get_address(SharedMetadataCacheArea, shardListPointer);
+	SharedShardInterval *sharedShardIntervals = (SharedShardInterval *) sharedData;
+	SharedShardPlacement *sharedPlacements =
+		(SharedShardPlacement *) (sharedData + shardIntervalsSize);
+	int placementOffset = 0;
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		ShardInterval *shardInterval = sortedShardIntervalArray[shardIndex];
+		SharedShardInterval *sharedShardInterval = &sharedShardIntervals[shardIndex];
+		GroupShardPlacement *placementArray = arrayOfPlacementArrays[shardIndex];
+		int shardPlacementCount = arrayOfPlacementArrayLengths[shardIndex];
+
+		memset(sharedShardInterval, 0, sizeof(SharedShardInterval));
+		sharedShardInterval->shardId = shardInterval->shardId;
+		sharedShardInterval->storageType = shardInterval->storageType;
+		sharedShardInterval->hasValues = shardInterval->minValueExists &&
+										 shardInterval->maxValueExists;
+
+		if (sharedShardInterval->hasValues)
+		{
+			sharedShardInterval->minValue = DatumGetInt32(shardInterval->minValue);
+			sharedShardInterval->maxValue = DatumGetInt32(shardInterval->maxValue);
+		}
+
+		sharedShardInterval->placementOffset = placementOffset;
+		sharedShardInterval->placementCount = shardPlacementCount;
+
+		for (int placementIndex = 0; placementIndex < shardPlacementCount;
+			 placementIndex++)
+		{
+			GroupShardPlacement *placement = &placementArray[placementIndex];
+			SharedShardPlacement *sharedPlacement = &sharedPlacements[placementOffset];
+
+			memset(sharedPlacement, 0, sizeof(SharedShardPlacement));
+			sharedPlacement->placementId = placement->placementId;
+			sharedPlacement->shardLength = placement->shardLength;
+			sharedPlacement->groupId = placement->groupId;
+
+			placementOffset++;
+		}
+	}
+
+	InitSharedShardListKey(&key, relationId);
+
+	dsa_pointer previousShardList = InvalidDsaPointer;
+	SharedShardListEntry *entry =
+		dshash_find_or_insert(SharedShardListHash, &key, &found);
+
+	if (found && SharedShardListEntryIsValid(entry))
+	{
+		/* another backend published a valid shard list in the meantime */
+		previousShardList = shardListPointer;
+	}
+	else
+	{
+		if (found)
+		{
+			previousShardList = entry->shardList;
+		}
+
+		entry->generation = generation;
+		entry->shardCount = shardCount;
+		entry->placementCount = placementCount;
+		entry->shardList = shardListPointer;
+	}
+
+	dshash_release_lock(SharedShardListHash, entry);
+
+	if (DsaPointerIsValid(previousShardList))
+	{
+		dsa_free(SharedMetadataCacheArea, previousShardList);
+	}
+}
+
+
+/*
+ * InvalidateSharedShardList invalidates the shared shard list of the given
+ * relation, or of all relations if relationId is InvalidOid. It is called
+ * for every relcache invalidation, hence it only touches the generation
+ * counters and never the cache entries themselves.
+ */
+void
+InvalidateSharedShardList(Oid relationId)
+{
+	/* nothing to invalidate until a backend created the cache */
+	if (SharedMetadataCacheState == NULL ||
+		SharedMetadataCacheState->areaHandle == DSA_HANDLE_INVALID)
+	{
+		return;
+	}
+
+	if (relationId == InvalidOid)
+	{
+		for (int bucketIndex = 0; bucketIndex < SHARED_METADATA_CACHE_BUCKETS;
+			 bucketIndex++)
+		{
+			pg_atomic_fetch_add_u64(
+				&SharedMetadataCacheState->bucketGenerations[bucketIndex], 1);
+		}
+	}
+	else
+	{
+		pg_atomic_fetch_add_u64(SharedShardListBucket(MyDatabaseId, relationId), 1);
+	}
+}
+
+
+/*
+ * AttachSharedMetadataCache attaches the backend to the dynamic shared memory
+ * area of the cache, creating it if no backend did so far. The mapping is
+ * kept until the backend exits. Returns false if the cache cannot be used.
+ */
+static bool
+AttachSharedMetadataCache(void)
+{
+	if (SharedShardListHash != NULL)
+	{
+		return true;
+	}
+
+	if (SharedMetadataCacheState == NULL)
+	{
+		return false;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+	LWLockRegisterTranche(SharedMetadataCacheState->trancheId,
+						  SharedMetadataCacheState->lockTrancheName);
+
+	LWLockAcquire(&SharedMetadataCacheState->lock, LW_EXCLUSIVE);
+
+	dshash_parameters hashParameters = SharedShardListHashParameters();
+
+	if (SharedMetadataCacheState->areaHandle == DSA_HANDLE_INVALID)
+	{
+		SharedMetadataCacheArea = dsa_create(SharedMetadataCacheState->trancheId);
+		dsa_pin(SharedMetadataCacheArea);
+		dsa_pin_mapping(SharedMetadataCacheArea);
+		dsa_set_size_limit(SharedMetadataCacheArea,
+						   (Size) SharedMetadataCacheSize * 1024);
+
+		SharedShardListHash = dshash_create(SharedMetadataCacheArea, &hashParameters,
+											NULL);
+
+		SharedMetadataCacheState->hashHandle =
+			dshash_get_hash_table_handle(SharedShardListHash);
+		SharedMetadataCacheState->areaHandle = dsa_get_handle(SharedMetadataCacheArea);
+	}
+	else
+	{
+		SharedMetadataCacheArea = dsa_attach(SharedMetadataCacheState->areaHandle);
+		dsa_pin_mapping(SharedMetadataCacheArea);
+
+		SharedShardListHash = dshash_attach(SharedMetadataCacheArea, &hashParameters,
+											SharedMetadataCacheState->hashHandle,
+											NULL);
+	}
+
+	LWLockRelease(&SharedMetadataCacheState->lock);
+
+	MemoryContextSwitchTo(oldContext);
+
+	return true;
+}
+
+
+/*
+ * SharedShardListHashParameters returns the parameters of the hash that maps
+ * relations to their shard lists.
+ */
+static dshash_parameters
+SharedShardListHashParameters(void)
+{
+	dshash_parameters hashParameters;
+
+	memset(&hashParameters, 0, sizeof(hashParameters));
+	hashParameters.key_size = sizeof(SharedShardListKey);
+	hashParameters.entry_size = sizeof(SharedShardListEntry);
+	hashParameters.compare_function = dshash_memcmp;
+	hashParameters.hash_function = dshash_memhash;
+#if PG_VERSION_NUM >= PG_VERSION_17
+	hashParameters.copy_function = dshash_memcpy;
+#endif
+	hashParameters.tranche_id = SharedMetadataCacheState->trancheId;
+
+	return hashParameters;
+}
+
+
+/*
+ * InitSharedShardListKey initializes the hash key of the given relation in
+ * the current database.
+ */
+static void
+InitSharedShardListKey(SharedShardListKey *key, Oid relationId)
+{
+	memset(key, 0, sizeof(SharedShardListKey));
+	key->databaseId = MyDatabaseId;
+	key->relationId = relationId;
+}
+
+
+/*
+ * SharedShardListBucket returns the generation counter of the bucket that the
+ * given relation maps to.
+ */
+static pg_atomic_uint64 *
+SharedShardListBucket(Oid databaseId, Oid relationId)
+{
+	uint32 hash = hash_combine(hash_uint32(databaseId), hash_uint32(relationId));
+
+	return &SharedMetadataCacheState->bucketGenerations[hash %
+														SHARED_METADATA_CACHE_BUCKETS];
+}
+
+
+/*
+ * SharedShardListEntryIsValid returns whether the entry was built in the
+ * current generation of its bucket. The caller should hold the lock on the
+ * entry.
+ */
+static bool
+SharedShardListEntryIsValid(SharedShardListEntry *entry)
+{
+	pg_atomic_uint64 *bucket = SharedShardListBucket(entry->key.databaseId,
+													 entry->key.relationId);
+
+	return entry->generation == pg_atomic_read_u64(bucket);
+}
+
+
+/*
+ * AllocateSharedShardList allocates memory for a shard list in the dynamic
+ * shared memory area. If the size limit of the area is reached, invalidated
+ * entries are removed and the allocation is retried once. Returns
+ * InvalidDsaPointer if there is still not enough space.
+ */
+static dsa_pointer
+AllocateSharedShardList(Size size)
+{
+	/* avoid zero-sized allocations for tables without shards */
+	size = Max(size, 1);
+
+	dsa_pointer shardList = dsa_allocate_extended(SharedMetadataCacheArea, size,
+												  DSA_ALLOC_NO_OOM);
+	if (!DsaPointerIsValid(shardList))
+	{
+		RemoveInvalidSharedShardLists();
+
+		shardList = dsa_allocate_extended(SharedMetadataCacheArea, size,
+										  DSA_ALLOC_NO_OOM);
+	}
+
+	return shardList;
+}
+
+
+/*
+ * RemoveInvalidSharedShardLists removes all entries that are no longer valid,
+ * for instance because the table was dropped or its shards changed, and frees
+ * their shard lists.
+ */
+static void
+RemoveInvalidSharedShardLists(void)
+{
+	dshash_seq_status status;
+	SharedShardListEntry *entry = NULL;
+
+	dshash_seq_init(&status, SharedShardListHash, true);
+
+	while ((entry = dshash_seq_next(&status)) != NULL)
+	{
+		if (!SharedShardListEntryIsValid(entry))
+		{
+			dsa_free(SharedMetadataCacheArea, entry->shardList);
+			dshash_delete_current(&status);
+		}
+	}
+
+	dshash_seq_term(&status);
+}
@@ -1213,7 +1213,7 @@ CitusCreateAlterColumnarTableSet(char *qualifiedRelationName,
 					 "columnar.chunk_group_row_limit = %d, "
 					 "columnar.stripe_row_limit = %lu, "
 					 "columnar.compression_level = %d, "
-					 "columnar.compression = %s);",
+					 "columnar.compression = %s",
 					 qualifiedRelationName,
 					 options->chunkRowCount,
 					 options->stripeRowCount,
@@ -1221,6 +1221,14 @@ CitusCreateAlterColumnarTableSet(char *qualifiedRelationName,
 					 quote_literal_cstr(extern_CompressionTypeStr(
 											options->compressionType)));
 
+	if (options->bloomFilterColumns != NULL)
+	{
+		appendStringInfo(&buf, ", columnar.bloom_filter_columns = %s",
+						 quote_literal_cstr(options->bloomFilterColumns));
+	}
+
+	appendStringInfoString(&buf, ");");
+
 	return buf.data;
 }
 
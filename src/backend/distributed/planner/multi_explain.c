@@ -594,6 +594,8 @@ ExplainSubPlans(DistributedPlan *distributedPlan, ExplainState *es)
 
 			ExplainPropertyBytes("Intermediate Data Size",
 								 subPlan->bytesSentPerWorker, es);
+			ExplainPropertyText("Intermediate Data Format",
+								subPlan->binaryFormat ? "binary" : "text", es);
 
 			StringInfo destination = makeStringInfo();
 			if (subPlan->remoteWorkerCount && subPlan->writeLocalFile)
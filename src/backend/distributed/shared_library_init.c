@@ -51,6 +51,7 @@
 #include "columnar/columnar.h"
 
 #include "distributed/adaptive_executor.h"
+#include "distributed/async_commit.h"
 #include "distributed/backend_data.h"
 #include "distributed/background_jobs.h"
 #include "distributed/causal_clock.h"
@@ -62,11 +63,13 @@
 #include "distributed/commands/multi_copy.h"
 #include "distributed/commands/utility_hook.h"
 #include "distributed/connection_management.h"
+#include "distributed/connection_warmup.h"
 #include "distributed/coordinator_protocol.h"
 #include "distributed/cte_inline.h"
 #include "distributed/distributed_deadlock_detection.h"
 #include "distributed/distributed_planner.h"
 #include "distributed/errormessage.h"
+#include "distributed/intermediate_result_compression.h"
 #include "distributed/intermediate_result_pruning.h"
 #include "distributed/local_distributed_join_planner.h"
 #include "distributed/local_executor.h"
@@ -93,6 +96,7 @@
 #include "distributed/reference_table_utils.h"
 #include "distributed/relation_access_tracking.h"
 #include "distributed/remote_commands.h"
+#include "distributed/remote_prepared_statements.h"
 #include "distributed/remote_transaction.h"
 #include "distributed/repartition_executor.h"
 #include "distributed/replication_origin_session_utils.h"
@@ -104,6 +108,7 @@
 #include "distributed/shardsplit_shared_memory.h"
 #include "distributed/shared_connection_stats.h"
 #include "distributed/shared_library_init.h"
+#include "distributed/shared_metadata_cache.h"
 #include "distributed/stats/query_stats.h"
 #include "distributed/stats/stat_counters.h"
 #include "distributed/stats/stat_tenants.h"
@@ -112,6 +117,7 @@
 #include "distributed/transaction_management.h"
 #include "distributed/transaction_recovery.h"
 #include "distributed/utils/directory.h"
+#include "distributed/worker_connection_pool.h"
 #include "distributed/worker_log_messages.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
@@ -128,6 +134,7 @@ ColumnarSupportsIndexAM_type extern_ColumnarSupportsIndexAM = NULL;
 CompressionTypeStr_type extern_CompressionTypeStr = NULL;
 IsColumnarTableAmTable_type extern_IsColumnarTableAmTable = NULL;
 ReadColumnarOptions_type extern_ReadColumnarOptions = NULL;
+TryCompactColumnarTables_type extern_TryCompactColumnarTables = NULL;
 
 /*
  * Define "pass-through" functions so that a SQL function defined as one of
@@ -321,6 +328,17 @@ static const struct config_enum_entry create_object_propagation_options[] = {
 	{NULL,        0,                                   false}
 };
 
+static const struct config_enum_entry intermediate_result_compression_options[] = {
+	{ "none", INTERMEDIATE_RESULT_COMPRESSION_NONE, false },
+#if HAVE_CITUS_LIBLZ4
+	{ "lz4", INTERMEDIATE_RESULT_COMPRESSION_LZ4, false },
+#endif
+#if HAVE_LIBZSTD
+	{ "zstd", INTERMEDIATE_RESULT_COMPRESSION_ZSTD, false },
+#endif
+	{ NULL, 0, false }
+};
+
 /*
  * This used to choose CPU priorities for GUCs. For most other integer options
  * we use the -1 value as inherit/default/unset. For CPU priorities this isn't
@@ -519,6 +537,12 @@ _PG_init(void)
 	InitRelationAccessHash();
 	InitializeCitusQueryStats();
 	InitializeSharedConnectionStats();
+	InitializeConnectionWarmup();
+	InitializeWorkerConnectionPool();
+	InitializeAsyncCommit();
+	InitializeWaitGraphSnapshots();
+	InitializeDeadlockDetectionStats();
+	InitializeSharedMetadataCache();
 	InitializeLocallyReservedSharedConnections();
 	InitializeClusterClockMem();
 
@@ -593,6 +617,7 @@ _PG_init(void)
 	INIT_COLUMNAR_SYMBOL(CompressionTypeStr_type, CompressionTypeStr);
 	INIT_COLUMNAR_SYMBOL(IsColumnarTableAmTable_type, IsColumnarTableAmTable);
 	INIT_COLUMNAR_SYMBOL(ReadColumnarOptions_type, ReadColumnarOptions);
+	INIT_COLUMNAR_SYMBOL(TryCompactColumnarTables_type, TryCompactColumnarTables);
 
 	/* initialize symbols for "pass-through" functions */
 	INIT_COLUMNAR_SYMBOL(PGFunction, columnar_handler);
@@ -646,6 +671,12 @@ citus_shmem_request(void)
 
 	RequestAddinShmemSpace(BackendManagementShmemSize());
 	RequestAddinShmemSpace(SharedConnectionStatsShmemSize());
+	RequestAddinShmemSpace(ConnectionWarmupShmemSize());
+	RequestAddinShmemSpace(WorkerConnectionPoolShmemSize());
+	RequestAddinShmemSpace(AsyncCommitShmemSize());
+	RequestAddinShmemSpace(WaitGraphSnapshotShmemSize());
+	RequestAddinShmemSpace(DeadlockDetectionStatsShmemSize());
+	RequestAddinShmemSpace(SharedMetadataCacheShmemSize());
 	RequestAddinShmemSpace(MaintenanceDaemonShmemSize());
 	RequestAddinShmemSpace(CitusQueryStatsSharedMemSize());
 	RequestAddinShmemSpace(LogicalClockShmemSize());
@@ -1058,6 +1089,24 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL | GUC_NOT_IN_SAMPLE,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.async_commit_prepared",
+		gettext_noop("Returns to the client before the prepared transactions of a "
+					 "two-phase commit are committed on the workers."),
+		gettext_noop("When enabled, COMMIT PREPARED is sent by a background "
+					 "worker once the local transaction committed, and retried "
+					 "until it or 2PC recovery succeeds. The session waits up "
+					 "to 30 seconds for its queued commits before it uses a "
+					 "worker connection again. The background worker is "
+					 "started when the setting is enabled for the database, and "
+					 "the setting has no effect while citus.recover_2pc_interval "
+					 "is disabled."),
+		&AsyncCommitPrepared,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.background_task_queue_interval",
 		gettext_noop("Time to wait between checks for scheduled background tasks."),
@@ -1089,6 +1138,38 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.columnar_compaction_interval",
+		gettext_noop("Sets the time to wait between compacting the stripes of "
+					 "columnar tables."),
+		gettext_noop("The maintenance daemon periodically merges the small "
+					 "stripes that many small transactions leave behind in "
+					 "columnar tables into full stripes. This setting "
+					 "determines how often compaction should run, "
+					 "use -1 to disable."),
+		&ColumnarCompactionInterval,
+		-1, -1, 7 * MS_PER_DAY,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.compact_transaction_records",
+		gettext_noop("Logs a single commit record per distributed transaction."),
+		gettext_noop("By default, a distributed transaction that uses 2PC writes "
+					 "a record to pg_dist_transaction for every node it prepares "
+					 "transactions on. When enabled, a single record decides "
+					 "the prepared transactions on all nodes, which reduces the "
+					 "write load on pg_dist_transaction. Such records are only "
+					 "written once 2PC recovery resolved all primary nodes after "
+					 "a restart, and only cleaned up once 2PC recovery checked "
+					 "all primary nodes."),
+		&CompactTransactionRecords,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.coordinator_aggregation_strategy",
 		gettext_noop("Sets the strategy for when an aggregate cannot be pushed down. "
@@ -1317,6 +1398,25 @@ RegisterCitusConfigVariables(void)
 		PGC_USERSET,
 		GUC_NO_SHOW_ALL | GUC_NOT_IN_SAMPLE,
 		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_copy_pass_through",
+		gettext_noop("Enables passing COPY columns through to the shards without "
+					 "parsing them on the coordinator"),
+		gettext_noop("When enabled, COPY into a distributed table in text or csv "
+					 "format only parses the distribution column on the coordinator "
+					 "and forwards the other columns to the shards as text, which "
+					 "increases COPY throughput for wide tables. Malformed values "
+					 "are then reported by the workers, without the line number of "
+					 "the input. The columns are only passed through when all "
+					 "columns of the table have types whose input does not depend "
+					 "on settings like DateStyle."),
+		&EnableCopyPassThrough,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_cost_based_connection_establishment",
 		gettext_noop("When enabled the connection establishment times "
@@ -1499,6 +1599,23 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL | GUC_NOT_IN_SAMPLE,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_pipelined_execution",
+		gettext_noop("Enables sending multiple tasks over a connection in a "
+					 "single pipeline."),
+		gettext_noop("When enabled, the adaptive executor sends all the tasks "
+					 "that a connection picks up, along with BEGIN when "
+					 "needed, in libpq pipeline mode and then receives the "
+					 "results in order. This saves a network round trip per "
+					 "task when multiple tasks run over the same connection, "
+					 "but tasks are taken before the transaction block on "
+					 "the worker is known to be open."),
+		&EnablePipelinedExecution,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_recurring_outer_join_pushdown",
 		gettext_noop("Enables outer join pushdown for recurring relations."),
@@ -1558,6 +1675,22 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_shared_metadata_cache",
+		gettext_noop("Enables sharing shard metadata between backends"),
+		gettext_noop("When enabled, the shards and placements of hash "
+					 "distributed tables and tables without a distribution "
+					 "key are published in shared memory once they are read "
+					 "from the catalogs, such that other backends can use "
+					 "them without scanning pg_dist_shard and "
+					 "pg_dist_placement. This lowers the latency of the first "
+					 "query on tables with many shards in new sessions."),
+		&EnableSharedMetadataCache,
+		false,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_single_hash_repartition_joins",
 		gettext_noop("Enables single hash repartitioning between hash "
@@ -1593,6 +1726,22 @@ RegisterCitusConfigVariables(void)
 		GUC_SUPERUSER_ONLY,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_streaming_results",
+		gettext_noop("Enables returning rows of distributed queries while they "
+					 "are being received from the workers"),
+		gettext_noop("By default, the results of a distributed query are stored "
+					 "in a tuple store before the first row is returned. When "
+					 "enabled, read-only queries outside of transaction blocks "
+					 "return rows as they arrive and only keep the rows that "
+					 "were not returned yet, which lowers the latency of the "
+					 "first row and the memory usage for large results."),
+		&EnableStreamingResults,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_unique_job_ids",
 		gettext_noop("Enables unique job IDs by prepending the local process ID and "
@@ -1637,6 +1786,21 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL | GUC_NOT_IN_SAMPLE,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_worker_prepared_statements",
+		gettext_noop("Enables preparing parameterized shard queries on the workers"),
+		gettext_noop("When enabled, single shard queries that are sent with "
+					 "parameters are prepared once per connection as a named "
+					 "statement on the worker, such that subsequent executions "
+					 "of the same shard query skip parsing and planning on the "
+					 "worker. The statements are deallocated when the metadata "
+					 "of a distributed table changes."),
+		&EnableWorkerPreparedStatements,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enforce_foreign_key_restrictions",
 		gettext_noop("Enforce restrictions while querying distributed/reference "
@@ -1791,6 +1955,40 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL | GUC_NOT_IN_SAMPLE,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.incremental_deadlock_detection",
+		gettext_noop("Enables reading only the changes to the wait graphs of the "
+					 "nodes during distributed deadlock detection."),
+		gettext_noop("By default, distributed deadlock detection reads the full "
+					 "wait graph of every node and searches it for cycles on "
+					 "each run. When enabled, each node keeps the wait graph "
+					 "it last reported and only returns the changes, and the "
+					 "search for cycles is skipped when no wait edges were "
+					 "added since the previous run. Nodes only keep the wait "
+					 "graphs when citus.max_wait_graph_snapshots is set."),
+		&IncrementalDeadlockDetection,
+		false,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomEnumVariable(
+		"citus.intermediate_result_compression",
+		gettext_noop("Sets the compression method for intermediate results."),
+		gettext_noop("When set, the intermediate results of CTEs, subqueries and "
+					 "repartitioned queries are compressed in chunks before they "
+					 "are written to files and sent to other nodes. This reduces "
+					 "network traffic and disk usage at the expense of CPU time. "
+					 "Files are read regardless of this setting, but nodes "
+					 "running an older version of Citus cannot read compressed "
+					 "files."),
+		&IntermediateResultCompression,
+		INTERMEDIATE_RESULT_COMPRESSION_NONE,
+		intermediate_result_compression_options,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.isolation_test_session_process_id",
 		NULL,
@@ -2096,6 +2294,40 @@ RegisterCitusConfigVariables(void)
 		GUC_SUPERUSER_ONLY,
 		NULL, NULL, MaxSharedPoolSizeGucShowHook);
 
+	DefineCustomIntVariable(
+		"citus.max_wait_graph_snapshots",
+		gettext_noop("Sets the maximum number of wait graphs that this node keeps "
+					 "for incremental deadlock detection."),
+		gettext_noop("With citus.incremental_deadlock_detection, this node keeps "
+					 "the local wait graph that it last reported to each polling "
+					 "node and database, up to this number, such that it only "
+					 "needs to report the changes next time. The shared memory "
+					 "fits as many wait edges as there are processes for each "
+					 "wait graph, and a larger wait graph takes the space of the "
+					 "least recently polled ones. 0 does not allocate any shared "
+					 "memory and always reports the full wait graph."),
+		&MaxWaitGraphSnapshots,
+		0, 0, 1024,
+		PGC_POSTMASTER,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_warm_conns_per_worker",
+		gettext_noop("Sets the maximum number of connections to keep warm per worker."),
+		gettext_noop("When set to a value above 0, the connections that the recent "
+					 "multi-shard queries used in parallel on a worker are kept "
+					 "open at the end of the transaction, up to this number per "
+					 "worker and beyond citus.max_cached_conns_per_worker, and are "
+					 "all opened at once by the next query instead of being "
+					 "subject to citus.executor_slow_start_interval. 0 disables "
+					 "connection warm-up."),
+		&MaxWarmConnectionsPerWorker,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_worker_nodes_tracked",
 		gettext_noop("Sets the maximum number of worker nodes that are tracked."),
@@ -2115,6 +2347,19 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.max_worker_prepared_statements_per_connection",
+		gettext_noop("Sets the maximum number of statements that are prepared "
+					 "on a worker over a single connection."),
+		gettext_noop("When the limit is reached, all statements that are prepared "
+					 "over the connection are deallocated. Only used when "
+					 "citus.enable_worker_prepared_statements is enabled."),
+		&MaxWorkerPreparedStatementsPerConnection,
+		1000, 1, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.metadata_sync_interval",
 		gettext_noop("Sets the time to wait between metadata syncs."),
@@ -2475,6 +2720,18 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.shared_metadata_cache_size",
+		gettext_noop("Sets the maximum amount of shared memory used by the "
+					 "shared metadata cache."),
+		gettext_noop("Shard lists that do not fit are not shared. The size "
+					 "limit is applied when the cache is created."),
+		&SharedMetadataCacheSize,
+		65536, 1024, MAX_KILOBYTES,
+		PGC_POSTMASTER,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomStringVariable(
 		"citus.show_shards_for_app_name_prefixes",
 		gettext_noop("If application_name starts with one of these values, show shards"),
@@ -2759,6 +3016,21 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.worker_connection_pool_size",
+		gettext_noop("Sets the maximum number of connections per worker node that "
+					 "the worker connection pooler shares between the backends."),
+		gettext_noop("When set, the maintenance daemon of each database starts a "
+					 "background worker that runs the tasks of read-only queries "
+					 "outside of transaction blocks on a bounded set of "
+					 "connections, instead of each backend opening its own. "
+					 "0 disables the pool."),
+		&WorkerConnectionPoolSize,
+		0, 0, INT_MAX,
+		PGC_SIGHUP,
+		GUC_SUPERUSER_ONLY,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.worker_min_messages",
 		gettext_noop("Log messages from workers only if their log level is at or above "
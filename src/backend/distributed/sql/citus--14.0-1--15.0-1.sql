@@ -1,2 +1,6 @@
 -- citus--14.0-1--15.0-1
 -- bump version to 15.0-1
+
+#include "udfs/citus_internal_local_wait_edge_changes/15.0-1.sql"
+#include "udfs/citus_stat_connection_warmup/15.0-1.sql"
+#include "udfs/citus_stat_deadlock_detection/15.0-1.sql"
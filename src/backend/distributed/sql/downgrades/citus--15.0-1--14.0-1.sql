@@ -1,2 +1,8 @@
 -- citus--15.0-1--14.0-1
 -- downgrade version to 14.0-1
+
+DROP FUNCTION citus_internal.local_wait_edge_changes(int4, int8, int8);
+DROP VIEW pg_catalog.citus_stat_deadlock_detection;
+DROP FUNCTION pg_catalog.citus_stat_deadlock_detection();
+DROP VIEW pg_catalog.citus_stat_connection_warmup;
+DROP FUNCTION pg_catalog.citus_stat_connection_warmup();
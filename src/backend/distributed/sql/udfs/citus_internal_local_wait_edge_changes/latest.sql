@@ -0,0 +1,21 @@
+CREATE OR REPLACE FUNCTION citus_internal.local_wait_edge_changes(
+                    requester_node_id int4,
+                    since_version int8,
+                    new_version int8,
+                    OUT change_type "char",
+                    OUT waiting_pid int4,
+                    OUT waiting_node_id int4,
+                    OUT waiting_transaction_num int8,
+                    OUT waiting_transaction_stamp timestamptz,
+                    OUT blocking_pid int4,
+                    OUT blocking_node_id int4,
+                    OUT blocking_transaction_num int8,
+                    OUT blocking_transaction_stamp timestamptz,
+                    OUT blocking_transaction_waiting bool)
+RETURNS SETOF RECORD
+LANGUAGE C STRICT
+AS $$MODULE_PATHNAME$$, $$citus_internal_local_wait_edge_changes$$;
+COMMENT ON FUNCTION citus_internal.local_wait_edge_changes(int4, int8, int8)
+IS 'returns the changes to the local lock wait chains of distributed transactions since the given version';
+
+REVOKE ALL ON FUNCTION citus_internal.local_wait_edge_changes(int4, int8, int8) FROM PUBLIC;
@@ -0,0 +1,34 @@
+-- See the comments for the function in
+-- src/backend/distributed/connection/connection_warmup.c for more details.
+CREATE OR REPLACE FUNCTION pg_catalog.citus_stat_connection_warmup(
+    OUT database_id oid,
+    OUT nodename text,
+    OUT nodeport int,
+    OUT parallelism double precision,
+    OUT executions bigint,
+    OUT connections_established bigint,
+    OUT avg_establishment_time double precision,
+    OUT warm_connections_reused bigint,
+    OUT establishment_time_avoided double precision
+)
+RETURNS SETOF RECORD
+LANGUAGE C STRICT VOLATILE PARALLEL SAFE
+AS 'MODULE_PATHNAME', $$citus_stat_connection_warmup$$;
+COMMENT ON FUNCTION pg_catalog.citus_stat_connection_warmup() IS 'Returns the recent parallelism of multi-shard queries per worker node that connection warm-up is based on, and the connection establishment time it avoided, with times in milliseconds.';
+
+CREATE VIEW citus.citus_stat_connection_warmup AS
+SELECT pg_database.datname AS database_name,
+       stats.nodename,
+       stats.nodeport,
+       stats.parallelism,
+       stats.executions,
+       stats.connections_established,
+       stats.avg_establishment_time,
+       stats.warm_connections_reused,
+       stats.establishment_time_avoided
+FROM pg_catalog.citus_stat_connection_warmup() stats
+LEFT JOIN pg_catalog.pg_database ON (pg_database.oid = stats.database_id);
+
+ALTER VIEW citus.citus_stat_connection_warmup SET SCHEMA pg_catalog;
+
+GRANT SELECT ON pg_catalog.citus_stat_connection_warmup TO PUBLIC;
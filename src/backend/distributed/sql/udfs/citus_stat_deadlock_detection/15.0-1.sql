@@ -0,0 +1,38 @@
+-- See the comments for the function in
+-- src/backend/distributed/transaction/distributed_deadlock_detection.c for more details.
+CREATE OR REPLACE FUNCTION pg_catalog.citus_stat_deadlock_detection(
+    OUT database_id oid,
+    OUT start_time timestamp with time zone,
+    OUT incremental bool,
+    OUT node_count int,
+    OUT full_graph_count int,
+    OUT edges_received bigint,
+    OUT edge_count bigint,
+    OUT gather_time double precision,
+    OUT search_time double precision,
+    OUT search_skipped bool,
+    OUT deadlock_found bool
+)
+RETURNS SETOF RECORD
+LANGUAGE C STRICT VOLATILE PARALLEL SAFE
+AS 'MODULE_PATHNAME', $$citus_stat_deadlock_detection$$;
+COMMENT ON FUNCTION pg_catalog.citus_stat_deadlock_detection() IS 'Returns the statistics of the most recent distributed deadlock detection passes on the local node, with times in milliseconds.';
+
+CREATE VIEW citus.citus_stat_deadlock_detection AS
+SELECT pg_database.datname AS database_name,
+       stats.start_time,
+       stats.incremental,
+       stats.node_count,
+       stats.full_graph_count,
+       stats.edges_received,
+       stats.edge_count,
+       stats.gather_time,
+       stats.search_time,
+       stats.search_skipped,
+       stats.deadlock_found
+FROM pg_catalog.citus_stat_deadlock_detection() stats
+LEFT JOIN pg_catalog.pg_database ON (pg_database.oid = stats.database_id);
+
+ALTER VIEW citus.citus_stat_deadlock_detection SET SCHEMA pg_catalog;
+
+GRANT SELECT ON pg_catalog.citus_stat_deadlock_detection TO PUBLIC;
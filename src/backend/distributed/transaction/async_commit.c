@@ -0,0 +1,1092 @@
+/*-------------------------------------------------------------------------
+ *
+ * async_commit.c
+ *   Hands the COMMIT PREPARED round of two-phase commits to a background
+ *   worker, such that the client does not wait for it.
+ *
+ * Once the local transaction that wrote the pg_dist_transaction records
+ * commits, the outcome of a distributed transaction is decided and 2PC
+ * recovery would commit the prepared transactions on the workers if we
+ * failed to do so. When citus.async_commit_prepared is enabled, the backend
+ * therefore only queues the prepared transactions in shared memory at
+ * XACT_EVENT_COMMIT, and a per-database "async commit worker" that the
+ * maintenance daemon starts sends the COMMIT PREPARED commands.
+ *
+ * Until the worker has committed the prepared transactions of a backend,
+ * the changes are not visible on the workers. To keep read-your-writes
+ * semantics within a session, the backend waits for its queued commits
+ * before it uses a worker connection again.
+ *
+ * If the worker fails to commit a prepared transaction, the entry stays in
+ * the queue and the worker retries it periodically until either COMMIT
+ * PREPARED succeeds or 2PC recovery committed the prepared transaction in
+ * the meantime, such that a backend never stops waiting for a commit that
+ * did not happen yet. Entries that a worker left behind when it exited are
+ * picked up by the next worker, which the maintenance daemon starts as long
+ * as the queue of the database is not empty. The queue is only used while
+ * citus.recover_2pc_interval is enabled, since recovery is what resolves
+ * the prepared transactions of a failed node.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "libpq-fe.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include "access/xact.h"
+#include "postmaster/bgworker.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lwlock.h"
+#include "storage/proc.h"
+#include "storage/shmem.h"
+#include "tcop/tcopprot.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+
+#include "distributed/async_commit.h"
+#include "distributed/backend_data.h"
+#include "distributed/background_worker_utils.h"
+#include "distributed/citus_safe_lib.h"
+#include "distributed/connection_management.h"
+#include "distributed/listutils.h"
+#include "distributed/remote_commands.h"
+#include "distributed/remote_transaction.h"
+#include "distributed/transaction_management.h"
+#include "distributed/transaction_recovery.h"
+#include "distributed/version_compat.h"
+#include "distributed/worker_manager.h"
+
+
+/* number of prepared transactions that can be queued across all databases */
+#define ASYNC_COMMIT_QUEUE_SIZE 1024
+
+/* maximum number of COMMIT PREPARED commands that the worker sends at once */
+#define ASYNC_COMMIT_BATCH_SIZE 64
+
+/* how long to sleep between checks while waiting for the worker */
+#define ASYNC_COMMIT_WAIT_INTERVAL_MS 1000
+
+/* how long to wait before retrying a COMMIT PREPARED that failed */
+#define ASYNC_COMMIT_RETRY_INTERVAL_MS 5000
+
+/* how long a backend waits for its queued commits before it gives up */
+#define ASYNC_COMMIT_WAIT_TIMEOUT_MS 30000
+
+
+/*
+ * AsyncCommitWorker is the shared memory entry of the async commit worker of
+ * a database.
+ */
+typedef struct AsyncCommitWorker
+{
+	/* InvalidOid when the entry is not used */
+	Oid databaseId;
+	pid_t pid;
+	Latch *latch;
+} AsyncCommitWorker;
+
+
+typedef enum AsyncCommitEntryState
+{
+	ASYNC_COMMIT_ENTRY_FREE = 0,
+	ASYNC_COMMIT_ENTRY_PENDING,
+	ASYNC_COMMIT_ENTRY_RUNNING
+} AsyncCommitEntryState;
+
+
+/*
+ * AsyncCommitEntry is a prepared transaction on a worker that should be
+ * committed.
+ */
+typedef struct AsyncCommitEntry
+{
+	AsyncCommitEntryState state;
+	Oid databaseId;
+
+	/* backend that committed the distributed transaction */
+	int ownerProcNo;
+	pid_t ownerPid;
+
+	/* connection parameters that the transaction was prepared with */
+	char nodeName[MAX_NODE_LENGTH];
+	int nodePort;
+	char userName[NAMEDATALEN];
+	char databaseName[NAMEDATALEN];
+
+	char preparedName[NAMEDATALEN];
+
+	/* the worker does not take the entry before this time, after a failure */
+	TimestampTz retryTime;
+} AsyncCommitEntry;
+
+
+/*
+ * AsyncCommitBackend tracks the queued commits of a backend, such that it
+ * can wait for them.
+ */
+typedef struct AsyncCommitBackend
+{
+	/* the slot is reused when a process with another pid gets the pgprocno */
+	pid_t pid;
+	Latch *latch;
+	int pendingCount;
+} AsyncCommitBackend;
+
+
+/*
+ * AsyncCommitSharedData is the header of the shared memory of the async
+ * commits, which is followed by workerCount workers, entryCount entries and
+ * backendCount backends.
+ */
+typedef struct AsyncCommitSharedData
+{
+	int trancheId;
+	char *lockTrancheName;
+	LWLock lock;
+
+	int workerCount;
+	int entryCount;
+	int backendCount;
+} AsyncCommitSharedData;
+
+
+/* config variable managed via guc.c */
+bool AsyncCommitPrepared = false;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static AsyncCommitSharedData *AsyncCommitShared = NULL;
+static AsyncCommitWorker *AsyncCommitWorkers = NULL;
+static AsyncCommitEntry *AsyncCommitEntries = NULL;
+static AsyncCommitBackend *AsyncCommitBackends = NULL;
+
+/* whether the current backend queued commits that it did not wait for yet */
+static bool HasPendingAsyncCommits = false;
+
+static volatile sig_atomic_t got_SIGHUP = false;
+static volatile sig_atomic_t got_SIGTERM = false;
+
+
+static void AsyncCommitShmemInit(void);
+static AsyncCommitWorker * FindAsyncCommitWorker(Oid databaseId);
+static int MyAsyncCommitPendingCount(void);
+static void StopWaitingForAsyncCommitPrepared(void);
+static bool RegisterAsyncCommitWorker(void);
+static void AsyncCommitWorkerShmemExit(int code, Datum arg);
+static int CommitQueuedPreparedTransactions(void);
+static void SendCommitPreparedBatch(AsyncCommitEntry *batch, int batchSize,
+									bool *committed, bool *abandoned);
+static bool AsyncCommitNodeActive(AsyncCommitEntry *entry);
+static bool SameAsyncCommitConnection(AsyncCommitEntry *entry,
+									  AsyncCommitEntry *otherEntry);
+static bool CommitPreparedResponseOK(PGresult *result);
+static void ReleaseAsyncCommitEntry(AsyncCommitEntry *entry);
+static void RetryAsyncCommitEntryLater(AsyncCommitEntry *entry, TimestampTz retryTime);
+static void AsyncCommitWorkerSigTermHandler(SIGNAL_ARGS);
+static void AsyncCommitWorkerSigHupHandler(SIGNAL_ARGS);
+
+
+/*
+ * InitializeAsyncCommit sets up the shared memory startup hook of the async
+ * commits.
+ */
+void
+InitializeAsyncCommit(void)
+{
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = AsyncCommitShmemInit;
+}
+
+
+/*
+ * AsyncCommitShmemSize returns the size that should be allocated on the
+ * shared memory for the async commits.
+ */
+size_t
+AsyncCommitShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, MAXALIGN(sizeof(AsyncCommitSharedData)));
+	size = add_size(size, MAXALIGN(mul_size(sizeof(AsyncCommitWorker),
+											max_worker_processes)));
+	size = add_size(size, MAXALIGN(mul_size(sizeof(AsyncCommitEntry),
+											ASYNC_COMMIT_QUEUE_SIZE)));
+	size = add_size(size, mul_size(sizeof(AsyncCommitBackend), TotalProcCount()));
+
+	return size;
+}
+
+
+/*
+ * AsyncCommitShmemInit initializes the shared memory through which the
+ * backends queue their prepared transactions.
+ */
+static void
+AsyncCommitShmemInit(void)
+{
+	bool alreadyInitialized = false;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	char *sharedMemory = ShmemInitStruct("Async Commit Data", AsyncCommitShmemSize(),
+										 &alreadyInitialized);
+
+	char *nextStruct = sharedMemory + MAXALIGN(sizeof(AsyncCommitSharedData));
+
+	AsyncCommitShared = (AsyncCommitSharedData *) sharedMemory;
+	AsyncCommitWorkers = (AsyncCommitWorker *) nextStruct;
+	nextStruct += MAXALIGN(mul_size(sizeof(AsyncCommitWorker), max_worker_processes));
+	AsyncCommitEntries = (AsyncCommitEntry *) nextStruct;
+	nextStruct += MAXALIGN(mul_size(sizeof(AsyncCommitEntry), ASYNC_COMMIT_QUEUE_SIZE));
+	AsyncCommitBackends = (AsyncCommitBackend *) nextStruct;
+
+	if (!alreadyInitialized)
+	{
+		memset(sharedMemory, 0, AsyncCommitShmemSize());
+
+		AsyncCommitShared->trancheId = LWLockNewTrancheId();
+		AsyncCommitShared->lockTrancheName = "Async Commit Tranche";
+		LWLockRegisterTranche(AsyncCommitShared->trancheId,
+							  AsyncCommitShared->lockTrancheName);
+		LWLockInitialize(&AsyncCommitShared->lock, AsyncCommitShared->trancheId);
+
+		AsyncCommitShared->workerCount = max_worker_processes;
+		AsyncCommitShared->entryCount = ASYNC_COMMIT_QUEUE_SIZE;
+		AsyncCommitShared->backendCount = TotalProcCount();
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * FindAsyncCommitWorker returns the async commit worker entry of the given
+ * database, or NULL if there is none. The caller should hold the lock.
+ */
+static AsyncCommitWorker *
+FindAsyncCommitWorker(Oid databaseId)
+{
+	for (int workerIndex = 0; workerIndex < AsyncCommitShared->workerCount;
+		 workerIndex++)
+	{
+		AsyncCommitWorker *worker = &AsyncCommitWorkers[workerIndex];
+		if (worker->databaseId == databaseId)
+		{
+			return worker;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * AsyncCommitWorkerRunning returns true if the async commit worker of the
+ * given database is running.
+ */
+bool
+AsyncCommitWorkerRunning(Oid database)
+{
+	LWLockAcquire(&AsyncCommitShared->lock, LW_SHARED);
+	bool workerRunning = FindAsyncCommitWorker(database) != NULL;
+	LWLockRelease(&AsyncCommitShared->lock);
+
+	return workerRunning;
+}
+
+
+/*
+ * DeferPreparedRemoteTransactionsCommit queues the prepared transactions of
+ * the coordinated transaction for the async commit worker, and marks them as
+ * committed such that CoordinatedRemoteTransactionsCommit only handles the
+ * remaining connections. It is called at XACT_EVENT_COMMIT, so it does not
+ * allocate memory.
+ *
+ * The prepared transactions are committed synchronously if the async commit
+ * worker is not running or the queue does not have room for all of them.
+ */
+void
+DeferPreparedRemoteTransactionsCommit(void)
+{
+	dlist_iter iter;
+	int preparedCount = 0;
+
+	if (!AsyncCommitPrepared || Recover2PCInterval <= 0 || AsyncCommitShared == NULL)
+	{
+		return;
+	}
+
+	dlist_foreach(iter, &InProgressTransactions)
+	{
+		MultiConnection *connection = dlist_container(MultiConnection, transactionNode,
+													  iter.cur);
+		RemoteTransaction *transaction = &connection->remoteTransaction;
+
+		if (transaction->transactionState == REMOTE_TRANS_PREPARED &&
+			!transaction->transactionFailed)
+		{
+			preparedCount++;
+		}
+	}
+
+	if (preparedCount == 0)
+	{
+		return;
+	}
+
+	LWLockAcquire(&AsyncCommitShared->lock, LW_EXCLUSIVE);
+
+	AsyncCommitWorker *worker = FindAsyncCommitWorker(MyDatabaseId);
+	if (worker == NULL)
+	{
+		LWLockRelease(&AsyncCommitShared->lock);
+		return;
+	}
+
+	int freeEntryCount = 0;
+	for (int entryIndex = 0; entryIndex < AsyncCommitShared->entryCount; entryIndex++)
+	{
+		if (AsyncCommitEntries[entryIndex].state == ASYNC_COMMIT_ENTRY_FREE)
+		{
+			freeEntryCount++;
+		}
+	}
+
+	if (freeEntryCount < preparedCount)
+	{
+		/* the worker is falling behind, commit this transaction ourselves */
+		LWLockRelease(&AsyncCommitShared->lock);
+		return;
+	}
+
+	int pgprocno = getProcNo_compat(MyProc);
+	AsyncCommitBackend *backend = &AsyncCommitBackends[pgprocno];
+	if (backend->pid != MyProcPid)
+	{
+		backend->pid = MyProcPid;
+		backend->latch = MyLatch;
+		backend->pendingCount = 0;
+	}
+
+	int entryIndex = 0;
+
+	dlist_foreach(iter, &InProgressTransactions)
+	{
+		MultiConnection *connection = dlist_container(MultiConnection, transactionNode,
+													  iter.cur);
+		RemoteTransaction *transaction = &connection->remoteTransaction;
+
+		if (transaction->transactionState != REMOTE_TRANS_PREPARED ||
+			transaction->transactionFailed)
+		{
+			continue;
+		}
+
+		while (AsyncCommitEntries[entryIndex].state != ASYNC_COMMIT_ENTRY_FREE)
+		{
+			entryIndex++;
+		}
+
+		AsyncCommitEntry *entry = &AsyncCommitEntries[entryIndex];
+		entry->state = ASYNC_COMMIT_ENTRY_PENDING;
+		entry->databaseId = MyDatabaseId;
+		entry->ownerProcNo = pgprocno;
+		entry->ownerPid = MyProcPid;
+		strlcpy(entry->nodeName, connection->hostname, MAX_NODE_LENGTH);
+		entry->nodePort = connection->port;
+		strlcpy(entry->userName, connection->user, NAMEDATALEN);
+		strlcpy(entry->databaseName, connection->database, NAMEDATALEN);
+		strlcpy(entry->preparedName, transaction->preparedName, NAMEDATALEN);
+		entry->retryTime = 0;
+
+		backend->pendingCount++;
+
+		/* the connection can be reused, the worker commits via its own */
+		transaction->transactionState = REMOTE_TRANS_COMMITTED;
+	}
+
+	Latch *workerLatch = worker->latch;
+
+	LWLockRelease(&AsyncCommitShared->lock);
+
+	SetLatch(workerLatch);
+
+	HasPendingAsyncCommits = true;
+}
+
+
+/*
+ * WaitForAsyncCommitPrepared waits until the async commit worker committed
+ * all the prepared transactions that the current backend queued, such that
+ * the backend sees its own writes on the workers.
+ *
+ * Like a synchronous COMMIT PREPARED that fails, a commit that does not
+ * finish in time (e.g. because the node is down) only raises a warning and
+ * is left to the worker and 2PC recovery, such that the session does not
+ * hang on every later access to the workers.
+ */
+void
+WaitForAsyncCommitPrepared(void)
+{
+	if (!HasPendingAsyncCommits || !IsTransactionState())
+	{
+		/* nothing to wait for, or we are committing or aborting */
+		return;
+	}
+
+	TimestampTz waitStart = GetCurrentTimestamp();
+
+	int pendingCount = 0;
+	while ((pendingCount = MyAsyncCommitPendingCount()) > 0)
+	{
+		if (TimestampDifferenceExceeds(waitStart, GetCurrentTimestamp(),
+									   ASYNC_COMMIT_WAIT_TIMEOUT_MS))
+		{
+			StopWaitingForAsyncCommitPrepared();
+
+			ereport(WARNING, (errmsg("%d prepared transactions of a previous "
+									 "commit have not been committed yet",
+									 pendingCount),
+							  errdetail("The async commit worker or 2PC recovery "
+										"will commit them, the changes might "
+										"not be visible until then.")));
+			break;
+		}
+
+		int rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+						   ASYNC_COMMIT_WAIT_INTERVAL_MS, PG_WAIT_EXTENSION);
+		if (rc & WL_LATCH_SET)
+		{
+			ResetLatch(MyLatch);
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	HasPendingAsyncCommits = false;
+}
+
+
+/*
+ * MyAsyncCommitPendingCount returns the number of prepared transactions that
+ * the current backend queued and the worker did not commit yet.
+ */
+static int
+MyAsyncCommitPendingCount(void)
+{
+	int pendingCount = 0;
+
+	LWLockAcquire(&AsyncCommitShared->lock, LW_SHARED);
+
+	AsyncCommitBackend *backend = &AsyncCommitBackends[getProcNo_compat(MyProc)];
+	if (backend->pid == MyProcPid)
+	{
+		pendingCount = backend->pendingCount;
+	}
+
+	LWLockRelease(&AsyncCommitShared->lock);
+
+	return pendingCount;
+}
+
+
+/*
+ * StopWaitingForAsyncCommitPrepared detaches the queued commits of the
+ * current backend from it, such that later commits of the backend do not
+ * wait for them. The worker keeps committing them.
+ */
+static void
+StopWaitingForAsyncCommitPrepared(void)
+{
+	int myProcNo = getProcNo_compat(MyProc);
+
+	LWLockAcquire(&AsyncCommitShared->lock, LW_EXCLUSIVE);
+
+	for (int entryIndex = 0; entryIndex < AsyncCommitShared->entryCount; entryIndex++)
+	{
+		AsyncCommitEntry *entry = &AsyncCommitEntries[entryIndex];
+		if (entry->state != ASYNC_COMMIT_ENTRY_FREE &&
+			entry->ownerProcNo == myProcNo && entry->ownerPid == MyProcPid)
+		{
+			/* ReleaseAsyncCommitEntry skips entries of other processes */
+			entry->ownerPid = 0;
+		}
+	}
+
+	AsyncCommitBackend *backend = &AsyncCommitBackends[myProcNo];
+	if (backend->pid == MyProcPid)
+	{
+		backend->pendingCount = 0;
+	}
+
+	LWLockRelease(&AsyncCommitShared->lock);
+}
+
+
+/*
+ * StartAsyncCommitWorker spawns the async commit worker of the current
+ * database.
+ */
+BackgroundWorkerHandle *
+StartAsyncCommitWorker(Oid database, Oid extensionOwner)
+{
+	char workerName[BGW_MAXLEN];
+
+	SafeSnprintf(workerName, BGW_MAXLEN,
+				 "Citus Async Commit Worker: %u/%u",
+				 database, extensionOwner);
+
+	CitusBackgroundWorkerConfig config = {
+		.workerName = workerName,
+		.functionName = "AsyncCommitWorkerMain",
+		.mainArg = ObjectIdGetDatum(database),
+		.extensionOwner = extensionOwner,
+		.needsNotification = true,
+		.waitForStartup = false,
+		.restartTime = CITUS_BGW_NEVER_RESTART,
+		.startTime = CITUS_BGW_DEFAULT_START_TIME,
+		.workerType = NULL, /* use default */
+		.extraData = NULL,
+		.extraDataSize = 0
+	};
+	return RegisterCitusBackgroundWorker(&config);
+}
+
+
+/*
+ * AsyncCommitWorkerMain is the main routine of the async commit worker. The
+ * maintenance daemon starts it whenever it is not running and either
+ * citus.async_commit_prepared is enabled for the database or prepared
+ * transactions are queued, and it exits once the setting is disabled and the
+ * queue of the database is empty.
+ */
+void
+AsyncCommitWorkerMain(Datum arg)
+{
+	Oid databaseOid = DatumGetObjectId(arg);
+
+	pqsignal(SIGTERM, AsyncCommitWorkerSigTermHandler);
+	pqsignal(SIGHUP, AsyncCommitWorkerSigHupHandler);
+	BackgroundWorkerUnblockSignals();
+
+	/* extension owner is passed via bgw_extra */
+	Oid extensionOwner = InvalidOid;
+	memcpy_s(&extensionOwner, sizeof(extensionOwner),
+			 MyBgworkerEntry->bgw_extra, sizeof(Oid));
+
+	/* connect to database, after that we can actually access catalogs */
+	BackgroundWorkerInitializeConnectionByOid(databaseOid, extensionOwner, 0);
+
+	/* make worker recognizable in pg_stat_activity */
+	pgstat_report_appname("Citus Async Commit Worker");
+
+	if (!RegisterAsyncCommitWorker())
+	{
+		ereport(LOG, (errmsg("async commit worker already running for database %u",
+							 databaseOid)));
+		proc_exit(0);
+	}
+
+	MemoryContext workerContext = AllocSetContextCreate(TopMemoryContext,
+														"Async Commit Worker",
+														ALLOCSET_DEFAULT_SIZES);
+	MemoryContextSwitchTo(workerContext);
+
+	ereport(DEBUG1, (errmsg("started async commit worker")));
+
+	while (!got_SIGTERM)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		if (got_SIGHUP)
+		{
+			got_SIGHUP = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+
+		if (CommitQueuedPreparedTransactions() > 0)
+		{
+			/* there might be more work queued already */
+			continue;
+		}
+
+		if (!AsyncCommitPrepared && !HasQueuedAsyncCommits())
+		{
+			break;
+		}
+
+		int rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+						   ASYNC_COMMIT_WAIT_INTERVAL_MS, PG_WAIT_EXTENSION);
+		if (rc & WL_LATCH_SET)
+		{
+			ResetLatch(MyLatch);
+		}
+	}
+
+	proc_exit(0);
+}
+
+
+/*
+ * RegisterAsyncCommitWorker publishes the current process as the async
+ * commit worker of its database. It returns false if the database already
+ * has one.
+ */
+static bool
+RegisterAsyncCommitWorker(void)
+{
+	bool registered = false;
+
+	LWLockAcquire(&AsyncCommitShared->lock, LW_EXCLUSIVE);
+
+	if (FindAsyncCommitWorker(MyDatabaseId) == NULL)
+	{
+		AsyncCommitWorker *worker = FindAsyncCommitWorker(InvalidOid);
+		if (worker != NULL)
+		{
+			worker->databaseId = MyDatabaseId;
+			worker->pid = MyProcPid;
+			worker->latch = MyLatch;
+
+			registered = true;
+		}
+	}
+
+	LWLockRelease(&AsyncCommitShared->lock);
+
+	if (registered)
+	{
+		on_shmem_exit(AsyncCommitWorkerShmemExit, 0);
+	}
+
+	return registered;
+}
+
+
+/*
+ * AsyncCommitWorkerShmemExit removes the worker from shared memory when it
+ * exits. The prepared transactions that it was committing go back to the
+ * queue, such that the next worker commits them and the backends keep
+ * waiting until that happened.
+ */
+static void
+AsyncCommitWorkerShmemExit(int code, Datum arg)
+{
+	LWLockAcquire(&AsyncCommitShared->lock, LW_EXCLUSIVE);
+
+	AsyncCommitWorker *worker = FindAsyncCommitWorker(MyDatabaseId);
+	if (worker != NULL && worker->pid == MyProcPid)
+	{
+		worker->databaseId = InvalidOid;
+		worker->pid = 0;
+		worker->latch = NULL;
+	}
+
+	for (int entryIndex = 0; entryIndex < AsyncCommitShared->entryCount; entryIndex++)
+	{
+		AsyncCommitEntry *entry = &AsyncCommitEntries[entryIndex];
+		if (entry->state == ASYNC_COMMIT_ENTRY_RUNNING &&
+			entry->databaseId == MyDatabaseId)
+		{
+			entry->state = ASYNC_COMMIT_ENTRY_PENDING;
+		}
+	}
+
+	LWLockRelease(&AsyncCommitShared->lock);
+}
+
+
+/*
+ * HasQueuedAsyncCommits returns true if there are prepared transactions
+ * queued for the current database, including the ones that wait for a retry.
+ */
+bool
+HasQueuedAsyncCommits(void)
+{
+	bool hasQueuedCommits = false;
+
+	if (AsyncCommitShared == NULL)
+	{
+		return false;
+	}
+
+	LWLockAcquire(&AsyncCommitShared->lock, LW_SHARED);
+
+	for (int entryIndex = 0; entryIndex < AsyncCommitShared->entryCount; entryIndex++)
+	{
+		AsyncCommitEntry *entry = &AsyncCommitEntries[entryIndex];
+		if (entry->state == ASYNC_COMMIT_ENTRY_PENDING &&
+			entry->databaseId == MyDatabaseId)
+		{
+			hasQueuedCommits = true;
+			break;
+		}
+	}
+
+	LWLockRelease(&AsyncCommitShared->lock);
+
+	return hasQueuedCommits;
+}
+
+
+/*
+ * CommitQueuedPreparedTransactions takes a batch of queued prepared
+ * transactions of the current database and commits them. Since a connection
+ * can only run one COMMIT PREPARED at a time, the batch contains at most one
+ * prepared transaction per node and user. Prepared transactions that could
+ * not be committed stay in the queue and are retried later. It returns the
+ * number of prepared transactions that it took from the queue.
+ */
+static int
+CommitQueuedPreparedTransactions(void)
+{
+	AsyncCommitEntry batch[ASYNC_COMMIT_BATCH_SIZE];
+	int batchEntryIndexes[ASYNC_COMMIT_BATCH_SIZE];
+	bool committed[ASYNC_COMMIT_BATCH_SIZE];
+	bool abandoned[ASYNC_COMMIT_BATCH_SIZE];
+	int batchSize = 0;
+
+	TimestampTz currentTime = GetCurrentTimestamp();
+
+	LWLockAcquire(&AsyncCommitShared->lock, LW_EXCLUSIVE);
+
+	for (int entryIndex = 0;
+		 entryIndex < AsyncCommitShared->entryCount &&
+		 batchSize < ASYNC_COMMIT_BATCH_SIZE;
+		 entryIndex++)
+	{
+		AsyncCommitEntry *entry = &AsyncCommitEntries[entryIndex];
+		if (entry->state != ASYNC_COMMIT_ENTRY_PENDING ||
+			entry->databaseId != MyDatabaseId ||
+			entry->retryTime > currentTime)
+		{
+			continue;
+		}
+
+		bool connectionInBatch = false;
+		for (int batchIndex = 0; batchIndex < batchSize; batchIndex++)
+		{
+			if (SameAsyncCommitConnection(entry, &batch[batchIndex]))
+			{
+				connectionInBatch = true;
+				break;
+			}
+		}
+
+		if (connectionInBatch)
+		{
+			continue;
+		}
+
+		entry->state = ASYNC_COMMIT_ENTRY_RUNNING;
+		batch[batchSize] = *entry;
+		batchEntryIndexes[batchSize] = entryIndex;
+		committed[batchSize] = false;
+		abandoned[batchSize] = false;
+		batchSize++;
+	}
+
+	LWLockRelease(&AsyncCommitShared->lock);
+
+	if (batchSize == 0)
+	{
+		return 0;
+	}
+
+	/* connection establishment reads the catalogs */
+	MemoryContext savedContext = CurrentMemoryContext;
+	StartTransactionCommand();
+
+	PG_TRY();
+	{
+		SendCommitPreparedBatch(batch, batchSize, committed, abandoned);
+
+		CommitTransactionCommand();
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(savedContext);
+		ErrorData *edata = CopyErrorData();
+		FlushErrorState();
+
+		AbortCurrentTransaction();
+
+		/* the whole batch is retried, committed entries are skipped then */
+		memset(committed, 0, sizeof(committed));
+		memset(abandoned, 0, sizeof(abandoned));
+
+		/* report the error without exiting the worker */
+		edata->elevel = LOG;
+		ThrowErrorData(edata);
+		FreeErrorData(edata);
+	}
+	PG_END_TRY();
+
+	MemoryContextSwitchTo(savedContext);
+
+	TimestampTz retryTime = TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
+														ASYNC_COMMIT_RETRY_INTERVAL_MS);
+
+	LWLockAcquire(&AsyncCommitShared->lock, LW_EXCLUSIVE);
+
+	for (int batchIndex = 0; batchIndex < batchSize; batchIndex++)
+	{
+		AsyncCommitEntry *entry = &AsyncCommitEntries[batchEntryIndexes[batchIndex]];
+
+		if (committed[batchIndex] || abandoned[batchIndex])
+		{
+			ReleaseAsyncCommitEntry(entry);
+		}
+		else
+		{
+			RetryAsyncCommitEntryLater(entry, retryTime);
+		}
+	}
+
+	LWLockRelease(&AsyncCommitShared->lock);
+
+	return batchSize;
+}
+
+
+/*
+ * SendCommitPreparedBatch sends COMMIT PREPARED for each entry of the batch
+ * over its own connection and sets committed[i] for the entries that were
+ * committed, or that 2PC recovery committed already. Entries of nodes that
+ * were removed or disabled are not committed, but abandoned[i] is set, such
+ * that they are left to 2PC recovery instead of being retried forever.
+ * Connection and command failures are logged.
+ */
+static void
+SendCommitPreparedBatch(AsyncCommitEntry *batch, int batchSize, bool *committed,
+						bool *abandoned)
+{
+	MultiConnection *connections[ASYNC_COMMIT_BATCH_SIZE];
+	bool commandSent[ASYNC_COMMIT_BATCH_SIZE];
+	List *connectionList = NIL;
+	List *sentConnectionList = NIL;
+
+	for (int batchIndex = 0; batchIndex < batchSize; batchIndex++)
+	{
+		AsyncCommitEntry *entry = &batch[batchIndex];
+		int connectionFlags = 0;
+
+		connections[batchIndex] = NULL;
+		commandSent[batchIndex] = false;
+
+		if (!AsyncCommitNodeActive(entry))
+		{
+			ereport(LOG, (errmsg("not committing prepared transaction %s on "
+								 "%s:%d since the node is not an active node "
+								 "anymore", entry->preparedName, entry->nodeName,
+								 entry->nodePort)));
+			abandoned[batchIndex] = true;
+			continue;
+		}
+
+		connections[batchIndex] =
+			StartNodeUserDatabaseConnection(connectionFlags, entry->nodeName,
+											entry->nodePort, entry->userName,
+											entry->databaseName);
+		connectionList = lappend(connectionList, connections[batchIndex]);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	for (int batchIndex = 0; batchIndex < batchSize; batchIndex++)
+	{
+		MultiConnection *connection = connections[batchIndex];
+		AsyncCommitEntry *entry = &batch[batchIndex];
+
+		if (connection == NULL)
+		{
+			continue;
+		}
+
+		StringInfo command = makeStringInfo();
+		appendStringInfo(command, "COMMIT PREPARED %s",
+						 quote_literal_cstr(entry->preparedName));
+
+		commandSent[batchIndex] = PQstatus(connection->pgConn) == CONNECTION_OK &&
+								  SendRemoteCommand(connection, command->data) != 0;
+		if (commandSent[batchIndex])
+		{
+			sentConnectionList = lappend(sentConnectionList, connection);
+		}
+		else
+		{
+			ReportConnectionError(connection, LOG);
+		}
+	}
+
+	bool raiseInterrupts = true;
+	WaitForAllConnections(sentConnectionList, raiseInterrupts);
+
+	for (int batchIndex = 0; batchIndex < batchSize; batchIndex++)
+	{
+		MultiConnection *connection = connections[batchIndex];
+		if (!commandSent[batchIndex])
+		{
+			continue;
+		}
+
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (CommitPreparedResponseOK(result))
+		{
+			committed[batchIndex] = true;
+		}
+		else
+		{
+			ReportResultError(connection, result, LOG);
+		}
+
+		PQclear(result);
+		ForgetResults(connection);
+	}
+}
+
+
+/*
+ * AsyncCommitNodeActive returns whether the node of the given entry is still
+ * an active node in the metadata.
+ */
+static bool
+AsyncCommitNodeActive(AsyncCommitEntry *entry)
+{
+	WorkerNode *workerNode = FindWorkerNode(entry->nodeName, entry->nodePort);
+
+	return workerNode != NULL && workerNode->isActive;
+}
+
+
+/*
+ * SameAsyncCommitConnection returns true if the given entries would be
+ * committed over the same cached connection.
+ */
+static bool
+SameAsyncCommitConnection(AsyncCommitEntry *entry, AsyncCommitEntry *otherEntry)
+{
+	return entry->nodePort == otherEntry->nodePort &&
+		   strncmp(entry->nodeName, otherEntry->nodeName, MAX_NODE_LENGTH) == 0 &&
+		   strncmp(entry->userName, otherEntry->userName, NAMEDATALEN) == 0 &&
+		   strncmp(entry->databaseName, otherEntry->databaseName, NAMEDATALEN) == 0;
+}
+
+
+/*
+ * CommitPreparedResponseOK returns true if COMMIT PREPARED succeeded, or if
+ * the prepared transaction is already gone because 2PC recovery committed it
+ * concurrently.
+ */
+static bool
+CommitPreparedResponseOK(PGresult *result)
+{
+	if (IsResponseOK(result))
+	{
+		return true;
+	}
+
+	char *sqlStateString = PQresultErrorField(result, PG_DIAG_SQLSTATE);
+	if (sqlStateString == NULL || strlen(sqlStateString) != 5)
+	{
+		return false;
+	}
+
+	int sqlState = MAKE_SQLSTATE(sqlStateString[0], sqlStateString[1],
+								 sqlStateString[2], sqlStateString[3],
+								 sqlStateString[4]);
+
+	return sqlState == ERRCODE_UNDEFINED_OBJECT;
+}
+
+
+/*
+ * ReleaseAsyncCommitEntry frees the given entry and wakes up its backend once
+ * all of its queued commits are done. The caller should hold the lock
+ * exclusively.
+ */
+static void
+ReleaseAsyncCommitEntry(AsyncCommitEntry *entry)
+{
+	AsyncCommitBackend *backend = &AsyncCommitBackends[entry->ownerProcNo];
+
+	if (entry->ownerPid != 0 && backend->pid == entry->ownerPid &&
+		backend->pendingCount > 0)
+	{
+		backend->pendingCount--;
+
+		if (backend->pendingCount == 0)
+		{
+			SetLatch(backend->latch);
+		}
+	}
+
+	entry->state = ASYNC_COMMIT_ENTRY_FREE;
+	entry->databaseId = InvalidOid;
+}
+
+
+/*
+ * RetryAsyncCommitEntryLater puts an entry that could not be committed back
+ * into the queue. Its backend keeps waiting, up to
+ * ASYNC_COMMIT_WAIT_TIMEOUT_MS, since the prepared transaction is only
+ * committed once the worker or 2PC recovery succeeded. The caller should
+ * hold the lock exclusively.
+ */
+static void
+RetryAsyncCommitEntryLater(AsyncCommitEntry *entry, TimestampTz retryTime)
+{
+	entry->state = ASYNC_COMMIT_ENTRY_PENDING;
+	entry->retryTime = retryTime;
+}
+
+
+/*
+ * AsyncCommitWorkerSigTermHandler sets a flag to request termination of the
+ * async commit worker.
+ */
+static void
+AsyncCommitWorkerSigTermHandler(SIGNAL_ARGS)
+{
+	int save_errno = errno;
+
+	got_SIGTERM = true;
+	if (MyProc != NULL)
+	{
+		SetLatch(&MyProc->procLatch);
+	}
+
+	errno = save_errno;
+}
+
+
+/*
+ * AsyncCommitWorkerSigHupHandler sets a flag to re-read the config file at
+ * the next convenient time.
+ */
+static void
+AsyncCommitWorkerSigHupHandler(SIGNAL_ARGS)
+{
+	int save_errno = errno;
+
+	got_SIGHUP = true;
+	if (MyProc != NULL)
+	{
+		SetLatch(&MyProc->procLatch);
+	}
+
+	errno = save_errno;
+}
@@ -16,6 +16,10 @@
 
 #include "access/hash.h"
 #include "nodes/pg_list.h"
+#include "portability/instr_time.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
 #include "utils/hsearch.h"
 #include "utils/timestamp.h"
 
@@ -28,6 +32,11 @@
 #include "distributed/log_utils.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/transaction_identifier.h"
+#include "distributed/tuplestore.h"
+
+
+/* number of recent deadlock detection passes for which we keep statistics */
+#define DEADLOCK_DETECTION_STATS_COUNT 128
 
 
 /* used only for finding the deadlock cycle path */
@@ -39,10 +48,70 @@ typedef struct QueuedTransactionNode
 } QueuedTransactionNode;
 
 
+/*
+ * DeadlockDetectionPassStats describes a single distributed deadlock
+ * detection pass, as shown in citus_stat_deadlock_detection.
+ */
+typedef struct DeadlockDetectionPassStats
+{
+	Oid databaseId;
+	TimestampTz startTime;
+	bool incremental;
+
+	/* number of nodes polled, and number of nodes that sent their full graph */
+	int nodeCount;
+	int fullGraphCount;
+
+	/* number of wait edges read from the nodes, and size of the wait graph */
+	int64 edgesReceived;
+	int64 edgeCount;
+
+	/* time spent on building the wait graph and on searching for cycles */
+	double gatherTimeMs;
+	double searchTimeMs;
+
+	bool searchSkipped;
+	bool deadlockFound;
+} DeadlockDetectionPassStats;
+
+
+/*
+ * DeadlockDetectionStatsSharedData keeps the statistics of the most recent
+ * deadlock detection passes in a ring buffer.
+ */
+typedef struct DeadlockDetectionStatsSharedData
+{
+	int trancheId;
+	char *lockTrancheName;
+	LWLock lock;
+
+	/* number of passes recorded so far, the next one goes to passCount % size */
+	uint64 passCount;
+
+	DeadlockDetectionPassStats passes[DEADLOCK_DETECTION_STATS_COUNT];
+} DeadlockDetectionStatsSharedData;
+
+
 /* GUC, determining whether debug messages for deadlock detection sent to LOG */
 bool LogDistributedDeadlockDetection = false;
 
+/* GUC, determining whether nodes only report changes to their wait graph */
+bool IncrementalDeadlockDetection = false;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static DeadlockDetectionStatsSharedData *DeadlockDetectionStats = NULL;
+
+/*
+ * Whether the last check in this process found a cycle in the wait graph.
+ * When it did not, and no wait edges were added since, there cannot be a
+ * new cycle and the incremental mode skips the search.
+ */
+static bool CycleFoundInLastCheck = false;
+
 
+static bool CheckForDeadlocksInWaitGraph(WaitGraph *waitGraph, bool *cycleFound);
+static void DeadlockDetectionStatsShmemInit(void);
+static void RecordDeadlockDetectionPass(DeadlockDetectionPassStats *passStats);
 static bool CheckDeadlockForTransactionNode(TransactionNode *startingTransactionNode,
 											int maxStackDepth,
 											List **deadlockPath);
@@ -65,6 +134,7 @@ static void LogTransactionNode(TransactionNode *transactionNode);
 static void LogDistributedDeadlockDebugMessage(const char *errorMessage);
 
 PG_FUNCTION_INFO_V1(check_distributed_deadlocks);
+PG_FUNCTION_INFO_V1(citus_stat_deadlock_detection);
 
 
 /*
@@ -98,16 +168,22 @@ check_distributed_deadlocks(PG_FUNCTION_ARGS)
  * transaction that's checked for deadlocks. Note that there exists
  *  0 to MaxBackends number of transactions.
  *
+ * When citus.incremental_deadlock_detection is enabled, the nodes only
+ * report the changes to their wait graphs since the previous check, and
+ * the search is skipped if no wait edges were added and the previous check
+ * found no cycle.
+ *
  * The function returns true if a deadlock is found. Otherwise, returns
  * false.
  */
 bool
 CheckForDistributedDeadlocks(void)
 {
-	HASH_SEQ_STATUS status;
-	TransactionNode *transactionNode = NULL;
-	int32 localGroupId = GetLocalGroupId();
 	List *workerNodeList = ActiveReadableNodeList();
+	DeadlockDetectionPassStats passStats;
+	instr_time startTime;
+	instr_time gatherEndTime;
+	instr_time searchEndTime;
 
 	/*
 	 * We don't need to do any distributed deadlock checking if there
@@ -120,13 +196,83 @@ CheckForDistributedDeadlocks(void)
 		return false;
 	}
 
-	/* distributed deadlock detection only considers distributed txs */
-	bool onlyDistributedTx = true;
-	WaitGraph *waitGraph = BuildGlobalWaitGraph(onlyDistributedTx);
+	memset(&passStats, 0, sizeof(passStats));
+	passStats.databaseId = MyDatabaseId;
+	passStats.startTime = GetCurrentTimestamp();
+	passStats.incremental = IncrementalDeadlockDetection;
+
+	INSTR_TIME_SET_CURRENT(startTime);
+
+	WaitGraph *waitGraph = NULL;
+	bool deadlockFound = false;
+
+	if (IncrementalDeadlockDetection)
+	{
+		WaitGraphPollStats pollStats;
+
+		waitGraph = BuildIncrementalGlobalWaitGraph(&pollStats);
+
+		passStats.nodeCount = pollStats.nodeCount;
+		passStats.fullGraphCount = pollStats.fullGraphCount;
+		passStats.edgesReceived = pollStats.edgesReceived;
+
+		/* a new cycle requires a new edge */
+		passStats.searchSkipped = pollStats.edgesAdded == 0 && !CycleFoundInLastCheck;
+	}
+	else
+	{
+		/* distributed deadlock detection only considers distributed txs */
+		bool onlyDistributedTx = true;
+		waitGraph = BuildGlobalWaitGraph(onlyDistributedTx);
+
+		passStats.nodeCount = list_length(workerNodeList);
+		passStats.fullGraphCount = passStats.nodeCount;
+		passStats.edgesReceived = waitGraph->edgeCount;
+	}
+
+	passStats.edgeCount = waitGraph->edgeCount;
+
+	INSTR_TIME_SET_CURRENT(gatherEndTime);
+
+	if (!passStats.searchSkipped)
+	{
+		deadlockFound = CheckForDeadlocksInWaitGraph(waitGraph, &CycleFoundInLastCheck);
+	}
+
+	INSTR_TIME_SET_CURRENT(searchEndTime);
+
+	INSTR_TIME_SUBTRACT(searchEndTime, gatherEndTime);
+	INSTR_TIME_SUBTRACT(gatherEndTime, startTime);
+
+	passStats.gatherTimeMs = INSTR_TIME_GET_MILLISEC(gatherEndTime);
+	passStats.searchTimeMs = INSTR_TIME_GET_MILLISEC(searchEndTime);
+	passStats.deadlockFound = deadlockFound;
+
+	RecordDeadlockDetectionPass(&passStats);
+
+	return deadlockFound;
+}
+
+
+/*
+ * CheckForDeadlocksInWaitGraph searches for cycles in the wait graph that
+ * start from transactions of this node, and cancels the youngest participant
+ * of the first cycle that has a backend on this node. It returns whether a
+ * backend was cancelled, and sets cycleFound to whether any cycle was found.
+ */
+static bool
+CheckForDeadlocksInWaitGraph(WaitGraph *waitGraph, bool *cycleFound)
+{
+	HASH_SEQ_STATUS status;
+	TransactionNode *transactionNode = NULL;
+	int32 localGroupId = GetLocalGroupId();
+
 	HTAB *adjacencyLists = BuildAdjacencyListsForWaitGraph(waitGraph);
 
 	int edgeCount = waitGraph->edgeCount;
 
+	*cycleFound = false;
+
 	/*
 	 * We iterate on transaction nodes and search for deadlocks where the
 	 * starting node is the given transaction node.
@@ -157,6 +303,8 @@ CheckForDistributedDeadlocks(void)
 		{
 			TransactionNode *youngestAliveTransaction = NULL;
 
+			*cycleFound = true;
+
 			/*
 			 * There should generally be at least two transactions to get into a
 			 * deadlock. However, in case Citus gets into a self-deadlock, we may
@@ -685,3 +833,142 @@ WaitsForToString(List *waitsFor)
 
 	return transactionIdStr->data;
 }
+
+
+/*
+ * InitializeDeadlockDetectionStats sets up the shared memory startup hook of
+ * the deadlock detection statistics.
+ */
+void
+InitializeDeadlockDetectionStats(void)
+{
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = DeadlockDetectionStatsShmemInit;
+}
+
+
+/*
+ * DeadlockDetectionStatsShmemSize returns the size that should be allocated
+ * on the shared memory for the deadlock detection statistics.
+ */
+size_t
+DeadlockDetectionStatsShmemSize(void)
+{
+	return sizeof(DeadlockDetectionStatsSharedData);
+}
+
+
+/*
+ * DeadlockDetectionStatsShmemInit initializes the shared memory in which
+ * the statistics of the recent deadlock detection passes are kept.
+ */
+static void
+DeadlockDetectionStatsShmemInit(void)
+{
+	bool alreadyInitialized = false;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	DeadlockDetectionStats =
+		(DeadlockDetectionStatsSharedData *) ShmemInitStruct(
+			"Deadlock Detection Stats",
+			DeadlockDetectionStatsShmemSize(),
+			&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		memset(DeadlockDetectionStats, 0, DeadlockDetectionStatsShmemSize());
+
+		DeadlockDetectionStats->trancheId = LWLockNewTrancheId();
+		DeadlockDetectionStats->lockTrancheName = "Deadlock Detection Stats Tranche";
+		LWLockRegisterTranche(DeadlockDetectionStats->trancheId,
+							  DeadlockDetectionStats->lockTrancheName);
+		LWLockInitialize(&DeadlockDetectionStats->lock,
+						 DeadlockDetectionStats->trancheId);
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * RecordDeadlockDetectionPass stores the statistics of a deadlock detection
+ * pass in the ring buffer, overwriting the oldest pass.
+ */
+static void
+RecordDeadlockDetectionPass(DeadlockDetectionPassStats *passStats)
+{
+	LWLockAcquire(&DeadlockDetectionStats->lock, LW_EXCLUSIVE);
+
+	int passIndex = DeadlockDetectionStats->passCount % DEADLOCK_DETECTION_STATS_COUNT;
+	DeadlockDetectionStats->passes[passIndex] = *passStats;
+	DeadlockDetectionStats->passCount++;
+
+	LWLockRelease(&DeadlockDetectionStats->lock);
+}
+
+
+/*
+ * citus_stat_deadlock_detection returns the statistics of the most recent
+ * distributed deadlock detection passes on this node, oldest first.
+ */
+Datum
+citus_stat_deadlock_detection(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDesc;
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDesc);
+
+	DeadlockDetectionPassStats *passStatsArray =
+		palloc0(DEADLOCK_DETECTION_STATS_COUNT * sizeof(DeadlockDetectionPassStats));
+	int passStatsCount = 0;
+
+	/* copy the passes, such that we do not hold the lock while building tuples */
+	LWLockAcquire(&DeadlockDetectionStats->lock, LW_SHARED);
+
+	uint64 passCount = DeadlockDetectionStats->passCount;
+	uint64 firstPass = 0;
+
+	if (passCount > DEADLOCK_DETECTION_STATS_COUNT)
+	{
+		firstPass = passCount - DEADLOCK_DETECTION_STATS_COUNT;
+	}
+
+	for (uint64 passNumber = firstPass; passNumber < passCount; passNumber++)
+	{
+		passStatsArray[passStatsCount++] =
+			DeadlockDetectionStats->passes[passNumber % DEADLOCK_DETECTION_STATS_COUNT];
+	}
+
+	LWLockRelease(&DeadlockDetectionStats->lock);
+
+	for (int passIndex = 0; passIndex < passStatsCount; passIndex++)
+	{
+		DeadlockDetectionPassStats *passStats = &passStatsArray[passIndex];
+		Datum values[11];
+		bool isNulls[11];
+
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = ObjectIdGetDatum(passStats->databaseId);
+		values[1] = TimestampTzGetDatum(passStats->startTime);
+		values[2] = BoolGetDatum(passStats->incremental);
+		values[3] = Int32GetDatum(passStats->nodeCount);
+		values[4] = Int32GetDatum(passStats->fullGraphCount);
+		values[5] = Int64GetDatum(passStats->edgesReceived);
+		values[6] = Int64GetDatum(passStats->edgeCount);
+		values[7] = Float8GetDatum(passStats->gatherTimeMs);
+		values[8] = Float8GetDatum(passStats->searchTimeMs);
+		values[9] = BoolGetDatum(passStats->searchSkipped);
+		values[10] = BoolGetDatum(passStats->deadlockFound);
+
+		tuplestore_putvalues(tupleStore, tupleDesc, values, isNulls);
+	}
+
+	PG_RETURN_VOID();
+}
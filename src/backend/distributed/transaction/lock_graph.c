@@ -18,14 +18,19 @@
 #include "miscadmin.h"
 
 #include "access/hash.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
 #include "storage/proc.h"
+#include "storage/shmem.h"
 #include "utils/builtins.h"
 #include "utils/hsearch.h"
+#include "utils/memutils.h"
 #include "utils/timestamp.h"
 
 #include "pg_version_compat.h"
 
 #include "distributed/backend_data.h"
+#include "distributed/citus_safe_lib.h"
 #include "distributed/connection_management.h"
 #include "distributed/hash_helpers.h"
 #include "distributed/listutils.h"
@@ -35,6 +40,18 @@
 #include "distributed/tuplestore.h"
 
 
+/* number of wait edges per chunk of the shared wait graph snapshot edges */
+#define WAIT_GRAPH_SNAPSHOT_CHUNK_SIZE 64
+
+/* number of fields that identify a wait edge, see WaitEdgeKeyFields */
+#define WAIT_EDGE_KEY_FIELD_COUNT 9
+
+/* change types returned by citus_internal.local_wait_edge_changes */
+#define WAIT_EDGE_CHANGE_FULL_GRAPH 'f'
+#define WAIT_EDGE_CHANGE_ADDED 'a'
+#define WAIT_EDGE_CHANGE_REMOVED 'r'
+
+
 /*
  * PROCStack is a stack of PGPROC pointers used to perform a depth-first search
  * through the lock graph. It also keeps track of which processes have been
@@ -48,8 +65,122 @@ typedef struct PROCStack
 } PROCStack;
 
 
+/*
+ * WaitGraphSnapshot is the local wait graph that a node last polled through
+ * citus_internal.local_wait_edge_changes. Its edges are stored sorted in a
+ * list of chunks of the shared edge array, such that a large wait graph can
+ * use the space of several snapshots.
+ */
+typedef struct WaitGraphSnapshot
+{
+	/* node and database that polled the wait graph, InvalidOid if unused */
+	int32 requesterNodeId;
+	Oid databaseId;
+
+	/* version that the node passes to get the changes since the snapshot */
+	uint64 version;
+	TimestampTz lastPollTime;
+
+	/* number of edges, and the first chunk that holds them or -1 */
+	int edgeCount;
+	int firstChunk;
+} WaitGraphSnapshot;
+
+
+/*
+ * WaitGraphSnapshotSharedData is the header of the shared memory for the
+ * wait graph snapshots, which is followed by the citus.max_wait_graph_snapshots
+ * snapshots, the next chunk of every chunk and the edges of the chunks.
+ */
+typedef struct WaitGraphSnapshotSharedData
+{
+	int trancheId;
+	char *lockTrancheName;
+	LWLock lock;
+
+	/* total number of chunks, and the list of chunks that no snapshot uses */
+	int chunkCount;
+	int freeChunk;
+	int freeChunkCount;
+} WaitGraphSnapshotSharedData;
+
+
+/*
+ * WaitGraphNodeState is the part of the global wait graph that a node
+ * reported, which we keep across calls to BuildIncrementalGlobalWaitGraph.
+ */
+typedef struct WaitGraphNodeState
+{
+	/* hash key, group ID of the node */
+	int32 groupId;
+
+	/* version of the node's snapshot that matches edges, 0 if unknown */
+	uint64 version;
+
+	/* set of WaitEdge's that the node reported */
+	HTAB *edges;
+
+	/* whether the node is polled in the current call, and over which connection */
+	bool polled;
+	MultiConnection *connection;
+} WaitGraphNodeState;
+
+
+/* GUC, number of polling nodes and databases for which we keep the wait graph */
+int MaxWaitGraphSnapshots = 0;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static WaitGraphSnapshotSharedData *WaitGraphSnapshotShared = NULL;
+static WaitGraphSnapshot *WaitGraphSnapshots = NULL;
+static int *WaitGraphSnapshotNextChunk = NULL;
+static WaitEdge *WaitGraphSnapshotEdges = NULL;
+
+/* wait graph that the nodes reported to the current process */
+static MemoryContext WaitGraphNodeStateContext = NULL;
+static HTAB *WaitGraphNodeStates = NULL;
+static uint32 WaitGraphPollCount = 0;
+
+
 static void AddWaitEdgeFromResult(WaitGraph *waitGraph, PGresult *result, int rowIndex);
+static void ParseWaitEdge(WaitEdge *waitEdge, PGresult *result, int rowIndex,
+						  int firstColumn);
 static void ReturnWaitGraph(WaitGraph *waitGraph, FunctionCallInfo fcinfo);
+static void FillWaitEdgeValues(WaitEdge *waitEdge, Datum *values, bool *nulls);
+static void ReturnWaitGraphChanges(WaitGraphChanges *changes, FunctionCallInfo fcinfo);
+static void PutWaitEdgeChangeTuples(Tuplestorestate *tupleStore, TupleDesc tupleDesc,
+									WaitGraph *waitGraph, char changeType);
+static void WaitGraphSnapshotShmemInit(void);
+static int WaitGraphSnapshotChunkCount(void);
+static WaitGraphSnapshot * GetWaitGraphSnapshot(int32 requesterNodeId, Oid databaseId);
+static WaitEdge * ReadWaitGraphSnapshotEdges(WaitGraphSnapshot *snapshot);
+static bool StoreWaitGraphSnapshotEdges(WaitGraphSnapshot *snapshot,
+										WaitGraph *waitGraph);
+static void FreeWaitGraphSnapshotEdges(WaitGraphSnapshot *snapshot);
+												WaitEdge **snapshotEdges);
+static void SortWaitGraphEdges(WaitGraph *waitGraph);
+static void WaitEdgeKeyFields(const WaitEdge *waitEdge, int64 *fields);
+static int CompareWaitEdges(const void *leftElement, const void *rightElement);
+static uint32 WaitEdgeHash(const void *key, Size keysize);
+static int WaitEdgeMatch(const void *leftKey, const void *rightKey, Size keysize);
+static WaitGraphNodeState * GetWaitGraphNodeState(int32 groupId);
+static HTAB * CreateWaitEdgeSet(void);
+static void ClearWaitGraphNodeState(WaitGraphNodeState *nodeState);
+static void AddWaitEdgeToNodeState(WaitGraphNodeState *nodeState, WaitEdge *waitEdge,
+								   WaitGraphPollStats *pollStats);
+static void RemoveWaitEdgeFromNodeState(WaitGraphNodeState *nodeState,
+										WaitEdge *waitEdge,
+										WaitGraphPollStats *pollStats);
+static void ApplyWaitGraphChanges(WaitGraphNodeState *nodeState,
+								  WaitGraphChanges *changes,
+								  WaitGraphPollStats *pollStats);
+static void ApplyWaitGraphChangesFromResult(WaitGraphNodeState *nodeState,
+											PGresult *result,
+											WaitGraphPollStats *pollStats);
+static void AddFullWaitGraphsFromNodes(List *nodeStateList,
+									   WaitGraphPollStats *pollStats);
+static void RemoveUnpolledWaitGraphNodeStates(void);
+static WaitGraph * WaitGraphFromNodeStates(void);
+static WaitGraph * CreateWaitGraph(int allocatedSize);
 static void AddWaitEdgeFromBlockedProcessResult(WaitGraph *waitGraph, PGresult *result,
 												int rowIndex);
 static void ReturnBlockedProcessGraph(WaitGraph *waitGraph, FunctionCallInfo fcinfo);
@@ -92,6 +223,8 @@ PG_FUNCTION_INFO_V1(dump_global_wait_edges);
 PG_FUNCTION_INFO_V1(citus_internal_local_blocked_processes);
 PG_FUNCTION_INFO_V1(citus_internal_global_blocked_processes);
 
+PG_FUNCTION_INFO_V1(citus_internal_local_wait_edge_changes);
+
 
 /*
  * dump_global_wait_edges returns global wait edges for distributed transactions
@@ -253,268 +386,1217 @@ BuildGlobalWaitGraph(bool onlyDistributedTx)
 
 
 /*
- * AddWaitEdgeFromResult adds an edge to the wait graph that is read from
- * a PGresult.
+ * BuildIncrementalGlobalWaitGraph returns the same wait graph as
+ * BuildGlobalWaitGraph for distributed transactions, but only reads the
+ * changes to the local wait graphs of the nodes since the previous call.
+ *
+ * The edges that each node reported are kept in the memory of the current
+ * process, and each node keeps the local wait graph that it last reported
+ * to us in shared memory, identified by a version. When the versions do not
+ * match, for instance because another process of this node polled the node
+ * in the meantime, the node reports its full local wait graph again.
+ *
+ * pollStats is filled with the amount of work done, where the edgesAdded
+ * field tells whether the graph might contain new cycles.
+ */
+WaitGraph *
+BuildIncrementalGlobalWaitGraph(WaitGraphPollStats *pollStats)
+{
+	List *workerNodeList = ActiveReadableNodeList();
+	char *nodeUser = CitusExtensionOwnerName();
+	List *connectionList = NIL;
+	List *nodeStateList = NIL;
+	List *fallbackNodeStateList = NIL;
+	int32 localGroupId = GetLocalGroupId();
+	HASH_SEQ_STATUS status;
+
+	memset(pollStats, 0, sizeof(WaitGraphPollStats));
+
+	if (WaitGraphNodeStates == NULL)
+	{
+		WaitGraphNodeStateContext = AllocSetContextCreate(TopMemoryContext,
+														  "Wait Graph Node States",
+														  ALLOCSET_DEFAULT_SIZES);
+
+		HASHCTL info;
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(int32);
+		info.entrysize = sizeof(WaitGraphNodeState);
+		info.hcxt = WaitGraphNodeStateContext;
+		int hashFlags = (HASH_ELEM | HASH_CONTEXT | HASH_BLOBS);
+
+		WaitGraphNodeStates = hash_create("wait graph node states", 32, &info,
+										  hashFlags);
+	}
+
+	WaitGraphNodeState *nodeState = NULL;
+	hash_seq_init(&status, WaitGraphNodeStates);
+	while ((nodeState = hash_seq_search(&status)) != NULL)
+	{
+		nodeState->polled = false;
+		nodeState->connection = NULL;
+	}
+
+	/* versions are unique per process, such that other pollers invalidate ours */
+	uint64 newVersion = ((uint64) MyProcPid << 32) | ++WaitGraphPollCount;
+
+	/* we read the local changes without a round trip */
+	WaitGraphNodeState *localNodeState = GetWaitGraphNodeState(localGroupId);
+	WaitGraphChanges *localChanges = LocalWaitGraphChanges(localGroupId,
+														   localNodeState->version,
+														   newVersion);
+
+	ApplyWaitGraphChanges(localNodeState, localChanges, pollStats);
+	localNodeState->version = newVersion;
+	localNodeState->polled = true;
+	pollStats->nodeCount++;
+
+	/* open connections in parallel */
+	WorkerNode *workerNode = NULL;
+	foreach_declared_ptr(workerNode, workerNodeList)
+	{
+		const char *nodeName = workerNode->workerName;
+		int nodePort = workerNode->workerPort;
+		int connectionFlags = 0;
+
+		if (workerNode->groupId == localGroupId)
+		{
+			/* we already have local wait edges */
+			continue;
+		}
+
+		MultiConnection *connection = StartNodeUserDatabaseConnection(connectionFlags,
+																	  nodeName, nodePort,
+																	  nodeUser, NULL);
+
+		nodeState = GetWaitGraphNodeState(workerNode->groupId);
+		nodeState->polled = true;
+		nodeState->connection = connection;
+
+		connectionList = lappend(connectionList, connection);
+		nodeStateList = lappend(nodeStateList, nodeState);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	/* send commands in parallel */
+	foreach_declared_ptr(nodeState, nodeStateList)
+	{
+		StringInfo queryString = makeStringInfo();
+
+		appendStringInfo(queryString,
+						 "SELECT change_type, waiting_pid, waiting_node_id, "
+						 "waiting_transaction_num, waiting_transaction_stamp, "
+						 "blocking_pid, blocking_node_id, blocking_transaction_num, "
+						 "blocking_transaction_stamp, blocking_transaction_waiting "
+						 "FROM citus_internal.local_wait_edge_changes(%d, "
+						 INT64_FORMAT ", " INT64_FORMAT ")",
+						 localGroupId, (int64) nodeState->version, (int64) newVersion);
+
+		int querySent = SendRemoteCommand(nodeState->connection, queryString->data);
+		if (querySent == 0)
+		{
+			ReportConnectionError(nodeState->connection, WARNING);
+
+			/* we no longer know the wait edges of the node */
+			ClearWaitGraphNodeState(nodeState);
+			nodeState->connection = NULL;
+		}
+	}
+
+	/* receive citus_internal.local_wait_edge_changes results */
+	foreach_declared_ptr(nodeState, nodeStateList)
+	{
+		MultiConnection *connection = nodeState->connection;
+		bool raiseInterrupts = true;
+
+		if (connection == NULL)
+		{
+			continue;
+		}
+
+		pollStats->nodeCount++;
+
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (!IsResponseOK(result) || PQnfields(result) != 10)
+		{
+			/* nodes that run an older version only report their full wait graph */
+			ereport(DEBUG1, (errmsg("could not read the wait graph changes of "
+									"%s:%d, reading the full wait graph",
+									connection->hostname, connection->port)));
+
+			ClearWaitGraphNodeState(nodeState);
+			fallbackNodeStateList = lappend(fallbackNodeStateList, nodeState);
+
+			PQclear(result);
+			ForgetResults(connection);
+			continue;
+		}
+
+		ApplyWaitGraphChangesFromResult(nodeState, result, pollStats);
+		nodeState->version = newVersion;
+
+		PQclear(result);
+		ForgetResults(connection);
+	}
+
+	AddFullWaitGraphsFromNodes(fallbackNodeStateList, pollStats);
+
+	RemoveUnpolledWaitGraphNodeStates();
+
+	return WaitGraphFromNodeStates();
+}
+
+
+/*
+ * AddFullWaitGraphsFromNodes reads the wait graph of the given nodes through
+ * dump_local_wait_edges, which all versions of Citus provide.
  */
 static void
-AddWaitEdgeFromResult(WaitGraph *waitGraph, PGresult *result, int rowIndex)
+AddFullWaitGraphsFromNodes(List *nodeStateList, WaitGraphPollStats *pollStats)
 {
-	WaitEdge *waitEdge = AllocWaitEdge(waitGraph);
+	const char *queryString =
+		"SELECT waiting_pid, waiting_node_id, "
+		"waiting_transaction_num, waiting_transaction_stamp, "
+		"blocking_pid, blocking_node_id, blocking_transaction_num, "
+		"blocking_transaction_stamp, blocking_transaction_waiting "
+		"FROM dump_local_wait_edges()";
 
-	waitEdge->waitingGPid = 0; /* not requested for deadlock detection */
-	waitEdge->waitingPid = ParseIntField(result, rowIndex, 0);
-	waitEdge->waitingNodeId = ParseIntField(result, rowIndex, 1);
-	waitEdge->waitingTransactionNum = ParseIntField(result, rowIndex, 2);
-	waitEdge->waitingTransactionStamp = ParseTimestampTzField(result, rowIndex, 3);
-	waitEdge->blockingGPid = 0; /* not requested for deadlock detection */
-	waitEdge->blockingPid = ParseIntField(result, rowIndex, 4);
-	waitEdge->blockingNodeId = ParseIntField(result, rowIndex, 5);
-	waitEdge->blockingTransactionNum = ParseIntField(result, rowIndex, 6);
-	waitEdge->blockingTransactionStamp = ParseTimestampTzField(result, rowIndex, 7);
-	waitEdge->isBlockingXactWaiting = ParseBoolField(result, rowIndex, 8);
+	/* send commands in parallel */
+	WaitGraphNodeState *nodeState = NULL;
+	foreach_declared_ptr(nodeState, nodeStateList)
+	{
+		int querySent = SendRemoteCommand(nodeState->connection, queryString);
+		if (querySent == 0)
+		{
+			ReportConnectionError(nodeState->connection, WARNING);
+			nodeState->connection = NULL;
+		}
+	}
+
+	/* receive dump_local_wait_edges results */
+	foreach_declared_ptr(nodeState, nodeStateList)
+	{
+		MultiConnection *connection = nodeState->connection;
+		bool raiseInterrupts = true;
+
+		if (connection == NULL)
+		{
+			continue;
+		}
+
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (!IsResponseOK(result))
+		{
+			ReportResultError(connection, result, WARNING);
+			continue;
+		}
+
+		if (PQnfields(result) != 9)
+		{
+			ereport(WARNING, (errmsg("unexpected number of columns from "
+									 "dump_local_wait_edges")));
+			PQclear(result);
+			ForgetResults(connection);
+			continue;
+		}
+
+		int64 rowCount = PQntuples(result);
+		for (int64 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		{
+			WaitEdge waitEdge;
+
+			ParseWaitEdge(&waitEdge, result, rowIndex, 0);
+			AddWaitEdgeToNodeState(nodeState, &waitEdge, pollStats);
+		}
+
+		pollStats->fullGraphCount++;
+
+		PQclear(result);
+		ForgetResults(connection);
+	}
 }
 
 
 /*
- * AddWaitEdgeFromBlockedProcessResult adds an edge to the wait graph that
- * is read from a PGresult.
+ * ApplyWaitGraphChangesFromResult applies the wait graph changes that a node
+ * returned from citus_internal.local_wait_edge_changes to its state.
  */
 static void
-AddWaitEdgeFromBlockedProcessResult(WaitGraph *waitGraph, PGresult *result, int rowIndex)
+ApplyWaitGraphChangesFromResult(WaitGraphNodeState *nodeState, PGresult *result,
+								WaitGraphPollStats *pollStats)
 {
-	WaitEdge *waitEdge = AllocWaitEdge(waitGraph);
+	int64 rowCount = PQntuples(result);
 
-	waitEdge->waitingGPid = ParseIntField(result, rowIndex, 0);
-	waitEdge->waitingPid = ParseIntField(result, rowIndex, 1);
-	waitEdge->waitingNodeId = ParseIntField(result, rowIndex, 2);
-	waitEdge->waitingTransactionNum = ParseIntField(result, rowIndex, 3);
-	waitEdge->waitingTransactionStamp = ParseTimestampTzField(result, rowIndex, 4);
-	waitEdge->blockingGPid = ParseIntField(result, rowIndex, 5);
-	waitEdge->blockingPid = ParseIntField(result, rowIndex, 6);
-	waitEdge->blockingNodeId = ParseIntField(result, rowIndex, 7);
-	waitEdge->blockingTransactionNum = ParseIntField(result, rowIndex, 8);
-	waitEdge->blockingTransactionStamp = ParseTimestampTzField(result, rowIndex, 9);
-	waitEdge->isBlockingXactWaiting = ParseBoolField(result, rowIndex, 10);
+	for (int64 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		char changeType = PQgetvalue(result, rowIndex, 0)[0];
+		WaitEdge waitEdge;
+
+		if (changeType == WAIT_EDGE_CHANGE_FULL_GRAPH)
+		{
+			/* the node does not know which edges we have, start over */
+			ClearWaitGraphNodeState(nodeState);
+			pollStats->fullGraphCount++;
+			continue;
+		}
+
+		ParseWaitEdge(&waitEdge, result, rowIndex, 1);
+
+		if (changeType == WAIT_EDGE_CHANGE_REMOVED)
+		{
+			RemoveWaitEdgeFromNodeState(nodeState, &waitEdge, pollStats);
+		}
+		else
+		{
+			AddWaitEdgeToNodeState(nodeState, &waitEdge, pollStats);
+		}
+	}
 }
 
 
 /*
- * ParseIntField parses a int64 from a remote result or returns 0 if the
- * result is NULL.
+ * ApplyWaitGraphChanges applies the changes to the local wait graph to the
+ * state of the local node.
  */
-int64
-ParseIntField(PGresult *result, int rowIndex, int colIndex)
+static void
+ApplyWaitGraphChanges(WaitGraphNodeState *nodeState, WaitGraphChanges *changes,
+					  WaitGraphPollStats *pollStats)
 {
-	if (PQgetisnull(result, rowIndex, colIndex))
+	if (changes->isFullGraph)
+	{
+		ClearWaitGraphNodeState(nodeState);
+		pollStats->fullGraphCount++;
+	}
+
+	for (int edgeIndex = 0; edgeIndex < changes->removedEdges->edgeCount; edgeIndex++)
+	{
+		RemoveWaitEdgeFromNodeState(nodeState, &changes->removedEdges->edges[edgeIndex],
+									pollStats);
+	}
+
+	for (int edgeIndex = 0; edgeIndex < changes->addedEdges->edgeCount; edgeIndex++)
+	{
+		AddWaitEdgeToNodeState(nodeState, &changes->addedEdges->edges[edgeIndex],
+							   pollStats);
+	}
+}
+
+
+/*
+ * GetWaitGraphNodeState returns the wait graph state of the node with the
+ * given group ID, and creates an empty one if it does not exist yet.
+ */
+static WaitGraphNodeState *
+GetWaitGraphNodeState(int32 groupId)
+{
+	bool found = false;
+
+	WaitGraphNodeState *nodeState = hash_search(WaitGraphNodeStates, &groupId,
+												HASH_ENTER, &found);
+	if (!found)
+	{
+		nodeState->version = 0;
+		nodeState->edges = CreateWaitEdgeSet();
+		nodeState->polled = false;
+		nodeState->connection = NULL;
+	}
+
+	return nodeState;
+}
+
+
+/*
+ * CreateWaitEdgeSet creates a hash set of WaitEdge's in the memory context
+ * of the wait graph node states.
+ */
+static HTAB *
+CreateWaitEdgeSet(void)
+{
+	HASHCTL info;
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(WaitEdge);
+	info.entrysize = sizeof(WaitEdge);
+	info.hash = WaitEdgeHash;
+	info.match = WaitEdgeMatch;
+	info.hcxt = WaitGraphNodeStateContext;
+	int hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_CONTEXT);
+
+	return hash_create("wait edge set", 64, &info, hashFlags);
+}
+
+
+/*
+ * ClearWaitGraphNodeState forgets the wait edges that a node reported, such
+ * that the node reports its full wait graph on the next call.
+ */
+static void
+ClearWaitGraphNodeState(WaitGraphNodeState *nodeState)
+{
+	if (hash_get_num_entries(nodeState->edges) > 0)
+	{
+		hash_destroy(nodeState->edges);
+		nodeState->edges = CreateWaitEdgeSet();
+	}
+
+	nodeState->version = 0;
+}
+
+
+/*
+ * AddWaitEdgeToNodeState adds a wait edge to the edges that a node reported.
+ */
+static void
+AddWaitEdgeToNodeState(WaitGraphNodeState *nodeState, WaitEdge *waitEdge,
+					   WaitGraphPollStats *pollStats)
+{
+	bool found = false;
+
+	hash_search(nodeState->edges, waitEdge, HASH_ENTER, &found);
+
+	pollStats->edgesReceived++;
+
+	if (!found)
+	{
+		pollStats->edgesAdded++;
+	}
+}
+
+
+/*
+ * RemoveWaitEdgeFromNodeState removes a wait edge from the edges that a node
+ * reported.
+ */
+static void
+RemoveWaitEdgeFromNodeState(WaitGraphNodeState *nodeState, WaitEdge *waitEdge,
+							WaitGraphPollStats *pollStats)
+{
+	hash_search(nodeState->edges, waitEdge, HASH_REMOVE, NULL);
+
+	pollStats->edgesReceived++;
+}
+
+
+/*
+ * RemoveUnpolledWaitGraphNodeStates removes the states of the nodes that were
+ * not polled in the current call, since they are no longer active.
+ */
+static void
+RemoveUnpolledWaitGraphNodeStates(void)
+{
+	HASH_SEQ_STATUS status;
+	WaitGraphNodeState *nodeState = NULL;
+
+	hash_seq_init(&status, WaitGraphNodeStates);
+	while ((nodeState = hash_seq_search(&status)) != NULL)
+	{
+		if (!nodeState->polled)
+		{
+			hash_destroy(nodeState->edges);
+			hash_search(WaitGraphNodeStates, &nodeState->groupId, HASH_REMOVE, NULL);
+		}
+	}
+}
+
+
+/*
+ * WaitGraphFromNodeStates returns a wait graph that contains the edges that
+ * all nodes reported.
+ */
+static WaitGraph *
+WaitGraphFromNodeStates(void)
+{
+	HASH_SEQ_STATUS status;
+	WaitGraphNodeState *nodeState = NULL;
+	int edgeCount = 0;
+
+	hash_seq_init(&status, WaitGraphNodeStates);
+	while ((nodeState = hash_seq_search(&status)) != NULL)
+	{
+		edgeCount += hash_get_num_entries(nodeState->edges);
+	}
+
+	WaitGraph *waitGraph = CreateWaitGraph(edgeCount);
+
+	hash_seq_init(&status, WaitGraphNodeStates);
+	while ((nodeState = hash_seq_search(&status)) != NULL)
+	{
+		HASH_SEQ_STATUS edgeStatus;
+		WaitEdge *waitEdge = NULL;
+
+		hash_seq_init(&edgeStatus, nodeState->edges);
+		while ((waitEdge = hash_seq_search(&edgeStatus)) != NULL)
+		{
+			*AllocWaitEdge(waitGraph) = *waitEdge;
+		}
+	}
+
+	return waitGraph;
+}
+
+
+/*
+ * AddWaitEdgeFromResult adds an edge to the wait graph that is read from
+ * a PGresult.
+ */
+static void
+AddWaitEdgeFromResult(WaitGraph *waitGraph, PGresult *result, int rowIndex)
+{
+	WaitEdge *waitEdge = AllocWaitEdge(waitGraph);
+
+	ParseWaitEdge(waitEdge, result, rowIndex, 0);
+}
+
+
+/*
+ * ParseWaitEdge reads a wait edge in the format of dump_local_wait_edges
+ * from a PGresult, starting at the given column.
+ */
+static void
+ParseWaitEdge(WaitEdge *waitEdge, PGresult *result, int rowIndex, int firstColumn)
+{
+	memset(waitEdge, 0, sizeof(WaitEdge));
+
+	waitEdge->waitingGPid = 0; /* not requested for deadlock detection */
+	waitEdge->waitingPid = ParseIntField(result, rowIndex, firstColumn);
+	waitEdge->waitingNodeId = ParseIntField(result, rowIndex, firstColumn + 1);
+	waitEdge->waitingTransactionNum = ParseIntField(result, rowIndex, firstColumn + 2);
+	waitEdge->waitingTransactionStamp = ParseTimestampTzField(result, rowIndex,
+															  firstColumn + 3);
+	waitEdge->blockingGPid = 0; /* not requested for deadlock detection */
+	waitEdge->blockingPid = ParseIntField(result, rowIndex, firstColumn + 4);
+	waitEdge->blockingNodeId = ParseIntField(result, rowIndex, firstColumn + 5);
+	waitEdge->blockingTransactionNum = ParseIntField(result, rowIndex, firstColumn + 6);
+	waitEdge->blockingTransactionStamp = ParseTimestampTzField(result, rowIndex,
+															   firstColumn + 7);
+	waitEdge->isBlockingXactWaiting = ParseBoolField(result, rowIndex, firstColumn + 8);
+}
+
+
+/*
+ * AddWaitEdgeFromBlockedProcessResult adds an edge to the wait graph that
+ * is read from a PGresult.
+ */
+static void
+AddWaitEdgeFromBlockedProcessResult(WaitGraph *waitGraph, PGresult *result, int rowIndex)
+{
+	WaitEdge *waitEdge = AllocWaitEdge(waitGraph);
+
+	waitEdge->waitingGPid = ParseIntField(result, rowIndex, 0);
+	waitEdge->waitingPid = ParseIntField(result, rowIndex, 1);
+	waitEdge->waitingNodeId = ParseIntField(result, rowIndex, 2);
+	waitEdge->waitingTransactionNum = ParseIntField(result, rowIndex, 3);
+	waitEdge->waitingTransactionStamp = ParseTimestampTzField(result, rowIndex, 4);
+	waitEdge->blockingGPid = ParseIntField(result, rowIndex, 5);
+	waitEdge->blockingPid = ParseIntField(result, rowIndex, 6);
+	waitEdge->blockingNodeId = ParseIntField(result, rowIndex, 7);
+	waitEdge->blockingTransactionNum = ParseIntField(result, rowIndex, 8);
+	waitEdge->blockingTransactionStamp = ParseTimestampTzField(result, rowIndex, 9);
+	waitEdge->isBlockingXactWaiting = ParseBoolField(result, rowIndex, 10);
+}
+
+
+/*
+ * ParseIntField parses a int64 from a remote result or returns 0 if the
+ * result is NULL.
+ */
+int64
+ParseIntField(PGresult *result, int rowIndex, int colIndex)
+{
+	if (PQgetisnull(result, rowIndex, colIndex))
+	{
+		return 0;
+	}
+
+	char *resultString = PQgetvalue(result, rowIndex, colIndex);
+
+	return strtou64(resultString, NULL, 10);
+}
+
+
+/*
+ * ParseBoolField parses a bool from a remote result or returns false if the
+ * result is NULL.
+ */
+bool
+ParseBoolField(PGresult *result, int rowIndex, int colIndex)
+{
+	if (PQgetisnull(result, rowIndex, colIndex))
+	{
+		return false;
+	}
+
+	char *resultString = PQgetvalue(result, rowIndex, colIndex);
+	if (strlen(resultString) != 1)
+	{
+		return false;
+	}
+
+	return resultString[0] == 't';
+}
+
+
+/*
+ * ParseTimestampTzField parses a timestamptz from a remote result or returns
+ * 0 if the result is NULL.
+ */
+TimestampTz
+ParseTimestampTzField(PGresult *result, int rowIndex, int colIndex)
+{
+	if (PQgetisnull(result, rowIndex, colIndex))
+	{
+		return DT_NOBEGIN;
+	}
+
+	char *resultString = PQgetvalue(result, rowIndex, colIndex);
+	Datum resultStringDatum = CStringGetDatum(resultString);
+	Datum timestampDatum = DirectFunctionCall3(timestamptz_in, resultStringDatum, 0, -1);
+
+	return DatumGetTimestampTz(timestampDatum);
+}
+
+
+/*
+ * dump_local_wait_edges returns wait edges for distributed transactions
+ * running on the node on which it is called, which originate from the source node.
+ */
+Datum
+dump_local_wait_edges(PG_FUNCTION_ARGS)
+{
+	bool onlyDistributedTx = true;
+
+	WaitGraph *waitGraph = BuildLocalWaitGraph(onlyDistributedTx);
+	ReturnWaitGraph(waitGraph, fcinfo);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * citus_internal_local_blocked_processes returns global wait edges
+ * including all processes running on the node.
+ */
+Datum
+citus_internal_local_blocked_processes(PG_FUNCTION_ARGS)
+{
+	bool onlyDistributedTx = false;
+
+	WaitGraph *waitGraph = BuildLocalWaitGraph(onlyDistributedTx);
+	ReturnBlockedProcessGraph(waitGraph, fcinfo);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * ReturnWaitGraph returns a wait graph for a set returning function.
+ */
+static void
+ReturnWaitGraph(WaitGraph *waitGraph, FunctionCallInfo fcinfo)
+{
+	TupleDesc tupleDesc;
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDesc);
+
+	for (size_t curEdgeNum = 0; curEdgeNum < waitGraph->edgeCount; curEdgeNum++)
+	{
+		Datum values[9];
+		bool nulls[9];
+		WaitEdge *curEdge = &waitGraph->edges[curEdgeNum];
+
+		FillWaitEdgeValues(curEdge, values, nulls);
+
+		tuplestore_putvalues(tupleStore, tupleDesc, values, nulls);
+	}
+}
+
+
+/*
+ * FillWaitEdgeValues fills the 9 values and nulls of a wait edge in the
+ * format of dump_local_wait_edges.
+ */
+static void
+FillWaitEdgeValues(WaitEdge *waitEdge, Datum *values, bool *nulls)
+{
+	/*
+	 * Columns:
+	 * 00: waiting_pid
+	 * 01: waiting_node_id
+	 * 02: waiting_transaction_num
+	 * 03: waiting_transaction_stamp
+	 * 04: blocking_pid
+	 * 05: blocking__node_id
+	 * 06: blocking_transaction_num
+	 * 07: blocking_transaction_stamp
+	 * 08: blocking_transaction_waiting
+	 */
+	memset(values, 0, 9 * sizeof(Datum));
+	memset(nulls, 0, 9 * sizeof(bool));
+
+	values[0] = Int32GetDatum(waitEdge->waitingPid);
+	values[1] = Int32GetDatum(waitEdge->waitingNodeId);
+	if (waitEdge->waitingTransactionNum != 0)
+	{
+		values[2] = Int64GetDatum(waitEdge->waitingTransactionNum);
+		values[3] = TimestampTzGetDatum(waitEdge->waitingTransactionStamp);
+	}
+	else
+	{
+		nulls[2] = true;
+		nulls[3] = true;
+	}
+
+	values[4] = Int32GetDatum(waitEdge->blockingPid);
+	values[5] = Int32GetDatum(waitEdge->blockingNodeId);
+	if (waitEdge->blockingTransactionNum != 0)
+	{
+		values[6] = Int64GetDatum(waitEdge->blockingTransactionNum);
+		values[7] = TimestampTzGetDatum(waitEdge->blockingTransactionStamp);
+	}
+	else
+	{
+		nulls[6] = true;
+		nulls[7] = true;
+	}
+	values[8] = BoolGetDatum(waitEdge->isBlockingXactWaiting);
+}
+
+
+/*
+ * ReturnBlockedProcessGraph returns a wait graph for a set returning function.
+ */
+static void
+ReturnBlockedProcessGraph(WaitGraph *waitGraph, FunctionCallInfo fcinfo)
+{
+	TupleDesc tupleDesc;
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDesc);
+
+	/*
+	 * Columns:
+	 * 00: waiting_global_pid
+	 * 01: waiting_pid
+	 * 02: waiting_node_id
+	 * 03: waiting_transaction_num
+	 * 04: waiting_transaction_stamp
+	 * 05: blocking_global_pid
+	 * 06: blocking_pid
+	 * 07: blocking__node_id
+	 * 08: blocking_transaction_num
+	 * 09: blocking_transaction_stamp
+	 * 10: blocking_transaction_waiting
+	 */
+	for (size_t curEdgeNum = 0; curEdgeNum < waitGraph->edgeCount; curEdgeNum++)
+	{
+		Datum values[11];
+		bool nulls[11];
+		WaitEdge *curEdge = &waitGraph->edges[curEdgeNum];
+
+		memset(values, 0, sizeof(values));
+		memset(nulls, 0, sizeof(nulls));
+
+		values[0] = UInt64GetDatum(curEdge->waitingGPid);
+		values[1] = Int32GetDatum(curEdge->waitingPid);
+		values[2] = Int32GetDatum(curEdge->waitingNodeId);
+		if (curEdge->waitingTransactionNum != 0)
+		{
+			values[3] = Int64GetDatum(curEdge->waitingTransactionNum);
+			values[4] = TimestampTzGetDatum(curEdge->waitingTransactionStamp);
+		}
+		else
+		{
+			nulls[3] = true;
+			nulls[4] = true;
+		}
+
+		values[5] = UInt64GetDatum(curEdge->blockingGPid);
+		values[6] = Int32GetDatum(curEdge->blockingPid);
+		values[7] = Int32GetDatum(curEdge->blockingNodeId);
+		if (curEdge->blockingTransactionNum != 0)
+		{
+			values[8] = Int64GetDatum(curEdge->blockingTransactionNum);
+			values[9] = TimestampTzGetDatum(curEdge->blockingTransactionStamp);
+		}
+		else
+		{
+			nulls[8] = true;
+			nulls[9] = true;
+		}
+		values[10] = BoolGetDatum(curEdge->isBlockingXactWaiting);
+
+		tuplestore_putvalues(tupleStore, tupleDesc, values, nulls);
+	}
+}
+
+
+/*
+ * citus_internal_local_wait_edge_changes returns how the local wait edges for
+ * distributed transactions changed since the given version of the wait graph
+ * was returned to the requesting node. If we no longer have that version, a
+ * row with change type 'f' is followed by the full wait graph. The returned
+ * wait graph is stored as new_version.
+ */
+Datum
+citus_internal_local_wait_edge_changes(PG_FUNCTION_ARGS)
+{
+	int32 requesterNodeId = PG_GETARG_INT32(0);
+	uint64 sinceVersion = (uint64) PG_GETARG_INT64(1);
+	uint64 newVersion = (uint64) PG_GETARG_INT64(2);
+
+	WaitGraphChanges *changes = LocalWaitGraphChanges(requesterNodeId, sinceVersion,
+													  newVersion);
+	ReturnWaitGraphChanges(changes, fcinfo);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * ReturnWaitGraphChanges returns wait graph changes for a set returning
+ * function, starting with the full graph marker if needed, followed by the
+ * removed and the added edges.
+ */
+static void
+ReturnWaitGraphChanges(WaitGraphChanges *changes, FunctionCallInfo fcinfo)
+{
+	TupleDesc tupleDesc;
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDesc);
+
+	if (changes->isFullGraph)
+	{
+		Datum values[10];
+		bool nulls[10];
+
+		memset(values, 0, sizeof(values));
+		memset(nulls, true, sizeof(nulls));
+
+		values[0] = CharGetDatum(WAIT_EDGE_CHANGE_FULL_GRAPH);
+		nulls[0] = false;
+
+		tuplestore_putvalues(tupleStore, tupleDesc, values, nulls);
+	}
+
+	PutWaitEdgeChangeTuples(tupleStore, tupleDesc, changes->removedEdges,
+							WAIT_EDGE_CHANGE_REMOVED);
+	PutWaitEdgeChangeTuples(tupleStore, tupleDesc, changes->addedEdges,
+							WAIT_EDGE_CHANGE_ADDED);
+}
+
+
+/*
+ * PutWaitEdgeChangeTuples adds a tuple with the given change type for each
+ * edge in the wait graph.
+ */
+static void
+PutWaitEdgeChangeTuples(Tuplestorestate *tupleStore, TupleDesc tupleDesc,
+						WaitGraph *waitGraph, char changeType)
+{
+	/*
+	 * Columns:
+	 * 00: change_type
+	 * 01-09: same as dump_local_wait_edges
+	 */
+	for (int edgeIndex = 0; edgeIndex < waitGraph->edgeCount; edgeIndex++)
+	{
+		Datum values[10];
+		bool nulls[10];
+
+		values[0] = CharGetDatum(changeType);
+		nulls[0] = false;
+
+		FillWaitEdgeValues(&waitGraph->edges[edgeIndex], &values[1], &nulls[1]);
+
+		tuplestore_putvalues(tupleStore, tupleDesc, values, nulls);
+	}
+}
+
+
+/*
+ * LocalWaitGraphChanges returns how the local wait graph of distributed
+ * transactions changed since the requesting node got the given version of
+ * it, and stores the current wait graph as newVersion. If sinceVersion is
+ * not the stored version, the full wait graph is returned.
+ */
+WaitGraphChanges *
+LocalWaitGraphChanges(int32 requesterNodeId, uint64 sinceVersion, uint64 newVersion)
+{
+	bool onlyDistributedTx = true;
+
+	WaitGraph *waitGraph = BuildLocalWaitGraph(onlyDistributedTx);
+	SortWaitGraphEdges(waitGraph);
+
+	WaitGraphChanges *changes = (WaitGraphChanges *) palloc0(sizeof(WaitGraphChanges));
+	changes->addedEdges = CreateWaitGraph(waitGraph->edgeCount);
+	changes->removedEdges = CreateWaitGraph(waitGraph->edgeCount);
+
+	if (MaxWaitGraphSnapshots == 0)
+	{
+		/* we do not keep snapshots, so the node always gets the full graph */
+		changes->isFullGraph = true;
+		changes->addedEdges = waitGraph;
+
+		return changes;
+	}
+
+	LWLockAcquire(&WaitGraphSnapshotShared->lock, LW_EXCLUSIVE);
+
+	WaitGraphSnapshot *snapshot = GetWaitGraphSnapshot(requesterNodeId, MyDatabaseId);
+
+	if (sinceVersion != 0 && snapshot->version == sinceVersion)
+	{
+		WaitEdge *snapshotEdges = ReadWaitGraphSnapshotEdges(snapshot);
+		int snapshotIndex = 0;
+		int edgeIndex = 0;
+
+		changes->isFullGraph = false;
+
+		/* both lists of edges are sorted, so we can merge them */
+		while (snapshotIndex < snapshot->edgeCount || edgeIndex < waitGraph->edgeCount)
+		{
+			int comparison = 0;
+
+			if (snapshotIndex == snapshot->edgeCount)
+			{
+				comparison = 1;
+			}
+			else if (edgeIndex == waitGraph->edgeCount)
+			{
+				comparison = -1;
+			}
+			else
+			{
+				comparison = CompareWaitEdges(&snapshotEdges[snapshotIndex],
+											  &waitGraph->edges[edgeIndex]);
+			}
+
+			if (comparison < 0)
+			{
+				*AllocWaitEdge(changes->removedEdges) = snapshotEdges[snapshotIndex++];
+			}
+			else if (comparison > 0)
+			{
+				*AllocWaitEdge(changes->addedEdges) = waitGraph->edges[edgeIndex++];
+			}
+			else
+			{
+				snapshotIndex++;
+				edgeIndex++;
+			}
+		}
+	}
+	else
+	{
+		changes->isFullGraph = true;
+		changes->addedEdges = waitGraph;
+	}
+
+	if (StoreWaitGraphSnapshotEdges(snapshot, waitGraph))
+	{
+		snapshot->version = newVersion;
+	}
+	else
+	{
+		/* the wait graph does not fit, the node gets the full graph next time */
+		snapshot->version = 0;
+	}
+
+	snapshot->lastPollTime = GetCurrentTimestamp();
+
+	LWLockRelease(&WaitGraphSnapshotShared->lock);
+
+	return changes;
+}
+
+
+/*
+ * InitializeWaitGraphSnapshots sets up the shared memory startup hook of the
+ * wait graph snapshots.
+ */
+void
+InitializeWaitGraphSnapshots(void)
+{
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = WaitGraphSnapshotShmemInit;
+}
+
+
+/*
+ * WaitGraphSnapshotChunkCount returns the number of chunks of wait edges to
+ * allocate, which is enough for every snapshot to hold an edge per process.
+ */
+static int
+WaitGraphSnapshotChunkCount(void)
+{
+	uint64 edgeCount = (uint64) MaxWaitGraphSnapshots * TotalProcCount();
+
+	return (int) ((edgeCount + WAIT_GRAPH_SNAPSHOT_CHUNK_SIZE - 1) /
+				  WAIT_GRAPH_SNAPSHOT_CHUNK_SIZE);
+}
+
+
+/*
+ * WaitGraphSnapshotShmemSize returns the size that should be allocated on
+ * the shared memory for the wait graph snapshots, which is nothing unless
+ * citus.max_wait_graph_snapshots is set.
+ */
+size_t
+WaitGraphSnapshotShmemSize(void)
+{
+	Size size = 0;
+
+	if (MaxWaitGraphSnapshots == 0)
 	{
-		return 0;
+		return size;
 	}
 
-	char *resultString = PQgetvalue(result, rowIndex, colIndex);
+	int chunkCount = WaitGraphSnapshotChunkCount();
 
-	return strtou64(resultString, NULL, 10);
+	size = add_size(size, MAXALIGN(sizeof(WaitGraphSnapshotSharedData)));
+	size = add_size(size, MAXALIGN(mul_size(sizeof(WaitGraphSnapshot),
+											MaxWaitGraphSnapshots)));
+	size = add_size(size, MAXALIGN(mul_size(sizeof(int), chunkCount)));
+	size = add_size(size, mul_size(mul_size(sizeof(WaitEdge), chunkCount),
+								   WAIT_GRAPH_SNAPSHOT_CHUNK_SIZE));
+
+	return size;
 }
 
 
 /*
- * ParseBoolField parses a bool from a remote result or returns false if the
- * result is NULL.
+ * WaitGraphSnapshotShmemInit initializes the shared memory in which the
+ * local wait graphs that nodes polled are kept.
  */
-bool
-ParseBoolField(PGresult *result, int rowIndex, int colIndex)
+static void
+WaitGraphSnapshotShmemInit(void)
 {
-	if (PQgetisnull(result, rowIndex, colIndex))
+	if (MaxWaitGraphSnapshots > 0)
 	{
-		return false;
+		bool alreadyInitialized = false;
+		int chunkCount = WaitGraphSnapshotChunkCount();
+
+		LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+		char *sharedMemory = ShmemInitStruct("Wait Graph Snapshots",
+											 WaitGraphSnapshotShmemSize(),
+											 &alreadyInitialized);
+
+		WaitGraphSnapshotShared = (WaitGraphSnapshotSharedData *) sharedMemory;
+		sharedMemory += MAXALIGN(sizeof(WaitGraphSnapshotSharedData));
+
+		WaitGraphSnapshots = (WaitGraphSnapshot *) sharedMemory;
+		sharedMemory += MAXALIGN(mul_size(sizeof(WaitGraphSnapshot),
+										  MaxWaitGraphSnapshots));
+
+		WaitGraphSnapshotNextChunk = (int *) sharedMemory;
+		sharedMemory += MAXALIGN(mul_size(sizeof(int), chunkCount));
+
+		WaitGraphSnapshotEdges = (WaitEdge *) sharedMemory;
+
+		if (!alreadyInitialized)
+		{
+			memset(WaitGraphSnapshotShared, 0, WaitGraphSnapshotShmemSize());
+
+			WaitGraphSnapshotShared->trancheId = LWLockNewTrancheId();
+			WaitGraphSnapshotShared->lockTrancheName = "Wait Graph Snapshot Tranche";
+			LWLockRegisterTranche(WaitGraphSnapshotShared->trancheId,
+								  WaitGraphSnapshotShared->lockTrancheName);
+			LWLockInitialize(&WaitGraphSnapshotShared->lock,
+							 WaitGraphSnapshotShared->trancheId);
+
+			for (int snapshotIndex = 0; snapshotIndex < MaxWaitGraphSnapshots;
+				 snapshotIndex++)
+			{
+				WaitGraphSnapshots[snapshotIndex].firstChunk = -1;
+			}
+
+			/* all chunks start out free */
+			WaitGraphSnapshotShared->chunkCount = chunkCount;
+			WaitGraphSnapshotShared->freeChunk = -1;
+			WaitGraphSnapshotShared->freeChunkCount = chunkCount;
+
+			for (int chunk = chunkCount - 1; chunk >= 0; chunk--)
+			{
+				WaitGraphSnapshotNextChunk[chunk] = WaitGraphSnapshotShared->freeChunk;
+				WaitGraphSnapshotShared->freeChunk = chunk;
+			}
+		}
+
+		LWLockRelease(AddinShmemInitLock);
 	}
 
-	char *resultString = PQgetvalue(result, rowIndex, colIndex);
-	if (strlen(resultString) != 1)
+	if (prev_shmem_startup_hook != NULL)
 	{
-		return false;
+		prev_shmem_startup_hook();
 	}
-
-	return resultString[0] == 't';
 }
 
 
 /*
- * ParseTimestampTzField parses a timestamptz from a remote result or returns
- * 0 if the result is NULL.
+ * GetWaitGraphSnapshot returns the wait graph snapshot of the given node
+ * and database. If there is none, the least recently polled snapshot is
+ * reused. The caller should hold the lock in exclusive mode.
  */
-TimestampTz
-ParseTimestampTzField(PGresult *result, int rowIndex, int colIndex)
+static WaitGraphSnapshot *
+GetWaitGraphSnapshot(int32 requesterNodeId, Oid databaseId)
 {
-	if (PQgetisnull(result, rowIndex, colIndex))
+	int snapshotIndex = -1;
+
+	for (int index = 0; index < MaxWaitGraphSnapshots; index++)
 	{
-		return DT_NOBEGIN;
+		WaitGraphSnapshot *snapshot = &WaitGraphSnapshots[index];
+
+		if (snapshot->databaseId == databaseId &&
+			snapshot->requesterNodeId == requesterNodeId)
+		{
+			snapshotIndex = index;
+			break;
+		}
+
+		if (snapshotIndex == -1 ||
+			snapshot->lastPollTime < WaitGraphSnapshots[snapshotIndex].lastPollTime)
+		{
+			/* unused snapshots have the lowest poll time */
+			snapshotIndex = index;
+		}
 	}
 
-	char *resultString = PQgetvalue(result, rowIndex, colIndex);
-	Datum resultStringDatum = CStringGetDatum(resultString);
-	Datum timestampDatum = DirectFunctionCall3(timestamptz_in, resultStringDatum, 0, -1);
+	WaitGraphSnapshot *snapshot = &WaitGraphSnapshots[snapshotIndex];
+	if (snapshot->databaseId != databaseId ||
+		snapshot->requesterNodeId != requesterNodeId)
+	{
+		FreeWaitGraphSnapshotEdges(snapshot);
 
-	return DatumGetTimestampTz(timestampDatum);
+		snapshot->requesterNodeId = requesterNodeId;
+		snapshot->databaseId = databaseId;
+	}
+
+	return snapshot;
 }
 
 
 /*
- * dump_local_wait_edges returns wait edges for distributed transactions
- * running on the node on which it is called, which originate from the source node.
+ * ReadWaitGraphSnapshotEdges returns a copy of the edges of the given
+ * snapshot. The caller should hold the lock.
  */
-Datum
-dump_local_wait_edges(PG_FUNCTION_ARGS)
+static WaitEdge *
+ReadWaitGraphSnapshotEdges(WaitGraphSnapshot *snapshot)
 {
-	bool onlyDistributedTx = true;
-
-	WaitGraph *waitGraph = BuildLocalWaitGraph(onlyDistributedTx);
-	ReturnWaitGraph(waitGraph, fcinfo);
+	WaitEdge *edges = (WaitEdge *) palloc(Max(snapshot->edgeCount, 1) *
+										  sizeof(WaitEdge));
+	int chunk = snapshot->firstChunk;
 
-	return (Datum) 0;
-}
+	for (int edgeIndex = 0; edgeIndex < snapshot->edgeCount;
+		 edgeIndex += WAIT_GRAPH_SNAPSHOT_CHUNK_SIZE)
+	{
+		int chunkEdgeCount = Min(snapshot->edgeCount - edgeIndex,
+								 WAIT_GRAPH_SNAPSHOT_CHUNK_SIZE);
 
+		Assert(chunk != -1);
 
-/*
- * citus_internal_local_blocked_processes returns global wait edges
- * including all processes running on the node.
- */
-Datum
-citus_internal_local_blocked_processes(PG_FUNCTION_ARGS)
-{
-	bool onlyDistributedTx = false;
+		memcpy_s(&edges[edgeIndex],
+				 (snapshot->edgeCount - edgeIndex) * sizeof(WaitEdge),
+				 &WaitGraphSnapshotEdges[chunk * WAIT_GRAPH_SNAPSHOT_CHUNK_SIZE],
+				 chunkEdgeCount * sizeof(WaitEdge));
 
-	WaitGraph *waitGraph = BuildLocalWaitGraph(onlyDistributedTx);
-	ReturnBlockedProcessGraph(waitGraph, fcinfo);
+		chunk = WaitGraphSnapshotNextChunk[chunk];
+	}
 
-	return (Datum) 0;
+	return edges;
 }
 
 
 /*
- * ReturnWaitGraph returns a wait graph for a set returning function.
+ * StoreWaitGraphSnapshotEdges replaces the edges of the given snapshot by
+ * the edges of the given wait graph. If there are not enough free chunks,
+ * the edges of the least recently polled other snapshots are dropped, such
+ * that their nodes get the full graph next time. Returns false if the wait
+ * graph does not fit even into all the chunks. The caller should hold the
+ * lock in exclusive mode.
  */
-static void
-ReturnWaitGraph(WaitGraph *waitGraph, FunctionCallInfo fcinfo)
+static bool
+StoreWaitGraphSnapshotEdges(WaitGraphSnapshot *snapshot, WaitGraph *waitGraph)
 {
-	TupleDesc tupleDesc;
-	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDesc);
+	int chunkCount = (waitGraph->edgeCount + WAIT_GRAPH_SNAPSHOT_CHUNK_SIZE - 1) /
+					 WAIT_GRAPH_SNAPSHOT_CHUNK_SIZE;
 
-	/*
-	 * Columns:
-	 * 00: waiting_pid
-	 * 01: waiting_node_id
-	 * 02: waiting_transaction_num
-	 * 03: waiting_transaction_stamp
-	 * 04: blocking_pid
-	 * 05: blocking__node_id
-	 * 06: blocking_transaction_num
-	 * 07: blocking_transaction_stamp
-	 * 08: blocking_transaction_waiting
-	 */
-	for (size_t curEdgeNum = 0; curEdgeNum < waitGraph->edgeCount; curEdgeNum++)
+	FreeWaitGraphSnapshotEdges(snapshot);
+
+	if (chunkCount > WaitGraphSnapshotShared->chunkCount)
 	{
-		Datum values[9];
-		bool nulls[9];
-		WaitEdge *curEdge = &waitGraph->edges[curEdgeNum];
+		return false;
+	}
 
-		memset(values, 0, sizeof(values));
-		memset(nulls, 0, sizeof(nulls));
+	while (WaitGraphSnapshotShared->freeChunkCount < chunkCount)
+	{
+		WaitGraphSnapshot *oldestSnapshot = NULL;
 
-		values[0] = Int32GetDatum(curEdge->waitingPid);
-		values[1] = Int32GetDatum(curEdge->waitingNodeId);
-		if (curEdge->waitingTransactionNum != 0)
-		{
-			values[2] = Int64GetDatum(curEdge->waitingTransactionNum);
-			values[3] = TimestampTzGetDatum(curEdge->waitingTransactionStamp);
-		}
-		else
+		for (int index = 0; index < MaxWaitGraphSnapshots; index++)
 		{
-			nulls[2] = true;
-			nulls[3] = true;
-		}
+			WaitGraphSnapshot *otherSnapshot = &WaitGraphSnapshots[index];
 
-		values[4] = Int32GetDatum(curEdge->blockingPid);
-		values[5] = Int32GetDatum(curEdge->blockingNodeId);
-		if (curEdge->blockingTransactionNum != 0)
-		{
-			values[6] = Int64GetDatum(curEdge->blockingTransactionNum);
-			values[7] = TimestampTzGetDatum(curEdge->blockingTransactionStamp);
-		}
-		else
-		{
-			nulls[6] = true;
-			nulls[7] = true;
+			if (otherSnapshot->firstChunk != -1 &&
+				(oldestSnapshot == NULL ||
+				 otherSnapshot->lastPollTime < oldestSnapshot->lastPollTime))
+			{
+				oldestSnapshot = otherSnapshot;
+			}
 		}
-		values[8] = BoolGetDatum(curEdge->isBlockingXactWaiting);
 
-		tuplestore_putvalues(tupleStore, tupleDesc, values, nulls);
+		/* the chunks of all other snapshots add up to enough free chunks */
+		Assert(oldestSnapshot != NULL);
+
+		FreeWaitGraphSnapshotEdges(oldestSnapshot);
+	}
+
+	int *nextChunk = &snapshot->firstChunk;
+
+	for (int edgeIndex = 0; edgeIndex < waitGraph->edgeCount;
+		 edgeIndex += WAIT_GRAPH_SNAPSHOT_CHUNK_SIZE)
+	{
+		int chunk = WaitGraphSnapshotShared->freeChunk;
+		int chunkEdgeCount = Min(waitGraph->edgeCount - edgeIndex,
+								 WAIT_GRAPH_SNAPSHOT_CHUNK_SIZE);
+
+		WaitGraphSnapshotShared->freeChunk = WaitGraphSnapshotNextChunk[chunk];
+		WaitGraphSnapshotShared->freeChunkCount--;
+
+		memcpy_s(&WaitGraphSnapshotEdges[chunk * WAIT_GRAPH_SNAPSHOT_CHUNK_SIZE],
+				 WAIT_GRAPH_SNAPSHOT_CHUNK_SIZE * sizeof(WaitEdge),
+				 &waitGraph->edges[edgeIndex], chunkEdgeCount * sizeof(WaitEdge));
+
+		*nextChunk = chunk;
+		nextChunk = &WaitGraphSnapshotNextChunk[chunk];
 	}
+
+	*nextChunk = -1;
+	snapshot->edgeCount = waitGraph->edgeCount;
+
+	return true;
 }
 
 
 /*
- * ReturnBlockedProcessGraph returns a wait graph for a set returning function.
+ * FreeWaitGraphSnapshotEdges returns the chunks of the given snapshot to the
+ * free chunks, after which the node gets the full graph next time. The
+ * caller should hold the lock in exclusive mode.
  */
 static void
-ReturnBlockedProcessGraph(WaitGraph *waitGraph, FunctionCallInfo fcinfo)
+FreeWaitGraphSnapshotEdges(WaitGraphSnapshot *snapshot)
 {
-	TupleDesc tupleDesc;
-	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDesc);
+	int chunk = snapshot->firstChunk;
 
-	/*
-	 * Columns:
-	 * 00: waiting_global_pid
-	 * 01: waiting_pid
-	 * 02: waiting_node_id
-	 * 03: waiting_transaction_num
-	 * 04: waiting_transaction_stamp
-	 * 05: blocking_global_pid
-	 * 06: blocking_pid
-	 * 07: blocking__node_id
-	 * 08: blocking_transaction_num
-	 * 09: blocking_transaction_stamp
-	 * 10: blocking_transaction_waiting
-	 */
-	for (size_t curEdgeNum = 0; curEdgeNum < waitGraph->edgeCount; curEdgeNum++)
+	while (chunk != -1)
 	{
-		Datum values[11];
-		bool nulls[11];
-		WaitEdge *curEdge = &waitGraph->edges[curEdgeNum];
-
-		memset(values, 0, sizeof(values));
-		memset(nulls, 0, sizeof(nulls));
-
-		values[0] = UInt64GetDatum(curEdge->waitingGPid);
-		values[1] = Int32GetDatum(curEdge->waitingPid);
-		values[2] = Int32GetDatum(curEdge->waitingNodeId);
-		if (curEdge->waitingTransactionNum != 0)
-		{
-			values[3] = Int64GetDatum(curEdge->waitingTransactionNum);
-			values[4] = TimestampTzGetDatum(curEdge->waitingTransactionStamp);
-		}
-		else
-		{
-			nulls[3] = true;
-			nulls[4] = true;
-		}
+		int nextChunk = WaitGraphSnapshotNextChunk[chunk];
 
-		values[5] = UInt64GetDatum(curEdge->blockingGPid);
-		values[6] = Int32GetDatum(curEdge->blockingPid);
-		values[7] = Int32GetDatum(curEdge->blockingNodeId);
-		if (curEdge->blockingTransactionNum != 0)
-		{
-			values[8] = Int64GetDatum(curEdge->blockingTransactionNum);
-			values[9] = TimestampTzGetDatum(curEdge->blockingTransactionStamp);
-		}
-		else
-		{
-			nulls[8] = true;
-			nulls[9] = true;
-		}
-		values[10] = BoolGetDatum(curEdge->isBlockingXactWaiting);
+		WaitGraphSnapshotNextChunk[chunk] = WaitGraphSnapshotShared->freeChunk;
+		WaitGraphSnapshotShared->freeChunk = chunk;
+		WaitGraphSnapshotShared->freeChunkCount++;
 
-		tuplestore_putvalues(tupleStore, tupleDesc, values, nulls);
+		chunk = nextChunk;
 	}
+
+	snapshot->firstChunk = -1;
+	snapshot->edgeCount = 0;
+	snapshot->version = 0;
 }
 
 
@@ -539,11 +1621,7 @@ BuildLocalWaitGraph(bool onlyDistributedTx)
 	 * more than enough space to build the list of wait edges without a single
 	 * allocation.
 	 */
-	WaitGraph *waitGraph = (WaitGraph *) palloc0(sizeof(WaitGraph));
-	waitGraph->localNodeId = GetLocalGroupId();
-	waitGraph->allocatedSize = totalProcs * 3;
-	waitGraph->edgeCount = 0;
-	waitGraph->edges = (WaitEdge *) palloc(waitGraph->allocatedSize * sizeof(WaitEdge));
+	WaitGraph *waitGraph = CreateWaitGraph(totalProcs * 3);
 
 	remaining.procs = (PGPROC **) palloc(sizeof(PGPROC *) * totalProcs);
 	remaining.procAdded = (bool *) palloc0(sizeof(bool *) * totalProcs);
@@ -885,6 +1963,23 @@ AddWaitEdge(WaitGraph *waitGraph, PGPROC *waitingProc, PGPROC *blockingProc,
 }
 
 
+/*
+ * CreateWaitGraph allocates an empty wait graph with space for the given
+ * number of edges.
+ */
+static WaitGraph *
+CreateWaitGraph(int allocatedSize)
+{
+	WaitGraph *waitGraph = (WaitGraph *) palloc0(sizeof(WaitGraph));
+	waitGraph->localNodeId = GetLocalGroupId();
+	waitGraph->allocatedSize = Max(allocatedSize, 1);
+	waitGraph->edgeCount = 0;
+	waitGraph->edges = (WaitEdge *) palloc(waitGraph->allocatedSize * sizeof(WaitEdge));
+
+	return waitGraph;
+}
+
+
 /*
  * AllocWaitEdge allocates a wait edge as part of the given wait graph.
  * If the wait graph has insufficient space its size is doubled using
@@ -973,3 +2068,102 @@ IsInDistributedTransaction(BackendData *backendData)
 {
 	return backendData->transactionId.transactionNumber != 0;
 }
+
+
+/*
+ * SortWaitGraphEdges sorts the edges of a wait graph and removes duplicates,
+ * since a process can be both a hard and a soft edge of a waiting process.
+ */
+static void
+SortWaitGraphEdges(WaitGraph *waitGraph)
+{
+	int uniqueEdgeCount = 0;
+
+	qsort(waitGraph->edges, waitGraph->edgeCount, sizeof(WaitEdge), CompareWaitEdges);
+
+	for (int edgeIndex = 0; edgeIndex < waitGraph->edgeCount; edgeIndex++)
+	{
+		if (uniqueEdgeCount > 0 &&
+			CompareWaitEdges(&waitGraph->edges[uniqueEdgeCount - 1],
+							 &waitGraph->edges[edgeIndex]) == 0)
+		{
+			continue;
+		}
+
+		waitGraph->edges[uniqueEdgeCount++] = waitGraph->edges[edgeIndex];
+	}
+
+	waitGraph->edgeCount = uniqueEdgeCount;
+}
+
+
+/*
+ * WaitEdgeKeyFields fills fields with the WAIT_EDGE_KEY_FIELD_COUNT fields
+ * that identify a wait edge. Global PIDs are not part of it, since they are
+ * not used for deadlock detection.
+ */
+static void
+WaitEdgeKeyFields(const WaitEdge *waitEdge, int64 *fields)
+{
+	fields[0] = waitEdge->waitingPid;
+	fields[1] = waitEdge->waitingNodeId;
+	fields[2] = waitEdge->waitingTransactionNum;
+	fields[3] = waitEdge->waitingTransactionStamp;
+	fields[4] = waitEdge->blockingPid;
+	fields[5] = waitEdge->blockingNodeId;
+	fields[6] = waitEdge->blockingTransactionNum;
+	fields[7] = waitEdge->blockingTransactionStamp;
+	fields[8] = waitEdge->isBlockingXactWaiting;
+}
+
+
+/*
+ * CompareWaitEdges is a comparator for sorting wait edges.
+ */
+static int
+CompareWaitEdges(const void *leftElement, const void *rightElement)
+{
+	int64 leftFields[WAIT_EDGE_KEY_FIELD_COUNT];
+	int64 rightFields[WAIT_EDGE_KEY_FIELD_COUNT];
+
+	WaitEdgeKeyFields((const WaitEdge *) leftElement, leftFields);
+	WaitEdgeKeyFields((const WaitEdge *) rightElement, rightFields);
+
+	for (int fieldIndex = 0; fieldIndex < WAIT_EDGE_KEY_FIELD_COUNT; fieldIndex++)
+	{
+		if (leftFields[fieldIndex] < rightFields[fieldIndex])
+		{
+			return -1;
+		}
+		else if (leftFields[fieldIndex] > rightFields[fieldIndex])
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+ * WaitEdgeHash returns the hash value of a wait edge.
+ */
+static uint32
+WaitEdgeHash(const void *key, Size keysize)
+{
+	int64 fields[WAIT_EDGE_KEY_FIELD_COUNT];
+
+	WaitEdgeKeyFields((const WaitEdge *) key, fields);
+
+	return hash_any((unsigned char *) fields, sizeof(fields));
+}
+
+
+/*
+ * WaitEdgeMatch returns 0 if two wait edges are the same.
+ */
+static int
+WaitEdgeMatch(const void *leftKey, const void *rightKey, Size keysize)
+{
+	return CompareWaitEdges(leftKey, rightKey);
+}
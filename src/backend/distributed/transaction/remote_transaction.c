@@ -312,6 +312,100 @@ StartRemoteTransactionBegin(struct MultiConnection *connection)
 }
 
 
+/*
+ * RemoteTransactionBeginCanBePipelined returns whether the commands that begin
+ * a remote transaction can be sent one by one in libpq pipeline mode, which
+ * does not allow multiple statements in a single command. That is not the case
+ * when we need to replay SET LOCAL commands, which we only keep as a string
+ * that may contain multiple statements.
+ */
+bool
+RemoteTransactionBeginCanBePipelined(void)
+{
+	if (activeSetStmts != NULL && activeSetStmts->len > 0)
+	{
+		return false;
+	}
+
+	List *activeSubXacts = ActiveSubXactContexts();
+
+	SubXactContext *subXactState = NULL;
+	foreach_declared_ptr(subXactState, activeSubXacts)
+	{
+		if (subXactState->setLocalCmds != NULL && subXactState->setLocalCmds->len > 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * StartRemoteTransactionBeginPipelined is the pipeline mode variant of
+ * StartRemoteTransactionBegin. It sends BEGIN, a SAVEPOINT for every active
+ * subtransaction and assign_distributed_transaction_id() as separate commands
+ * and returns the number of commands sent, such that the caller knows how many
+ * results to clear before the results of its own commands follow.
+ *
+ * The caller should check RemoteTransactionBeginCanBePipelined() first.
+ */
+int
+StartRemoteTransactionBeginPipelined(struct MultiConnection *connection)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+	List *beginCommandList = NIL;
+
+	Assert(transaction->transactionState == REMOTE_TRANS_NOT_STARTED);
+	Assert(PQpipelineStatus(connection->pgConn) == PQ_PIPELINE_ON);
+	Assert(RemoteTransactionBeginCanBePipelined());
+
+	/* remember transaction as being in-progress */
+	dlist_push_tail(&InProgressTransactions, &connection->transactionNode);
+	connection->transactionInProgress = true;
+
+	transaction->transactionState = REMOTE_TRANS_STARTING;
+
+	beginCommandList = lappend(beginCommandList, BeginTransactionCommand());
+
+	List *activeSubXacts = ActiveSubXactContexts();
+	transaction->lastSuccessfulSubXact = TopSubTransactionId;
+	transaction->lastQueuedSubXact = TopSubTransactionId;
+
+	SubXactContext *subXactState = NULL;
+	foreach_declared_ptr(subXactState, activeSubXacts)
+	{
+		beginCommandList = lappend(beginCommandList,
+								   psprintf("SAVEPOINT savepoint_%u",
+											subXactState->subId));
+		transaction->lastQueuedSubXact = subXactState->subId;
+	}
+
+	beginCommandList = lappend(beginCommandList,
+							   AssignDistributedTransactionIdCommand());
+
+	char *command = NULL;
+	foreach_declared_ptr(command, beginCommandList)
+	{
+		if (!SendRemoteCommand(connection, command))
+		{
+			const bool raiseErrors = true;
+
+			HandleRemoteTransactionConnectionError(connection, raiseErrors);
+			break;
+		}
+	}
+
+	int commandCount = list_length(beginCommandList);
+	list_free_deep(beginCommandList);
+
+	transaction->beginSent = true;
+
+	return commandCount;
+}
+
+
 /*
  * BeginAndSetDistributedTransactionIdCommand returns a command which starts
  * a transaction and assigns the current distributed transaction id.
@@ -782,7 +876,16 @@ StartRemoteTransactionPrepare(struct MultiConnection *connection)
 	WorkerNode *workerNode = FindWorkerNode(connection->hostname, connection->port);
 	if (workerNode != NULL)
 	{
-		LogTransactionRecord(workerNode->groupId, transaction->preparedName, OuterXid);
+		if (!IsMainDBCommand && ShouldLogDistributedTransactionRecord())
+		{
+			/* a single record decides the prepared transactions on all groups */
+			LogDistributedTransactionRecord(transaction->preparedName);
+		}
+		else
+		{
+			LogTransactionRecord(workerNode->groupId, transaction->preparedName,
+								 OuterXid);
+		}
 	}
 
 	/*
@@ -29,6 +29,7 @@
 #include "utils/hsearch.h"
 #include "utils/memutils.h"
 
+#include "distributed/async_commit.h"
 #include "distributed/backend_data.h"
 #include "distributed/citus_safe_lib.h"
 #include "distributed/commands.h"
@@ -55,6 +56,7 @@
 #include "distributed/shared_connection_stats.h"
 #include "distributed/subplan_execution.h"
 #include "distributed/transaction_management.h"
+#include "distributed/transaction_recovery.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_log_messages.h"
 
@@ -326,6 +328,9 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 			if (CurrentCoordinatedTransactionState == COORD_TRANS_PREPARED &&
 				!IsMainDBCommand)
 			{
+				/* optionally leave COMMIT PREPARED to the async commit worker */
+				DeferPreparedRemoteTransactionsCommit();
+
 				/* handles both already prepared and open transactions */
 				CoordinatedRemoteTransactionsCommit();
 			}
@@ -666,9 +671,11 @@ ResetGlobalVariables()
 	XactModificationLevel = XACT_MODIFICATION_NONE;
 	SetLocalExecutionStatus(LOCAL_EXECUTION_OPTIONAL);
 	FreeSavedExplainPlan();
+	ResetStreamingExecution();
 	dlist_init(&InProgressTransactions);
 	activeSetStmts = NULL;
 	ShouldCoordinatedTransactionUse2PC = false;
+	DistributedTransactionRecordLogged = false;
 	TransactionModifiedNodeMetadata = false;
 	NodeMetadataSyncOnCommit = false;
 	InTopLevelDelegatedFunctionCall = false;
@@ -42,6 +42,7 @@
 #include "distributed/backend_data.h"
 #include "distributed/connection_management.h"
 #include "distributed/listutils.h"
+#include "distributed/maintenanced.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/pg_dist_transaction.h"
 #include "distributed/remote_commands.h"
@@ -51,13 +52,66 @@
 #include "distributed/worker_manager.h"
 
 
+/*
+ * DistributedTransactionRecordKey identifies the distributed transaction that
+ * a prepared transaction belongs to by its initiator. Transaction numbers
+ * restart after a restart of the initiator, hence they are not unique on
+ * their own.
+ */
+typedef struct DistributedTransactionRecordKey
+{
+	int32 groupId;
+	int procId;
+	uint64 transactionNumber;
+} DistributedTransactionRecordKey;
+
+
+/*
+ * ResolvedTransactionRecord counts the nodes on which no prepared transaction
+ * of a distributed transaction record is left.
+ */
+typedef struct ResolvedTransactionRecord
+{
+	DistributedTransactionRecordKey key;
+	int resolvedNodeCount;
+} ResolvedTransactionRecord;
+
+
+/* GUC to log a single pg_dist_transaction record per distributed transaction */
+bool CompactTransactionRecords = false;
+
+/*
+ * Whether the current transaction logged its distributed transaction record,
+ * reset at the end of the transaction.
+ */
+bool DistributedTransactionRecordLogged = false;
+
+/* whether 2PC recovery resolved all nodes since the server started */
+static bool TwoPhaseCommitsRecoveredSinceStart = false;
+
+
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(recover_prepared_transactions);
 
 
 /* Local functions forward declarations */
 static int RecoverWorkerTransactions(WorkerNode *workerNode,
-									 MultiConnection *connection);
+									 MultiConnection *connection,
+									 HTAB *resolvedRecordHash,
+									 bool *nodeRecovered);
+static bool ParseDistributedTransactionRecordKey(char *preparedTransactionName,
+												 DistributedTransactionRecordKey *key);
+static HTAB * DistributedTransactionRecordSet(Relation pgDistTransaction);
+static bool HasDistributedTransactionRecord(HTAB *distributedTransactionRecordSet,
+											char *preparedTransactionName);
+static void CountResolvedTransactionRecords(HTAB *resolvedRecordHash,
+											HTAB *distributedTransactionRecordSet,
+											HTAB *activeTransactionNumberSet,
+											List *pendingTransactionList,
+											List *recheckTransactionList);
+static int PrimaryNodeCount(void);
+static void DeleteResolvedTransactionRecords(HTAB *resolvedRecordHash,
+											 int recoveredNodeCount);
 static List * PendingWorkerTransactionList(MultiConnection *connection);
 static bool IsTransactionInProgress(HTAB *activeTransactionNumberSet,
 									char *preparedTransactionName);
@@ -120,6 +174,66 @@ LogTransactionRecord(int32 groupId, char *transactionName, FullTransactionId out
 }
 
 
+/*
+ * LogDistributedTransactionRecord registers the fact that the current
+ * distributed transaction prepared transactions on one or more workers.
+ * Unlike LogTransactionRecord, it writes a single record per distributed
+ * transaction, which decides the prepared transactions on all groups. This
+ * reduces the catalog churn of multi-shard writes, at the cost of recovery
+ * only cleaning up the record once all the nodes have been checked.
+ *
+ * The record is the name of the first prepared transaction, from which
+ * recovery takes the initiator group, process ID and transaction number that
+ * all prepared transactions of the distributed transaction share.
+ */
+void
+LogDistributedTransactionRecord(char *transactionName)
+{
+	if (DistributedTransactionRecordLogged)
+	{
+		/* already logged on a previous connection */
+		return;
+	}
+
+	FullTransactionId outerXid = InvalidFullTransactionId;
+	LogTransactionRecord(DISTRIBUTED_TRANSACTION_RECORD_GROUP_ID, transactionName,
+						 outerXid);
+
+	DistributedTransactionRecordLogged = true;
+}
+
+
+/*
+ * ShouldLogDistributedTransactionRecord returns whether the current
+ * distributed transaction should log a single distributed transaction record
+ * instead of one record per group.
+ *
+ * Such a record decides every prepared transaction with the same initiator
+ * process ID and transaction number, but both of them are reused after the
+ * server restarts. A prepared transaction that was left behind before the
+ * restart could therefore be taken for one of a new distributed transaction.
+ * We hence only log these records once 2PC recovery resolved the prepared
+ * transactions on all primary nodes since the server started, which starts a
+ * new epoch in which the identities of prepared transactions are unique.
+ */
+bool
+ShouldLogDistributedTransactionRecord(void)
+{
+	if (!CompactTransactionRecords)
+	{
+		return false;
+	}
+
+	if (!TwoPhaseCommitsRecoveredSinceStart)
+	{
+		/* once true, it stays true until the server restarts */
+		TwoPhaseCommitsRecoveredSinceStart = TwoPhaseCommitsRecovered(MyDatabaseId);
+	}
+
+	return TwoPhaseCommitsRecoveredSinceStart;
+}
+
+
 /*
  * RecoverTwoPhaseCommits recovers any pending prepared
  * transactions started by this node on other nodes.
@@ -175,9 +289,43 @@ RecoverTwoPhaseCommits(void)
 		 */
 		workerConnections = lappend(workerConnections, connection);
 	}
+
+	/* nodes on which the distributed transaction records are resolved */
+	HASHCTL info;
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(DistributedTransactionRecordKey);
+	info.entrysize = sizeof(ResolvedTransactionRecord);
+	info.hcxt = CurrentMemoryContext;
+	int hashFlags = (HASH_ELEM | HASH_CONTEXT | HASH_BLOBS);
+
+	HTAB *resolvedRecordHash = hash_create("resolved transaction records", 32, &info,
+										   hashFlags);
+
+	int recoveredNodeCount = 0;
+
 	forboth_ptr(workerNode, workerList, connection, workerConnections)
 	{
-		recoveredTransactionCount += RecoverWorkerTransactions(workerNode, connection);
+		bool nodeRecovered = false;
+
+		recoveredTransactionCount += RecoverWorkerTransactions(workerNode, connection,
+															   resolvedRecordHash,
+															   &nodeRecovered);
+		if (nodeRecovered)
+		{
+			recoveredNodeCount++;
+		}
+	}
+
+	/*
+	 * Since we do not know which groups a distributed transaction prepared
+	 * transactions on, we only act on the distributed transaction records if
+	 * recovery succeeded on all primary nodes, including inactive ones.
+	 */
+	if (recoveredNodeCount == PrimaryNodeCount())
+	{
+		DeleteResolvedTransactionRecords(resolvedRecordHash, recoveredNodeCount);
+
+		MarkTwoPhaseCommitsRecovered(MyDatabaseId);
 	}
 
 	return recoveredTransactionCount;
@@ -186,10 +334,14 @@ RecoverTwoPhaseCommits(void)
 
 /*
  * RecoverWorkerTransactions recovers any pending prepared transactions
- * started by this node on the specified worker.
+ * started by this node on the specified worker. It counts the distributed
+ * transaction records that have no prepared transactions left on the worker
+ * in resolvedRecordHash, and sets nodeRecovered if it recovered all prepared
+ * transactions on the worker that are not in progress.
  */
 static int
-RecoverWorkerTransactions(WorkerNode *workerNode, MultiConnection *connection)
+RecoverWorkerTransactions(WorkerNode *workerNode, MultiConnection *connection,
+						  HTAB *resolvedRecordHash, bool *nodeRecovered)
 {
 	int recoveredTransactionCount = 0;
 
@@ -270,6 +422,13 @@ RecoverWorkerTransactions(WorkerNode *workerNode, MultiConnection *connection)
 	HTAB *activeTransactionNumberSet = ListToHashSet(activeTransactionNumberList,
 													 sizeof(uint64), false);
 
+	/*
+	 * Get a snapshot of the records that decide all prepared transactions of
+	 * a distributed transaction, which is part of T.
+	 */
+	HTAB *distributedTransactionRecordSet =
+		DistributedTransactionRecordSet(pgDistTransaction);
+
 	/* scan through all recovery records of the current worker */
 	ScanKeyInit(&scanKey[0], Anum_pg_dist_transaction_groupid,
 				BTEqualStrategyNumber, F_INT4EQ, Int32GetDatum(groupId));
@@ -468,12 +627,13 @@ RecoverWorkerTransactions(WorkerNode *workerNode, MultiConnection *connection)
 	if (!recoveryFailed)
 	{
 		char *pendingTransactionName = NULL;
-		bool abortSucceeded = true;
 
 		/*
 		 * All remaining prepared transactions that are not part of an in-progress
 		 * distributed transaction should be aborted since we did not find a recovery
-		 * record, which implies the disributed transaction aborted.
+		 * record, which implies the disributed transaction aborted. The exception
+		 * are prepared transactions that a distributed transaction record decides,
+		 * which we commit under the same conditions as above.
 		 */
 		hash_seq_init(&status, pendingTransactionSet);
 
@@ -488,11 +648,27 @@ RecoverWorkerTransactions(WorkerNode *workerNode, MultiConnection *connection)
 			}
 
 			bool shouldCommit = false;
-			abortSucceeded = RecoverPreparedTransactionOnWorker(connection,
-																pendingTransactionName,
-																shouldCommit);
-			if (!abortSucceeded)
+			if (HasDistributedTransactionRecord(distributedTransactionRecordSet,
+												pendingTransactionName))
+			{
+				bool foundPreparedTransactionAfterCommit = false;
+				hash_search(recheckTransactionSet, pendingTransactionName, HASH_FIND,
+							&foundPreparedTransactionAfterCommit);
+				if (!foundPreparedTransactionAfterCommit)
+				{
+					/* committed after we observed the prepared transactions */
+					continue;
+				}
+
+				shouldCommit = true;
+			}
+
+			bool recoverySucceeded =
+				RecoverPreparedTransactionOnWorker(connection, pendingTransactionName,
+												   shouldCommit);
+			if (!recoverySucceeded)
 			{
+				recoveryFailed = true;
 				hash_seq_term(&status);
 				break;
 			}
@@ -501,6 +677,17 @@ RecoverWorkerTransactions(WorkerNode *workerNode, MultiConnection *connection)
 		}
 	}
 
+	if (!recoveryFailed)
+	{
+		CountResolvedTransactionRecords(resolvedRecordHash,
+										distributedTransactionRecordSet,
+										activeTransactionNumberSet,
+										pendingTransactionList,
+										recheckTransactionList);
+
+		*nodeRecovered = true;
+	}
+
 	MemoryContextSwitchTo(oldContext);
 	MemoryContextDelete(localContext);
 
@@ -508,6 +695,251 @@ RecoverWorkerTransactions(WorkerNode *workerNode, MultiConnection *connection)
 }
 
 
+/*
+ * ParseDistributedTransactionRecordKey parses the initiator of a prepared
+ * transaction into key. It returns false if the name cannot be parsed.
+ */
+static bool
+ParseDistributedTransactionRecordKey(char *preparedTransactionName,
+									 DistributedTransactionRecordKey *key)
+{
+	uint32 connectionNumber = 0;
+
+	/* the key is hashed as a blob, make sure the padding is zeroed */
+	memset(key, 0, sizeof(DistributedTransactionRecordKey));
+
+	return ParsePreparedTransactionName(preparedTransactionName, &key->groupId,
+										&key->procId, &key->transactionNumber,
+										&connectionNumber);
+}
+
+
+/*
+ * DistributedTransactionRecordSet returns the set of initiators of the
+ * distributed transactions that have a distributed transaction record in
+ * pg_dist_transaction.
+ */
+static HTAB *
+DistributedTransactionRecordSet(Relation pgDistTransaction)
+{
+	ScanKeyData scanKey[1];
+	int scanKeyCount = 1;
+	bool indexOK = true;
+	HeapTuple heapTuple = NULL;
+	List *recordKeyList = NIL;
+	TupleDesc tupleDescriptor = RelationGetDescr(pgDistTransaction);
+
+	ScanKeyInit(&scanKey[0], Anum_pg_dist_transaction_groupid,
+				BTEqualStrategyNumber, F_INT4EQ,
+				Int32GetDatum(DISTRIBUTED_TRANSACTION_RECORD_GROUP_ID));
+
+	SysScanDesc scanDescriptor = systable_beginscan(pgDistTransaction,
+													DistTransactionGroupIndexId(),
+													indexOK,
+													NULL, scanKeyCount, scanKey);
+
+	while (HeapTupleIsValid(heapTuple = systable_getnext(scanDescriptor)))
+	{
+		bool isNull = false;
+		DistributedTransactionRecordKey *recordKey =
+			palloc0(sizeof(DistributedTransactionRecordKey));
+
+		Datum transactionNameDatum = heap_getattr(heapTuple,
+												  Anum_pg_dist_transaction_gid,
+												  tupleDescriptor, &isNull);
+		char *transactionName = TextDatumGetCString(transactionNameDatum);
+
+		if (ParseDistributedTransactionRecordKey(transactionName, recordKey))
+		{
+			recordKeyList = lappend(recordKeyList, recordKey);
+		}
+	}
+
+	systable_endscan(scanDescriptor);
+
+	return ListToHashSet(recordKeyList, sizeof(DistributedTransactionRecordKey), false);
+}
+
+
+/*
+ * HasDistributedTransactionRecord returns whether the distributed transaction
+ * to which preparedTransactionName belongs has a distributed transaction
+ * record, that is whether a record with the same initiator group, process ID
+ * and transaction number exists.
+ */
+static bool
+HasDistributedTransactionRecord(HTAB *distributedTransactionRecordSet,
+								char *preparedTransactionName)
+{
+	DistributedTransactionRecordKey recordKey;
+	bool hasRecord = false;
+
+	if (ParseDistributedTransactionRecordKey(preparedTransactionName, &recordKey))
+	{
+		hash_search(distributedTransactionRecordSet, &recordKey, HASH_FIND,
+					&hasRecord);
+	}
+
+	return hasRecord;
+}
+
+
+/*
+ * CountResolvedTransactionRecords increments the resolved node count of the
+ * distributed transaction records that are not in progress and have no
+ * prepared transactions on the current worker, neither before nor after we
+ * took the snapshot of pg_dist_transaction. Records of which we committed
+ * the prepared transactions just now are resolved in the next round.
+ */
+static void
+CountResolvedTransactionRecords(HTAB *resolvedRecordHash,
+								HTAB *distributedTransactionRecordSet,
+								HTAB *activeTransactionNumberSet,
+								List *pendingTransactionList,
+								List *recheckTransactionList)
+{
+	List *preparedTransactionKeyList = NIL;
+	List *preparedTransactionList = list_concat_copy(pendingTransactionList,
+													 recheckTransactionList);
+
+	char *preparedTransactionName = NULL;
+	foreach_declared_ptr(preparedTransactionName, preparedTransactionList)
+	{
+		DistributedTransactionRecordKey *preparedTransactionKey =
+			palloc0(sizeof(DistributedTransactionRecordKey));
+
+		if (ParseDistributedTransactionRecordKey(preparedTransactionName,
+												 preparedTransactionKey))
+		{
+			preparedTransactionKeyList = lappend(preparedTransactionKeyList,
+												 preparedTransactionKey);
+		}
+	}
+
+	HTAB *preparedTransactionKeySet =
+		ListToHashSet(preparedTransactionKeyList,
+					  sizeof(DistributedTransactionRecordKey), false);
+
+	HASH_SEQ_STATUS status;
+	DistributedTransactionRecordKey *recordKey = NULL;
+
+	hash_seq_init(&status, distributedTransactionRecordSet);
+
+	while ((recordKey = hash_seq_search(&status)) != NULL)
+	{
+		bool isTransactionInProgress = false;
+		bool hasPreparedTransaction = false;
+
+		hash_search(activeTransactionNumberSet, &recordKey->transactionNumber,
+					HASH_FIND, &isTransactionInProgress);
+		hash_search(preparedTransactionKeySet, recordKey, HASH_FIND,
+					&hasPreparedTransaction);
+
+		if (isTransactionInProgress || hasPreparedTransaction)
+		{
+			continue;
+		}
+
+		bool found = false;
+		ResolvedTransactionRecord *resolvedRecord =
+			hash_search(resolvedRecordHash, recordKey, HASH_ENTER, &found);
+		if (!found)
+		{
+			resolvedRecord->resolvedNodeCount = 0;
+		}
+
+		resolvedRecord->resolvedNodeCount++;
+	}
+}
+
+
+/*
+ * PrimaryNodeCount returns the number of primary nodes in pg_dist_node,
+ * including inactive ones.
+ */
+static int
+PrimaryNodeCount(void)
+{
+	int primaryNodeCount = 0;
+	bool includeNodesFromOtherClusters = false;
+
+	WorkerNode *workerNode = NULL;
+	foreach_declared_ptr(workerNode, ReadDistNode(includeNodesFromOtherClusters))
+	{
+		if (NodeIsPrimary(workerNode))
+		{
+			primaryNodeCount++;
+		}
+	}
+
+	return primaryNodeCount;
+}
+
+
+/*
+ * DeleteResolvedTransactionRecords deletes the distributed transaction
+ * records that are resolved on all the nodes that recovery checked. The
+ * caller should make sure that recovery checked all primary nodes, since we
+ * do not know which groups a distributed transaction prepared transactions
+ * on.
+ */
+static void
+DeleteResolvedTransactionRecords(HTAB *resolvedRecordHash, int recoveredNodeCount)
+{
+	if (hash_get_num_entries(resolvedRecordHash) == 0)
+	{
+		return;
+	}
+
+	ScanKeyData scanKey[1];
+	int scanKeyCount = 1;
+	bool indexOK = true;
+	HeapTuple heapTuple = NULL;
+
+	Relation pgDistTransaction = table_open(DistTransactionRelationId(),
+											RowExclusiveLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(pgDistTransaction);
+
+	ScanKeyInit(&scanKey[0], Anum_pg_dist_transaction_groupid,
+				BTEqualStrategyNumber, F_INT4EQ,
+				Int32GetDatum(DISTRIBUTED_TRANSACTION_RECORD_GROUP_ID));
+
+	SysScanDesc scanDescriptor = systable_beginscan(pgDistTransaction,
+													DistTransactionGroupIndexId(),
+													indexOK,
+													NULL, scanKeyCount, scanKey);
+
+	while (HeapTupleIsValid(heapTuple = systable_getnext(scanDescriptor)))
+	{
+		bool isNull = false;
+		DistributedTransactionRecordKey recordKey;
+
+		Datum transactionNameDatum = heap_getattr(heapTuple,
+												  Anum_pg_dist_transaction_gid,
+												  tupleDescriptor, &isNull);
+		char *transactionName = TextDatumGetCString(transactionNameDatum);
+
+		if (!ParseDistributedTransactionRecordKey(transactionName, &recordKey))
+		{
+			continue;
+		}
+
+		bool found = false;
+		ResolvedTransactionRecord *resolvedRecord =
+			hash_search(resolvedRecordHash, &recordKey, HASH_FIND, &found);
+
+		if (found && resolvedRecord->resolvedNodeCount == recoveredNodeCount)
+		{
+			simple_heap_delete(pgDistTransaction, &heapTuple->t_self);
+		}
+	}
+
+	CommandCounterIncrement();
+	systable_endscan(scanDescriptor);
+	table_close(pgDistTransaction, NoLock);
+}
+
+
 /*
  * PendingWorkerTransactionList returns a list of pending prepared
  * transactions on a remote node that were started by this node.
@@ -150,6 +150,7 @@ CopyNodeDistributedSubPlan(COPYFUNC_ARGS)
 	COPY_SCALAR_FIELD(subPlanId);
 	COPY_NODE_FIELD(plan);
 	COPY_SCALAR_FIELD(bytesSentPerWorker);
+	COPY_SCALAR_FIELD(binaryFormat);
 	COPY_SCALAR_FIELD(remoteWorkerCount);
 	COPY_SCALAR_FIELD(durationMillisecs);
 	COPY_SCALAR_FIELD(writeLocalFile);
@@ -217,6 +217,7 @@ OutDistributedSubPlan(OUTFUNC_ARGS)
 	WRITE_UINT_FIELD(subPlanId);
 	WRITE_NODE_FIELD(plan);
 	WRITE_UINT64_FIELD(bytesSentPerWorker);
+	WRITE_BOOL_FIELD(binaryFormat);
 	WRITE_INT_FIELD(remoteWorkerCount);
 	WRITE_FLOAT_FIELD(durationMillisecs, "%.2f");
 	WRITE_BOOL_FIELD(writeLocalFile);
@@ -47,6 +47,7 @@
 #include "citus_version.h"
 #include "pg_version_constants.h"
 
+#include "distributed/async_commit.h"
 #include "distributed/background_jobs.h"
 #include "distributed/background_worker_utils.h"
 #include "distributed/citus_safe_lib.h"
@@ -57,9 +58,11 @@
 #include "distributed/metadata_sync.h"
 #include "distributed/resource_lock.h"
 #include "distributed/shard_cleaner.h"
+#include "distributed/shared_library_init.h"
 #include "distributed/stats/query_stats.h"
 #include "distributed/transaction_recovery.h"
 #include "distributed/version_compat.h"
+#include "distributed/worker_connection_pool.h"
 
 /*
  * Shared memory data for all maintenance workers.
@@ -91,6 +94,9 @@ typedef struct MaintenanceDaemonDBData
 	bool daemonStarted;
 	bool triggerNodeMetadataSync;
 	Latch *latch; /* pointer to the background worker's latch */
+
+	/* whether 2PC recovery resolved all primary nodes since the server started */
+	bool twoPhaseCommitsRecovered;
 } MaintenanceDaemonDBData;
 
 /* config variable for distributed deadlock detection timeout */
@@ -104,6 +110,7 @@ char *MainDb = "";
 /* config variables for metadata sync timeout */
 int MetadataSyncInterval = 60000;
 int MetadataSyncRetryInterval = 5000;
+int ColumnarCompactionInterval = -1;
 
 static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
 static MaintenanceDaemonControlData *MaintenanceDaemonControl = NULL;
@@ -462,6 +469,7 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 	Oid databaseOid = DatumGetObjectId(main_arg);
 	TimestampTz lastRecoveryTime = 0;
 	TimestampTz lastShardCleanTime = 0;
+	TimestampTz lastColumnarCompactionTime = 0;
 	TimestampTz lastStatStatementsPurgeTime = 0;
 	TimestampTz nextMetadataSyncTime = 0;
 
@@ -470,6 +478,11 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 	BackgroundWorkerHandle *backgroundTasksQueueBgwHandle = NULL;
 	bool backgroundTasksQueueWarnedForLock = false;
 
+	/* the worker connection pooler runs while citus.worker_connection_pool_size is set */
+	BackgroundWorkerHandle *workerConnectionPoolerBgwHandle = NULL;
+
+	/* the async commit worker runs while citus.async_commit_prepared is enabled */
+	BackgroundWorkerHandle *asyncCommitBgwHandle = NULL;
 
 	/*
 	 * We do metadata sync in a separate background worker. We need its
@@ -711,6 +724,44 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 			timeout = Min(timeout, DeferShardDeleteInterval);
 		}
 
+		if (!RecoveryInProgress() && ColumnarCompactionInterval > 0 &&
+			extern_TryCompactColumnarTables != NULL &&
+			TimestampDifferenceExceeds(lastColumnarCompactionTime, GetCurrentTimestamp(),
+									   ColumnarCompactionInterval))
+		{
+			int numberOfCompactedTables = 0;
+
+			InvalidateMetadataSystemCache();
+			StartTransactionCommand();
+
+			if (!LockCitusExtension())
+			{
+				ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+										"skipping columnar compaction")));
+			}
+			else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+			{
+				/*
+				 * Record last compaction time at start to ensure we run once per
+				 * ColumnarCompactionInterval.
+				 */
+				lastColumnarCompactionTime = GetCurrentTimestamp();
+
+				numberOfCompactedTables = extern_TryCompactColumnarTables();
+			}
+
+			CommitTransactionCommand();
+
+			if (numberOfCompactedTables > 0)
+			{
+				ereport(LOG, (errmsg("maintenance daemon compacted the stripes of "
+									 "%d columnar tables", numberOfCompactedTables)));
+			}
+
+			/* make sure we don't wait too long */
+			timeout = Min(timeout, ColumnarCompactionInterval);
+		}
+
 		if (StatStatementsPurgeInterval > 0 &&
 			StatStatementsTrack != STAT_STATEMENTS_TRACK_NONE &&
 			TimestampDifferenceExceeds(lastStatStatementsPurgeTime, GetCurrentTimestamp(),
@@ -842,6 +893,109 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 			timeout = Min(timeout, BackgroundTaskQueueCheckInterval);
 		}
 
+		pid_t workerConnectionPoolerPid = 0;
+		BgwHandleStatus workerConnectionPoolerStatus =
+			workerConnectionPoolerBgwHandle != NULL ? GetBackgroundWorkerPid(
+				workerConnectionPoolerBgwHandle, &workerConnectionPoolerPid) :
+			BGWH_STOPPED;
+		if (!RecoveryInProgress() && WorkerConnectionPoolSize > 0 &&
+			workerConnectionPoolerStatus == BGWH_STOPPED &&
+			!WorkerConnectionPoolerRunning(MyDatabaseId))
+		{
+			if (workerConnectionPoolerBgwHandle)
+			{
+				pfree(workerConnectionPoolerBgwHandle);
+				workerConnectionPoolerBgwHandle = NULL;
+			}
+
+			StartTransactionCommand();
+
+			bool shouldStartWorkerConnectionPooler = false;
+			if (!LockCitusExtension())
+			{
+				ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+										"skipping worker connection pooler start")));
+			}
+			else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+			{
+				shouldStartWorkerConnectionPooler = true;
+			}
+
+			CommitTransactionCommand();
+
+			if (shouldStartWorkerConnectionPooler)
+			{
+				ereport(LOG, (errmsg("starting worker connection pooler")));
+
+				workerConnectionPoolerBgwHandle =
+					StartWorkerConnectionPooler(MyDatabaseId, myDbData->userOid);
+
+				if (!workerConnectionPoolerBgwHandle ||
+					GetBackgroundWorkerPid(workerConnectionPoolerBgwHandle,
+										   &workerConnectionPoolerPid) ==
+					BGWH_STOPPED)
+				{
+					ereport(WARNING, (errmsg("unable to start background worker for "
+											 "the worker connection pool")));
+				}
+			}
+		}
+
+		pid_t asyncCommitWorkerPid = 0;
+		BgwHandleStatus asyncCommitWorkerStatus =
+			asyncCommitBgwHandle != NULL ? GetBackgroundWorkerPid(
+				asyncCommitBgwHandle, &asyncCommitWorkerPid) :
+			BGWH_STOPPED;
+
+		/*
+		 * Also start the async commit worker when the setting was disabled in
+		 * the meantime but prepared transactions are still queued, backends
+		 * wait for those to be committed.
+		 */
+		if (!RecoveryInProgress() &&
+			((AsyncCommitPrepared && Recover2PCInterval > 0) ||
+			 HasQueuedAsyncCommits()) &&
+			asyncCommitWorkerStatus == BGWH_STOPPED &&
+			!AsyncCommitWorkerRunning(MyDatabaseId))
+		{
+			if (asyncCommitBgwHandle)
+			{
+				pfree(asyncCommitBgwHandle);
+				asyncCommitBgwHandle = NULL;
+			}
+
+			StartTransactionCommand();
+
+			bool shouldStartAsyncCommitWorker = false;
+			if (!LockCitusExtension())
+			{
+				ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+										"skipping async commit worker start")));
+			}
+			else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+			{
+				shouldStartAsyncCommitWorker = true;
+			}
+
+			CommitTransactionCommand();
+
+			if (shouldStartAsyncCommitWorker)
+			{
+				ereport(LOG, (errmsg("starting async commit worker")));
+
+				asyncCommitBgwHandle =
+					StartAsyncCommitWorker(MyDatabaseId, myDbData->userOid);
+
+				if (!asyncCommitBgwHandle ||
+					GetBackgroundWorkerPid(asyncCommitBgwHandle,
+										   &asyncCommitWorkerPid) == BGWH_STOPPED)
+				{
+					ereport(WARNING, (errmsg("unable to start background worker for "
+											 "async commits")));
+				}
+			}
+		}
+
 		/*
 		 * Wait until timeout, or until somebody wakes us up. Also cast the timeout to
 		 * integer where we've calculated it using double for not losing the precision.
@@ -1150,6 +1304,59 @@ TriggerNodeMetadataSync(Oid databaseId)
 }
 
 
+/*
+ * MarkTwoPhaseCommitsRecovered records that 2PC recovery resolved the
+ * prepared transactions on all primary nodes for the given database. The
+ * flag is kept in shared memory, so it is reset when the server restarts.
+ */
+void
+MarkTwoPhaseCommitsRecovered(Oid databaseId)
+{
+	bool found = false;
+
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
+
+	MaintenanceDaemonDBData *dbData = (MaintenanceDaemonDBData *) hash_search(
+		MaintenanceDaemonDBHash,
+		&databaseId,
+		HASH_FIND, &found);
+	if (found)
+	{
+		dbData->twoPhaseCommitsRecovered = true;
+	}
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+}
+
+
+/*
+ * TwoPhaseCommitsRecovered returns whether 2PC recovery resolved the prepared
+ * transactions on all primary nodes for the given database since the server
+ * started.
+ */
+bool
+TwoPhaseCommitsRecovered(Oid databaseId)
+{
+	bool found = false;
+	bool twoPhaseCommitsRecovered = false;
+
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_SHARED);
+
+	MaintenanceDaemonDBData *dbData = (MaintenanceDaemonDBData *) hash_search(
+		MaintenanceDaemonDBHash,
+		&databaseId,
+		HASH_FIND, &found);
+	if (found)
+	{
+		twoPhaseCommitsRecovered = dbData->twoPhaseCommitsRecovered;
+	}
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+
+	return twoPhaseCommitsRecovered;
+}
+
+
 /*
  * MetadataSyncTriggeredCheckAndReset checks if metadata sync has been
  * triggered for the given database, and resets the flag.
@@ -21,6 +21,7 @@
 #include "utils/memutils.h"
 
 #include "distributed/commands/multi_copy.h"
+#include "distributed/intermediate_result_compression.h"
 #include "distributed/multi_executor.h"
 #include "distributed/transmit.h"
 #include "distributed/version_compat.h"
@@ -29,6 +30,12 @@
 
 #define COPY_BUFFER_SIZE (4 * 1024 * 1024)
 
+/* bytes of COPY data that the partitions of a result buffer in total */
+#define PARTITIONED_RESULT_BUFFER_SIZE (8 * 1024 * 1024)
+
+/* minimum bytes of COPY data that a partition buffers before writing */
+#define MIN_PARTITION_BUFFER_SIZE (16 * 1024)
+
 /* TaskFileDestReceiver can be used to stream results into a file */
 typedef struct TaskFileDestReceiver
 {
@@ -49,6 +56,16 @@ typedef struct TaskFileDestReceiver
 	FileCompat fileCompat;
 	bool binaryCopyFormat;
 
+	/* method used to compress the COPY data in the file */
+	int compressionType;
+
+	/* bytes of COPY data to buffer before writing, and the limit if set */
+	int bufferSize;
+	int maxBufferSize;
+
+	/* buffer for compressing the COPY data, may be shared with other receivers */
+	StringInfo compressionBuffer;
+
 	/* state on how to copy out data types */
 	CopyOutState copyOutState;
 	FmgrInfo *columnOutputFunctions;
@@ -62,6 +79,7 @@ typedef struct TaskFileDestReceiver
 static void TaskFileDestReceiverStartup(DestReceiver *dest, int operation,
 										TupleDesc inputTupleDescriptor);
 static bool TaskFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest);
+static void FlushCopyData(StringInfo copyData, TaskFileDestReceiver *taskFileDest);
 static void WriteToLocalFile(StringInfo copyData, TaskFileDestReceiver *taskFileDest);
 static void TaskFileDestReceiverShutdown(DestReceiver *destReceiver);
 static void TaskFileDestReceiverDestroy(DestReceiver *destReceiver);
@@ -111,6 +129,30 @@ CreateFileDestReceiver(char *filePath, MemoryContext tupleContext, bool binaryCo
 }
 
 
+/*
+ * ShareFileDestReceiverBuffers makes the given file dest receivers, which
+ * write the partitions of the same result, compress their COPY data in a
+ * single buffer and divides PARTITIONED_RESULT_BUFFER_SIZE among them for
+ * buffering the COPY data, such that the memory use does not grow with the
+ * number of partitions. Should be called before the receivers start up.
+ */
+void
+ShareFileDestReceiverBuffers(DestReceiver **dests, int destCount)
+{
+	StringInfo compressionBuffer = makeStringInfo();
+	int maxBufferSize = Max(PARTITIONED_RESULT_BUFFER_SIZE / Max(destCount, 1),
+							MIN_PARTITION_BUFFER_SIZE);
+
+	for (int destIndex = 0; destIndex < destCount; destIndex++)
+	{
+		TaskFileDestReceiver *taskFileDest = (TaskFileDestReceiver *) dests[destIndex];
+
+		taskFileDest->maxBufferSize = maxBufferSize;
+		taskFileDest->compressionBuffer = compressionBuffer;
+	}
+}
+
+
 /*
  * TaskFileDestReceiverStartup implements the rStartup interface of
  * TaskFileDestReceiver. It opens the destination file and sets up
@@ -149,6 +191,33 @@ TaskFileDestReceiverStartup(DestReceiver *dest, int operation,
 														   taskFileDest->filePath,
 														   fileFlags));
 
+	taskFileDest->compressionType = IntermediateResultCompression;
+	taskFileDest->bufferSize = COPY_BUFFER_SIZE;
+
+	if (taskFileDest->compressionType != INTERMEDIATE_RESULT_COMPRESSION_NONE)
+	{
+		taskFileDest->bufferSize = INTERMEDIATE_RESULT_COMPRESSION_CHUNK_SIZE;
+
+		if (taskFileDest->compressionBuffer == NULL)
+		{
+			taskFileDest->compressionBuffer = makeStringInfo();
+		}
+	}
+
+	if (taskFileDest->maxBufferSize > 0)
+	{
+		taskFileDest->bufferSize = Min(taskFileDest->bufferSize,
+									   taskFileDest->maxBufferSize);
+	}
+
+	if (taskFileDest->compressionType != INTERMEDIATE_RESULT_COMPRESSION_NONE)
+	{
+		/* mark the file as compressed, the COPY data follows in chunks */
+		StringInfo signature = makeStringInfo();
+		AppendCompressedResultSignature(signature);
+		WriteToLocalFile(signature, taskFileDest);
+	}
+
 	if (copyOutState->binary)
 	{
 		/* write headers when using binary encoding */
@@ -188,9 +257,9 @@ TaskFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 	AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
 					  copyOutState, columnOutputFunctions, NULL);
 
-	if (copyData->len > COPY_BUFFER_SIZE)
+	if (copyData->len > taskFileDest->bufferSize)
 	{
-		WriteToLocalFile(copyOutState->fe_msgbuf, taskFileDest);
+		FlushCopyData(copyOutState->fe_msgbuf, taskFileDest);
 		resetStringInfo(copyData);
 	}
 
@@ -204,6 +273,29 @@ TaskFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 }
 
 
+/*
+ * FlushCopyData writes the buffered COPY data to the file, as a compressed
+ * chunk when compression is enabled.
+ */
+static void
+FlushCopyData(StringInfo copyData, TaskFileDestReceiver *taskFileDest)
+{
+	if (taskFileDest->compressionType == INTERMEDIATE_RESULT_COMPRESSION_NONE)
+	{
+		WriteToLocalFile(copyData, taskFileDest);
+		return;
+	}
+
+	StringInfo chunk = taskFileDest->compressionBuffer;
+	resetStringInfo(chunk);
+
+	AppendCompressedResultChunk(chunk, copyData->data, copyData->len,
+								taskFileDest->compressionType);
+
+	WriteToLocalFile(chunk, taskFileDest);
+}
+
+
 /*
  * WriteToLocalResultsFile writes the bytes in a StringInfo to a local file.
  */
@@ -233,17 +325,15 @@ TaskFileDestReceiverShutdown(DestReceiver *destReceiver)
 	TaskFileDestReceiver *taskFileDest = (TaskFileDestReceiver *) destReceiver;
 	CopyOutState copyOutState = taskFileDest->copyOutState;
 
-	if (copyOutState->fe_msgbuf->len > 0)
-	{
-		WriteToLocalFile(copyOutState->fe_msgbuf, taskFileDest);
-		resetStringInfo(copyOutState->fe_msgbuf);
-	}
-
 	if (copyOutState->binary)
 	{
 		/* write footers when using binary encoding */
 		AppendCopyBinaryFooters(copyOutState);
-		WriteToLocalFile(copyOutState->fe_msgbuf, taskFileDest);
+	}
+
+	if (copyOutState->fe_msgbuf->len > 0)
+	{
+		FlushCopyData(copyOutState->fe_msgbuf, taskFileDest);
 		resetStringInfo(copyOutState->fe_msgbuf);
 	}
 
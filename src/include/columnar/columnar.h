@@ -17,6 +17,7 @@
 
 #include "lib/stringinfo.h"
 #include "nodes/parsenodes.h"
+#include "port/atomics.h"
 #include "storage/bufpage.h"
 #include "storage/lockdefs.h"
 #include "storage/relfilelocator.h"
@@ -26,6 +27,7 @@
 #include "pg_version_compat.h"
 
 #include "columnar/columnar_compression.h"
+#include "columnar/columnar_encoding.h"
 #include "columnar/columnar_metadata.h"
 
 #define COLUMNAR_AM_NAME "columnar"
@@ -37,6 +39,7 @@
 #define OPTION_NAME_COMPRESSION_TYPE "compression"
 #define OPTION_NAME_STRIPE_ROW_COUNT "stripe_row_limit"
 #define OPTION_NAME_CHUNK_ROW_COUNT "chunk_group_row_limit"
+#define OPTION_NAME_BLOOM_FILTER_COLUMNS "bloom_filter_columns"
 
 /* Limits for option parameters */
 #define STRIPE_ROW_COUNT_MINIMUM 1000
@@ -78,6 +81,9 @@ typedef struct ColumnarOptions
 	uint32 chunkRowCount;
 	CompressionType compressionType;
 	int compressionLevel;
+
+	/* comma-separated list of columns to build bloom filters for, or NULL */
+	char *bloomFilterColumns;
 } ColumnarOptions;
 
 
@@ -108,6 +114,12 @@ typedef struct ColumnChunkSkipNode
 
 	CompressionType valueCompressionType;
 	int valueCompressionLevel;
+
+	/* lightweight encoding applied to the values before compression */
+	EncodingType valueEncodingType;
+
+	/* bloom filter of the values, NULL if not enabled for the column */
+	bytea *bloomFilter;
 } ColumnChunkSkipNode;
 
 
@@ -125,6 +137,21 @@ typedef struct StripeSkipList
 } StripeSkipList;
 
 
+/*
+ * StripeSummary contains the minimum and maximum values of each column in a
+ * stripe, so that a stripe can be skipped without reading its skip list.
+ * hasMinMax[column] is false if the column has no comparison function or if
+ * all its values in the stripe are NULL.
+ */
+typedef struct StripeSummary
+{
+	bool *hasMinMax;
+	Datum *minimumValues;
+	Datum *maximumValues;
+	uint32 columnCount;
+} StripeSummary;
+
+
 /*
  * ChunkData represents a chunk of data for multiple columns. valueArray stores
  * the values of data, and existsArray stores whether a value is present.
@@ -146,6 +173,12 @@ typedef struct ChunkData
 
 	/* valueBuffer keeps actual data for type-by-reference datums from valueArray. */
 	StringInfo *valueBufferArray;
+
+	/*
+	 * Distinct values of the dictionary or run-length encoded columns, NULL
+	 * for the other columns. Only set when reading.
+	 */
+	ChunkColumnDictionary **dictionaryArray;
 } ChunkData;
 
 
@@ -161,7 +194,11 @@ typedef struct ColumnChunkBuffers
 	StringInfo existsBuffer;
 	StringInfo valueBuffer;
 	CompressionType valueCompressionType;
+	EncodingType valueEncodingType;
 	uint64 decompressedValueSize;
+
+	/* whether to add the decompressed value buffer to the chunk cache */
+	bool cacheValueBuffer;
 } ColumnChunkBuffers;
 
 
@@ -182,7 +219,19 @@ typedef struct StripeBuffers
 	uint32 rowCount;
 	ColumnBuffers **columnBuffersArray;
 
+	uint32 selectedChunkGroupCount;
 	uint32 *selectedChunkGroupRowCounts;
+
+	/* indexes of the selected chunk groups in the stripe */
+	uint32 *selectedChunkGroupIndexes;
+
+	/* offsets of the first rows of the selected chunk groups in the stripe */
+	uint64 *selectedChunkGroupRowOffsets;
+
+	/* identify the chunks of the stripe in the chunk cache */
+	bool useChunkCache;
+	uint64 storageId;
+	uint64 stripeId;
 } StripeBuffers;
 
 
@@ -206,15 +255,44 @@ typedef enum StripeWriteStateEnum
 	STRIPE_WRITE_IN_PROGRESS
 } StripeWriteStateEnum;
 
+/* return value of ColumnarMarkRowDeleted */
+typedef enum ColumnarDeleteResult
+{
+	/* row is marked as deleted by the current subtransaction */
+	COLUMNAR_DELETE_OK,
+
+	/* row was already deleted by the current transaction, not flushed yet */
+	COLUMNAR_DELETE_SELF_DELETED,
+
+	/*
+	 * Row was deleted by another transaction, by a command of the current
+	 * transaction whose deletes were flushed already, or its stripe was
+	 * removed by VACUUM.
+	 */
+	COLUMNAR_DELETE_ALREADY_DELETED
+} ColumnarDeleteResult;
+
 typedef bool (*ColumnarSupportsIndexAM_type)(char *);
 typedef const char *(*CompressionTypeStr_type)(CompressionType);
 typedef bool (*IsColumnarTableAmTable_type)(Oid);
 typedef bool (*ReadColumnarOptions_type)(Oid, ColumnarOptions *);
+typedef int (*TryCompactColumnarTables_type)(void);
 
 /* ColumnarReadState represents state of a columnar scan. */
 struct ColumnarReadState;
 typedef struct ColumnarReadState ColumnarReadState;
 
+/*
+ * ColumnarCoveredChunkGroupCallback is called for the chunk groups whose rows
+ * are all known to satisfy the where clauses of a read. It returns true if it
+ * could process the chunk group using its skip nodes only, in which case the
+ * chunk group is not read.
+ */
+typedef bool (*ColumnarCoveredChunkGroupCallback)(StripeMetadata *stripeMetadata,
+												  StripeSkipList *stripeSkipList,
+												  uint32 chunkIndex,
+												  void *callbackArg);
+
 
 /* ColumnarWriteState represents state of a columnar write operation. */
 struct ColumnarWriteState;
@@ -225,6 +303,10 @@ extern int columnar_compression;
 extern int columnar_stripe_row_limit;
 extern int columnar_chunk_group_row_limit;
 extern int columnar_compression_level;
+extern bool columnar_enable_vector_filter;
+extern bool columnar_enable_column_encodings;
+extern double columnar_vacuum_rewrite_threshold;
+extern int columnar_chunk_cache_size;
 
 /* called when the user changes options on the given relation */
 typedef void (*ColumnarTableSetOptions_hook_type)(Oid relid, ColumnarOptions options);
@@ -244,6 +326,7 @@ extern void ColumnarFlushPendingWrites(ColumnarWriteState *state);
 extern void ColumnarEndWrite(ColumnarWriteState *state);
 extern bool ContainsPendingWrites(ColumnarWriteState *state);
 extern MemoryContext ColumnarWritePerTupleContext(ColumnarWriteState *state);
+extern void ColumnarWriteReuseDataRanges(ColumnarWriteState *state, List *rangeList);
 
 /* Function declarations for reading from columnar table */
 
@@ -254,7 +337,8 @@ extern ColumnarReadState * ColumnarBeginRead(Relation relation,
 											 List *qualConditions,
 											 MemoryContext scanContext,
 											 Snapshot snaphot,
-											 bool randomAccess);
+											 bool randomAccess,
+											 pg_atomic_uint64 *parallelStripeCursor);
 extern void ColumnarReadFlushPendingWrites(ColumnarReadState *readState);
 extern void ColumnarEndRead(ColumnarReadState *state);
 extern void ColumnarResetRead(ColumnarReadState *readState);
@@ -263,7 +347,16 @@ extern void ColumnarResetRead(ColumnarReadState *readState);
 extern bool ColumnarReadNextRow(ColumnarReadState *state, Datum *columnValues,
 								bool *columnNulls, uint64 *rowNumber);
 extern int64 ColumnarReadChunkGroupsFiltered(ColumnarReadState *state);
+extern int64 ColumnarReadStripesFiltered(ColumnarReadState *state);
+extern int64 ColumnarReadStripesRead(ColumnarReadState *state);
+extern int64 ColumnarReadStripesPrefetched(ColumnarReadState *state);
+extern int64 ColumnarReadChunkGroupsVectorFiltered(ColumnarReadState *state);
+extern int64 ColumnarReadVectorFilteredRows(ColumnarReadState *state);
 extern void ColumnarRescan(ColumnarReadState *readState, List *scanQual);
+extern void ColumnarReadSetCoveredChunkGroupCallback(ColumnarReadState *readState,
+													 ColumnarCoveredChunkGroupCallback
+													 callback, void *callbackArg);
+extern int64 ColumnarReadChunkGroupsCovered(ColumnarReadState *state);
 
 /* functions only applicable for random access */
 extern void ColumnarReadRowByRowNumberOrError(ColumnarReadState *readState,
@@ -282,6 +375,14 @@ extern void FreeChunkData(ChunkData *chunkData);
 extern uint64 ColumnarTableRowCount(Relation relation);
 extern PGDLLEXPORT const char * CompressionTypeStr(CompressionType type);
 
+/* columnar_vector_filter.c */
+extern List * BuildColumnarVectorFilters(List *whereClauseList,
+										 TupleDesc tupleDescriptor);
+extern uint32 ApplyColumnarVectorFilters(List *vectorFilterList, ChunkData *chunkData,
+										 bool *selectedRows);
+extern List * ColumnarVectorFilterColumnList(List *vectorFilterList,
+											 List *projectedColumnList);
+
 /* columnar_metadata_tables.c */
 extern PGDLLEXPORT void InitColumnarOptions(Oid regclass);
 extern PGDLLEXPORT void SetColumnarOptions(Oid regclass, ColumnarOptions *options);
@@ -289,25 +390,41 @@ extern PGDLLEXPORT bool DeleteColumnarTableOptions(Oid regclass, bool missingOk)
 extern PGDLLEXPORT bool ReadColumnarOptions(Oid regclass, ColumnarOptions *options);
 extern PGDLLEXPORT bool IsColumnarTableAmTable(Oid relationId);
 
+/* columnar_tableam.c */
+extern PGDLLEXPORT int TryCompactColumnarTables(void);
+
 /* columnar_metadata_tables.c */
 extern void DeleteMetadataRows(Relation rel);
 extern uint64 ColumnarMetadataNewStorageId(void);
 extern uint64 GetHighestUsedAddress(Relation rel);
+extern List * ReusableDataRanges(Relation rel);
 extern EmptyStripeReservation * ReserveEmptyStripe(Relation rel, uint64 columnCount,
 												   uint64 chunkGroupRowCount,
 												   uint64 stripeRowCount);
 extern StripeMetadata * CompleteStripeReservation(Relation rel, uint64 stripeId,
 												  uint64 sizeBytes, uint64 rowCount,
-												  uint64 chunkCount);
+												  uint64 chunkCount,
+												  List *reusableDataRanges);
 extern void SaveStripeSkipList(Oid relid, RelFileLocator relfilelocator, uint64 stripe,
 							   StripeSkipList *stripeSkipList,
 							   TupleDesc tupleDescriptor);
 extern void SaveChunkGroups(Oid relid, RelFileLocator relfilelocator, uint64 stripe,
 							List *chunkGroupRowCounts);
+extern void SaveStripeSummary(Oid relid, RelFileLocator relfilelocator, uint64 stripe,
+							  StripeSummary *stripeSummary,
+							  TupleDesc tupleDescriptor);
 extern StripeSkipList * ReadStripeSkipList(Relation rel, uint64 stripe,
 										   TupleDesc tupleDescriptor,
 										   uint32 chunkCount,
 										   Snapshot snapshot);
+extern StripeSummary * ReadStripeSummary(Relation rel, uint64 stripe,
+										 TupleDesc tupleDescriptor,
+										 Snapshot snapshot);
+extern void SaveStripeRowMask(Oid relid, RelFileLocator relfilelocator, uint64 stripe,
+							  uint64 stripeRowCount, bytea *deletedRows);
+extern bytea * ReadStripeRowMask(Relation rel, uint64 stripe, Snapshot snapshot);
+extern uint64 ReadDeletedRowCount(Relation rel, Snapshot snapshot);
+extern void DeleteStripeMetadataRows(Relation rel, uint64 stripe);
 extern StripeMetadata * FindNextStripeByRowNumber(Relation relation, uint64 rowNumber,
 												  Snapshot snapshot);
 extern StripeMetadata * FindStripeByRowNumber(Relation relation, uint64 rowNumber,
@@ -339,6 +456,11 @@ extern void MarkRelfilenumberDropped(RelFileNumber relfilenumber,
 extern void NonTransactionDropWriteState(RelFileNumber relfilenumber);
 extern bool PendingWritesInUpperTransactions(RelFileNumber relfilenumber,
 											 SubTransactionId currentSubXid);
+extern bool PendingWritesInSubTransaction(RelFileNumber relfilenumber,
+										  SubTransactionId subXid);
+extern ColumnarDeleteResult ColumnarMarkRowDeleted(Relation relation, uint64 rowNumber,
+												   SubTransactionId currentSubXid);
+extern bool PendingDeleteInTransaction(RelFileNumber relfilenumber, uint64 rowNumber);
 extern MemoryContext GetWriteContextForDebug(void);
 
 #endif /* COLUMNAR_H */
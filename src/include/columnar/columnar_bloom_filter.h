@@ -0,0 +1,25 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_bloom_filter.h
+ *
+ * Type and function declarations for columnar chunk bloom filters.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef COLUMNAR_BLOOM_FILTER_H
+#define COLUMNAR_BLOOM_FILTER_H
+
+#include "fmgr.h"
+#include "nodes/pg_list.h"
+
+extern List * ParseBloomFilterColumnList(const char *bloomFilterColumns);
+extern FmgrInfo * BloomFilterHashFunctionOrNull(Oid typeId);
+extern uint64 BloomFilterHashDatum(FmgrInfo *hashFunction, Oid collation,
+								   Datum value);
+extern bytea * BuildBloomFilter(uint64 *hashArray, uint32 hashCount);
+extern bool BloomFilterMightContain(bytea *bloomFilter, uint64 hash);
+
+#endif /* COLUMNAR_BLOOM_FILTER_H */
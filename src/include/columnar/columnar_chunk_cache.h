@@ -0,0 +1,28 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_chunk_cache.h
+ *
+ * Declarations for the cache of decompressed column chunks that is shared
+ * between the backends.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef COLUMNAR_CHUNK_CACHE_H
+#define COLUMNAR_CHUNK_CACHE_H
+
+#include "postgres.h"
+
+#include "lib/stringinfo.h"
+
+extern void InitializeColumnarChunkCache(void);
+extern bool ColumnarChunkCacheEnabled(void);
+extern StringInfo ColumnarChunkCacheLookup(uint64 storageId, uint64 stripeId,
+										   uint32 columnIndex, uint64 chunkGroupIndex);
+extern void ColumnarChunkCacheInsert(uint64 storageId, uint64 stripeId,
+									 uint32 columnIndex, uint64 chunkGroupIndex,
+									 StringInfo valueBuffer);
+
+#endif /* COLUMNAR_CHUNK_CACHE_H */
@@ -0,0 +1,55 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_encoding.h
+ *
+ * Type and function declarations for lightweight column encodings.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef COLUMNAR_ENCODING_H
+#define COLUMNAR_ENCODING_H
+
+#include "access/tupdesc.h"
+#include "lib/stringinfo.h"
+
+/* Enumaration for the encoding of a column chunk's values */
+typedef enum
+{
+	ENCODING_TYPE_INVALID = -1,
+	ENCODING_NONE = 0,
+	ENCODING_DICTIONARY = 1,
+	ENCODING_RLE = 2,
+	ENCODING_DELTA = 3,
+	ENCODING_FOR = 4,
+
+	ENCODING_COUNT
+} EncodingType;
+
+
+/*
+ * ChunkColumnDictionary contains the distinct values (dictionary encoding)
+ * or the run values (run-length encoding) of a column chunk, and the index of
+ * the entry that each row maps to. This allows evaluating a qual once per
+ * entry instead of once per row. entryIndexes is only valid for the rows where
+ * the column is not NULL.
+ */
+typedef struct ChunkColumnDictionary
+{
+	uint32 entryCount;
+	Datum *entries;
+	uint32 *entryIndexes;
+} ChunkColumnDictionary;
+
+
+extern EncodingType EncodeValueBuffer(StringInfo valueBuffer, uint32 valueCount,
+									  Form_pg_attribute attributeForm,
+									  StringInfo outputBuffer);
+extern void DecodeDatumArray(StringInfo encodedBuffer, EncodingType encodingType,
+							 bool *existsArray, uint32 datumCount,
+							 Form_pg_attribute attributeForm, Datum *datumArray,
+							 ChunkColumnDictionary **dictionary);
+
+#endif /* COLUMNAR_ENCODING_H */
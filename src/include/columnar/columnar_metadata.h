@@ -57,6 +57,16 @@ typedef struct EmptyStripeReservation
 	uint64 stripeFirstRowNumber;
 } EmptyStripeReservation;
 
+/*
+ * ColumnarDataRange represents a range of logical offsets in the storage of a
+ * columnar table.
+ */
+typedef struct ColumnarDataRange
+{
+	uint64 logicalOffset;
+	uint64 length;
+} ColumnarDataRange;
+
 extern List * StripesForRelfilelocator(Relation rel);
 extern void ColumnarStorageUpdateIfNeeded(Relation rel, bool isUpgrade);
 extern List * ExtractColumnarRelOptions(List *inOptions, List **outColumnarOptions);
@@ -0,0 +1,24 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_row_mask.h
+ *
+ * Type and function declarations for the row masks that record the deleted
+ * rows of columnar stripes.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef COLUMNAR_ROW_MASK_H
+#define COLUMNAR_ROW_MASK_H
+
+#include "postgres.h"
+
+extern bytea * CreateRowMask(uint64 rowCount);
+extern void RowMaskSetRow(bytea *rowMask, uint64 rowOffset);
+extern bool RowMaskContainsRow(bytea *rowMask, uint64 rowOffset);
+extern void RowMaskUnion(bytea *targetRowMask, bytea *sourceRowMask);
+extern uint64 RowMaskCountRows(bytea *rowMask, uint64 firstRowOffset, uint64 rowCount);
+
+#endif /* COLUMNAR_ROW_MASK_H */
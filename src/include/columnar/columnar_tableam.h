@@ -57,7 +57,17 @@ extern TableScanDesc columnar_beginscan_extended(Relation relation, Snapshot sna
 												 ParallelTableScanDesc parallel_scan,
 												 uint32 flags, Bitmapset *attr_needed,
 												 List *scanQual);
+extern TableScanDesc columnar_beginscan_parallel_extended(Relation relation,
+														  ParallelTableScanDesc
+														  parallel_scan,
+														  Bitmapset *attr_needed,
+														  List *scanQual);
 extern int64 ColumnarScanChunkGroupsFiltered(ColumnarScanDesc columnarScanDesc);
+extern int64 ColumnarScanStripesFiltered(ColumnarScanDesc columnarScanDesc);
+extern int64 ColumnarScanStripesRead(ColumnarScanDesc columnarScanDesc);
+extern int64 ColumnarScanStripesPrefetched(ColumnarScanDesc columnarScanDesc);
+extern int64 ColumnarScanChunkGroupsVectorFiltered(ColumnarScanDesc columnarScanDesc);
+extern int64 ColumnarScanVectorFilteredRows(ColumnarScanDesc columnarScanDesc);
 extern PGDLLEXPORT bool ColumnarSupportsIndexAM(char *indexAMName);
 extern bool IsColumnarTableAmTable(Oid relationId);
 extern void CheckCitusColumnarCreateExtensionStmt(Node *parseTree);
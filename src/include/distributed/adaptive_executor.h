@@ -7,6 +7,8 @@
 extern bool ForceMaxQueryParallelization;
 extern int MaxAdaptiveExecutorPoolSize;
 extern bool EnableBinaryProtocol;
+extern bool EnablePipelinedExecution;
+extern bool EnableStreamingResults;
 
 
 /* GUC, number of ms to wait between opening connections to the same worker */
@@ -0,0 +1,34 @@
+/*-------------------------------------------------------------------------
+ *
+ * async_commit.h
+ *	  Hands the COMMIT PREPARED round of two-phase commits to a background
+ *	  worker.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef ASYNC_COMMIT_H
+#define ASYNC_COMMIT_H
+
+#include "postgres.h"
+
+#include "postmaster/bgworker.h"
+
+
+/* GUC, whether to return to the client before COMMIT PREPARED finished */
+extern bool AsyncCommitPrepared;
+
+
+extern size_t AsyncCommitShmemSize(void);
+extern void InitializeAsyncCommit(void);
+extern void DeferPreparedRemoteTransactionsCommit(void);
+extern void WaitForAsyncCommitPrepared(void);
+extern BackgroundWorkerHandle * StartAsyncCommitWorker(Oid database,
+													   Oid extensionOwner);
+extern bool AsyncCommitWorkerRunning(Oid database);
+extern bool HasQueuedAsyncCommits(void);
+extern PGDLLEXPORT void AsyncCommitWorkerMain(Datum arg);
+
+#endif /* ASYNC_COMMIT_H */
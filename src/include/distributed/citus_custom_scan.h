@@ -28,6 +28,16 @@ typedef struct CitusScanState
 	MultiExecutorType executorType;   /* distributed executor type */
 	bool finishedRemoteScan;          /* flag to check if remote scan is finished */
 	Tuplestorestate *tuplestorestate; /* tuple store to store distributed results */
+	int eflags;                       /* executor flags passed to BeginScan */
+
+	/*
+	 * When results are streamed, the tuple store only holds the rows that were
+	 * received since the scan last ran out of rows. streamingExecution is set
+	 * until all results are received, and resultsStreamed remains set such
+	 * that a rescan re-executes the distributed query.
+	 */
+	struct DistributedExecution *streamingExecution;
+	bool resultsStreamed;
 } CitusScanState;
 
 
@@ -117,6 +117,9 @@ typedef struct CitusCopyDestReceiver
 	CopyOutState copyOutState;
 	FmgrInfo *columnOutputFunctions;
 
+	/* buffer holding the current tuple in COPY format, shared by all placements */
+	StringInfo rowBuffer;
+
 	/* instructions for coercing incoming tuples */
 	CopyCoercionData *columnCoercionPaths;
 
@@ -155,6 +158,12 @@ typedef struct CitusCopyDestReceiver
 	 */
 	bool skipCoercions;
 
+	/*
+	 * When set, some columns are passed through as text without parsing them,
+	 * so tuples are always sent in text format.
+	 */
+	bool passThroughTextColumns;
+
 	/*
 	 * Determines whether the COPY command should track query stat counters.
 	 */
@@ -164,6 +173,7 @@ typedef struct CitusCopyDestReceiver
 
 /* GUCs */
 extern bool SkipJsonbValidationInCopy;
+extern bool EnableCopyPassThrough;
 
 /* managed via GUC, the default is 4MB */
 extern int CopySwitchOverThresholdBytes;
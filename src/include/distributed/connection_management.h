@@ -197,6 +197,12 @@ typedef struct MultiConnection
 	 */
 	bool useForMetadataOperations;
 
+	/*
+	 * Set when the connection was cached beyond citus.max_cached_conns_per_worker
+	 * at the end of the last transaction to keep it warm, see connection_warmup.c.
+	 */
+	bool keptWarm;
+
 	/* time connection establishment was started, for timeout and executor stats */
 	instr_time connectionEstablishmentStart;
 	instr_time connectionEstablishmentEnd;
@@ -223,6 +229,12 @@ typedef struct MultiConnection
 	/* replication option */
 	bool requiresReplication;
 
+	/* statements prepared over this connection, see remote_prepared_statements.c */
+	struct MemoryContextData *preparedStatementContext;
+	HTAB *preparedStatementHash;
+	uint64 preparedStatementGeneration;
+	uint32 preparedStatementCounter;
+
 	MultiConnectionStructInitializationState initializationState;
 } MultiConnection;
 
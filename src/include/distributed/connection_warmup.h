@@ -0,0 +1,30 @@
+/*-------------------------------------------------------------------------
+ *
+ * connection_warmup.h
+ *	  Keeps connections to worker nodes warm across transactions based on
+ *	  the recent per-node parallelism of the adaptive executor.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef CONNECTION_WARMUP_H
+#define CONNECTION_WARMUP_H
+
+#include "postgres.h"
+
+
+/* GUC, maximum number of connections to keep warm per worker node */
+extern int MaxWarmConnectionsPerWorker;
+
+
+extern size_t ConnectionWarmupShmemSize(void);
+extern void InitializeConnectionWarmup(void);
+extern int WarmConnectionCount(const char *hostname, int port);
+extern void RecordWorkerPoolConnectionUsage(const char *hostname, int port,
+											int parallelism, int newConnectionCount,
+											uint64 establishmentTime,
+											int warmConnectionCount);
+
+#endif /* CONNECTION_WARMUP_H */
@@ -38,7 +38,12 @@ typedef struct TransactionNode
 /* GUC, determining whether debug messages for deadlock detection sent to LOG */
 extern bool LogDistributedDeadlockDetection;
 
+/* GUC, determining whether nodes only report changes to their wait graph */
+extern bool IncrementalDeadlockDetection;
 
+
+extern size_t DeadlockDetectionStatsShmemSize(void);
+extern void InitializeDeadlockDetectionStats(void);
 extern bool CheckForDistributedDeadlocks(void);
 extern HTAB * BuildAdjacencyListsForWaitGraph(WaitGraph *waitGraph);
 extern char * WaitsForToString(List *waitsFor);
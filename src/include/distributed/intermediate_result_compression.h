@@ -0,0 +1,47 @@
+/*-------------------------------------------------------------------------
+ *
+ * intermediate_result_compression.h
+ *   Declarations for compressing intermediate result files.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef INTERMEDIATE_RESULT_COMPRESSION_H
+#define INTERMEDIATE_RESULT_COMPRESSION_H
+
+#include "postgres.h"
+
+#include "lib/stringinfo.h"
+
+
+/* number of bytes of COPY data that are compressed together */
+#define INTERMEDIATE_RESULT_COMPRESSION_CHUNK_SIZE (1024 * 1024)
+
+
+/*
+ * IntermediateResultCompressionType enumerates the methods that can be used
+ * to compress the chunks of an intermediate result file. The values are
+ * stored in the files and should therefore not be changed.
+ */
+typedef enum IntermediateResultCompressionType
+{
+	INTERMEDIATE_RESULT_COMPRESSION_NONE = 0,
+	INTERMEDIATE_RESULT_COMPRESSION_LZ4 = 1,
+	INTERMEDIATE_RESULT_COMPRESSION_ZSTD = 2
+} IntermediateResultCompressionType;
+
+
+/* GUC variable */
+extern int IntermediateResultCompression;
+
+
+extern void AppendCompressedResultSignature(StringInfo buffer);
+extern void AppendCompressedResultChunk(StringInfo buffer, const char *data,
+										int length, int compressionType);
+extern bool BeginCompressedResultRead(const char *fileName);
+extern int ReadCompressedResultData(void *outbuf, int minread, int maxread);
+extern void EndCompressedResultRead(void);
+
+#endif /* INTERMEDIATE_RESULT_COMPRESSION_H */
@@ -92,6 +92,7 @@ extern CitusTableCacheEntry * QueryTupleShardSearchInfo(ArrayType *minValuesArra
 														Var *partitionColumn);
 extern void WriteToLocalFile(StringInfo copyData, FileCompat *fileCompat);
 extern uint64 RemoteFileDestReceiverBytesSent(DestReceiver *destReceiver);
+extern bool RemoteFileDestReceiverUsesBinaryFormat(DestReceiver *destReceiver);
 extern void SendQueryResultViaCopy(const char *resultId);
 extern void ReceiveQueryResultViaCopy(const char *resultId);
 extern void RemoveIntermediateResultsDirectories(void);
@@ -62,7 +62,48 @@ typedef struct WaitGraph
 } WaitGraph;
 
 
+/*
+ * WaitGraphChanges describes how the local wait graph of distributed
+ * transactions changed since a node last polled it.
+ */
+typedef struct WaitGraphChanges
+{
+	/* whether addedEdges is the full graph, and earlier edges should be forgotten */
+	bool isFullGraph;
+
+	WaitGraph *addedEdges;
+	WaitGraph *removedEdges;
+} WaitGraphChanges;
+
+
+/*
+ * WaitGraphPollStats describes the work done by a single call to
+ * BuildIncrementalGlobalWaitGraph.
+ */
+typedef struct WaitGraphPollStats
+{
+	/* number of nodes polled, including the local node */
+	int nodeCount;
+
+	/* number of nodes that reported their full wait graph */
+	int fullGraphCount;
+
+	/* number of wait edges read, and number of edges that were new */
+	int64 edgesReceived;
+	int64 edgesAdded;
+} WaitGraphPollStats;
+
+
+/* GUC, number of polling nodes and databases for which we keep the wait graph */
+extern int MaxWaitGraphSnapshots;
+
 extern WaitGraph * BuildGlobalWaitGraph(bool onlyDistributedTx);
+extern WaitGraph * BuildIncrementalGlobalWaitGraph(WaitGraphPollStats *pollStats);
+extern WaitGraphChanges * LocalWaitGraphChanges(int32 requesterNodeId,
+												uint64 sinceVersion,
+												uint64 newVersion);
+extern size_t WaitGraphSnapshotShmemSize(void);
+extern void InitializeWaitGraphSnapshots(void);
 extern bool IsProcessWaitingForLock(PGPROC *proc);
 extern bool IsInDistributedTransaction(BackendData *backendData);
 extern TimestampTz ParseTimestampTzField(PGresult *result, int rowIndex, int colIndex);
@@ -21,9 +21,12 @@
 /* config variable for */
 extern double DistributedDeadlockDetectionTimeoutFactor;
 extern char *MainDb;
+extern int ColumnarCompactionInterval;
 
 extern void StopMaintenanceDaemon(Oid databaseId);
 extern void TriggerNodeMetadataSync(Oid databaseId);
+extern void MarkTwoPhaseCommitsRecovered(Oid databaseId);
+extern bool TwoPhaseCommitsRecovered(Oid databaseId);
 extern void InitializeMaintenanceDaemon(void);
 extern size_t MaintenanceDaemonShmemSize(void);
 extern void MaintenanceDaemonShmemInit(void);
@@ -78,6 +78,9 @@ extern void CitusExecutorRun(QueryDesc *queryDesc, ScanDirection direction, uint
 							 bool execute_once);
 extern void AdaptiveExecutorPreExecutorRun(CitusScanState *scanState);
 extern TupleTableSlot * AdaptiveExecutor(CitusScanState *scanState);
+extern void AdaptiveExecutorFetchNextBatch(CitusScanState *scanState);
+extern void AdaptiveExecutorFinishStreaming(CitusScanState *scanState, bool discardRows);
+extern void ResetStreamingExecution(void);
 
 
 /*
@@ -523,6 +523,7 @@ typedef struct DistributedSubPlan
 
 	/* EXPLAIN ANALYZE instrumentations */
 	uint64 bytesSentPerWorker;
+	bool binaryFormat;
 	uint32 remoteWorkerCount;
 	double durationMillisecs;
 	bool writeLocalFile;
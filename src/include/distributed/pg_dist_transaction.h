@@ -40,6 +40,12 @@ typedef FormData_pg_dist_transaction *Form_pg_dist_transaction;
 #define Anum_pg_dist_transaction_gid 2
 #define Anum_pg_dist_transaction_outerxid 3
 
+/*
+ * groupid of the records that decide all the prepared transactions of a
+ * distributed transaction, regardless of the group they were prepared on
+ */
+#define DISTRIBUTED_TRANSACTION_RECORD_GROUP_ID -1
+
 extern int GetOuterXidAttrIndexInPgDistTransaction(TupleDesc tupleDesc);
 
 
@@ -0,0 +1,28 @@
+/*-------------------------------------------------------------------------
+ *
+ * remote_prepared_statements.h
+ *	  Per-connection cache of statements that are prepared on remote nodes.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef REMOTE_PREPARED_STATEMENTS_H
+#define REMOTE_PREPARED_STATEMENTS_H
+
+#include "distributed/connection_management.h"
+
+/* GUCs, determining whether and how many shard queries are prepared on workers */
+extern bool EnableWorkerPreparedStatements;
+extern int MaxWorkerPreparedStatementsPerConnection;
+
+
+extern int SendRemoteCommandPrepared(MultiConnection *connection, const char *command,
+									 int parameterCount, const Oid *parameterTypes,
+									 const char *const *parameterValues,
+									 bool binaryResults, int *setupCommandCount);
+extern void InvalidateWorkerPreparedStatements(void);
+extern void FreeWorkerPreparedStatements(MultiConnection *connection);
+
+#endif /* REMOTE_PREPARED_STATEMENTS_H */
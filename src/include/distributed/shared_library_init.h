@@ -21,6 +21,7 @@ extern PGDLLEXPORT ColumnarSupportsIndexAM_type extern_ColumnarSupportsIndexAM;
 extern PGDLLEXPORT CompressionTypeStr_type extern_CompressionTypeStr;
 extern PGDLLEXPORT IsColumnarTableAmTable_type extern_IsColumnarTableAmTable;
 extern PGDLLEXPORT ReadColumnarOptions_type extern_ReadColumnarOptions;
+extern PGDLLEXPORT TryCompactColumnarTables_type extern_TryCompactColumnarTables;
 
 extern void StartupCitusBackend(void);
 extern const char * GetClientMinMessageLevelNameForValue(int minMessageLevel);
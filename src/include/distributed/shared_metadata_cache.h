@@ -0,0 +1,76 @@
+/*-------------------------------------------------------------------------
+ *
+ * shared_metadata_cache.h
+ *   Declarations for the cache of shard metadata that is shared between
+ *   backends.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARED_METADATA_CACHE_H
+#define SHARED_METADATA_CACHE_H
+
+#include "postgres.h"
+
+#include "distributed/metadata_utility.h"
+
+
+/*
+ * SharedShardInterval is the representation of a shard of a hash distributed
+ * table or a table without distribution key in the shared metadata cache.
+ * The placements of the shard are stored consecutively, starting at
+ * placementOffset.
+ */
+typedef struct SharedShardInterval
+{
+	uint64 shardId;
+	char storageType;
+	bool hasValues;
+	int32 minValue;
+	int32 maxValue;
+	int placementOffset;
+	int placementCount;
+} SharedShardInterval;
+
+
+/* SharedShardPlacement is the representation of a placement in the cache */
+typedef struct SharedShardPlacement
+{
+	uint64 placementId;
+	uint64 shardLength;
+	int32 groupId;
+} SharedShardPlacement;
+
+
+/*
+ * SharedShardList is a backend-local copy of the shards and placements of a
+ * table that were found in the shared metadata cache. The shards are sorted
+ * in the order of the shard interval array of the table.
+ */
+typedef struct SharedShardList
+{
+	int shardCount;
+	SharedShardInterval *shardIntervals;
+	SharedShardPlacement *placements;
+} SharedShardList;
+
+
+/* GUC variables */
+extern bool EnableSharedMetadataCache;
+extern int SharedMetadataCacheSize;
+
+
+extern void InitializeSharedMetadataCache(void);
+extern size_t SharedMetadataCacheShmemSize(void);
+extern SharedShardList * LookupSharedShardList(Oid relationId);
+extern uint64 SharedShardListGeneration(Oid relationId);
+extern void PublishSharedShardList(Oid relationId, uint64 generation,
+								   ShardInterval **sortedShardIntervalArray,
+								   int shardCount,
+								   GroupShardPlacement **arrayOfPlacementArrays,
+								   int *arrayOfPlacementArrayLengths);
+extern void InvalidateSharedShardList(Oid relationId);
+
+#endif /* SHARED_METADATA_CACHE_H */
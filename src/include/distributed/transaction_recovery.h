@@ -15,10 +15,17 @@
 /* GUC to configure interval for 2PC auto-recovery */
 extern int Recover2PCInterval;
 
+/* GUC to log a single pg_dist_transaction record per distributed transaction */
+extern bool CompactTransactionRecords;
+
+extern bool DistributedTransactionRecordLogged;
+
 
 /* Functions declarations for worker transactions */
 extern void LogTransactionRecord(int32 groupId, char *transactionName,
 								 FullTransactionId outerXid);
+extern void LogDistributedTransactionRecord(char *transactionName);
+extern bool ShouldLogDistributedTransactionRecord(void);
 extern int RecoverTwoPhaseCommits(void);
 extern void DeleteWorkerTransactions(WorkerNode *workerNode);
 
@@ -0,0 +1,87 @@
+/*-------------------------------------------------------------------------
+ *
+ * worker_connection_pool.h
+ *	  Shares a bounded set of worker connections between the backends of a
+ *	  database through a background worker.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef WORKER_CONNECTION_POOL_H
+#define WORKER_CONNECTION_POOL_H
+
+#include "postgres.h"
+
+#include "nodes/pg_list.h"
+#include "postmaster/bgworker.h"
+
+
+/*
+ * PooledTask describes a read-only query that the worker connection pooler
+ * runs on the first placement in placementList that it can connect to.
+ */
+typedef struct PooledTask
+{
+	char *queryString;
+
+	/* parameters of the query in text format, NULL values are NULL pointers */
+	int parameterCount;
+	Oid *parameterTypes;
+	const char **parameterValues;
+
+	/* list of ShardPlacement's to try in order */
+	List *placementList;
+} PooledTask;
+
+
+/*
+ * PooledExecutionMessageType is the type of the messages that a backend
+ * receives from the worker connection pooler.
+ */
+typedef enum PooledExecutionMessageType
+{
+	POOLED_EXECUTION_ROW,
+	POOLED_EXECUTION_TASK_DONE
+} PooledExecutionMessageType;
+
+
+/*
+ * PooledExecutionMessage is a row or a task completion received from the
+ * worker connection pooler.
+ */
+typedef struct PooledExecutionMessage
+{
+	PooledExecutionMessageType type;
+
+	/* index of the task in the list passed to StartPooledExecution */
+	int taskIndex;
+
+	/* columns of a row in text format, NULL values are NULL pointers */
+	int columnCount;
+	char **columnValues;
+	uint64 rowSize;
+} PooledExecutionMessage;
+
+
+typedef struct PooledExecution PooledExecution;
+
+
+/* GUC, maximum number of pooled connections per worker node */
+extern int WorkerConnectionPoolSize;
+
+
+extern size_t WorkerConnectionPoolShmemSize(void);
+extern void InitializeWorkerConnectionPool(void);
+extern bool WorkerConnectionPoolAvailable(void);
+extern PooledExecution * StartPooledExecution(List *pooledTaskList);
+extern bool ReceivePooledExecutionMessage(PooledExecution *pooledExecution,
+										  PooledExecutionMessage *message);
+extern void FinishPooledExecution(PooledExecution *pooledExecution);
+extern BackgroundWorkerHandle * StartWorkerConnectionPooler(Oid database,
+															Oid extensionOwner);
+extern bool WorkerConnectionPoolerRunning(Oid database);
+extern PGDLLEXPORT void WorkerConnectionPoolerMain(Datum arg);
+
+#endif /* WORKER_CONNECTION_POOL_H */
@@ -46,6 +46,7 @@ extern void SetDefElemArg(AlterSeqStmt *statement, const char *name, Node *arg);
 extern DestReceiver * CreateFileDestReceiver(char *filePath,
 											 MemoryContext tupleContext,
 											 bool binaryCopyFormat);
+extern void ShareFileDestReceiverBuffers(DestReceiver **dests, int destCount);
 extern void FileDestReceiverStats(DestReceiver *dest,
 								  uint64 *rowsSent,
 								  uint64 *bytesSent);
@@ -603,6 +603,7 @@ if ($majorversion >= "14") {
 push(@pgOptions, "citus.shard_count=4");
 push(@pgOptions, "citus.max_adaptive_executor_pool_size=4");
 push(@pgOptions, "citus.defer_shard_delete_interval=-1");
+push(@pgOptions, "columnar.chunk_cache_size='16MB'");
 push(@pgOptions, "citus.repartition_join_bucket_count_per_node=2");
 push(@pgOptions, "citus.sort_returning='on'");
 if ($backupnodetest)
@@ -697,6 +698,7 @@ if($isolationtester)
    push(@pgOptions, "citus.shard_count=4");
    push(@pgOptions, "citus.metadata_sync_interval=1000");
    push(@pgOptions, "citus.metadata_sync_retry_interval=100");
+   push(@pgOptions, "citus.max_wait_graph_snapshots=32");
    push(@pgOptions, "client_min_messages='warning'"); # pg12 introduced notice showing during isolation tests
 
    # Disable all features of the maintenance daemon. Otherwise queries might
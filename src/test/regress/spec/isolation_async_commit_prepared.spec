@@ -0,0 +1,126 @@
+// Tests citus.async_commit_prepared, where the async commit worker sends
+// COMMIT PREPARED after the coordinator committed a two-phase commit.
+setup
+{
+    CREATE OR REPLACE FUNCTION wait_for_async_commit_worker()
+    RETURNS bool
+    LANGUAGE plpgsql
+    AS $$
+    BEGIN
+        FOR i IN 1 .. 300 LOOP
+            IF EXISTS (SELECT 1 FROM pg_stat_activity
+                       WHERE application_name = 'Citus Async Commit Worker'
+                       AND datname = current_database()) THEN
+                RETURN true;
+            END IF;
+            PERFORM pg_sleep(0.1);
+        END LOOP;
+        RETURN false;
+    END;
+    $$;
+
+    CREATE TABLE async_commit_test (key int, value int);
+    INSERT INTO async_commit_test SELECT i, 0 FROM generate_series(1, 8) i;
+    SELECT create_distributed_table('async_commit_test', 'key');
+}
+
+teardown
+{
+    DROP TABLE async_commit_test;
+    DROP FUNCTION wait_for_async_commit_worker();
+}
+
+session "s1"
+
+// ALTER SYSTEM cannot run in a transaction block, so every setting is a step
+step "s1-enable-async-commit"
+{
+    ALTER SYSTEM SET citus.async_commit_prepared TO on;
+}
+
+step "s1-enable-recovery"
+{
+    ALTER SYSTEM SET citus.recover_2pc_interval TO '1h';
+}
+
+step "s1-disable-async-commit"
+{
+    ALTER SYSTEM RESET citus.async_commit_prepared;
+}
+
+step "s1-disable-recovery"
+{
+    ALTER SYSTEM RESET citus.recover_2pc_interval;
+}
+
+step "s1-reload-conf"
+{
+    SELECT pg_reload_conf();
+}
+
+step "s1-wait-for-worker"
+{
+    SET citus.async_commit_prepared TO on;
+    SELECT wait_for_async_commit_worker();
+}
+
+step "s1-begin"
+{
+    BEGIN;
+}
+
+step "s1-update-all"
+{
+    UPDATE async_commit_test SET value = value + 1;
+}
+
+step "s1-commit"
+{
+    COMMIT;
+}
+
+step "s1-select"
+{
+    SELECT key, value FROM async_commit_test ORDER BY key;
+}
+
+step "s1-prepared-xacts"
+{
+    SELECT nodeport, result FROM run_command_on_workers($$SELECT count(*) FROM pg_prepared_xacts WHERE gid LIKE 'citus\_%'$$) ORDER BY nodeport;
+}
+
+step "s1-recover"
+{
+    SELECT recover_prepared_transactions();
+}
+
+session "s2"
+
+step "s2-begin"
+{
+    BEGIN;
+}
+
+step "s2-update-one"
+{
+    UPDATE async_commit_test SET value = value * 10 WHERE key = 1;
+}
+
+step "s2-commit"
+{
+    COMMIT;
+}
+
+step "s2-select"
+{
+    SELECT key, value FROM async_commit_test ORDER BY key;
+}
+
+// the session sees its own writes right after COMMIT returned
+permutation "s1-enable-async-commit" "s1-enable-recovery" "s1-reload-conf" "s1-wait-for-worker" "s1-begin" "s1-update-all" "s1-commit" "s1-select" "s1-prepared-xacts" "s2-select" "s1-recover" "s1-disable-async-commit" "s1-disable-recovery" "s1-reload-conf"
+
+// a concurrent writer waits for the prepared transaction on the worker, which the async commit worker commits
+permutation "s1-enable-async-commit" "s1-enable-recovery" "s1-reload-conf" "s1-wait-for-worker" "s1-begin" "s1-update-all" "s2-begin" "s2-update-one" "s1-commit" "s2-commit" "s2-select" "s1-prepared-xacts" "s1-disable-async-commit" "s1-disable-recovery" "s1-reload-conf"
+
+// queued commits are still committed after the setting is disabled
+permutation "s1-enable-async-commit" "s1-enable-recovery" "s1-reload-conf" "s1-wait-for-worker" "s1-begin" "s1-update-all" "s1-commit" "s1-disable-async-commit" "s1-reload-conf" "s1-select" "s1-prepared-xacts" "s1-recover" "s1-disable-recovery" "s1-reload-conf"
@@ -0,0 +1,146 @@
+// Tests citus.incremental_deadlock_detection, where the deadlock detection only
+// asks the nodes for the wait edges that changed since its previous run.
+setup
+{
+  -- sums up the wait edge changes that the workers report to requester 1000
+  CREATE FUNCTION wait_edge_changes(since_version bigint, new_version bigint,
+                                    OUT full_graphs numeric, OUT added numeric,
+                                    OUT removed numeric)
+  LANGUAGE sql
+  AS $$
+    SELECT sum(split_part(result, ' ', 1)::int),
+           sum(split_part(result, ' ', 2)::int),
+           sum(split_part(result, ' ', 3)::int)
+    FROM run_command_on_workers(format(
+      'SELECT format(%L, count(*) FILTER (WHERE change_type = %L), '
+      'count(*) FILTER (WHERE change_type = %L), '
+      'count(*) FILTER (WHERE change_type = %L)) '
+      'FROM citus_internal.local_wait_edge_changes(1000, %s, %s)',
+      '%s %s %s', 'f', 'a', 'r', since_version, new_version));
+  $$;
+
+  CREATE TABLE deadlock_detection_test (user_id int UNIQUE, some_val int);
+  INSERT INTO deadlock_detection_test SELECT i, i FROM generate_series(1,7) i;
+  SELECT create_distributed_table('deadlock_detection_test', 'user_id');
+}
+
+teardown
+{
+  DROP TABLE deadlock_detection_test;
+  DROP FUNCTION wait_edge_changes(bigint, bigint);
+}
+
+session "s1"
+
+step "s1-begin"
+{
+  BEGIN;
+}
+
+step "s1-update-1"
+{
+  UPDATE deadlock_detection_test SET some_val = 1 WHERE user_id = 1;
+}
+
+step "s1-update-2"
+{
+  UPDATE deadlock_detection_test SET some_val = 1 WHERE user_id = 2;
+}
+
+step "s1-commit"
+{
+  COMMIT;
+}
+
+session "s2"
+
+step "s2-begin"
+{
+  BEGIN;
+}
+
+step "s2-update-1"
+{
+  UPDATE deadlock_detection_test SET some_val = 2 WHERE user_id = 1;
+}
+
+step "s2-update-2"
+{
+  UPDATE deadlock_detection_test SET some_val = 2 WHERE user_id = 2;
+}
+
+step "s2-commit"
+{
+  COMMIT;
+}
+
+session "deadlock-checker"
+
+// citus.incremental_deadlock_detection can only be set in the config file
+step "enable-incremental"
+{
+  ALTER SYSTEM SET citus.incremental_deadlock_detection TO on;
+}
+
+step "disable-incremental"
+{
+  ALTER SYSTEM RESET citus.incremental_deadlock_detection;
+}
+
+step "reload-conf"
+{
+  SELECT pg_reload_conf();
+}
+
+step "deadlock-checker-call"
+{
+  SELECT check_distributed_deadlocks();
+}
+
+step "deadlock-checker-stats"
+{
+  SELECT incremental, full_graph_count > 0 AS full_graph, search_skipped, deadlock_found
+  FROM (SELECT * FROM citus_stat_deadlock_detection
+        WHERE database_name = current_database()
+        ORDER BY start_time DESC LIMIT 3) last_runs
+  ORDER BY start_time;
+}
+
+session "other-checker"
+
+// polls the nodes as well, which replaces the wait graphs that the nodes keep
+// for the coordinator, such that the next run of deadlock-checker reads the
+// full wait graphs again
+step "other-checker-call"
+{
+  SELECT check_distributed_deadlocks();
+}
+
+step "other-changes-full"
+{
+  SELECT * FROM wait_edge_changes(0, 1);
+}
+
+step "other-changes-incremental"
+{
+  SELECT * FROM wait_edge_changes(1, 2);
+}
+
+step "other-changes-stale"
+{
+  SELECT * FROM wait_edge_changes(1, 3);
+}
+
+step "other-changes-after"
+{
+  SELECT * FROM wait_edge_changes(3, 4);
+}
+
+// a distributed deadlock is found incrementally, the run without new wait edges skips the search
+permutation "enable-incremental" "reload-conf" "s1-begin" "s2-begin" "s1-update-1" "s2-update-2" "s2-update-1" "deadlock-checker-call" "deadlock-checker-call" "s1-update-2"("s2-update-1") "deadlock-checker-call" "s1-commit" "s2-commit" "deadlock-checker-stats" "disable-incremental" "reload-conf"
+
+// another process polls in between, so the wait graph versions no longer match and the full graphs are read
+permutation "enable-incremental" "reload-conf" "s1-begin" "s2-begin" "s1-update-1" "s2-update-2" "s2-update-1" "deadlock-checker-call" "other-checker-call" "deadlock-checker-call" "deadlock-checker-stats" "s1-update-2"("s2-update-1") "deadlock-checker-call" "s1-commit" "s2-commit" "disable-incremental" "reload-conf"
+
+// the changes that the nodes report for a version, and the full graph for a stale version
+permutation "enable-incremental" "reload-conf" "s1-begin" "s2-begin" "s1-update-1" "s2-update-2" "s2-update-1" "other-changes-full" "s1-update-2"("s2-update-1") "other-changes-incremental" "other-changes-stale" "deadlock-checker-call" "s1-commit" "s2-commit" "other-changes-after" "disable-incremental" "reload-conf"
@@ -0,0 +1,75 @@
+// Tests that citus.enable_shared_metadata_cache does not let other backends
+// see the placements of an uncommitted shard move.
+setup
+{
+    SET citus.shard_count TO 8;
+    SET citus.shard_replication_factor TO 1;
+    CREATE TABLE shared_cache_move (x int, y int);
+    SELECT create_distributed_table('shared_cache_move', 'x');
+    INSERT INTO shared_cache_move VALUES (15, 10);
+
+    SELECT get_shard_id_for_distribution_column('shared_cache_move', 15) INTO selected_shard;
+}
+
+teardown
+{
+    DROP TABLE shared_cache_move;
+    DROP TABLE selected_shard;
+}
+
+session "s1"
+
+// ALTER SYSTEM cannot run in a transaction block, so every setting is a step
+step "s1-enable-shared-cache"
+{
+    ALTER SYSTEM SET citus.enable_shared_metadata_cache TO on;
+}
+
+step "s1-disable-shared-cache"
+{
+    ALTER SYSTEM RESET citus.enable_shared_metadata_cache;
+}
+
+step "s1-reload-conf"
+{
+    SELECT pg_reload_conf();
+}
+
+step "s1-begin"
+{
+    BEGIN;
+}
+
+step "s1-move-placement"
+{
+    SELECT citus_move_shard_placement((SELECT * FROM selected_shard), 'localhost', 57637, 'localhost', 57638, shard_transfer_mode := 'block_writes');
+}
+
+step "s1-commit"
+{
+    COMMIT;
+}
+
+step "s1-rollback"
+{
+    ROLLBACK;
+}
+
+session "s2"
+
+step "s2-select"
+{
+    SELECT y FROM shared_cache_move WHERE x = 15;
+}
+
+step "s2-print-placements"
+{
+    SELECT nodeport FROM pg_dist_shard_placement
+    WHERE shardid IN (SELECT * FROM selected_shard);
+}
+
+// the reader builds its cache entry while the move is in progress and uses the old placement
+permutation "s1-enable-shared-cache" "s1-reload-conf" "s1-begin" "s1-move-placement" "s2-select" "s1-rollback" "s2-select" "s2-print-placements" "s1-disable-shared-cache" "s1-reload-conf"
+
+// the reader uses the new placement once the move committed
+permutation "s1-enable-shared-cache" "s1-reload-conf" "s1-begin" "s1-move-placement" "s2-select" "s1-commit" "s2-select" "s2-print-placements" "s1-disable-shared-cache" "s1-reload-conf"
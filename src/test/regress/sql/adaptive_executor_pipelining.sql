@@ -0,0 +1,60 @@
+--
+-- ADAPTIVE_EXECUTOR_PIPELINING
+--
+-- Tests for sending multiple tasks over a connection in a libpq pipeline
+--
+CREATE SCHEMA adaptive_executor_pipelining;
+SET search_path TO adaptive_executor_pipelining;
+
+SET citus.shard_count TO 8;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 801012000;
+
+CREATE TABLE test (x int, y int);
+SELECT create_distributed_table('test','x');
+INSERT INTO test SELECT i, i FROM generate_series(1,100) i;
+
+SET citus.enable_pipelined_execution TO on;
+
+-- use a single connection per worker such that it executes all shards
+SET citus.max_adaptive_executor_pool_size TO 1;
+
+-- multi-shard reads and modifications
+UPDATE test SET y = y + 1;
+SELECT sum(y) FROM test;
+DELETE FROM test WHERE x > 90;
+SELECT count(*) FROM test;
+
+-- BEGIN is sent in the same pipeline as the tasks
+BEGIN;
+UPDATE test SET y = y + 1 WHERE x = 1;
+UPDATE test SET y = y * 2;
+SELECT sum(y), count(*) FROM test;
+COMMIT;
+
+-- SAVEPOINTs are sent in the same pipeline as well
+BEGIN;
+SAVEPOINT s1;
+UPDATE test SET y = 0;
+SELECT sum(y) FROM test;
+ROLLBACK TO SAVEPOINT s1;
+SELECT sum(y) FROM test;
+COMMIT;
+
+-- an error in the middle of a pipeline leaves the connections usable
+ALTER TABLE test ADD CONSTRAINT y_positive CHECK (y > 0);
+DO $$
+BEGIN
+  UPDATE test SET y = -1 WHERE x > 45;
+EXCEPTION WHEN check_violation THEN
+  RAISE NOTICE 'update failed with check violation';
+END;
+$$;
+SELECT sum(y), count(*) FROM test;
+
+-- the same queries without pipelining give the same results
+SET citus.enable_pipelined_execution TO off;
+SELECT sum(y), count(*) FROM test;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA adaptive_executor_pipelining CASCADE;
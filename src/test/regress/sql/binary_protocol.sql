@@ -63,6 +63,10 @@ SELECT ARRAY[(col, col)] FROM composite_type_table;
 SELECT ARRAY[(col, col)::nested_composite_type] FROM composite_type_table;
 SELECT ARRAY[(col, col)::nested_composite_type_domain] FROM composite_type_table;
 
+-- composite types are also sent in binary format as intermediate results
+WITH cte AS MATERIALIZED (SELECT col FROM composite_type_table)
+SELECT col, (col, col)::nested_composite_type FROM cte;
+
 
 -- Confirm that aclitem doesn't have receive and send functions
 SELECT typreceive, typsend FROM pg_type WHERE typname = 'aclitem';
@@ -0,0 +1,109 @@
+--
+-- Test computing count(*), min() and max() on columnar tables using the
+-- metadata of the chunk groups.
+--
+CREATE SCHEMA columnar_aggregate_pushdown;
+SET search_path TO columnar_aggregate_pushdown;
+
+--
+-- columnar_agg_stats returns the custom scans and the number of chunk groups
+-- that they skipped or aggregated from metadata for the given query.
+--
+CREATE FUNCTION columnar_agg_stats(query text) RETURNS SETOF text AS
+$$
+    DECLARE
+        rec text;
+    BEGIN
+        FOR rec IN EXECUTE 'EXPLAIN (analyze, costs off, timing off, summary off) ' || query LOOP
+            IF rec ~ '(Custom Scan \(\w+\)|Columnar Chunk Groups [A-Za-z ]+:)' THEN
+                RETURN NEXT regexp_replace(trim(rec), ' +\(actual.*$', '');
+            END IF;
+        END LOOP;
+    END;
+$$ LANGUAGE PLPGSQL;
+
+SET max_parallel_workers_per_gather TO 0;
+SET columnar.stripe_row_limit TO 2000;
+SET columnar.chunk_group_row_limit TO 1000;
+
+-- 5 stripes with 2 chunk groups each, b is NULL in the last chunk group and
+-- in a single row of the fifth chunk group
+CREATE TABLE agg_pushdown (a int, b int, t text) USING columnar;
+INSERT INTO agg_pushdown
+SELECT i, CASE WHEN i <= 9000 AND i <> 4500 THEN i % 100 END, 'text_' || lpad(i::text, 5, '0')
+FROM generate_series(1, 10000) i;
+
+-- without quals, all chunk groups are aggregated from metadata
+EXPLAIN (costs off)
+SELECT count(*), min(a), max(a), min(b), max(b), min(t), max(t) FROM agg_pushdown;
+
+SELECT count(*), min(a), max(a), min(b), max(b), min(t), max(t) FROM agg_pushdown;
+
+SELECT columnar_agg_stats('SELECT count(*), min(a), max(a), min(b), max(b), min(t), max(t) FROM agg_pushdown');
+
+-- chunk groups whose rows all satisfy the quals are aggregated from metadata,
+-- the ones that the quals refute are skipped and the rest are read
+EXPLAIN (costs off)
+SELECT count(*), min(a), max(b), max(t) FROM agg_pushdown WHERE a > 1500;
+
+SELECT count(*), min(a), max(b), max(t) FROM agg_pushdown WHERE a > 1500;
+
+SELECT columnar_agg_stats('SELECT count(*), min(a), max(b), max(t) FROM agg_pushdown WHERE a > 1500');
+
+-- chunk groups with NULLs in the filtered columns need to be read
+SELECT count(*) FROM agg_pushdown WHERE b >= 0;
+
+SELECT columnar_agg_stats('SELECT count(*) FROM agg_pushdown WHERE b >= 0');
+
+-- quals that cannot be proven using min/max values are evaluated on all rows
+SELECT count(*) FROM agg_pushdown WHERE a % 2 = 0;
+
+SELECT columnar_agg_stats('SELECT count(*) FROM agg_pushdown WHERE a % 2 = 0');
+
+-- params are evaluated when the aggregates are computed
+SET plan_cache_mode TO force_generic_plan;
+PREPARE agg_count(int) AS SELECT count(*), max(a) FROM agg_pushdown WHERE a > $1;
+EXECUTE agg_count(1500);
+EXECUTE agg_count(9000);
+RESET plan_cache_mode;
+
+SELECT x, (SELECT count(*) FROM agg_pushdown WHERE a <= x)
+FROM (VALUES (10), (1000), (5500)) v(x) ORDER BY x;
+
+-- other aggregates and grouping are not pushed down
+EXPLAIN (costs off) SELECT count(*), sum(a) FROM agg_pushdown;
+
+SELECT columnar_agg_stats('SELECT count(DISTINCT b) FROM agg_pushdown');
+
+SELECT columnar_agg_stats('SELECT b, count(*) FROM agg_pushdown GROUP BY b');
+
+-- results are the same without aggregate pushdown
+SET columnar.enable_aggregate_pushdown TO false;
+
+EXPLAIN (costs off)
+SELECT count(*), min(a), max(a), min(b), max(b), min(t), max(t) FROM agg_pushdown;
+
+SELECT count(*), min(a), max(a), min(b), max(b), min(t), max(t) FROM agg_pushdown;
+
+SELECT count(*), min(a), max(b), max(t) FROM agg_pushdown WHERE a > 1500;
+
+SELECT count(*) FROM agg_pushdown WHERE b >= 0;
+
+RESET columnar.enable_aggregate_pushdown;
+
+-- columns added after a stripe was written are read from such stripes
+ALTER TABLE agg_pushdown ADD COLUMN c int DEFAULT 7;
+INSERT INTO agg_pushdown VALUES (10001, 1, 'text_10001', 1);
+
+SELECT count(*), min(c), max(c) FROM agg_pushdown;
+
+SELECT columnar_agg_stats('SELECT count(*), min(c), max(c) FROM agg_pushdown');
+
+SELECT count(*) FROM agg_pushdown WHERE c = 7;
+
+-- empty tables
+CREATE TABLE empty_agg (a int) USING columnar;
+SELECT count(*), min(a), max(a) FROM empty_agg;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_aggregate_pushdown CASCADE;
@@ -0,0 +1,98 @@
+--
+-- Test bitmap heap scans and TID scans on columnar tables.
+--
+CREATE SCHEMA columnar_bitmap_scan;
+SET search_path TO columnar_bitmap_scan;
+
+-- columnar_bitmap_scan has an alternative test output file because only
+-- before PG18, bitmap heap scans are not used on large tables.
+CREATE FUNCTION uses_bitmap_heap_scan(command text) RETURNS boolean AS
+$$
+    DECLARE
+        query_plan text;
+    BEGIN
+        FOR query_plan IN EXECUTE 'EXPLAIN ' || command LOOP
+            IF query_plan ILIKE '%Bitmap Heap Scan on%' THEN
+                RETURN true;
+            END IF;
+        END LOOP;
+        RETURN false;
+    END;
+$$ LANGUAGE PLPGSQL;
+
+SET max_parallel_workers_per_gather TO 0;
+SET columnar.stripe_row_limit TO 1000;
+SET columnar.chunk_group_row_limit TO 100;
+
+CREATE TABLE bitmap_test (a int, b int, c text) USING columnar;
+INSERT INTO bitmap_test SELECT i, i % 100, 'text_' || i FROM generate_series(1, 10000) i;
+CREATE INDEX bitmap_test_a_idx ON bitmap_test (a);
+CREATE INDEX bitmap_test_b_idx ON bitmap_test (b);
+ANALYZE bitmap_test;
+
+SET enable_seqscan TO off;
+SET enable_indexscan TO off;
+SET columnar.enable_custom_scan TO off;
+
+-- multi-index OR and AND quals are combined into a single bitmap
+SELECT uses_bitmap_heap_scan('SELECT count(*) FROM bitmap_test WHERE a < 100 OR b = 5');
+SELECT count(*), sum(a) FROM bitmap_test WHERE a < 100 OR b = 5;
+
+SELECT uses_bitmap_heap_scan('SELECT count(*) FROM bitmap_test WHERE a BETWEEN 1000 AND 5000 AND b = 7');
+SELECT count(*), sum(a) FROM bitmap_test WHERE a BETWEEN 1000 AND 5000 AND b = 7;
+
+-- the TIDs that a bitmap heap scan returns point to the rows it read
+SELECT ctid, a, c FROM bitmap_test WHERE a IN (2, 295) ORDER BY a;
+
+-- deleted rows are skipped
+DELETE FROM bitmap_test WHERE b = 5 AND a > 5000;
+SELECT count(*), sum(a) FROM bitmap_test WHERE a < 100 OR b = 5;
+
+-- rows deleted and inserted earlier in the same transaction are visible to
+-- the bitmap heap scan
+BEGIN;
+DELETE FROM bitmap_test WHERE a = 50;
+UPDATE bitmap_test SET b = 5 WHERE a = 10000;
+SELECT count(*), sum(a) FROM bitmap_test WHERE a < 100 OR b = 5;
+ROLLBACK;
+
+SELECT count(*), sum(a) FROM bitmap_test WHERE a < 100 OR b = 5;
+
+-- TID scans fetch the rows by their row numbers
+SELECT a, b, c FROM bitmap_test WHERE ctid = '(0,3)';
+SELECT a FROM bitmap_test WHERE ctid IN ('(1,5)', '(17,59)', '(1000,1)');
+
+-- Before PG18, the executor prefetches the pages of a bitmap heap scan, which
+-- fails for the virtual pages beyond the first segment file. Hence bitmap heap
+-- scans are only used while the reserved row numbers map to the first
+-- RELSEG_SIZE pages (about 38 million rows), unless prefetching is disabled.
+-- Every stripe reserves stripe_row_limit row numbers.
+SET columnar.stripe_row_limit TO 10000000;
+CREATE TABLE boundary_test (a int) USING columnar;
+INSERT INTO boundary_test VALUES (1);
+INSERT INTO boundary_test VALUES (2);
+INSERT INTO boundary_test VALUES (3);
+CREATE INDEX boundary_test_a_idx ON boundary_test (a);
+
+-- 30 million row numbers are reserved
+SELECT uses_bitmap_heap_scan('SELECT a FROM boundary_test WHERE a > 1');
+SELECT a FROM boundary_test WHERE a > 1 ORDER BY a;
+
+-- 50 million row numbers are reserved, the last row is beyond the first segment
+INSERT INTO boundary_test VALUES (4);
+INSERT INTO boundary_test VALUES (5);
+SELECT uses_bitmap_heap_scan('SELECT a FROM boundary_test WHERE a > 1');
+SELECT a FROM boundary_test WHERE a > 1 ORDER BY a;
+
+SET effective_io_concurrency TO 0;
+SELECT uses_bitmap_heap_scan('SELECT a FROM boundary_test WHERE a > 1');
+SELECT a FROM boundary_test WHERE a > 1 ORDER BY a;
+RESET effective_io_concurrency;
+RESET columnar.stripe_row_limit;
+
+RESET enable_seqscan;
+RESET enable_indexscan;
+RESET columnar.enable_custom_scan;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_bitmap_scan CASCADE;
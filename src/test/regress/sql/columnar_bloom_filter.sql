@@ -0,0 +1,105 @@
+--
+-- Test skipping columnar chunk groups using bloom filters.
+--
+CREATE SCHEMA columnar_bloom_filter;
+SET search_path TO columnar_bloom_filter;
+
+-- chunk_groups_filtered returns the number of chunk groups that columnar
+-- skipped for the given query
+CREATE FUNCTION chunk_groups_filtered(query text) RETURNS bigint AS
+$$
+    DECLARE
+        rec text;
+    BEGIN
+        FOR rec IN EXECUTE 'EXPLAIN (analyze, costs off, timing off, summary off) ' || query LOOP
+            IF rec ~ '^\s+Columnar Chunk Groups Removed by Filter:' THEN
+                RETURN regexp_replace(rec, '[^0-9]*', '', 'g');
+            END IF;
+        END LOOP;
+        RETURN 0;
+    END;
+$$ LANGUAGE PLPGSQL;
+
+SET max_parallel_workers_per_gather TO 0;
+SET columnar.qual_pushdown_correlation TO 0.0;
+SET columnar.stripe_row_limit TO 10000;
+SET columnar.chunk_group_row_limit TO 1000;
+
+-- customer ids are unique and spread over all chunk groups, so min/max
+-- values cannot skip any chunk groups
+CREATE TABLE events (id int, customer_id bigint, customer_name text, location point)
+USING columnar;
+INSERT INTO events
+SELECT i, (i * 7919) % 100000, 'customer_' || (i * 7919) % 100000, point(i, i)
+FROM generate_series(1, 10000) i;
+
+SELECT chunk_groups_filtered('SELECT count(*) FROM events WHERE customer_id = 92398');
+
+-- bloom filters can only be built for existing columns with a hash function
+ALTER TABLE events SET (columnar.bloom_filter_columns = 'no_such_column');
+
+ALTER TABLE events SET (columnar.bloom_filter_columns = 'location');
+
+ALTER TABLE events SET (columnar.bloom_filter_columns = 'customer_id,,id');
+
+ALTER TABLE events SET (columnar.bloom_filter_columns = 'customer_id, customer_name');
+SELECT bloom_filter_columns FROM columnar.options WHERE relation = 'events'::regclass;
+
+-- bloom filters are built for the chunks written after setting the option
+SELECT attr_num, count(bloom_filter) FROM columnar_internal.chunk
+WHERE storage_id = columnar.get_storage_id('events') GROUP BY 1 ORDER BY 1;
+
+VACUUM FULL events;
+SELECT attr_num, count(bloom_filter) FROM columnar_internal.chunk
+WHERE storage_id = columnar.get_storage_id('events') GROUP BY 1 ORDER BY 1;
+
+-- equality and IN quals skip the chunk groups whose bloom filters don't
+-- contain the values, allowing for a few false positives
+SELECT count(*) FROM events WHERE customer_id = 92398;
+
+SELECT chunk_groups_filtered('SELECT count(*) FROM events WHERE customer_id = 92398') >= 8;
+
+SELECT count(*) FROM events WHERE customer_name = 'customer_92398';
+
+SELECT chunk_groups_filtered('SELECT count(*) FROM events WHERE customer_name = ''customer_92398''') >= 8;
+
+SELECT count(*) FROM events WHERE customer_id IN (79190, 74190, 50190);
+
+SELECT chunk_groups_filtered('SELECT count(*) FROM events WHERE customer_id IN (79190, 74190, 50190)') >= 6;
+
+SELECT count(*) FROM events WHERE customer_id = 50001;
+
+SELECT chunk_groups_filtered('SELECT count(*) FROM events WHERE customer_id = 50001') >= 8;
+
+-- constants of another type in the same operator family are hashed consistently
+SELECT count(*) FROM events WHERE customer_id = 92398::int;
+
+SELECT chunk_groups_filtered('SELECT count(*) FROM events WHERE customer_id = 92398::int') >= 8;
+
+PREPARE customer_count(bigint) AS SELECT count(*) FROM events WHERE customer_id = $1;
+EXECUTE customer_count(92398);
+
+EXECUTE customer_count(50001);
+
+-- bloom filters cannot refute other operators
+SELECT count(*) FROM events WHERE customer_id <> 92398;
+
+SELECT chunk_groups_filtered('SELECT count(*) FROM events WHERE customer_id <> 92398');
+
+-- the option follows renamed columns and ignores dropped ones
+ALTER TABLE events RENAME COLUMN customer_name TO name;
+SELECT bloom_filter_columns FROM columnar.options WHERE relation = 'events'::regclass;
+
+SELECT count(*) FROM events WHERE name = 'customer_92398';
+
+ALTER TABLE events DROP COLUMN name;
+SELECT bloom_filter_columns FROM columnar.options WHERE relation = 'events'::regclass;
+
+INSERT INTO events SELECT i, i, point(i, i) FROM generate_series(100001, 101000) i;
+SELECT count(*) FROM events WHERE customer_id = 100500;
+
+ALTER TABLE events RESET (columnar.bloom_filter_columns);
+SELECT bloom_filter_columns IS NULL FROM columnar.options WHERE relation = 'events'::regclass;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_bloom_filter CASCADE;
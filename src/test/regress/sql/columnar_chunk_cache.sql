@@ -0,0 +1,58 @@
+--
+-- Test the shared cache of decompressed columnar chunks.
+--
+CREATE SCHEMA columnar_chunk_cache;
+SET search_path TO columnar_chunk_cache;
+
+-- chunk_cache_lookups returns the number of chunk cache lookups that hit and
+-- missed the cache while running the given query
+CREATE FUNCTION chunk_cache_lookups(query text, OUT hits bigint, OUT misses bigint) AS
+$$
+    DECLARE
+        before record;
+    BEGIN
+        SELECT * INTO before FROM columnar.chunk_cache_stats();
+        EXECUTE query;
+        SELECT s.hits - before.hits, s.misses - before.misses INTO hits, misses
+        FROM columnar.chunk_cache_stats() s;
+    END;
+$$ LANGUAGE PLPGSQL;
+
+SHOW columnar.chunk_cache_size;
+
+SET max_parallel_workers_per_gather TO 0;
+SET columnar.qual_pushdown_correlation TO 0.0;
+SET columnar.compression TO 'pglz';
+SET columnar.chunk_group_row_limit TO 1000;
+
+CREATE TABLE cached (a int, b text) USING columnar;
+INSERT INTO cached
+SELECT i, (i - 1) / 1000 || repeat('columnar', 8) || (i % 10)
+FROM generate_series(1, 3000) i;
+
+-- the first scan decompresses the chunks of b and caches them, the second
+-- one reads them from the cache
+SELECT * FROM chunk_cache_lookups('SELECT sum(length(b)) FROM cached');
+SELECT * FROM chunk_cache_lookups('SELECT sum(length(b)) FROM cached');
+
+SELECT sum(length(b)), count(DISTINCT b) FROM cached;
+
+SELECT cached_chunks >= 3, cached_bytes > 0 FROM columnar.chunk_cache_stats();
+
+-- only the chunk groups that are not skipped are looked up
+SELECT * FROM chunk_cache_lookups('SELECT sum(length(b)) FROM cached WHERE b >= ''2''');
+
+-- rewriting the table assigns it a new storage id, so its chunks are read
+-- from the table again
+VACUUM FULL cached;
+SELECT * FROM chunk_cache_lookups('SELECT sum(length(b)) FROM cached');
+SELECT * FROM chunk_cache_lookups('SELECT sum(length(b)) FROM cached');
+
+-- uncompressed chunks are not cached
+CREATE TABLE uncompressed (a int, b text) USING columnar;
+ALTER TABLE uncompressed SET (columnar.compression = none);
+INSERT INTO uncompressed SELECT i, repeat('columnar', 8) || (i % 10) FROM generate_series(1, 3000) i;
+SELECT * FROM chunk_cache_lookups('SELECT sum(length(b)) FROM uncompressed');
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_chunk_cache CASCADE;
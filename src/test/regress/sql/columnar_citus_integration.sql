@@ -444,7 +444,7 @@ WHERE "bbbbbbbbbbbbbbbbbbbbbbbbb\!bbbb'bbbbbbbbbbbbbbbbbbbbb''bbbbbbbb" * 2 >
       "aaaaaaaaaaaa$aaaaaa$$aaaaaaaaaaaaaaaaaaaaaaaaaaaaa'aaaaaaaa'$a'!";
 \set VERBOSITY default
 
--- should not project any columns
+-- should be computed from chunk group metadata without reading any columns
 EXPLAIN (COSTS OFF, SUMMARY OFF)
 SELECT COUNT(*) FROM weird_col_explain;
 
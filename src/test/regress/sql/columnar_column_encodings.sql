@@ -0,0 +1,91 @@
+--
+-- Test lightweight column encodings in columnar.
+--
+CREATE SCHEMA columnar_column_encodings;
+SET search_path TO columnar_column_encodings;
+
+SET columnar.stripe_row_limit TO 10000;
+SET columnar.chunk_group_row_limit TO 1000;
+SET columnar.compression TO 'none';
+
+CREATE TABLE encoded (
+    id int,
+    ts timestamptz,
+    category text,
+    run_label text,
+    small_int int,
+    negative bigint,
+    always_null int,
+    hash text
+) USING columnar;
+CREATE TABLE plain (LIKE encoded) USING columnar;
+
+INSERT INTO plain
+SELECT i,
+       '2024-01-01 00:00:00+00'::timestamptz + i * interval '1 minute',
+       'cat_' || (i % 5),
+       'label_' || (i / 100),
+       (i * 7919) % 100,
+       -1000 * i,
+       NULL,
+       md5(i::text)
+FROM generate_series(1, 10000) i;
+
+SET columnar.enable_column_encodings TO on;
+INSERT INTO encoded SELECT * FROM plain;
+
+-- encodings are chosen per chunk, based on which one results in the smallest
+-- value buffer
+SELECT attr_num, value_encoding_type, count(*) FROM columnar.chunk
+WHERE relation = 'encoded'::regclass GROUP BY 1, 2 ORDER BY 1, 2;
+
+SELECT count(*) FROM columnar.chunk
+WHERE relation = 'plain'::regclass AND value_encoding_type <> 0;
+
+-- encoded chunks decode to the same values
+SELECT count(*) FROM (
+    (TABLE encoded EXCEPT ALL TABLE plain)
+    UNION ALL
+    (TABLE plain EXCEPT ALL TABLE encoded)
+) diff;
+
+SELECT sum(id), sum(small_int), sum(negative), count(always_null) FROM encoded;
+
+-- filters are evaluated once per dictionary entry or run
+SELECT count(*) FROM encoded WHERE category = 'cat_3';
+
+SELECT count(*) FROM encoded WHERE run_label IN ('label_5', 'label_50');
+
+SELECT count(*) FROM encoded WHERE category = 'cat_3' AND small_int = 42;
+
+SELECT count(*) FROM encoded WHERE small_int = 42;
+
+SELECT count(*) FROM encoded WHERE ts < '2024-01-01 01:00:00+00';
+
+SELECT count(*) FROM encoded WHERE negative > -5000;
+
+-- index scans read encoded chunks as well
+CREATE INDEX encoded_id_idx ON encoded (id);
+SET enable_seqscan TO off;
+SELECT category, run_label, small_int FROM encoded WHERE id = 4242;
+
+RESET enable_seqscan;
+
+-- tables can mix encoded and unencoded chunks
+SET columnar.enable_column_encodings TO off;
+INSERT INTO encoded SELECT * FROM plain WHERE id <= 1000;
+
+SELECT value_encoding_type, count(*) FROM columnar.chunk
+WHERE relation = 'encoded'::regclass AND attr_num = 3 GROUP BY 1 ORDER BY 1;
+
+SELECT count(*) FROM encoded WHERE category = 'cat_3';
+
+-- rewriting the table with encodings disabled decodes all chunks
+VACUUM FULL encoded;
+SELECT count(*) FROM columnar.chunk
+WHERE relation = 'encoded'::regclass AND value_encoding_type <> 0;
+
+SELECT count(*) FROM encoded WHERE category = 'cat_3';
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_column_encodings CASCADE;
@@ -0,0 +1,125 @@
+--
+-- Test merging the small stripes of columnar tables into full stripes.
+--
+CREATE SCHEMA columnar_compaction;
+SET search_path TO columnar_compaction;
+
+SET max_parallel_workers_per_gather TO 0;
+SET columnar.qual_pushdown_correlation TO 0.0;
+SET columnar.stripe_row_limit TO 1000;
+SET columnar.chunk_group_row_limit TO 100;
+
+-- every insert writes a stripe of its own, stripes with fewer than 500 live
+-- rows are small
+CREATE TABLE compact (a int, b text) USING columnar;
+CREATE INDEX compact_a_idx ON compact (a);
+INSERT INTO compact SELECT i, 'text_' || i FROM generate_series(1001, 1300) i;
+INSERT INTO compact SELECT i, 'text_' || i FROM generate_series(1, 1000) i;
+INSERT INTO compact SELECT i, 'text_' || i FROM generate_series(1301, 1500) i;
+INSERT INTO compact SELECT i, 'text_' || i FROM generate_series(1501, 1700) i;
+INSERT INTO compact VALUES (1701, 'text_1701');
+INSERT INTO compact VALUES (1702, 'text_1702');
+DELETE FROM compact WHERE a BETWEEN 1001 AND 1100;
+
+SELECT stripe_num, row_count FROM columnar.stripe
+WHERE relation = 'compact'::regclass ORDER BY stripe_num;
+
+SELECT count(*), sum(a), min(a), max(a) FROM compact;
+
+-- the small stripes are merged, and their deleted rows are dropped
+SELECT columnar.compact_stripes('compact');
+
+SELECT stripe_num, row_count FROM columnar.stripe
+WHERE relation = 'compact'::regclass ORDER BY stripe_num;
+
+SELECT stripe_num, deleted_row_count FROM columnar.row_mask
+WHERE relation = 'compact'::regclass ORDER BY stripe_num;
+
+SELECT count(*), sum(a), min(a), max(a) FROM compact;
+
+-- the merged stripe is not small, so it is not rewritten again
+SELECT columnar.compact_stripes('compact');
+
+-- merging only these would write a small stripe again, so they wait for
+-- more rows
+INSERT INTO compact VALUES (1703, 'text_1703');
+INSERT INTO compact VALUES (1704, 'text_1704');
+SELECT columnar.compact_stripes('compact');
+
+-- index scans find the merged rows, but not the deleted ones
+SET enable_seqscan TO off;
+SET columnar.enable_custom_scan TO off;
+SELECT a, b FROM compact WHERE a IN (500, 1050, 1101, 1502, 1704) ORDER BY a;
+RESET enable_seqscan;
+RESET columnar.enable_custom_scan;
+
+-- rows deleted earlier in the same transaction stay deleted
+CREATE TABLE txn (a int) USING columnar;
+INSERT INTO txn SELECT generate_series(1, 200);
+INSERT INTO txn SELECT generate_series(201, 400);
+INSERT INTO txn SELECT generate_series(401, 600);
+BEGIN;
+DELETE FROM txn WHERE a = 300;
+SELECT columnar.compact_stripes('txn');
+COMMIT;
+
+SELECT stripe_num, row_count FROM columnar.stripe
+WHERE relation = 'txn'::regclass ORDER BY stripe_num;
+
+SELECT count(*), sum(a) FROM txn;
+SELECT a FROM txn WHERE a BETWEEN 299 AND 301 ORDER BY a;
+
+-- the rows are sorted by the clustered index, so that more chunk groups can
+-- be skipped
+CREATE TABLE sorted (a int) USING columnar;
+CREATE INDEX sorted_a_idx ON sorted (a);
+ALTER TABLE sorted CLUSTER ON sorted_a_idx;
+INSERT INTO sorted SELECT i FROM generate_series(1, 800) i WHERE i % 2 = 0;
+INSERT INTO sorted SELECT i FROM generate_series(1, 800) i WHERE i % 2 = 1;
+
+SET enable_indexscan TO off;
+SET enable_bitmapscan TO off;
+SET columnar.enable_aggregate_pushdown TO false;
+
+SELECT count(*) FROM sorted WHERE a <= 100;
+SELECT columnar_test_helpers.columnar_scan_stats('SELECT count(*) FROM sorted WHERE a <= 100');
+
+SELECT columnar.compact_stripes('sorted');
+
+SELECT count(*) FROM sorted WHERE a <= 100;
+SELECT columnar_test_helpers.columnar_scan_stats('SELECT count(*) FROM sorted WHERE a <= 100');
+
+RESET enable_indexscan;
+RESET enable_bitmapscan;
+RESET columnar.enable_aggregate_pushdown;
+
+SELECT stripe_num, row_count, chunk_group_count FROM columnar.stripe
+WHERE relation = 'sorted'::regclass ORDER BY stripe_num;
+
+-- the merged stripes are written into the space of the stripes that an
+-- earlier compaction merged, once no one can read those anymore
+CREATE TABLE reuse (a int) USING columnar;
+ALTER TABLE reuse SET (columnar.compression = none);
+INSERT INTO reuse SELECT generate_series(1, 300);
+INSERT INTO reuse SELECT generate_series(301, 600);
+SELECT min(file_offset) AS first_stripe_offset FROM columnar.stripe
+WHERE relation = 'reuse'::regclass \gset
+SELECT columnar.compact_stripes('reuse');
+VACUUM columnar_internal.stripe;
+
+INSERT INTO reuse SELECT generate_series(601, 900);
+INSERT INTO reuse SELECT generate_series(901, 1200);
+SELECT pg_relation_size('reuse') AS reuse_size \gset
+SELECT columnar.compact_stripes('reuse');
+
+SELECT stripe_num, row_count, file_offset = :first_stripe_offset AS reused_space
+FROM columnar.stripe WHERE relation = 'reuse'::regclass ORDER BY stripe_num;
+SELECT pg_relation_size('reuse') = :reuse_size AS same_size;
+SELECT count(*), sum(a) FROM reuse;
+
+-- only columnar tables can be compacted
+CREATE TABLE heap_table (a int);
+SELECT columnar.compact_stripes('heap_table');
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_compaction CASCADE;
@@ -0,0 +1,105 @@
+--
+-- Test DELETE and UPDATE on columnar tables, and rewriting the stripes with
+-- deleted rows in VACUUM.
+--
+CREATE SCHEMA columnar_delete;
+SET search_path TO columnar_delete;
+
+SET max_parallel_workers_per_gather TO 0;
+SET columnar.qual_pushdown_correlation TO 0.0;
+SET columnar.stripe_row_limit TO 1000;
+SET columnar.chunk_group_row_limit TO 100;
+
+-- 3 stripes with 10 chunk groups each
+CREATE TABLE del (a int, b text) USING columnar;
+INSERT INTO del SELECT i, 'text_' || i FROM generate_series(1, 3000) i;
+
+DELETE FROM del WHERE a % 10 = 0;
+
+SELECT count(*), sum(a) FROM del;
+
+SET columnar.enable_aggregate_pushdown TO false;
+SELECT count(*), sum(a) FROM del;
+RESET columnar.enable_aggregate_pushdown;
+
+SELECT stripe_num, deleted_row_count FROM columnar.row_mask
+WHERE relation = 'del'::regclass ORDER BY stripe_num;
+
+-- deleted rows are skipped when some chunk groups are filtered out too
+SELECT a, b FROM del WHERE a BETWEEN 495 AND 505 ORDER BY a;
+
+UPDATE del SET b = 'updated' WHERE a BETWEEN 1 AND 5;
+SELECT a, b FROM del WHERE a <= 6 ORDER BY a;
+
+-- deletes are undone on rollback
+BEGIN;
+DELETE FROM del WHERE a > 2000;
+SELECT count(*) FROM del;
+SAVEPOINT s1;
+DELETE FROM del WHERE a <= 1000;
+SELECT count(*) FROM del;
+ROLLBACK TO SAVEPOINT s1;
+SELECT count(*) FROM del;
+ROLLBACK;
+SELECT count(*) FROM del;
+
+-- index scans skip the deleted rows
+CREATE INDEX del_a_idx ON del (a);
+SET enable_seqscan TO off;
+SET columnar.enable_custom_scan TO off;
+SELECT a, b FROM del WHERE a IN (3, 10, 11) ORDER BY a;
+DELETE FROM del WHERE a = 11;
+SELECT a, b FROM del WHERE a = 11;
+RESET enable_seqscan;
+RESET columnar.enable_custom_scan;
+
+-- deleted rows don't violate unique constraints
+CREATE TABLE uniq (a int PRIMARY KEY, b int) USING columnar;
+INSERT INTO uniq SELECT i, i FROM generate_series(1, 10) i;
+INSERT INTO uniq VALUES (5, 0);
+DELETE FROM uniq WHERE a = 5;
+INSERT INTO uniq VALUES (5, 50);
+UPDATE uniq SET b = b * 10 WHERE a = 6;
+SELECT * FROM uniq WHERE a IN (5, 6) ORDER BY a;
+
+-- VACUUM rewrites the third stripe, which has 55% of its rows deleted
+DELETE FROM del WHERE a > 2000 AND a <= 2500;
+VACUUM del;
+
+SELECT stripe_num, row_count FROM columnar.stripe
+WHERE storage_id = columnar.get_storage_id('del'::regclass) ORDER BY stripe_num;
+
+SELECT stripe_num, deleted_row_count FROM columnar.row_mask
+WHERE relation = 'del'::regclass ORDER BY stripe_num;
+
+SELECT count(*) FROM del;
+SELECT min(a), max(a) FROM del WHERE a > 2000;
+
+-- rewritten rows are found using the index
+SET enable_seqscan TO off;
+SET columnar.enable_custom_scan TO off;
+SELECT a, b FROM del WHERE a = 2999;
+RESET enable_seqscan;
+RESET columnar.enable_custom_scan;
+
+-- no stripes are rewritten when the threshold is 0
+SET columnar.vacuum_rewrite_threshold TO 0;
+DELETE FROM del WHERE a > 1000 AND a <= 1900;
+VACUUM del;
+RESET columnar.vacuum_rewrite_threshold;
+
+SELECT stripe_num, row_count FROM columnar.stripe
+WHERE storage_id = columnar.get_storage_id('del'::regclass) ORDER BY stripe_num;
+
+-- VACUUM FULL removes the deleted rows
+VACUUM FULL del;
+
+SELECT count(*) FROM columnar.row_mask WHERE relation = 'del'::regclass;
+
+SELECT sum(row_count) FROM columnar.stripe
+WHERE storage_id = columnar.get_storage_id('del'::regclass);
+
+SELECT count(*), min(a), max(a) FROM del;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_delete CASCADE;
@@ -0,0 +1,76 @@
+--
+-- Test parallel scans on columnar tables.
+--
+CREATE SCHEMA columnar_parallel_scan;
+SET search_path TO columnar_parallel_scan;
+
+SET columnar.stripe_row_limit TO 10000;
+SET columnar.chunk_group_row_limit TO 1000;
+
+CREATE TABLE parallel_scan (a int, b bigint) USING columnar;
+INSERT INTO parallel_scan SELECT i, i * 2 FROM generate_series(1, 100000) i;
+
+SET parallel_setup_cost TO 0;
+SET parallel_tuple_cost TO 0;
+SET min_parallel_table_scan_size TO 0;
+SET max_parallel_workers_per_gather TO 2;
+
+-- participants of the scan read whole stripes
+EXPLAIN (costs off) SELECT count(*), sum(a), min(b), max(b) FROM parallel_scan;
+
+SELECT count(*), sum(a), min(b), max(b) FROM parallel_scan;
+
+SELECT count(*), sum(a) FROM parallel_scan WHERE a > 25000 AND a <= 75000;
+
+-- compare with a serial scan
+SET max_parallel_workers_per_gather TO 0;
+
+SELECT count(*), sum(a), min(b), max(b) FROM parallel_scan;
+
+SELECT count(*), sum(a) FROM parallel_scan WHERE a > 25000 AND a <= 75000;
+
+SET max_parallel_workers_per_gather TO 2;
+
+-- a table with a single stripe is not scanned in parallel
+CREATE TABLE single_stripe (a int) USING columnar;
+INSERT INTO single_stripe SELECT i FROM generate_series(1, 5000) i;
+
+EXPLAIN (costs off) SELECT count(*), sum(a) FROM single_stripe;
+
+-- prefer a serial scan when there are pending writes
+BEGIN;
+INSERT INTO parallel_scan SELECT i, i * 2 FROM generate_series(100001, 100010) i;
+
+EXPLAIN (costs off) SELECT count(*), sum(a) FROM parallel_scan;
+
+SELECT count(*), sum(a) FROM parallel_scan;
+
+ROLLBACK;
+
+-- pending writes are flushed before executing a cached parallel plan
+PREPARE parallel_count AS SELECT count(*), sum(a) FROM parallel_scan;
+
+EXECUTE parallel_count;
+
+BEGIN;
+INSERT INTO parallel_scan SELECT i, i * 2 FROM generate_series(100001, 100010) i;
+
+EXECUTE parallel_count;
+
+ROLLBACK;
+
+EXECUTE parallel_count;
+
+-- parallel scans are not used without columnar custom scan
+SET columnar.enable_custom_scan TO false;
+
+EXPLAIN (costs off) SELECT count(*), sum(a) FROM parallel_scan;
+
+SET columnar.enable_custom_scan TO DEFAULT;
+SET parallel_setup_cost TO DEFAULT;
+SET parallel_tuple_cost TO DEFAULT;
+SET min_parallel_table_scan_size TO DEFAULT;
+SET max_parallel_workers_per_gather TO DEFAULT;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_parallel_scan CASCADE;
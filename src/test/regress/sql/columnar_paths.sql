@@ -230,11 +230,14 @@ SELECT a FROM full_correlated WHERE a>1 AND a<10;
 $$
 );
 
+-- bitmap heap scans over the hash index are covered by columnar_bitmap_scan
+SET enable_bitmapscan TO OFF;
 SELECT columnar_test_helpers.uses_custom_scan (
 $$
 SELECT a FROM full_correlated WHERE a=0 OR a=5;
 $$
 );
+RESET enable_bitmapscan;
 
 SELECT columnar_test_helpers.uses_index_scan (
 $$
@@ -274,6 +277,8 @@ SELECT a,b FROM full_anti_correlated WHERE b='600';
 $$
 );
 
+-- bitmap heap scans over the hash index are covered by columnar_bitmap_scan
+SET enable_bitmapscan TO OFF;
 SELECT columnar_test_helpers.uses_custom_scan (
 $$
 SELECT a,b FROM full_anti_correlated WHERE b='600' OR b='10';
@@ -288,6 +293,7 @@ BEGIN;
   $$
   );
 ROLLBACK;
+RESET enable_bitmapscan;
 
 DROP INDEX full_anti_correlated_hash;
 
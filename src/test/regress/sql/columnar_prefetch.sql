@@ -0,0 +1,55 @@
+--
+-- Test prefetching the next stripe during sequential columnar scans.
+--
+CREATE SCHEMA columnar_prefetch;
+SET search_path TO columnar_prefetch;
+
+SET max_parallel_workers_per_gather TO 0;
+SET columnar.qual_pushdown_correlation TO 0.0;
+SET columnar.stripe_row_limit TO 2000;
+SET columnar.chunk_group_row_limit TO 1000;
+SET columnar.enable_aggregate_pushdown TO false;
+
+-- 5 stripes with 2 chunk groups each
+CREATE TABLE prefetch (a int, b text) USING columnar;
+INSERT INTO prefetch SELECT i, 'value' || (i % 100) FROM generate_series(1, 10000) i;
+
+-- the 6th stripe has a column that the earlier stripes don't store
+ALTER TABLE prefetch ADD COLUMN c int;
+INSERT INTO prefetch SELECT i, 'value' || (i % 100), i FROM generate_series(10001, 12000) i;
+
+SELECT count(*) FROM columnar.stripe WHERE relation = 'prefetch'::regclass;
+
+-- prefetching is disabled when effective_io_concurrency is 0, the results
+-- must be the same either way
+SET effective_io_concurrency TO 0;
+
+SELECT count(*), sum(a), sum(length(b)), count(c), sum(c) FROM prefetch;
+SELECT count(*), sum(a) FROM prefetch WHERE a BETWEEN 3500 AND 4500;
+SELECT columnar_test_helpers.columnar_scan_stats('SELECT count(*) FROM prefetch WHERE a BETWEEN 3500 AND 4500');
+SELECT columnar_test_helpers.columnar_stripes_prefetched('SELECT count(*) FROM prefetch WHERE a > 0');
+
+SET effective_io_concurrency TO 16;
+
+SELECT count(*), sum(a), sum(length(b)), count(c), sum(c) FROM prefetch;
+SELECT count(*), sum(a) FROM prefetch WHERE a BETWEEN 3500 AND 4500;
+SELECT columnar_test_helpers.columnar_scan_stats('SELECT count(*) FROM prefetch WHERE a BETWEEN 3500 AND 4500');
+
+-- the stripes that follow a stripe that is read are prefetched
+SELECT columnar_test_helpers.columnar_stripes_prefetched('SELECT count(*) FROM prefetch WHERE a BETWEEN 3500 AND 4500');
+SELECT columnar_test_helpers.columnar_stripes_prefetched('SELECT count(*) FROM prefetch WHERE a > 0');
+
+-- rescans start over from the first stripe
+SELECT g, (SELECT count(*) FROM prefetch WHERE a > g * 3000)
+FROM generate_series(1, 3) g ORDER BY g;
+
+-- a cursor pauses just before the end of a stripe, then continues into the
+-- prefetched stripe
+BEGIN;
+DECLARE prefetch_cursor CURSOR FOR SELECT a, b FROM prefetch;
+MOVE 3998 IN prefetch_cursor;
+FETCH 4 FROM prefetch_cursor;
+COMMIT;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_prefetch CASCADE;
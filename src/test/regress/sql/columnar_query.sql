@@ -15,8 +15,10 @@ SELECT country, avg(rating) FROM contestant WHERE rating > 2200
 	GROUP BY country ORDER BY country;
 SELECT * FROM contestant ORDER BY handle;
 
--- all special column accesses should fail
+-- ctid is the row number of the row
 SELECT ctid FROM contestant;
+
+-- other special column accesses should fail
 SELECT cmin FROM contestant;
 SELECT cmax FROM contestant;
 SELECT xmin FROM contestant;
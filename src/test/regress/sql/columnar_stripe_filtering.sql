@@ -0,0 +1,76 @@
+--
+-- Test skipping whole stripes in columnar using min/max values in stripe
+-- summaries.
+--
+CREATE SCHEMA columnar_stripe_filtering;
+SET search_path TO columnar_stripe_filtering;
+
+SET max_parallel_workers_per_gather TO 0;
+SET columnar.qual_pushdown_correlation TO 0.0;
+SET columnar.stripe_row_limit TO 2000;
+SET columnar.chunk_group_row_limit TO 1000;
+-- the stripe stats are reported by ColumnarScan, so scan the rows
+SET columnar.enable_aggregate_pushdown TO false;
+
+-- 5 stripes with 2 chunk groups each, b is always NULL
+CREATE TABLE stripe_filtering (a int, b int) USING columnar;
+INSERT INTO stripe_filtering SELECT i, NULL FROM generate_series(1, 10000) i;
+
+-- there are no summaries for columns that only have NULLs
+SELECT stripe_num, attr_num FROM columnar.stripe_summary
+WHERE relation = 'stripe_filtering'::regclass ORDER BY 1, 2;
+
+SELECT count(*) FROM stripe_filtering WHERE a < 200;
+
+SELECT columnar_test_helpers.columnar_scan_stats('SELECT count(*) FROM stripe_filtering WHERE a < 200');
+
+SELECT count(*) FROM stripe_filtering WHERE a BETWEEN 3500 AND 4500;
+
+SELECT columnar_test_helpers.columnar_scan_stats('SELECT count(*) FROM stripe_filtering WHERE a BETWEEN 3500 AND 4500');
+
+SELECT count(*) FROM stripe_filtering WHERE a < 200 OR a > 9900;
+
+SELECT columnar_test_helpers.columnar_scan_stats('SELECT count(*) FROM stripe_filtering WHERE a < 200 OR a > 9900');
+
+SELECT count(*) FROM stripe_filtering WHERE a > 20000;
+
+SELECT columnar_test_helpers.columnar_scan_stats('SELECT count(*) FROM stripe_filtering WHERE a > 20000');
+
+SELECT count(*) FROM stripe_filtering WHERE b = 5;
+
+SELECT columnar_test_helpers.columnar_scan_stats('SELECT count(*) FROM stripe_filtering WHERE b = 5');
+
+-- stripes are also skipped in parallel scans
+SET parallel_setup_cost TO 0;
+SET parallel_tuple_cost TO 0;
+SET min_parallel_table_scan_size TO 0;
+SET max_parallel_workers_per_gather TO 2;
+
+SELECT count(*) FROM stripe_filtering WHERE a BETWEEN 3500 AND 4500;
+
+SELECT count(*) FROM stripe_filtering WHERE a > 20000;
+
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET min_parallel_table_scan_size;
+SET max_parallel_workers_per_gather TO 0;
+
+-- stripes without summaries, e.g. the ones written before upgrading to
+-- 15.0-1, are only filtered using their skip lists
+DELETE FROM columnar_internal.stripe_summary
+WHERE storage_id = columnar.get_storage_id('stripe_filtering');
+
+SELECT count(*) FROM stripe_filtering WHERE a < 200;
+
+SELECT columnar_test_helpers.columnar_scan_stats('SELECT count(*) FROM stripe_filtering WHERE a < 200');
+
+-- summaries are removed together with the table
+SELECT columnar.get_storage_id('stripe_filtering') AS stripe_filtering_storage_id \gset
+INSERT INTO stripe_filtering SELECT i, i FROM generate_series(1, 1000) i;
+DROP TABLE stripe_filtering;
+
+SELECT COUNT(*) FROM columnar_internal.stripe_summary
+WHERE storage_id = :stripe_filtering_storage_id;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_stripe_filtering CASCADE;
@@ -167,3 +167,35 @@ BEGIN
   EXECUTE format('EXPLAIN (FORMAT JSON, COSTS OFF, ANALYZE OFF) %s', q) INTO j;
   RETURN j;
 END $$;
+
+-- columnar_scan_stats returns the number of chunk groups and stripes that
+-- columnar skipped, and the number of stripes that it read for the given
+-- query.
+CREATE FUNCTION columnar_scan_stats(query text) RETURNS SETOF text AS
+$$
+    DECLARE
+        rec text;
+    BEGIN
+        FOR rec IN EXECUTE 'EXPLAIN (analyze, verbose, costs off, timing off, summary off) ' || query LOOP
+            IF rec ~ '^\s+Columnar (Chunk Groups Removed by Filter|Stripes Removed by Filter|Stripes Read):' THEN
+                RETURN NEXT trim(rec);
+            END IF;
+        END LOOP;
+    END;
+$$ LANGUAGE PLPGSQL;
+
+-- columnar_stripes_prefetched returns the number of stripes for which
+-- columnar issued read-ahead while running the given query.
+CREATE FUNCTION columnar_stripes_prefetched(query text) RETURNS bigint AS
+$$
+    DECLARE
+        rec text;
+    BEGIN
+        FOR rec IN EXECUTE 'EXPLAIN (analyze, verbose, costs off, timing off, summary off) ' || query LOOP
+            IF rec ~ '^\s+Columnar Stripes Prefetched:' THEN
+                RETURN substring(rec, '\d+$')::bigint;
+            END IF;
+        END LOOP;
+        RETURN NULL;
+    END;
+$$ LANGUAGE PLPGSQL;
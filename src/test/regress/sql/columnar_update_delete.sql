@@ -5,10 +5,12 @@ INSERT INTO columnar_update VALUES (1, 10);
 INSERT INTO columnar_update VALUES (2, 20);
 INSERT INTO columnar_update VALUES (3, 30);
 
--- should fail
+-- should succeed
 UPDATE columnar_update SET j = j+1 WHERE i = 2;
--- should fail
+SELECT * FROM columnar_update ORDER BY i;
+-- should succeed
 DELETE FROM columnar_update WHERE i = 2;
+SELECT * FROM columnar_update ORDER BY i;
 
 -- should succeed because there's no target
 INSERT INTO columnar_update VALUES
@@ -25,10 +27,10 @@ INSERT INTO columnar_update VALUES
   ON CONFLICT (i) DO NOTHING;
 
 -- tuple locks should fail
-SELECT * FROM columnar_update WHERE i = 2 FOR SHARE;
-SELECT * FROM columnar_update WHERE i = 2 FOR UPDATE;
+SELECT * FROM columnar_update WHERE i = 1 FOR SHARE;
+SELECT * FROM columnar_update WHERE i = 1 FOR UPDATE;
 
--- CTID scans should fail
+-- CTID quals are evaluated by the scan
 SELECT * FROM columnar_update WHERE ctid = '(0,2)';
 
 DROP TABLE columnar_update;
@@ -58,7 +60,7 @@ SELECT * FROM parent;
 UPDATE p2 SET i = i+1 WHERE ts = '2020-03-15';
 DELETE FROM p2 WHERE ts = '2020-03-21';
 
--- update on specific columnar partition should fail
+-- update on specific columnar partition should succeed
 UPDATE p1 SET i = i+1 WHERE ts = '2020-02-15';
 DELETE FROM p1 WHERE ts = '2020-02-15';
 
@@ -68,12 +70,11 @@ UPDATE parent SET i = i+1 WHERE ts = '2020-03-15';
 DELETE FROM parent WHERE ts = '2020-03-22';
 
 -- partitioned updates that affect columnar tables
--- should fail
+-- should succeed
 UPDATE parent SET i = i+1 WHERE ts > '2020-02-15';
 DELETE FROM parent WHERE ts > '2020-02-15';
 
--- non-partitioned update should fail, even if it
--- only affects a row partition
+-- non-partitioned update should succeed
 UPDATE parent SET i = i+1 WHERE n = 300;
 DELETE FROM parent WHERE n = 303;
 
@@ -0,0 +1,135 @@
+--
+-- Test evaluating pushed-down quals over column vectors in columnar.
+--
+CREATE SCHEMA columnar_vector_filter;
+SET search_path TO columnar_vector_filter, public;
+
+CREATE OR REPLACE FUNCTION filtered_row_count (query text) RETURNS bigint AS
+$$
+    DECLARE
+        result bigint;
+        rec text;
+    BEGIN
+        result := 0;
+
+        FOR rec IN EXECUTE 'EXPLAIN ANALYZE ' || query LOOP
+            IF rec ~ '^\s+Rows Removed by Filter' then
+                result := regexp_replace(rec, '[^0-9]*', '', 'g');
+            END IF;
+        END LOOP;
+
+        RETURN result;
+    END;
+$$ LANGUAGE PLPGSQL;
+
+--
+-- chunk_group_stats returns the number of chunk groups that columnar skipped
+-- using min/max values and vector filters for the given query.
+--
+CREATE FUNCTION chunk_group_stats(query text) RETURNS SETOF text AS
+$$
+    DECLARE
+        rec text;
+    BEGIN
+        FOR rec IN EXECUTE 'EXPLAIN (analyze, verbose, costs off, timing off, summary off) ' || query LOOP
+            IF rec ~ '^\s+Columnar Chunk Groups Removed by' THEN
+                RETURN NEXT trim(rec);
+            END IF;
+        END LOOP;
+    END;
+$$ LANGUAGE PLPGSQL;
+
+SET columnar.qual_pushdown_correlation_threshold TO 0.0;
+-- rows removed by the filter are only reported when the rows are read
+SET columnar.enable_aggregate_pushdown TO false;
+SET columnar.stripe_row_limit TO 2000;
+SET columnar.chunk_group_row_limit TO 1000;
+
+CREATE TABLE vector_filter (a int, b bigint, c smallint, d date, t text) USING columnar;
+INSERT INTO vector_filter
+  SELECT i, i % 100, i % 7, '2020-01-01'::date + i % 365, 'v' || (i % 10)
+  FROM generate_series(1, 10000) i;
+INSERT INTO vector_filter VALUES (NULL, NULL, NULL, NULL, NULL);
+
+-- comparisons, IN lists and ANY/ALL over integer, date and text columns
+SELECT count(*) FROM vector_filter WHERE b = 42;
+SELECT count(*) FROM vector_filter WHERE b < 10 AND c >= 3;
+SELECT count(*) FROM vector_filter WHERE 50 > b;
+SELECT count(*) FROM vector_filter WHERE b = 42::int;
+SELECT count(*) FROM vector_filter WHERE c IN (1, 3, 5);
+SELECT count(*) FROM vector_filter WHERE b = ANY(ARRAY[1, NULL, 3]::bigint[]);
+SELECT count(*) FROM vector_filter WHERE b <> ALL(ARRAY[1, 2]::bigint[]);
+SELECT count(*) FROM vector_filter WHERE b < ALL(ARRAY[5, NULL]::bigint[]);
+SELECT count(*) FROM vector_filter WHERE b > ALL('{}'::bigint[]);
+SELECT count(*) FROM vector_filter WHERE d < '2020-02-01';
+SELECT count(*) FROM vector_filter WHERE t = 'v3';
+SELECT count(*) FROM vector_filter WHERE a >= 5000 AND t IN ('v0', 'v5');
+SELECT count(*) FROM vector_filter WHERE b IS NULL;
+
+-- rows removed by the vector filters are still reported by EXPLAIN ANALYZE
+SELECT filtered_row_count('SELECT count(*) FROM vector_filter WHERE b = 42');
+
+-- chunk groups without rows that pass the vector filters are skipped after
+-- reading only the filter columns, k is between 0 and 2 in every chunk group
+-- but is 1 only in the third one
+CREATE TABLE late_materialization (a int, k int, payload text) USING columnar;
+INSERT INTO late_materialization
+  SELECT i, CASE WHEN i BETWEEN 2001 AND 2010 THEN 1 ELSE (i % 2) * 2 END, 'payload_' || i
+  FROM generate_series(1, 10000) i;
+
+SELECT count(*), min(a), max(payload) FROM late_materialization WHERE k = 1;
+
+SELECT chunk_group_stats('SELECT count(*), min(a), max(payload) FROM late_materialization WHERE k = 1');
+
+-- columns that are both filtered and projected are read once
+SELECT a, k FROM late_materialization WHERE k = 1 AND a > 2008 ORDER BY a;
+
+-- operators that return NULL for non-NULL values never pass the filter
+CREATE FUNCTION text_eq_unless_v5(text, text) RETURNS bool
+  LANGUAGE plpgsql IMMUTABLE STRICT AS
+$$ BEGIN IF $1 = 'v5' THEN RETURN NULL; END IF; RETURN $1 = $2; END; $$;
+CREATE OPERATOR === (LEFTARG = text, RIGHTARG = text, PROCEDURE = text_eq_unless_v5);
+
+SELECT count(*) FROM vector_filter WHERE t === ANY(ARRAY['v5', 'v6']);
+SELECT count(*) FROM vector_filter WHERE t === ALL(ARRAY['v5']);
+
+-- quals that can leak values are not evaluated before row level security quals
+CREATE FUNCTION leaky_int_eq(int, int) RETURNS bool
+  LANGUAGE plpgsql IMMUTABLE STRICT AS
+$$ BEGIN RAISE NOTICE 'leaky_int_eq saw %', $1; RETURN $1 = $2; END; $$;
+CREATE OPERATOR <=?=> (LEFTARG = int, RIGHTARG = int, PROCEDURE = leaky_int_eq);
+
+CREATE ROLE columnar_vector_filter_user;
+GRANT USAGE ON SCHEMA columnar_vector_filter TO columnar_vector_filter_user;
+CREATE TABLE rls_vector_filter (owner name, secret int) USING columnar;
+INSERT INTO rls_vector_filter VALUES
+  ('columnar_vector_filter_user', 1), ('postgres', 2), ('columnar_vector_filter_user', 3);
+GRANT SELECT ON rls_vector_filter TO columnar_vector_filter_user;
+CREATE POLICY rls_vector_filter_policy ON rls_vector_filter USING (owner = current_user);
+ALTER TABLE rls_vector_filter ENABLE ROW LEVEL SECURITY;
+
+SET ROLE columnar_vector_filter_user;
+SELECT secret FROM rls_vector_filter WHERE secret <=?=> ANY(ARRAY[1, 2]);
+RESET ROLE;
+
+-- results are the same without vector filters
+SET columnar.enable_vector_filter TO off;
+SELECT count(*) FROM vector_filter WHERE b = 42;
+SELECT count(*) FROM vector_filter WHERE b < 10 AND c >= 3;
+SELECT count(*) FROM vector_filter WHERE 50 > b;
+SELECT count(*) FROM vector_filter WHERE b = ANY(ARRAY[1, NULL, 3]::bigint[]);
+SELECT count(*) FROM vector_filter WHERE b <> ALL(ARRAY[1, 2]::bigint[]);
+SELECT count(*) FROM vector_filter WHERE b < ALL(ARRAY[5, NULL]::bigint[]);
+SELECT count(*) FROM vector_filter WHERE b > ALL('{}'::bigint[]);
+SELECT count(*) FROM vector_filter WHERE t === ANY(ARRAY['v5', 'v6']);
+SELECT filtered_row_count('SELECT count(*) FROM vector_filter WHERE b = 42');
+RESET columnar.enable_vector_filter;
+
+RESET columnar.chunk_group_row_limit;
+RESET columnar.stripe_row_limit;
+RESET columnar.qual_pushdown_correlation_threshold;
+RESET columnar.enable_aggregate_pushdown;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_vector_filter CASCADE;
+DROP ROLE columnar_vector_filter_user;
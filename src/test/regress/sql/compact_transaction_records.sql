@@ -0,0 +1,87 @@
+-- Tests for citus.compact_transaction_records
+CREATE SCHEMA compact_transaction_records;
+SET search_path TO compact_transaction_records;
+SET citus.next_shard_id TO 1775000;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+
+-- Disable auto-recovery, such that the records stay around
+ALTER SYSTEM SET citus.recover_2pc_interval TO -1;
+SELECT pg_reload_conf();
+
+CREATE TABLE compact_records (key int, value int);
+SELECT create_distributed_table('compact_records', 'key');
+
+-- Records are only compacted once recovery resolved all nodes
+SELECT recover_prepared_transactions();
+SELECT count(*) FROM pg_dist_transaction;
+
+-- A multi-node write logs a single record for all groups
+SET citus.compact_transaction_records TO on;
+INSERT INTO compact_records SELECT i, i FROM generate_series(1, 100) i;
+SELECT groupid, count(*) FROM pg_dist_transaction GROUP BY groupid ORDER BY groupid;
+
+-- The record carries the initiator process of the prepared transactions
+SELECT gid LIKE format('citus\_%s\_%s\_%%', groupid, pg_backend_pid())
+FROM pg_dist_transaction, pg_dist_local_group;
+
+SELECT recover_prepared_transactions();
+SELECT count(*) FROM pg_dist_transaction;
+
+BEGIN;
+UPDATE compact_records SET value = value + 1;
+DELETE FROM compact_records WHERE key > 50;
+COMMIT;
+SELECT groupid, count(*) FROM pg_dist_transaction GROUP BY groupid ORDER BY groupid;
+SELECT recover_prepared_transactions();
+SELECT count(*), sum(value) FROM compact_records;
+
+-- Without the setting, every group gets its own record
+SET citus.compact_transaction_records TO off;
+UPDATE compact_records SET value = value + 1;
+SELECT count(DISTINCT groupid), bool_and(groupid >= 0) FROM pg_dist_transaction;
+
+SELECT recover_prepared_transactions();
+SELECT count(*) FROM pg_dist_transaction;
+
+-- Create "fake" prepared transactions of a distributed transaction whose
+-- record was written before a failure. Only the prepared transactions with
+-- the same initiator process and transaction number should be committed,
+-- the one of another process with the same transaction number (for instance
+-- from before a restart) should be aborted.
+\c - - - :worker_1_port
+
+BEGIN;
+CREATE TABLE compact_should_commit (value int);
+PREPARE TRANSACTION 'citus_0_1234567_4242424242_0';
+
+BEGIN;
+CREATE TABLE compact_should_commit_too (value int);
+PREPARE TRANSACTION 'citus_0_1234567_4242424242_7';
+
+BEGIN;
+CREATE TABLE compact_should_abort (value int);
+PREPARE TRANSACTION 'citus_0_7654321_4242424242_0';
+
+\c - - - :master_port
+SET search_path TO compact_transaction_records;
+
+INSERT INTO pg_dist_transaction VALUES (-1, 'citus_0_1234567_4242424242_3');
+
+SELECT recover_prepared_transactions();
+
+-- The record stays until recovery found no prepared transaction left
+SELECT count(*) FROM pg_dist_transaction;
+SELECT recover_prepared_transactions();
+SELECT count(*) FROM pg_dist_transaction;
+
+\c - - - :worker_1_port
+SELECT tablename FROM pg_tables WHERE tablename LIKE 'compact\_should\_%' ORDER BY 1;
+DROP TABLE compact_should_commit, compact_should_commit_too;
+
+\c - - - :master_port
+ALTER SYSTEM RESET citus.recover_2pc_interval;
+SELECT pg_reload_conf();
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA compact_transaction_records CASCADE;
@@ -0,0 +1,66 @@
+-- Tests for citus.max_warm_conns_per_worker and citus_stat_connection_warmup
+CREATE SCHEMA connection_warmup;
+SET search_path TO connection_warmup;
+SET citus.next_shard_id TO 1776000;
+SET citus.shard_count TO 8;
+SET citus.shard_replication_factor TO 1;
+
+CREATE TABLE warmup_test (key int, value int);
+SELECT create_distributed_table('warmup_test', 'key');
+INSERT INTO warmup_test SELECT i, i FROM generate_series(1, 100) i;
+
+SET citus.max_warm_conns_per_worker TO -1;
+
+-- Nothing is recorded while connection warm-up is disabled
+SELECT count(*) FROM warmup_test;
+SELECT count(*) FROM citus_stat_connection_warmup WHERE database_name = current_database();
+
+-- Use a connection per shard, such that 4 connections are open per worker
+SET citus.max_warm_conns_per_worker TO 4;
+SET citus.force_max_query_parallelization TO on;
+
+SELECT count(*) FROM warmup_test;
+SELECT nodeport, parallelism, executions, connections_established, warm_connections_reused
+FROM citus_stat_connection_warmup WHERE database_name = current_database()
+ORDER BY nodeport;
+
+-- The connections were kept open, all but the cached one count as warm
+SELECT count(*) FROM warmup_test;
+SELECT nodeport, parallelism, executions, connections_established, warm_connections_reused
+FROM citus_stat_connection_warmup WHERE database_name = current_database()
+ORDER BY nodeport;
+
+-- Single-task executions are not recorded
+SELECT value FROM warmup_test WHERE key = 1;
+SELECT nodeport, executions FROM citus_stat_connection_warmup
+WHERE database_name = current_database() ORDER BY nodeport;
+
+-- The setting caps the connections that are kept warm at the end of a transaction
+SET citus.max_warm_conns_per_worker TO 2;
+SELECT count(*) FROM warmup_test;
+SELECT count(*) FROM warmup_test;
+SELECT nodeport, parallelism, executions, connections_established, warm_connections_reused
+FROM citus_stat_connection_warmup WHERE database_name = current_database()
+ORDER BY nodeport;
+
+-- Executions with a single task per worker lower the recorded parallelism
+-- gradually, even though they open the warm connections up front
+RESET citus.force_max_query_parallelization;
+SET citus.max_warm_conns_per_worker TO 4;
+SET citus.shard_count TO 2;
+CREATE TABLE low_parallelism_test (key int, value int);
+SELECT create_distributed_table('low_parallelism_test', 'key', colocate_with := 'none');
+SELECT count(*) FROM low_parallelism_test;
+SELECT nodeport, round(parallelism::numeric, 1) AS parallelism, executions
+FROM citus_stat_connection_warmup
+WHERE database_name = current_database() ORDER BY nodeport;
+
+SELECT count(*) FROM low_parallelism_test;
+SELECT nodeport, round(parallelism::numeric, 1) AS parallelism, executions
+FROM citus_stat_connection_warmup
+WHERE database_name = current_database() ORDER BY nodeport;
+
+RESET citus.max_warm_conns_per_worker;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA connection_warmup CASCADE;
@@ -0,0 +1,74 @@
+--
+-- COPY_PASS_THROUGH
+--
+-- Tests for passing COPY columns through to the shards without parsing them
+--
+CREATE SCHEMA copy_pass_through;
+SET search_path TO copy_pass_through;
+
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 801017000;
+
+CREATE TYPE mood AS ENUM ('sad', 'ok', 'happy');
+
+CREATE TABLE wide (
+	key int,
+	name text,
+	code varchar(3),
+	amount numeric,
+	ratio float8,
+	feeling mood,
+	tags int[],
+	doc jsonb,
+	id bigserial
+);
+SELECT create_distributed_table('wide', 'key');
+
+CREATE TABLE ref (key int, name text);
+SELECT create_reference_table('ref');
+
+SET citus.enable_copy_pass_through TO on;
+
+-- text format with escapes and NULLs
+COPY wide (key, name, code, amount, ratio, feeling, tags, doc) FROM STDIN;
+1	one	abc	1.50	0.1	sad	{1,2}	{"a": 1}
+2	hex\x41	xyz	-2	1e10	ok	{}	[]
+3	\N	\N	\N	\N	\N	\N	\N
+4	back\\slash	q	0.000	-0	happy	{NULL,3}	{"b": [1, 2]}
+\.
+
+-- csv format with quotes and a header
+COPY wide (key, name, code, amount, ratio, feeling, tags, doc) FROM STDIN WITH (format csv, header true);
+key,name,code,amount,ratio,feeling,tags,doc
+5,"comma, quote""",,7,2.5,ok,"{4,5}","{""c"": null}"
+6,"",abc,8,3,sad,{},"{}"
+\.
+
+SELECT key, name, code, amount, ratio, feeling, tags, doc, id IS NOT NULL AS has_id
+FROM wide ORDER BY key;
+
+-- malformed values are reported by the shards
+COPY wide (key, code) FROM STDIN;
+7	toolong
+\.
+SELECT count(*) FROM wide WHERE key = 7;
+
+-- reference tables pass all columns through
+COPY ref FROM STDIN WITH (format csv);
+1,a
+2,"b,c"
+\.
+SELECT * FROM ref ORDER BY key;
+
+-- columns with settings-dependent input are parsed on the coordinator
+ALTER TABLE wide ADD COLUMN created date;
+SET datestyle TO 'SQL, DMY';
+COPY wide (key, created) FROM STDIN;
+8	01/02/2020
+\.
+RESET datestyle;
+SELECT key, created FROM wide WHERE key = 8;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA copy_pass_through CASCADE;
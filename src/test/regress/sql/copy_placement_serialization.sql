@@ -0,0 +1,70 @@
+--
+-- COPY_PLACEMENT_SERIALIZATION
+--
+-- Tests that COPY sends the same rows to every placement of a shard, since
+-- a row is serialized once and then sent to all placements
+--
+CREATE SCHEMA copy_placement_serialization;
+SET search_path TO copy_placement_serialization;
+
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 2;
+SET citus.next_shard_id TO 801018000;
+
+CREATE TABLE replicated (key int, name text, amount numeric, tags text[]);
+SELECT create_distributed_table('replicated', 'key');
+
+CREATE TABLE ref (key int, name text, amount numeric);
+SELECT create_reference_table('ref');
+
+COPY replicated FROM STDIN;
+1	one	1.5	{a,b}
+2	tab\there	-2	{}
+3	\N	\N	\N
+4	back\\slash	0.000	{"c d",NULL}
+5	new\nline	7	{e}
+6	six	6	{f}
+7	seven	7e3	{g}
+8	eight	8	{h}
+\.
+
+COPY ref FROM STDIN WITH (format csv);
+1,"a,b",1
+2,,2.5
+3,"quote""d",-3
+\.
+
+SELECT to_json(name) AS name, amount, tags, key FROM replicated ORDER BY key;
+SELECT key, name, amount FROM ref ORDER BY key;
+
+-- every placement of a shard got the same rows
+SELECT shardid, count(*) AS placements, count(DISTINCT result) AS distinct_results
+FROM run_command_on_placements('replicated',
+	$$SELECT count(*) || ':' || coalesce(string_agg(t::text, ',' ORDER BY key), '') FROM %s t$$)
+GROUP BY shardid ORDER BY shardid;
+
+SELECT count(*) > 1 AS multiple_placements, count(DISTINCT result) AS distinct_results
+FROM run_command_on_placements('ref',
+	$$SELECT string_agg(t::text, ',' ORDER BY key) FROM %s t$$);
+
+-- COPY in a transaction block
+BEGIN;
+COPY replicated FROM STDIN WITH (format csv);
+9,nine,9,{i}
+10,ten,10,{j}
+\.
+COPY ref FROM STDIN WITH (format csv);
+4,four,4
+\.
+COMMIT;
+
+SELECT count(*), sum(amount) FROM replicated;
+SELECT count(*), sum(amount) FROM ref;
+
+SELECT shardid, count(*) AS placements, count(DISTINCT result) AS distinct_results
+FROM run_command_on_placements('replicated',
+	$$SELECT count(*) || ':' || coalesce(string_agg(t::text, ',' ORDER BY key), '') FROM %s t$$)
+GROUP BY shardid ORDER BY shardid;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA copy_placement_serialization CASCADE;
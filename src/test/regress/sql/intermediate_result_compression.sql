@@ -0,0 +1,76 @@
+--
+-- INTERMEDIATE_RESULT_COMPRESSION
+--
+-- Tests for compressing intermediate result files and transfers
+--
+CREATE SCHEMA intermediate_result_compression;
+SET search_path TO intermediate_result_compression;
+
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 801016000;
+
+CREATE TABLE dist (a int, b text);
+SELECT create_distributed_table('dist','a');
+INSERT INTO dist SELECT i, repeat('x', i % 1000) FROM generate_series(1,10000) i;
+
+CREATE TABLE other (a int, b int);
+SELECT create_distributed_table('other','a');
+INSERT INTO other SELECT i, i % 50 FROM generate_series(1,1000) i;
+
+-- use the last compression method that this build supports
+SELECT enumvals[array_length(enumvals, 1)] AS compression_method
+FROM pg_settings WHERE name = 'citus.intermediate_result_compression' \gset
+SET citus.intermediate_result_compression TO :'compression_method';
+
+-- CTE that is broadcast to the workers, the result spans multiple chunks
+WITH cte AS MATERIALIZED (SELECT a, b FROM dist)
+SELECT count(*), sum(length(cte.b)) FROM cte JOIN other USING (a);
+
+-- CTE that is only written to a local file
+WITH cte AS MATERIALIZED (SELECT a, b FROM dist)
+SELECT count(*), sum(length(b)) FROM cte;
+
+-- empty results
+WITH cte AS MATERIALIZED (SELECT a, b FROM dist WHERE a < 0)
+SELECT count(*) FROM cte JOIN other USING (a);
+
+-- compressed files are read regardless of the setting
+BEGIN;
+SELECT create_intermediate_result('compressed', 'SELECT a, b FROM dist');
+SET LOCAL citus.intermediate_result_compression TO none;
+SELECT count(*), sum(length(b)) FROM read_intermediate_result('compressed', 'binary') AS res (a int, b text);
+END;
+
+-- repartition joins compress the files on the workers
+SET citus.enable_repartition_joins TO on;
+BEGIN;
+SET LOCAL citus.propagate_set_commands TO 'local';
+SET LOCAL citus.intermediate_result_compression TO :'compression_method';
+SELECT count(*) FROM dist d JOIN other o ON (d.a = o.b);
+END;
+
+-- many partitions share the memory for buffering and compressing the
+-- partitions, each partition is written in several chunks
+SELECT array_agg((-2147483648 + i * 4194304)::text ORDER BY i) AS min_values,
+       array_agg((-2147483648 + (i + 1) * 4194304 - 1)::text ORDER BY i) AS max_values
+FROM generate_series(0::bigint, 1023) i \gset
+BEGIN;
+SELECT count(*), sum(rows_written)
+FROM worker_partition_query_result('many_partitions',
+                                   'SELECT i, repeat(''x'', 1000) FROM generate_series(1, 30000) i',
+                                   0, 'hash', :'min_values'::text[], :'max_values'::text[], true);
+SELECT count(*), sum(length(b)),
+       bool_and(hashint4(a) BETWEEN -2147483648 + p * 4194304 AND -2147483648 + (p + 1) * 4194304 - 1)
+FROM generate_series(0::bigint, 1023) p,
+     read_intermediate_result('many_partitions_' || p, 'binary') AS res (a int, b text);
+END;
+
+-- the same queries without compression give the same results
+SET citus.intermediate_result_compression TO none;
+WITH cte AS MATERIALIZED (SELECT a, b FROM dist)
+SELECT count(*), sum(length(cte.b)) FROM cte JOIN other USING (a);
+SELECT count(*) FROM dist d JOIN other o ON (d.a = o.b);
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA intermediate_result_compression CASCADE;
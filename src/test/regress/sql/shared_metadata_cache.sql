@@ -0,0 +1,54 @@
+--
+-- SHARED_METADATA_CACHE
+--
+-- Tests for sharing shard metadata between backends
+--
+CREATE SCHEMA shared_metadata_cache;
+SET search_path TO shared_metadata_cache;
+SET citus.next_shard_id TO 801015000;
+SET citus.shard_replication_factor TO 1;
+
+ALTER SYSTEM SET citus.enable_shared_metadata_cache TO on;
+SELECT pg_reload_conf();
+SELECT pg_sleep(0.1);
+
+CREATE TABLE hashed (a int, b int);
+SELECT create_distributed_table('hashed', 'a', shard_count => 4);
+INSERT INTO hashed SELECT i, i FROM generate_series(1, 100) i;
+
+CREATE TABLE ref (a int);
+SELECT create_reference_table('ref');
+INSERT INTO ref VALUES (1), (2);
+
+-- the first backend publishes the shard lists
+SELECT count(*) FROM hashed;
+SELECT count(*) FROM ref;
+
+-- new backends use the published shard lists
+\c - - - :master_port
+SET search_path TO shared_metadata_cache;
+SELECT count(*) FROM hashed;
+SELECT b FROM hashed WHERE a = 5;
+SELECT count(*) FROM ref;
+SELECT get_shard_id_for_distribution_column('hashed', 5) IN
+  (SELECT shardid FROM pg_dist_shard WHERE logicalrelid = 'hashed'::regclass);
+
+-- changes to the shards are seen by new backends
+SELECT 1 FROM isolate_tenant_to_new_shard('hashed', 5, shard_transfer_mode => 'block_writes');
+
+\c - - - :master_port
+SET search_path TO shared_metadata_cache;
+SELECT count(*) FROM hashed;
+SELECT b FROM hashed WHERE a = 5;
+SELECT get_shard_id_for_distribution_column('hashed', 5) IN
+  (SELECT shardid FROM pg_dist_shard WHERE logicalrelid = 'hashed'::regclass);
+
+\c - - - :master_port
+SET search_path TO shared_metadata_cache;
+SELECT count(*) FROM hashed;
+
+ALTER SYSTEM RESET citus.enable_shared_metadata_cache;
+SELECT pg_reload_conf();
+
+SET client_min_messages TO error;
+DROP SCHEMA shared_metadata_cache CASCADE;
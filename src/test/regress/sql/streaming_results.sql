@@ -0,0 +1,42 @@
+--
+-- STREAMING_RESULTS
+--
+-- Tests for returning rows of distributed queries while they are received
+--
+CREATE SCHEMA streaming_results;
+SET search_path TO streaming_results;
+
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 801014000;
+
+CREATE TABLE big (a int, b text);
+SELECT create_distributed_table('big','a');
+INSERT INTO big SELECT i, repeat('x', 100) FROM generate_series(1,10000) i;
+
+SET citus.enable_streaming_results TO on;
+
+SELECT count(*), sum(length(b)) FROM big;
+
+-- stop consuming rows before all of them are received
+SELECT 1 FROM big LIMIT 3;
+SELECT a FROM big WHERE a <= 5 ORDER BY a;
+
+-- connections are usable after a LIMIT
+SELECT count(*) FROM big WHERE a > 5000;
+
+-- results are materialized within transaction blocks and for cursors
+BEGIN;
+SELECT count(*) FROM big;
+DECLARE c CURSOR FOR SELECT a FROM big WHERE a <= 3 ORDER BY a;
+FETCH 2 FROM c;
+CLOSE c;
+COMMIT;
+
+-- the same queries without streaming give the same results
+SET citus.enable_streaming_results TO off;
+SELECT count(*), sum(length(b)) FROM big;
+SELECT a FROM big WHERE a <= 5 ORDER BY a;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA streaming_results CASCADE;
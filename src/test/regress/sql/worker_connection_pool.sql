@@ -0,0 +1,142 @@
+--
+-- Test the worker connection pooler, which runs the read-only queries of all
+-- sessions of a database on a shared set of connections.
+--
+CREATE SCHEMA worker_connection_pool;
+SET search_path TO worker_connection_pool;
+SET citus.next_shard_id TO 1790000;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+
+-- wait_for_worker_connection_pooler waits until a pooler other than the given
+-- one runs for the current database, or until none runs
+CREATE FUNCTION wait_for_worker_connection_pooler(running bool, previous_pid int DEFAULT 0)
+RETURNS bool AS $$
+    DECLARE
+        pooler_running bool;
+    BEGIN
+        FOR i IN 1 .. 300 LOOP
+            PERFORM pg_stat_clear_snapshot();
+
+            SELECT count(*) > 0 INTO pooler_running FROM pg_stat_activity
+            WHERE datname = current_database() AND pid <> previous_pid
+            AND application_name = 'Citus Worker Connection Pooler';
+
+            IF pooler_running = running THEN
+                RETURN true;
+            END IF;
+
+            PERFORM pg_sleep(0.1);
+        END LOOP;
+
+        RETURN false;
+    END;
+$$ LANGUAGE PLPGSQL;
+
+-- pooled_connection_counts returns the number of connections that the given
+-- user has to each worker node, other than those of the current session
+CREATE FUNCTION pooled_connection_counts(user_name text)
+RETURNS SETOF text AS $$
+    SELECT result FROM run_command_on_workers(format(
+        'SELECT count(*) FROM pg_stat_activity WHERE usename = %L AND application_name <> %L',
+        user_name, 'citus_internal gpid=' || citus_backend_gpid()))
+    ORDER BY nodeport;
+$$ LANGUAGE SQL;
+
+-- sleeping_query_counts returns the number of queries that sleep on each
+-- worker node
+CREATE FUNCTION sleeping_query_counts(user_name text)
+RETURNS SETOF text AS $$
+    SELECT result FROM run_command_on_workers(format(
+        'SELECT count(*) FROM pg_stat_activity WHERE usename = %L AND state = %L '
+        'AND query LIKE %L AND pid <> pg_backend_pid()',
+        user_name, 'active', '%pg_sleep%'))
+    ORDER BY nodeport;
+$$ LANGUAGE SQL;
+
+-- wait_for_sleeping_queries_cancelled waits until no worker node runs a
+-- query that sleeps
+CREATE FUNCTION wait_for_sleeping_queries_cancelled(user_name text)
+RETURNS bool AS $$
+    BEGIN
+        FOR i IN 1 .. 100 LOOP
+            IF (SELECT bool_and(c = '0') FROM sleeping_query_counts(user_name) c) THEN
+                RETURN true;
+            END IF;
+
+            PERFORM pg_sleep(0.1);
+        END LOOP;
+
+        RETURN false;
+    END;
+$$ LANGUAGE PLPGSQL;
+
+CREATE TABLE pooled (a int, b text);
+SELECT create_distributed_table('pooled', 'a');
+INSERT INTO pooled SELECT i, 'value' || i FROM generate_series(1, 1000) i;
+
+SET client_min_messages TO ERROR;
+CREATE USER worker_connection_pool_user;
+SELECT 1 FROM run_command_on_workers('CREATE USER worker_connection_pool_user');
+RESET client_min_messages;
+
+GRANT USAGE ON SCHEMA worker_connection_pool TO worker_connection_pool_user;
+GRANT SELECT ON pooled TO worker_connection_pool_user;
+
+ALTER SYSTEM SET citus.worker_connection_pool_size TO 1;
+SELECT pg_reload_conf();
+SELECT wait_for_worker_connection_pooler(running => true);
+
+\c - worker_connection_pool_user - :master_port
+SET search_path TO worker_connection_pool;
+
+-- multi-shard queries run via the pooler, which opens 1 connection per node
+SELECT count(*), sum(a), max(b) FROM pooled;
+SELECT * FROM pooled_connection_counts('worker_connection_pool_user');
+
+-- router queries with parameters
+PREPARE pooled_router(int) AS SELECT b FROM pooled WHERE a = $1;
+EXECUTE pooled_router(5);
+EXECUTE pooled_router(500);
+
+-- errors on the worker nodes are thrown by the session
+SELECT count(*) FROM pooled WHERE 1 / (a - 500) > 0;
+
+-- the pooled connections are still usable after the error
+SELECT count(*) FROM pooled WHERE a > 500;
+
+-- when the query is cancelled, the pooler cancels the queries on the workers
+SET statement_timeout TO '1s';
+SELECT count(*) FROM pooled WHERE pg_sleep(0.1) IS NOT NULL;
+RESET statement_timeout;
+
+SELECT wait_for_sleeping_queries_cancelled('worker_connection_pool_user');
+SELECT count(*) FROM pooled WHERE a <= 500;
+
+-- the maintenance daemon restarts the pooler once it exits
+\c - postgres - :master_port
+SET search_path TO worker_connection_pool;
+
+SELECT pid AS pooler_pid FROM pg_stat_activity
+WHERE datname = current_database() AND application_name = 'Citus Worker Connection Pooler' \gset
+SELECT pg_terminate_backend(:pooler_pid);
+SELECT wait_for_worker_connection_pooler(running => true, previous_pid => :pooler_pid);
+
+\c - worker_connection_pool_user - :master_port
+SET search_path TO worker_connection_pool;
+
+SELECT count(*), sum(a), max(b) FROM pooled;
+
+-- the pooler exits once the pool is disabled, and closes its connections
+\c - postgres - :master_port
+SET search_path TO worker_connection_pool;
+
+ALTER SYSTEM RESET citus.worker_connection_pool_size;
+SELECT pg_reload_conf();
+SELECT wait_for_worker_connection_pooler(running => false);
+
+SELECT count(*), sum(a), max(b) FROM pooled;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA worker_connection_pool CASCADE;
+DROP USER worker_connection_pool_user;
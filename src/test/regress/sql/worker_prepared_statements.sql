@@ -0,0 +1,56 @@
+--
+-- WORKER_PREPARED_STATEMENTS
+--
+-- Tests for preparing parameterized shard queries on the workers
+--
+CREATE SCHEMA worker_prepared_statements;
+SET search_path TO worker_prepared_statements;
+
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 801013000;
+
+CREATE TABLE kv (key int, value text);
+SELECT create_distributed_table('kv','key');
+INSERT INTO kv SELECT i, 'value-' || i FROM generate_series(1,9) i;
+
+SET citus.enable_worker_prepared_statements TO on;
+
+-- make sure we prune shards during execution
+SET plan_cache_mode TO force_generic_plan;
+
+PREPARE lookup(int) AS SELECT value FROM kv WHERE key = $1;
+EXECUTE lookup(1);
+EXECUTE lookup(2);
+EXECUTE lookup(1);
+EXECUTE lookup(3);
+
+-- statements are reused within a transaction block
+BEGIN;
+EXECUTE lookup(1);
+EXECUTE lookup(1);
+UPDATE kv SET value = 'updated-1' WHERE key = 1;
+EXECUTE lookup(1);
+ROLLBACK;
+EXECUTE lookup(1);
+
+-- DDL invalidates the statements on the workers
+ALTER TABLE kv ALTER COLUMN value TYPE varchar(20);
+EXECUTE lookup(1);
+EXECUTE lookup(2);
+
+-- statements are deallocated when the limit is reached
+SET citus.max_worker_prepared_statements_per_connection TO 1;
+EXECUTE lookup(1);
+EXECUTE lookup(2);
+EXECUTE lookup(3);
+EXECUTE lookup(1);
+RESET citus.max_worker_prepared_statements_per_connection;
+
+-- disabling the cache in the middle of a session works as before
+SET citus.enable_worker_prepared_statements TO off;
+EXECUTE lookup(2);
+
+DEALLOCATE lookup;
+SET client_min_messages TO WARNING;
+DROP SCHEMA worker_prepared_statements CASCADE;